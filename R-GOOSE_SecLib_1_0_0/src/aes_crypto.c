@@ -1,7 +1,9 @@
 #include "aes_crypto.h"
+#include "r_goose_alloc.h"
 
 
 
+#if R_GOOSE_WITH_AES_256_GCM
 int aes_256_gcm_encrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size, int iv_size, uint8_t** dest){
 
 	EVP_CIPHER_CTX *ctx;
@@ -10,11 +12,13 @@ int aes_256_gcm_encrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size,
 
 	int ciphertext_len;
 
-	int block_size = EVP_CIPHER_block_size(EVP_aes_256_gcm());
-
-	uint8_t* ciphertext = (uint8_t*)malloc(sizeof(char)*(data_size+block_size));
-
-    *dest = (uint8_t*)malloc(sizeof(char)*(data_size+block_size));
+	/* GCM is a stream mode - ciphertext has the same length as the plaintext */
+	if(*dest == NULL){
+		*dest = (uint8_t*)r_goose_malloc(sizeof(char)*(data_size+1));
+		if(*dest == NULL){
+			return -1;
+		}
+	}
 
 
 	/* Create and initialise the context */
@@ -39,7 +43,7 @@ int aes_256_gcm_encrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size,
      * Provide the message to be encrypted, and obtain the encrypted output.
      * EVP_EncryptUpdate can be called multiple times if necessary
      */
-    if(1 != EVP_EncryptUpdate(ctx, ciphertext, &len, data, data_size))
+    if(1 != EVP_EncryptUpdate(ctx, *dest, &len, data, data_size))
         return -1;
     ciphertext_len = len;
 
@@ -47,21 +51,18 @@ int aes_256_gcm_encrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size,
      * Finalise the encryption. Normally ciphertext bytes may be written at
      * this stage, but this does not occur in GCM mode
      */
-    if(1 != EVP_EncryptFinal_ex(ctx, ciphertext + len, &len))
+    if(1 != EVP_EncryptFinal_ex(ctx, *dest + len, &len))
         return -1;
     ciphertext_len += len;
 
-
-    memcpy(*dest, ciphertext, ciphertext_len);
-
-    free(ciphertext);
-
     /* Clean up */
     EVP_CIPHER_CTX_free(ctx);
 
     return ciphertext_len;
 }
+#endif
 
+#if R_GOOSE_WITH_AES_128_GCM
 int aes_128_gcm_encrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size, int iv_size, uint8_t** dest){
     EVP_CIPHER_CTX *ctx;
 
@@ -69,11 +70,13 @@ int aes_128_gcm_encrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size,
 
     int ciphertext_len;
 
-    int block_size = EVP_CIPHER_block_size(EVP_aes_128_gcm());
-
-    uint8_t* ciphertext = (uint8_t*)malloc(sizeof(char)*(data_size+block_size));
-
-    *dest = (uint8_t*)malloc(sizeof(char)*(data_size+block_size));
+    /* GCM is a stream mode - ciphertext has the same length as the plaintext */
+    if(*dest == NULL){
+        *dest = (uint8_t*)r_goose_malloc(sizeof(char)*(data_size+1));
+        if(*dest == NULL){
+            return -1;
+        }
+    }
 
     /* Create and initialise the context */
     if(!(ctx = EVP_CIPHER_CTX_new()))
@@ -97,7 +100,7 @@ int aes_128_gcm_encrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size,
      * Provide the message to be encrypted, and obtain the encrypted output.
      * EVP_EncryptUpdate can be called multiple times if necessary
      */
-    if(1 != EVP_EncryptUpdate(ctx, ciphertext, &len, data, data_size))
+    if(1 != EVP_EncryptUpdate(ctx, *dest, &len, data, data_size))
         return -1;
     ciphertext_len = len;
 
@@ -105,31 +108,31 @@ int aes_128_gcm_encrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size,
      * Finalise the encryption. Normally ciphertext bytes may be written at
      * this stage, but this does not occur in GCM mode
      */
-    if(1 != EVP_EncryptFinal_ex(ctx, ciphertext + len, &len))
+    if(1 != EVP_EncryptFinal_ex(ctx, *dest + len, &len))
         return -1;
     ciphertext_len += len;
 
-    memcpy(*dest, ciphertext, ciphertext_len);
-
-    free(ciphertext);
 
     /* Clean up */
     EVP_CIPHER_CTX_free(ctx);
 
     return ciphertext_len;
 }
+#endif
 
+#if R_GOOSE_WITH_AES_256_GCM
 int aes_256_gcm_decrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size, int iv_size, uint8_t** dest){
 
     EVP_CIPHER_CTX *ctx;
     int len;
     int plaintext_len;
 
-    int block_size = EVP_CIPHER_block_size(EVP_aes_256_gcm());
-    uint8_t* plaintext = (uint8_t*)malloc(sizeof(char)*(data_size+block_size));
-
-    *dest = (uint8_t*)malloc(sizeof(char)*(data_size+block_size));
-
+    if(*dest == NULL){
+        *dest = (uint8_t*)r_goose_malloc(sizeof(char)*(data_size+1));
+        if(*dest == NULL){
+            return -1;
+        }
+    }
 
     /* Create and initialise the context */
     if(!(ctx = EVP_CIPHER_CTX_new()))
@@ -151,7 +154,7 @@ int aes_256_gcm_decrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size,
      * Provide the message to be decrypted, and obtain the plaintext output.
      * EVP_DecryptUpdate can be called multiple times if necessary
      */
-    if(!EVP_DecryptUpdate(ctx, plaintext, &len, data, data_size))
+    if(!EVP_DecryptUpdate(ctx, *dest, &len, data, data_size))
         return -1;
     plaintext_len = len;
 
@@ -159,32 +162,31 @@ int aes_256_gcm_decrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size,
      * Finalise the decryption. A positive return value indicates success,
      * anything else is a failure - the plaintext is not trustworthy.
      */
-    EVP_DecryptFinal_ex(ctx, plaintext + len, &len);
+    EVP_DecryptFinal_ex(ctx, *dest + len, &len);
 
 
     /* Clean up */
     EVP_CIPHER_CTX_free(ctx);
 
-    memcpy(*dest, plaintext, plaintext_len+len);
-
-    free(plaintext);
-
     plaintext_len += len;
 
     return plaintext_len;
 }
+#endif
 
+#if R_GOOSE_WITH_AES_128_GCM
 int aes_128_gcm_decrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size, int iv_size, uint8_t** dest){
 
     EVP_CIPHER_CTX *ctx;
     int len;
     int plaintext_len;
 
-    int block_size = EVP_CIPHER_block_size(EVP_aes_128_gcm());
-    uint8_t* plaintext = (uint8_t*)malloc(sizeof(char)*(data_size+block_size));
-
-    *dest = (uint8_t*)malloc(sizeof(char)*(data_size+block_size));
-
+    if(*dest == NULL){
+        *dest = (uint8_t*)r_goose_malloc(sizeof(char)*(data_size+1));
+        if(*dest == NULL){
+            return -1;
+        }
+    }
 
     /* Create and initialise the context */
     if(!(ctx = EVP_CIPHER_CTX_new()))
@@ -206,7 +208,7 @@ int aes_128_gcm_decrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size,
      * Provide the message to be decrypted, and obtain the plaintext output.
      * EVP_DecryptUpdate can be called multiple times if necessary
      */
-    if(!EVP_DecryptUpdate(ctx, plaintext, &len, data, data_size))
+    if(!EVP_DecryptUpdate(ctx, *dest, &len, data, data_size))
         return -1;
     plaintext_len = len;
 
@@ -214,19 +216,17 @@ int aes_128_gcm_decrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size,
      * Finalise the decryption. A positive return value indicates success,
      * anything else is a failure - the plaintext is not trustworthy.
      */
-    EVP_DecryptFinal_ex(ctx, plaintext + len, &len);
+    EVP_DecryptFinal_ex(ctx, *dest + len, &len);
 
 
     /* Clean up */
     EVP_CIPHER_CTX_free(ctx);
 
-    memcpy(*dest, plaintext, plaintext_len+len);
-
     plaintext_len += len;
 
-    free(plaintext);
 
 
     return plaintext_len;
 }
+#endif
 
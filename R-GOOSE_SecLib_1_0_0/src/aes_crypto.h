@@ -14,6 +14,7 @@
 #include <string.h>
 
 #include "aux_funcs.h"
+#include "r_goose_config.h"
 
 //openssl headers
 #include <openssl/evp.h>
@@ -51,11 +52,12 @@
  * @param data_size Variable (<tt>size_t</tt>) that hold the size in bytes of data. 
  * @param iv_size Variable (<tt>size_t</tt>) that hold the size in bytes of IV. 
  * @param dest key Pointer (<tt>uint8_t**</tt>) pointing to the destiny memory address where encrypted data should be stored
- * @return An integer containing the length of the encrypted data
+ * @return An integer containing the length of the encrypted data, or -1 if an error occurred
  * @warning @p dest should be create as a data type capable of storing the encrypted data (ex. <tt>uint8_t*</tt>). However, it's 
  * memory address must be passed to the function and not the pointer itself (<b><tt>&dest</tt></b>)
  * @note It is not required to manually allocate/reserve memory for @p dest, this functions allocates the necessary memory
- * to store the encrypted data. 
+ * to store the encrypted data if @p *dest is NULL. A preallocated @p *dest (at least @p data_size bytes) is written directly,
+ * which may be @p data itself (in place operation).
  */
 int aes_256_gcm_encrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size, int iv_size, uint8_t** dest);
 
@@ -91,11 +93,12 @@ int aes_256_gcm_encrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size,
  * @param data_size Variable (<tt>size_t</tt>) that hold the size in bytes of data. 
  * @param iv_size Variable (<tt>size_t</tt>) that hold the size in bytes of IV. 
  * @param dest key Pointer (<tt>uint8_t**</tt>) pointing to the destiny memory address where encrypted data should be stored
- * @return An integer containing the length of the encrypted data
+ * @return An integer containing the length of the encrypted data, or -1 if an error occurred
  * @warning @p dest should be create as a data type capable of storing the encrypted data (ex. <tt>uint8_t*</tt>). However, it's 
  * memory address must be passed to the function and not the pointer itself (<b><tt>&dest</tt></b>)
  * @note It is not required to manually allocate/reserve memory for @p dest, this functions allocates the necessary memory
- * to store the encrypted data. 
+ * to store the encrypted data if @p *dest is NULL. A preallocated @p *dest (at least @p data_size bytes) is written directly,
+ * which may be @p data itself (in place operation).
  */
 int aes_128_gcm_encrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size, int iv_size, uint8_t** dest);
 
@@ -131,11 +134,12 @@ int aes_128_gcm_encrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size,
  * @param data_size Variable (<tt>size_t</tt>) that hold the size in bytes of data. 
  * @param iv_size Variable (<tt>size_t</tt>) that hold the size in bytes of IV. 
  * @param dest key Pointer (<tt>uint8_t**</tt>) pointing to the destiny memory address where decrypted data should be stored
- * @return An integer containing the length of the decrypted data
+ * @return An integer containing the length of the decrypted data, or -1 if an error occurred
  * @warning @p dest should be create as a data type capable of storing the decrypted data (ex. <tt>uint8_t*</tt>). However, it's 
  * memory address must be passed to the function and not the pointer itself (<b><tt>&dest</tt></b>)
  * @note It is not required to manually allocate/reserve memory for @p dest, this functions allocates the necessary memory
- * to store the decrypted data. 
+ * to store the decrypted data if @p *dest is NULL. A preallocated @p *dest (at least @p data_size bytes) is written directly,
+ * which may be @p data itself (in place operation).
  */
 int aes_256_gcm_decrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size, int iv_size, uint8_t** dest);
 
@@ -171,11 +175,12 @@ int aes_256_gcm_decrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size,
  * @param data_size Variable (<tt>size_t</tt>) that hold the size in bytes of data. 
  * @param iv_size Variable (<tt>size_t</tt>) that hold the size in bytes of IV. 
  * @param dest key Pointer (<tt>uint8_t**</tt>) pointing to the destiny memory address where decrypted data should be stored
- * @return An integer containing the length of the decrypted data
+ * @return An integer containing the length of the decrypted data, or -1 if an error occurred
  * @warning @p dest should be create as a data type capable of storing the decrypted data (ex. <tt>uint8_t*</tt>). However, it's 
  * memory address must be passed to the function and not the pointer itself (<b><tt>&dest</tt></b>)
  * @note It is not required to manually allocate/reserve memory for @p dest, this functions allocates the necessary memory
- * to store the decrypted data. 
+ * to store the decrypted data if @p *dest is NULL. A preallocated @p *dest (at least @p data_size bytes) is written directly,
+ * which may be @p data itself (in place operation).
  */
 int aes_128_gcm_decrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size, int iv_size, uint8_t** dest);
 
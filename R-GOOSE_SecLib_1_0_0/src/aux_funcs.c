@@ -1,4 +1,5 @@
 #include "aux_funcs.h"
+#include "r_goose_alloc.h"
 
 int decode_2bytesToInt(uint8_t* buffer, int index){
     return((buffer[index]<<8) + (buffer[index+1]));
@@ -22,7 +23,7 @@ void encodeInt4Bytes(uint8_t* buffer, uint32_t value, int index){
 
 uint8_t* hexStringToBytes(char hex[], size_t len){
     char* pos = hex;
-    uint8_t* bytes = (uint8_t*)malloc(sizeof(char)*(len/2));
+    uint8_t* bytes = (uint8_t*)r_goose_malloc(sizeof(char)*(len/2));
 
     /* verificação len ser impar */
 
@@ -0,0 +1,559 @@
+/*
+	File defining native keyed BLAKE2 MAC functions (RFC 7693)
+
+	blake2X_80 functions receive pointer to original data
+
+	Keyed mode:
+		The key is padded with zeros to a full block and processed as the first
+		message block. The digest length (10 bytes for the *_80 variants) is part
+		of the parameter block, so the tag is not a truncation of the full digest.
+
+	Compression functions:
+		- Portable C, always available
+		- BLAKE2b: AVX2 (4x64-bit rows in one __m256i)
+		- BLAKE2s: SSE4.1 (4x32-bit rows in one __m128i)
+		The SIMD variant is picked once per state, in blake2X_init_key().
+*/
+
+#include "blake2_functions.h"
+#include "r_goose_alloc.h"
+
+#include <openssl/crypto.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BLAKE2_X86_SIMD
+#include <immintrin.h>
+#endif
+
+
+#if R_GOOSE_WITH_BLAKE2B
+static const uint64_t blake2b_IV[8] = {
+	0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+	0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+#endif
+
+#if R_GOOSE_WITH_BLAKE2S
+static const uint32_t blake2s_IV[8] = {
+	0x6a09e667UL, 0xbb67ae85UL, 0x3c6ef372UL, 0xa54ff53aUL,
+	0x510e527fUL, 0x9b05688cUL, 0x1f83d9abUL, 0x5be0cd19UL
+};
+#endif
+
+#if R_GOOSE_WITH_BLAKE2B || R_GOOSE_WITH_BLAKE2S
+static const uint8_t blake2_sigma[10][16] = {
+	{  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+	{ 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+	{ 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+	{  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+	{  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+	{  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+	{ 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+	{ 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+	{  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+	{ 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 }
+};
+#endif
+
+
+static inline uint64_t load64(const uint8_t* p){
+	return ((uint64_t)p[0]      ) | ((uint64_t)p[1] <<  8) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+	       ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+static inline uint32_t load32(const uint8_t* p){
+	return ((uint32_t)p[0]) | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t rotr64(uint64_t x, int n){
+	return (x >> n) | (x << (64 - n));
+}
+
+static inline uint32_t rotr32(uint32_t x, int n){
+	return (x >> n) | (x << (32 - n));
+}
+
+
+#if R_GOOSE_WITH_BLAKE2B
+// BLAKE2b - Portable compression function
+
+#define G64(r,i,a,b,c,d)								\
+	do {												\
+		a = a + b + m[blake2_sigma[r][2*i+0]];			\
+		d = rotr64(d ^ a, 32);							\
+		c = c + d;										\
+		b = rotr64(b ^ c, 24);							\
+		a = a + b + m[blake2_sigma[r][2*i+1]];			\
+		d = rotr64(d ^ a, 16);							\
+		c = c + d;										\
+		b = rotr64(b ^ c, 63);							\
+	} while(0)
+
+static void
+blake2b_compress_portable(blake2b_state* S, const uint8_t* block){
+	uint64_t m[16], v[16];
+	int i, r;
+
+	for(i = 0; i < 16; i++){
+		m[i] = load64(block + i*8);
+	}
+
+	for(i = 0; i < 8; i++){
+		v[i] = S->h[i];
+		v[i+8] = blake2b_IV[i];
+	}
+
+	v[12] ^= S->t[0];
+	v[13] ^= S->t[1];
+	v[14] ^= S->f[0];
+	v[15] ^= S->f[1];
+
+	for(r = 0; r < 12; r++){
+		G64(r%10, 0, v[0], v[4], v[ 8], v[12]);
+		G64(r%10, 1, v[1], v[5], v[ 9], v[13]);
+		G64(r%10, 2, v[2], v[6], v[10], v[14]);
+		G64(r%10, 3, v[3], v[7], v[11], v[15]);
+		G64(r%10, 4, v[0], v[5], v[10], v[15]);
+		G64(r%10, 5, v[1], v[6], v[11], v[12]);
+		G64(r%10, 6, v[2], v[7], v[ 8], v[13]);
+		G64(r%10, 7, v[3], v[4], v[ 9], v[14]);
+	}
+
+	for(i = 0; i < 8; i++){
+		S->h[i] ^= v[i] ^ v[i+8];
+	}
+}
+#endif
+
+
+#if R_GOOSE_WITH_BLAKE2S
+// BLAKE2s - Portable compression function
+
+#define G32(r,i,a,b,c,d)								\
+	do {												\
+		a = a + b + m[blake2_sigma[r][2*i+0]];			\
+		d = rotr32(d ^ a, 16);							\
+		c = c + d;										\
+		b = rotr32(b ^ c, 12);							\
+		a = a + b + m[blake2_sigma[r][2*i+1]];			\
+		d = rotr32(d ^ a, 8);							\
+		c = c + d;										\
+		b = rotr32(b ^ c, 7);							\
+	} while(0)
+
+static void
+blake2s_compress_portable(blake2s_state* S, const uint8_t* block){
+	uint32_t m[16], v[16];
+	int i, r;
+
+	for(i = 0; i < 16; i++){
+		m[i] = load32(block + i*4);
+	}
+
+	for(i = 0; i < 8; i++){
+		v[i] = S->h[i];
+		v[i+8] = blake2s_IV[i];
+	}
+
+	v[12] ^= S->t[0];
+	v[13] ^= S->t[1];
+	v[14] ^= S->f[0];
+	v[15] ^= S->f[1];
+
+	for(r = 0; r < 10; r++){
+		G32(r, 0, v[0], v[4], v[ 8], v[12]);
+		G32(r, 1, v[1], v[5], v[ 9], v[13]);
+		G32(r, 2, v[2], v[6], v[10], v[14]);
+		G32(r, 3, v[3], v[7], v[11], v[15]);
+		G32(r, 4, v[0], v[5], v[10], v[15]);
+		G32(r, 5, v[1], v[6], v[11], v[12]);
+		G32(r, 6, v[2], v[7], v[ 8], v[13]);
+		G32(r, 7, v[3], v[4], v[ 9], v[14]);
+	}
+
+	for(i = 0; i < 8; i++){
+		S->h[i] ^= v[i] ^ v[i+8];
+	}
+}
+#endif
+
+
+#ifdef BLAKE2_X86_SIMD
+
+#if R_GOOSE_WITH_BLAKE2B
+/* 	BLAKE2b - AVX2 compression function
+
+	Each row of the 4x4 state matrix (a, b, c, d) lives in one 256-bit register, so one
+	G application processes the 4 columns (or the 4 diagonals) at once. Diagonalization
+	is a lane rotation of rows b, c and d.
+*/
+
+#define AVX2_ROT32(x)		_mm256_shuffle_epi32((x), _MM_SHUFFLE(2,3,0,1))
+#define AVX2_ROT24(x)		_mm256_shuffle_epi8((x), r24)
+#define AVX2_ROT16(x)		_mm256_shuffle_epi8((x), r16)
+#define AVX2_ROT63(x)		_mm256_xor_si256(_mm256_srli_epi64((x), 63), _mm256_add_epi64((x), (x)))
+
+#define AVX2_G(a,b,c,d,m0,m1)											\
+	do {																\
+		a = _mm256_add_epi64(_mm256_add_epi64(a, b), m0);				\
+		d = AVX2_ROT32(_mm256_xor_si256(d, a));							\
+		c = _mm256_add_epi64(c, d);										\
+		b = AVX2_ROT24(_mm256_xor_si256(b, c));							\
+		a = _mm256_add_epi64(_mm256_add_epi64(a, b), m1);				\
+		d = AVX2_ROT16(_mm256_xor_si256(d, a));							\
+		c = _mm256_add_epi64(c, d);										\
+		b = AVX2_ROT63(_mm256_xor_si256(b, c));							\
+	} while(0)
+
+#define AVX2_MSG(s,i0,i1,i2,i3)	\
+	_mm256_set_epi64x((long long)m[s[i3]], (long long)m[s[i2]], (long long)m[s[i1]], (long long)m[s[i0]])
+
+__attribute__((target("avx2")))
+static void
+blake2b_compress_avx2(blake2b_state* S, const uint8_t* block){
+	const __m256i r16 = _mm256_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9,
+										 2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9);
+	const __m256i r24 = _mm256_setr_epi8(3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10,
+										 3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10);
+	uint64_t m[16];
+	int i, r;
+
+	for(i = 0; i < 16; i++){
+		m[i] = load64(block + i*8);
+	}
+
+	__m256i a = _mm256_loadu_si256((const __m256i*)&S->h[0]);
+	__m256i b = _mm256_loadu_si256((const __m256i*)&S->h[4]);
+	__m256i c = _mm256_loadu_si256((const __m256i*)&blake2b_IV[0]);
+	__m256i d = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)&blake2b_IV[4]),
+								 _mm256_set_epi64x((long long)S->f[1], (long long)S->f[0], (long long)S->t[1], (long long)S->t[0]));
+
+	const __m256i h0 = a, h1 = b;
+
+	for(r = 0; r < 12; r++){
+		const uint8_t* s = blake2_sigma[r%10];
+
+		// Columns
+		AVX2_G(a, b, c, d, AVX2_MSG(s, 0, 2, 4, 6), AVX2_MSG(s, 1, 3, 5, 7));
+
+		// Diagonalize
+		b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(0,3,2,1));
+		c = _mm256_permute4x64_epi64(c, _MM_SHUFFLE(1,0,3,2));
+		d = _mm256_permute4x64_epi64(d, _MM_SHUFFLE(2,1,0,3));
+
+		// Diagonals
+		AVX2_G(a, b, c, d, AVX2_MSG(s, 8, 10, 12, 14), AVX2_MSG(s, 9, 11, 13, 15));
+
+		// Undiagonalize
+		b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(2,1,0,3));
+		c = _mm256_permute4x64_epi64(c, _MM_SHUFFLE(1,0,3,2));
+		d = _mm256_permute4x64_epi64(d, _MM_SHUFFLE(0,3,2,1));
+	}
+
+	_mm256_storeu_si256((__m256i*)&S->h[0], _mm256_xor_si256(h0, _mm256_xor_si256(a, c)));
+	_mm256_storeu_si256((__m256i*)&S->h[4], _mm256_xor_si256(h1, _mm256_xor_si256(b, d)));
+}
+#endif
+
+
+#if R_GOOSE_WITH_BLAKE2S
+/* 	BLAKE2s - SSE4.1 compression function
+
+	Same row-wise layout as the AVX2 BLAKE2b function, with 4x32-bit rows in a 128-bit register.
+*/
+
+#define SSE_ROT16(x)		_mm_shuffle_epi8((x), r16)
+#define SSE_ROT12(x)		_mm_xor_si128(_mm_srli_epi32((x), 12), _mm_slli_epi32((x), 20))
+#define SSE_ROT8(x)			_mm_shuffle_epi8((x), r8)
+#define SSE_ROT7(x)			_mm_xor_si128(_mm_srli_epi32((x), 7), _mm_slli_epi32((x), 25))
+
+#define SSE_G(a,b,c,d,m0,m1)											\
+	do {																\
+		a = _mm_add_epi32(_mm_add_epi32(a, b), m0);						\
+		d = SSE_ROT16(_mm_xor_si128(d, a));								\
+		c = _mm_add_epi32(c, d);										\
+		b = SSE_ROT12(_mm_xor_si128(b, c));								\
+		a = _mm_add_epi32(_mm_add_epi32(a, b), m1);						\
+		d = SSE_ROT8(_mm_xor_si128(d, a));								\
+		c = _mm_add_epi32(c, d);										\
+		b = SSE_ROT7(_mm_xor_si128(b, c));								\
+	} while(0)
+
+#define SSE_MSG(s,i0,i1,i2,i3)	\
+	_mm_set_epi32((int)m[s[i3]], (int)m[s[i2]], (int)m[s[i1]], (int)m[s[i0]])
+
+__attribute__((target("sse4.1")))
+static void
+blake2s_compress_sse41(blake2s_state* S, const uint8_t* block){
+	const __m128i r16 = _mm_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+	const __m128i r8  = _mm_setr_epi8(1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12);
+	uint32_t m[16];
+	int i, r;
+
+	for(i = 0; i < 16; i++){
+		m[i] = load32(block + i*4);
+	}
+
+	__m128i a = _mm_loadu_si128((const __m128i*)&S->h[0]);
+	__m128i b = _mm_loadu_si128((const __m128i*)&S->h[4]);
+	__m128i c = _mm_loadu_si128((const __m128i*)&blake2s_IV[0]);
+	__m128i d = _mm_xor_si128(_mm_loadu_si128((const __m128i*)&blake2s_IV[4]),
+							  _mm_set_epi32((int)S->f[1], (int)S->f[0], (int)S->t[1], (int)S->t[0]));
+
+	const __m128i h0 = a, h1 = b;
+
+	for(r = 0; r < 10; r++){
+		const uint8_t* s = blake2_sigma[r];
+
+		// Columns
+		SSE_G(a, b, c, d, SSE_MSG(s, 0, 2, 4, 6), SSE_MSG(s, 1, 3, 5, 7));
+
+		// Diagonalize
+		b = _mm_shuffle_epi32(b, _MM_SHUFFLE(0,3,2,1));
+		c = _mm_shuffle_epi32(c, _MM_SHUFFLE(1,0,3,2));
+		d = _mm_shuffle_epi32(d, _MM_SHUFFLE(2,1,0,3));
+
+		// Diagonals
+		SSE_G(a, b, c, d, SSE_MSG(s, 8, 10, 12, 14), SSE_MSG(s, 9, 11, 13, 15));
+
+		// Undiagonalize
+		b = _mm_shuffle_epi32(b, _MM_SHUFFLE(2,1,0,3));
+		c = _mm_shuffle_epi32(c, _MM_SHUFFLE(1,0,3,2));
+		d = _mm_shuffle_epi32(d, _MM_SHUFFLE(0,3,2,1));
+	}
+
+	_mm_storeu_si128((__m128i*)&S->h[0], _mm_xor_si128(h0, _mm_xor_si128(a, c)));
+	_mm_storeu_si128((__m128i*)&S->h[4], _mm_xor_si128(h1, _mm_xor_si128(b, d)));
+}
+#endif
+
+#endif
+
+
+#if R_GOOSE_WITH_BLAKE2B
+// BLAKE2b - Streaming interface
+
+int blake2b_init_key(blake2b_state* S, size_t outlen, const uint8_t* key, size_t key_size, int simd){
+	uint8_t block[BLAKE2B_BLOCKBYTES];
+
+	if(outlen == 0 || outlen > BLAKE2B_OUTBYTES || key_size > BLAKE2B_KEYBYTES){
+		return -1;
+	}
+
+	memcpy(S->h, blake2b_IV, sizeof(S->h));
+
+	// Parameter block: digest length, key length, fanout = 1, depth = 1
+	S->h[0] ^= 0x01010000ULL ^ ((uint64_t)key_size << 8) ^ (uint64_t)outlen;
+
+	S->t[0] = S->t[1] = 0;
+	S->f[0] = S->f[1] = 0;
+	S->buflen = 0;
+	S->outlen = outlen;
+
+	S->compress = blake2b_compress_portable;
+#ifdef BLAKE2_X86_SIMD
+	if(simd && __builtin_cpu_supports("avx2")){
+		S->compress = blake2b_compress_avx2;
+	}
+#endif
+
+	if(key_size > 0){
+		// Key is processed as the first (zero padded) block
+		memset(block, 0, BLAKE2B_BLOCKBYTES);
+		memcpy(block, key, key_size);
+		blake2b_update(S, block, BLAKE2B_BLOCKBYTES);
+	}
+
+	return 0;
+}
+
+static inline void
+blake2b_increment_counter(blake2b_state* S, uint64_t inc){
+	S->t[0] += inc;
+	S->t[1] += (S->t[0] < inc);
+}
+
+void blake2b_update(blake2b_state* S, const uint8_t* data, size_t data_size){
+	if(data_size == 0){
+		return;
+	}
+
+	size_t left = S->buflen;
+	size_t fill = BLAKE2B_BLOCKBYTES - left;
+
+	// The last block is only compressed in blake2b_final(), with the finalization flag set
+	if(data_size > fill){
+		S->buflen = 0;
+		memcpy(S->buf + left, data, fill);
+		blake2b_increment_counter(S, BLAKE2B_BLOCKBYTES);
+		S->compress(S, S->buf);
+		data += fill;
+		data_size -= fill;
+
+		while(data_size > BLAKE2B_BLOCKBYTES){
+			blake2b_increment_counter(S, BLAKE2B_BLOCKBYTES);
+			S->compress(S, data);
+			data += BLAKE2B_BLOCKBYTES;
+			data_size -= BLAKE2B_BLOCKBYTES;
+		}
+	}
+
+	memcpy(S->buf + S->buflen, data, data_size);
+	S->buflen += data_size;
+}
+
+void blake2b_final(blake2b_state* S, uint8_t* out){
+	blake2b_increment_counter(S, S->buflen);
+	S->f[0] = (uint64_t)-1;
+	memset(S->buf + S->buflen, 0, BLAKE2B_BLOCKBYTES - S->buflen);
+	S->compress(S, S->buf);
+
+	for(size_t i = 0; i < S->outlen; i++){
+		out[i] = (uint8_t)(S->h[i >> 3] >> (8 * (i & 7)));
+	}
+}
+#endif
+
+
+#if R_GOOSE_WITH_BLAKE2S
+// BLAKE2s - Streaming interface
+
+int blake2s_init_key(blake2s_state* S, size_t outlen, const uint8_t* key, size_t key_size, int simd){
+	uint8_t block[BLAKE2S_BLOCKBYTES];
+
+	if(outlen == 0 || outlen > BLAKE2S_OUTBYTES || key_size > BLAKE2S_KEYBYTES){
+		return -1;
+	}
+
+	memcpy(S->h, blake2s_IV, sizeof(S->h));
+
+	// Parameter block: digest length, key length, fanout = 1, depth = 1
+	S->h[0] ^= 0x01010000UL ^ ((uint32_t)key_size << 8) ^ (uint32_t)outlen;
+
+	S->t[0] = S->t[1] = 0;
+	S->f[0] = S->f[1] = 0;
+	S->buflen = 0;
+	S->outlen = outlen;
+
+	S->compress = blake2s_compress_portable;
+#ifdef BLAKE2_X86_SIMD
+	if(simd && __builtin_cpu_supports("sse4.1")){
+		S->compress = blake2s_compress_sse41;
+	}
+#endif
+
+	if(key_size > 0){
+		// Key is processed as the first (zero padded) block
+		memset(block, 0, BLAKE2S_BLOCKBYTES);
+		memcpy(block, key, key_size);
+		blake2s_update(S, block, BLAKE2S_BLOCKBYTES);
+	}
+
+	return 0;
+}
+
+static inline void
+blake2s_increment_counter(blake2s_state* S, uint32_t inc){
+	S->t[0] += inc;
+	S->t[1] += (S->t[0] < inc);
+}
+
+void blake2s_update(blake2s_state* S, const uint8_t* data, size_t data_size){
+	if(data_size == 0){
+		return;
+	}
+
+	size_t left = S->buflen;
+	size_t fill = BLAKE2S_BLOCKBYTES - left;
+
+	// The last block is only compressed in blake2s_final(), with the finalization flag set
+	if(data_size > fill){
+		S->buflen = 0;
+		memcpy(S->buf + left, data, fill);
+		blake2s_increment_counter(S, BLAKE2S_BLOCKBYTES);
+		S->compress(S, S->buf);
+		data += fill;
+		data_size -= fill;
+
+		while(data_size > BLAKE2S_BLOCKBYTES){
+			blake2s_increment_counter(S, BLAKE2S_BLOCKBYTES);
+			S->compress(S, data);
+			data += BLAKE2S_BLOCKBYTES;
+			data_size -= BLAKE2S_BLOCKBYTES;
+		}
+	}
+
+	memcpy(S->buf + S->buflen, data, data_size);
+	S->buflen += data_size;
+}
+
+void blake2s_final(blake2s_state* S, uint8_t* out){
+	blake2s_increment_counter(S, (uint32_t)S->buflen);
+	S->f[0] = (uint32_t)-1;
+	memset(S->buf + S->buflen, 0, BLAKE2S_BLOCKBYTES - S->buflen);
+	S->compress(S, S->buf);
+
+	for(size_t i = 0; i < S->outlen; i++){
+		out[i] = (uint8_t)(S->h[i >> 2] >> (8 * (i & 3)));
+	}
+}
+#endif
+
+
+// Keyed BLAKE2 MAC functions - Custom/Off-Standard
+
+#if R_GOOSE_WITH_BLAKE2B_KEYED_80
+int
+blake2b_80(uint8_t* data, uint8_t* key, size_t data_size, size_t key_size, uint8_t** dest){
+	blake2b_state S;
+
+	if(blake2b_init_key(&S, 10, key, key_size, 1) != 0){
+		return -1;
+	}
+
+	if(*dest == NULL){
+		// Malloc and prepare
+		*dest = (uint8_t*)r_goose_malloc(sizeof(char)*10);
+		if(*dest == NULL){
+			OPENSSL_cleanse(&S, sizeof(S));
+			return 1;
+		}
+	}
+
+	blake2b_update(&S, data, data_size);
+	blake2b_final(&S, *dest);
+
+	// The state holds the key block
+	OPENSSL_cleanse(&S, sizeof(S));
+
+	return 0;
+}
+#endif
+
+#if R_GOOSE_WITH_BLAKE2S_KEYED_80
+int
+blake2s_80(uint8_t* data, uint8_t* key, size_t data_size, size_t key_size, uint8_t** dest){
+	blake2s_state S;
+
+	if(blake2s_init_key(&S, 10, key, key_size, 1) != 0){
+		return -1;
+	}
+
+	if(*dest == NULL){
+		// Malloc and prepare
+		*dest = (uint8_t*)r_goose_malloc(sizeof(char)*10);
+		if(*dest == NULL){
+			OPENSSL_cleanse(&S, sizeof(S));
+			return 1;
+		}
+	}
+
+	blake2s_update(&S, data, data_size);
+	blake2s_final(&S, *dest);
+
+	// The state holds the key block
+	OPENSSL_cleanse(&S, sizeof(S));
+
+	return 0;
+}
+#endif
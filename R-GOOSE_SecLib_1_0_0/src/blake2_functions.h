@@ -0,0 +1,220 @@
+/*
+	File declaring native keyed BLAKE2 MAC functions (Custom/Off-Standard)
+*/
+
+/**
+ * @file blake2_functions.h
+ * @author Eduardo Andrade
+ * @date Mar 2020
+ * @brief File containing the declarations of the native keyed BLAKE2b/BLAKE2s MAC functions
+ *
+ * This header file declares the several funtions implemented on the file blake2_functions.c.
+ * Unlike hmac_BLAKE2b_80() and hmac_BLAKE2s_80(), which wrap BLAKE2 inside HMAC (two hash passes),
+ * these functions use the keyed mode defined in RFC 7693: the key is absorbed as the first block and
+ * the message is processed in a single pass.
+ *
+ * The compression function has a portable implementation and SIMD implementations (AVX2 for BLAKE2b,
+ * SSE4.1 for BLAKE2s). The SIMD variant is selected at runtime, when the CPU supports it.
+ * @see https://tools.ietf.org/html/rfc7693
+ */
+
+#ifndef BLAKE2_FUNCTIONS_H
+#define BLAKE2_FUNCTIONS_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "r_goose_config.h"
+
+#define BLAKE2B_BLOCKBYTES		128
+#define BLAKE2B_OUTBYTES		64
+#define BLAKE2B_KEYBYTES		64
+
+#define BLAKE2S_BLOCKBYTES		64
+#define BLAKE2S_OUTBYTES		32
+#define BLAKE2S_KEYBYTES		32
+
+// The BLAKE2 cores are also compiled for the HMAC-BLAKE2 states of the key ring (r_goose_keyring.c)
+#define R_GOOSE_WITH_BLAKE2B	(R_GOOSE_WITH_BLAKE2B_KEYED_80 || R_GOOSE_WITH_HMAC_BLAKE2B_80)
+#define R_GOOSE_WITH_BLAKE2S	(R_GOOSE_WITH_BLAKE2S_KEYED_80 || R_GOOSE_WITH_HMAC_BLAKE2S_80)
+
+
+/**
+ * @brief BLAKE2b streaming state.
+ *
+ * Holds the chaining value, counters and the pending (not yet compressed) block. The
+ * compression function used is chosen by blake2b_init_key() and kept in @p compress.
+ */
+typedef struct blake2b_state {
+	uint64_t h[8];
+	uint64_t t[2];
+	uint64_t f[2];
+	uint8_t buf[BLAKE2B_BLOCKBYTES];
+	size_t buflen;
+	size_t outlen;
+	void (*compress)(struct blake2b_state* S, const uint8_t* block);
+} blake2b_state;
+
+/**
+ * @brief BLAKE2s streaming state.
+ *
+ * Holds the chaining value, counters and the pending (not yet compressed) block. The
+ * compression function used is chosen by blake2s_init_key() and kept in @p compress.
+ */
+typedef struct blake2s_state {
+	uint32_t h[8];
+	uint32_t t[2];
+	uint32_t f[2];
+	uint8_t buf[BLAKE2S_BLOCKBYTES];
+	size_t buflen;
+	size_t outlen;
+	void (*compress)(struct blake2s_state* S, const uint8_t* block);
+} blake2s_state;
+
+
+/**
+ * @brief Function that initializes a keyed BLAKE2b state.
+ *
+ * This function initializes @p S for a digest of @p outlen bytes, keyed with @p key. If @p key_size
+ * is 0 the state computes the plain (unkeyed) BLAKE2b hash.
+ *
+ * @param S Pointer (<tt>blake2b_state*</tt>) to the state to initialize
+ * @param outlen Variable (<tt>size_t</tt>) with the digest size in bytes (1 to 64)
+ * @param key Pointer (<tt>uint8_t*</tt>) containg the key
+ * @param key_size Variable (<tt>size_t</tt>) that hold the size in bytes of key (0 to 64)
+ * @param simd Variable (<tt>int</tt>) that enables (1) or disables (0) the use of the AVX2 compression function
+ * @return The function returns -1 if @p outlen or @p key_size are out of range and 0 otherwise.
+ */
+int blake2b_init_key(blake2b_state* S, size_t outlen, const uint8_t* key, size_t key_size, int simd);
+
+/**
+ * @brief Function that absorbs @p data_size bytes of @p data into a BLAKE2b state.
+ *
+ * @param S Pointer (<tt>blake2b_state*</tt>) to an initialized state
+ * @param data Pointer (<tt>uint8_t*</tt>) containg the data
+ * @param data_size Variable (<tt>size_t</tt>) that hold the size in bytes of data
+ * @return The function doesn't return any value
+ */
+void blake2b_update(blake2b_state* S, const uint8_t* data, size_t data_size);
+
+/**
+ * @brief Function that finalizes a BLAKE2b state and writes the digest (@p S->outlen bytes) to @p out.
+ *
+ * @param S Pointer (<tt>blake2b_state*</tt>) to an initialized state
+ * @param out Pointer (<tt>uint8_t*</tt>) to a buffer with at least @p S->outlen bytes
+ * @return The function doesn't return any value
+ */
+void blake2b_final(blake2b_state* S, uint8_t* out);
+
+/**
+ * @brief Function that initializes a keyed BLAKE2s state.
+ *
+ * This function initializes @p S for a digest of @p outlen bytes, keyed with @p key. If @p key_size
+ * is 0 the state computes the plain (unkeyed) BLAKE2s hash.
+ *
+ * @param S Pointer (<tt>blake2s_state*</tt>) to the state to initialize
+ * @param outlen Variable (<tt>size_t</tt>) with the digest size in bytes (1 to 32)
+ * @param key Pointer (<tt>uint8_t*</tt>) containg the key
+ * @param key_size Variable (<tt>size_t</tt>) that hold the size in bytes of key (0 to 32)
+ * @param simd Variable (<tt>int</tt>) that enables (1) or disables (0) the use of the SSE4.1 compression function
+ * @return The function returns -1 if @p outlen or @p key_size are out of range and 0 otherwise.
+ */
+int blake2s_init_key(blake2s_state* S, size_t outlen, const uint8_t* key, size_t key_size, int simd);
+
+/**
+ * @brief Function that absorbs @p data_size bytes of @p data into a BLAKE2s state.
+ *
+ * @param S Pointer (<tt>blake2s_state*</tt>) to an initialized state
+ * @param data Pointer (<tt>uint8_t*</tt>) containg the data
+ * @param data_size Variable (<tt>size_t</tt>) that hold the size in bytes of data
+ * @return The function doesn't return any value
+ */
+void blake2s_update(blake2s_state* S, const uint8_t* data, size_t data_size);
+
+/**
+ * @brief Function that finalizes a BLAKE2s state and writes the digest (@p S->outlen bytes) to @p out.
+ *
+ * @param S Pointer (<tt>blake2s_state*</tt>) to an initialized state
+ * @param out Pointer (<tt>uint8_t*</tt>) to a buffer with at least @p S->outlen bytes
+ * @return The function doesn't return any value
+ */
+void blake2s_final(blake2s_state* S, uint8_t* out);
+
+
+/**
+ * @brief Function that generates a keyed BLAKE2b-80 Tag
+ *
+ * This function generates a MAC Tag of 80bits (10bytes) long, using BLAKE2b in its native
+ * keyed mode (digest length set to 10 bytes in the parameter block). It receives @p data,
+ * @p key and @p dest as pointers, and both data and key sizes as <tt>size_t</tt>. The function
+ * calculates the MAC tag and stores it on @p dest.
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * uint8_t* dest = NULL;
+ * uint8_t* key = (uint8_t*)malloc(sizeof(uint8_t)*32);
+ * set_key(key); 											// pseudo-function that populates key
+ * uint8_t* data = (uint8_t*)malloc(sizeof(uint8_t)*8);
+ * set_data(data); 										// pseudo-function that populates data
+ *
+ * int data_size = 8, key_size = 32;
+ *
+ * blake2b_80(data, key, data_size, key_size, &dest);
+ *
+ * print_array_hex(dest);									// pseudo-function that prints dest in hex format
+ * @endcode
+ * @param data Pointer (<tt>uint8_t*</tt>) containg the data that will be used to generate the MAC Tag
+ * @param key Pointer (<tt>uint8_t*</tt>) containg the key that will be used to generate the MAC Tag
+ * @param data_size Variable (<tt>size_t</tt>) that hold the size in bytes of data.
+ * @param key_size Variable (<tt>size_t</tt>) that hold the size in bytes of key (at most 64 bytes).
+ * @param dest key Pointer (<tt>uint8_t**</tt>) pointing to the destiny memory address where MAC tag should be stored
+ * @return The function returns -1 if @p key_size is larger than 64 bytes, 1 if @p *dest can't be allocated and 0
+ * otherwise.
+ * @warning @p dest memory should be released outside the function (where @p dest is declared) (free())
+ * @note It is not required to manually allocate/reserve memory for @p dest, this functions allocates the necessary memory
+ * to store the MAC tag if @p *dest is NULL.
+ */
+int
+blake2b_80(uint8_t* data, uint8_t* key, size_t data_size, size_t key_size, uint8_t** dest);
+
+/**
+ * @brief Function that generates a keyed BLAKE2s-80 Tag
+ *
+ * This function generates a MAC Tag of 80bits (10bytes) long, using BLAKE2s in its native
+ * keyed mode (digest length set to 10 bytes in the parameter block). It receives @p data,
+ * @p key and @p dest as pointers, and both data and key sizes as <tt>size_t</tt>. The function
+ * calculates the MAC tag and stores it on @p dest.
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * uint8_t* dest = NULL;
+ * uint8_t* key = (uint8_t*)malloc(sizeof(uint8_t)*16);
+ * set_key(key); 											// pseudo-function that populates key
+ * uint8_t* data = (uint8_t*)malloc(sizeof(uint8_t)*8);
+ * set_data(data); 										// pseudo-function that populates data
+ *
+ * int data_size = 8, key_size = 16;
+ *
+ * blake2s_80(data, key, data_size, key_size, &dest);
+ *
+ * print_array_hex(dest);									// pseudo-function that prints dest in hex format
+ * @endcode
+ * @param data Pointer (<tt>uint8_t*</tt>) containg the data that will be used to generate the MAC Tag
+ * @param key Pointer (<tt>uint8_t*</tt>) containg the key that will be used to generate the MAC Tag
+ * @param data_size Variable (<tt>size_t</tt>) that hold the size in bytes of data.
+ * @param key_size Variable (<tt>size_t</tt>) that hold the size in bytes of key (at most 32 bytes).
+ * @param dest key Pointer (<tt>uint8_t**</tt>) pointing to the destiny memory address where MAC tag should be stored
+ * @return The function returns -1 if @p key_size is larger than 32 bytes, 1 if @p *dest can't be allocated and 0
+ * otherwise.
+ * @warning @p dest memory should be released outside the function (where @p dest is declared) (free())
+ * @note It is not required to manually allocate/reserve memory for @p dest, this functions allocates the necessary memory
+ * to store the MAC tag if @p *dest is NULL.
+ */
+int
+blake2s_80(uint8_t* data, uint8_t* key, size_t data_size, size_t key_size, uint8_t** dest);
+
+#endif
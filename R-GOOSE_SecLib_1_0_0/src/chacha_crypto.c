@@ -0,0 +1,213 @@
+/*
+    File defining ChaCha20-Poly1305 functions (Custom/Off-Standard)
+
+    Encryption/decryption follow the aes_xyz_gcm functions (same arguments and
+    return values), MAC Tag generation follows the gmac_XYZ functions.
+
+    MAC Tag nonce:
+        Poly1305 keys are one-time keys: the ChaCha20-Poly1305 MAC Tags of two messages
+        under the same key and nonce allow forgeries. The nonce of a message is
+        salt || SPDU Number, salt = SHA-256("R-GOOSE Poly1305 nonce" || key) truncated to
+        8 bytes, so it changes with every SPDU Number and both ends derive it. The label
+        differs from the one of the key ring payload IVs, so a MAC nonce never equals the
+        payload IV under the same key.
+*/
+
+#include "chacha_crypto.h"
+#include "r_goose_alloc.h"
+
+
+#if R_GOOSE_WITH_CHACHA20_POLY1305
+int chacha20_poly1305_encrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size, int iv_size, uint8_t** dest){
+
+    EVP_CIPHER_CTX *ctx;
+
+    int len;
+
+    int ciphertext_len;
+
+    /* Stream cipher - ciphertext has the same length as the plaintext */
+    if(*dest == NULL){
+        *dest = (uint8_t*)r_goose_malloc(sizeof(char)*(data_size+1));
+        if(*dest == NULL){
+            return -1;
+        }
+    }
+
+    /* Create and initialise the context */
+    if(!(ctx = EVP_CIPHER_CTX_new()))
+        return -1;
+
+    /* Initialise the encryption operation. */
+    if(1 != EVP_EncryptInit_ex(ctx, EVP_chacha20_poly1305(), NULL, NULL, NULL))
+        goto error;
+
+    /* Set nonce length, 12 bytes (96 bits) by default */
+    if(1 != EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN, iv_size, NULL))
+        goto error;
+
+    /* Initialise key and nonce */
+    if(1 != EVP_EncryptInit_ex(ctx, NULL, NULL, key, iv))
+        goto error;
+
+    if(1 != EVP_EncryptUpdate(ctx, *dest, &len, data, data_size))
+        goto error;
+    ciphertext_len = len;
+
+    if(1 != EVP_EncryptFinal_ex(ctx, *dest + len, &len))
+        goto error;
+    ciphertext_len += len;
+
+    /* Clean up */
+    EVP_CIPHER_CTX_free(ctx);
+
+    return ciphertext_len;
+
+error:
+    EVP_CIPHER_CTX_free(ctx);
+    return -1;
+}
+#endif
+
+#if R_GOOSE_WITH_CHACHA20_POLY1305
+int chacha20_poly1305_decrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size, int iv_size, uint8_t** dest){
+
+    EVP_CIPHER_CTX *ctx;
+
+    int len;
+
+    int plaintext_len;
+
+    if(*dest == NULL){
+        *dest = (uint8_t*)r_goose_malloc(sizeof(char)*(data_size+1));
+        if(*dest == NULL){
+            return -1;
+        }
+    }
+
+    /* Create and initialise the context */
+    if(!(ctx = EVP_CIPHER_CTX_new()))
+        return -1;
+
+    /* Initialise the decryption operation. */
+    if(!EVP_DecryptInit_ex(ctx, EVP_chacha20_poly1305(), NULL, NULL, NULL))
+        goto error;
+
+    /* Set nonce length, 12 bytes (96 bits) by default */
+    if(!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN, iv_size, NULL))
+        goto error;
+
+    /* Initialise key and nonce */
+    if(!EVP_DecryptInit_ex(ctx, NULL, NULL, key, iv))
+        goto error;
+
+    if(!EVP_DecryptUpdate(ctx, *dest, &len, data, data_size))
+        goto error;
+    plaintext_len = len;
+
+    /*
+     * As in the AES-GCM functions, the R-GOOSE message doesn't carry the AEAD tag,
+     * so the result of the tag check done on finalisation is not used.
+     */
+    EVP_DecryptFinal_ex(ctx, *dest + len, &len);
+
+    /* Clean up */
+    EVP_CIPHER_CTX_free(ctx);
+
+    return plaintext_len;
+
+error:
+    EVP_CIPHER_CTX_free(ctx);
+    return -1;
+}
+#endif
+
+#if R_GOOSE_WITH_CHACHA20_POLY1305_128
+int poly1305_CHACHA20_salt(uint8_t* key, uint8_t* salt){
+
+    static const char label[] = "R-GOOSE Poly1305 nonce";
+    uint8_t input[sizeof(label) - 1 + 32], digest[32];
+    unsigned int len;
+
+    memcpy(input, label, sizeof(label) - 1);
+    memcpy(&input[sizeof(label) - 1], key, 32);
+
+    int rc = EVP_Digest(input, sizeof(input), digest, &len, EVP_sha256(), NULL);
+    OPENSSL_cleanse(input, sizeof(input));
+    if(rc != 1) {
+        return 1;
+    }
+
+    memcpy(salt, digest, POLY1305_NONCE_SALT_SIZE);
+    OPENSSL_cleanse(digest, sizeof(digest));
+
+    return 0;
+}
+
+int poly1305_CHACHA20_nonce(uint8_t* key, uint32_t spdu_number, uint8_t* nonce){
+
+    if(poly1305_CHACHA20_salt(key, nonce) != 0) {
+        return 1;
+    }
+    encodeInt4Bytes(nonce, spdu_number, POLY1305_NONCE_SALT_SIZE);
+
+    return 0;
+}
+
+int
+poly1305_CHACHA20_128(uint8_t* data, uint8_t* key, uint8_t* iv ,size_t data_size, size_t iv_size, uint8_t** dest){
+
+    int rc = 0, unused;
+
+    if(*dest == NULL){
+        *dest = (uint8_t*)r_goose_malloc(sizeof(uint8_t)*16);
+        if(*dest == NULL){
+            return 1;
+        }
+    }
+
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    if(ctx == NULL) {
+        return 1;
+    }
+
+    rc = EVP_EncryptInit_ex(ctx, EVP_chacha20_poly1305(), NULL, NULL, NULL);
+    if(rc != 1) {
+        goto error;
+    }
+
+    rc = EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN, iv_size, NULL);
+    if(rc != 1) {
+        goto error;
+    }
+
+    rc = EVP_EncryptInit_ex(ctx, NULL, NULL, key, iv);
+    if(rc != 1) {
+        goto error;
+    }
+
+    /* Data is only authenticated (AAD) */
+    rc = EVP_EncryptUpdate(ctx, NULL, &unused, data, data_size);
+    if(rc != 1) {
+        goto error;
+    }
+
+    rc = EVP_EncryptFinal_ex(ctx, NULL, &unused);
+    if(rc != 1) {
+        goto error;
+    }
+
+    rc = EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, 16, *dest);
+    if(rc != 1) {
+        goto error;
+    }
+
+    EVP_CIPHER_CTX_free(ctx);
+
+    return 0;
+
+error:
+    EVP_CIPHER_CTX_free(ctx);
+    return 1;
+}
+#endif
@@ -0,0 +1,182 @@
+/**
+ * @file chacha_crypto.h
+ * @author Eduardo Andrade
+ * @date Mar 2020
+ * @brief File containing the declarations of all ChaCha20-Poly1305 functions (encryption and MAC Tag generation)
+ *
+ * This header file declares the several funtions implemented on the file chacha_crypto.c.
+ * ChaCha20-Poly1305 (RFC 8439) is an alternative to AES-GCM/GMAC for hosts without AES acceleration
+ * (AES-NI/PCLMULQDQ): it only uses additions, rotations and xors, so its throughput does not depend on
+ * dedicated instructions. The functions use the OpenSSL EVP implementation, which selects at runtime
+ * its vectorized code paths (SSSE3/AVX2/AVX-512 on x86, NEON on ARM).
+ * @note ChaCha20-Poly1305 always uses a 32 bytes key and a 12 bytes nonce (IV).
+ * @see https://tools.ietf.org/html/rfc8439
+ * @see https://www.openssl.org/docs/man1.1.1/man3/EVP_chacha20_poly1305.html
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "aux_funcs.h"
+#include "r_goose_config.h"
+
+//openssl headers
+#include <openssl/evp.h>
+#include <openssl/crypto.h>
+
+
+// Size of the salt of the MAC Tag nonce (nonce = salt || SPDU Number)
+#define POLY1305_NONCE_SALT_SIZE	8
+
+
+/**
+ * @brief Function that encrypts feeded data using ChaCha20-Poly1305
+ *
+ * This functions encrypts feeded data using ChaCha20-Poly1305, producing an output with the same
+ * length as the original. It receives @p data, @p key and @p dest as pointers, and @p iv,
+ * @p data_size and @p iv_size as integers. The function calculates the encrypted data
+ * and stores it on @p dest. It uses OpenSSL Library to implement such algorithm.
+ *
+ * Below is an example of usage:
+ * @code
+ *
+ * uint8_t* dest = NULL;
+ * uint8_t* key = (uint8_t*)malloc(sizeof(uint8_t)*32);
+ * set_key(key); 											// pseudo-function that populates key
+ * uint8_t* data = (uint8_t*)malloc(sizeof(uint8_t)*8);
+ * set_data(data); 										// pseudo-function that populates data
+ * uint8_t* iv = (uint8_t*)malloc(sizeof(uint8_t)*12);
+ * set_data(iv);											// pseudo-function that populates iv
+ *
+ * int data_size = 8, iv_size = 12;
+ *
+ * int len = chacha20_poly1305_encrypt(data, key, iv, data_size, iv_size, &dest);
+ *
+ * print_array_hex(dest,len);								// pseudo-function that prints dest in hex format
+ * @endcode
+ * @param data Pointer (<tt>uint8_t*</tt>) containg the data that will be encrypted
+ * @param key Pointer (<tt>uint8_t*</tt>) containg the 32 bytes key that will be used encrypt data
+ * @param iv Pointer (<tt>uint8_t*</tt>) containg the nonce (Initialization Vector) to be used by ChaCha20
+ * @param data_size Variable (<tt>int</tt>) that hold the size in bytes of data.
+ * @param iv_size Variable (<tt>int</tt>) that hold the size in bytes of IV (at most 12).
+ * @param dest key Pointer (<tt>uint8_t**</tt>) pointing to the destiny memory address where encrypted data should be stored
+ * @return An integer containing the length of the encrypted data, or -1 if an error occurred
+ * @note It is not required to manually allocate/reserve memory for @p dest, this functions allocates the necessary memory
+ * to store the encrypted data if @p *dest is NULL. A preallocated @p *dest (at least @p data_size bytes) is written directly,
+ * which may be @p data itself (in place operation).
+ */
+int chacha20_poly1305_encrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size, int iv_size, uint8_t** dest);
+
+
+/**
+ * @brief Function that decrypts feeded data using ChaCha20-Poly1305
+ *
+ * This functions decrypts feeded data using ChaCha20-Poly1305, producing an output with the same
+ * length as the encrypted (original). It receives @p data, @p key and @p dest as pointers, and @p iv,
+ * @p data_size and @p iv_size as integers. The function calculates the decrypted data
+ * and stores it on @p dest. It uses OpenSSL Library to implement such algorithm.
+ *
+ * Below is an example of usage:
+ * @code
+ *
+ * uint8_t* dest = NULL;
+ * uint8_t* key = (uint8_t*)malloc(sizeof(uint8_t)*32);
+ * set_key(key); 											// pseudo-function that populates key
+ * uint8_t* data = (uint8_t*)malloc(sizeof(uint8_t)*8);
+ * set_data(data); 										// pseudo-function that populates data
+ * uint8_t* iv = (uint8_t*)malloc(sizeof(uint8_t)*12);
+ * set_data(iv);											// pseudo-function that populates iv
+ *
+ * int data_size = 8, iv_size = 12;
+ *
+ * int len = chacha20_poly1305_decrypt(data, key, iv, data_size, iv_size, &dest);
+ *
+ * print_array_hex(dest,len);								// pseudo-function that prints dest in hex format
+ * @endcode
+ * @param data Pointer (<tt>uint8_t*</tt>) containg the data that will be decrypted
+ * @param key Pointer (<tt>uint8_t*</tt>) containg the 32 bytes key that will be used decrypt data
+ * @param iv Pointer (<tt>uint8_t*</tt>) containg the nonce (Initialization Vector) to be used by ChaCha20
+ * @param data_size Variable (<tt>int</tt>) that hold the size in bytes of data.
+ * @param iv_size Variable (<tt>int</tt>) that hold the size in bytes of IV (at most 12).
+ * @param dest key Pointer (<tt>uint8_t**</tt>) pointing to the destiny memory address where decrypted data should be stored
+ * @return An integer containing the length of the decrypted data, or -1 if an error occurred
+ * @note It is not required to manually allocate/reserve memory for @p dest, this functions allocates the necessary memory
+ * to store the decrypted data if @p *dest is NULL. A preallocated @p *dest (at least @p data_size bytes) is written directly,
+ * which may be @p data itself (in place operation).
+ */
+int chacha20_poly1305_decrypt(uint8_t* data, uint8_t* key, uint8_t* iv, int data_size, int iv_size, uint8_t** dest);
+
+
+/**
+ * @brief Function that generates a ChaCha20-Poly1305 Tag (128 bits)
+ *
+ * This function generates a MAC Tag of 128bits (16bytes) long, using the ChaCha20-Poly1305 AEAD.
+ * As done by the GMAC functions, data is passed to OpenSSL as AAD (Additional Authenticated Data),
+ * leaving the PT (Plain Text) empty, so that only authentication and data integrity are provided.
+ * It receives @p data, @p key, @p iv and @p dest as pointers, and both data and IV sizes as <tt>size_t</tt>.
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * uint8_t* dest = NULL;
+ * uint8_t* key = (uint8_t*)malloc(sizeof(uint8_t)*32);
+ * set_key(key); 											// pseudo-function that populates key
+ * uint8_t* data = (uint8_t*)malloc(sizeof(uint8_t)*16);
+ * set_data(data); 									 	// pseudo-function that populates data
+ * uint8_t* iv = (uint8_t*)malloc(sizeof(uint8_t)*12);
+ * set_iv(iv);												// pseudo-function that populates IV
+ *
+ * int data_size = 16, iv_size = 12;
+ *
+ * poly1305_CHACHA20_128(data, key, iv, data_size, iv_size, &dest);
+ *
+ * print_array_hex(dest);									// pseudo-function that prints dest in hex format
+ * @endcode
+ * @param data Pointer (<tt>uint8_t*</tt>) containg the data that will be used to generate the MAC Tag
+ * @param key Pointer (<tt>uint8_t*</tt>) containg the 32 bytes key that will be used to generate the MAC Tag
+ * @param iv Pointer (<tt>uint8_t*</tt>) containg the nonce (Initialization Vector)
+ * @param data_size Variable (<tt>size_t</tt>) that hold the size in bytes of data.
+ * @param iv_size Variable (<tt>size_t</tt>) that hold the size in bytes of IV (at most 12).
+ * @param dest key Pointer (<tt>uint8_t**</tt>) pointing to the destiny memory address where MAC tag should be stored
+ * @return The function returns 0 on success and 1 if an error occurred
+ * @warning @p dest memory should be released outside the function (where @p dest is declared) (free())
+ * @note It is not required to manually allocate/reserve memory for @p dest, this functions allocates the necessary memory
+ * to store the MAC tag.
+ */
+int
+poly1305_CHACHA20_128(uint8_t* data, uint8_t* key, uint8_t* iv ,size_t data_size, size_t iv_size, uint8_t** dest);
+
+
+/**
+ * @brief Function that derives the salt of the ChaCha20-Poly1305 MAC Tag nonces of a key
+ *
+ * The salt is SHA-256("R-GOOSE Poly1305 nonce" || @p key) truncated to POLY1305_NONCE_SALT_SIZE bytes. It is computed
+ * once per key by the key ring (r_goose_keyring_publish()); poly1305_CHACHA20_nonce() derives it on every call.
+ *
+ * @param key Pointer (<tt>uint8_t*</tt>) containg the 32 bytes key
+ * @param salt Pointer (<tt>uint8_t*</tt>) to the destination (POLY1305_NONCE_SALT_SIZE bytes)
+ * @return The function returns 0 on success and 1 if an error occurred
+ */
+int poly1305_CHACHA20_salt(uint8_t* key, uint8_t* salt);
+
+/**
+ * @brief Function that derives the nonce of the ChaCha20-Poly1305 MAC Tag (CHACHA20_POLY1305_128) of a message
+ *
+ * The nonce is the salt of @p key (poly1305_CHACHA20_salt()) followed by @p spdu_number (big endian), so that every
+ * message gets its own Poly1305 one-time key. Used by r_gooseMessage_InsertGMAC() and r_gooseMessage_ValidateGMAC().
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * uint8_t nonce[12];
+ * poly1305_CHACHA20_nonce(key, decode_4bytesToInt(buffer, INDEX_SPDU_NUMBER), nonce);
+ * poly1305_CHACHA20_128(&buffer[2], key, nonce, data_size, 12, &dest);
+ *
+ * @endcode
+ * @param key Pointer (<tt>uint8_t*</tt>) containg the 32 bytes key
+ * @param spdu_number Variable (<tt>uint32_t</tt>) with the SPDU Number of the message
+ * @param nonce Pointer (<tt>uint8_t*</tt>) to the destination (12 bytes)
+ * @return The function returns 0 on success and 1 if an error occurred
+ * @warning The MAC Tags are only secure while a key never signs two different messages with the same SPDU Number.
+ */
+int poly1305_CHACHA20_nonce(uint8_t* key, uint32_t spdu_number, uint8_t* nonce);
@@ -5,17 +5,22 @@
 */
 
 #include "gmac_functions.h"
+#include "r_goose_alloc.h"
 
 
+#if R_GOOSE_WITH_GMAC_AES128_64
 int
 gmac_AES128_64(uint8_t* data, uint8_t* key, uint8_t* iv ,size_t data_size, size_t iv_size, uint8_t** dest){
 
 	int rc = 0, unused;
 
-    uint8_t* tmp = (uint8_t*)calloc(16, sizeof(uint8_t));
+    uint8_t tmp[16];
    
     if(*dest == NULL){
-    	*dest = (uint8_t*)malloc(sizeof(uint8_t)*8);
+    	*dest = (uint8_t*)r_goose_malloc(sizeof(uint8_t)*8);
+    	if(*dest == NULL){
+    		return 1;
+    	}
     }
 
     EVP_CIPHER_CTX *ctx = NULL;
@@ -67,19 +72,22 @@ gmac_AES128_64(uint8_t* data, uint8_t* key, uint8_t* iv ,size_t data_size, size_
     }
 
     memcpy(*dest, tmp, 8);
-
-    free(tmp);    
     
     return 0;
 }
+#endif
 
+#if R_GOOSE_WITH_GMAC_AES128_128
 int
 gmac_AES128_128(uint8_t* data, uint8_t* key, uint8_t* iv ,size_t data_size, size_t iv_size, uint8_t** dest){
 
     int rc = 0, unused;
    
     if(*dest == NULL){
-        *dest = (uint8_t*)malloc(sizeof(uint8_t)*16);
+        *dest = (uint8_t*)r_goose_malloc(sizeof(uint8_t)*16);
+        if(*dest == NULL){
+            return 1;
+        }
     }
 
     EVP_CIPHER_CTX *ctx = NULL;
@@ -133,7 +141,9 @@ gmac_AES128_128(uint8_t* data, uint8_t* key, uint8_t* iv ,size_t data_size, size
 
     return 0;
 }
+#endif
 
+#if R_GOOSE_WITH_GMAC_AES256_64
 int
 gmac_AES256_64(uint8_t* data, uint8_t* key, uint8_t* iv ,size_t data_size, size_t iv_size, uint8_t** dest){
 
@@ -141,10 +151,13 @@ gmac_AES256_64(uint8_t* data, uint8_t* key, uint8_t* iv ,size_t data_size, size_
 
     int rc = 0, unused;
 
-    uint8_t* tmp = (uint8_t*)calloc(16, sizeof(uint8_t));
+    uint8_t tmp[16];
    
     if(*dest == NULL){
-        *dest = (uint8_t*)malloc(sizeof(uint8_t)*8);
+        *dest = (uint8_t*)r_goose_malloc(sizeof(uint8_t)*8);
+        if(*dest == NULL){
+            return 1;
+        }
     }
 
     EVP_CIPHER_CTX *ctx = NULL;
@@ -196,12 +209,12 @@ gmac_AES256_64(uint8_t* data, uint8_t* key, uint8_t* iv ,size_t data_size, size_
     }
 
     memcpy(*dest, tmp, 8);
-
-    free(tmp);
     
     return 0;
 }
+#endif
 
+#if R_GOOSE_WITH_GMAC_AES256_128
 int
 gmac_AES256_128(uint8_t* data, uint8_t* key, uint8_t* iv ,size_t data_size, size_t iv_size, uint8_t** dest){
 
@@ -210,7 +223,10 @@ gmac_AES256_128(uint8_t* data, uint8_t* key, uint8_t* iv ,size_t data_size, size
     int rc = 0, unused;
    
     if(*dest == NULL){
-        *dest = (uint8_t*)malloc(sizeof(uint8_t)*16);
+        *dest = (uint8_t*)r_goose_malloc(sizeof(uint8_t)*16);
+        if(*dest == NULL){
+            return 1;
+        }
     }
 
     EVP_CIPHER_CTX *ctx = NULL;
@@ -263,3 +279,4 @@ gmac_AES256_128(uint8_t* data, uint8_t* key, uint8_t* iv ,size_t data_size, size
 
     return 0;
 }
+#endif
@@ -30,6 +30,8 @@
 #include <openssl/pem.h>
 #include <openssl/rand.h>
 
+#include "r_goose_config.h"
+
 #define ASSERT(x) assert(x)
 
 
@@ -17,98 +17,175 @@
 			ALL OK -> Functions allocate dynamic memory to DEST
 		
 	NOTES:
+		-- Functions return 0, or 1 if the allocation of DEST or HMAC() failed (DEST, when
+		allocated, is left to the caller).
 		-- DEST is a pointer to where the MAC Tag should be written. 
 		To hmac_xyz functions, should be passed memory address of such pointer (&dest)
 		
 */
 
 #include "hmac_functions.h"
+#include "r_goose_alloc.h"
 
-void
+#if R_GOOSE_WITH_HMAC_SHA256_80
+int
 hmac_SHA256_80(uint8_t* data, uint8_t* key, size_t data_size, size_t key_size, uint8_t** dest){
-	unsigned char* tmp = (unsigned char*)calloc(32, sizeof(char));
+	unsigned char tmp[EVP_MAX_MD_SIZE];
 	
 	if(*dest == NULL){
 		// Malloc and prepare
-		*dest = (uint8_t*)malloc(sizeof(char)*10);
+		*dest = (uint8_t*)r_goose_malloc(sizeof(char)*10);
+		if(*dest == NULL){
+			return 1;
+		}
 	}
 
-	HMAC(EVP_sha256(), key, key_size, data, data_size, tmp, NULL);
+	if(HMAC(EVP_sha256(), key, key_size, data, data_size, tmp, NULL) == NULL){
+		return 1;
+	}
 
 	memcpy(*dest, tmp, 10);
-
-	free(tmp);
+	return 0;
 }
+#endif
 
 
-void
+#if R_GOOSE_WITH_HMAC_SHA256_128
+int
 hmac_SHA256_128(uint8_t* data, uint8_t* key, size_t data_size, size_t key_size, uint8_t** dest){
-	unsigned char* tmp = (unsigned char*)calloc(32, sizeof(char));
+	unsigned char tmp[EVP_MAX_MD_SIZE];
 	
 	if(*dest == NULL){
 		// Malloc and prepare
-		*dest = (uint8_t*)malloc(sizeof(char)*16);
+		*dest = (uint8_t*)r_goose_malloc(sizeof(char)*16);
+		if(*dest == NULL){
+			return 1;
+		}
 	}
 
-	HMAC(EVP_sha256(), key, key_size, data, data_size, tmp, NULL);
+	if(HMAC(EVP_sha256(), key, key_size, data, data_size, tmp, NULL) == NULL){
+		return 1;
+	}
 
 	memcpy(*dest, tmp, 16);
-
-	free(tmp);
+	return 0;
 }
+#endif
 
 
-void
+#if R_GOOSE_WITH_HMAC_SHA256_256
+int
 hmac_SHA256_256(uint8_t* data, uint8_t* key, size_t data_size, size_t key_size, uint8_t** dest){
-	unsigned char* tmp = (unsigned char*)calloc(32, sizeof(char));
 	
 	if(*dest == NULL){
 		// Malloc and prepare
-		*dest = (uint8_t*)malloc(sizeof(char)*32);
+		*dest = (uint8_t*)r_goose_malloc(sizeof(char)*32);
+		if(*dest == NULL){
+			return 1;
+		}
 	}
 
-	HMAC(EVP_sha256(), key, key_size, data, data_size, tmp, NULL);
+	// Full length digest, no truncation - written directly to dest
+	if(HMAC(EVP_sha256(), key, key_size, data, data_size, *dest, NULL) == NULL){
+		return 1;
+	}
+	return 0;
+}
+#endif
 
-	memcpy(*dest, tmp, 32);
 
-	free(tmp);
+// Custom/Off-Standard Hash functions
+
+// SHA-512/256 variants - 128 bytes blocks and 64-bit arithmetic, faster than SHA256 on 64-bit cores
+#if R_GOOSE_WITH_HMAC_SHA512_256_80
+int
+hmac_SHA512_256_80(uint8_t* data, uint8_t* key, size_t data_size, size_t key_size, uint8_t** dest){
+	unsigned char tmp[EVP_MAX_MD_SIZE];
+	
+	if(*dest == NULL){
+		// Malloc and prepare
+		*dest = (uint8_t*)r_goose_malloc(sizeof(char)*10);
+		if(*dest == NULL){
+			return 1;
+		}
+	}
+
+	if(HMAC(EVP_sha512_256(), key, key_size, data, data_size, tmp, NULL) == NULL){
+		return 1;
+	}
+
+	memcpy(*dest, tmp, 10);
+	return 0;
 }
+#endif
 
+#if R_GOOSE_WITH_HMAC_SHA512_256_128
+int
+hmac_SHA512_256_128(uint8_t* data, uint8_t* key, size_t data_size, size_t key_size, uint8_t** dest){
+	unsigned char tmp[EVP_MAX_MD_SIZE];
+	
+	if(*dest == NULL){
+		// Malloc and prepare
+		*dest = (uint8_t*)r_goose_malloc(sizeof(char)*16);
+		if(*dest == NULL){
+			return 1;
+		}
+	}
+
+	if(HMAC(EVP_sha512_256(), key, key_size, data, data_size, tmp, NULL) == NULL){
+		return 1;
+	}
+
+	memcpy(*dest, tmp, 16);
+	return 0;
+}
+#endif
 
-// Custom/Off-Standard Hash functions
 
 // BLAKE2 variants
-void
+#if R_GOOSE_WITH_HMAC_BLAKE2B_80
+int
 hmac_BLAKE2b_80(uint8_t* data, uint8_t* key, size_t data_size, size_t key_size, uint8_t** dest){
-	unsigned char* tmp = (unsigned char*)calloc(64, sizeof(char));
+	unsigned char tmp[EVP_MAX_MD_SIZE];
 	
 	if(*dest == NULL){
 		// Malloc and prepare
-		*dest = (uint8_t*)malloc(sizeof(char)*10);
+		*dest = (uint8_t*)r_goose_malloc(sizeof(char)*10);
+		if(*dest == NULL){
+			return 1;
+		}
 	}
 
-	HMAC(EVP_blake2b512(), key, key_size, data, data_size, tmp, NULL);
+	if(HMAC(EVP_blake2b512(), key, key_size, data, data_size, tmp, NULL) == NULL){
+		return 1;
+	}
 
 	memcpy(*dest, tmp, 10);
-
-	free(tmp);
+	return 0;
 }
+#endif
 
-void
+#if R_GOOSE_WITH_HMAC_BLAKE2S_80
+int
 hmac_BLAKE2s_80(uint8_t* data, uint8_t* key, size_t data_size, size_t key_size, uint8_t** dest){
-	unsigned char* tmp = (unsigned char*)calloc(32, sizeof(char));
+	unsigned char tmp[EVP_MAX_MD_SIZE];
 	
 	if(*dest == NULL){
 		// Malloc and prepare
-		*dest = (uint8_t*)malloc(sizeof(char)*10);
+		*dest = (uint8_t*)r_goose_malloc(sizeof(char)*10);
+		if(*dest == NULL){
+			return 1;
+		}
 	}
 
-	HMAC(EVP_blake2s256(), key, key_size, data, data_size, tmp, NULL);
+	if(HMAC(EVP_blake2s256(), key, key_size, data, data_size, tmp, NULL) == NULL){
+		return 1;
+	}
 
 	memcpy(*dest, tmp, 10);
-
-	free(tmp);
+	return 0;
 }
+#endif
 
 
 // MD5 Variants
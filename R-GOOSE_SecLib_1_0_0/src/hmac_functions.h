@@ -25,6 +25,8 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "r_goose_config.h"
+
 //openssl headers
 #include <openssl/hmac.h>
 #include <openssl/evp.h>
@@ -60,14 +62,14 @@
  * @param data_size Variable (<tt>size_t</tt>) that hold the size in bytes of data. 
  * @param key_size Variable (<tt>size_t</tt>) that hold the size in bytes of key. 
  * @param dest key Pointer (<tt>uint8_t**</tt>) pointing to the destiny memory address where HMAC tag should be stored
- * @return The function doesn't return any value
+ * @return The function returns 0 if everything went as expected (no errors) or 1 if an error occured (allocation of @p dest, HMAC()).
  * @warning @p dest should be create as a data type capable of storing the HMAC Tag (ex. <tt>uint8_t*</tt>). However, it's 
  * memory address must be passed to the function and not the pointer itself (<b><tt>&dest</tt></b>)
  * @warning @p dest memory should be released outside the function (where @p dest is declared) (free())
  * @note It is not required to manually allocate/reserve memory for @p dest, this functions allocates the necessary memory
  * to store the HMAC tag. 
  */
-void 
+int
 hmac_SHA256_80(uint8_t* data, uint8_t* key, size_t data_size, size_t key_size, uint8_t** dest);
 
 /**
@@ -98,14 +100,14 @@ hmac_SHA256_80(uint8_t* data, uint8_t* key, size_t data_size, size_t key_size, u
  * @param data_size Variable (<tt>size_t</tt>) that hold the size in bytes of data. 
  * @param key_size Variable (<tt>size_t</tt>) that hold the size in bytes of key. 
  * @param dest key Pointer (<tt>uint8_t**</tt>) pointing to the destiny memory address where HMAC tag should be stored
- * @return The function doesn't return any value
+ * @return The function returns 0 if everything went as expected (no errors) or 1 if an error occured (allocation of @p dest, HMAC()).
  * @warning @p dest should be create as a data type capable of storing the HMAC Tag (ex. <tt>uint8_t*</tt>). However, it's 
  * memory address must be passed to the function and not the pointer itself (<b><tt>&dest</tt></b>)
  * @warning @p dest memory should be released outside the function (where @p dest is declared) (free())
  * @note It is not required to manually allocate/reserve memory for @p dest, this functions allocates the necessary memory
  * to store the HMAC tag. 
  */
-void
+int
 hmac_SHA256_128(uint8_t* data, uint8_t* key, size_t data_size, size_t key_size, uint8_t** dest);
 
 /**
@@ -136,16 +138,94 @@ hmac_SHA256_128(uint8_t* data, uint8_t* key, size_t data_size, size_t key_size,
  * @param data_size Variable (<tt>size_t</tt>) that hold the size in bytes of data. 
  * @param key_size Variable (<tt>size_t</tt>) that hold the size in bytes of key. 
  * @param dest key Pointer (<tt>uint8_t**</tt>) pointing to the destiny memory address where HMAC tag should be stored
- * @return The function doesn't return any value
+ * @return The function returns 0 if everything went as expected (no errors) or 1 if an error occured (allocation of @p dest, HMAC()).
  * @warning @p dest should be create as a data type capable of storing the HMAC Tag (ex. <tt>uint8_t*</tt>). However, it's 
  * memory address must be passed to the function and not the pointer itself (<b><tt>&dest</tt></b>)
  * @warning @p dest memory should be released outside the function (where @p dest is declared) (free())
  * @note It is not required to manually allocate/reserve memory for @p dest, this functions allocates the necessary memory
  * to store the HMAC tag. 
  */
-void
+int
 hmac_SHA256_256(uint8_t* data, uint8_t* key, size_t data_size, size_t key_size, uint8_t** dest);
 
+/**
+ * @brief Function that generates an HMAC-SHA512/256-80 Tag
+ *
+ * This function generates an HMAC Tag of 80bits (10bytes) long, using SHA-512/256 as
+ * its base hashing algorithm (SHA-512 truncated to 256 bits, with its own initial values).
+ * It receives @p data, @p key and @p dest as pointers, and both data and key sizes as
+ * <tt>size_t</tt>. The functions calculates the MAC tag and stores it on @p dest. It uses
+ * OpenSSL Library to implement such algorithms. 
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * uint8_t* dest = NULL;
+ * uint8_t* key = (uint8_t*)malloc(sizeof(uint8_t)*20);
+ * set_key(key); 											// pseudo-function that populates key 
+ * uint8_t* data = (uint8_t*)malloc(sizeof(uint8_t)*8);
+ * set_data(data); 										// pseudo-function that populates data 
+ * 
+ * int data_size = 8, key_size = 20;
+ *
+ * hmac_SHA512_256_80(data, key, data_size, key_size, &dest);
+ *
+ * print_array_hex(dest);									// pseudo-function that prints dest in hex format
+ * @endcode
+ * @param data Pointer (<tt>uint8_t*</tt>) containg the data that will be used to generate the HMAC Tag
+ * @param key Pointer (<tt>uint8_t*</tt>) containg the key that will be used to generate the HMAC Tag
+ * @param data_size Variable (<tt>size_t</tt>) that hold the size in bytes of data. 
+ * @param key_size Variable (<tt>size_t</tt>) that hold the size in bytes of key. 
+ * @param dest key Pointer (<tt>uint8_t**</tt>) pointing to the destiny memory address where HMAC tag should be stored
+ * @return The function returns 0 if everything went as expected (no errors) or 1 if an error occured (allocation of @p dest, HMAC()).
+ * @warning @p dest should be create as a data type capable of storing the HMAC Tag (ex. <tt>uint8_t*</tt>). However, it's 
+ * memory address must be passed to the function and not the pointer itself (<b><tt>&dest</tt></b>)
+ * @warning @p dest memory should be released outside the function (where @p dest is declared) (free())
+ * @note It is not required to manually allocate/reserve memory for @p dest, this functions allocates the necessary memory
+ * to store the HMAC tag. 
+ */
+int
+hmac_SHA512_256_80(uint8_t* data, uint8_t* key, size_t data_size, size_t key_size, uint8_t** dest);
+
+/**
+ * @brief Function that generates an HMAC-SHA512/256-128 Tag
+ *
+ * This function generates an HMAC Tag of 128bits (16bytes) long, using SHA-512/256 as
+ * its base hashing algorithm (SHA-512 truncated to 256 bits, with its own initial values).
+ * It receives @p data, @p key and @p dest as pointers, and both data and key sizes as
+ * <tt>size_t</tt>. The functions calculates the MAC tag and stores it on @p dest. It uses
+ * OpenSSL Library to implement such algorithms. 
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * uint8_t* dest = NULL;
+ * uint8_t* key = (uint8_t*)malloc(sizeof(uint8_t)*20);
+ * set_key(key); 											// pseudo-function that populates key 
+ * uint8_t* data = (uint8_t*)malloc(sizeof(uint8_t)*8);
+ * set_data(data); 										// pseudo-function that populates data 
+ * 
+ * int data_size = 8, key_size = 20;
+ *
+ * hmac_SHA512_256_128(data, key, data_size, key_size, &dest);
+ *
+ * print_array_hex(dest);									// pseudo-function that prints dest in hex format
+ * @endcode
+ * @param data Pointer (<tt>uint8_t*</tt>) containg the data that will be used to generate the HMAC Tag
+ * @param key Pointer (<tt>uint8_t*</tt>) containg the key that will be used to generate the HMAC Tag
+ * @param data_size Variable (<tt>size_t</tt>) that hold the size in bytes of data. 
+ * @param key_size Variable (<tt>size_t</tt>) that hold the size in bytes of key. 
+ * @param dest key Pointer (<tt>uint8_t**</tt>) pointing to the destiny memory address where HMAC tag should be stored
+ * @return The function returns 0 if everything went as expected (no errors) or 1 if an error occured (allocation of @p dest, HMAC()).
+ * @warning @p dest should be create as a data type capable of storing the HMAC Tag (ex. <tt>uint8_t*</tt>). However, it's 
+ * memory address must be passed to the function and not the pointer itself (<b><tt>&dest</tt></b>)
+ * @warning @p dest memory should be released outside the function (where @p dest is declared) (free())
+ * @note It is not required to manually allocate/reserve memory for @p dest, this functions allocates the necessary memory
+ * to store the HMAC tag. 
+ */
+int
+hmac_SHA512_256_128(uint8_t* data, uint8_t* key, size_t data_size, size_t key_size, uint8_t** dest);
+
 /**
  * @brief Function that generates an HMAC-BLAKE2b_80 Tag
  *
@@ -174,12 +254,12 @@ hmac_SHA256_256(uint8_t* data, uint8_t* key, size_t data_size, size_t key_size,
  * @param data_size Variable (<tt>size_t</tt>) that hold the size in bytes of data. 
  * @param key_size Variable (<tt>size_t</tt>) that hold the size in bytes of key. 
  * @param dest key Pointer (<tt>uint8_t**</tt>) pointing to the destiny memory address where HMAC tag should be stored
- * @return The function doesn't return any value
+ * @return The function returns 0 if everything went as expected (no errors) or 1 if an error occured (allocation of @p dest, HMAC()).
  * @warning @p dest should be create as a data type capable of storing the HMAC Tag (ex. <tt>uint8_t*</tt>). However, it's 
  * memory address must be passed to the function and not the pointer itself (<b><tt>&dest</tt></b>)
  * @warning @p dest memory should be released outside the function (where @p dest is declared) (free())
  */
-void
+int
 hmac_BLAKE2b_80(uint8_t* data, uint8_t* key, size_t data_size, size_t key_size, uint8_t** dest);
 
 /**
@@ -210,10 +290,10 @@ hmac_BLAKE2b_80(uint8_t* data, uint8_t* key, size_t data_size, size_t key_size,
  * @param data_size Variable (<tt>size_t</tt>) that hold the size in bytes of data. 
  * @param key_size Variable (<tt>size_t</tt>) that hold the size in bytes of key. 
  * @param dest key Pointer (<tt>uint8_t**</tt>) pointing to the destiny memory address where HMAC tag should be stored
- * @return The function doesn't return any value
+ * @return The function returns 0 if everything went as expected (no errors) or 1 if an error occured (allocation of @p dest, HMAC()).
  * @warning @p dest should be create as a data type capable of storing the HMAC Tag (ex. <tt>uint8_t*</tt>). However, it's 
  * memory address must be passed to the function and not the pointer itself (<b><tt>&dest</tt></b>)
  * @warning @p dest memory should be released outside the function (where @p dest is declared) (free())
  */
-void
+int
 hmac_BLAKE2s_80(uint8_t* data, uint8_t* key, size_t data_size, size_t key_size, uint8_t** dest);
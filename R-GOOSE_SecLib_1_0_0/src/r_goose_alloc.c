@@ -0,0 +1,415 @@
+/*
+	File defining the allocator of the library (Custom/Off-Standard)
+
+	Callbacks:
+		one global pair (and context), set before the library is used, so they are read without
+		synchronization. The default allocation uses malloc() up to the alignment malloc()
+		guarantees (alignof(max_align_t)) and posix_memalign() above it; both are released by free().
+
+	Counting:
+		relaxed atomic counters, only updated while the mode is on (one relaxed load of the flag
+		otherwise), so they can be read by any thread while the library runs.
+
+	OpenSSL:
+		the first r_goose_set_allocator() installs CRYPTO_set_mem_functions() wrappers (in the
+		no heap build r_goose_static_init() installs its own, on the storage), so the
+		contexts of OpenSSL come from the callbacks and are counted like the blocks of the library.
+		If OpenSSL has already allocated, the wrappers can't be installed: the callbacks are set
+		anyway (for the library only), r_goose_set_allocator() returns 1 and the next calls retry.
+		Each block has a header in front (size, for realloc, and the release callback and context
+		it was allocated with): OpenSSL keeps some blocks for the life of the process, and they
+		must go back to their own allocator even if the application sets another one later.
+
+	No heap build (R_GOOSE_NO_HEAP):
+		malloc()/free() are not referenced. The default callbacks carve blocks out of the storage
+		given to r_goose_static_init(): a 16 byte header (usable size, free list link) before each
+		block, sizes rounded up to 16 bytes. Released blocks are kept on free lists - one per size
+		up to 1 KB (exact fit, O(1)) and one for larger blocks (first fit, no split) - and reused,
+		so a steady state of allocations and releases (keys replaced by rotation) does not grow
+		the carved storage. Storage is never given back to the system.
+
+		OpenSSL allocates its contexts (and its own tables) through the same storage, set with
+		CRYPTO_set_mem_functions(), so r_goose_static_init() must precede any call to OpenSSL.
+		A spin lock serializes the allocator, which every reader thread takes while it creates its
+		cipher contexts (first message per cipher) and the writer takes to publish and release keys.
+		The key ring paths that run per message don't allocate after that (r_goose_keyring.c).
+*/
+
+#include "r_goose_alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+
+#include <openssl/crypto.h>
+
+
+#ifndef R_GOOSE_NO_HEAP
+
+static void* default_alloc(size_t size, size_t align, void* ctx){
+	void* ptr;
+
+	if(align <= alignof(max_align_t)){
+		return malloc(size);
+	}
+	return posix_memalign(&ptr, align, size) == 0 ? ptr : NULL;
+}
+
+static void default_free(void* ptr, void* ctx){
+	free(ptr);
+}
+
+#else
+
+#define STATIC_BINS			64			// exact fit free lists, blocks up to STATIC_BINS * 16 bytes
+
+typedef struct static_block {
+	size_t size;
+	struct static_block* next;
+} static_block;
+
+_Static_assert(sizeof(static_block) <= R_GOOSE_STATIC_GRAIN, "block header larger than the grain");
+
+static uint8_t* static_base = NULL;
+static size_t static_size = 0;
+static size_t static_carved = 0;
+static size_t static_in_use = 0;
+static uint64_t static_allocs = 0;
+static uint64_t static_failures = 0;
+static static_block* static_bins[STATIC_BINS];
+static static_block* static_large = NULL;
+static atomic_flag static_lock = ATOMIC_FLAG_INIT;
+
+static static_block* static_header(void* ptr){
+	return (static_block*)((uint8_t*)ptr - R_GOOSE_STATIC_GRAIN);
+}
+
+// Unlinks a released block of at least size bytes (exactly size up to 1 KB) aligned to align, or returns NULL
+static static_block* static_reuse(size_t size, size_t align){
+	static_block** link = size <= STATIC_BINS * R_GOOSE_STATIC_GRAIN ? &static_bins[size / R_GOOSE_STATIC_GRAIN - 1] : &static_large;
+
+	for(; *link != NULL; link = &(*link)->next){
+		static_block* b = *link;
+		if(b->size >= size && ((uintptr_t)b + R_GOOSE_STATIC_GRAIN) % align == 0){
+			*link = b->next;
+			return b;
+		}
+	}
+	return NULL;
+}
+
+static void* static_alloc(size_t size, size_t align){
+	static_block* b;
+	void* ptr = NULL;
+
+	if(size > SIZE_MAX / 2){
+		return NULL;
+	}
+	size = size == 0 ? R_GOOSE_STATIC_GRAIN : (size + R_GOOSE_STATIC_GRAIN - 1) / R_GOOSE_STATIC_GRAIN * R_GOOSE_STATIC_GRAIN;
+	if(align < R_GOOSE_STATIC_GRAIN){
+		align = R_GOOSE_STATIC_GRAIN;
+	}
+
+	while(atomic_flag_test_and_set_explicit(&static_lock, memory_order_acquire));
+
+	if((b = static_reuse(size, align)) != NULL){
+		ptr = (uint8_t*)b + R_GOOSE_STATIC_GRAIN;
+	}else if(static_base != NULL){
+		uintptr_t start = (uintptr_t)static_base + static_carved + R_GOOSE_STATIC_GRAIN;
+		size_t offset = (size_t)((start + align - 1) / align * align - (uintptr_t)static_base);
+
+		if(offset <= static_size && size <= static_size - offset){
+			ptr = static_base + offset;
+			b = static_header(ptr);
+			b->size = size;
+			static_carved = offset + size;
+		}
+	}
+
+	if(ptr != NULL){
+		static_in_use += b->size;
+		static_allocs++;
+	}else{
+		static_failures++;
+	}
+
+	atomic_flag_clear_explicit(&static_lock, memory_order_release);
+
+	return ptr;
+}
+
+static void static_free(void* ptr){
+	static_block* b;
+
+	if(ptr == NULL){
+		return;
+	}
+	b = static_header(ptr);
+
+	while(atomic_flag_test_and_set_explicit(&static_lock, memory_order_acquire));
+
+	static_in_use -= b->size;
+	if(b->size <= STATIC_BINS * R_GOOSE_STATIC_GRAIN){
+		b->next = static_bins[b->size / R_GOOSE_STATIC_GRAIN - 1];
+		static_bins[b->size / R_GOOSE_STATIC_GRAIN - 1] = b;
+	}else{
+		b->next = static_large;
+		static_large = b;
+	}
+
+	atomic_flag_clear_explicit(&static_lock, memory_order_release);
+}
+
+static void count_alloc(void* ptr, size_t size);
+static void count_free(void);
+
+static void* crypto_malloc(size_t num, const char* file, int line){
+	void* ptr = static_alloc(num, alignof(max_align_t));
+	count_alloc(ptr, num);
+	return ptr;
+}
+
+static void crypto_free(void* addr, const char* file, int line){
+	if(addr != NULL){
+		count_free();
+		static_free(addr);
+	}
+}
+
+static void* crypto_realloc(void* addr, size_t num, const char* file, int line){
+	void* ptr;
+
+	if(addr == NULL){
+		return crypto_malloc(num, file, line);
+	}
+	if(num == 0){
+		crypto_free(addr, file, line);
+		return NULL;
+	}
+	if(num <= static_header(addr)->size){
+		return addr;
+	}
+	if((ptr = crypto_malloc(num, file, line)) != NULL){
+		memcpy(ptr, addr, static_header(addr)->size);
+		crypto_free(addr, file, line);
+	}
+	return ptr;
+}
+
+
+int r_goose_static_init(void* storage, size_t size){
+	if(static_base != NULL || storage == NULL || (uintptr_t)storage % R_GOOSE_STATIC_GRAIN != 0){
+		return -1;
+	}
+	// Fails if OpenSSL has already allocated memory
+	if(CRYPTO_set_mem_functions(crypto_malloc, crypto_realloc, crypto_free) != 1){
+		return -1;
+	}
+
+	static_base = (uint8_t*)storage;
+	static_size = size;
+
+	return 0;
+}
+
+void r_goose_static_get_stats(r_goose_static_stats* stats){
+	while(atomic_flag_test_and_set_explicit(&static_lock, memory_order_acquire));
+
+	stats->size = static_size;
+	stats->carved = static_carved;
+	stats->in_use = static_in_use;
+	stats->allocs = static_allocs;
+	stats->failures = static_failures;
+
+	atomic_flag_clear_explicit(&static_lock, memory_order_release);
+}
+
+static void* default_alloc(size_t size, size_t align, void* ctx){
+	return static_alloc(size, align);
+}
+
+static void default_free(void* ptr, void* ctx){
+	static_free(ptr);
+}
+
+#endif
+
+static r_goose_alloc_fn alloc_fn = default_alloc;
+static r_goose_free_fn free_fn = default_free;
+static void* alloc_ctx = NULL;
+
+static _Atomic int counting = 0;
+static _Atomic uint64_t count_allocs = 0;
+static _Atomic uint64_t count_frees = 0;
+static _Atomic uint64_t count_bytes = 0;
+static _Atomic uint64_t count_failures = 0;
+
+
+static void count_alloc(void* ptr, size_t size){
+	if(atomic_load_explicit(&counting, memory_order_relaxed)){
+		if(ptr != NULL){
+			atomic_fetch_add_explicit(&count_allocs, 1, memory_order_relaxed);
+			atomic_fetch_add_explicit(&count_bytes, size, memory_order_relaxed);
+		}else{
+			atomic_fetch_add_explicit(&count_failures, 1, memory_order_relaxed);
+		}
+	}
+}
+
+static void count_free(void){
+	if(atomic_load_explicit(&counting, memory_order_relaxed)){
+		atomic_fetch_add_explicit(&count_frees, 1, memory_order_relaxed);
+	}
+}
+
+
+#ifndef R_GOOSE_NO_HEAP
+
+// Header in front of each OpenSSL block, a multiple of the alignment of malloc()
+typedef struct crypto_block {
+	size_t size;
+	r_goose_free_fn release;
+	void* ctx;
+} crypto_block;
+
+#define CRYPTO_HEADER	((sizeof(crypto_block) + alignof(max_align_t) - 1) / alignof(max_align_t) * alignof(max_align_t))
+
+static int crypto_hooked = 0;
+
+static crypto_block* crypto_header(void* addr){
+	return (crypto_block*)((uint8_t*)addr - CRYPTO_HEADER);
+}
+
+static void* crypto_malloc(size_t num, const char* file, int line){
+	crypto_block* b = NULL;
+
+	if(num <= SIZE_MAX - CRYPTO_HEADER){
+		b = (crypto_block*)alloc_fn(CRYPTO_HEADER + num, alignof(max_align_t), alloc_ctx);
+	}
+	count_alloc(b, num);
+	if(b == NULL){
+		return NULL;
+	}
+	b->size = num;
+	b->release = free_fn;
+	b->ctx = alloc_ctx;
+	return (uint8_t*)b + CRYPTO_HEADER;
+}
+
+static void crypto_free(void* addr, const char* file, int line){
+	if(addr != NULL){
+		crypto_block* b = crypto_header(addr);
+		count_free();
+		b->release(b, b->ctx);
+	}
+}
+
+static void* crypto_realloc(void* addr, size_t num, const char* file, int line){
+	void* ptr;
+
+	if(addr == NULL){
+		return crypto_malloc(num, file, line);
+	}
+	if(num == 0){
+		crypto_free(addr, file, line);
+		return NULL;
+	}
+	if(num <= crypto_header(addr)->size){
+		return addr;
+	}
+	if((ptr = crypto_malloc(num, file, line)) != NULL){
+		memcpy(ptr, addr, crypto_header(addr)->size);
+		crypto_free(addr, file, line);
+	}
+	return ptr;
+}
+
+#endif
+
+
+int r_goose_set_allocator(r_goose_alloc_fn alloc, r_goose_free_fn release, void* ctx){
+	if((alloc == NULL) != (release == NULL)){
+		return -1;
+	}
+
+	alloc_fn = alloc != NULL ? alloc : default_alloc;
+	free_fn = release != NULL ? release : default_free;
+	alloc_ctx = alloc != NULL ? ctx : NULL;
+
+#ifndef R_GOOSE_NO_HEAP
+	// Fails if OpenSSL has already allocated memory (its blocks could not be released through the wrappers):
+	// the callbacks still serve the library, OpenSSL keeps its own allocator
+	if(!crypto_hooked){
+		if(CRYPTO_set_mem_functions(crypto_malloc, crypto_realloc, crypto_free) != 1){
+			return 1;
+		}
+		crypto_hooked = 1;
+	}
+#endif
+
+	return 0;
+}
+
+int r_goose_alloc_openssl_hooked(void){
+#ifndef R_GOOSE_NO_HEAP
+	return crypto_hooked;
+#else
+	return static_base != NULL;
+#endif
+}
+
+void* r_goose_aligned_alloc(size_t align, size_t size){
+	void* ptr;
+
+	if(align < alignof(max_align_t)){
+		align = alignof(max_align_t);
+	}
+	ptr = alloc_fn(size, align, alloc_ctx);
+	count_alloc(ptr, size);
+
+	return ptr;
+}
+
+void* r_goose_malloc(size_t size){
+	return r_goose_aligned_alloc(alignof(max_align_t), size);
+}
+
+void* r_goose_calloc(size_t count, size_t size){
+	void* ptr;
+
+	if(size != 0 && count > SIZE_MAX / size){
+		return NULL;
+	}
+	ptr = r_goose_malloc(count * size);
+	if(ptr != NULL){
+		memset(ptr, 0, count * size);
+	}
+	return ptr;
+}
+
+void r_goose_free(void* ptr){
+	if(ptr == NULL){
+		return;
+	}
+	count_free();
+	free_fn(ptr, alloc_ctx);
+}
+
+void r_goose_alloc_count(int enable){
+	atomic_store_explicit(&counting, enable != 0, memory_order_relaxed);
+}
+
+void r_goose_alloc_get_stats(r_goose_alloc_stats* stats){
+	stats->allocs = atomic_load_explicit(&count_allocs, memory_order_relaxed);
+	stats->frees = atomic_load_explicit(&count_frees, memory_order_relaxed);
+	stats->bytes = atomic_load_explicit(&count_bytes, memory_order_relaxed);
+	stats->failures = atomic_load_explicit(&count_failures, memory_order_relaxed);
+}
+
+void r_goose_alloc_reset_stats(void){
+	atomic_store_explicit(&count_allocs, 0, memory_order_relaxed);
+	atomic_store_explicit(&count_frees, 0, memory_order_relaxed);
+	atomic_store_explicit(&count_bytes, 0, memory_order_relaxed);
+	atomic_store_explicit(&count_failures, 0, memory_order_relaxed);
+}
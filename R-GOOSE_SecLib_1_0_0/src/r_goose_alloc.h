@@ -0,0 +1,247 @@
+/**
+ * @file r_goose_alloc.h
+ * @author Eduardo Andrade
+ * @date Mar 2020
+ * @brief File containing the declarations of the allocator of the library: every allocation and release of the
+ * library goes through a pair of callbacks, that can be replaced (e.g. by a real-time or per-core allocator), and can
+ * be counted.
+ *
+ * By default the callbacks use malloc()/posix_memalign() and free(). r_goose_set_allocator() replaces them with
+ * callbacks of the application, which receive a context pointer given at registration. Buffers returned by the
+ * library to the application (e.g. @p *dest of r_gooseMessage_InsertHMAC() or hexStringToBytes()) are allocated with
+ * them too, and must be released with r_goose_free(). The first r_goose_set_allocator() also routes the allocations of
+ * OpenSSL (its contexts and tables) to the callbacks, with CRYPTO_set_mem_functions(), unless OpenSSL has already
+ * allocated memory (r_goose_alloc_openssl_hooked()).
+ *
+ * In counting mode (r_goose_alloc_count()) every allocation and release is counted, OpenSSL ones included once the
+ * allocator is set, so a test can run a path of the library between two readings of the counters
+ * (r_goose_alloc_get_stats()) and show whether it allocates.
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * void* rt_alloc(size_t size, size_t align, void* ctx){ return rt_pool_get(ctx, size, align); }	// application allocator
+ * void rt_release(void* ptr, void* ctx){ rt_pool_put(ctx, ptr); }
+ *
+ * r_goose_set_allocator(rt_alloc, rt_release, &core_pool);			// before any other call to the library
+ *
+ * r_goose_alloc_stats before, after;
+ * r_goose_alloc_count(1);
+ * r_goose_alloc_get_stats(&before);
+ * r_gooseMessage_ProtectKeyring(buffer, sizeof(buffer), ring, reader, key_id, NULL, 0);
+ * r_goose_alloc_get_stats(&after);
+ * printf("%llu allocations\n", (unsigned long long)(after.allocs - before.allocs));
+ *
+ * @endcode
+ * @warning The allocator must be set before the library allocates anything, as memory of the library is released with
+ * the allocator in use when it is released (OpenSSL blocks go back to the allocator they came from). The first
+ * r_goose_set_allocator() must also precede any use of OpenSSL by the application.
+ *
+ * No heap build: compiled with @c R_GOOSE_NO_HEAP the library does not reference malloc()/free() at all. Its
+ * allocations, and the ones of OpenSSL, are carved out of static storage given once by the application to
+ * r_goose_static_init(), and released blocks are reused. The storage is budgeted at compile time with the
+ * @c R_GOOSE_*_STORAGE() macros of each module (upper bounds of what their constructors allocate), plus
+ * @c R_GOOSE_STATIC_CRYPTO_STORAGE for OpenSSL. Linking with @c -Wl,--wrap=malloc (and calloc, realloc, free,
+ * posix_memalign, aligned_alloc) turns any remaining heap call of the application or the library into a link error.
+ *
+ * @code
+ *
+ * R_GOOSE_STATIC_STORAGE(storage, R_GOOSE_STATIC_CRYPTO_STORAGE + R_GOOSE_KEYRING_STORAGE(16, 32) +
+ * 		R_GOOSE_SESSION_TABLE_STORAGE(64) + R_GOOSE_MBUF_POOL_STORAGE(32, R_GOOSE_MBUF_HEADROOM, 1600));
+ *
+ * r_goose_static_init(storage, sizeof(storage));		// first call, before OpenSSL is used
+ * ring = r_goose_keyring_new(16);						// init: every object of the application
+ * ...
+ * r_goose_static_get_stats(&stats);					// stats.carved: storage actually needed
+ *
+ * @endcode
+ */
+
+#ifndef R_GOOSE_ALLOC_H
+#define R_GOOSE_ALLOC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+/**
+ * @brief Granularity (and block header size) of the static storage of the no heap build.
+ */
+#define R_GOOSE_STATIC_GRAIN				16
+
+/**
+ * @brief Static storage taken by one allocation of @p size bytes in the no heap build.
+ */
+#define R_GOOSE_STATIC_BLOCK(size)			(((size_t)(size) + R_GOOSE_STATIC_GRAIN - 1) / R_GOOSE_STATIC_GRAIN * R_GOOSE_STATIC_GRAIN + R_GOOSE_STATIC_GRAIN)
+
+/**
+ * @brief Static storage taken by one allocation of @p size bytes aligned to @p align in the no heap build.
+ */
+#define R_GOOSE_STATIC_ALIGNED_BLOCK(size, align)	(R_GOOSE_STATIC_BLOCK(size) + (size_t)(align))
+
+/**
+ * @brief Upper bound of the power of two (at least @p min) that the constructors round @p n up to.
+ */
+#define R_GOOSE_STATIC_POW2(n, min)			((size_t)(n) * 2 > (size_t)(min) ? (size_t)(n) * 2 : (size_t)(min))
+
+/**
+ * @brief Storage taken by OpenSSL in the no heap build: its initialization and the algorithms fetched by the library
+ * (measured with OpenSSL 3.0, with margin). The contexts of the readers are counted by R_GOOSE_KEYRING_STORAGE().
+ * Can be redefined at build time, r_goose_static_get_stats() shows what the application actually needs.
+ */
+#ifndef R_GOOSE_STATIC_CRYPTO_STORAGE
+#define R_GOOSE_STATIC_CRYPTO_STORAGE		(640 * 1024)
+#endif
+
+/**
+ * @brief Storage taken by one OpenSSL context (EVP_MD_CTX or EVP_CIPHER_CTX, with its algorithm state) in the no heap
+ * build (measured with OpenSSL 3.0, with margin).
+ */
+#ifndef R_GOOSE_STATIC_CRYPTO_CONTEXT
+#define R_GOOSE_STATIC_CRYPTO_CONTEXT		2048
+#endif
+
+/**
+ * @brief Declares static storage @p name of @p size bytes for r_goose_static_init().
+ */
+#define R_GOOSE_STATIC_STORAGE(name, size)	static _Alignas(64) uint8_t name[size]
+
+
+/**
+ * @brief Allocation callback: returns @p size bytes aligned to @p align (a power of two, at least the alignment of
+ * malloc()), or NULL.
+ */
+typedef void* (*r_goose_alloc_fn)(size_t size, size_t align, void* ctx);
+
+/**
+ * @brief Release callback: releases memory returned by the allocation callback (@p ptr may be NULL).
+ */
+typedef void (*r_goose_free_fn)(void* ptr, void* ctx);
+
+/**
+ * @brief Counters of the counting mode.
+ */
+typedef struct r_goose_alloc_stats {
+	uint64_t allocs;					// successful allocations
+	uint64_t frees;						// releases (of non NULL pointers)
+	uint64_t bytes;						// bytes requested by the successful allocations
+	uint64_t failures;					// allocations that returned NULL
+} r_goose_alloc_stats;
+
+
+/**
+ * @brief Function that sets the allocation and release callbacks of the library.
+ *
+ * @param alloc Variable (<tt>r_goose_alloc_fn</tt>) with the allocation callback, or NULL for the default
+ * @param release Variable (<tt>r_goose_free_fn</tt>) with the release callback, or NULL for the default
+ * @param ctx Pointer (<tt>void*</tt>) given to the callbacks
+ * @return The function returns 0, -1 if only one of the callbacks is NULL (nothing is set), or 1 if the callbacks are
+ * set but OpenSSL has already allocated memory, so its allocations can't be routed to them
+ * (r_goose_alloc_openssl_hooked() stays 0).
+ * @note In the no heap build OpenSSL always allocates from the storage of r_goose_static_init().
+ * @warning Not thread safe: call it before any other function of the library.
+ */
+int r_goose_set_allocator(r_goose_alloc_fn alloc, r_goose_free_fn release, void* ctx);
+
+/**
+ * @brief Function that tells whether the allocations of OpenSSL go through the allocator of the library (set by
+ * r_goose_set_allocator(), or r_goose_static_init() in the no heap build).
+ *
+ * @return The function returns 1 if they do, 0 otherwise.
+ */
+int r_goose_alloc_openssl_hooked(void);
+
+/**
+ * @brief Function that allocates @p size bytes with the allocator of the library.
+ *
+ * @param size Variable (<tt>size_t</tt>) with the number of bytes
+ * @return The function returns the memory, or NULL.
+ */
+void* r_goose_malloc(size_t size);
+
+/**
+ * @brief Function that allocates @p count elements of @p size bytes, set to zero, with the allocator of the library.
+ *
+ * @param count Variable (<tt>size_t</tt>) with the number of elements
+ * @param size Variable (<tt>size_t</tt>) with the size of an element
+ * @return The function returns the memory, or NULL (also if @p count * @p size overflows).
+ */
+void* r_goose_calloc(size_t count, size_t size);
+
+/**
+ * @brief Function that allocates @p size bytes aligned to @p align with the allocator of the library.
+ *
+ * @param align Variable (<tt>size_t</tt>) with the alignment (a power of two)
+ * @param size Variable (<tt>size_t</tt>) with the number of bytes
+ * @return The function returns the memory, or NULL.
+ */
+void* r_goose_aligned_alloc(size_t align, size_t size);
+
+/**
+ * @brief Function that releases memory allocated by the library (including the buffers it returns to the
+ * application).
+ *
+ * @param ptr Pointer (<tt>void*</tt>) to the memory, or NULL
+ * @return The function doesn't return any value
+ */
+void r_goose_free(void* ptr);
+
+/**
+ * @brief Function that turns the counting mode on (@p enable 1) or off (0). The counters keep their values.
+ *
+ * @param enable Variable (<tt>int</tt>) with the new mode
+ * @return The function doesn't return any value
+ */
+void r_goose_alloc_count(int enable);
+
+/**
+ * @brief Function that reads the counters of the counting mode (thread safe).
+ *
+ * @param stats Pointer (<tt>r_goose_alloc_stats*</tt>) set to the counters
+ * @return The function doesn't return any value
+ */
+void r_goose_alloc_get_stats(r_goose_alloc_stats* stats);
+
+/**
+ * @brief Function that sets the counters of the counting mode to zero.
+ *
+ * @return The function doesn't return any value
+ */
+void r_goose_alloc_reset_stats(void);
+
+
+#ifdef R_GOOSE_NO_HEAP
+
+/**
+ * @brief Usage of the static storage of the no heap build.
+ */
+typedef struct r_goose_static_stats {
+	size_t size;						// bytes given to r_goose_static_init()
+	size_t carved;						// bytes carved so far (the high water mark, released blocks are reused)
+	size_t in_use;						// bytes of the blocks currently allocated
+	uint64_t allocs;					// blocks handed out so far (carved or reused), by the library and OpenSSL
+	uint64_t failures;					// allocations that did not fit
+} r_goose_static_stats;
+
+/**
+ * @brief Function that gives the static storage to the allocator of the no heap build (library and OpenSSL).
+ *
+ * @param storage Pointer (<tt>void*</tt>) to the storage, aligned to 16 bytes (see R_GOOSE_STATIC_STORAGE())
+ * @param size Variable (<tt>size_t</tt>) with the size of the storage
+ * @return The function returns 0, or -1 if the storage was already given, is not aligned, or OpenSSL has already
+ * allocated memory.
+ * @warning Must be the first call to the library and to OpenSSL. The storage is used until the process ends.
+ */
+int r_goose_static_init(void* storage, size_t size);
+
+/**
+ * @brief Function that reads the usage of the static storage (thread safe).
+ *
+ * @param stats Pointer (<tt>r_goose_static_stats*</tt>) set to the usage
+ * @return The function doesn't return any value
+ */
+void r_goose_static_get_stats(r_goose_static_stats* stats);
+
+#endif
+
+#endif
@@ -0,0 +1,171 @@
+/**
+ * @file r_goose_config.h
+ * @author Eduardo Andrade
+ * @date Mar 2020
+ * @brief File containing the compile time selection of the MAC and encryption algorithms of the library.
+ *
+ * By default every algorithm is compiled in. Defining @c R_GOOSE_SELECT_ALGORITHMS compiles in only the algorithms
+ * whose @c R_GOOSE_WITH_<algorithm> macro is defined (the names are the constants of r_goose_security.h): the
+ * branches of the other ones are removed from InsertHMAC/ValidateHMAC/InsertGMAC/ValidateGMAC/Encrypt/Decrypt and
+ * from the key ring, with their primitives (hmac_functions.c, gmac_functions.c, aes_crypto.c, chacha_crypto.c,
+ * blake2_functions.c) and so their OpenSSL references. A disabled algorithm is handled as an unknown one: the
+ * functions return -1 and r_goose_keyring_publish() refuses its keys.
+ *
+ * The selection can be given on the command line or in a configuration file, included through
+ * @c R_GOOSE_CONFIG_FILE. Every file of the library must be built with the same selection.
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * // ied_config.h
+ * #define R_GOOSE_SELECT_ALGORITHMS
+ * #define R_GOOSE_WITH_HMAC_SHA256_80		1
+ * #define R_GOOSE_WITH_AES_128_GCM			1
+ *
+ * gcc -DR_GOOSE_CONFIG_FILE='"ied_config.h"' ...
+ * // or
+ * gcc -DR_GOOSE_SELECT_ALGORITHMS -DR_GOOSE_WITH_HMAC_SHA256_80 -DR_GOOSE_WITH_AES_128_GCM ...
+ *
+ * @endcode
+ * @note MAC_NONE and ENC_NONE are always available. The key ring derives the IV salt with SHA-256, so SHA-256 stays
+ * linked in whatever the selection.
+ */
+
+#ifndef R_GOOSE_CONFIG_H
+#define R_GOOSE_CONFIG_H
+
+#ifdef R_GOOSE_CONFIG_FILE
+#include R_GOOSE_CONFIG_FILE
+#endif
+
+
+#ifndef R_GOOSE_SELECT_ALGORITHMS
+
+// MAC algorithms
+#define R_GOOSE_WITH_HMAC_SHA256_80			1
+#define R_GOOSE_WITH_HMAC_SHA256_128		1
+#define R_GOOSE_WITH_HMAC_SHA256_256		1
+#define R_GOOSE_WITH_GMAC_AES256_64			1
+#define R_GOOSE_WITH_GMAC_AES256_128		1
+#define R_GOOSE_WITH_HMAC_BLAKE2B_80		1
+#define R_GOOSE_WITH_HMAC_BLAKE2S_80		1
+#define R_GOOSE_WITH_GMAC_AES128_64			1
+#define R_GOOSE_WITH_GMAC_AES128_128		1
+#define R_GOOSE_WITH_BLAKE2B_KEYED_80		1
+#define R_GOOSE_WITH_BLAKE2S_KEYED_80		1
+#define R_GOOSE_WITH_CHACHA20_POLY1305_128	1
+#define R_GOOSE_WITH_HMAC_SHA512_256_80		1
+#define R_GOOSE_WITH_HMAC_SHA512_256_128	1
+
+// Encryption algorithms
+#define R_GOOSE_WITH_AES_128_GCM			1
+#define R_GOOSE_WITH_AES_256_GCM			1
+#define R_GOOSE_WITH_CHACHA20_POLY1305		1
+
+#else
+
+// Algorithms not selected are 0, so the macros can also be used in expressions
+#ifndef R_GOOSE_WITH_HMAC_SHA256_80
+#define R_GOOSE_WITH_HMAC_SHA256_80			0
+#endif
+#ifndef R_GOOSE_WITH_HMAC_SHA256_128
+#define R_GOOSE_WITH_HMAC_SHA256_128		0
+#endif
+#ifndef R_GOOSE_WITH_HMAC_SHA256_256
+#define R_GOOSE_WITH_HMAC_SHA256_256		0
+#endif
+#ifndef R_GOOSE_WITH_GMAC_AES256_64
+#define R_GOOSE_WITH_GMAC_AES256_64			0
+#endif
+#ifndef R_GOOSE_WITH_GMAC_AES256_128
+#define R_GOOSE_WITH_GMAC_AES256_128		0
+#endif
+#ifndef R_GOOSE_WITH_HMAC_BLAKE2B_80
+#define R_GOOSE_WITH_HMAC_BLAKE2B_80		0
+#endif
+#ifndef R_GOOSE_WITH_HMAC_BLAKE2S_80
+#define R_GOOSE_WITH_HMAC_BLAKE2S_80		0
+#endif
+#ifndef R_GOOSE_WITH_GMAC_AES128_64
+#define R_GOOSE_WITH_GMAC_AES128_64			0
+#endif
+#ifndef R_GOOSE_WITH_GMAC_AES128_128
+#define R_GOOSE_WITH_GMAC_AES128_128		0
+#endif
+#ifndef R_GOOSE_WITH_BLAKE2B_KEYED_80
+#define R_GOOSE_WITH_BLAKE2B_KEYED_80		0
+#endif
+#ifndef R_GOOSE_WITH_BLAKE2S_KEYED_80
+#define R_GOOSE_WITH_BLAKE2S_KEYED_80		0
+#endif
+#ifndef R_GOOSE_WITH_CHACHA20_POLY1305_128
+#define R_GOOSE_WITH_CHACHA20_POLY1305_128	0
+#endif
+#ifndef R_GOOSE_WITH_HMAC_SHA512_256_80
+#define R_GOOSE_WITH_HMAC_SHA512_256_80		0
+#endif
+#ifndef R_GOOSE_WITH_HMAC_SHA512_256_128
+#define R_GOOSE_WITH_HMAC_SHA512_256_128	0
+#endif
+
+#ifndef R_GOOSE_WITH_AES_128_GCM
+#define R_GOOSE_WITH_AES_128_GCM			0
+#endif
+#ifndef R_GOOSE_WITH_AES_256_GCM
+#define R_GOOSE_WITH_AES_256_GCM			0
+#endif
+#ifndef R_GOOSE_WITH_CHACHA20_POLY1305
+#define R_GOOSE_WITH_CHACHA20_POLY1305		0
+#endif
+
+#endif
+
+
+/**
+ * @brief Bit mask of the compiled in MAC algorithms (bit = algorithm constant, MAC_NONE always set).
+ */
+#define R_GOOSE_MAC_ENABLED_MASK	(1u | \
+		(R_GOOSE_WITH_HMAC_SHA256_80 ? 1u << 1 : 0) | (R_GOOSE_WITH_HMAC_SHA256_128 ? 1u << 2 : 0) | \
+		(R_GOOSE_WITH_HMAC_SHA256_256 ? 1u << 3 : 0) | (R_GOOSE_WITH_GMAC_AES256_64 ? 1u << 4 : 0) | \
+		(R_GOOSE_WITH_GMAC_AES256_128 ? 1u << 5 : 0) | (R_GOOSE_WITH_HMAC_BLAKE2B_80 ? 1u << 6 : 0) | \
+		(R_GOOSE_WITH_HMAC_BLAKE2S_80 ? 1u << 7 : 0) | (R_GOOSE_WITH_GMAC_AES128_64 ? 1u << 8 : 0) | \
+		(R_GOOSE_WITH_GMAC_AES128_128 ? 1u << 9 : 0) | (R_GOOSE_WITH_BLAKE2B_KEYED_80 ? 1u << 10 : 0) | \
+		(R_GOOSE_WITH_BLAKE2S_KEYED_80 ? 1u << 11 : 0) | (R_GOOSE_WITH_CHACHA20_POLY1305_128 ? 1u << 12 : 0) | \
+		(R_GOOSE_WITH_HMAC_SHA512_256_80 ? 1u << 13 : 0) | (R_GOOSE_WITH_HMAC_SHA512_256_128 ? 1u << 14 : 0))
+
+/**
+ * @brief Bit mask of the compiled in encryption algorithms (bit = algorithm constant, ENC_NONE always set).
+ */
+#define R_GOOSE_ENC_ENABLED_MASK	(1u | \
+		(R_GOOSE_WITH_AES_128_GCM ? 1u << 1 : 0) | (R_GOOSE_WITH_AES_256_GCM ? 1u << 2 : 0) | \
+		(R_GOOSE_WITH_CHACHA20_POLY1305 ? 1u << 3 : 0))
+
+/**
+ * @brief 1 if at least one of the HMAC and BLAKE2 algorithms is compiled in.
+ */
+#define R_GOOSE_WITH_ANY_HMAC		(R_GOOSE_WITH_HMAC_SHA256_80 || R_GOOSE_WITH_HMAC_SHA256_128 || R_GOOSE_WITH_HMAC_SHA256_256 || \
+			R_GOOSE_WITH_HMAC_BLAKE2B_80 || R_GOOSE_WITH_HMAC_BLAKE2S_80 || R_GOOSE_WITH_BLAKE2B_KEYED_80 || \
+			R_GOOSE_WITH_BLAKE2S_KEYED_80 || R_GOOSE_WITH_HMAC_SHA512_256_80 || R_GOOSE_WITH_HMAC_SHA512_256_128)
+
+/**
+ * @brief 1 if at least one of the GMAC algorithms (AES-GMAC, Poly1305) is compiled in.
+ */
+#define R_GOOSE_WITH_ANY_GMAC		(R_GOOSE_WITH_GMAC_AES256_64 || R_GOOSE_WITH_GMAC_AES256_128 || \
+			R_GOOSE_WITH_GMAC_AES128_64 || R_GOOSE_WITH_GMAC_AES128_128 || R_GOOSE_WITH_CHACHA20_POLY1305_128)
+
+/**
+ * @brief 1 if at least one of the encryption algorithms is compiled in.
+ */
+#define R_GOOSE_WITH_ANY_ENCRYPTION	(R_GOOSE_WITH_AES_128_GCM || R_GOOSE_WITH_AES_256_GCM || R_GOOSE_WITH_CHACHA20_POLY1305)
+
+/**
+ * @brief 1 if the MAC algorithm @p alg is known and compiled in, 0 otherwise (a constant for a constant @p alg).
+ */
+#define R_GOOSE_MAC_ENABLED(alg)	((unsigned)(alg) < 15 && ((R_GOOSE_MAC_ENABLED_MASK >> (unsigned)(alg)) & 1u))
+
+/**
+ * @brief 1 if the encryption algorithm @p alg is known and compiled in, 0 otherwise.
+ */
+#define R_GOOSE_ENC_ENABLED(alg)	((unsigned)(alg) < 4 && ((R_GOOSE_ENC_ENABLED_MASK >> (unsigned)(alg)) & 1u))
+
+#endif
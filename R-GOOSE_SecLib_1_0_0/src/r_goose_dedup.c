@@ -0,0 +1,191 @@
+/*
+	File defining the R-GOOSE duplicate suppression cache (Custom/Off-Standard)
+
+	Cache:
+		Direct mapped array of 32 byte entries, indexed by a hash of (APPID, SPDU Number, first
+		8 bytes of the MAC Tag). Each entry has its own slot of max_message bytes in a separate
+		array, holding the whole verified message. Entries match when APPID, SPDU Number, size
+		and stored MAC Tag bytes are equal and the entry is younger than ttl_ms; the message
+		bytes are then compared with memcmp, which costs far less than computing the MAC Tag.
+
+		Times are compared modulo 2^32 ms, so now_ms may wrap around.
+
+		SPDU Length is checked against the received length, and against the MAC Tag size, before
+		the MAC Tag is read.
+*/
+
+#include "r_goose_dedup.h"
+
+
+static inline size_t dedup_index(r_goose_dedup* dedup, uint16_t appid, uint32_t spdu_number, const uint8_t* tag){
+	uint64_t t;
+	memcpy(&t, tag, sizeof(t));
+
+	uint64_t h = (((uint64_t)appid << 32) | spdu_number) ^ t;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return (size_t)h & (dedup->capacity - 1);
+}
+
+// Message size (whole SPDU) if the message has a MAC Tag, 0 if it has none, -1 if the SPDU Length doesn't match
+// the received length or leaves no room for the MAC Tag (checked before the MAC Tag is read)
+static inline long dedup_message(uint8_t* buffer, size_t len, size_t* tag_size, uint8_t* tag){
+
+	if(len < INDEX_PAYLOAD || (size_t)decode_4bytesToInt(buffer, INDEX_SPDU_LENGTH) + 10 != len){
+		return -1;
+	}
+
+	int alg = buffer[INDEX_MAC_ALG];
+
+	if(alg == MAC_NONE || alg >= MAC_ALGS_COUNT){
+		return 0;
+	}
+
+	size_t messageSize = len;
+	size_t macSize = MAC_SIZES[alg];
+
+	if(messageSize < INDEX_PAYLOAD + 2 + macSize){
+		return -1;
+	}
+
+	*tag_size = macSize < R_GOOSE_DEDUP_TAG_BYTES ? macSize : R_GOOSE_DEDUP_TAG_BYTES;
+	memset(tag, 0, R_GOOSE_DEDUP_TAG_BYTES);
+	memcpy(tag, &buffer[messageSize - macSize], *tag_size);
+
+	return (long)messageSize;
+}
+
+
+r_goose_dedup* r_goose_dedup_new(size_t entries, size_t max_message, uint32_t ttl_ms){
+	size_t capacity = 16;
+
+	if(entries == 0 || max_message < INDEX_PAYLOAD){
+		return NULL;
+	}
+	while(capacity < entries){
+		capacity <<= 1;
+	}
+
+	r_goose_dedup* dedup = (r_goose_dedup*)r_goose_calloc(1, sizeof(r_goose_dedup));
+	if(dedup == NULL){
+		return NULL;
+	}
+
+	dedup->entries = (r_goose_dedup_entry*)r_goose_calloc(capacity, sizeof(r_goose_dedup_entry));
+	dedup->messages = (uint8_t*)r_goose_malloc(capacity * max_message);
+	if(dedup->entries == NULL || dedup->messages == NULL){
+		r_goose_dedup_free(dedup);
+		return NULL;
+	}
+
+	dedup->capacity = capacity;
+	dedup->max_message = max_message;
+	dedup->ttl_ms = ttl_ms;
+
+	return dedup;
+}
+
+void r_goose_dedup_free(r_goose_dedup* dedup){
+	if(dedup == NULL){
+		return;
+	}
+	r_goose_free(dedup->entries);
+	r_goose_free(dedup->messages);
+	r_goose_free(dedup);
+}
+
+
+int r_goose_dedup_lookup(r_goose_dedup* dedup, uint8_t* buffer, size_t len, uint32_t now_ms){
+	uint8_t tag[R_GOOSE_DEDUP_TAG_BYTES];
+	size_t tag_size;
+	long res = dedup_message(buffer, len, &tag_size, tag);
+
+	if(res == -1){
+		return -1;
+	}
+
+	size_t messageSize = (size_t)res;
+
+	if(messageSize == 0 || messageSize > dedup->max_message){
+		dedup->stats.misses++;
+		return 0;
+	}
+
+	uint16_t appid = decode_2bytesToInt(buffer, INDEX_APPID);
+	uint32_t spdu_number = decode_4bytesToInt(buffer, INDEX_SPDU_NUMBER);
+	size_t idx = dedup_index(dedup, appid, spdu_number, tag);
+	r_goose_dedup_entry* e = &dedup->entries[idx];
+
+	if(e->size == messageSize && e->appid == appid && e->spdu_number == spdu_number &&
+	   now_ms - e->inserted < dedup->ttl_ms && memcmp(e->tag, tag, R_GOOSE_DEDUP_TAG_BYTES) == 0 &&
+	   memcmp(&dedup->messages[idx * dedup->max_message], buffer, messageSize) == 0){
+		dedup->stats.duplicates++;
+		return 1;
+	}
+
+	dedup->stats.misses++;
+	return 0;
+}
+
+int r_goose_dedup_insert(r_goose_dedup* dedup, uint8_t* buffer, size_t len, uint32_t now_ms){
+	uint8_t tag[R_GOOSE_DEDUP_TAG_BYTES];
+	size_t tag_size;
+	long res = dedup_message(buffer, len, &tag_size, tag);
+
+	if(res == -1){
+		return -1;
+	}
+
+	size_t messageSize = (size_t)res;
+
+	if(messageSize == 0){
+		return 0;
+	}
+	if(messageSize > dedup->max_message){
+		dedup->stats.too_large++;
+		return 0;
+	}
+
+	uint16_t appid = decode_2bytesToInt(buffer, INDEX_APPID);
+	uint32_t spdu_number = decode_4bytesToInt(buffer, INDEX_SPDU_NUMBER);
+	size_t idx = dedup_index(dedup, appid, spdu_number, tag);
+	r_goose_dedup_entry* e = &dedup->entries[idx];
+
+	if(e->size != 0 && now_ms - e->inserted < dedup->ttl_ms){
+		dedup->stats.evicted++;
+	}
+
+	e->spdu_number = spdu_number;
+	e->inserted = now_ms;
+	e->size = (uint32_t)messageSize;
+	e->appid = appid;
+	memcpy(e->tag, tag, R_GOOSE_DEDUP_TAG_BYTES);
+	memcpy(&dedup->messages[idx * dedup->max_message], buffer, messageSize);
+
+	dedup->stats.stored++;
+	return 1;
+}
+
+void r_goose_dedup_get_stats(r_goose_dedup* dedup, r_goose_dedup_stats* stats){
+	*stats = dedup->stats;
+}
+
+
+int r_gooseMessage_ValidateDedup(uint8_t* buffer, size_t len, r_goose_dedup* dedup, r_goose_keyring* ring, int reader, uint32_t now_ms){
+
+	int found = r_goose_dedup_lookup(dedup, buffer, len, now_ms);
+	if(found == 1){
+		return R_GOOSE_DUPLICATE;
+	}
+	if(found == -1){
+		return -1;
+	}
+
+	int res = r_gooseMessage_ValidateKeyring(buffer, len, ring, reader);
+	if(res == 1){
+		r_goose_dedup_insert(dedup, buffer, len, now_ms);
+	}
+
+	return res;
+}
@@ -0,0 +1,177 @@
+/**
+ * @file r_goose_dedup.h
+ * @author Eduardo Andrade
+ * @date Mar 2020
+ * @brief File containing the declarations of the R-GOOSE duplicate suppression cache, used by subscribers attached
+ * to redundant networks (PRP/HSR), where every message is received twice.
+ *
+ * Messages whose MAC Tag was verified are stored in the cache, indexed by (APPID, SPDU Number, MAC Tag), for a short
+ * time (@p ttl_ms). When a second copy of the message arrives and is byte-identical to the stored one, it is
+ * reported as a duplicate (R_GOOSE_DUPLICATE) without computing the MAC Tag again.
+ *
+ * The whole message is compared (not only the MAC Tag), so a message with a copied MAC Tag and any other change
+ * is never taken as a duplicate and goes through the normal verification.
+ *
+ * The cache is direct mapped with a fixed number of entries: a new message replaces the one stored at the same
+ * position. Messages larger than @p max_message are not stored.
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * r_goose_dedup* dedup = r_goose_dedup_new(1024, 1500, 100);		// 1024 messages up to 1500 bytes, kept 100 ms
+ *
+ * while(1){
+ * 	size_t len;
+ * 	uint8_t* buffer = receive_packet(&len);							// pseudo-function that receives a packet from LAN A or B
+ *
+ * 	int res = r_gooseMessage_ValidateDedup(buffer, len, dedup, ring, reader, now_ms());	// pseudo-function that returns the time in ms
+ *
+ * 	if(res == 1){
+ * 		process_packet(buffer);										// first copy
+ * 	}else if(res == R_GOOSE_DUPLICATE){
+ * 		// second copy of an authentic message - discarded
+ * 	}
+ * }
+ *
+ * @endcode
+ * @note With r_gooseMessage_ValidateSession() the second copy is already rejected by the replay window
+ * (R_GOOSE_REPLAY) before the MAC Tag verification. This cache is meant for subscribers without a session table, or
+ * that must tell the copies received over the redundant networks apart from replays.
+ * @warning A cache must only be used by one thread.
+ */
+
+#ifndef R_GOOSE_DEDUP_H
+#define R_GOOSE_DEDUP_H
+
+#include "r_goose_security.h"
+#include "r_goose_keyring.h"
+
+// Return value for a byte-identical copy of a message already verified (authentic, MAC Tag not computed)
+#define R_GOOSE_DUPLICATE			4
+
+// Number of MAC Tag bytes stored in each entry (used to index and to filter before comparing the message)
+#define R_GOOSE_DEDUP_TAG_BYTES		16
+
+
+/**
+ * @brief Cache entry (32 bytes). @p size is 0 for empty entries.
+ */
+typedef struct r_goose_dedup_entry {
+	uint32_t spdu_number;
+	uint32_t inserted;
+	uint32_t size;
+	uint16_t appid;
+	uint16_t reserved;
+	uint8_t tag[R_GOOSE_DEDUP_TAG_BYTES];
+} r_goose_dedup_entry;
+
+
+/**
+ * @brief Counters of a duplicate suppression cache.
+ */
+typedef struct r_goose_dedup_stats {
+	uint64_t duplicates;		// Copies answered from the cache
+	uint64_t misses;			// Messages not found (first copies, expired entries, different bytes)
+	uint64_t stored;			// Verified messages stored
+	uint64_t evicted;			// Entries replaced before their expiration
+	uint64_t too_large;			// Messages larger than max_message, not stored
+} r_goose_dedup_stats;
+
+
+/**
+ * @brief Duplicate suppression cache.
+ */
+typedef struct r_goose_dedup {
+	r_goose_dedup_entry* entries;
+	uint8_t* messages;
+	size_t capacity;
+	size_t max_message;
+	uint32_t ttl_ms;
+	r_goose_dedup_stats stats;
+} r_goose_dedup;
+
+/**
+ * @brief Static storage (no heap build) of a duplicate suppression cache of @p entries messages of @p max_message bytes.
+ */
+#define R_GOOSE_DEDUP_STORAGE(entries, max_message)	(R_GOOSE_STATIC_BLOCK(sizeof(r_goose_dedup)) + \
+		R_GOOSE_STATIC_BLOCK(R_GOOSE_STATIC_POW2(entries, 16) * sizeof(r_goose_dedup_entry)) + \
+		R_GOOSE_STATIC_BLOCK(R_GOOSE_STATIC_POW2(entries, 16) * (size_t)(max_message)))
+
+
+/**
+ * @brief Function that creates a duplicate suppression cache.
+ *
+ * @param entries Variable (<tt>size_t</tt>) with the number of entries, rounded up to a power of two
+ * @param max_message Variable (<tt>size_t</tt>) with the size of the largest message stored
+ * @param ttl_ms Variable (<tt>uint32_t</tt>) with the time (ms) a verified message is kept
+ * @return A pointer to the new cache, or NULL if an error occurred.
+ * @note The cache uses @p entries * (32 + @p max_message) bytes. As the copies of a message arrive a few
+ * milliseconds apart, a small number of entries is enough: (messages per second) * @p ttl_ms / 1000, doubled.
+ * @warning The cache must be released with r_goose_dedup_free().
+ */
+r_goose_dedup* r_goose_dedup_new(size_t entries, size_t max_message, uint32_t ttl_ms);
+
+/**
+ * @brief Function that releases a duplicate suppression cache.
+ *
+ * @param dedup Pointer (<tt>r_goose_dedup*</tt>) to the cache
+ * @return The function doesn't return any value
+ */
+void r_goose_dedup_free(r_goose_dedup* dedup);
+
+
+/**
+ * @brief Function that checks if the R-GOOSE message @p buffer is a byte-identical copy of a message verified less
+ * than @p ttl_ms ago.
+ *
+ * @param dedup Pointer (<tt>r_goose_dedup*</tt>) to the cache
+ * @param buffer Pointer (<tt>uint8_t*</tt>) containg to the R-GOOSE message
+ * @param len Variable (<tt>size_t</tt>) with the number of bytes received
+ * @param now_ms Variable (<tt>uint32_t</tt>) with the current time (ms)
+ * @return The function returns 1 if the message is a duplicate, 0 otherwise, and -1 if the message is malformed
+ * (SPDU Length + 10 differs from @p len, or leaves no room for the MAC Tag).
+ */
+int r_goose_dedup_lookup(r_goose_dedup* dedup, uint8_t* buffer, size_t len, uint32_t now_ms);
+
+/**
+ * @brief Function that stores the R-GOOSE message @p buffer in the cache.
+ *
+ * Must only be called after the MAC Tag of the message was verified.
+ *
+ * @param dedup Pointer (<tt>r_goose_dedup*</tt>) to the cache
+ * @param buffer Pointer (<tt>uint8_t*</tt>) containg to the R-GOOSE message
+ * @param len Variable (<tt>size_t</tt>) with the number of bytes received
+ * @param now_ms Variable (<tt>uint32_t</tt>) with the current time (ms)
+ * @return The function returns 1 if the message was stored, 0 if it has no MAC Tag or is larger than max_message,
+ * and -1 if the message is malformed.
+ */
+int r_goose_dedup_insert(r_goose_dedup* dedup, uint8_t* buffer, size_t len, uint32_t now_ms);
+
+/**
+ * @brief Function that copies the counters of @p dedup to @p stats.
+ *
+ * @param dedup Pointer (<tt>r_goose_dedup*</tt>) to the cache
+ * @param stats Pointer (<tt>r_goose_dedup_stats*</tt>) to the destination
+ * @return The function doesn't return any value
+ */
+void r_goose_dedup_get_stats(r_goose_dedup* dedup, r_goose_dedup_stats* stats);
+
+
+/**
+ * @brief Function that validates an R-GOOSE message received over redundant networks.
+ *
+ * Duplicates of messages already verified are answered from the cache. Other messages are validated with
+ * r_gooseMessage_ValidateKeyring(), and stored in the cache when the MAC Tag is valid.
+ *
+ * @param buffer Pointer (<tt>uint8_t*</tt>) containg to the R-GOOSE message
+ * @param len Variable (<tt>size_t</tt>) with the number of bytes received
+ * @param dedup Pointer (<tt>r_goose_dedup*</tt>) to the cache
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the key ring reader identifier
+ * @param now_ms Variable (<tt>uint32_t</tt>) with the current time (ms)
+ * @return The function returns R_GOOSE_DUPLICATE (4) for a copy of a message already verified, and otherwise the
+ * value of r_gooseMessage_ValidateKeyring() (-1 error/unknown key/malformed message, 0 invalid, 1 valid, 2 no MAC Tag).
+ */
+int r_gooseMessage_ValidateDedup(uint8_t* buffer, size_t len, r_goose_dedup* dedup, r_goose_keyring* ring, int reader, uint32_t now_ms);
+
+#endif
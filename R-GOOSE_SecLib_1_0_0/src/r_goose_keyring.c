@@ -0,0 +1,1870 @@
+/*
+	File defining the R-GOOSE key ring (Custom/Off-Standard)
+
+	Table:
+		Open addressing (linear probing) array of atomic pointers to immutable key entries.
+		Slots are NULL (never used), TOMBSTONE (retired) or point to a live entry. Only the
+		writer thread stores into slots; readers only load them. A publish reuses the first
+		tombstone on its probe sequence; when tombstones reach capacity / 4 (with at most
+		capacity / 2 live entries, a quarter of the slots stays NULL and probes stay bounded)
+		the writer rebuilds the live entries in the spare array, swaps the table pointer and
+		retires the old array under the epoch scheme; once reclaimed it becomes the spare. A
+		reader loads the table pointer once per lookup, so it probes either array consistently.
+
+	Reclamation:
+		Global epoch starts at 1. A reader stores the epoch it observed on enter and 0 on exit.
+		A retired entry is tagged with the epoch at retirement (after it was unlinked) and the
+		global epoch is advanced. It is released when every reader is either outside a read
+		section (0) or entered after the retirement (epoch > tag).
+
+	Rotation:
+		rollover = TimeOfCurrentKey + TimeToNextKey * 60. The tick publishes the successor at
+		rollover - lead (states built and exercised once, so no lazy initialization is left
+		for the first packet) and retires the old key at rollover + overlap.
+
+	Contexts:
+		HMAC and BLAKE2 MACs run on plain hash states (SHA256_CTX, SHA512_CTX, blake2X_state)
+		prebuilt in the key entry and copied by value, with the low level SHA-2 functions, which
+		don't allocate (EVP_MD_CTX_copy_ex() does, once per message). The cipher contexts are
+		held by the key entry, one per reader and use (MAC, payload), in a slot written only by
+		that reader (or by the writer before publication) and released with the entry. Publish
+		builds and keys them for every registered reader; a reader registered later builds its
+		own on its first message under the key. A message only sets the IV, so a reader that
+		alternates between streams never expands a key schedule again (one context per reader
+		per cipher, keyed again on each key change, did). Fan-out destinations that share a key
+		in one call need distinct contexts: the second one uses a per-reader set, keyed again
+		on a key change. A MAC key outside a key ring (r_goose_mac_key, the C++ Key) is one entry
+		keyed when built, using the slot of reader 0. Besides r_goose_mac_key_tag() it has one
+		entry point per MAC family, the hash or cipher inlined as a constant, which the C++
+		interface picks at compile time.
+
+	Protect/Unprotect:
+		the MAC is computed incrementally (init/update/final on the reader contexts). The payload
+		is processed in R_GOOSE_PROTECT_CHUNK byte chunks: encrypted then given to the MAC, or
+		given to the MAC then decrypted, so the MAC reads each chunk while it is still in cache.
+		Every cipher/MAC call has a fixed cost, so chunks are large: a message up to 16 KB is one
+		chunk (cipher pass then MAC pass), and 4 KB chunks were slower than two passes. GCM and
+		ChaCha20 are a keystream xor (the GCM tag is not carried by the message, the MAC Tag
+		protects the ciphertext), so the payload of a message found invalid is restored by
+		applying the keystream again. The payload cipher uses the enc contexts of the reader, as a
+		GMAC key needs its mac context at the same time.
+
+	IVs:
+		IV = salt || SPDU Number, salt = SHA-256("R-GOOSE IV salt" || key) truncated to 8 bytes,
+		so both ends derive it. Uniqueness only needs unique SPDU Numbers per key: they are
+		handed out from a 64-bit atomic counter of the key entry (fetch_add per block), and no
+		block is granted past 2^32. A replacement (same APPID and Key ID) carries the counter
+		over. GMAC MAC Tags keep the all-zero IV of the message format; Poly1305 MAC Tags use
+		their own salt || SPDU Number (chacha_crypto.c), a one-time key per message.
+
+	Scatter-gather:
+		the V functions take the message as an iovec array, split at any byte (header fields
+		included). The 38 header bytes are gathered into a local copy, patched and scattered
+		back; the payload and trailer are walked with a cursor that yields the contiguous
+		pieces of each fragment (at most R_GOOSE_PROTECT_CHUNK bytes), so nothing is copied.
+*/
+
+// SHA256_Init()/SHA512_Init() and friends: the only SHA-2 interface that runs on caller owned states
+#define OPENSSL_SUPPRESS_DEPRECATED
+
+#include "r_goose_keyring.h"
+
+
+static r_goose_key tombstone_entry;
+#define TOMBSTONE	(&tombstone_entry)
+
+// Counter value of a replaced entry: far past 2^32, so every later reservation fails
+#define R_GOOSE_IV_CLOSED	((uint64_t)1 << 62)
+
+// All-zero IV, as used by r_gooseMessage_InsertGMAC()/ValidateGMAC()
+static const uint8_t zero_iv[12] = {0};
+
+// Context slots of a reader in a key entry (written by that reader only, or by the writer before the entry is published)
+#define KEY_MAC_CTX(k, reader)		(&((r_goose_key*)(k))->mac_ctx[reader])
+#define KEY_ENC_CTX(k, reader)		(&((r_goose_key*)(k))->enc_ctx[reader])
+
+
+static void keyring_table_clear(r_goose_keyring_table* t, size_t capacity){
+	for(size_t i = 0; i < capacity; i++){
+		atomic_init(&t->slots[i], NULL);
+	}
+}
+
+static r_goose_keyring_table* keyring_table_new(size_t capacity){
+	r_goose_keyring_table* t = (r_goose_keyring_table*)r_goose_calloc(1, sizeof(r_goose_keyring_table) + capacity * sizeof(t->slots[0]));
+	if(t != NULL){
+		keyring_table_clear(t, capacity);
+	}
+	return t;
+}
+
+static size_t keyring_hash(r_goose_keyring* ring, uint16_t appid, uint32_t key_id){
+	uint64_t h = ((uint64_t)appid << 32) | key_id;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return (size_t)h & (ring->capacity - 1);
+}
+
+// Only the algorithms compiled in (r_goose_config.h) have a case
+static int hmac_hash(int alg){
+	switch(alg){
+#if R_GOOSE_WITH_HMAC_SHA256_80
+		case HMAC_SHA256_80:		return R_GOOSE_HASH_SHA256;
+#endif
+#if R_GOOSE_WITH_HMAC_SHA256_128
+		case HMAC_SHA256_128:		return R_GOOSE_HASH_SHA256;
+#endif
+#if R_GOOSE_WITH_HMAC_SHA256_256
+		case HMAC_SHA256_256:		return R_GOOSE_HASH_SHA256;
+#endif
+#if R_GOOSE_WITH_HMAC_BLAKE2B_80
+		case HMAC_BLAKE2B_80:		return R_GOOSE_HASH_BLAKE2B;
+#endif
+#if R_GOOSE_WITH_HMAC_BLAKE2S_80
+		case HMAC_BLAKE2S_80:		return R_GOOSE_HASH_BLAKE2S;
+#endif
+#if R_GOOSE_WITH_HMAC_SHA512_256_80
+		case HMAC_SHA512_256_80:	return R_GOOSE_HASH_SHA512_256;
+#endif
+#if R_GOOSE_WITH_HMAC_SHA512_256_128
+		case HMAC_SHA512_256_128:	return R_GOOSE_HASH_SHA512_256;
+#endif
+	}
+	return R_GOOSE_HASH_NONE;
+}
+
+static int mac_cipher(int alg){
+	switch(alg){
+#if R_GOOSE_WITH_GMAC_AES256_64
+		case GMAC_AES256_64:		return R_GOOSE_CIPHER_AES256_GCM;
+#endif
+#if R_GOOSE_WITH_GMAC_AES256_128
+		case GMAC_AES256_128:		return R_GOOSE_CIPHER_AES256_GCM;
+#endif
+#if R_GOOSE_WITH_GMAC_AES128_64
+		case GMAC_AES128_64:		return R_GOOSE_CIPHER_AES128_GCM;
+#endif
+#if R_GOOSE_WITH_GMAC_AES128_128
+		case GMAC_AES128_128:		return R_GOOSE_CIPHER_AES128_GCM;
+#endif
+#if R_GOOSE_WITH_CHACHA20_POLY1305_128
+		case CHACHA20_POLY1305_128:	return R_GOOSE_CIPHER_CHACHA20_POLY1305;
+#endif
+	}
+	return R_GOOSE_CIPHER_NONE;
+}
+
+static int enc_cipher(int alg){
+	switch(alg){
+#if R_GOOSE_WITH_AES_128_GCM
+		case AES_128_GCM:			return R_GOOSE_CIPHER_AES128_GCM;
+#endif
+#if R_GOOSE_WITH_AES_256_GCM
+		case AES_256_GCM:			return R_GOOSE_CIPHER_AES256_GCM;
+#endif
+#if R_GOOSE_WITH_CHACHA20_POLY1305
+		case CHACHA20_POLY1305:		return R_GOOSE_CIPHER_CHACHA20_POLY1305;
+#endif
+	}
+	return R_GOOSE_CIPHER_NONE;
+}
+
+static const EVP_CIPHER* cipher_of(int cipher){
+	switch(cipher){
+		case R_GOOSE_CIPHER_AES128_GCM:			return EVP_aes_128_gcm();
+		case R_GOOSE_CIPHER_AES256_GCM:			return EVP_aes_256_gcm();
+		case R_GOOSE_CIPHER_CHACHA20_POLY1305:	return EVP_chacha20_poly1305();
+	}
+	return NULL;
+}
+
+/* New context of the cipher, key not set */
+static EVP_CIPHER_CTX* cipher_ctx_new(int cipher){
+	EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+
+	if(ctx != NULL && EVP_EncryptInit_ex(ctx, cipher_of(cipher), NULL, NULL, NULL) != 1){
+		EVP_CIPHER_CTX_free(ctx);
+		return NULL;
+	}
+	return ctx;
+}
+
+/* Key schedule is expanded here, the IV is set per message */
+static int cipher_ctx_set_key(EVP_CIPHER_CTX* ctx, const r_goose_key* k){
+	if(EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN, 12, NULL) != 1 ||
+	   EVP_EncryptInit_ex(ctx, NULL, NULL, k->key, NULL) != 1){
+		return -1;
+	}
+	return 0;
+}
+
+/* Returns the context in @p slot (a context slot of @p k), created and keyed with @p k if the slot is empty */
+static EVP_CIPHER_CTX* key_cipher_ctx(EVP_CIPHER_CTX** slot, int cipher, const r_goose_key* k){
+	if(*slot == NULL){
+		EVP_CIPHER_CTX* ctx = cipher_ctx_new(cipher);
+		if(ctx == NULL || cipher_ctx_set_key(ctx, k) != 0){
+			EVP_CIPHER_CTX_free(ctx);
+			return NULL;
+		}
+		*slot = ctx;
+	}
+	return *slot;
+}
+
+/* Returns the context of @p set for the cipher, keyed with @p k (created on first use, keyed again only on a key change) */
+static EVP_CIPHER_CTX* cipher_set_key(r_goose_cipher_set* set, int cipher, const r_goose_key* k){
+	int c = cipher - 1;
+
+	if(set->ctx[c] == NULL){
+		if((set->ctx[c] = cipher_ctx_new(cipher)) == NULL){
+			return NULL;
+		}
+		set->serial[c] = 0;
+	}
+	if(set->serial[c] != k->serial){
+		set->serial[c] = 0;
+		if(cipher_ctx_set_key(set->ctx[c], k) != 0){
+			return NULL;
+		}
+		set->serial[c] = k->serial;
+	}
+	return set->ctx[c];
+}
+
+static void cipher_set_free(r_goose_cipher_set* set){
+	for(int c = 0; c < R_GOOSE_CIPHERS; c++){
+		EVP_CIPHER_CTX_free(set->ctx[c]);
+		set->ctx[c] = NULL;
+		set->serial[c] = 0;
+	}
+}
+
+
+// Hash functions of the HMAC algorithms, on caller owned states (nothing allocated)
+static const uint64_t sha512_256_iv[8] = {
+	0x22312194FC2BF72CULL, 0x9F555FA3C84C64C2ULL, 0x2393B86B6F53B151ULL, 0x963877195940EABDULL,
+	0x96283EE2A88EFFE3ULL, 0xBE5E1E2553863992ULL, 0x2B0199FC2C85B8AAULL, 0x0EB72DDC81C52CA2ULL
+};
+
+static size_t hash_block_size(int hash){
+	return hash == R_GOOSE_HASH_SHA512_256 || hash == R_GOOSE_HASH_BLAKE2B ? 128 : 64;
+}
+
+static int hash_init(int hash, r_goose_hash_state* h){
+	switch(hash){
+		case R_GOOSE_HASH_SHA256:
+			return SHA256_Init(&h->sha256) == 1 ? 0 : -1;
+		case R_GOOSE_HASH_SHA512_256:
+			// SHA-512/256 (FIPS 180-4): SHA-512 with its own initial value, truncated to 32 bytes
+			if(SHA512_Init(&h->sha512) != 1){
+				return -1;
+			}
+			memcpy(h->sha512.h, sha512_256_iv, sizeof(sha512_256_iv));
+			h->sha512.md_len = 32;
+			return 0;
+#if R_GOOSE_WITH_BLAKE2B
+		case R_GOOSE_HASH_BLAKE2B:
+			return blake2b_init_key(&h->blake2b, BLAKE2B_OUTBYTES, NULL, 0, 1);
+#endif
+#if R_GOOSE_WITH_BLAKE2S
+		case R_GOOSE_HASH_BLAKE2S:
+			return blake2s_init_key(&h->blake2s, BLAKE2S_OUTBYTES, NULL, 0, 1);
+#endif
+	}
+	return -1;
+}
+
+static int hash_update(int hash, r_goose_hash_state* h, const uint8_t* data, size_t data_size){
+	switch(hash){
+		case R_GOOSE_HASH_SHA256:
+			return SHA256_Update(&h->sha256, data, data_size) == 1 ? 0 : -1;
+		case R_GOOSE_HASH_SHA512_256:
+			return SHA512_Update(&h->sha512, data, data_size) == 1 ? 0 : -1;
+#if R_GOOSE_WITH_BLAKE2B
+		case R_GOOSE_HASH_BLAKE2B:
+			blake2b_update(&h->blake2b, data, data_size);
+			return 0;
+#endif
+#if R_GOOSE_WITH_BLAKE2S
+		case R_GOOSE_HASH_BLAKE2S:
+			blake2s_update(&h->blake2s, data, data_size);
+			return 0;
+#endif
+	}
+	return -1;
+}
+
+// Returns the digest size, or -1
+static int hash_final(int hash, r_goose_hash_state* h, uint8_t* dest){
+	switch(hash){
+		case R_GOOSE_HASH_SHA256:
+			return SHA256_Final(dest, &h->sha256) == 1 ? SHA256_DIGEST_LENGTH : -1;
+		case R_GOOSE_HASH_SHA512_256:
+			return SHA512_Final(dest, &h->sha512) == 1 ? 32 : -1;
+#if R_GOOSE_WITH_BLAKE2B
+		case R_GOOSE_HASH_BLAKE2B:
+			blake2b_final(&h->blake2b, dest);
+			return BLAKE2B_OUTBYTES;
+#endif
+#if R_GOOSE_WITH_BLAKE2S
+		case R_GOOSE_HASH_BLAKE2S:
+			blake2s_final(&h->blake2s, dest);
+			return BLAKE2S_OUTBYTES;
+#endif
+	}
+	return -1;
+}
+
+/* HMAC(K, m) = H((K ^ opad) || H((K ^ ipad) || m)) - both padded key blocks are absorbed once */
+static int build_hmac(r_goose_key* k, int hash){
+	uint8_t block[128], pad[128];
+	size_t block_size = hash_block_size(hash);
+
+	memset(block, 0, sizeof(block));
+	if(k->key_size > block_size){
+		r_goose_hash_state h;
+		if(hash_init(hash, &h) != 0 || hash_update(hash, &h, k->key, k->key_size) != 0 || hash_final(hash, &h, block) < 0){
+			return -1;
+		}
+	}else{
+		memcpy(block, k->key, k->key_size);
+	}
+
+	k->hmac_hash = hash;
+
+	for(size_t i = 0; i < block_size; i++){
+		pad[i] = block[i] ^ 0x36;
+	}
+	if(hash_init(hash, &k->hmac_inner) != 0 || hash_update(hash, &k->hmac_inner, pad, block_size) != 0){
+		return -1;
+	}
+
+	for(size_t i = 0; i < block_size; i++){
+		pad[i] = block[i] ^ 0x5c;
+	}
+	if(hash_init(hash, &k->hmac_outer) != 0 || hash_update(hash, &k->hmac_outer, pad, block_size) != 0){
+		return -1;
+	}
+
+	return 0;
+}
+
+static void key_free(r_goose_key* k){
+	if(k == NULL || k == TOMBSTONE){
+		return;
+	}
+	for(int i = 0; i < R_GOOSE_KEYRING_MAX_READERS; i++){
+		EVP_CIPHER_CTX_free(k->mac_ctx[i]);
+		EVP_CIPHER_CTX_free(k->enc_ctx[i]);
+	}
+	OPENSSL_cleanse(k, sizeof(*k));
+	r_goose_free(k);
+}
+
+static int key_warm_up(r_goose_keyring* ring, const r_goose_key* k);
+
+/* IV salt = first bytes of SHA-256(label || key), the same on every node holding the key */
+static int key_iv_salt(r_goose_key* k){
+	static const char label[] = "R-GOOSE IV salt";
+	uint8_t digest[SHA256_DIGEST_LENGTH];
+	r_goose_hash_state h;
+
+	if(hash_init(R_GOOSE_HASH_SHA256, &h) != 0 ||
+	   hash_update(R_GOOSE_HASH_SHA256, &h, (const uint8_t*)label, sizeof(label) - 1) != 0 ||
+	   hash_update(R_GOOSE_HASH_SHA256, &h, k->key, k->key_size) != 0 ||
+	   hash_final(R_GOOSE_HASH_SHA256, &h, digest) < 0){
+		return -1;
+	}
+	memcpy(k->iv_salt, digest, R_GOOSE_IV_SALT_SIZE);
+	return 0;
+}
+
+static r_goose_key* key_new(uint16_t appid, uint32_t key_id, int mac_alg, int enc_alg, uint8_t* key, size_t key_size,
+							uint32_t timeOfCurrentKey, uint16_t timeToNextKey){
+	int hash;
+
+	if(!R_GOOSE_MAC_ENABLED(mac_alg) || key_size > R_GOOSE_KEYRING_MAX_KEY){
+		return NULL;
+	}
+	if(enc_alg != ENC_NONE && enc_cipher(enc_alg) == R_GOOSE_CIPHER_NONE){
+		return NULL;
+	}
+
+	r_goose_key* k = (r_goose_key*)r_goose_calloc(1, sizeof(r_goose_key));
+	if(k == NULL){
+		return NULL;
+	}
+
+	k->appid = appid;
+	k->key_id = key_id;
+	k->mac_alg = mac_alg;
+	k->enc_alg = enc_alg;
+	memcpy(k->key, key, key_size);
+	k->key_size = key_size;
+	k->timeOfCurrentKey = timeOfCurrentKey;
+	k->timeToNextKey = timeToNextKey;
+
+	if((hash = hmac_hash(mac_alg)) != R_GOOSE_HASH_NONE){
+		if(build_hmac(k, hash) != 0){
+			goto error;
+		}
+	}
+#if R_GOOSE_WITH_BLAKE2B_KEYED_80
+	else if(mac_alg == BLAKE2B_KEYED_80){
+		if(blake2b_init_key(&k->blake2b, 10, key, key_size, 1) != 0){
+			goto error;
+		}
+	}
+#endif
+#if R_GOOSE_WITH_BLAKE2S_KEYED_80
+	else if(mac_alg == BLAKE2S_KEYED_80){
+		if(blake2s_init_key(&k->blake2s, 10, key, key_size, 1) != 0){
+			goto error;
+		}
+	}
+#endif
+	else if((k->mac_cipher = mac_cipher(mac_alg)) != R_GOOSE_CIPHER_NONE){
+		if(key_size < (size_t)EVP_CIPHER_key_length(cipher_of(k->mac_cipher))){
+			goto error;
+		}
+#if R_GOOSE_WITH_CHACHA20_POLY1305_128
+		if(mac_alg == CHACHA20_POLY1305_128 && poly1305_CHACHA20_salt(k->key, k->mac_nonce_salt) != 0){
+			goto error;
+		}
+#endif
+	}
+
+	if(key_iv_salt(k) != 0){
+		goto error;
+	}
+	atomic_init(&k->iv_counter, 0);
+
+	if(enc_alg != ENC_NONE){
+		k->enc_cipher = enc_cipher(enc_alg);
+		if(key_size < (size_t)EVP_CIPHER_key_length(cipher_of(k->enc_cipher))){
+			goto error;
+		}
+	}
+
+	return k;
+
+error:
+	key_free(k);
+	return NULL;
+}
+
+
+r_goose_keyring* r_goose_keyring_new(size_t capacity){
+	size_t cap = 16;
+
+	while(cap < capacity * 2){
+		// Load factor kept at or below 50% - short probe sequences
+		cap <<= 1;
+	}
+
+	r_goose_keyring* ring = (r_goose_keyring*)r_goose_calloc(1, sizeof(r_goose_keyring));
+	if(ring == NULL){
+		return NULL;
+	}
+
+	r_goose_keyring_table* table = keyring_table_new(cap);
+	ring->spare = keyring_table_new(cap);
+	if(table == NULL || ring->spare == NULL){
+		r_goose_free(table);
+		r_goose_free(ring->spare);
+		r_goose_free(ring);
+		return NULL;
+	}
+
+	atomic_init(&ring->table, table);
+	ring->capacity = cap;
+	ring->lead = R_GOOSE_KEYRING_LEAD_DEFAULT;
+	ring->overlap = R_GOOSE_KEYRING_OVERLAP_DEFAULT;
+	atomic_init(&ring->epoch, 1);
+	for(int i = 0; i < R_GOOSE_KEYRING_MAX_READERS; i++){
+		atomic_init(&ring->readers[i].epoch, 0);
+		atomic_init(&ring->readers[i].in_use, 0);
+	}
+
+	return ring;
+}
+
+void r_goose_keyring_free(r_goose_keyring* ring){
+	if(ring == NULL){
+		return;
+	}
+
+	r_goose_keyring_table* table = atomic_load(&ring->table);
+
+	for(size_t i = 0; i < ring->capacity; i++){
+		key_free(atomic_load(&table->slots[i]));
+	}
+	while(ring->retired != NULL){
+		r_goose_key* next = ring->retired->retired_next;
+		key_free(ring->retired);
+		ring->retired = next;
+	}
+	r_goose_free(ring->retired_table);
+	r_goose_free(ring->spare);
+	for(int i = 0; i < R_GOOSE_KEYRING_MAX_READERS; i++){
+		for(int t = 0; t < R_GOOSE_FANOUT_MAX; t++){
+			cipher_set_free(&ring->readers[i].fan_mac[t]);
+			cipher_set_free(&ring->readers[i].fan_enc[t]);
+		}
+	}
+
+	r_goose_free(table);
+	r_goose_free(ring);
+}
+
+
+static void keyring_retire_entry(r_goose_keyring* ring, r_goose_key* k){
+	// Entry is already unlinked - tag it with the current epoch and advance
+	k->retired_epoch = atomic_load(&ring->epoch);
+	k->retired_next = ring->retired;
+	ring->retired = k;
+	atomic_fetch_add(&ring->epoch, 1);
+}
+
+int r_goose_keyring_reclaim(r_goose_keyring* ring){
+	uint64_t oldest = UINT64_MAX;
+	int pending = 0;
+
+	for(int i = 0; i < R_GOOSE_KEYRING_MAX_READERS; i++){
+		uint64_t e = atomic_load(&ring->readers[i].epoch);
+		if(e != 0 && e < oldest){
+			oldest = e;
+		}
+	}
+
+	r_goose_key** prev = &ring->retired;
+	while(*prev != NULL){
+		r_goose_key* k = *prev;
+		if(k->retired_epoch < oldest){
+			*prev = k->retired_next;
+			key_free(k);
+		}else{
+			prev = &k->retired_next;
+			pending++;
+		}
+	}
+
+	if(ring->retired_table != NULL){
+		if(ring->retired_table->retired_epoch < oldest){
+			ring->spare = ring->retired_table;
+			ring->retired_table = NULL;
+		}else{
+			pending++;
+		}
+	}
+
+	return pending;
+}
+
+// Rebuilds the table without tombstones in the spare array. Skipped (tombstones kept, retried by the next retire)
+// while the array replaced last time may still be read by a reader.
+static void keyring_compact(r_goose_keyring* ring){
+	r_goose_keyring_table* old = atomic_load_explicit(&ring->table, memory_order_relaxed);
+	r_goose_keyring_table* table = ring->spare;
+	size_t mask = ring->capacity - 1;
+
+	if(table == NULL){
+		return;
+	}
+	ring->spare = NULL;
+	keyring_table_clear(table, ring->capacity);
+
+	for(size_t i = 0; i < ring->capacity; i++){
+		r_goose_key* k = atomic_load_explicit(&old->slots[i], memory_order_relaxed);
+		if(k == NULL || k == TOMBSTONE){
+			continue;
+		}
+		size_t idx = keyring_hash(ring, k->appid, k->key_id);
+		while(atomic_load_explicit(&table->slots[idx], memory_order_relaxed) != NULL){
+			idx = (idx + 1) & mask;
+		}
+		atomic_init(&table->slots[idx], k);
+	}
+
+	// Readers that loaded the old pointer keep probing the old array, released once they have all exited
+	atomic_store(&ring->table, table);
+	ring->tombstones = 0;
+
+	old->retired_epoch = atomic_load(&ring->epoch);
+	ring->retired_table = old;
+	atomic_fetch_add(&ring->epoch, 1);
+}
+
+int r_goose_keyring_publish(r_goose_keyring* ring, uint16_t appid, uint32_t key_id, int mac_alg, int enc_alg,
+							uint8_t* key, size_t key_size, uint32_t timeOfCurrentKey, uint16_t timeToNextKey){
+
+	r_goose_keyring_table* table = atomic_load_explicit(&ring->table, memory_order_relaxed);
+	_Atomic(r_goose_key*)* free_slot = NULL;
+	size_t mask = ring->capacity - 1;
+	size_t idx = keyring_hash(ring, appid, key_id);
+
+	r_goose_key* k = key_new(appid, key_id, mac_alg, enc_alg, key, key_size, timeOfCurrentKey, timeToNextKey);
+	if(k == NULL){
+		return -1;
+	}
+	k->serial = ++ring->serial;
+	if(key_warm_up(ring, k) != 0){
+		key_free(k);
+		return -1;
+	}
+
+	for(size_t i = 0; i < ring->capacity; i++, idx = (idx + 1) & mask){
+		r_goose_key* cur = atomic_load_explicit(&table->slots[idx], memory_order_relaxed);
+
+		if(cur == NULL){
+			if(free_slot == NULL){
+				free_slot = &table->slots[idx];
+			}
+			break;
+		}
+		if(cur == TOMBSTONE){
+			if(free_slot == NULL){
+				free_slot = &table->slots[idx];
+			}
+			continue;
+		}
+		if(cur->appid == appid && cur->key_id == key_id){
+			// Key replacement - readers see either the old or the new entry. The old counter is closed (later
+			// reservations under it fail) and the new entry continues from it, so no SPDU Number (IV) is
+			// handed out twice under the same (APPID, Key ID)
+			uint64_t used = atomic_exchange(&cur->iv_counter, R_GOOSE_IV_CLOSED);
+			if(used > atomic_load_explicit(&k->iv_counter, memory_order_relaxed)){
+				atomic_store_explicit(&k->iv_counter, used, memory_order_relaxed);
+			}
+			atomic_store(&table->slots[idx], k);
+			keyring_retire_entry(ring, cur);
+			r_goose_keyring_reclaim(ring);
+			return 1;
+		}
+	}
+
+	if(free_slot == NULL || ring->count * 2 >= ring->capacity){
+		key_free(k);
+		return -1;
+	}
+
+	if(atomic_load_explicit(free_slot, memory_order_relaxed) == TOMBSTONE){
+		ring->tombstones--;
+	}
+	atomic_store(free_slot, k);
+	ring->count++;
+
+	r_goose_keyring_reclaim(ring);
+	return 1;
+}
+
+int r_goose_keyring_retire(r_goose_keyring* ring, uint16_t appid, uint32_t key_id){
+	r_goose_keyring_table* table = atomic_load_explicit(&ring->table, memory_order_relaxed);
+	size_t mask = ring->capacity - 1;
+	size_t idx = keyring_hash(ring, appid, key_id);
+
+	for(size_t i = 0; i < ring->capacity; i++, idx = (idx + 1) & mask){
+		r_goose_key* cur = atomic_load_explicit(&table->slots[idx], memory_order_relaxed);
+
+		if(cur == NULL){
+			break;
+		}
+		if(cur != TOMBSTONE && cur->appid == appid && cur->key_id == key_id){
+			atomic_store(&table->slots[idx], TOMBSTONE);
+			ring->count--;
+			ring->tombstones++;
+			keyring_retire_entry(ring, cur);
+			r_goose_keyring_reclaim(ring);
+			if(ring->tombstones * 4 >= ring->capacity){
+				keyring_compact(ring);
+			}
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+void r_goose_keyring_set_schedule(r_goose_keyring* ring, uint32_t lead, uint32_t overlap, r_goose_next_key_fn next_key, void* arg){
+	ring->lead = lead;
+	ring->overlap = overlap;
+	ring->next_key = next_key;
+	ring->next_key_arg = arg;
+}
+
+int r_goose_keyring_tick(r_goose_keyring* ring, uint32_t now, int* failed){
+	r_goose_key_material next;
+	int published = 0, failures = 0;
+
+	for(size_t i = 0; i < ring->capacity; i++){
+		// Loaded again every time: a retire below may have compacted the table (an entry moved by it is
+		// skipped or seen twice, both harmless - it is handled on the next tick, or found already handled)
+		r_goose_keyring_table* table = atomic_load_explicit(&ring->table, memory_order_relaxed);
+		r_goose_key* k = atomic_load_explicit(&table->slots[i], memory_order_relaxed);
+
+		if(k == NULL || k == TOMBSTONE || k->timeToNextKey == 0){
+			continue;
+		}
+
+		uint64_t rollover = (uint64_t)k->timeOfCurrentKey + (uint64_t)k->timeToNextKey * 60;
+
+		if(!k->successor_staged){
+			if(ring->next_key != NULL && (uint64_t)now + ring->lead >= rollover){
+				memset(&next, 0, sizeof(next));
+				if(ring->next_key(ring->next_key_arg, k, &next) == 1){
+					// Failures leave k without a successor (requested again on the next tick), the other streams go on
+					if(next.key_id == k->key_id){
+						// Would replace (and release) k instead of staging a successor
+						failures++;
+						continue;
+					}
+					// Set before publishing: k is not touched after the slots change
+					k->successor_staged = 1;
+					if(r_goose_keyring_publish(ring, k->appid, next.key_id, next.mac_alg, next.enc_alg, next.key, next.key_size,
+											   next.timeOfCurrentKey, next.timeToNextKey) != 1){
+						k->successor_staged = 0;
+						failures++;
+						continue;
+					}
+					published++;
+				}
+			}
+		}else if((uint64_t)now >= rollover + ring->overlap){
+			// Overlap window is over - old key no longer accepted
+			r_goose_keyring_retire(ring, k->appid, k->key_id);
+		}
+	}
+
+	if(failed != NULL){
+		*failed = failures;
+	}
+	return published;
+}
+
+
+int r_goose_keyring_reader_register(r_goose_keyring* ring){
+	for(int i = 0; i < R_GOOSE_KEYRING_MAX_READERS; i++){
+		int expected = 0;
+		if(atomic_compare_exchange_strong(&ring->readers[i].in_use, &expected, 1)){
+			// Contexts of the keys already published are built by the first message under each key, and kept when unregistered
+			return i;
+		}
+	}
+	return -1;
+}
+
+void r_goose_keyring_reader_unregister(r_goose_keyring* ring, int reader){
+	atomic_store(&ring->readers[reader].epoch, 0);
+	atomic_store(&ring->readers[reader].in_use, 0);
+}
+
+void r_goose_keyring_reader_enter(r_goose_keyring* ring, int reader){
+	atomic_store(&ring->readers[reader].epoch, atomic_load(&ring->epoch));
+	// Epoch must be visible to the writer before any slot is read
+	atomic_thread_fence(memory_order_seq_cst);
+}
+
+void r_goose_keyring_reader_exit(r_goose_keyring* ring, int reader){
+	atomic_store_explicit(&ring->readers[reader].epoch, 0, memory_order_release);
+}
+
+const r_goose_key* r_goose_keyring_lookup(r_goose_keyring* ring, uint16_t appid, uint32_t key_id){
+	r_goose_keyring_table* table = atomic_load_explicit(&ring->table, memory_order_acquire);
+	size_t mask = ring->capacity - 1;
+	size_t idx = keyring_hash(ring, appid, key_id);
+
+	for(size_t i = 0; i < ring->capacity; i++, idx = (idx + 1) & mask){
+		r_goose_key* cur = atomic_load_explicit(&table->slots[idx], memory_order_acquire);
+
+		if(cur == NULL){
+			return NULL;
+		}
+		if(cur != TOMBSTONE && cur->appid == appid && cur->key_id == key_id){
+			return cur;
+		}
+	}
+
+	return NULL;
+}
+
+
+// Incremental MAC computation: hash state copied from the key entry, or a cipher context of the caller
+typedef struct key_mac_state {
+	const r_goose_key* k;
+	EVP_CIPHER_CTX* ctx;
+	r_goose_hash_state h;
+} key_mac_state;
+
+static int key_mac_init(key_mac_state* st, EVP_CIPHER_CTX** slot, const r_goose_key* k, uint32_t spdu_number){
+	st->k = k;
+	st->ctx = NULL;
+
+	if(k->hmac_hash != R_GOOSE_HASH_NONE){
+		st->h = k->hmac_inner;
+		return 0;
+	}
+#if R_GOOSE_WITH_BLAKE2B_KEYED_80
+	else if(k->mac_alg == BLAKE2B_KEYED_80){
+		st->h.blake2b = k->blake2b;
+		return 0;
+	}
+#endif
+#if R_GOOSE_WITH_BLAKE2S_KEYED_80
+	else if(k->mac_alg == BLAKE2S_KEYED_80){
+		st->h.blake2s = k->blake2s;
+		return 0;
+	}
+#endif
+	else if(k->mac_cipher != R_GOOSE_CIPHER_NONE){
+		const uint8_t* iv = zero_iv;
+#if R_GOOSE_WITH_CHACHA20_POLY1305_128
+		uint8_t nonce[12];
+		if(k->mac_alg == CHACHA20_POLY1305_128){
+			memcpy(nonce, k->mac_nonce_salt, POLY1305_NONCE_SALT_SIZE);
+			encodeInt4Bytes(nonce, spdu_number, POLY1305_NONCE_SALT_SIZE);
+			iv = nonce;
+		}
+#else
+		(void)spdu_number;
+#endif
+		if((st->ctx = key_cipher_ctx(slot, k->mac_cipher, k)) == NULL ||
+		   EVP_EncryptInit_ex(st->ctx, NULL, NULL, NULL, iv) != 1){
+			return -1;
+		}
+		return 0;
+	}
+	return -1;
+}
+
+static int key_mac_update(key_mac_state* st, const uint8_t* data, size_t data_size){
+	int unused;
+
+	if(st->k->hmac_hash != R_GOOSE_HASH_NONE){
+		return hash_update(st->k->hmac_hash, &st->h, data, data_size);
+	}
+#if R_GOOSE_WITH_BLAKE2B_KEYED_80
+	if(st->k->mac_alg == BLAKE2B_KEYED_80){
+		blake2b_update(&st->h.blake2b, data, data_size);
+		return 0;
+	}
+#endif
+#if R_GOOSE_WITH_BLAKE2S_KEYED_80
+	if(st->k->mac_alg == BLAKE2S_KEYED_80){
+		blake2s_update(&st->h.blake2s, data, data_size);
+		return 0;
+	}
+#endif
+	// GMAC/Poly1305: data is authenticated as AAD
+	return EVP_EncryptUpdate(st->ctx, NULL, &unused, data, (int)data_size) == 1 ? 0 : -1;
+}
+
+static int key_mac_final(key_mac_state* st, uint8_t* dest){
+	uint8_t tmp[EVP_MAX_MD_SIZE];
+	int hash = st->k->hmac_hash;
+	int len, unused;
+
+	if(hash != R_GOOSE_HASH_NONE){
+		if((len = hash_final(hash, &st->h, tmp)) < 0){
+			return -1;
+		}
+		st->h = st->k->hmac_outer;
+		if(hash_update(hash, &st->h, tmp, (size_t)len) != 0 || hash_final(hash, &st->h, tmp) < 0){
+			return -1;
+		}
+	}
+#if R_GOOSE_WITH_BLAKE2B_KEYED_80
+	else if(st->k->mac_alg == BLAKE2B_KEYED_80){
+		blake2b_final(&st->h.blake2b, tmp);
+	}
+#endif
+#if R_GOOSE_WITH_BLAKE2S_KEYED_80
+	else if(st->k->mac_alg == BLAKE2S_KEYED_80){
+		blake2s_final(&st->h.blake2s, tmp);
+	}
+#endif
+	else{
+		if(EVP_EncryptFinal_ex(st->ctx, NULL, &unused) != 1 ||
+		   EVP_CIPHER_CTX_ctrl(st->ctx, EVP_CTRL_AEAD_GET_TAG, 16, tmp) != 1){
+			return -1;
+		}
+	}
+
+	memcpy(dest, tmp, MAC_SIZES[st->k->mac_alg]);
+	return MAC_SIZES[st->k->mac_alg];
+}
+
+static int key_mac(EVP_CIPHER_CTX** slot, const r_goose_key* k, uint8_t* data, size_t data_size, uint8_t* dest){
+	key_mac_state st;
+
+	// data starts at the third byte of the message
+	uint32_t spdu_number = data_size >= INDEX_SPDU_NUMBER + 2 ? decode_4bytesToInt(data, INDEX_SPDU_NUMBER - 2) : 0;
+
+	if(key_mac_init(&st, slot, k, spdu_number) < 0 || key_mac_update(&st, data, data_size) < 0){
+		return -1;
+	}
+	return key_mac_final(&st, dest);
+}
+
+int r_goose_key_mac(r_goose_keyring* ring, int reader, const r_goose_key* k, uint8_t* data, size_t data_size, uint8_t* dest){
+	(void)ring;
+	return key_mac(KEY_MAC_CTX(k, reader), k, data, data_size, dest);
+}
+
+
+// MAC key outside a key ring: one key entry, its MAC context in the slot of reader 0
+struct r_goose_mac_key {
+	r_goose_key* k;
+};
+
+r_goose_mac_key* r_goose_mac_key_new(int alg, const uint8_t* key, size_t key_size){
+	uint8_t block[64], tag[MAX_MAC_SIZE];
+
+	if(alg == MAC_NONE || key_size == 0){
+		return NULL;
+	}
+
+	r_goose_mac_key* mk = (r_goose_mac_key*)r_goose_calloc(1, sizeof(r_goose_mac_key));
+	if(mk == NULL){
+		return NULL;
+	}
+	if((mk->k = key_new(0, 0, alg, ENC_NONE, (uint8_t*)key, key_size, 0, 0)) == NULL){
+		r_goose_free(mk);
+		return NULL;
+	}
+	// Cipher context created and keyed here, not by the first message
+	memset(block, 0, sizeof(block));
+	if(key_mac(KEY_MAC_CTX(mk->k, 0), mk->k, block, sizeof(block), tag) < 0){
+		r_goose_mac_key_free(mk);
+		return NULL;
+	}
+
+	return mk;
+}
+
+void r_goose_mac_key_free(r_goose_mac_key* mk){
+	if(mk == NULL){
+		return;
+	}
+	key_free(mk->k);
+	r_goose_free(mk);
+}
+
+int r_goose_mac_key_tag(r_goose_mac_key* mk, uint8_t* data, size_t data_size, uint8_t* dest){
+	return key_mac(KEY_MAC_CTX(mk->k, 0), mk->k, data, data_size, dest);
+}
+
+// Entry points of one MAC family: the hash or cipher is a constant here, so nothing is dispatched on the algorithm
+static inline __attribute__((always_inline)) int mac_key_hmac(const r_goose_key* k, int hash, const uint8_t* data, size_t data_size, uint8_t* dest){
+	uint8_t tmp[EVP_MAX_MD_SIZE];
+	r_goose_hash_state h;
+	int len;
+
+	if(k->hmac_hash != hash){
+		return -1;
+	}
+	h = k->hmac_inner;
+	if(hash_update(hash, &h, data, data_size) != 0 || (len = hash_final(hash, &h, tmp)) < 0){
+		return -1;
+	}
+	h = k->hmac_outer;
+	if(hash_update(hash, &h, tmp, (size_t)len) != 0 || hash_final(hash, &h, tmp) < 0){
+		return -1;
+	}
+	memcpy(dest, tmp, MAC_SIZES[k->mac_alg]);
+	return MAC_SIZES[k->mac_alg];
+}
+
+static int mac_key_aead(const r_goose_key* k, const uint8_t* iv, const uint8_t* data, size_t data_size, uint8_t* dest){
+	EVP_CIPHER_CTX* ctx = k->mac_ctx[0];
+	uint8_t tmp[16];
+	int unused;
+
+	if(ctx == NULL || data_size > INT_MAX ||
+	   EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, iv) != 1 ||
+	   EVP_EncryptUpdate(ctx, NULL, &unused, data, (int)data_size) != 1 ||
+	   EVP_EncryptFinal_ex(ctx, NULL, &unused) != 1 ||
+	   EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, 16, tmp) != 1){
+		return -1;
+	}
+	memcpy(dest, tmp, MAC_SIZES[k->mac_alg]);
+	return MAC_SIZES[k->mac_alg];
+}
+
+int r_goose_mac_key_tag_hmac_sha256(r_goose_mac_key* mk, const uint8_t* data, size_t data_size, uint8_t* dest){
+	return mac_key_hmac(mk->k, R_GOOSE_HASH_SHA256, data, data_size, dest);
+}
+
+int r_goose_mac_key_tag_hmac_sha512_256(r_goose_mac_key* mk, const uint8_t* data, size_t data_size, uint8_t* dest){
+	return mac_key_hmac(mk->k, R_GOOSE_HASH_SHA512_256, data, data_size, dest);
+}
+
+int r_goose_mac_key_tag_hmac_blake2b(r_goose_mac_key* mk, const uint8_t* data, size_t data_size, uint8_t* dest){
+	return mac_key_hmac(mk->k, R_GOOSE_HASH_BLAKE2B, data, data_size, dest);
+}
+
+int r_goose_mac_key_tag_hmac_blake2s(r_goose_mac_key* mk, const uint8_t* data, size_t data_size, uint8_t* dest){
+	return mac_key_hmac(mk->k, R_GOOSE_HASH_BLAKE2S, data, data_size, dest);
+}
+
+int r_goose_mac_key_tag_blake2b_keyed(r_goose_mac_key* mk, const uint8_t* data, size_t data_size, uint8_t* dest){
+#if R_GOOSE_WITH_BLAKE2B_KEYED_80
+	uint8_t tmp[BLAKE2B_OUTBYTES];
+	blake2b_state S;
+
+	if(mk->k->mac_alg != BLAKE2B_KEYED_80){
+		return -1;
+	}
+	S = mk->k->blake2b;
+	blake2b_update(&S, data, data_size);
+	blake2b_final(&S, tmp);
+	memcpy(dest, tmp, MAC_SIZES[BLAKE2B_KEYED_80]);
+	return MAC_SIZES[BLAKE2B_KEYED_80];
+#else
+	(void)mk; (void)data; (void)data_size; (void)dest;
+	return -1;
+#endif
+}
+
+int r_goose_mac_key_tag_blake2s_keyed(r_goose_mac_key* mk, const uint8_t* data, size_t data_size, uint8_t* dest){
+#if R_GOOSE_WITH_BLAKE2S_KEYED_80
+	uint8_t tmp[BLAKE2S_OUTBYTES];
+	blake2s_state S;
+
+	if(mk->k->mac_alg != BLAKE2S_KEYED_80){
+		return -1;
+	}
+	S = mk->k->blake2s;
+	blake2s_update(&S, data, data_size);
+	blake2s_final(&S, tmp);
+	memcpy(dest, tmp, MAC_SIZES[BLAKE2S_KEYED_80]);
+	return MAC_SIZES[BLAKE2S_KEYED_80];
+#else
+	(void)mk; (void)data; (void)data_size; (void)dest;
+	return -1;
+#endif
+}
+
+int r_goose_mac_key_tag_gmac(r_goose_mac_key* mk, const uint8_t* data, size_t data_size, uint8_t* dest){
+	if(mk->k->mac_cipher != R_GOOSE_CIPHER_AES128_GCM && mk->k->mac_cipher != R_GOOSE_CIPHER_AES256_GCM){
+		return -1;
+	}
+	return mac_key_aead(mk->k, zero_iv, data, data_size, dest);
+}
+
+int r_goose_mac_key_tag_poly1305(r_goose_mac_key* mk, const uint8_t* data, size_t data_size, uint8_t* dest){
+#if R_GOOSE_WITH_CHACHA20_POLY1305_128
+	uint8_t nonce[12];
+
+	if(mk->k->mac_alg != CHACHA20_POLY1305_128){
+		return -1;
+	}
+	// data starts at the third byte of the message
+	memcpy(nonce, mk->k->mac_nonce_salt, POLY1305_NONCE_SALT_SIZE);
+	encodeInt4Bytes(nonce, data_size >= INDEX_SPDU_NUMBER + 2 ? decode_4bytesToInt((uint8_t*)data, INDEX_SPDU_NUMBER - 2) : 0,
+					POLY1305_NONCE_SALT_SIZE);
+	return mac_key_aead(mk->k, nonce, data, data_size, dest);
+#else
+	(void)mk; (void)data; (void)data_size; (void)dest;
+	return -1;
+#endif
+}
+
+/* Payload cipher context in @p slot keyed with @p k, IV set (iv_size bytes) */
+static EVP_CIPHER_CTX* key_payload_cipher(EVP_CIPHER_CTX** slot, const r_goose_key* k, uint8_t* iv, int iv_size){
+	EVP_CIPHER_CTX* ctx = key_cipher_ctx(slot, k->enc_cipher, k);
+
+	if(ctx == NULL ||
+	   EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN, iv_size, NULL) != 1 ||
+	   EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, iv) != 1){
+		return NULL;
+	}
+	return ctx;
+}
+
+/* Builds the cipher contexts of every registered reader for a new key and runs each state once, before readers can see it */
+static int key_warm_up(r_goose_keyring* ring, const r_goose_key* k){
+	uint8_t block[64], tag[MAX_MAC_SIZE];
+	EVP_CIPHER_CTX* ctx;
+	int len;
+
+	memset(block, 0, sizeof(block));
+
+	// Hash states are shared by all readers: run once
+	if(k->mac_alg != MAC_NONE && k->mac_cipher == R_GOOSE_CIPHER_NONE && key_mac(NULL, k, block, sizeof(block), tag) < 0){
+		return -1;
+	}
+	for(int i = 0; i < R_GOOSE_KEYRING_MAX_READERS; i++){
+		if(!atomic_load(&ring->readers[i].in_use)){
+			continue;
+		}
+		if(k->mac_cipher != R_GOOSE_CIPHER_NONE && key_mac(KEY_MAC_CTX(k, i), k, block, sizeof(block), tag) < 0){
+			return -1;
+		}
+		if(k->enc_cipher != R_GOOSE_CIPHER_NONE){
+			if((ctx = key_payload_cipher(KEY_ENC_CTX(k, i), k, (uint8_t*)zero_iv, sizeof(zero_iv))) == NULL ||
+			   EVP_EncryptUpdate(ctx, block, &len, block, sizeof(block)) != 1){
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+
+int r_gooseMessage_InsertKeyring(uint8_t* buffer, r_goose_keyring* ring, int reader, uint32_t key_id, uint8_t** dest){
+
+	int macSize, messageSize, new_size, res;
+	uint16_t appid = decode_2bytesToInt(buffer, INDEX_APPID);
+	uint8_t* tmp;
+
+	r_goose_keyring_reader_enter(ring, reader);
+
+	const r_goose_key* k = r_goose_keyring_lookup(ring, appid, key_id);
+	if(k == NULL || k->mac_alg == MAC_NONE){
+		r_goose_keyring_reader_exit(ring, reader);
+		return -1;
+	}
+
+	macSize = MAC_SIZES[k->mac_alg];
+	messageSize = decode_4bytesToInt(buffer, INDEX_SPDU_LENGTH) + 10;
+	new_size = messageSize + macSize;
+
+	*dest = (uint8_t*)r_goose_malloc(sizeof(char)*new_size);
+	if(*dest == NULL){
+		r_goose_keyring_reader_exit(ring, reader);
+		return -1;
+	}
+
+	memcpy(*dest, buffer, messageSize);
+
+	tmp = *dest;
+
+	// Security Information is taken from the key, so the receiver can find it
+	encodeInt4Bytes(tmp, k->timeOfCurrentKey, INDEX_TIMECURKEY);
+	encodeInt2Bytes(tmp, k->timeToNextKey, INDEX_TIMENEXTKEY);
+	tmp[INDEX_MAC_ALG] = (uint8_t)k->mac_alg;
+	encodeInt4Bytes(tmp, k->key_id, INDEX_KEYID);
+
+	encodeInt4Bytes(tmp, (uint32_t)(new_size-10), INDEX_SPDU_LENGTH);
+	tmp[new_size - macSize - 1] = (uint8_t)macSize;
+
+	res = r_goose_key_mac(ring, reader, k, &tmp[2], messageSize-4, &tmp[new_size-macSize]);
+
+	r_goose_keyring_reader_exit(ring, reader);
+
+	return res < 0 ? -1 : 1;
+}
+
+int r_gooseMessage_ValidateKeyring(uint8_t* buffer, size_t len, r_goose_keyring* ring, int reader){
+
+	size_t messageSize;
+	int alg, macSize, index_mac, res;
+	uint8_t tag[MAX_MAC_SIZE];
+
+	if(len < INDEX_PAYLOAD){
+		return -1;
+	}
+
+	alg = buffer[INDEX_MAC_ALG];
+	if(alg == MAC_NONE){
+		return 2;
+	}
+	if(alg >= MAC_ALGS_COUNT){
+		return -1;
+	}
+
+	// The SPDU Length must match the received length, and leave room for the header and the tag field
+	messageSize = (size_t)decode_4bytesToInt(buffer, INDEX_SPDU_LENGTH) + 10;
+	macSize = MAC_SIZES[alg];
+	if(messageSize != len || messageSize < INDEX_PAYLOAD + 2 + (size_t)macSize){
+		return -1;
+	}
+	index_mac = (int)messageSize - macSize;
+
+	r_goose_keyring_reader_enter(ring, reader);
+
+	const r_goose_key* k = r_goose_keyring_lookup(ring, decode_2bytesToInt(buffer, INDEX_APPID), decode_4bytesToInt(buffer, INDEX_KEYID));
+	if(k == NULL || k->mac_alg != alg){
+		r_goose_keyring_reader_exit(ring, reader);
+		return -1;
+	}
+
+	res = r_goose_key_mac(ring, reader, k, &buffer[2], messageSize-4-macSize, tag);
+
+	r_goose_keyring_reader_exit(ring, reader);
+
+	if(res < 0){
+		return -1;
+	}
+
+	// MAC Tag comparison (constant time)
+	return CRYPTO_memcmp(tag, &buffer[index_mac], macSize) == 0 ? 1 : 0;
+}
+
+int r_gooseMessage_DecryptKeyring(uint8_t* buffer, size_t len, r_goose_keyring* ring, int reader, uint8_t* iv, int iv_size){
+
+	int out, data_size, mac_alg;
+	uint8_t alg;
+
+	if(len < INDEX_PAYLOAD){
+		return -1;
+	}
+
+	alg = buffer[INDEX_ENCRYPTION_ALG];
+	if(alg == ENC_NONE){
+		return 0;
+	}
+
+	// The payload must lie in the received bytes, before the Signature TAG, Signature Length and MAC Tag
+	mac_alg = buffer[INDEX_MAC_ALG];
+	data_size = decode_2bytesToInt(buffer, INDEX_APDU_LENGTH) - 2;
+	if(mac_alg >= MAC_ALGS_COUNT || (size_t)decode_4bytesToInt(buffer, INDEX_SPDU_LENGTH) + 10 != len ||
+	   data_size < 0 || INDEX_PAYLOAD + (size_t)data_size > len - 2 - (size_t)MAC_SIZES[mac_alg]){
+		return -1;
+	}
+
+	r_goose_keyring_reader_enter(ring, reader);
+
+	const r_goose_key* k = r_goose_keyring_lookup(ring, decode_2bytesToInt(buffer, INDEX_APPID), decode_4bytesToInt(buffer, INDEX_KEYID));
+	if(k == NULL || k->enc_alg != alg){
+		r_goose_keyring_reader_exit(ring, reader);
+		return -1;
+	}
+
+	EVP_CIPHER_CTX* ctx;
+
+	// GCM/ChaCha20 decryption is the same keystream xor as encryption - payload decrypted in place
+	if((ctx = key_payload_cipher(KEY_ENC_CTX(k, reader), k, iv, iv_size)) == NULL ||
+	   EVP_EncryptUpdate(ctx, &buffer[INDEX_PAYLOAD], &out, &buffer[INDEX_PAYLOAD], data_size) != 1){
+		r_goose_keyring_reader_exit(ring, reader);
+		return -1;
+	}
+
+	r_goose_keyring_reader_exit(ring, reader);
+
+	buffer[INDEX_ENCRYPTION_ALG] = 0x00;
+	return 1;
+}
+
+
+void r_goose_key_iv(const r_goose_key* k, uint32_t spdu_number, uint8_t* iv){
+	memcpy(iv, k->iv_salt, R_GOOSE_IV_SALT_SIZE);
+	encodeInt4Bytes(iv, spdu_number, R_GOOSE_IV_SALT_SIZE);
+}
+
+int r_goose_key_iv_reserve(const r_goose_key* k, uint32_t count, r_goose_iv_block* block){
+	// The counter is the only mutable field of a published entry
+	_Atomic uint64_t* counter = &((r_goose_key*)k)->iv_counter;
+
+	if(count == 0){
+		return -1;
+	}
+
+	uint64_t first = atomic_fetch_add_explicit(counter, count, memory_order_relaxed);
+	if(first + count > ((uint64_t)1 << 32)){
+		// Exhausted: the counter stays past 2^32, so no later reservation succeeds either
+		return -1;
+	}
+
+	block->key = k;
+	block->next = first;
+	block->end = first + count;
+	return 1;
+}
+
+int r_goose_iv_block_next(const r_goose_key* k, r_goose_iv_block* block, uint32_t* spdu_number, uint8_t* iv){
+	if(block->key != k || block->next == block->end){
+		if(r_goose_key_iv_reserve(k, R_GOOSE_IV_BLOCK, block) < 0){
+			block->key = NULL;
+			return -1;
+		}
+	}
+
+	*spdu_number = (uint32_t)block->next++;
+	if(iv != NULL){
+		r_goose_key_iv(k, *spdu_number, iv);
+	}
+	return 1;
+}
+
+void r_goose_key_iv_advance(const r_goose_key* k, uint32_t first){
+	_Atomic uint64_t* counter = &((r_goose_key*)k)->iv_counter;
+	uint64_t current = atomic_load_explicit(counter, memory_order_relaxed);
+
+	while(current < first && !atomic_compare_exchange_weak(counter, &current, first));
+}
+
+
+int r_gooseMessage_ProtectKeyring(uint8_t* buffer, size_t buffer_size, r_goose_keyring* ring, int reader, uint32_t key_id, uint8_t* iv, int iv_size){
+	return r_gooseMessage_ProtectKeyringTo(buffer, buffer, buffer_size, ring, reader, key_id, iv, iv_size);
+}
+
+int r_gooseMessage_ProtectKeyringTo(const uint8_t* src, uint8_t* dest, size_t dest_size, r_goose_keyring* ring, int reader, uint32_t key_id, uint8_t* iv, int iv_size){
+
+	int macSize, messageSize, new_size, data_size, len;
+	uint16_t appid = decode_2bytesToInt((uint8_t*)src, INDEX_APPID);
+	EVP_CIPHER_CTX* enc = NULL;
+	uint8_t derived_iv[R_GOOSE_IV_SIZE];
+	key_mac_state st;
+
+	messageSize = decode_4bytesToInt((uint8_t*)src, INDEX_SPDU_LENGTH) + 10;
+	data_size = decode_2bytesToInt((uint8_t*)src, INDEX_APDU_LENGTH) - 2;
+	if(data_size < 0 || INDEX_PAYLOAD + data_size > messageSize - 2){
+		return -1;
+	}
+
+	r_goose_keyring_reader_enter(ring, reader);
+
+	const r_goose_key* k = r_goose_keyring_lookup(ring, appid, key_id);
+	if(k == NULL || k->mac_alg == MAC_NONE){
+		r_goose_keyring_reader_exit(ring, reader);
+		return -1;
+	}
+
+	macSize = MAC_SIZES[k->mac_alg];
+	new_size = messageSize + macSize;
+	if((size_t)new_size > dest_size){
+		r_goose_keyring_reader_exit(ring, reader);
+		return -1;
+	}
+
+	if(iv == NULL){
+		r_goose_key_iv(k, decode_4bytesToInt((uint8_t*)src, INDEX_SPDU_NUMBER), derived_iv);
+		iv = derived_iv;
+		iv_size = R_GOOSE_IV_SIZE;
+	}
+
+	// Header and trailer are copied around the payload - src is only read from here on
+	if(dest != src){
+		memcpy(dest, src, INDEX_PAYLOAD);
+		memcpy(&dest[INDEX_PAYLOAD + data_size], &src[INDEX_PAYLOAD + data_size], messageSize - INDEX_PAYLOAD - data_size);
+	}
+
+	// Security Information, lengths and Signature length are written before the MAC reads them
+	encodeInt4Bytes(dest, k->timeOfCurrentKey, INDEX_TIMECURKEY);
+	encodeInt2Bytes(dest, k->timeToNextKey, INDEX_TIMENEXTKEY);
+	dest[INDEX_ENCRYPTION_ALG] = (uint8_t)k->enc_alg;
+	dest[INDEX_MAC_ALG] = (uint8_t)k->mac_alg;
+	encodeInt4Bytes(dest, k->key_id, INDEX_KEYID);
+	encodeInt4Bytes(dest, (uint32_t)(new_size-10), INDEX_SPDU_LENGTH);
+	dest[new_size - macSize - 1] = (uint8_t)macSize;
+
+	if((k->enc_cipher != R_GOOSE_CIPHER_NONE && (enc = key_payload_cipher(KEY_ENC_CTX(k, reader), k, iv, iv_size)) == NULL) ||
+	   key_mac_init(&st, KEY_MAC_CTX(k, reader), k, decode_4bytesToInt(dest, INDEX_SPDU_NUMBER)) < 0 ||
+	   key_mac_update(&st, &dest[2], INDEX_PAYLOAD - 2) < 0){
+		r_goose_keyring_reader_exit(ring, reader);
+		return -1;
+	}
+
+	// Each chunk is encrypted (or copied) into dest and given to the MAC while it is in the L1 cache
+	for(int o = 0; o < data_size; o += R_GOOSE_PROTECT_CHUNK){
+		const uint8_t* in = &src[INDEX_PAYLOAD + o];
+		uint8_t* p = &dest[INDEX_PAYLOAD + o];
+		int n = data_size - o < R_GOOSE_PROTECT_CHUNK ? data_size - o : R_GOOSE_PROTECT_CHUNK;
+
+		if(enc != NULL){
+			if(EVP_EncryptUpdate(enc, p, &len, in, n) != 1){
+				r_goose_keyring_reader_exit(ring, reader);
+				return -1;
+			}
+		}else if(p != in){
+			memcpy(p, in, n);
+		}
+
+		if(key_mac_update(&st, p, n) < 0){
+			r_goose_keyring_reader_exit(ring, reader);
+			return -1;
+		}
+	}
+
+	if(key_mac_update(&st, &dest[INDEX_PAYLOAD + data_size], messageSize - 2 - INDEX_PAYLOAD - data_size) < 0 ||
+	   key_mac_final(&st, &dest[new_size - macSize]) < 0){
+		r_goose_keyring_reader_exit(ring, reader);
+		return -1;
+	}
+
+	r_goose_keyring_reader_exit(ring, reader);
+
+	return new_size;
+}
+
+int r_gooseMessage_ProtectKeyringFanout(const uint8_t* src, r_goose_fanout_target* targets, int count, r_goose_keyring* ring, int reader){
+
+	int messageSize, data_size, len, protected = 0;
+	uint16_t appid = decode_2bytesToInt((uint8_t*)src, INDEX_APPID);
+	r_goose_keyring_reader* r = &ring->readers[reader];
+	const r_goose_key* keys[R_GOOSE_FANOUT_MAX];
+	const r_goose_key* used[R_GOOSE_FANOUT_MAX];
+	EVP_CIPHER_CTX* enc[R_GOOSE_FANOUT_MAX];
+	EVP_CIPHER_CTX* fan_mac[R_GOOSE_FANOUT_MAX];
+	EVP_CIPHER_CTX* fan_enc[R_GOOSE_FANOUT_MAX];
+	key_mac_state st[R_GOOSE_FANOUT_MAX];
+	uint8_t derived_iv[R_GOOSE_IV_SIZE];
+
+	messageSize = decode_4bytesToInt((uint8_t*)src, INDEX_SPDU_LENGTH) + 10;
+	data_size = decode_2bytesToInt((uint8_t*)src, INDEX_APDU_LENGTH) - 2;
+	if(count < 1 || count > R_GOOSE_FANOUT_MAX || data_size < 0 || INDEX_PAYLOAD + data_size > messageSize - 2){
+		return -1;
+	}
+
+	r_goose_keyring_reader_enter(ring, reader);
+
+	// Header and trailer of each destination, then its cipher and MAC states (keys[t] NULL: destination skipped)
+	for(int t = 0; t < count; t++){
+		r_goose_fanout_target* d = &targets[t];
+		const r_goose_key* k = r_goose_keyring_lookup(ring, appid, d->key_id);
+		uint8_t* iv = d->iv;
+		int iv_size = d->iv_size, macSize, new_size;
+
+		keys[t] = NULL;
+		used[t] = NULL;
+		enc[t] = NULL;
+		d->size = -1;
+		if(k == NULL || k->mac_alg == MAC_NONE){
+			continue;
+		}
+		macSize = MAC_SIZES[k->mac_alg];
+		new_size = messageSize + macSize;
+		if((size_t)new_size > d->dest_size){
+			continue;
+		}
+
+		if(iv == NULL){
+			r_goose_key_iv(k, d->spdu_number, derived_iv);
+			iv = derived_iv;
+			iv_size = R_GOOSE_IV_SIZE;
+		}
+
+		memcpy(d->dest, src, INDEX_PAYLOAD);
+		memcpy(&d->dest[INDEX_PAYLOAD + data_size], &src[INDEX_PAYLOAD + data_size], messageSize - INDEX_PAYLOAD - data_size);
+
+		encodeInt4Bytes(d->dest, d->spdu_number, INDEX_SPDU_NUMBER);
+		encodeInt4Bytes(d->dest, k->timeOfCurrentKey, INDEX_TIMECURKEY);
+		encodeInt2Bytes(d->dest, k->timeToNextKey, INDEX_TIMENEXTKEY);
+		d->dest[INDEX_ENCRYPTION_ALG] = (uint8_t)k->enc_alg;
+		d->dest[INDEX_MAC_ALG] = (uint8_t)k->mac_alg;
+		encodeInt4Bytes(d->dest, k->key_id, INDEX_KEYID);
+		encodeInt4Bytes(d->dest, (uint32_t)(new_size-10), INDEX_SPDU_LENGTH);
+		d->dest[new_size - macSize - 1] = (uint8_t)macSize;
+
+		// The contexts of the key serve its first destination, a key met again uses the ones of the destination
+		EVP_CIPHER_CTX** mac_slot = KEY_MAC_CTX(k, reader);
+		EVP_CIPHER_CTX** enc_slot = KEY_ENC_CTX(k, reader);
+		int u = 0;
+		while(u < t && used[u] != k){
+			u++;
+		}
+		used[t] = k;
+		if(u < t){
+			fan_mac[t] = NULL;
+			fan_enc[t] = NULL;
+			if((k->mac_cipher != R_GOOSE_CIPHER_NONE && (fan_mac[t] = cipher_set_key(&r->fan_mac[t], k->mac_cipher, k)) == NULL) ||
+			   (k->enc_cipher != R_GOOSE_CIPHER_NONE && (fan_enc[t] = cipher_set_key(&r->fan_enc[t], k->enc_cipher, k)) == NULL)){
+				continue;
+			}
+			mac_slot = &fan_mac[t];
+			enc_slot = &fan_enc[t];
+		}
+
+		if((k->enc_cipher != R_GOOSE_CIPHER_NONE && (enc[t] = key_payload_cipher(enc_slot, k, iv, iv_size)) == NULL) ||
+		   key_mac_init(&st[t], mac_slot, k, d->spdu_number) < 0 ||
+		   key_mac_update(&st[t], &d->dest[2], INDEX_PAYLOAD - 2) < 0){
+			continue;
+		}
+		keys[t] = k;
+	}
+
+	// Each chunk of src is read once, and encrypted (or copied) and given to the MAC of every destination
+	for(int o = 0; o < data_size; o += R_GOOSE_PROTECT_CHUNK){
+		const uint8_t* in = &src[INDEX_PAYLOAD + o];
+		int n = data_size - o < R_GOOSE_PROTECT_CHUNK ? data_size - o : R_GOOSE_PROTECT_CHUNK;
+
+		for(int t = 0; t < count; t++){
+			if(keys[t] == NULL){
+				continue;
+			}
+			uint8_t* p = &targets[t].dest[INDEX_PAYLOAD + o];
+
+			if(enc[t] != NULL){
+				if(EVP_EncryptUpdate(enc[t], p, &len, in, n) != 1){
+					keys[t] = NULL;
+					continue;
+				}
+			}else{
+				memcpy(p, in, n);
+			}
+			if(key_mac_update(&st[t], p, n) < 0){
+				keys[t] = NULL;
+			}
+		}
+	}
+
+	for(int t = 0; t < count; t++){
+		r_goose_fanout_target* d = &targets[t];
+		if(keys[t] == NULL){
+			continue;
+		}
+		int macSize = MAC_SIZES[keys[t]->mac_alg];
+
+		if(key_mac_update(&st[t], &d->dest[INDEX_PAYLOAD + data_size], messageSize - 2 - INDEX_PAYLOAD - data_size) < 0 ||
+		   key_mac_final(&st[t], &d->dest[messageSize]) < 0){
+			continue;
+		}
+		d->size = messageSize + macSize;
+		protected++;
+	}
+
+	r_goose_keyring_reader_exit(ring, reader);
+
+	return protected;
+}
+
+int r_gooseMessage_UnprotectKeyring(uint8_t* buffer, size_t len, r_goose_keyring* ring, int reader, uint8_t* iv, int iv_size){
+
+	int messageSize, alg, macSize, index_mac, data_size, out, decrypted = 0, res = -1;
+	EVP_CIPHER_CTX* enc = NULL;
+	uint8_t tag[MAX_MAC_SIZE], derived_iv[R_GOOSE_IV_SIZE];
+	key_mac_state st;
+
+	if(len < INDEX_PAYLOAD){
+		return -1;
+	}
+
+	alg = buffer[INDEX_MAC_ALG];
+	if(alg == MAC_NONE){
+		// Not authenticated - not decrypted either
+		return 2;
+	}
+	if(alg >= MAC_ALGS_COUNT){
+		return -1;
+	}
+
+	// The SPDU Length must match the received length, so a forged one can't move the MAC or the decryption past it
+	if((size_t)decode_4bytesToInt(buffer, INDEX_SPDU_LENGTH) + 10 != len || len > INT_MAX){
+		return -1;
+	}
+	messageSize = (int)len;
+	macSize = MAC_SIZES[alg];
+	index_mac = messageSize - macSize;
+	data_size = decode_2bytesToInt(buffer, INDEX_APDU_LENGTH) - 2;
+	if(data_size < 0 || INDEX_PAYLOAD + data_size > index_mac - 2){
+		return -1;
+	}
+
+	r_goose_keyring_reader_enter(ring, reader);
+
+	const r_goose_key* k = r_goose_keyring_lookup(ring, decode_2bytesToInt(buffer, INDEX_APPID), decode_4bytesToInt(buffer, INDEX_KEYID));
+	if(k == NULL || k->mac_alg != alg || k->enc_alg != buffer[INDEX_ENCRYPTION_ALG]){
+		r_goose_keyring_reader_exit(ring, reader);
+		return -1;
+	}
+
+	if(iv == NULL){
+		r_goose_key_iv(k, decode_4bytesToInt(buffer, INDEX_SPDU_NUMBER), derived_iv);
+		iv = derived_iv;
+		iv_size = R_GOOSE_IV_SIZE;
+	}
+
+	if((k->enc_cipher != R_GOOSE_CIPHER_NONE && (enc = key_payload_cipher(KEY_ENC_CTX(k, reader), k, iv, iv_size)) == NULL) ||
+	   key_mac_init(&st, KEY_MAC_CTX(k, reader), k, decode_4bytesToInt(buffer, INDEX_SPDU_NUMBER)) < 0 ||
+	   key_mac_update(&st, &buffer[2], INDEX_PAYLOAD - 2) < 0){
+		goto exit;
+	}
+
+	// Each chunk is given to the MAC before it is decrypted (keystream xor, in place)
+	for(int o = 0; o < data_size; o += R_GOOSE_PROTECT_CHUNK){
+		uint8_t* p = &buffer[INDEX_PAYLOAD + o];
+		int n = data_size - o < R_GOOSE_PROTECT_CHUNK ? data_size - o : R_GOOSE_PROTECT_CHUNK;
+
+		if(key_mac_update(&st, p, n) < 0 || (enc != NULL && EVP_EncryptUpdate(enc, p, &out, p, n) != 1)){
+			goto exit;
+		}
+		decrypted = o + n;
+	}
+
+	if(key_mac_update(&st, &buffer[INDEX_PAYLOAD + data_size], index_mac - 2 - INDEX_PAYLOAD - data_size) < 0 ||
+	   key_mac_final(&st, tag) < 0){
+		goto exit;
+	}
+
+	if(CRYPTO_memcmp(tag, &buffer[index_mac], macSize) == 0){
+		if(enc != NULL){
+			buffer[INDEX_ENCRYPTION_ALG] = 0x00;
+		}
+		res = 1;
+	}else{
+		res = 0;
+	}
+
+exit:
+	// Invalid message or error after decryption started: the keystream is applied again to what was decrypted, so
+	// the payload is left as received. If that fails too, the plaintext is wiped rather than returned.
+	if(res != 1 && enc != NULL && decrypted > 0){
+		if(key_payload_cipher(KEY_ENC_CTX(k, reader), k, iv, iv_size) == NULL ||
+		   EVP_EncryptUpdate(enc, &buffer[INDEX_PAYLOAD], &out, &buffer[INDEX_PAYLOAD], decrypted) != 1){
+			OPENSSL_cleanse(&buffer[INDEX_PAYLOAD], decrypted);
+			res = -1;
+		}
+	}
+
+	r_goose_keyring_reader_exit(ring, reader);
+
+	return res;
+}
+
+// Position in a message split across an iovec array
+typedef struct iov_cursor {
+	const struct iovec* iov;
+	int iovcnt;
+	int i;
+	size_t off;
+} iov_cursor;
+
+static size_t iov_total(const struct iovec* iov, int iovcnt){
+	size_t total = 0;
+	for(int i = 0; i < iovcnt; i++){
+		total += iov[i].iov_len;
+	}
+	return total;
+}
+
+static void iov_seek(iov_cursor* c, const struct iovec* iov, int iovcnt, size_t pos){
+	c->iov = iov;
+	c->iovcnt = iovcnt;
+	c->i = 0;
+	while(c->i < iovcnt && pos >= iov[c->i].iov_len){
+		pos -= iov[c->i].iov_len;
+		c->i++;
+	}
+	c->off = pos;
+}
+
+// Contiguous bytes at the cursor (at most max), then moves past them. Returns 0 at the end of the message.
+static size_t iov_next(iov_cursor* c, size_t max, uint8_t** p){
+	while(c->i < c->iovcnt && c->off == c->iov[c->i].iov_len){
+		c->i++;
+		c->off = 0;
+	}
+	if(c->i == c->iovcnt || max == 0){
+		return 0;
+	}
+
+	size_t n = c->iov[c->i].iov_len - c->off;
+	if(n > max){
+		n = max;
+	}
+	*p = (uint8_t*)c->iov[c->i].iov_base + c->off;
+	c->off += n;
+	return n;
+}
+
+static void iov_gather(const struct iovec* iov, int iovcnt, size_t pos, uint8_t* dest, size_t n){
+	iov_cursor c;
+	uint8_t* p;
+	size_t len;
+
+	iov_seek(&c, iov, iovcnt, pos);
+	while((len = iov_next(&c, n, &p)) > 0){
+		memcpy(dest, p, len);
+		dest += len;
+		n -= len;
+	}
+}
+
+static void iov_scatter(const struct iovec* iov, int iovcnt, size_t pos, const uint8_t* src, size_t n){
+	iov_cursor c;
+	uint8_t* p;
+	size_t len;
+
+	iov_seek(&c, iov, iovcnt, pos);
+	while((len = iov_next(&c, n, &p)) > 0){
+		memcpy(p, src, len);
+		src += len;
+		n -= len;
+	}
+}
+
+// Gives n bytes at the cursor to the MAC, with the keystream of enc applied before (encrypt) or after (decrypt) it
+/* Gives n bytes from the cursor to the MAC and the cipher (in that order if !encrypt); *done (if not NULL) counts the
+   bytes the cipher went through, also on error */
+static int iov_mac_cipher(iov_cursor* c, size_t n, key_mac_state* st, EVP_CIPHER_CTX* enc, int encrypt, size_t* done){
+	uint8_t* p;
+	size_t len;
+	int unused;
+
+	while((len = iov_next(c, n < R_GOOSE_PROTECT_CHUNK ? n : R_GOOSE_PROTECT_CHUNK, &p)) > 0){
+		if((encrypt && enc != NULL && EVP_EncryptUpdate(enc, p, &unused, p, (int)len) != 1) ||
+		   (st != NULL && key_mac_update(st, p, len) < 0) ||
+		   (!encrypt && enc != NULL && EVP_EncryptUpdate(enc, p, &unused, p, (int)len) != 1)){
+			return -1;
+		}
+		n -= len;
+		if(done != NULL){
+			*done += len;
+		}
+	}
+	return n == 0 ? 0 : -1;
+}
+
+int r_gooseMessage_ProtectKeyringV(const struct iovec* iov, int iovcnt, struct iovec* tag, r_goose_keyring* ring, int reader, uint32_t key_id, uint8_t* iv, int iv_size){
+
+	int macSize, messageSize, new_size, data_size;
+	EVP_CIPHER_CTX* enc = NULL;
+	uint8_t header[INDEX_PAYLOAD], derived_iv[R_GOOSE_IV_SIZE], length;
+	key_mac_state st;
+	iov_cursor c;
+
+	if(iov_total(iov, iovcnt) < INDEX_PAYLOAD){
+		return -1;
+	}
+	iov_gather(iov, iovcnt, 0, header, INDEX_PAYLOAD);
+
+	messageSize = decode_4bytesToInt(header, INDEX_SPDU_LENGTH) + 10;
+	data_size = decode_2bytesToInt(header, INDEX_APDU_LENGTH) - 2;
+	if(data_size < 0 || INDEX_PAYLOAD + data_size > messageSize - 2 || (size_t)messageSize > iov_total(iov, iovcnt)){
+		return -1;
+	}
+
+	r_goose_keyring_reader_enter(ring, reader);
+
+	const r_goose_key* k = r_goose_keyring_lookup(ring, decode_2bytesToInt(header, INDEX_APPID), key_id);
+	if(k == NULL || k->mac_alg == MAC_NONE || tag->iov_len < (size_t)MAC_SIZES[k->mac_alg]){
+		r_goose_keyring_reader_exit(ring, reader);
+		return -1;
+	}
+
+	macSize = MAC_SIZES[k->mac_alg];
+	new_size = messageSize + macSize;
+
+	if(iv == NULL){
+		r_goose_key_iv(k, decode_4bytesToInt(header, INDEX_SPDU_NUMBER), derived_iv);
+		iv = derived_iv;
+		iv_size = R_GOOSE_IV_SIZE;
+	}
+
+	// Security Information, lengths and Signature length, as in r_gooseMessage_ProtectKeyring()
+	encodeInt4Bytes(header, k->timeOfCurrentKey, INDEX_TIMECURKEY);
+	encodeInt2Bytes(header, k->timeToNextKey, INDEX_TIMENEXTKEY);
+	header[INDEX_ENCRYPTION_ALG] = (uint8_t)k->enc_alg;
+	header[INDEX_MAC_ALG] = (uint8_t)k->mac_alg;
+	encodeInt4Bytes(header, k->key_id, INDEX_KEYID);
+	encodeInt4Bytes(header, (uint32_t)(new_size-10), INDEX_SPDU_LENGTH);
+	iov_scatter(iov, iovcnt, 0, header, INDEX_PAYLOAD);
+	length = (uint8_t)macSize;
+	iov_scatter(iov, iovcnt, messageSize - 1, &length, 1);
+
+	iov_seek(&c, iov, iovcnt, INDEX_PAYLOAD);
+	if((k->enc_cipher != R_GOOSE_CIPHER_NONE && (enc = key_payload_cipher(KEY_ENC_CTX(k, reader), k, iv, iv_size)) == NULL) ||
+	   key_mac_init(&st, KEY_MAC_CTX(k, reader), k, decode_4bytesToInt(header, INDEX_SPDU_NUMBER)) < 0 ||
+	   key_mac_update(&st, &header[2], INDEX_PAYLOAD - 2) < 0 ||
+	   iov_mac_cipher(&c, data_size, &st, enc, 1, NULL) < 0 ||
+	   iov_mac_cipher(&c, messageSize - 2 - INDEX_PAYLOAD - data_size, &st, NULL, 1, NULL) < 0 ||
+	   key_mac_final(&st, tag->iov_base) < 0){
+		r_goose_keyring_reader_exit(ring, reader);
+		return -1;
+	}
+	tag->iov_len = macSize;
+
+	r_goose_keyring_reader_exit(ring, reader);
+
+	return new_size;
+}
+
+// Validation (decrypt 0) or validation and decryption (decrypt 1) of a message split across an iovec array
+static int keyring_unprotect_v(const struct iovec* iov, int iovcnt, r_goose_keyring* ring, int reader, uint8_t* iv, int iv_size, int decrypt){
+
+	int messageSize, alg, macSize, index_mac, data_size, res = -1;
+	EVP_CIPHER_CTX* enc = NULL;
+	int encrypted;
+	size_t decrypted = 0;
+	uint8_t header[INDEX_PAYLOAD], tag[MAX_MAC_SIZE], received[MAX_MAC_SIZE], derived_iv[R_GOOSE_IV_SIZE], *p;
+	key_mac_state st;
+	iov_cursor c;
+
+	if(iov_total(iov, iovcnt) < INDEX_PAYLOAD){
+		return -1;
+	}
+	iov_gather(iov, iovcnt, 0, header, INDEX_PAYLOAD);
+
+	alg = header[INDEX_MAC_ALG];
+	if(alg == MAC_NONE){
+		return 2;
+	}
+	if(alg >= MAC_ALGS_COUNT){
+		return -1;
+	}
+
+	messageSize = decode_4bytesToInt(header, INDEX_SPDU_LENGTH) + 10;
+	macSize = MAC_SIZES[alg];
+	index_mac = messageSize - macSize;
+	data_size = decode_2bytesToInt(header, INDEX_APDU_LENGTH) - 2;
+	if(data_size < 0 || INDEX_PAYLOAD + data_size > index_mac - 2 || (size_t)messageSize > iov_total(iov, iovcnt)){
+		return -1;
+	}
+
+	r_goose_keyring_reader_enter(ring, reader);
+
+	const r_goose_key* k = r_goose_keyring_lookup(ring, decode_2bytesToInt(header, INDEX_APPID), decode_4bytesToInt(header, INDEX_KEYID));
+	if(k == NULL || k->mac_alg != alg || (decrypt && k->enc_alg != header[INDEX_ENCRYPTION_ALG])){
+		r_goose_keyring_reader_exit(ring, reader);
+		return -1;
+	}
+
+	encrypted = decrypt && k->enc_cipher != R_GOOSE_CIPHER_NONE;
+	if(encrypted){
+		if(iv == NULL){
+			r_goose_key_iv(k, decode_4bytesToInt(header, INDEX_SPDU_NUMBER), derived_iv);
+			iv = derived_iv;
+			iv_size = R_GOOSE_IV_SIZE;
+		}
+	}
+
+	iov_gather(iov, iovcnt, index_mac, received, macSize);
+	iov_seek(&c, iov, iovcnt, INDEX_PAYLOAD);
+	if((encrypted && (enc = key_payload_cipher(KEY_ENC_CTX(k, reader), k, iv, iv_size)) == NULL) ||
+	   key_mac_init(&st, KEY_MAC_CTX(k, reader), k, decode_4bytesToInt(header, INDEX_SPDU_NUMBER)) < 0 ||
+	   key_mac_update(&st, &header[2], INDEX_PAYLOAD - 2) < 0 ||
+	   iov_mac_cipher(&c, data_size, &st, enc, 0, &decrypted) < 0 ||
+	   iov_mac_cipher(&c, index_mac - 2 - INDEX_PAYLOAD - data_size, &st, NULL, 0, NULL) < 0 ||
+	   key_mac_final(&st, tag) < 0){
+		goto exit;
+	}
+
+	if(CRYPTO_memcmp(tag, received, macSize) == 0){
+		if(enc != NULL){
+			header[INDEX_ENCRYPTION_ALG] = 0x00;
+			iov_scatter(iov, iovcnt, INDEX_ENCRYPTION_ALG, &header[INDEX_ENCRYPTION_ALG], 1);
+		}
+		res = 1;
+	}else{
+		res = 0;
+	}
+
+exit:
+	// As in r_gooseMessage_UnprotectKeyring(): what was decrypted is encrypted again, or wiped if that fails
+	if(res != 1 && enc != NULL && decrypted > 0){
+		iov_seek(&c, iov, iovcnt, INDEX_PAYLOAD);
+		if(key_payload_cipher(KEY_ENC_CTX(k, reader), k, iv, iv_size) == NULL ||
+		   iov_mac_cipher(&c, decrypted, NULL, enc, 1, NULL) < 0){
+			iov_seek(&c, iov, iovcnt, INDEX_PAYLOAD);
+			for(size_t n, left = decrypted; (n = iov_next(&c, left, &p)) > 0; left -= n){
+				OPENSSL_cleanse(p, n);
+			}
+			res = -1;
+		}
+	}
+
+	r_goose_keyring_reader_exit(ring, reader);
+
+	return res;
+}
+
+int r_gooseMessage_ValidateKeyringV(const struct iovec* iov, int iovcnt, r_goose_keyring* ring, int reader){
+	return keyring_unprotect_v(iov, iovcnt, ring, reader, NULL, 0, 0);
+}
+
+int r_gooseMessage_UnprotectKeyringV(const struct iovec* iov, int iovcnt, r_goose_keyring* ring, int reader, uint8_t* iv, int iv_size){
+	return keyring_unprotect_v(iov, iovcnt, ring, reader, iv, iv_size, 1);
+}
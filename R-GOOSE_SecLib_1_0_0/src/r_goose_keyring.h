@@ -0,0 +1,786 @@
+/**
+ * @file r_goose_keyring.h
+ * @author Eduardo Andrade
+ * @date Mar 2020
+ * @brief File containing the declarations of the R-GOOSE key ring: keys indexed by (APPID, Key ID), holding prebuilt
+ * HMAC/BLAKE2 states and per-reader cipher contexts, with lock-free lookup and epoch based (RCU-style) key rotation.
+ *
+ * A subscriber receives R-GOOSE messages from several publishers (APPIDs), each one using the key identified
+ * by the Key ID field of the Security Information (INDEX_KEYID). The key ring maps (APPID, Key ID) to an
+ * immutable key entry, so that r_gooseMessage_ValidateKeyring() can pick the right key directly from the
+ * received header, instead of the application mapping headers to raw key pointers.
+ *
+ * Each key entry holds states built once, when the key is published, and copied by value for every message:
+ *				- HMAC algorithms: hash states after absorbing (key ^ ipad) and (key ^ opad)
+ *				- Keyed BLAKE2 algorithms: BLAKE2 state after absorbing the key block
+ * GMAC/ChaCha20-Poly1305 MAC Tags and the payload encryption use cipher contexts held by the key entry, one per
+ * reader and use (MAC, payload), keyed once when they are built: at publish for the readers registered then, by the
+ * first message under the key for a reader registered later. Readers alternating between streams never expand a key
+ * schedule again, and no context is allocated or copied per message.
+ *
+ * Concurrency model:
+ *				- Writer: a single control thread calls r_goose_keyring_publish(), r_goose_keyring_retire()
+ *				  and r_goose_keyring_reclaim(). Concurrent writers must be serialized by the application.
+ *				- Readers: each thread that validates packets registers once (r_goose_keyring_reader_register())
+ *				  and brackets its lookups with r_goose_keyring_reader_enter()/r_goose_keyring_reader_exit().
+ *				  Enter, exit and lookup never block and never retry (wait-free): a lookup probes at most
+ *				  capacity slots, reading each slot with a single atomic load.
+ *				- Retired entries are only released once every reader that could still hold them has exited
+ *				  (epoch based reclamation), so a key may be replaced while packets are being validated with it.
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * // Control thread
+ * r_goose_keyring* ring = r_goose_keyring_new(1024);
+ * r_goose_keyring_publish(ring, appid, key_id, HMAC_SHA256_80, ENC_NONE, key, key_size, timeOfCurrentKey, timeToNextKey);
+ *
+ * // Each receiving thread
+ * int reader = r_goose_keyring_reader_register(ring);
+ * while(1){
+ * 	size_t len;
+ * 	uint8_t* buffer = receive_packet(&len);				// pseudo-function that receives a packet
+ *
+ * 	if(r_gooseMessage_ValidateKeyring(buffer, len, ring, reader) == 1){
+ * 		process_packet(buffer);							// pseudo-function that processes a valid packet
+ * 	}
+ * }
+ *
+ * @endcode
+ *
+ * Key rotation:
+ *				A key is current from TimeOfCurrentKey (seconds) until TimeOfCurrentKey + TimeToNextKey (minutes),
+ *				the rollover time. With a schedule set (r_goose_keyring_set_schedule()), r_goose_keyring_tick()
+ *				requests the next key of every stream @p lead seconds before its rollover and publishes it, which
+ *				builds and runs once the contexts of every registered reader, so the first packet of a reader under
+ *				the new key takes the same path as any other packet (readers must register before the rollover).
+ *				Both keys are accepted until @p overlap seconds after the rollover, then the old one is retired.
+ *
+ * @note The table has a fixed capacity (rounded up to a power of two), chosen when the key ring is created.
+ * During rotations each stream holds two keys, so the capacity should be twice the number of streams.
+ * Retired keys leave tombstones in the table; once they reach a quarter of the capacity, the writer rebuilds
+ * the table without them in a second array allocated with the key ring, and swaps it in with one atomic store
+ * (the old array is reused once no reader can hold it, like a retired key).
+ */
+
+#ifndef R_GOOSE_KEYRING_H
+#define R_GOOSE_KEYRING_H
+
+#include <stdatomic.h>
+#include <sys/uio.h>
+
+#include <openssl/crypto.h>
+#include <openssl/sha.h>
+
+#include "r_goose_security.h"
+
+#define R_GOOSE_KEYRING_MAX_READERS		64
+#define R_GOOSE_KEYRING_MAX_KEY			64
+
+// Default key rotation schedule (seconds)
+#define R_GOOSE_KEYRING_LEAD_DEFAULT		60
+#define R_GOOSE_KEYRING_OVERLAP_DEFAULT		60
+
+// IV salt derived from each key, and IV size (salt || SPDU Number)
+#define R_GOOSE_IV_SALT_SIZE				8
+#define R_GOOSE_IV_SIZE						12
+
+// SPDU Numbers reserved at a time by r_goose_iv_block_next() (kept below R_GOOSE_REPLAY_WINDOW)
+#define R_GOOSE_IV_BLOCK					16
+
+// Payload bytes encrypted/decrypted at a time by r_gooseMessage_ProtectKeyring()/UnprotectKeyring() before the MAC reads them (fits L1/L2)
+#define R_GOOSE_PROTECT_CHUNK				16384
+
+// Destinations protected together by r_gooseMessage_ProtectKeyringFanout()
+#define R_GOOSE_FANOUT_MAX					8
+
+// Hash function of the HMAC algorithms (r_goose_key.hmac_hash)
+#define R_GOOSE_HASH_NONE					0
+#define R_GOOSE_HASH_SHA256					1
+#define R_GOOSE_HASH_SHA512_256				2
+#define R_GOOSE_HASH_BLAKE2B				3
+#define R_GOOSE_HASH_BLAKE2S				4
+
+// Cipher of the GMAC/Poly1305 MAC Tag or of the payload (r_goose_key.mac_cipher/enc_cipher), and number of ciphers
+#define R_GOOSE_CIPHER_NONE					0
+#define R_GOOSE_CIPHER_AES128_GCM			1
+#define R_GOOSE_CIPHER_AES256_GCM			2
+#define R_GOOSE_CIPHER_CHACHA20_POLY1305	3
+#define R_GOOSE_CIPHERS						3
+
+
+/**
+ * @brief Hash state of the HMAC and keyed BLAKE2 algorithms. Plain data, copied by value for every message.
+ */
+typedef union r_goose_hash_state {
+	SHA256_CTX sha256;
+	SHA512_CTX sha512;
+	blake2b_state blake2b;
+	blake2s_state blake2s;
+} r_goose_hash_state;
+
+
+/**
+ * @brief Key entry. Immutable once published (but for its SPDU Number counter and the context slot of each reader),
+ * released by the key ring after it is retired.
+ */
+typedef struct r_goose_key {
+	uint16_t appid;
+	uint32_t key_id;
+
+	int mac_alg;
+	int enc_alg;
+
+	uint8_t key[R_GOOSE_KEYRING_MAX_KEY];
+	size_t key_size;
+
+	uint32_t timeOfCurrentKey;
+	uint16_t timeToNextKey;
+
+	// Unique (never reused) number of the entry, recorded by the fan-out contexts keyed with it
+	uint64_t serial;
+
+	// Prebuilt MAC states (only the ones used by mac_alg are set)
+	int hmac_hash;										// R_GOOSE_HASH_*, R_GOOSE_HASH_NONE if not an HMAC algorithm
+	r_goose_hash_state hmac_inner;
+	r_goose_hash_state hmac_outer;
+	blake2b_state blake2b;
+	blake2s_state blake2s;
+	int mac_cipher;										// R_GOOSE_CIPHER_* of GMAC/Poly1305, R_GOOSE_CIPHER_NONE otherwise
+	uint8_t mac_nonce_salt[POLY1305_NONCE_SALT_SIZE];	// CHACHA20_POLY1305_128: nonce = salt || SPDU Number
+
+	// Cipher of the payload (R_GOOSE_CIPHER_NONE if enc_alg is ENC_NONE)
+	int enc_cipher;
+
+	// Cipher contexts keyed with the key, per reader (index of the reader): MAC Tag (GMAC/Poly1305) and payload.
+	// Built at publish for the registered readers, by the first message of a reader registered later
+	EVP_CIPHER_CTX* mac_ctx[R_GOOSE_KEYRING_MAX_READERS];
+	EVP_CIPHER_CTX* enc_ctx[R_GOOSE_KEYRING_MAX_READERS];
+
+	// IV salt (derived from the key) and next SPDU Number to hand out - the only field changed after publication
+	uint8_t iv_salt[R_GOOSE_IV_SALT_SIZE];
+	_Atomic uint64_t iv_counter;
+
+	// Retire list link and epoch (owned by the writer)
+	struct r_goose_key* retired_next;
+	uint64_t retired_epoch;
+
+	// Next key already published by r_goose_keyring_tick() (owned by the writer)
+	int successor_staged;
+} r_goose_key;
+
+
+/**
+ * @brief Key material, as given to r_goose_keyring_publish(). Filled by the next key callback.
+ */
+typedef struct r_goose_key_material {
+	uint32_t key_id;
+	int mac_alg;
+	int enc_alg;
+	uint8_t key[R_GOOSE_KEYRING_MAX_KEY];
+	size_t key_size;
+	uint32_t timeOfCurrentKey;
+	uint16_t timeToNextKey;
+} r_goose_key_material;
+
+/**
+ * @brief Next key callback: fills @p next with the key that follows @p current (same APPID).
+ * Returns 1 if @p next was filled, 0 if the next key is not available yet (the request is repeated on the next tick).
+ * The Key ID of @p next must differ from the one of @p current (r_goose_keyring_tick() counts it as a failure otherwise).
+ */
+typedef int (*r_goose_next_key_fn)(void* arg, const r_goose_key* current, r_goose_key_material* next);
+
+
+/**
+ * @brief Block of SPDU Numbers reserved by a publishing thread under one key. Zero initialized before first use.
+ */
+typedef struct r_goose_iv_block {
+	const r_goose_key* key;
+	uint64_t next;
+	uint64_t end;
+} r_goose_iv_block;
+
+
+/**
+ * @brief Cipher contexts of one use (MAC Tag or payload) of a fan-out destination, one per cipher (index
+ * R_GOOSE_CIPHER_* - 1), each with the serial of the key it is keyed with (0: not keyed yet). Only used by a
+ * destination whose key already serves an earlier destination of the same call.
+ */
+typedef struct r_goose_cipher_set {
+	EVP_CIPHER_CTX* ctx[R_GOOSE_CIPHERS];
+	uint64_t serial[R_GOOSE_CIPHERS];
+} r_goose_cipher_set;
+
+/**
+ * @brief Per reader thread record: current epoch (0 when outside a read section) and fan-out contexts (the other
+ * cipher contexts of the reader are held by the key entries).
+ */
+typedef struct r_goose_keyring_reader {
+	_Atomic uint64_t epoch;
+	_Atomic int in_use;
+	// Contexts of each fan-out destination
+	r_goose_cipher_set fan_mac[R_GOOSE_FANOUT_MAX];
+	r_goose_cipher_set fan_enc[R_GOOSE_FANOUT_MAX];
+	char pad[64];
+} r_goose_keyring_reader;
+
+
+/**
+ * @brief Destination of r_gooseMessage_ProtectKeyringFanout(): the key (and so the algorithms and Security
+ * Information) and the header fields of one group, and the buffer that receives its protected message.
+ */
+typedef struct r_goose_fanout_target {
+	uint32_t key_id;
+	uint32_t spdu_number;
+	uint8_t* iv;			// NULL: r_goose_key_iv() of spdu_number
+	int iv_size;
+
+	uint8_t* dest;
+	size_t dest_size;
+	int size;				// set to the size of the protected message, or -1
+} r_goose_fanout_target;
+
+
+/**
+ * @brief Slot array of a key ring. Replaced as a whole when its tombstones are compacted, and retired like a key entry.
+ */
+typedef struct r_goose_keyring_table {
+	uint64_t retired_epoch;
+	_Atomic(r_goose_key*) slots[];
+} r_goose_keyring_table;
+
+/**
+ * @brief Key ring. Open addressing table of pointers to immutable key entries.
+ */
+typedef struct r_goose_keyring {
+	_Atomic(r_goose_keyring_table*) table;
+	size_t capacity;
+	size_t count;
+	size_t tombstones;
+
+	_Atomic uint64_t epoch;
+	r_goose_keyring_reader readers[R_GOOSE_KEYRING_MAX_READERS];
+
+	r_goose_key* retired;
+	r_goose_keyring_table* retired_table;		// Array replaced by the last compaction, until no reader can hold it
+	r_goose_keyring_table* spare;				// Array the next compaction is built in (allocated with the key ring)
+
+	// Rotation schedule and serial of the last key
+	uint32_t lead;
+	uint32_t overlap;
+	r_goose_next_key_fn next_key;
+	void* next_key_arg;
+	uint64_t serial;
+} r_goose_keyring;
+
+/**
+ * @brief Static storage (no heap build) of a key ring of @p capacity keys, with at most @p keys keys alive at once
+ * (published, staged by r_goose_keyring_tick() and retired but not yet released) and @p readers registered readers.
+ * Two slot arrays are counted: the current one and the one replaced by the last compaction, and two cipher contexts
+ * (MAC Tag and payload) per key and reader.
+ */
+#define R_GOOSE_KEYRING_STORAGE(capacity, keys, readers)	(R_GOOSE_STATIC_BLOCK(sizeof(r_goose_keyring)) + \
+		2 * R_GOOSE_STATIC_BLOCK(sizeof(r_goose_keyring_table) + R_GOOSE_STATIC_POW2(2 * (size_t)(capacity), 16) * sizeof(void*)) + \
+		(size_t)(keys) * R_GOOSE_STATIC_BLOCK(sizeof(r_goose_key)) + \
+		2 * (size_t)(keys) * (size_t)(readers) * R_GOOSE_STATIC_CRYPTO_CONTEXT)
+
+/**
+ * @brief Static storage (no heap build) of the fan-out contexts of @p readers readers that call
+ * r_gooseMessage_ProtectKeyringFanout().
+ */
+#define R_GOOSE_KEYRING_FANOUT_STORAGE(readers)	((size_t)(readers) * 2 * R_GOOSE_CIPHERS * R_GOOSE_FANOUT_MAX * R_GOOSE_STATIC_CRYPTO_CONTEXT)
+
+
+/**
+ * @brief Function that creates an empty key ring.
+ *
+ * @param capacity Variable (<tt>size_t</tt>) with the maximum number of keys held at the same time (rounded up to a power of two)
+ * @return A pointer to the new key ring, or NULL if an error occurred.
+ * @warning The key ring must be released with r_goose_keyring_free().
+ */
+r_goose_keyring* r_goose_keyring_new(size_t capacity);
+
+/**
+ * @brief Function that releases a key ring and all of its keys.
+ *
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @return The function doesn't return any value
+ * @warning No reader may be using the key ring when it is released.
+ */
+void r_goose_keyring_free(r_goose_keyring* ring);
+
+
+/**
+ * @brief Function that publishes a key for (@p appid, @p key_id).
+ *
+ * This function builds a new key entry, with all the states required by @p mac_alg and @p enc_alg and the cipher
+ * contexts of every registered reader, and makes it visible to readers with a single atomic store. If a key with the same (@p appid, @p key_id)
+ * already exists, it is replaced and retired; the new entry continues the SPDU Numbers of the old one
+ * (r_goose_key_iv_reserve() fails under the old entry from then on).
+ *
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param appid Variable (<tt>uint16_t</tt>) with the APPID of the stream
+ * @param key_id Variable (<tt>uint32_t</tt>) with the Key ID carried by the messages (INDEX_KEYID)
+ * @param mac_alg Variable (<tt>int</tt>) with the MAC algorithm used with this key (constants of r_goose_security.h)
+ * @param enc_alg Variable (<tt>int</tt>) with the encryption algorithm used with this key (ENC_NONE if none)
+ * @param key Pointer (<tt>uint8_t*</tt>) containg the key
+ * @param key_size Variable (<tt>size_t</tt>) that hold the size in bytes of key (at most R_GOOSE_KEYRING_MAX_KEY)
+ * @param timeOfCurrentKey Variable (<tt>uint32_t</tt>) with the TimeOfCurrentKey value of the key
+ * @param timeToNextKey Variable (<tt>uint16_t</tt>) with the TimeToNextKey value of the key
+ * @return The function returns 1 if the key was published and -1 if an error occurred (invalid parameters, key ring full).
+ * @warning Must only be called by the writer (control) thread.
+ */
+int r_goose_keyring_publish(r_goose_keyring* ring, uint16_t appid, uint32_t key_id, int mac_alg, int enc_alg,
+							uint8_t* key, size_t key_size, uint32_t timeOfCurrentKey, uint16_t timeToNextKey);
+
+/**
+ * @brief Function that retires the key (@p appid, @p key_id).
+ *
+ * The key is removed from the table immediately (new lookups will not find it), and released once
+ * no reader can be using it anymore. If the tombstones left by retired keys reach a quarter of the capacity, the
+ * table is rebuilt without them.
+ *
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param appid Variable (<tt>uint16_t</tt>) with the APPID of the stream
+ * @param key_id Variable (<tt>uint32_t</tt>) with the Key ID
+ * @return The function returns 1 if the key was retired and 0 if it was not found.
+ * @warning Must only be called by the writer (control) thread.
+ */
+int r_goose_keyring_retire(r_goose_keyring* ring, uint16_t appid, uint32_t key_id);
+
+/**
+ * @brief Function that releases retired keys no longer reachable by any reader.
+ *
+ * Called by r_goose_keyring_publish() and r_goose_keyring_retire(); may also be called periodically by the writer thread.
+ *
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @return The number of retired keys (and replaced slot arrays) still waiting to be released.
+ * @warning Must only be called by the writer (control) thread.
+ */
+int r_goose_keyring_reclaim(r_goose_keyring* ring);
+
+
+/**
+ * @brief Function that sets the key rotation schedule of @p ring.
+ *
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param lead Variable (<tt>uint32_t</tt>) with the seconds before the rollover at which the next key is requested and published
+ * @param overlap Variable (<tt>uint32_t</tt>) with the seconds after the rollover during which the old key is still accepted
+ * @param next_key Pointer (<tt>r_goose_next_key_fn</tt>) to the callback that provides the next key of a stream
+ * @param arg Pointer (<tt>void*</tt>) passed to @p next_key
+ * @return The function doesn't return any value
+ * @warning Must only be called by the writer (control) thread.
+ */
+void r_goose_keyring_set_schedule(r_goose_keyring* ring, uint32_t lead, uint32_t overlap, r_goose_next_key_fn next_key, void* arg);
+
+/**
+ * @brief Function that runs the key rotation schedule at time @p now.
+ *
+ * For every key whose rollover (TimeOfCurrentKey + TimeToNextKey minutes) is less than @p lead seconds away,
+ * the next key is requested from the callback and published (contexts of the registered readers built and warmed
+ * up). Keys that have a successor and whose rollover is more than @p overlap seconds in the past are retired.
+ * A key whose successor cannot be published (key ring full, or the callback returned the Key ID of the current key)
+ * is counted in @p failed and requested again on the next tick; the other keys are still handled.
+ *
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param now Variable (<tt>uint32_t</tt>) with the current time, in the same unit as TimeOfCurrentKey (seconds)
+ * @param failed Pointer (<tt>int*</tt>) that receives the number of keys whose successor could not be published, or NULL
+ * @return The number of keys published by this tick.
+ * @warning Must only be called by the writer (control) thread, typically once per second.
+ */
+int r_goose_keyring_tick(r_goose_keyring* ring, uint32_t now, int* failed);
+
+
+/**
+ * @brief Function that registers the calling thread as a reader of @p ring.
+ *
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @return The reader identifier (to be passed to the other reader functions), or -1 if R_GOOSE_KEYRING_MAX_READERS
+ * readers are already registered.
+ */
+int r_goose_keyring_reader_register(r_goose_keyring* ring);
+
+/**
+ * @brief Function that unregisters a reader, releasing its identifier.
+ *
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the reader identifier
+ * @return The function doesn't return any value
+ */
+void r_goose_keyring_reader_unregister(r_goose_keyring* ring, int reader);
+
+/**
+ * @brief Function that starts a read section. Key entries returned by r_goose_keyring_lookup() stay valid
+ * until r_goose_keyring_reader_exit() is called.
+ *
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the reader identifier
+ * @return The function doesn't return any value
+ */
+void r_goose_keyring_reader_enter(r_goose_keyring* ring, int reader);
+
+/**
+ * @brief Function that ends a read section.
+ *
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the reader identifier
+ * @return The function doesn't return any value
+ */
+void r_goose_keyring_reader_exit(r_goose_keyring* ring, int reader);
+
+/**
+ * @brief Function that finds the key (@p appid, @p key_id).
+ *
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param appid Variable (<tt>uint16_t</tt>) with the APPID of the stream
+ * @param key_id Variable (<tt>uint32_t</tt>) with the Key ID
+ * @return A pointer to the key entry, or NULL if the key is not in the key ring.
+ * @warning Must be called inside a read section (r_goose_keyring_reader_enter()), the entry must not be used after it ends.
+ */
+const r_goose_key* r_goose_keyring_lookup(r_goose_keyring* ring, uint16_t appid, uint32_t key_id);
+
+
+/**
+ * @brief Function that generates the MAC Tag of @p data with a key entry, using its prebuilt states.
+ *
+ * @p data is the part of an R-GOOSE message covered by the MAC Tag (from its third byte): the SPDU Number it carries
+ * sets the nonce of CHACHA20_POLY1305_128 (poly1305_CHACHA20_nonce()).
+ *
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the reader identifier (its MAC cipher contexts are used)
+ * @param k Pointer (<tt>r_goose_key*</tt>) to the key entry
+ * @param data Pointer (<tt>uint8_t*</tt>) containg the data that will be used to generate the MAC Tag
+ * @param data_size Variable (<tt>size_t</tt>) that hold the size in bytes of data
+ * @param dest Pointer (<tt>uint8_t*</tt>) to a buffer with at least MAC_SIZES[k->mac_alg] bytes
+ * @return The function returns the size of the MAC Tag, or -1 if an error occurred.
+ */
+int r_goose_key_mac(r_goose_keyring* ring, int reader, const r_goose_key* k, uint8_t* data, size_t data_size, uint8_t* dest);
+
+
+/**
+ * @brief Function that generates and inserts a MAC Tag into an R-GOOSE message, using a key of the key ring.
+ *
+ * Same as r_gooseMessage_InsertHMAC()/r_gooseMessage_InsertGMAC(), but the MAC algorithm, key and Security
+ * Information fields (TimeOfCurrentKey, TimeToNextKey, Key ID) are taken from the key entry (@p appid, @p key_id),
+ * so that receivers can find the key from the header.
+ *
+ * @param buffer Pointer (<tt>uint8_t*</tt>) containg to the R-GOOSE message
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the reader identifier
+ * @param key_id Variable (<tt>uint32_t</tt>) with the Key ID (the APPID is read from the message)
+ * @param dest Pointer (<tt>uint8_t**</tt>) pointing to the destiny memory address where the new message should be stored
+ * @return The function returns -1 if an error occurred (unknown key) and 1 if the tag was successfully generated and inserted.
+ * @warning @p dest memory should be released outside the function (where @p dest is declared) (free())
+ */
+int r_gooseMessage_InsertKeyring(uint8_t* buffer, r_goose_keyring* ring, int reader, uint32_t key_id, uint8_t** dest);
+
+/**
+ * @brief Function that validates or invalidates an R-GOOSE message, using the key selected by its header.
+ *
+ * The APPID (INDEX_APPID) and Key ID (INDEX_KEYID) of the message select the key entry. The MAC algorithm
+ * of the message must be the one of the key. The read section is handled by the function. As in
+ * r_gooseMessage_Prefilter(), the SPDU Length must match the received length @p len, so a forged length can't make
+ * the MAC read past the buffer. The MAC Tag is compared in constant time.
+ *
+ * @param buffer Pointer (<tt>uint8_t*</tt>) containg to the R-GOOSE message
+ * @param len Variable (<tt>size_t</tt>) with the number of bytes received
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the reader identifier
+ * @return The function returns -1 if an error occurred (unknown key, algorithm mismatch or SPDU Length not matching
+ * @p len), 0 if the message is invalid, 1 if the message is valid and 2 if there is no MAC Tag on the message.
+ */
+int r_gooseMessage_ValidateKeyring(uint8_t* buffer, size_t len, r_goose_keyring* ring, int reader);
+
+/**
+ * @brief Function that decrypts an R-GOOSE message in place, using the key selected by its header.
+ *
+ * The SPDU Length must match the received length @p len, and the payload (APDU Length) must end before the Signature
+ * TAG, Signature Length and MAC Tag, so forged lengths can't move the decryption past the received bytes.
+ *
+ * @param buffer Pointer (<tt>uint8_t*</tt>) containg to the R-GOOSE message
+ * @param len Variable (<tt>size_t</tt>) with the number of bytes received
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the reader identifier
+ * @param iv Pointer (<tt>uint8_t*</tt>) containg the Initialization Vector
+ * @param iv_size Variable (<tt>int</tt>) that hold the size in bytes of IV
+ * @return The function returns -1 if an error occurred (unknown key, algorithm mismatch, SPDU Length not matching
+ * @p len or APDU Length out of the message), 0 if the message is not encrypted and 1 if it was decrypted.
+ * @warning The message is not authenticated. Use r_gooseMessage_UnprotectKeyring(), which decrypts only messages
+ * found valid, or call this function only after r_gooseMessage_ValidateKeyring() returned 1 for the same buffer.
+ */
+int r_gooseMessage_DecryptKeyring(uint8_t* buffer, size_t len, r_goose_keyring* ring, int reader, uint8_t* iv, int iv_size);
+
+/**
+ * @brief Function that writes the IV of the message @p spdu_number under the key @p k.
+ *
+ * IV (96 bits) = salt (R_GOOSE_IV_SALT_SIZE bytes, derived from the key when it is published) || SPDU Number (big
+ * endian). Publisher and subscribers derive the same IV from the key and the header, with no random numbers and no
+ * IV carried in the message. The IV is unique as long as no SPDU Number is used twice under the same key, which
+ * r_goose_key_iv_reserve() guarantees for the numbers it hands out (2^32 per key, then the key must be rotated).
+ *
+ * @param k Pointer (<tt>r_goose_key*</tt>) to the key entry
+ * @param spdu_number Variable (<tt>uint32_t</tt>) with the SPDU Number of the message
+ * @param iv Pointer (<tt>uint8_t*</tt>) to the destination (R_GOOSE_IV_SIZE bytes)
+ * @return The function doesn't return any value
+ */
+void r_goose_key_iv(const r_goose_key* k, uint32_t spdu_number, uint8_t* iv);
+
+/**
+ * @brief Function that reserves @p count consecutive SPDU Numbers under the key @p k.
+ *
+ * The numbers are taken from a counter of the key entry with one atomic addition, so threads publishing under the
+ * same key never take the same number and never wait for each other.
+ *
+ * @param k Pointer (<tt>r_goose_key*</tt>) to the key entry (inside a read section)
+ * @param count Variable (<tt>uint32_t</tt>) with the number of SPDU Numbers
+ * @param block Pointer (<tt>r_goose_iv_block*</tt>) set to the reserved numbers
+ * @return The function returns 1, or -1 if @p count is 0 or the key has less than @p count numbers left.
+ */
+int r_goose_key_iv_reserve(const r_goose_key* k, uint32_t count, r_goose_iv_block* block);
+
+/**
+ * @brief Function that takes the next SPDU Number (and its IV) of the block of the calling thread, reserving a new
+ * block of R_GOOSE_IV_BLOCK numbers when it is empty or was reserved under another key.
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * r_goose_iv_block block = {0};										// one per publishing thread
+ * uint8_t iv[R_GOOSE_IV_SIZE];
+ * uint32_t spdu_number;
+ *
+ * r_goose_keyring_reader_enter(ring, reader);
+ * const r_goose_key* k = r_goose_keyring_lookup(ring, appid, key_id);
+ * if(k != NULL && r_goose_iv_block_next(k, &block, &spdu_number, iv) == 1){
+ * 	encodeInt4Bytes(buffer, spdu_number, INDEX_SPDU_NUMBER);
+ * }
+ * r_goose_keyring_reader_exit(ring, reader);
+ * r_gooseMessage_ProtectKeyring(buffer, buffer_size, ring, reader, key_id, NULL, 0);	// IV derived again
+ *
+ * @endcode
+ *
+ * @param k Pointer (<tt>r_goose_key*</tt>) to the key entry (inside a read section)
+ * @param block Pointer (<tt>r_goose_iv_block*</tt>) to the block of the calling thread
+ * @param spdu_number Pointer (<tt>uint32_t*</tt>) set to the SPDU Number
+ * @param iv Pointer (<tt>uint8_t*</tt>) set to the IV (R_GOOSE_IV_SIZE bytes), or NULL
+ * @return The function returns 1, or -1 if the key has no numbers left.
+ * @note Subscribers accept SPDU Numbers up to R_GOOSE_REPLAY_WINDOW behind the highest one. Threads publishing the
+ * same stream must send at similar rates, so that their blocks don't drift apart by more than the window.
+ */
+int r_goose_iv_block_next(const r_goose_key* k, r_goose_iv_block* block, uint32_t* spdu_number, uint8_t* iv);
+
+/**
+ * @brief Function that moves the counter of the key @p k up to @p first (never down), so that a stream continues
+ * its SPDU Numbers under a new key, or under a key published again with the same material.
+ *
+ * @param k Pointer (<tt>r_goose_key*</tt>) to the key entry (inside a read section)
+ * @param first Variable (<tt>uint32_t</tt>) with the first SPDU Number to hand out
+ * @return The function doesn't return any value
+ */
+void r_goose_key_iv_advance(const r_goose_key* k, uint32_t first);
+
+/**
+ * @brief Function that encrypts an R-GOOSE message and inserts its MAC Tag, in place, using a key of the key ring.
+ *
+ * Same result as r_gooseMessage_Encrypt() followed by r_gooseMessage_InsertKeyring(), in one traversal of the
+ * message: the payload is encrypted in chunks of R_GOOSE_PROTECT_CHUNK bytes and each chunk is given to the MAC
+ * right away, while it is in the cache. The algorithms and Security Information are taken from the key entry
+ * (no encryption if the key has ENC_NONE).
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * uint8_t buffer[1600];
+ * build_message(buffer);											// pseudo-function that writes an R-GOOSE message without MAC Tag
+ * int len = r_gooseMessage_ProtectKeyring(buffer, sizeof(buffer), ring, reader, key_id, iv, 12);
+ * if(len > 0){
+ * 	send_packet(buffer, len);										// pseudo-function that sends the message
+ * }
+ *
+ * @endcode
+ *
+ * @param buffer Pointer (<tt>uint8_t*</tt>) containg to the R-GOOSE message
+ * @param buffer_size Variable (<tt>size_t</tt>) with the size of @p buffer (message size + MAC size at least)
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the reader identifier
+ * @param key_id Variable (<tt>uint32_t</tt>) with the Key ID (the APPID is read from the message)
+ * @param iv Pointer (<tt>uint8_t*</tt>) containg the Initialization Vector, or NULL to use r_goose_key_iv() with the
+ * SPDU Number of the message
+ * @param iv_size Variable (<tt>int</tt>) that hold the size in bytes of IV (ignored if @p iv is NULL)
+ * @return The function returns the size of the protected message, or -1 if an error occurred (unknown key, key without
+ * MAC algorithm, @p buffer too small).
+ */
+int r_gooseMessage_ProtectKeyring(uint8_t* buffer, size_t buffer_size, r_goose_keyring* ring, int reader, uint32_t key_id, uint8_t* iv, int iv_size);
+
+/**
+ * @brief Function that encrypts an R-GOOSE message and inserts its MAC Tag out of place: the message is read from
+ * @p src and the protected message is written to @p dest, in the same single traversal as
+ * r_gooseMessage_ProtectKeyring().
+ *
+ * @p src is only read, so a publisher keeps one plaintext message and protects it again for each retransmission or
+ * for several groups (keys) without copying it first. Nothing is allocated. The result is byte for byte the same as
+ * r_gooseMessage_ProtectKeyring() on a copy of @p src.
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * uint8_t plain[1500], out[1600];
+ * build_message(plain);											// pseudo-function that writes an R-GOOSE message without MAC Tag
+ * for(int g = 0; g < groups; g++){
+ * 	int len = r_gooseMessage_ProtectKeyringTo(plain, out, sizeof(out), ring, reader, key_ids[g], NULL, 0);
+ * 	if(len > 0){
+ * 		send_packet(out, len);										// pseudo-function that sends the message
+ * 	}
+ * }
+ *
+ * @endcode
+ *
+ * @param src Pointer (<tt>const uint8_t*</tt>) containg the R-GOOSE message without MAC Tag (left unchanged)
+ * @param dest Pointer (<tt>uint8_t*</tt>) to the buffer that receives the protected message
+ * @param dest_size Variable (<tt>size_t</tt>) with the size of @p dest (message size + MAC size at least)
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the reader identifier
+ * @param key_id Variable (<tt>uint32_t</tt>) with the Key ID (the APPID is read from @p src)
+ * @param iv Pointer (<tt>uint8_t*</tt>) containg the Initialization Vector, or NULL to use r_goose_key_iv() with the
+ * SPDU Number of @p src
+ * @param iv_size Variable (<tt>int</tt>) that hold the size in bytes of IV (ignored if @p iv is NULL)
+ * @return The function returns the size of the protected message, or -1 if an error occurred (unknown key, key without
+ * MAC algorithm, @p dest too small).
+ * @warning @p src and @p dest must either be the same pointer (in place) or not overlap at all.
+ */
+int r_gooseMessage_ProtectKeyringTo(const uint8_t* src, uint8_t* dest, size_t dest_size, r_goose_keyring* ring, int reader, uint32_t key_id, uint8_t* iv, int iv_size);
+
+/**
+ * @brief Function that protects one R-GOOSE message for several groups, each with its own key, SPDU Number and
+ * destination buffer, reading the payload once.
+ *
+ * The payload of @p src is streamed in chunks of R_GOOSE_PROTECT_CHUNK bytes, and every chunk is encrypted and given
+ * to the MAC of all the destinations before the next one is read, so the cipher and MAC states of the keys advance
+ * together over data that is in the cache. Each destination receives the same bytes as
+ * r_gooseMessage_ProtectKeyringTo() with its key, after its SPDU Number is written. @p src is left unchanged.
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * r_goose_fanout_target groups[3];
+ * for(int g = 0; g < 3; g++){
+ * 	groups[g].key_id = key_ids[g];
+ * 	groups[g].spdu_number = next_spdu_number(g);					// pseudo-function with the counter of the group
+ * 	groups[g].iv = NULL;
+ * 	groups[g].dest = out[g];
+ * 	groups[g].dest_size = sizeof(out[g]);
+ * }
+ *
+ * r_gooseMessage_ProtectKeyringFanout(plain, groups, 3, ring, reader);
+ * for(int g = 0; g < 3; g++){
+ * 	if(groups[g].size > 0){
+ * 		send_packet(g, out[g], groups[g].size);						// pseudo-function that sends the message to the group
+ * 	}
+ * }
+ *
+ * @endcode
+ *
+ * @param src Pointer (<tt>const uint8_t*</tt>) containg the R-GOOSE message without MAC Tag (left unchanged)
+ * @param targets Pointer (<tt>r_goose_fanout_target*</tt>) to the destinations; their @c size is set
+ * @param count Variable (<tt>int</tt>) with the number of destinations (1 to R_GOOSE_FANOUT_MAX)
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the reader identifier
+ * @return The function returns the number of destinations protected, or -1 if @p src or @p count is invalid. A
+ * destination with an unknown key, a key without MAC algorithm or a buffer too small gets @c size -1 and nothing is
+ * written to it; the others are still protected.
+ * @warning The destination buffers must not overlap @p src or each other.
+ */
+int r_gooseMessage_ProtectKeyringFanout(const uint8_t* src, r_goose_fanout_target* targets, int count, r_goose_keyring* ring, int reader);
+
+/**
+ * @brief Function that validates an R-GOOSE message and decrypts it in place, using the key selected by its header.
+ *
+ * Same result as r_gooseMessage_ValidateKeyring() followed, for valid messages, by r_gooseMessage_DecryptKeyring(),
+ * in one traversal of the message: each chunk of the payload is given to the MAC before it is decrypted. As in
+ * r_gooseMessage_ValidateKeyring(), the SPDU Length must match the received length @p len, checked before the payload
+ * is touched. When the MAC Tag doesn't match, or an error occurs once decryption started, what was decrypted is
+ * encrypted again (wiped if that fails), so the payload of a message not found valid is never left as plaintext.
+ *
+ * @param buffer Pointer (<tt>uint8_t*</tt>) containg to the R-GOOSE message
+ * @param len Variable (<tt>size_t</tt>) with the number of bytes received
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the reader identifier
+ * @param iv Pointer (<tt>uint8_t*</tt>) containg the Initialization Vector, or NULL to use r_goose_key_iv() with the
+ * SPDU Number of the message
+ * @param iv_size Variable (<tt>int</tt>) that hold the size in bytes of IV (ignored if @p iv is NULL)
+ * @return The function returns -1 if an error occurred (unknown key, algorithm mismatch, SPDU Length not matching
+ * @p len or APDU Length out of the message), 0 if the message is invalid, 1 if the message is valid (and decrypted, if
+ * it was encrypted) and 2 if there is no MAC Tag on the message (not decrypted).
+ */
+int r_gooseMessage_UnprotectKeyring(uint8_t* buffer, size_t len, r_goose_keyring* ring, int reader, uint8_t* iv, int iv_size);
+
+/**
+ * @brief Function that encrypts an R-GOOSE message split across several buffers and writes its MAC Tag to a buffer of
+ * its own (scatter-gather version of r_gooseMessage_ProtectKeyring()).
+ *
+ * The message (from the LI, without MAC Tag) is the concatenation of the @p iovcnt fragments of @p iov, which may be
+ * split at any byte. The header fields are updated and the payload is encrypted inside the fragments, and the MAC Tag
+ * is written to @p tag, so the protected message is sent with sendmsg() using @p iov followed by @p tag, without
+ * concatenating it first. The bytes are the same as r_gooseMessage_ProtectKeyring() on the concatenated message.
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * uint8_t tag_buffer[MAX_MAC_SIZE];
+ * struct iovec iov[3] = {{session_header, 38}, {goose_pdu, pdu_size}, {tag_buffer, sizeof(tag_buffer)}};
+ *
+ * int len = r_gooseMessage_ProtectKeyringV(iov, 2, &iov[2], ring, reader, key_id, NULL, 0);
+ * if(len > 0){
+ * 	struct msghdr msg = {.msg_name = &group, .msg_namelen = sizeof(group), .msg_iov = iov, .msg_iovlen = 3};
+ * 	sendmsg(sock, &msg, 0);
+ * }
+ *
+ * @endcode
+ *
+ * @param iov Pointer (<tt>const struct iovec*</tt>) to the fragments of the R-GOOSE message
+ * @param iovcnt Variable (<tt>int</tt>) with the number of fragments
+ * @param tag Pointer (<tt>struct iovec*</tt>) to the buffer of the MAC Tag (at least the MAC size); its length is set
+ * to the MAC size
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the reader identifier
+ * @param key_id Variable (<tt>uint32_t</tt>) with the Key ID (the APPID is read from the message)
+ * @param iv Pointer (<tt>uint8_t*</tt>) containg the Initialization Vector, or NULL to use r_goose_key_iv() with the
+ * SPDU Number of the message
+ * @param iv_size Variable (<tt>int</tt>) that hold the size in bytes of IV (ignored if @p iv is NULL)
+ * @return The function returns the size of the protected message (fragments and MAC Tag), or -1 if an error occurred
+ * (unknown key, key without MAC algorithm, fragments shorter than the message, @p tag too small).
+ */
+int r_gooseMessage_ProtectKeyringV(const struct iovec* iov, int iovcnt, struct iovec* tag, r_goose_keyring* ring, int reader, uint32_t key_id, uint8_t* iv, int iv_size);
+
+/**
+ * @brief Function that validates an R-GOOSE message split across several buffers (scatter-gather version of
+ * r_gooseMessage_ValidateKeyring()). The MAC Tag may be in a fragment of its own.
+ *
+ * @param iov Pointer (<tt>const struct iovec*</tt>) to the fragments of the R-GOOSE message
+ * @param iovcnt Variable (<tt>int</tt>) with the number of fragments
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the reader identifier
+ * @return The function returns -1 if an error occurred (unknown key, fragments shorter than the message), 0 if the
+ * message is invalid, 1 if the message is valid and 2 if there is no MAC Tag on the message.
+ */
+int r_gooseMessage_ValidateKeyringV(const struct iovec* iov, int iovcnt, r_goose_keyring* ring, int reader);
+
+/**
+ * @brief Function that validates an R-GOOSE message split across several buffers and decrypts it inside the fragments
+ * (scatter-gather version of r_gooseMessage_UnprotectKeyring()), e.g. as received with recvmsg(). The MAC Tag may be
+ * in a fragment of its own, and an invalid message is left as it was received.
+ *
+ * @param iov Pointer (<tt>const struct iovec*</tt>) to the fragments of the R-GOOSE message
+ * @param iovcnt Variable (<tt>int</tt>) with the number of fragments
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the reader identifier
+ * @param iv Pointer (<tt>uint8_t*</tt>) containg the Initialization Vector, or NULL to use r_goose_key_iv() with the
+ * SPDU Number of the message
+ * @param iv_size Variable (<tt>int</tt>) that hold the size in bytes of IV (ignored if @p iv is NULL)
+ * @return The function returns -1 if an error occurred (unknown key, algorithm mismatch, fragments shorter than the
+ * message), 0 if the message is invalid, 1 if the message is valid (and decrypted, if it was encrypted) and 2 if there
+ * is no MAC Tag on the message (not decrypted).
+ */
+int r_gooseMessage_UnprotectKeyringV(const struct iovec* iov, int iovcnt, r_goose_keyring* ring, int reader, uint8_t* iv, int iv_size);
+
+#endif
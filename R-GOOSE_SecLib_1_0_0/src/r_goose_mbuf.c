@@ -0,0 +1,261 @@
+/*
+	File defining the packet buffer pool (Custom/Off-Standard)
+
+	Memory:
+		one block of count * buf_size bytes (buf_size = headroom + data_room rounded up to
+		R_GOOSE_MBUF_ALIGN), cache line aligned, and an array of descriptors. The block is
+		zeroed on creation, so every page is touched (and placed) by the creating thread.
+
+	Free list:
+		lock-free stack (Treiber) of descriptor indexes. The head holds a version in the high
+		32 bits, incremented by every pop and push, so a pop whose head was popped and pushed
+		back meanwhile (ABA) fails its compare and exchange and retries.
+
+	Reference count:
+		release is acq_rel, so the writes of every holder happen before the buffer is pushed
+		back and taken by another thread.
+*/
+
+#include "r_goose_mbuf.h"
+
+#include <string.h>
+
+
+r_goose_mbuf_pool* r_goose_mbuf_pool_new(uint32_t count, uint32_t headroom, uint32_t data_room){
+	uint64_t size = (uint64_t)headroom + data_room;
+	r_goose_mbuf_pool* pool;
+	uint8_t* memory;
+
+	size = (size + R_GOOSE_MBUF_ALIGN - 1) / R_GOOSE_MBUF_ALIGN * R_GOOSE_MBUF_ALIGN;
+	if(count == 0 || size > UINT32_MAX){
+		return NULL;
+	}
+
+	pool = (r_goose_mbuf_pool*)r_goose_calloc(1, sizeof(r_goose_mbuf_pool));
+	if(pool == NULL){
+		return NULL;
+	}
+	pool->mbufs = (r_goose_mbuf*)r_goose_calloc(count, sizeof(r_goose_mbuf));
+	memory = (uint8_t*)r_goose_aligned_alloc(R_GOOSE_MBUF_ALIGN, (size_t)size * count);
+	if(pool->mbufs == NULL || memory == NULL){
+		r_goose_free(memory);
+		r_goose_free(pool->mbufs);
+		r_goose_free(pool);
+		return NULL;
+	}
+
+	// First touch by the creating thread
+	memset(memory, 0, (size_t)size * count);
+
+	pool->memory = memory;
+	pool->count = count;
+	pool->buf_size = (uint32_t)size;
+	pool->headroom = headroom;
+
+	for(uint32_t i = 0; i < count; i++){
+		r_goose_mbuf* m = &pool->mbufs[i];
+		m->pool = pool;
+		m->buf = &pool->memory[(size_t)i * size];
+		m->buf_size = (uint32_t)size;
+		atomic_init(&m->refcnt, 0);
+		atomic_init(&m->next, i + 1 < count ? i + 2 : 0);
+	}
+	atomic_init(&pool->free_head, 1);
+	atomic_init(&pool->available, count);
+
+	return pool;
+}
+
+void r_goose_mbuf_pool_free(r_goose_mbuf_pool* pool){
+	if(pool == NULL){
+		return;
+	}
+	r_goose_free(pool->memory);
+	r_goose_free(pool->mbufs);
+	r_goose_free(pool);
+}
+
+uint32_t r_goose_mbuf_available(r_goose_mbuf_pool* pool){
+	return atomic_load_explicit(&pool->available, memory_order_relaxed);
+}
+
+r_goose_mbuf* r_goose_mbuf_alloc(r_goose_mbuf_pool* pool){
+	uint64_t head = atomic_load_explicit(&pool->free_head, memory_order_acquire);
+	uint64_t next;
+	r_goose_mbuf* m;
+
+	do{
+		uint32_t index = (uint32_t)head;
+		if(index == 0){
+			return NULL;
+		}
+		m = &pool->mbufs[index - 1];
+		next = ((head >> 32) + 1) << 32 | atomic_load_explicit(&m->next, memory_order_relaxed);
+	}while(!atomic_compare_exchange_weak_explicit(&pool->free_head, &head, next, memory_order_acquire, memory_order_acquire));
+
+	atomic_fetch_sub_explicit(&pool->available, 1, memory_order_relaxed);
+
+	m->data_off = pool->headroom;
+	m->data_len = 0;
+	atomic_store_explicit(&m->refcnt, 1, memory_order_relaxed);
+
+	return m;
+}
+
+void r_goose_mbuf_ref(r_goose_mbuf* m){
+	atomic_fetch_add_explicit(&m->refcnt, 1, memory_order_relaxed);
+}
+
+void r_goose_mbuf_release(r_goose_mbuf* m){
+	r_goose_mbuf_pool* pool = m->pool;
+	uint64_t head, next;
+
+	if(atomic_fetch_sub_explicit(&m->refcnt, 1, memory_order_acq_rel) != 1){
+		return;
+	}
+
+	head = atomic_load_explicit(&pool->free_head, memory_order_relaxed);
+	do{
+		atomic_store_explicit(&m->next, (uint32_t)head, memory_order_relaxed);
+		next = ((head >> 32) + 1) << 32 | (uint32_t)(m - pool->mbufs + 1);
+	}while(!atomic_compare_exchange_weak_explicit(&pool->free_head, &head, next, memory_order_release, memory_order_relaxed));
+
+	atomic_fetch_add_explicit(&pool->available, 1, memory_order_relaxed);
+}
+
+uint32_t r_goose_mbuf_refcnt(r_goose_mbuf* m){
+	return atomic_load_explicit(&m->refcnt, memory_order_relaxed);
+}
+
+uint8_t* r_goose_mbuf_data(r_goose_mbuf* m){
+	return &m->buf[m->data_off];
+}
+
+uint32_t r_goose_mbuf_len(r_goose_mbuf* m){
+	return m->data_len;
+}
+
+uint32_t r_goose_mbuf_headroom(r_goose_mbuf* m){
+	return m->data_off;
+}
+
+uint32_t r_goose_mbuf_tailroom(r_goose_mbuf* m){
+	return m->buf_size - m->data_off - m->data_len;
+}
+
+uint8_t* r_goose_mbuf_prepend(r_goose_mbuf* m, uint32_t len){
+	if(len > m->data_off || r_goose_mbuf_refcnt(m) > 1){
+		return NULL;
+	}
+	m->data_off -= len;
+	m->data_len += len;
+	return &m->buf[m->data_off];
+}
+
+uint8_t* r_goose_mbuf_append(r_goose_mbuf* m, uint32_t len){
+	uint8_t* tail = &m->buf[m->data_off + m->data_len];
+
+	if(len > r_goose_mbuf_tailroom(m) || r_goose_mbuf_refcnt(m) > 1){
+		return NULL;
+	}
+	m->data_len += len;
+	return tail;
+}
+
+uint8_t* r_goose_mbuf_adj(r_goose_mbuf* m, uint32_t len){
+	if(len > m->data_len){
+		return NULL;
+	}
+	m->data_off += len;
+	m->data_len -= len;
+	return &m->buf[m->data_off];
+}
+
+int r_goose_mbuf_trim(r_goose_mbuf* m, uint32_t len){
+	if(len > m->data_len){
+		return -1;
+	}
+	m->data_len -= len;
+	return 0;
+}
+
+
+// The data of the buffer must be exactly one R-GOOSE message
+static int mbuf_message(r_goose_mbuf* m){
+	uint8_t* data = r_goose_mbuf_data(m);
+
+	return m->data_len >= INDEX_PAYLOAD && decode_4bytesToInt(data, INDEX_SPDU_LENGTH) + 10 == m->data_len ? 0 : -1;
+}
+
+// Empties a destination buffer (data starts after the headroom of the pool)
+static int mbuf_reset(r_goose_mbuf* m){
+	if(r_goose_mbuf_refcnt(m) > 1){
+		return -1;
+	}
+	m->data_off = m->pool->headroom;
+	m->data_len = 0;
+	return 0;
+}
+
+int r_gooseMessage_ProtectMbuf(r_goose_mbuf* m, r_goose_keyring* ring, int reader, uint32_t key_id, uint8_t* iv, int iv_size){
+	int size;
+
+	if(mbuf_message(m) < 0 || r_goose_mbuf_refcnt(m) > 1){
+		return -1;
+	}
+
+	size = r_gooseMessage_ProtectKeyring(r_goose_mbuf_data(m), m->buf_size - m->data_off, ring, reader, key_id, iv, iv_size);
+	if(size > 0){
+		m->data_len = size;
+	}
+	return size;
+}
+
+int r_gooseMessage_ProtectMbufTo(r_goose_mbuf* src, r_goose_mbuf* dest, r_goose_keyring* ring, int reader, uint32_t key_id, uint8_t* iv, int iv_size){
+	int size;
+
+	if(mbuf_message(src) < 0 || src == dest || mbuf_reset(dest) < 0){
+		return -1;
+	}
+
+	size = r_gooseMessage_ProtectKeyringTo(r_goose_mbuf_data(src), r_goose_mbuf_data(dest), r_goose_mbuf_tailroom(dest), ring, reader, key_id, iv, iv_size);
+	if(size > 0){
+		dest->data_len = size;
+	}
+	return size;
+}
+
+int r_gooseMessage_ProtectMbufFanout(r_goose_mbuf* src, r_goose_mbuf** dests, r_goose_fanout_target* targets, int count, r_goose_keyring* ring, int reader){
+	int res;
+
+	if(mbuf_message(src) < 0 || count < 1 || count > R_GOOSE_FANOUT_MAX){
+		return -1;
+	}
+	for(int t = 0; t < count; t++){
+		if(dests[t] == src || mbuf_reset(dests[t]) < 0){
+			return -1;
+		}
+		targets[t].dest = r_goose_mbuf_data(dests[t]);
+		targets[t].dest_size = r_goose_mbuf_tailroom(dests[t]);
+	}
+
+	res = r_gooseMessage_ProtectKeyringFanout(r_goose_mbuf_data(src), targets, count, ring, reader);
+	for(int t = 0; t < count; t++){
+		dests[t]->data_len = targets[t].size > 0 ? targets[t].size : 0;
+	}
+	return res;
+}
+
+int r_gooseMessage_ValidateMbuf(r_goose_mbuf* m, r_goose_keyring* ring, int reader){
+	if(mbuf_message(m) < 0){
+		return -1;
+	}
+	return r_gooseMessage_ValidateKeyring(r_goose_mbuf_data(m), m->data_len, ring, reader);
+}
+
+int r_gooseMessage_UnprotectMbuf(r_goose_mbuf* m, r_goose_keyring* ring, int reader, uint8_t* iv, int iv_size){
+	if(mbuf_message(m) < 0 || r_goose_mbuf_refcnt(m) > 1){
+		return -1;
+	}
+	return r_gooseMessage_UnprotectKeyring(r_goose_mbuf_data(m), m->data_len, ring, reader, iv, iv_size);
+}
@@ -0,0 +1,313 @@
+/**
+ * @file r_goose_mbuf.h
+ * @author Eduardo Andrade
+ * @date Mar 2020
+ * @brief File containing the declarations of the packet buffer pool, reference counted buffers with headroom and
+ * tailroom that carry an R-GOOSE message through the protection and transmission path without copies.
+ *
+ * A pool preallocates all its buffers in one block when it is created:
+ *				- Each buffer has a headroom in front of the message, where the lower layers prepend their headers
+ *				  (UDP, IP, Ethernet) in place, and a tailroom after it, where the MAC Tag is appended.
+ *				- Buffers are taken and given back with a lock-free free list, so any thread can allocate and
+ *				  release them, and nothing is allocated after the pool is created.
+ *				- A buffer is reference counted: a protected message handed to several senders (queues, sockets)
+ *				  is shared with r_goose_mbuf_ref() and returns to the pool when the last one releases it.
+ *				- The pool memory is written by the thread that creates the pool, so with the first-touch policy of
+ *				  the kernel its pages are on the NUMA node of that thread. A pool per node, created by a thread
+ *				  running on it, keeps the buffers local to the threads of that node.
+ *
+ * The protection functions of the key ring work on the buffers directly: r_gooseMessage_ProtectMbuf() (in place,
+ * MAC Tag in the tailroom), r_gooseMessage_ProtectMbufTo() (plaintext buffer kept as a template),
+ * r_gooseMessage_ProtectMbufFanout() (one buffer per group), r_gooseMessage_ValidateMbuf() and
+ * r_gooseMessage_UnprotectMbuf().
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * r_goose_mbuf_pool* pool = r_goose_mbuf_pool_new(1024, R_GOOSE_MBUF_HEADROOM, 1600);
+ *
+ * r_goose_mbuf* m = r_goose_mbuf_alloc(pool);
+ * uint8_t* message = r_goose_mbuf_append(m, message_size);
+ * build_message(message);											// pseudo-function that writes an R-GOOSE message without MAC Tag
+ *
+ * if(r_gooseMessage_ProtectMbuf(m, ring, reader, key_id, NULL, 0) > 0){
+ * 	uint8_t* udp = r_goose_mbuf_prepend(m, 8);
+ * 	write_udp_header(udp, r_goose_mbuf_len(m));						// pseudo-function that writes the UDP header
+ * 	r_goose_mbuf_ref(m);
+ * 	enqueue(link_a, m);												// pseudo-functions, each sender releases the buffer
+ * 	enqueue(link_b, m);
+ * }
+ * r_goose_mbuf_release(m);
+ *
+ * @endcode
+ * @warning A buffer shared by more than one reference must not be changed: the functions that write to a buffer
+ * return an error when its reference count is above 1.
+ */
+
+#ifndef R_GOOSE_MBUF_H
+#define R_GOOSE_MBUF_H
+
+#include <stdatomic.h>
+
+#include "r_goose_security.h"
+#include "r_goose_keyring.h"
+
+// Suggested headroom: Ethernet (14) + VLAN (4) + IPv6 (40) + UDP (8) headers, rounded up to a cache line multiple
+#define R_GOOSE_MBUF_HEADROOM		128
+
+// Buffer sizes are rounded up to a multiple of the cache line
+#define R_GOOSE_MBUF_ALIGN			64
+
+
+struct r_goose_mbuf_pool;
+
+/**
+ * @brief Packet buffer. The data (from r_goose_mbuf_data(), r_goose_mbuf_len() bytes) lies between the headroom and
+ * the tailroom of the buffer.
+ */
+typedef struct r_goose_mbuf {
+	struct r_goose_mbuf_pool* pool;
+	uint8_t* buf;
+	uint32_t buf_size;
+	uint32_t data_off;
+	uint32_t data_len;
+
+	_Atomic uint32_t refcnt;
+	_Atomic uint32_t next;				// free list: index + 1 of the next free buffer (0: none)
+} r_goose_mbuf;
+
+/**
+ * @brief Pool of packet buffers of the same size, preallocated in one block.
+ */
+typedef struct r_goose_mbuf_pool {
+	r_goose_mbuf* mbufs;
+	uint8_t* memory;
+	uint32_t count;
+	uint32_t buf_size;
+	uint32_t headroom;
+
+	// Free list head: version << 32 | (index + 1), the version avoids the ABA problem of the lock-free stack
+	_Atomic uint64_t free_head;
+	_Atomic uint32_t available;
+} r_goose_mbuf_pool;
+
+/**
+ * @brief Static storage (no heap build) of a pool of @p count buffers (see r_goose_mbuf_pool_new()).
+ */
+#define R_GOOSE_MBUF_POOL_STORAGE(count, headroom, data_room)	(R_GOOSE_STATIC_BLOCK(sizeof(r_goose_mbuf_pool)) + \
+		R_GOOSE_STATIC_BLOCK((size_t)(count) * sizeof(r_goose_mbuf)) + \
+		R_GOOSE_STATIC_ALIGNED_BLOCK((size_t)(count) * (((size_t)(headroom) + (data_room) + R_GOOSE_MBUF_ALIGN - 1) / \
+		R_GOOSE_MBUF_ALIGN * R_GOOSE_MBUF_ALIGN), R_GOOSE_MBUF_ALIGN))
+
+
+/**
+ * @brief Function that creates a pool of @p count buffers, with @p headroom bytes in front of the data and
+ * @p data_room bytes for the data and the tailroom.
+ *
+ * @param count Variable (<tt>uint32_t</tt>) with the number of buffers
+ * @param headroom Variable (<tt>uint32_t</tt>) with the headroom of a new buffer (e.g. R_GOOSE_MBUF_HEADROOM)
+ * @param data_room Variable (<tt>uint32_t</tt>) with the bytes after the headroom (largest message + MAX_MAC_SIZE)
+ * @return The function returns the pool, or NULL if it couldn't be allocated.
+ * @note All the memory of the pool is allocated and written here, by the calling thread (see the NUMA note above).
+ */
+r_goose_mbuf_pool* r_goose_mbuf_pool_new(uint32_t count, uint32_t headroom, uint32_t data_room);
+
+/**
+ * @brief Function that releases a pool and all its buffers.
+ *
+ * @param pool Pointer (<tt>r_goose_mbuf_pool*</tt>) to the pool
+ * @return The function doesn't return any value
+ * @warning No buffer of the pool may be used after this call.
+ */
+void r_goose_mbuf_pool_free(r_goose_mbuf_pool* pool);
+
+/**
+ * @brief Function that returns the number of free buffers of a pool.
+ *
+ * @param pool Pointer (<tt>r_goose_mbuf_pool*</tt>) to the pool
+ * @return The function returns the number of free buffers.
+ */
+uint32_t r_goose_mbuf_available(r_goose_mbuf_pool* pool);
+
+/**
+ * @brief Function that takes a buffer from a pool (thread safe, lock-free). The buffer has a reference count of 1,
+ * no data and the headroom of the pool.
+ *
+ * @param pool Pointer (<tt>r_goose_mbuf_pool*</tt>) to the pool
+ * @return The function returns the buffer, or NULL if the pool is empty.
+ */
+r_goose_mbuf* r_goose_mbuf_alloc(r_goose_mbuf_pool* pool);
+
+/**
+ * @brief Function that adds a reference to a buffer, to share it without copying it.
+ *
+ * @param m Pointer (<tt>r_goose_mbuf*</tt>) to the buffer
+ * @return The function doesn't return any value
+ */
+void r_goose_mbuf_ref(r_goose_mbuf* m);
+
+/**
+ * @brief Function that drops a reference to a buffer. The buffer goes back to its pool with the last reference.
+ *
+ * @param m Pointer (<tt>r_goose_mbuf*</tt>) to the buffer
+ * @return The function doesn't return any value
+ */
+void r_goose_mbuf_release(r_goose_mbuf* m);
+
+/**
+ * @brief Function that returns the reference count of a buffer.
+ *
+ * @param m Pointer (<tt>r_goose_mbuf*</tt>) to the buffer
+ * @return The function returns the reference count.
+ */
+uint32_t r_goose_mbuf_refcnt(r_goose_mbuf* m);
+
+/**
+ * @brief Function that returns the first byte of the data of a buffer.
+ *
+ * @param m Pointer (<tt>r_goose_mbuf*</tt>) to the buffer
+ * @return The function returns a pointer to the data.
+ */
+uint8_t* r_goose_mbuf_data(r_goose_mbuf* m);
+
+/**
+ * @brief Function that returns the size of the data of a buffer.
+ *
+ * @param m Pointer (<tt>r_goose_mbuf*</tt>) to the buffer
+ * @return The function returns the size of the data in bytes.
+ */
+uint32_t r_goose_mbuf_len(r_goose_mbuf* m);
+
+/**
+ * @brief Function that returns the free bytes in front of the data of a buffer.
+ *
+ * @param m Pointer (<tt>r_goose_mbuf*</tt>) to the buffer
+ * @return The function returns the size of the headroom in bytes.
+ */
+uint32_t r_goose_mbuf_headroom(r_goose_mbuf* m);
+
+/**
+ * @brief Function that returns the free bytes after the data of a buffer.
+ *
+ * @param m Pointer (<tt>r_goose_mbuf*</tt>) to the buffer
+ * @return The function returns the size of the tailroom in bytes.
+ */
+uint32_t r_goose_mbuf_tailroom(r_goose_mbuf* m);
+
+/**
+ * @brief Function that extends the data of a buffer by @p len bytes in front (taken from the headroom), e.g. to write
+ * a header.
+ *
+ * @param m Pointer (<tt>r_goose_mbuf*</tt>) to the buffer
+ * @param len Variable (<tt>uint32_t</tt>) with the number of bytes
+ * @return The function returns a pointer to the new first byte of the data, or NULL if the headroom is too small or
+ * the buffer is shared.
+ */
+uint8_t* r_goose_mbuf_prepend(r_goose_mbuf* m, uint32_t len);
+
+/**
+ * @brief Function that extends the data of a buffer by @p len bytes at the end (taken from the tailroom).
+ *
+ * @param m Pointer (<tt>r_goose_mbuf*</tt>) to the buffer
+ * @param len Variable (<tt>uint32_t</tt>) with the number of bytes
+ * @return The function returns a pointer to the first added byte, or NULL if the tailroom is too small or the buffer
+ * is shared.
+ */
+uint8_t* r_goose_mbuf_append(r_goose_mbuf* m, uint32_t len);
+
+/**
+ * @brief Function that removes @p len bytes from the front of the data of a buffer (given back to the headroom), e.g.
+ * to strip a received header.
+ *
+ * @param m Pointer (<tt>r_goose_mbuf*</tt>) to the buffer
+ * @param len Variable (<tt>uint32_t</tt>) with the number of bytes
+ * @return The function returns a pointer to the new first byte of the data, or NULL if the data is shorter than
+ * @p len.
+ */
+uint8_t* r_goose_mbuf_adj(r_goose_mbuf* m, uint32_t len);
+
+/**
+ * @brief Function that removes @p len bytes from the end of the data of a buffer (given back to the tailroom).
+ *
+ * @param m Pointer (<tt>r_goose_mbuf*</tt>) to the buffer
+ * @param len Variable (<tt>uint32_t</tt>) with the number of bytes
+ * @return The function returns 0, or -1 if the data is shorter than @p len.
+ */
+int r_goose_mbuf_trim(r_goose_mbuf* m, uint32_t len);
+
+/**
+ * @brief Function that encrypts the R-GOOSE message of a buffer and appends its MAC Tag in the tailroom
+ * (r_gooseMessage_ProtectKeyring() on the buffer).
+ *
+ * @param m Pointer (<tt>r_goose_mbuf*</tt>) to the buffer; its data must be the R-GOOSE message without MAC Tag
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the reader identifier
+ * @param key_id Variable (<tt>uint32_t</tt>) with the Key ID (the APPID is read from the message)
+ * @param iv Pointer (<tt>uint8_t*</tt>) containg the Initialization Vector, or NULL to use r_goose_key_iv() with the
+ * SPDU Number of the message
+ * @param iv_size Variable (<tt>int</tt>) that hold the size in bytes of IV (ignored if @p iv is NULL)
+ * @return The function returns the size of the protected message (the new data size), or -1 if an error occurred
+ * (the errors of r_gooseMessage_ProtectKeyring(), a data size that is not the SPDU Length + 10, a tailroom smaller
+ * than the MAC Tag, a shared buffer).
+ */
+int r_gooseMessage_ProtectMbuf(r_goose_mbuf* m, r_goose_keyring* ring, int reader, uint32_t key_id, uint8_t* iv, int iv_size);
+
+/**
+ * @brief Function that protects the R-GOOSE message of a buffer into another buffer, leaving the source unchanged
+ * (r_gooseMessage_ProtectKeyringTo() between the buffers). The data of @p dest is replaced by the protected message,
+ * after its headroom.
+ *
+ * @param src Pointer (<tt>r_goose_mbuf*</tt>) to the buffer with the R-GOOSE message without MAC Tag (may be shared)
+ * @param dest Pointer (<tt>r_goose_mbuf*</tt>) to the buffer that receives the protected message
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the reader identifier
+ * @param key_id Variable (<tt>uint32_t</tt>) with the Key ID (the APPID is read from the message)
+ * @param iv Pointer (<tt>uint8_t*</tt>) containg the Initialization Vector, or NULL to use r_goose_key_iv()
+ * @param iv_size Variable (<tt>int</tt>) that hold the size in bytes of IV (ignored if @p iv is NULL)
+ * @return The function returns the size of the protected message, or -1 if an error occurred (as
+ * r_gooseMessage_ProtectMbuf(), @p dest shared or too small).
+ */
+int r_gooseMessage_ProtectMbufTo(r_goose_mbuf* src, r_goose_mbuf* dest, r_goose_keyring* ring, int reader, uint32_t key_id, uint8_t* iv, int iv_size);
+
+/**
+ * @brief Function that protects the R-GOOSE message of a buffer for several groups, one destination buffer per
+ * group (r_gooseMessage_ProtectKeyringFanout() into the buffers). The @c dest and @c dest_size of the targets are set
+ * from @p dests, and the data of each destination is replaced by its protected message.
+ *
+ * @param src Pointer (<tt>r_goose_mbuf*</tt>) to the buffer with the R-GOOSE message without MAC Tag (may be shared)
+ * @param dests Pointer (<tt>r_goose_mbuf**</tt>) to the destination buffers, one per target
+ * @param targets Pointer (<tt>r_goose_fanout_target*</tt>) to the key and header fields of each group
+ * @param count Variable (<tt>int</tt>) with the number of destinations (1 to R_GOOSE_FANOUT_MAX)
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the reader identifier
+ * @return The function returns the number of destinations protected, or -1 if @p src, @p count or a destination
+ * buffer (shared) is invalid. Destinations that failed get @c size -1 and keep no data.
+ */
+int r_gooseMessage_ProtectMbufFanout(r_goose_mbuf* src, r_goose_mbuf** dests, r_goose_fanout_target* targets, int count, r_goose_keyring* ring, int reader);
+
+/**
+ * @brief Function that validates the R-GOOSE message of a buffer (r_gooseMessage_ValidateKeyring() on the buffer).
+ *
+ * @param m Pointer (<tt>r_goose_mbuf*</tt>) to the buffer; its data must be the R-GOOSE message (may be shared)
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the reader identifier
+ * @return The function returns the result of r_gooseMessage_ValidateKeyring(), or -1 if the data size is not the
+ * SPDU Length + 10.
+ */
+int r_gooseMessage_ValidateMbuf(r_goose_mbuf* m, r_goose_keyring* ring, int reader);
+
+/**
+ * @brief Function that validates the R-GOOSE message of a buffer and decrypts it in place
+ * (r_gooseMessage_UnprotectKeyring() on the buffer).
+ *
+ * @param m Pointer (<tt>r_goose_mbuf*</tt>) to the buffer; its data must be the R-GOOSE message
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the reader identifier
+ * @param iv Pointer (<tt>uint8_t*</tt>) containg the Initialization Vector, or NULL to use r_goose_key_iv()
+ * @param iv_size Variable (<tt>int</tt>) that hold the size in bytes of IV (ignored if @p iv is NULL)
+ * @return The function returns the result of r_gooseMessage_UnprotectKeyring(), or -1 if the data size is not the
+ * SPDU Length + 10 or the buffer is shared.
+ */
+int r_gooseMessage_UnprotectMbuf(r_goose_mbuf* m, r_goose_keyring* ring, int reader, uint8_t* iv, int iv_size);
+
+#endif
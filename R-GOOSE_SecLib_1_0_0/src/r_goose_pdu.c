@@ -0,0 +1,343 @@
+/*
+	File defining the pre-encoded GOOSE PDU template (Custom/Off-Standard)
+
+	GOOSE PDU (IEC 61850-8-1), in order:
+		61 L								goosePdu
+			80 L gocbRef					VisibleString
+			81 L timeAllowedToLive			INTEGER (minimal)
+			82 L datSet						VisibleString
+			83 L goID						VisibleString (only if set)
+			84 08 t							UtcTime
+			85 05 stNum						INTEGER (fixed width)
+			86 05 sqNum						INTEGER (fixed width)
+			87 01 simulation				BOOLEAN
+			88 L confRev					INTEGER (minimal)
+			89 01 ndsCom					BOOLEAN
+			8a L numDatSetEntries			INTEGER (minimal)
+			ab L allData					Data values (fixed width, see r_goose_pdu.h)
+
+	The same writer computes the layout (no buffer, r_goose_pdu_template_new()) and encodes
+	the PDU (r_goose_pdu_encode()), so the offsets always match the bytes written.
+
+	Quality:
+		the 13 bits of the quality bit-string are given in the low bits of a uint16_t, bit 0 of
+		the bit-string (validity, MSB) being bit 12. They are stored left aligned in the 2
+		content bytes after the unused bits count (3).
+*/
+
+#include "r_goose_pdu.h"
+
+// Constructed tags of goosePdu and allData
+#define GOOSE_PDU_TAG		0x61
+#define ALL_DATA_TAG		0xAB
+
+
+typedef struct pdu_writer {
+	uint8_t* buf;
+	size_t pos;
+} pdu_writer;
+
+static inline void put(pdu_writer* w, uint8_t b){
+	if(w->buf != NULL){
+		w->buf[w->pos] = b;
+	}
+	w->pos++;
+}
+
+static inline void store_be32(uint8_t* p, uint32_t v){
+	p[0] = (uint8_t)(v >> 24);
+	p[1] = (uint8_t)(v >> 16);
+	p[2] = (uint8_t)(v >> 8);
+	p[3] = (uint8_t)v;
+}
+
+static size_t length_size(size_t len){
+	return len < 128 ? 1 : (len < 256 ? 2 : 3);
+}
+
+static size_t tlv_size(size_t len){
+	return 1 + length_size(len) + len;
+}
+
+static void put_length(pdu_writer* w, size_t len){
+	if(len >= 256){
+		put(w, 0x82);
+		put(w, (uint8_t)(len >> 8));
+	}else if(len >= 128){
+		put(w, 0x81);
+	}
+	put(w, (uint8_t)len);
+}
+
+// Content bytes of the minimal INTEGER encoding of an unsigned value
+static size_t uint_size(uint32_t v){
+	size_t n = 1;
+	while(n < 5 && (n == 4 ? v >= 0x80000000U : v >= (1U << (8 * n - 1)))){
+		n++;
+	}
+	return n;
+}
+
+static void put_uint(pdu_writer* w, uint8_t tag, uint32_t v){
+	size_t n = uint_size(v);
+
+	put(w, tag);
+	put(w, (uint8_t)n);
+	for(size_t i = n; i > 0; i--){
+		put(w, i > 4 ? 0 : (uint8_t)(v >> (8 * (i - 1))));
+	}
+}
+
+static void put_string(pdu_writer* w, uint8_t tag, const char* s){
+	size_t len = s == NULL ? 0 : strlen(s);
+
+	put(w, tag);
+	put_length(w, len);
+	for(size_t i = 0; i < len; i++){
+		put(w, (uint8_t)s[i]);
+	}
+}
+
+// Fixed width field: tag, length, prefix bytes, then width zero bytes. Returns the offset of the first zero byte.
+static size_t put_fixed(pdu_writer* w, uint8_t tag, const uint8_t* prefix, size_t prefix_size, size_t width){
+	put(w, tag);
+	put(w, (uint8_t)(prefix_size + width));
+	for(size_t i = 0; i < prefix_size; i++){
+		put(w, prefix[i]);
+	}
+	size_t offset = w->pos;
+	for(size_t i = 0; i < width; i++){
+		put(w, 0);
+	}
+	return offset;
+}
+
+static size_t value_size(int type){
+	switch(type){
+		case R_GOOSE_DATA_BOOLEAN:	return 3;
+		case R_GOOSE_DATA_INT32:	return 6;
+		case R_GOOSE_DATA_UINT32:	return 7;
+		case R_GOOSE_DATA_FLOAT32:	return 7;
+		case R_GOOSE_DATA_QUALITY:	return 5;
+		case R_GOOSE_DATA_UTCTIME:	return 10;
+		default:					return 0;
+	}
+}
+
+static size_t put_value(pdu_writer* w, int type){
+	static const uint8_t zero[1] = {0x00};
+	static const uint8_t float32[1] = {0x08};
+	static const uint8_t quality[1] = {0x03};
+
+	switch(type){
+		case R_GOOSE_DATA_BOOLEAN:	return put_fixed(w, 0x83, NULL, 0, 1);
+		case R_GOOSE_DATA_INT32:	return put_fixed(w, 0x85, NULL, 0, 4);
+		case R_GOOSE_DATA_UINT32:	return put_fixed(w, 0x86, zero, 1, 4);
+		case R_GOOSE_DATA_FLOAT32:	return put_fixed(w, 0x87, float32, 1, 4);
+		case R_GOOSE_DATA_QUALITY:	return put_fixed(w, 0x84, quality, 1, 2);
+		default:					return put_fixed(w, 0x91, NULL, 0, 8);
+	}
+}
+
+static size_t strlen_null(const char* s){
+	return s == NULL ? 0 : strlen(s);
+}
+
+// Writes the whole GOOSE PDU (or only records the offsets if w->buf is NULL)
+static void pdu_write(r_goose_pdu_template* pdu, pdu_writer* w){
+	static const uint8_t zero[1] = {0x00};
+	const r_goose_pdu_config* c = &pdu->config;
+	size_t all_data = 0;
+
+	for(int i = 0; i < pdu->count; i++){
+		all_data += value_size(pdu->types[i]);
+	}
+
+	size_t content = tlv_size(strlen_null(c->gocbRef)) + tlv_size(uint_size(c->timeAllowedToLive)) +
+					 tlv_size(strlen_null(c->datSet)) + (c->goID != NULL ? tlv_size(strlen(c->goID)) : 0) +
+					 10 + 7 + 7 + 3 + tlv_size(uint_size(c->confRev)) + 3 + tlv_size(uint_size((uint32_t)pdu->count)) +
+					 tlv_size(all_data);
+
+	put(w, GOOSE_PDU_TAG);
+	put_length(w, content);
+
+	put_string(w, 0x80, c->gocbRef);
+	put_uint(w, 0x81, c->timeAllowedToLive);
+	put_string(w, 0x82, c->datSet);
+	if(c->goID != NULL){
+		put_string(w, 0x83, c->goID);
+	}
+
+	pdu->t = put_fixed(w, 0x84, NULL, 0, 8);
+	if(w->buf != NULL){
+		w->buf[pdu->t + 7] = c->time_quality;
+	}
+	pdu->stnum = put_fixed(w, 0x85, zero, 1, 4);
+	pdu->sqnum = put_fixed(w, 0x86, zero, 1, 4);
+
+	put(w, 0x87); put(w, 0x01); put(w, c->simulation ? 0xFF : 0x00);
+	put_uint(w, 0x88, c->confRev);
+	put(w, 0x89); put(w, 0x01); put(w, c->ndsCom ? 0xFF : 0x00);
+	put_uint(w, 0x8A, (uint32_t)pdu->count);
+
+	put(w, ALL_DATA_TAG);
+	put_length(w, all_data);
+	for(int i = 0; i < pdu->count; i++){
+		pdu->values[i] = put_value(w, pdu->types[i]);
+	}
+
+	pdu->size = w->pos;
+}
+
+
+r_goose_pdu_template* r_goose_pdu_template_new(const r_goose_pdu_config* config){
+
+	if(config->count < 0 || config->count > R_GOOSE_PDU_MAX_VALUES || (config->count > 0 && config->types == NULL)){
+		return NULL;
+	}
+	for(int i = 0; i < config->count; i++){
+		if(value_size(config->types[i]) == 0){
+			return NULL;
+		}
+	}
+
+	r_goose_pdu_template* pdu = (r_goose_pdu_template*)r_goose_calloc(1, sizeof(r_goose_pdu_template));
+	if(pdu == NULL){
+		return NULL;
+	}
+
+	pdu->config = *config;
+	pdu->count = config->count;
+	pdu->types = (uint8_t*)r_goose_malloc(config->count + 1);
+	pdu->values = (size_t*)r_goose_malloc((config->count + 1) * sizeof(size_t));
+	if(pdu->types == NULL || pdu->values == NULL){
+		r_goose_pdu_template_free(pdu);
+		return NULL;
+	}
+	for(int i = 0; i < config->count; i++){
+		pdu->types[i] = (uint8_t)config->types[i];
+	}
+	pdu->config.types = NULL;
+
+	pdu_writer w = {NULL, 0};
+	pdu_write(pdu, &w);
+
+	// Any field above 64 KB makes the whole PDU larger (lengths are encoded in at most 2 bytes)
+	if(pdu->size > 65535){
+		r_goose_pdu_template_free(pdu);
+		return NULL;
+	}
+
+	return pdu;
+}
+
+void r_goose_pdu_template_free(r_goose_pdu_template* pdu){
+	if(pdu == NULL){
+		return;
+	}
+	r_goose_free(pdu->types);
+	r_goose_free(pdu->values);
+	r_goose_free(pdu);
+}
+
+int r_goose_pdu_encode(r_goose_pdu_template* pdu, uint8_t* dest, size_t dest_size){
+	if(dest_size < pdu->size){
+		return -1;
+	}
+
+	pdu_writer w = {dest, 0};
+	pdu_write(pdu, &w);
+
+	pdu->pdu = dest;
+	r_goose_pdu_set_stnum(pdu, 1);
+
+	return (int)pdu->size;
+}
+
+
+void r_goose_pdu_set_stnum(r_goose_pdu_template* pdu, uint32_t stnum){
+	store_be32(&pdu->pdu[pdu->stnum], stnum);
+}
+
+void r_goose_pdu_set_sqnum(r_goose_pdu_template* pdu, uint32_t sqnum){
+	store_be32(&pdu->pdu[pdu->sqnum], sqnum);
+}
+
+void r_goose_pdu_set_timestamp(r_goose_pdu_template* pdu, uint32_t seconds, uint32_t fraction){
+	uint8_t* p = &pdu->pdu[pdu->t];
+
+	store_be32(p, seconds);
+	p[4] = (uint8_t)(fraction >> 16);
+	p[5] = (uint8_t)(fraction >> 8);
+	p[6] = (uint8_t)fraction;
+}
+
+static inline uint8_t* value_at(r_goose_pdu_template* pdu, int index, int type){
+	if(index < 0 || index >= pdu->count || pdu->types[index] != type){
+		return NULL;
+	}
+	return &pdu->pdu[pdu->values[index]];
+}
+
+int r_goose_pdu_set_boolean(r_goose_pdu_template* pdu, int index, int value){
+	uint8_t* p = value_at(pdu, index, R_GOOSE_DATA_BOOLEAN);
+	if(p == NULL){
+		return -1;
+	}
+	p[0] = value ? 0xFF : 0x00;
+	return 1;
+}
+
+int r_goose_pdu_set_int32(r_goose_pdu_template* pdu, int index, int32_t value){
+	uint8_t* p = value_at(pdu, index, R_GOOSE_DATA_INT32);
+	if(p == NULL){
+		return -1;
+	}
+	store_be32(p, (uint32_t)value);
+	return 1;
+}
+
+int r_goose_pdu_set_uint32(r_goose_pdu_template* pdu, int index, uint32_t value){
+	uint8_t* p = value_at(pdu, index, R_GOOSE_DATA_UINT32);
+	if(p == NULL){
+		return -1;
+	}
+	store_be32(p, value);
+	return 1;
+}
+
+int r_goose_pdu_set_float32(r_goose_pdu_template* pdu, int index, float value){
+	uint8_t* p = value_at(pdu, index, R_GOOSE_DATA_FLOAT32);
+	uint32_t bits;
+
+	if(p == NULL){
+		return -1;
+	}
+	memcpy(&bits, &value, sizeof(bits));
+	store_be32(p, bits);
+	return 1;
+}
+
+int r_goose_pdu_set_quality(r_goose_pdu_template* pdu, int index, uint16_t quality){
+	uint8_t* p = value_at(pdu, index, R_GOOSE_DATA_QUALITY);
+	if(p == NULL){
+		return -1;
+	}
+	uint16_t bits = (uint16_t)((quality & 0x1FFF) << 3);
+	p[0] = (uint8_t)(bits >> 8);
+	p[1] = (uint8_t)bits;
+	return 1;
+}
+
+int r_goose_pdu_set_utctime(r_goose_pdu_template* pdu, int index, uint32_t seconds, uint32_t fraction, uint8_t time_quality){
+	uint8_t* p = value_at(pdu, index, R_GOOSE_DATA_UTCTIME);
+	if(p == NULL){
+		return -1;
+	}
+	store_be32(p, seconds);
+	p[4] = (uint8_t)(fraction >> 16);
+	p[5] = (uint8_t)(fraction >> 8);
+	p[6] = (uint8_t)fraction;
+	p[7] = time_quality;
+	return 1;
+}
@@ -0,0 +1,159 @@
+/**
+ * @file r_goose_pdu.h
+ * @author Eduardo Andrade
+ * @date Mar 2020
+ * @brief File containing the declarations of the pre-encoded GOOSE PDU template, which BER-encodes the fixed part of
+ * a GOOSE PDU once and patches the changing values in place.
+ *
+ * Between two messages of a GOOSE control block only stNum, sqNum, the timestamp (t) and the values of allData
+ * change. The template encodes the whole GOOSE PDU (IEC 61850-8-1) once, with every changing field encoded with a
+ * fixed width, and records the offset of each one:
+ *
+ *				- t:			84 08 + UtcTime (4 bytes seconds, 3 bytes fraction, 1 byte time quality)
+ *				- stNum, sqNum:	85 05 / 86 05 + 0x00 + 4 bytes (the whole INT32U range, always positive)
+ *				- allData:		R_GOOSE_DATA_BOOLEAN		83 01 + 1 byte
+ *								R_GOOSE_DATA_INT32			85 04 + 4 bytes
+ *								R_GOOSE_DATA_UINT32			86 05 + 0x00 + 4 bytes
+ *								R_GOOSE_DATA_FLOAT32		87 05 08 + 4 bytes (IEEE 754 single)
+ *								R_GOOSE_DATA_QUALITY		84 03 03 + 2 bytes (13 bit bit-string)
+ *								R_GOOSE_DATA_UTCTIME		91 08 + 8 bytes
+ *
+ * Lengths never change, so a new message is a few fixed-width stores followed by the MAC Tag generation, without
+ * re-encoding or allocation. The PDU is encoded directly where it is sent from, e.g. the payload of a publisher
+ * (r_goose_publisher_payload()).
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * int types[] = {R_GOOSE_DATA_FLOAT32, R_GOOSE_DATA_QUALITY};
+ * r_goose_pdu_config cfg = {"IED1LD0/LLN0$GO$gcb1", "IED1LD0/LLN0$DataSet1", "IED1", 2000, 1, 0, 0, 0x0A, types, 2};
+ *
+ * r_goose_pdu_template* pdu = r_goose_pdu_template_new(&cfg);
+ * r_goose_pdu_encode(pdu, r_goose_publisher_payload(pub), pub->max_payload);
+ *
+ * while(1){
+ * 	r_goose_pdu_set_float32(pdu, 0, read_measurement());			// pseudo-function that reads a value
+ * 	r_goose_pdu_set_stnum(pdu, stnum);
+ * 	r_goose_pdu_set_sqnum(pdu, sqnum);
+ * 	r_goose_pdu_set_timestamp(pdu, seconds, fraction);
+ *
+ * 	int len = r_goose_publisher_sign(pub, pdu->size, &message);
+ * 	send_packet(message, len);									// pseudo-function that sends a packet
+ * }
+ *
+ * @endcode
+ * @note stNum, sqNum, INT32 and INT32U values use a fixed number of content bytes, which is valid BER but not the
+ * minimal encoding (DER). Receivers decode them as any other INTEGER.
+ */
+
+#ifndef R_GOOSE_PDU_H
+#define R_GOOSE_PDU_H
+
+#include "r_goose_security.h"
+
+// allData value types
+#define R_GOOSE_DATA_BOOLEAN		1
+#define R_GOOSE_DATA_INT32			2
+#define R_GOOSE_DATA_UINT32			3
+#define R_GOOSE_DATA_FLOAT32		4
+#define R_GOOSE_DATA_QUALITY		5
+#define R_GOOSE_DATA_UTCTIME		6
+
+// Largest number of allData values
+#define R_GOOSE_PDU_MAX_VALUES		1024
+
+
+/**
+ * @brief Fixed part of a GOOSE PDU. @p datSet and @p goID may be NULL (goID is then not encoded).
+ */
+typedef struct r_goose_pdu_config {
+	const char* gocbRef;
+	const char* datSet;
+	const char* goID;
+	uint32_t timeAllowedToLive;
+	uint32_t confRev;
+	int simulation;
+	int ndsCom;
+	uint8_t time_quality;
+
+	const int* types;
+	int count;
+} r_goose_pdu_config;
+
+
+/**
+ * @brief GOOSE PDU template: encoded size, offsets of the changing fields (content bytes) and the buffer it is encoded in.
+ */
+typedef struct r_goose_pdu_template {
+	uint8_t* pdu;
+	size_t size;
+
+	r_goose_pdu_config config;
+
+	size_t t;
+	size_t stnum;
+	size_t sqnum;
+
+	int count;
+	uint8_t* types;
+	size_t* values;
+} r_goose_pdu_template;
+
+/**
+ * @brief Static storage (no heap build) of a PDU template of @p count values.
+ */
+#define R_GOOSE_PDU_TEMPLATE_STORAGE(count)	(R_GOOSE_STATIC_BLOCK(sizeof(r_goose_pdu_template)) + \
+		R_GOOSE_STATIC_BLOCK((size_t)(count) + 1) + R_GOOSE_STATIC_BLOCK(((size_t)(count) + 1) * sizeof(size_t)))
+
+
+/**
+ * @brief Function that computes the layout of a GOOSE PDU (size and offsets). Nothing is encoded yet.
+ *
+ * @param config Pointer (<tt>r_goose_pdu_config*</tt>) to the fixed part of the GOOSE PDU (the strings must stay valid until r_goose_pdu_encode())
+ * @return A pointer to the new template, or NULL if an error occurred (unknown type, too many values or PDU above 64 KB).
+ * @warning The template must be released with r_goose_pdu_template_free().
+ */
+r_goose_pdu_template* r_goose_pdu_template_new(const r_goose_pdu_config* config);
+
+/**
+ * @brief Function that releases a GOOSE PDU template (not the buffer it is encoded in).
+ *
+ * @param pdu Pointer (<tt>r_goose_pdu_template*</tt>) to the template
+ */
+void r_goose_pdu_template_free(r_goose_pdu_template* pdu);
+
+/**
+ * @brief Function that encodes the GOOSE PDU in @p dest, with stNum 1, sqNum 0, t 0 and every value 0/FALSE, and binds
+ * the template to @p dest (the set functions write there).
+ *
+ * @param pdu Pointer (<tt>r_goose_pdu_template*</tt>) to the template
+ * @param dest Pointer (<tt>uint8_t*</tt>) to the buffer where the GOOSE PDU is encoded
+ * @param dest_size Variable (<tt>size_t</tt>) with the size of @p dest
+ * @return The function returns the size of the GOOSE PDU, or -1 if @p dest is too small.
+ */
+int r_goose_pdu_encode(r_goose_pdu_template* pdu, uint8_t* dest, size_t dest_size);
+
+/**
+ * @brief Functions that patch stNum, sqNum and t (seconds since epoch, 24 bit binary fraction of second).
+ *
+ * @param pdu Pointer (<tt>r_goose_pdu_template*</tt>) to the template, already encoded
+ */
+void r_goose_pdu_set_stnum(r_goose_pdu_template* pdu, uint32_t stnum);
+void r_goose_pdu_set_sqnum(r_goose_pdu_template* pdu, uint32_t sqnum);
+void r_goose_pdu_set_timestamp(r_goose_pdu_template* pdu, uint32_t seconds, uint32_t fraction);
+
+/**
+ * @brief Functions that patch the value @p index of allData.
+ *
+ * @param pdu Pointer (<tt>r_goose_pdu_template*</tt>) to the template, already encoded
+ * @param index Variable (<tt>int</tt>) with the position of the value in allData
+ * @return The functions return -1 if @p index is out of range or the value has another type, and 1 otherwise.
+ */
+int r_goose_pdu_set_boolean(r_goose_pdu_template* pdu, int index, int value);
+int r_goose_pdu_set_int32(r_goose_pdu_template* pdu, int index, int32_t value);
+int r_goose_pdu_set_uint32(r_goose_pdu_template* pdu, int index, uint32_t value);
+int r_goose_pdu_set_float32(r_goose_pdu_template* pdu, int index, float value);
+int r_goose_pdu_set_quality(r_goose_pdu_template* pdu, int index, uint16_t quality);
+int r_goose_pdu_set_utctime(r_goose_pdu_template* pdu, int index, uint32_t seconds, uint32_t fraction, uint8_t time_quality);
+
+#endif
@@ -0,0 +1,196 @@
+/*
+	File defining the R-GOOSE structural pre-filter (Custom/Off-Standard)
+
+	Scalar:
+		Every field is loaded from the fixed header positions (always inside the message once
+		the minimum size is checked), the checks are combined with bitwise operators and the
+		position of the Signature TAG is selected (cmov) between m - s - 2 and a fixed in-bounds
+		position, so there is no data dependent branch after the size check.
+
+			m = SPDU Length + 10, s = MAC_SIZES[MAC Algorithm]
+
+			m == len, m <= 65535
+			m >= R_GOOSE_MIN_MESSAGE_SIZE + s
+			buffer[m - s - 2] == 0x85, buffer[m - s - 1] == s
+			INDEX_APDU_LENGTH + APDU Length == m - s - 2
+			Length + 30 == m - s
+
+	AVX2:
+		8 messages per call. Each header word is fetched with two 64-bit index gathers (4
+		messages each) relative to the first message, so every lane of a 256-bit register
+		holds the same field of a different message. The checks are then done on the 8 lanes
+		at once with the same formulas, and the Signature TAG/Length are gathered last from
+		the selected positions. Messages shorter than the minimum size are pointed to a zero
+		header so the gathers never leave the received bytes.
+*/
+
+#include "r_goose_prefilter.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PREFILTER_X86_SIMD
+#include <immintrin.h>
+#endif
+
+_Static_assert(MAC_ALGS_COUNT <= 16, "MAC Algorithm lookup uses 16 entries");
+
+// Signature TAG
+#define SIGNATURE_TAG		0x85
+
+
+static inline uint32_t load_be32(const uint8_t* p){
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+int r_gooseMessage_Prefilter(uint8_t* buffer, size_t len){
+
+	if(len < R_GOOSE_MIN_MESSAGE_SIZE){
+		return R_GOOSE_MALFORMED_SHORT;
+	}
+
+	uint32_t spdu = load_be32(&buffer[INDEX_SPDU_LENGTH]);
+	uint32_t alg = buffer[INDEX_MAC_ALG];
+	uint32_t enc = buffer[INDEX_ENCRYPTION_ALG];
+	uint32_t apdu = ((uint32_t)buffer[INDEX_APDU_LENGTH] << 8) | buffer[INDEX_APDU_LENGTH + 1];
+	uint32_t length = load_be32(&buffer[INDEX_LENGTH]);
+
+	uint32_t m = spdu + 10;
+	int alg_ok = alg < MAC_ALGS_COUNT;
+	uint32_t s = MAC_SIZES[alg_ok ? alg : MAC_NONE];
+
+	int len_ok = (spdu <= R_GOOSE_MAX_MESSAGE_SIZE - 10) & (m == len);
+	int room = m >= R_GOOSE_MIN_MESSAGE_SIZE + s;
+	int structured = len_ok & alg_ok & room;
+
+	// Signature TAG position, or a fixed in-bounds position when the lengths can't be trusted
+	uint32_t t = structured ? m - s - 2 : INDEX_PAYLOAD;
+
+	int sig_ok = (buffer[t] == SIGNATURE_TAG) & (buffer[t + 1] == s);
+	int lengths_ok = (apdu + INDEX_APDU_LENGTH == m - s - 2) & (length + 30 == m - s);
+
+	return (R_GOOSE_MALFORMED_LI_TI * ((buffer[0] != 0x01) | (buffer[1] != 0x40))) |
+		   (R_GOOSE_MALFORMED_SPDU_LENGTH * !len_ok) |
+		   (R_GOOSE_MALFORMED_ALG * (!alg_ok | (enc > CHACHA20_POLY1305))) |
+		   (R_GOOSE_MALFORMED_SIGNATURE * (len_ok & alg_ok & !(room & sig_ok))) |
+		   (R_GOOSE_MALFORMED_APDU_LENGTH * (structured & !lengths_ok));
+}
+
+
+#ifdef PREFILTER_X86_SIMD
+
+// Zero header used in place of messages shorter than R_GOOSE_MIN_MESSAGE_SIZE
+static const uint8_t short_header[64] = {0};
+
+#define GATHER32(lo, hi, offset)																	\
+	_mm256_set_m128i(_mm256_i64gather_epi32((const int*)base, _mm256_add_epi64(hi, _mm256_set1_epi64x(offset)), 1),	\
+					 _mm256_i64gather_epi32((const int*)base, _mm256_add_epi64(lo, _mm256_set1_epi64x(offset)), 1))
+
+#define FLAG(cond, bit)		_mm256_and_si256((cond), _mm256_set1_epi32(bit))
+
+__attribute__((target("avx2")))
+static void prefilter_avx2(uint8_t** buffers, const size_t* lens, int* results){
+	const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+										   3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	const __m256i ones = _mm256_set1_epi32(-1);
+	const __m256i byte = _mm256_set1_epi32(0xFF);
+
+	const uint8_t* base = buffers[0];
+	int64_t offsets[8];
+	uint32_t received[8];
+	int short_mask = 0;
+
+	for(int i = 0; i < 8; i++){
+		int is_short = lens[i] < R_GOOSE_MIN_MESSAGE_SIZE;
+		const uint8_t* p = is_short ? short_header : buffers[i];
+
+		offsets[i] = (intptr_t)p - (intptr_t)base;
+		received[i] = lens[i] > R_GOOSE_MAX_MESSAGE_SIZE ? UINT32_MAX : (uint32_t)lens[i];
+		short_mask |= is_short << i;
+	}
+
+	__m256i lo = _mm256_loadu_si256((const __m256i*)&offsets[0]);
+	__m256i hi = _mm256_loadu_si256((const __m256i*)&offsets[4]);
+	__m256i len = _mm256_loadu_si256((const __m256i*)received);
+
+	// Header words, one message per lane
+	__m256i w0 = GATHER32(lo, hi, 0);
+	__m256i spdu = _mm256_shuffle_epi8(GATHER32(lo, hi, INDEX_SPDU_LENGTH), bswap);
+	__m256i w20 = GATHER32(lo, hi, INDEX_TIMENEXTKEY);
+	__m256i length = _mm256_shuffle_epi8(GATHER32(lo, hi, INDEX_LENGTH), bswap);
+	__m256i apdu = _mm256_and_si256(_mm256_shuffle_epi8(GATHER32(lo, hi, INDEX_APPID), bswap), _mm256_set1_epi32(0xFFFF));
+
+	__m256i enc = _mm256_and_si256(_mm256_srli_epi32(w20, 16), byte);
+	__m256i alg = _mm256_srli_epi32(w20, 24);
+
+	// s = MAC_SIZES[alg], 0 for unknown algorithms
+	__m256i sizes_lo = _mm256_loadu_si256((const __m256i*)MAC_SIZES);
+	__m256i sizes_hi = _mm256_setr_epi32(MAC_SIZES[8], MAC_SIZES[9], MAC_SIZES[10], MAC_SIZES[11],
+										 MAC_SIZES[12], MAC_SIZES[13], MAC_SIZES[14], 0);
+	__m256i upper = _mm256_cmpeq_epi32(_mm256_and_si256(alg, _mm256_set1_epi32(8)), _mm256_set1_epi32(8));
+	__m256i alg_ok = _mm256_cmpgt_epi32(_mm256_set1_epi32(MAC_ALGS_COUNT), alg);
+	__m256i s = _mm256_and_si256(alg_ok, _mm256_blendv_epi8(_mm256_permutevar8x32_epi32(sizes_lo, alg),
+															  _mm256_permutevar8x32_epi32(sizes_hi, alg), upper));
+
+	__m256i m = _mm256_add_epi32(spdu, _mm256_set1_epi32(10));
+	__m256i spdu_lim = _mm256_set1_epi32(R_GOOSE_MAX_MESSAGE_SIZE - 10);
+	__m256i len_ok = _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_max_epu32(spdu, spdu_lim), spdu_lim),
+									  _mm256_cmpeq_epi32(m, len));
+	__m256i room = _mm256_xor_si256(_mm256_cmpgt_epi32(_mm256_add_epi32(s, _mm256_set1_epi32(R_GOOSE_MIN_MESSAGE_SIZE)), m), ones);
+	__m256i structured = _mm256_and_si256(_mm256_and_si256(len_ok, alg_ok), room);
+
+	// Signature TAG position (m - s - 2), gathered with the 2 bytes before it
+	__m256i end = _mm256_sub_epi32(m, s);
+	__m256i t = _mm256_blendv_epi8(_mm256_set1_epi32(INDEX_PAYLOAD), _mm256_sub_epi32(end, _mm256_set1_epi32(2)), structured);
+	__m256i t2 = _mm256_sub_epi32(t, _mm256_set1_epi32(2));
+	__m128i tg_lo = _mm256_i64gather_epi32((const int*)base, _mm256_add_epi64(lo, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(t2))), 1);
+	__m128i tg_hi = _mm256_i64gather_epi32((const int*)base, _mm256_add_epi64(hi, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(t2, 1))), 1);
+	__m256i trailer = _mm256_set_m128i(tg_hi, tg_lo);
+
+	__m256i sig_ok = _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_srli_epi32(trailer, 16), byte), _mm256_set1_epi32(SIGNATURE_TAG)),
+									  _mm256_cmpeq_epi32(_mm256_srli_epi32(trailer, 24), s));
+	__m256i lengths_ok = _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_add_epi32(apdu, _mm256_set1_epi32(INDEX_APDU_LENGTH)), _mm256_sub_epi32(end, _mm256_set1_epi32(2))),
+										  _mm256_cmpeq_epi32(_mm256_add_epi32(length, _mm256_set1_epi32(30)), end));
+
+	__m256i li_ti_bad = _mm256_xor_si256(_mm256_cmpeq_epi32(_mm256_and_si256(w0, _mm256_set1_epi32(0xFFFF)), _mm256_set1_epi32(0x4001)), ones);
+	__m256i alg_bad = _mm256_or_si256(_mm256_xor_si256(alg_ok, ones), _mm256_cmpgt_epi32(enc, _mm256_set1_epi32(CHACHA20_POLY1305)));
+	__m256i sig_bad = _mm256_andnot_si256(_mm256_and_si256(room, sig_ok), _mm256_and_si256(len_ok, alg_ok));
+	__m256i lengths_bad = _mm256_andnot_si256(lengths_ok, structured);
+
+	__m256i mask = _mm256_or_si256(_mm256_or_si256(FLAG(li_ti_bad, R_GOOSE_MALFORMED_LI_TI),
+												   FLAG(_mm256_xor_si256(len_ok, ones), R_GOOSE_MALFORMED_SPDU_LENGTH)),
+								   _mm256_or_si256(_mm256_or_si256(FLAG(alg_bad, R_GOOSE_MALFORMED_ALG),
+																   FLAG(sig_bad, R_GOOSE_MALFORMED_SIGNATURE)),
+												   FLAG(lengths_bad, R_GOOSE_MALFORMED_APDU_LENGTH)));
+
+	_mm256_storeu_si256((__m256i*)results, mask);
+
+	while(short_mask != 0){
+		int i = __builtin_ctz(short_mask);
+		results[i] = R_GOOSE_MALFORMED_SHORT;
+		short_mask &= short_mask - 1;
+	}
+}
+
+#endif
+
+
+int r_gooseMessage_PrefilterBatch(uint8_t** buffers, const size_t* lens, int count, int* results){
+	int i = 0, valid = 0;
+
+#ifdef PREFILTER_X86_SIMD
+	if(__builtin_cpu_supports("avx2")){
+		for(; i + 8 <= count; i += 8){
+			prefilter_avx2(&buffers[i], &lens[i], &results[i]);
+		}
+	}
+#endif
+
+	for(; i < count; i++){
+		results[i] = r_gooseMessage_Prefilter(buffers[i], lens[i]);
+	}
+
+	for(i = 0; i < count; i++){
+		valid += results[i] == 0;
+	}
+
+	return valid;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file r_goose_prefilter.h
+ * @author Eduardo Andrade
+ * @date Mar 2020
+ * @brief File containing the declarations of the R-GOOSE structural pre-filter, which rejects malformed messages
+ * before any cryptographic operation.
+ *
+ * The Validate functions trust the SPDU Length and MAC Algorithm fields of the message. A message received from
+ * the network is checked first against the number of bytes actually received:
+ *
+ *				- LI = 0x01 and TI = 0x40
+ *				- SPDU Length + 10 equal to the received length (and below 64 KB)
+ *				- MAC Algorithm and Encryption Algorithm are defined values
+ *				- Signature TAG (0x85) and Signature Length (MAC_SIZES[MAC Algorithm]) at the position given by the
+ *				  SPDU Length, with room for the header before them
+ *				- APDU Length and (Session Payload) Length ending exactly at the Signature TAG
+ *
+ * All the checks are evaluated without early exits, and the result is a mask of the failed ones (0 for a well
+ * formed message). When the result is 0, every index used by the Validate functions lies inside the received bytes.
+ *
+ * r_gooseMessage_PrefilterBatch() checks several messages at once; when the CPU supports AVX2, 8 headers are
+ * gathered and checked together.
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * int n = receive_packets(buffers, lens, 16);				// pseudo-function that receives up to 16 packets
+ * int results[16];
+ *
+ * r_gooseMessage_PrefilterBatch(buffers, lens, n, results);
+ *
+ * for(int i = 0; i < n; i++){
+ * 	if(results[i] == 0 && r_gooseMessage_ValidateHMAC(buffers[i], key, key_size) == 1){
+ * 		process_packet(buffers[i]);							// pseudo-function that processes a valid packet
+ * 	}
+ * }
+ *
+ * @endcode
+ */
+
+#ifndef R_GOOSE_PREFILTER_H
+#define R_GOOSE_PREFILTER_H
+
+#include "r_goose_security.h"
+
+// Smallest R-GOOSE message: header up to the APDU Length, Signature TAG and Signature Length
+#define R_GOOSE_MIN_MESSAGE_SIZE		(INDEX_PAYLOAD + 2)
+
+// Largest R-GOOSE message (one UDP datagram)
+#define R_GOOSE_MAX_MESSAGE_SIZE		65535
+
+// Pre-filter results (mask of failed checks)
+#define R_GOOSE_MALFORMED_SHORT			0x01		// Less than R_GOOSE_MIN_MESSAGE_SIZE bytes (no other check done)
+#define R_GOOSE_MALFORMED_LI_TI			0x02		// LI/TI are not 0x01/0x40
+#define R_GOOSE_MALFORMED_SPDU_LENGTH	0x04		// SPDU Length doesn't match the received length
+#define R_GOOSE_MALFORMED_ALG			0x08		// Unknown MAC or Encryption Algorithm
+#define R_GOOSE_MALFORMED_SIGNATURE		0x10		// Signature TAG/Length not found where expected
+#define R_GOOSE_MALFORMED_APDU_LENGTH	0x20		// APDU Length or Length inconsistent with the SPDU Length
+
+
+/**
+ * @brief Function that checks the structure of an R-GOOSE message.
+ *
+ * @param buffer Pointer (<tt>uint8_t*</tt>) containg to the R-GOOSE message
+ * @param len Variable (<tt>size_t</tt>) with the number of bytes received
+ * @return The function returns 0 if the message is well formed, and otherwise a mask of R_GOOSE_MALFORMED_* values.
+ * @note The Signature and APDU Length checks are only done when the SPDU Length and MAC Algorithm are valid.
+ */
+int r_gooseMessage_Prefilter(uint8_t* buffer, size_t len);
+
+/**
+ * @brief Function that checks the structure of @p count R-GOOSE messages.
+ *
+ * @param buffers Array of pointers (<tt>uint8_t**</tt>) to the R-GOOSE messages
+ * @param lens Array (<tt>size_t*</tt>) with the number of bytes received for each message
+ * @param count Variable (<tt>int</tt>) with the number of messages
+ * @param results Array (<tt>int*</tt>) where the result of r_gooseMessage_Prefilter() for each message is stored
+ * @return The number of well formed messages.
+ */
+int r_gooseMessage_PrefilterBatch(uint8_t** buffers, const size_t* lens, int count, int* results);
+
+#endif
@@ -0,0 +1,181 @@
+/*
+	File defining the R-GOOSE publisher session (Custom/Off-Standard)
+
+	Message buffer:
+		[0, INDEX_PAYLOAD)				header, copied from the template once
+		[INDEX_PAYLOAD, +payload)		GOOSE APDU, written by the application
+		Signature TAG, Signature Length	2 bytes after the APDU
+		MAC Tag							MAC_SIZES[alg] bytes
+
+		The buffer is allocated for max_payload and MAX_MAC_SIZE, so it is never moved.
+
+	Per message stores:
+		SPDU Number (4), Security Information of the key (11), Signature TAG/Length (2). The
+		SPDU Length, Length and APDU Length are only written when the APDU size or the MAC Tag
+		size differ from the previous message:
+
+			SPDU Length = INDEX_PAYLOAD + payload + 2 + s - 10
+			Length = INDEX_PAYLOAD + payload + 2 - 30
+			APDU Length = payload + 2
+
+	The key is looked up on every message (inside a read section) rather than kept, so a
+	retired key is never used and r_goose_publisher_set_key() only changes the Key ID.
+
+	Encryption:
+		the payload is signed as written by the application, never encrypted, so keys with an
+		encryption algorithm are refused (by new and by sign, after a key change) and the
+		Encryption Algorithm of the header is ENC_NONE. Encrypted streams use
+		r_gooseMessage_ProtectKeyring().
+*/
+
+#include "r_goose_publisher.h"
+#include "r_goose_prefilter.h"
+
+// Signature TAG
+#define SIGNATURE_TAG		0x85
+
+
+static inline void store_be32(uint8_t* p, uint32_t v){
+	p[0] = (uint8_t)(v >> 24);
+	p[1] = (uint8_t)(v >> 16);
+	p[2] = (uint8_t)(v >> 8);
+	p[3] = (uint8_t)v;
+}
+
+static inline void store_be16(uint8_t* p, uint16_t v){
+	p[0] = (uint8_t)(v >> 8);
+	p[1] = (uint8_t)v;
+}
+
+
+r_goose_publisher* r_goose_publisher_new(uint8_t* tmpl, r_goose_keyring* ring, int reader, uint32_t key_id, size_t max_payload){
+
+	size_t messageSize = decode_4bytesToInt(tmpl, INDEX_SPDU_LENGTH) + 10;
+	uint16_t appid = decode_2bytesToInt(tmpl, INDEX_APPID);
+	int mac_alg, enc_alg;
+
+	if(messageSize < R_GOOSE_MIN_MESSAGE_SIZE){
+		return NULL;
+	}
+
+	// Template GOOSE APDU (between the header and the Signature TAG)
+	size_t payload_size = messageSize - INDEX_PAYLOAD - 2;
+	if(max_payload < payload_size){
+		max_payload = payload_size;
+	}
+	if(INDEX_PAYLOAD + max_payload + 2 + MAX_MAC_SIZE > R_GOOSE_MAX_MESSAGE_SIZE){
+		return NULL;
+	}
+
+	r_goose_keyring_reader_enter(ring, reader);
+	const r_goose_key* k = r_goose_keyring_lookup(ring, appid, key_id);
+	mac_alg = k == NULL ? MAC_NONE : k->mac_alg;
+	enc_alg = k == NULL ? ENC_NONE : k->enc_alg;
+	r_goose_keyring_reader_exit(ring, reader);
+
+	if(mac_alg == MAC_NONE || enc_alg != ENC_NONE){
+		return NULL;
+	}
+
+	r_goose_publisher* pub = (r_goose_publisher*)r_goose_calloc(1, sizeof(r_goose_publisher));
+	if(pub == NULL){
+		return NULL;
+	}
+
+	pub->message = (uint8_t*)r_goose_malloc(INDEX_PAYLOAD + max_payload + 2 + MAX_MAC_SIZE);
+	if(pub->message == NULL){
+		r_goose_free(pub);
+		return NULL;
+	}
+
+	memcpy(pub->message, tmpl, messageSize - 2);
+	pub->message[INDEX_ENCRYPTION_ALG] = ENC_NONE;
+
+	pub->max_payload = max_payload;
+	pub->ring = ring;
+	pub->reader = reader;
+	pub->appid = appid;
+	pub->key_id = key_id;
+	pub->spdu_number = decode_4bytesToInt(tmpl, INDEX_SPDU_NUMBER);
+
+	// Length fields written on the first message
+	pub->payload_size = payload_size;
+	pub->mac_size = -1;
+
+	return pub;
+}
+
+void r_goose_publisher_free(r_goose_publisher* pub){
+	if(pub == NULL){
+		return;
+	}
+	r_goose_free(pub->message);
+	r_goose_free(pub);
+}
+
+void r_goose_publisher_set_key(r_goose_publisher* pub, uint32_t key_id){
+	pub->key_id = key_id;
+}
+
+void r_goose_publisher_set_spdu_number(r_goose_publisher* pub, uint32_t spdu_number){
+	pub->spdu_number = spdu_number;
+}
+
+uint8_t* r_goose_publisher_payload(r_goose_publisher* pub){
+	return &pub->message[INDEX_PAYLOAD];
+}
+
+
+int r_goose_publisher_sign(r_goose_publisher* pub, size_t payload_size, uint8_t** message){
+
+	uint8_t* m = pub->message;
+	int macSize, res;
+
+	if(payload_size > pub->max_payload){
+		return -1;
+	}
+
+	r_goose_keyring_reader_enter(pub->ring, pub->reader);
+
+	const r_goose_key* k = r_goose_keyring_lookup(pub->ring, pub->appid, pub->key_id);
+	if(k == NULL || k->mac_alg == MAC_NONE || k->enc_alg != ENC_NONE){
+		r_goose_keyring_reader_exit(pub->ring, pub->reader);
+		return -1;
+	}
+
+	macSize = MAC_SIZES[k->mac_alg];
+	size_t tag = INDEX_PAYLOAD + payload_size;
+	size_t messageSize = tag + 2 + macSize;
+
+	if(payload_size != pub->payload_size || macSize != pub->mac_size){
+		store_be32(&m[INDEX_SPDU_LENGTH], (uint32_t)(messageSize - 10));
+		store_be32(&m[INDEX_LENGTH], (uint32_t)(tag + 2 - 30));
+		store_be16(&m[INDEX_APDU_LENGTH], (uint16_t)(payload_size + 2));
+		pub->payload_size = payload_size;
+		pub->mac_size = macSize;
+	}
+
+	store_be32(&m[INDEX_SPDU_NUMBER], pub->spdu_number);
+
+	// Security Information of the current key
+	store_be32(&m[INDEX_TIMECURKEY], k->timeOfCurrentKey);
+	store_be16(&m[INDEX_TIMENEXTKEY], k->timeToNextKey);
+	m[INDEX_MAC_ALG] = (uint8_t)k->mac_alg;
+	store_be32(&m[INDEX_KEYID], k->key_id);
+
+	m[tag] = SIGNATURE_TAG;
+	m[tag + 1] = (uint8_t)macSize;
+
+	res = r_goose_key_mac(pub->ring, pub->reader, k, &m[2], tag - 2, &m[tag + 2]);
+
+	r_goose_keyring_reader_exit(pub->ring, pub->reader);
+
+	if(res < 0){
+		return -1;
+	}
+
+	pub->spdu_number++;
+	*message = m;
+
+	return (int)messageSize;
+}
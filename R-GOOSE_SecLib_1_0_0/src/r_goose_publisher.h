@@ -0,0 +1,133 @@
+/**
+ * @file r_goose_publisher.h
+ * @author Eduardo Andrade
+ * @date Mar 2020
+ * @brief File containing the declarations of the R-GOOSE publisher session, which keeps the outgoing message of
+ * one stream (APPID) preformatted between publications.
+ *
+ * r_gooseMessage_InsertKeyring() copies the whole message, writes every Security Information field and recomputes
+ * the lengths on each call. A publisher holds instead:
+ *				- The message buffer, with the Session Header and Session Payload header already written from a
+ *				  template message, and room for the largest GOOSE APDU and MAC Tag
+ *				- The key handle (APPID, Key ID) in a key ring, and the MAC algorithm of that key
+ *				- The SPDU Number of the next message, incremented after each publication (modulo 2^32)
+ *
+ * The GOOSE APDU is written directly into the message (r_goose_publisher_payload()), and r_goose_publisher_sign()
+ * only stores the SPDU Number, the Security Information of the current key, the Signature TAG/Length and, when
+ * the APDU size or the MAC algorithm changed, the length fields. The MAC Tag is then generated in place with the
+ * prebuilt contexts of the key.
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * r_goose_publisher* pub = r_goose_publisher_new(tmpl, ring, reader, key_id, 1400);	// template message (without MAC Tag)
+ * uint8_t* message;
+ *
+ * while(1){
+ * 	size_t apdu_size = encode_goose_pdu(r_goose_publisher_payload(pub));	// pseudo-function that writes the GOOSE APDU
+ *
+ * 	int len = r_goose_publisher_sign(pub, apdu_size, &message);
+ * 	if(len > 0){
+ * 		send_packet(message, len);											// pseudo-function that sends a packet
+ * 	}
+ * }
+ *
+ * @endcode
+ * @warning A publisher must only be used by one thread (the one owning @p reader).
+ */
+
+#ifndef R_GOOSE_PUBLISHER_H
+#define R_GOOSE_PUBLISHER_H
+
+#include "r_goose_security.h"
+#include "r_goose_keyring.h"
+
+
+/**
+ * @brief Publisher session. @p message holds the last message signed.
+ */
+typedef struct r_goose_publisher {
+	uint8_t* message;
+	size_t max_payload;
+
+	r_goose_keyring* ring;
+	int reader;
+	uint16_t appid;
+	uint32_t key_id;
+
+	uint32_t spdu_number;
+
+	// Payload size and MAC Tag size the length fields were last written for
+	size_t payload_size;
+	int mac_size;
+} r_goose_publisher;
+
+/**
+ * @brief Static storage (no heap build) of a publisher of at most @p max_payload bytes of GOOSE APDU.
+ */
+#define R_GOOSE_PUBLISHER_STORAGE(max_payload)	(R_GOOSE_STATIC_BLOCK(sizeof(r_goose_publisher)) + \
+		R_GOOSE_STATIC_BLOCK(INDEX_PAYLOAD + (size_t)(max_payload) + 2 + MAX_MAC_SIZE))
+
+
+/**
+ * @brief Function that creates a publisher session from a template R-GOOSE message.
+ *
+ * The Session Header and Session Payload header (up to the APDU Length) are copied from @p tmpl, as well as its
+ * GOOSE APDU, which is the payload of the publisher until it is overwritten. The first message is published with the
+ * SPDU Number of @p tmpl. Messages are signed, not encrypted: the Encryption Algorithm field is set to ENC_NONE, and
+ * keys with an encryption algorithm are refused (use r_gooseMessage_ProtectKeyring() for encrypted streams).
+ *
+ * @param tmpl Pointer (<tt>uint8_t*</tt>) containg an R-GOOSE message without MAC Tag (same as r_gooseMessage_InsertKeyring())
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the reader identifier used to sign
+ * @param key_id Variable (<tt>uint32_t</tt>) with the Key ID (the APPID is read from @p tmpl)
+ * @param max_payload Variable (<tt>size_t</tt>) with the largest GOOSE APDU that will be published (at least the one of @p tmpl)
+ * @return A pointer to the new publisher, or NULL if an error occurred (unknown key, no MAC algorithm, key with an
+ * encryption algorithm or message too large).
+ * @warning The publisher must be released with r_goose_publisher_free().
+ */
+r_goose_publisher* r_goose_publisher_new(uint8_t* tmpl, r_goose_keyring* ring, int reader, uint32_t key_id, size_t max_payload);
+
+/**
+ * @brief Function that releases a publisher session.
+ *
+ * @param pub Pointer (<tt>r_goose_publisher*</tt>) to the publisher
+ */
+void r_goose_publisher_free(r_goose_publisher* pub);
+
+/**
+ * @brief Function that changes the key used by the publisher (key rotation). Takes effect on the next message.
+ *
+ * @param pub Pointer (<tt>r_goose_publisher*</tt>) to the publisher
+ * @param key_id Variable (<tt>uint32_t</tt>) with the new Key ID (same APPID)
+ */
+void r_goose_publisher_set_key(r_goose_publisher* pub, uint32_t key_id);
+
+/**
+ * @brief Function that sets the SPDU Number of the next message.
+ *
+ * @param pub Pointer (<tt>r_goose_publisher*</tt>) to the publisher
+ * @param spdu_number Variable (<tt>uint32_t</tt>) with the SPDU Number
+ */
+void r_goose_publisher_set_spdu_number(r_goose_publisher* pub, uint32_t spdu_number);
+
+/**
+ * @brief Function that returns where the GOOSE APDU of the next message is written (INDEX_PAYLOAD of the message).
+ *
+ * @param pub Pointer (<tt>r_goose_publisher*</tt>) to the publisher
+ * @return Pointer to a buffer of @p max_payload bytes.
+ */
+uint8_t* r_goose_publisher_payload(r_goose_publisher* pub);
+
+/**
+ * @brief Function that completes and signs the next message of the publisher.
+ *
+ * @param pub Pointer (<tt>r_goose_publisher*</tt>) to the publisher
+ * @param payload_size Variable (<tt>size_t</tt>) with the size of the GOOSE APDU written at r_goose_publisher_payload()
+ * @param message Pointer (<tt>uint8_t**</tt>) set to the signed message (owned by the publisher, valid until the next call)
+ * @return The function returns the size of the message, or -1 if an error occurred (unknown key, no MAC algorithm, key
+ * with an encryption algorithm or @p payload_size above @p max_payload). The SPDU Number is only incremented when the message is signed.
+ */
+int r_goose_publisher_sign(r_goose_publisher* pub, size_t payload_size, uint8_t** message);
+
+#endif
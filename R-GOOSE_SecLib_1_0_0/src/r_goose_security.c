@@ -1,7 +1,7 @@
 #include "r_goose_security.h"
 
 
-const int MAC_SIZES[] = {0, 10, 16, 32, 8, 16, 10, 10, 8, 16};
+const int MAC_SIZES[] = MAC_SIZES_INIT;
 
 /* Recebe apenas a mensagem r_goose, não o pacote inteiro 
 
@@ -22,10 +22,15 @@ const int MAC_SIZES[] = {0, 10, 16, 32, 8, 16, 10, 10, 8, 16};
 */		
 int r_gooseMessage_InsertHMAC(uint8_t* buffer, uint8_t* key, size_t key_size, int alg, uint8_t** dest){
 	
-	int macSize, messageSize, new_size;
+	int macSize, messageSize, new_size, rc = 0;
 	uint8_t* tmp;
 
 	
+	// Unknown algorithm, or not compiled in (r_goose_config.h)
+	if(!R_GOOSE_MAC_ENABLED(alg)){
+		return -1;
+	}
+
 	// Get length of MAC Tag from alg parameter
 	macSize = MAC_SIZES[alg];
 
@@ -66,7 +71,7 @@ int r_gooseMessage_InsertHMAC(uint8_t* buffer, uint8_t* key, size_t key_size, in
 		buffer = tmp;
 	}*/
 
-	*dest = (uint8_t*)malloc(sizeof(char)*new_size);
+	*dest = (uint8_t*)r_goose_malloc(sizeof(char)*new_size);
 	if(*dest == NULL){
 		perror("Memory exausted");
 		return -1;
@@ -123,8 +128,13 @@ int r_gooseMessage_InsertHMAC(uint8_t* buffer, uint8_t* key, size_t key_size, in
 
 	// Generate Authentication Tag
 
-	// Malloc temporary/auxiliary buffer to store generated MAC Tag
-	uint8_t* aux = (uint8_t*)malloc(sizeof(uint8_t)*macSize);
+	// MAC Tag is generated directly on its position at the end of the new buffer
+	uint8_t* aux = &tmp[new_size-macSize];
+
+#if !R_GOOSE_WITH_ANY_HMAC
+	// No HMAC algorithm compiled in, only MAC_NONE gets here
+	(void)aux;
+#endif
 
 	/* 	Depending on the algorithm choosen (alg param), MAC Signature Algorithm field
 		must be updated, and call respective HMAC generation function
@@ -139,50 +149,80 @@ int r_gooseMessage_InsertHMAC(uint8_t* buffer, uint8_t* key, size_t key_size, in
 			- Key and key size are received by param
 		
 	*/
-	if(alg == HMAC_SHA256_80){
-
-		// MAC Algorithm - 0x01 - HMAC-SHA256-80 as per IEC 62351-6:2020 draft
-		tmp[23] = 0x01;										
-
-		hmac_SHA256_80(&tmp[2], key, messageSize-4, key_size, &aux);
-
-	}else if(alg == HMAC_SHA256_128){
-
-		// MAC Algorithm - 0x02 - HMAC-SHA256-128 as per IEC 62351-6:2020 draft
-		tmp[23] = 0x02;										
-		
-		hmac_SHA256_128(&tmp[2], key, messageSize-4, key_size, &aux);
-
-	}else if(alg == HMAC_SHA256_256){
-
-		// MAC Algorithm - 0x03 - HMAC-SHA256-256 as per IEC 62351-6:2020 draft
-		tmp[23] = 0x03;										
-		
-		hmac_SHA256_256(&tmp[2], key, messageSize-4, key_size, &aux);
-
-	}else if(alg == HMAC_BLAKE2B_80){
-
-		// MAC Algorithm - 0x06 - BLAKE2b padded to 10bytes - Custom made
-		tmp[23] = 0x06;										
-		
-		hmac_BLAKE2b_80(&tmp[2], key, messageSize-4, key_size, &aux);
-
-	}else if(alg == HMAC_BLAKE2S_80){
-
-		// MAC Algorithm - 0x07 - BLAKE2s padded to 10 bytes - Custom made
-		tmp[23] = 0x07;										
-		
-		hmac_BLAKE2s_80(&tmp[2], key, messageSize-4, key_size, &aux);
+	switch(alg){
+#if R_GOOSE_WITH_HMAC_SHA256_80
+		case HMAC_SHA256_80:
+			// MAC Algorithm - 0x01 - HMAC-SHA256-80 as per IEC 62351-6:2020 draft
+			tmp[23] = 0x01;
+			rc = hmac_SHA256_80(&tmp[2], key, messageSize-4, key_size, &aux);
+			break;
+#endif
+#if R_GOOSE_WITH_HMAC_SHA256_128
+		case HMAC_SHA256_128:
+			// MAC Algorithm - 0x02 - HMAC-SHA256-128 as per IEC 62351-6:2020 draft
+			tmp[23] = 0x02;
+			rc = hmac_SHA256_128(&tmp[2], key, messageSize-4, key_size, &aux);
+			break;
+#endif
+#if R_GOOSE_WITH_HMAC_SHA256_256
+		case HMAC_SHA256_256:
+			// MAC Algorithm - 0x03 - HMAC-SHA256-256 as per IEC 62351-6:2020 draft
+			tmp[23] = 0x03;
+			rc = hmac_SHA256_256(&tmp[2], key, messageSize-4, key_size, &aux);
+			break;
+#endif
+#if R_GOOSE_WITH_HMAC_SHA512_256_80
+		case HMAC_SHA512_256_80:
+			// MAC Algorithm - 0x0D - HMAC-SHA512/256 truncated to 10 bytes - Custom made
+			tmp[23] = 0x0D;
+			rc = hmac_SHA512_256_80(&tmp[2], key, messageSize-4, key_size, &aux);
+			break;
+#endif
+#if R_GOOSE_WITH_HMAC_SHA512_256_128
+		case HMAC_SHA512_256_128:
+			// MAC Algorithm - 0x0E - HMAC-SHA512/256 truncated to 16 bytes - Custom made
+			tmp[23] = 0x0E;
+			rc = hmac_SHA512_256_128(&tmp[2], key, messageSize-4, key_size, &aux);
+			break;
+#endif
+#if R_GOOSE_WITH_HMAC_BLAKE2B_80
+		case HMAC_BLAKE2B_80:
+			// MAC Algorithm - 0x06 - BLAKE2b padded to 10bytes - Custom made
+			tmp[23] = 0x06;
+			rc = hmac_BLAKE2b_80(&tmp[2], key, messageSize-4, key_size, &aux);
+			break;
+#endif
+#if R_GOOSE_WITH_HMAC_BLAKE2S_80
+		case HMAC_BLAKE2S_80:
+			// MAC Algorithm - 0x07 - BLAKE2s padded to 10 bytes - Custom made
+			tmp[23] = 0x07;
+			rc = hmac_BLAKE2s_80(&tmp[2], key, messageSize-4, key_size, &aux);
+			break;
+#endif
+#if R_GOOSE_WITH_BLAKE2B_KEYED_80
+		case BLAKE2B_KEYED_80:
+			// MAC Algorithm - 0x0A - Native keyed BLAKE2b with 10 bytes digest - Custom made
+			tmp[23] = 0x0A;
+			rc = blake2b_80(&tmp[2], key, messageSize-4, key_size, &aux);
+			break;
+#endif
+#if R_GOOSE_WITH_BLAKE2S_KEYED_80
+		case BLAKE2S_KEYED_80:
+			// MAC Algorithm - 0x0B - Native keyed BLAKE2s with 10 bytes digest - Custom made
+			tmp[23] = 0x0B;
+			rc = blake2s_80(&tmp[2], key, messageSize-4, key_size, &aux);
+			break;
+#endif
+		default:
+			rc = 1;
+	}
 
-	}else{
+	if(rc != 0){
+		r_goose_free(*dest);
+		*dest = NULL;
 		return -1;
 	}
 	
-	// Append Authentication Tag to original buffer (already resized)
-	memcpy(&tmp[new_size-macSize], aux, macSize);
-
-	// Free memory
-	free(aux);
 	return 1;
 }
 
@@ -194,6 +234,11 @@ int r_gooseMessage_ValidateHMAC(uint8_t* buffer, uint8_t* key, size_t key_size){
 
 	alg = buffer[INDEX_MAC_ALG];
 
+	// Unknown algorithm (MAC_SIZES can't be indexed with it), or not compiled in (r_goose_config.h)
+	if(!R_GOOSE_MAC_ENABLED(alg)){
+		return -1;
+	}
+
 	macSize = MAC_SIZES[alg];
 
 	index_mac = messageSize - macSize;
@@ -204,108 +249,100 @@ int r_gooseMessage_ValidateHMAC(uint8_t* buffer, uint8_t* key, size_t key_size){
 	/* Get Security Info ... */
 
 	/* Generate local HMAC from received data */
-	if(alg == HMAC_SHA256_80){
-		uint8_t* aux = (uint8_t*)malloc(sizeof(uint8_t)*macSize);
-
-		hmac_SHA256_80(&buffer[2], key, messageSize-4-macSize, key_size, &aux);
-		
-		// MAC Tag comparison
-		if(memcmp(aux, &buffer[index_mac], macSize) == 0){
-			// MAC Tag is valid
-			free(aux);
-			return 1;
-		}else{
-			free(aux);
-			return 0;
-		}
-
-	}else if(alg == HMAC_SHA256_128){
-		uint8_t* aux = (uint8_t*)malloc(sizeof(uint8_t)*macSize);
-
-		hmac_SHA256_128(&buffer[2], key, messageSize-4-macSize, key_size, &aux);
-		
-		// MAC Tag comparison
-		if(memcmp(aux, &buffer[index_mac], macSize) == 0){
-			// MAC Tag is valid
-			free(aux);
-			return 1;
-		}else{
-			free(aux);
-			return 0;
-		}
-
-	}else if(alg == HMAC_SHA256_256){
-		uint8_t* aux = (uint8_t*)malloc(sizeof(uint8_t)*macSize);
-
-		hmac_SHA256_256(&buffer[2], key, messageSize-4-macSize, key_size, &aux);
-	
-		// MAC Tag comparison
-		if(memcmp(aux, &buffer[index_mac], macSize) == 0){
-			// MAC Tag is valid
-			free(aux);
-			return 1;
-		}else{
-			free(aux);
-			return 0;
-		}
-
-	}else if(alg == HMAC_BLAKE2B_80){
-		uint8_t* aux = (uint8_t*)malloc(sizeof(uint8_t)*macSize);
-
-		hmac_BLAKE2b_80(&buffer[2], key, messageSize-4-macSize, key_size, &aux);
-	
-		// MAC Tag comparison
-		if(memcmp(aux, &buffer[index_mac], macSize) == 0){
-			// MAC Tag is valid
-			free(aux);
-			return 1;
-		}else{
-			free(aux);
-			return 0;
-		}
-
-	}else if(alg == HMAC_BLAKE2S_80){
-		uint8_t* aux = (uint8_t*)malloc(sizeof(uint8_t)*macSize);
-
-		hmac_BLAKE2s_80(&buffer[2], key, messageSize-4-macSize, key_size, &aux);
-	
-		// MAC Tag comparison
-		if(memcmp(aux, &buffer[index_mac], macSize) == 0){
-			// MAC Tag is valid
-			free(aux);
-			return 1;
-		}else{
-			free(aux);
-			return 0;
-		}
+	uint8_t aux_tag[MAX_MAC_SIZE], *aux = aux_tag;
+
+	switch(alg){
+#if R_GOOSE_WITH_HMAC_SHA256_80
+		case HMAC_SHA256_80:
+			if(hmac_SHA256_80(&buffer[2], key, messageSize-4-macSize, key_size, &aux) != 0){
+				return -1;
+			}
+			break;
+#endif
+#if R_GOOSE_WITH_HMAC_SHA256_128
+		case HMAC_SHA256_128:
+			if(hmac_SHA256_128(&buffer[2], key, messageSize-4-macSize, key_size, &aux) != 0){
+				return -1;
+			}
+			break;
+#endif
+#if R_GOOSE_WITH_HMAC_SHA256_256
+		case HMAC_SHA256_256:
+			if(hmac_SHA256_256(&buffer[2], key, messageSize-4-macSize, key_size, &aux) != 0){
+				return -1;
+			}
+			break;
+#endif
+#if R_GOOSE_WITH_HMAC_SHA512_256_80
+		case HMAC_SHA512_256_80:
+			if(hmac_SHA512_256_80(&buffer[2], key, messageSize-4-macSize, key_size, &aux) != 0){
+				return -1;
+			}
+			break;
+#endif
+#if R_GOOSE_WITH_HMAC_SHA512_256_128
+		case HMAC_SHA512_256_128:
+			if(hmac_SHA512_256_128(&buffer[2], key, messageSize-4-macSize, key_size, &aux) != 0){
+				return -1;
+			}
+			break;
+#endif
+#if R_GOOSE_WITH_HMAC_BLAKE2B_80
+		case HMAC_BLAKE2B_80:
+			if(hmac_BLAKE2b_80(&buffer[2], key, messageSize-4-macSize, key_size, &aux) != 0){
+				return -1;
+			}
+			break;
+#endif
+#if R_GOOSE_WITH_HMAC_BLAKE2S_80
+		case HMAC_BLAKE2S_80:
+			if(hmac_BLAKE2s_80(&buffer[2], key, messageSize-4-macSize, key_size, &aux) != 0){
+				return -1;
+			}
+			break;
+#endif
+#if R_GOOSE_WITH_BLAKE2B_KEYED_80
+		case BLAKE2B_KEYED_80:
+			if(blake2b_80(&buffer[2], key, messageSize-4-macSize, key_size, &aux) != 0){
+				return -1;
+			}
+			break;
+#endif
+#if R_GOOSE_WITH_BLAKE2S_KEYED_80
+		case BLAKE2S_KEYED_80:
+			if(blake2s_80(&buffer[2], key, messageSize-4-macSize, key_size, &aux) != 0){
+				return -1;
+			}
+			break;
+#endif
+		case MAC_NONE:
+			// Nothing to do ... but not an error
+			return 2;
+		default:
+			// Invalid data
+			return -1;
+	}
 
-	}else if(alg == MAC_NONE){
-		// Nothing to do ... but not an error
-		return 2;
+	// MAC Tag comparison
+	if(memcmp(aux, &buffer[index_mac], macSize) == 0){
+		// MAC Tag is valid
+		return 1;
 	}else{
-		// Invalid data
-		return -1;
+		return 0;
 	}
 }
 
 int r_gooseMessage_InsertGMAC(uint8_t* buffer, uint8_t* key, size_t key_size, int alg, uint8_t** dest){
 	// Initialize IV - Can be changed
-	uint8_t* iv = (uint8_t*)malloc(sizeof(uint8_t)*12);
-	*(iv + 0) = 0x00;
-	*(iv + 1) = 0x00;
-	*(iv + 2) = 0x00;
-	*(iv + 3) = 0x00;
-	*(iv + 4) = 0x00;
-	*(iv + 5) = 0x00;
-	*(iv + 6) = 0x00;
-	*(iv + 7) = 0x00;
-	*(iv + 8) = 0x00;
-	*(iv + 9) = 0x00;
-	*(iv + 10) = 0x00;
-	*(iv + 11) = 0x00;
+	uint8_t iv[12] = {0};
 
 	int iv_size = 12;
 
+	// Unknown algorithm, or not compiled in (r_goose_config.h)
+	if(!R_GOOSE_MAC_ENABLED(alg)){
+		return -1;
+	}
+
 	int macSize = MAC_SIZES[alg];
 
 	int messageSize = decode_4bytesToInt(buffer,6) + 10;
@@ -336,7 +373,7 @@ int r_gooseMessage_InsertGMAC(uint8_t* buffer, uint8_t* key, size_t key_size, in
 		buffer = tmp;
 	}*/
 
-	*dest = (uint8_t*)malloc(sizeof(char)*new_size);
+	*dest = (uint8_t*)r_goose_malloc(sizeof(char)*new_size);
 	if(*dest == NULL){
 		perror("Memory exausted");
 		return -1;
@@ -374,57 +411,66 @@ int r_gooseMessage_InsertGMAC(uint8_t* buffer, uint8_t* key, size_t key_size, in
 
 	// Generate Authentication Tag
 
-	uint8_t* aux = (uint8_t*)malloc(sizeof(uint8_t)*macSize);
-
-	if(alg == GMAC_AES256_64){
-
-		tmp[23] = 0x04;										// MAC Algorithm - 0x04 - GMAC_AES256_64 as per IEC 62351-6:2020 draft
-		
-		gmac_AES256_64(&tmp[2], key, iv, messageSize-4, iv_size, &aux);
-
-	}else if(alg == GMAC_AES256_128){
-
-		tmp[23] = 0x05;										// MAC Algorithm - 0x05 - GMAC_AES256_128 as per IEC 62351-6:2020 draft
-		
-		gmac_AES256_128(&tmp[2], key, iv, messageSize-4, iv_size, &aux);
-
-	}else if(alg == GMAC_AES128_64){
-
-		tmp[23] = 0x08;										// MAC Algorithm - 0x08 - Custom made
-		
-		gmac_AES128_64(&tmp[2], key, iv, messageSize-4, iv_size, &aux);
-
-	}else if(alg == GMAC_AES128_128){
-
-		tmp[23] = 0x09;										// MAC Algorithm - 0x09 - Custom made
-		
-		gmac_AES128_128(&tmp[2], key, iv, messageSize-4, iv_size, &aux);
+	// MAC Tag is generated directly on its position at the end of the new buffer
+	uint8_t* aux = &tmp[new_size-macSize];
+
+#if !R_GOOSE_WITH_ANY_GMAC
+	// No GMAC algorithm compiled in, only MAC_NONE gets here
+	(void)iv; (void)iv_size; (void)aux;
+#endif
+
+	int rc = 0;
+
+	switch(alg){
+#if R_GOOSE_WITH_GMAC_AES256_64
+		case GMAC_AES256_64:
+			tmp[23] = 0x04;									// MAC Algorithm - 0x04 - GMAC_AES256_64 as per IEC 62351-6:2020 draft
+			rc = gmac_AES256_64(&tmp[2], key, iv, messageSize-4, iv_size, &aux);
+			break;
+#endif
+#if R_GOOSE_WITH_GMAC_AES256_128
+		case GMAC_AES256_128:
+			tmp[23] = 0x05;									// MAC Algorithm - 0x05 - GMAC_AES256_128 as per IEC 62351-6:2020 draft
+			rc = gmac_AES256_128(&tmp[2], key, iv, messageSize-4, iv_size, &aux);
+			break;
+#endif
+#if R_GOOSE_WITH_GMAC_AES128_64
+		case GMAC_AES128_64:
+			tmp[23] = 0x08;									// MAC Algorithm - 0x08 - Custom made
+			rc = gmac_AES128_64(&tmp[2], key, iv, messageSize-4, iv_size, &aux);
+			break;
+#endif
+#if R_GOOSE_WITH_GMAC_AES128_128
+		case GMAC_AES128_128:
+			tmp[23] = 0x09;									// MAC Algorithm - 0x09 - Custom made
+			rc = gmac_AES128_128(&tmp[2], key, iv, messageSize-4, iv_size, &aux);
+			break;
+#endif
+#if R_GOOSE_WITH_CHACHA20_POLY1305_128
+		case CHACHA20_POLY1305_128:
+			tmp[23] = 0x0C;									// MAC Algorithm - 0x0C - Custom made
+			// Poly1305 keys are one-time keys: nonce derived from the SPDU Number (never the fixed IV)
+			rc = poly1305_CHACHA20_nonce(key, decode_4bytesToInt(tmp, INDEX_SPDU_NUMBER), iv);
+			if(rc == 0){
+				rc = poly1305_CHACHA20_128(&tmp[2], key, iv, messageSize-4, iv_size, &aux);
+			}
+			break;
+#endif
+	}
 
+	if(rc != 0){
+		r_goose_free(*dest);
+		*dest = NULL;
+		return -1;
 	}
 	
-	// Append Authentication Tag to buffer
-	memcpy(&tmp[new_size-macSize], aux, macSize);
-	free(aux);
-	free(iv);
 	return 1;
 }
 
 int r_gooseMessage_ValidateGMAC(uint8_t* buffer, uint8_t* key, size_t key_size){
 	
 	// Initialize IV - Can be changed
-	uint8_t* iv = (uint8_t*)malloc(sizeof(uint8_t)*12);
-	*(iv + 0) = 0x00;
-	*(iv + 1) = 0x00;
-	*(iv + 2) = 0x00;
-	*(iv + 3) = 0x00;
-	*(iv + 4) = 0x00;
-	*(iv + 5) = 0x00;
-	*(iv + 6) = 0x00;
-	*(iv + 7) = 0x00;
-	*(iv + 8) = 0x00;
-	*(iv + 9) = 0x00;
-	*(iv + 10) = 0x00;
-	*(iv + 11) = 0x00;
+	uint8_t iv[12] = {0};
 
 	int iv_size = 12;
 
@@ -434,6 +480,11 @@ int r_gooseMessage_ValidateGMAC(uint8_t* buffer, uint8_t* key, size_t key_size){
 
 	alg = buffer[INDEX_MAC_ALG];
 
+	// Unknown algorithm (MAC_SIZES can't be indexed with it), or not compiled in (r_goose_config.h)
+	if(!R_GOOSE_MAC_ENABLED(alg)){
+		return -1;
+	}
+
 	macSize = MAC_SIZES[alg];
 
 	index_mac = messageSize - macSize;
@@ -444,102 +495,84 @@ int r_gooseMessage_ValidateGMAC(uint8_t* buffer, uint8_t* key, size_t key_size){
 	/* Get Security Info ... */
 
 	/* Generate local HMAC from received data */
-	if(alg == GMAC_AES256_64){
-		uint8_t* aux = (uint8_t*)malloc(sizeof(uint8_t)*macSize);
-
-		gmac_AES256_64(&buffer[2], key, iv, messageSize-4-macSize, iv_size, &aux);
-	
-		// MAC Tag comparison
-		if(memcmp(aux, &buffer[index_mac], macSize) == 0){
-			// MAC Tag is valid
-			free(aux);
-			free(iv);
-			return 1;
-		}else{
-			free(aux);
-			free(iv);
-			return 0;
-		}
-
-	}else if(alg == GMAC_AES256_128){
-		uint8_t* aux = (uint8_t*)malloc(sizeof(uint8_t)*macSize);
-
-		gmac_AES256_128(&buffer[2], key, iv, messageSize-4-macSize, iv_size, &aux);
-		
-		// MAC Tag comparison
-		if(memcmp(aux, &buffer[index_mac], macSize) == 0){
-			// MAC Tag is valid
-			free(aux);
-			free(iv);
-			return 1;
-		}else{
-			free(aux);
-			free(iv);
-			return 0;
-		}
-
-	}else if(alg == GMAC_AES128_64){
-		uint8_t* aux = (uint8_t*)malloc(sizeof(uint8_t)*macSize);
-
-		gmac_AES128_64(&buffer[2], key, iv, messageSize-4-macSize, iv_size, &aux);
-		
-		// MAC Tag comparison
-		if(memcmp(aux, &buffer[index_mac], macSize) == 0){
-			// MAC Tag is valid
-			free(aux);
-			free(iv);
-			return 1;
-		}else{
-			free(aux);
-			free(iv);
-			return 0;
-		}
-
-	}else if(alg == GMAC_AES128_128){
-		uint8_t* aux = (uint8_t*)malloc(sizeof(uint8_t)*macSize);
+	uint8_t aux_tag[MAX_MAC_SIZE], *aux = aux_tag;
+
+#if !R_GOOSE_WITH_ANY_GMAC
+	// No GMAC algorithm compiled in, only MAC_NONE gets here
+	(void)iv; (void)iv_size;
+#endif
+
+	int rc = 0;
+
+	switch(alg){
+#if R_GOOSE_WITH_GMAC_AES256_64
+		case GMAC_AES256_64:
+			rc = gmac_AES256_64(&buffer[2], key, iv, messageSize-4-macSize, iv_size, &aux);
+			break;
+#endif
+#if R_GOOSE_WITH_GMAC_AES256_128
+		case GMAC_AES256_128:
+			rc = gmac_AES256_128(&buffer[2], key, iv, messageSize-4-macSize, iv_size, &aux);
+			break;
+#endif
+#if R_GOOSE_WITH_GMAC_AES128_64
+		case GMAC_AES128_64:
+			rc = gmac_AES128_64(&buffer[2], key, iv, messageSize-4-macSize, iv_size, &aux);
+			break;
+#endif
+#if R_GOOSE_WITH_GMAC_AES128_128
+		case GMAC_AES128_128:
+			rc = gmac_AES128_128(&buffer[2], key, iv, messageSize-4-macSize, iv_size, &aux);
+			break;
+#endif
+#if R_GOOSE_WITH_CHACHA20_POLY1305_128
+		case CHACHA20_POLY1305_128:
+			rc = poly1305_CHACHA20_nonce(key, decode_4bytesToInt(buffer, INDEX_SPDU_NUMBER), iv);
+			if(rc == 0){
+				rc = poly1305_CHACHA20_128(&buffer[2], key, iv, messageSize-4-macSize, iv_size, &aux);
+			}
+			break;
+#endif
+		case MAC_NONE:
+			// Verificar se Signature Length != 0
+			if(buffer[index_mac-1] != 0){
+				// MAC Length changed, packet invalid
+				return 0;
+			}
+			return 2;
+		default:
+			// Invalid data
+			return -1;
+	}
 
-		gmac_AES128_128(&buffer[2], key, iv, messageSize-4-macSize, iv_size, &aux);;
-	
-		// MAC Tag comparison
-		if(memcmp(aux, &buffer[index_mac], macSize) == 0){
-			// MAC Tag is valid
-			free(aux);
-			free(iv);
-			return 1;
-		}else{
-			free(aux);
-			free(iv);
-			return 0;
-		}
+	if(rc != 0){
+		return -1;
+	}
 
-	}else if(alg == MAC_NONE){
-		// Verificar se Signature Length != 0
-		if(buffer[index_mac-1] != 0){
-			// MAC Length changed, packet invalid
-			free(iv);
-			return 0;
-		}else{
-			free(iv);
-			return 2;
-		}
-		free(iv);
+	// MAC Tag comparison
+	if(memcmp(aux, &buffer[index_mac], macSize) == 0){
+		// MAC Tag is valid
 		return 1;
 	}else{
-		// Invalid data
-		free(iv);
-		return -1;
+		return 0;
 	}
-
 }
 
 
 int r_gooseMessage_Encrypt(uint8_t* buffer, uint8_t* key, int alg, uint32_t timeOfCurrentKey, uint16_t timeToNextKey, uint32_t key_id, uint8_t* iv, int iv_size){
 	int encLen;
 
-	uint8_t* encryptedPayload = NULL;
+	// Payload is encrypted in place (GCM/ChaCha20 output has the same length as the input)
+	uint8_t* encryptedPayload = &buffer[INDEX_PAYLOAD];
 
 	int data_size;
 
+#if !R_GOOSE_WITH_ANY_ENCRYPTION
+	// No encryption algorithm compiled in, only ENC_NONE is handled
+	(void)encLen; (void)encryptedPayload; (void)data_size;
+#endif
+
+#if R_GOOSE_WITH_AES_128_GCM
 	if(alg == 1){
 		// AES-128-GCM
 
@@ -551,14 +584,16 @@ int r_gooseMessage_Encrypt(uint8_t* buffer, uint8_t* key, int alg, uint32_t time
 
 		buffer[INDEX_ENCRYPTION_ALG] = 0x01;
 		encLen = aes_128_gcm_encrypt(&buffer[INDEX_PAYLOAD], key, iv, data_size, iv_size, &encryptedPayload);
-
-		memcpy(&buffer[INDEX_PAYLOAD], encryptedPayload, encLen);
-
-		free(encryptedPayload);
+		if(encLen < 0){
+			return -1;
+		}
 
 		return 1;
 
-	}else if(alg == 2){
+	}
+#endif
+#if R_GOOSE_WITH_AES_256_GCM
+	if(alg == 2){
 		// AES-256-GCM
 
 		data_size = decode_2bytesToInt(buffer,INDEX_APDU_LENGTH) - 2;
@@ -569,14 +604,36 @@ int r_gooseMessage_Encrypt(uint8_t* buffer, uint8_t* key, int alg, uint32_t time
 
 		buffer[INDEX_ENCRYPTION_ALG] = 0x02;
 		encLen = aes_256_gcm_encrypt(&buffer[INDEX_PAYLOAD], key, iv, data_size, iv_size, &encryptedPayload);
+		if(encLen < 0){
+			return -1;
+		}
+
+		return 1;
+
+	}
+#endif
+#if R_GOOSE_WITH_CHACHA20_POLY1305
+	if(alg == 3){
+		// ChaCha20-Poly1305
+
+		data_size = decode_2bytesToInt(buffer,INDEX_APDU_LENGTH) - 2;
 
-		memcpy(&buffer[INDEX_PAYLOAD], encryptedPayload, encLen);
+		encodeInt4Bytes(buffer,timeOfCurrentKey,INDEX_TIMECURKEY);
+		encodeInt2Bytes(buffer,timeToNextKey,INDEX_TIMENEXTKEY);
+		encodeInt4Bytes(buffer,key_id,INDEX_KEYID);
 
-		free(encryptedPayload);	
+		buffer[INDEX_ENCRYPTION_ALG] = 0x03;
+		encLen = chacha20_poly1305_encrypt(&buffer[INDEX_PAYLOAD], key, iv, data_size, iv_size, &encryptedPayload);
+		if(encLen < 0){
+			return -1;
+		}
 
 		return 1;
 
-	}else if(alg == 0){
+	}
+#endif
+
+	if(alg == 0){
 		// Default case ? - None Encryption
 		buffer[INDEX_ENCRYPTION_ALG] = 0x00;
 
@@ -587,43 +644,122 @@ int r_gooseMessage_Encrypt(uint8_t* buffer, uint8_t* key, int alg, uint32_t time
 	return -1;
 }
 
+int r_gooseMessage_EncryptTo(const uint8_t* src, uint8_t* dest, size_t dest_size, uint8_t* key, int alg, uint32_t timeOfCurrentKey, uint16_t timeToNextKey, uint32_t key_id, uint8_t* iv, int iv_size){
+	int encLen, messageSize, data_size;
+
+	messageSize = decode_4bytesToInt((uint8_t*)src, INDEX_SPDU_LENGTH) + 10;
+	data_size = decode_2bytesToInt((uint8_t*)src, INDEX_APDU_LENGTH) - 2;
+	if(!R_GOOSE_ENC_ENABLED(alg) || (size_t)messageSize > dest_size || data_size < 0 || INDEX_PAYLOAD + data_size > messageSize){
+		return -1;
+	}
+
+	// Header and trailer are copied, the payload is written by the cipher straight from src
+	uint8_t* encryptedPayload = &dest[INDEX_PAYLOAD];
+	memcpy(dest, src, INDEX_PAYLOAD);
+	memcpy(&dest[INDEX_PAYLOAD + data_size], &src[INDEX_PAYLOAD + data_size], messageSize - INDEX_PAYLOAD - data_size);
+
+	dest[INDEX_ENCRYPTION_ALG] = (uint8_t)alg;
+
+	if(alg == 0){
+		// None Encryption
+		memcpy(encryptedPayload, &src[INDEX_PAYLOAD], data_size);
+		return 0;
+	}
+
+	encodeInt4Bytes(dest,timeOfCurrentKey,INDEX_TIMECURKEY);
+	encodeInt2Bytes(dest,timeToNextKey,INDEX_TIMENEXTKEY);
+	encodeInt4Bytes(dest,key_id,INDEX_KEYID);
+
+	switch(alg){
+#if R_GOOSE_WITH_AES_128_GCM
+		case AES_128_GCM:
+			encLen = aes_128_gcm_encrypt((uint8_t*)&src[INDEX_PAYLOAD], key, iv, data_size, iv_size, &encryptedPayload);
+			break;
+#endif
+#if R_GOOSE_WITH_AES_256_GCM
+		case AES_256_GCM:
+			encLen = aes_256_gcm_encrypt((uint8_t*)&src[INDEX_PAYLOAD], key, iv, data_size, iv_size, &encryptedPayload);
+			break;
+#endif
+#if R_GOOSE_WITH_CHACHA20_POLY1305
+		case CHACHA20_POLY1305:
+			encLen = chacha20_poly1305_encrypt((uint8_t*)&src[INDEX_PAYLOAD], key, iv, data_size, iv_size, &encryptedPayload);
+			break;
+#endif
+		default:
+			return -1;
+	}
+
+	if(encLen < 0){
+		return -1;
+	}
+
+	return 1;
+}
+
 int r_gooseMessage_Decrypt(uint8_t* buffer, uint8_t* key, uint8_t* iv, int iv_size){
 	int ptLen;
 
-	uint8_t* plaintextPayload = NULL;
+	// Payload is decrypted in place
+	uint8_t* plaintextPayload = &buffer[INDEX_PAYLOAD];
 
 	uint8_t alg = buffer[INDEX_ENCRYPTION_ALG];
 
 	int data_size;
 
+#if !R_GOOSE_WITH_ANY_ENCRYPTION
+	// No encryption algorithm compiled in, only ENC_NONE is handled
+	(void)ptLen; (void)plaintextPayload; (void)data_size;
+#endif
+
+#if R_GOOSE_WITH_AES_128_GCM
 	if(alg == 1){
 		// AES-128-GCM	
 		buffer[INDEX_ENCRYPTION_ALG] = 0x00;
 
 		data_size = decode_2bytesToInt(buffer,INDEX_APDU_LENGTH) - 2;
 		
-		ptLen = aes_256_gcm_decrypt(&buffer[INDEX_PAYLOAD], key, iv, data_size, iv_size, &plaintextPayload);
-		
-		memcpy(&buffer[INDEX_PAYLOAD], plaintextPayload, ptLen);
+		ptLen = aes_128_gcm_decrypt(&buffer[INDEX_PAYLOAD], key, iv, data_size, iv_size, &plaintextPayload);
+		if(ptLen < 0){
+			return -1;
+		}
 
-		free(plaintextPayload);
-		
 		return 1;
 
-	}else if(alg == 2){
+	}
+#endif
+#if R_GOOSE_WITH_AES_256_GCM
+	if(alg == 2){
 		// AES-256-GCM
 		buffer[INDEX_ENCRYPTION_ALG] = 0x00;
 		data_size = decode_2bytesToInt(buffer,INDEX_APDU_LENGTH) - 2;
 		
 		ptLen = aes_256_gcm_decrypt(&buffer[INDEX_PAYLOAD], key, iv, data_size, iv_size, &plaintextPayload);
-		
-		memcpy(&buffer[INDEX_PAYLOAD], plaintextPayload, ptLen);
+		if(ptLen < 0){
+			return -1;
+		}
 
-		free(plaintextPayload);
+		return 1;
+
+	}
+#endif
+#if R_GOOSE_WITH_CHACHA20_POLY1305
+	if(alg == 3){
+		// ChaCha20-Poly1305
+		buffer[INDEX_ENCRYPTION_ALG] = 0x00;
+		data_size = decode_2bytesToInt(buffer,INDEX_APDU_LENGTH) - 2;
 		
+		ptLen = chacha20_poly1305_decrypt(&buffer[INDEX_PAYLOAD], key, iv, data_size, iv_size, &plaintextPayload);
+		if(ptLen < 0){
+			return -1;
+		}
+
 		return 1;
 
-	}else if(alg == 0){
+	}
+#endif
+
+	if(alg == 0){
 		// Default - None Encryption
 		return 0;
 	}
@@ -45,9 +45,13 @@
  
 #include "hmac_functions.h"
 #include "gmac_functions.h"
+#include "blake2_functions.h"
 #include "aes_crypto.h"
+#include "chacha_crypto.h"
 
 #include "aux_funcs.h"
+#include "r_goose_alloc.h"
+#include "r_goose_config.h"
 
 
 // Analisar de mudar 1 -> 0x01 tem impacto na performance
@@ -65,11 +69,20 @@
 #define GMAC_AES128_64 		8
 #define GMAC_AES128_128 	9
 
+#define BLAKE2B_KEYED_80 	10
+#define BLAKE2S_KEYED_80 	11
+
+#define CHACHA20_POLY1305_128 	12
+
+#define HMAC_SHA512_256_80 	13
+#define HMAC_SHA512_256_128 	14
+
 
 // Encryption Algorithms Defined Values
 #define ENC_NONE			0
 #define AES_128_GCM			1
 #define AES_256_GCM			2
+#define CHACHA20_POLY1305	3
 
 
 // R-GOOSE message field indexes
@@ -94,8 +107,16 @@
 #define INDEX_PAYLOAD				38		
 
 // Mapping between defined MAC Tag Algorithms and MAC Tag sizes
+#define MAC_SIZES_INIT				{0, 10, 16, 32, 8, 16, 10, 10, 8, 16, 10, 10, 16, 10, 16}
+
 extern const int MAC_SIZES[];
 
+// Number of defined MAC Tag Algorithms (entries of MAC_SIZES)
+#define MAC_ALGS_COUNT				15
+
+// Largest value in MAC_SIZES - size of the stack buffers used to hold a MAC Tag
+#define MAX_MAC_SIZE				32
+
 
 /**
  * @brief Function that generate and insert an HMAC Tag into an R-GOOSE message.
@@ -164,8 +185,10 @@ int r_gooseMessage_InsertHMAC(uint8_t* buffer, uint8_t* key, size_t key_size, in
  * @warning The packet format must be the same as specified on the top the this page.
  * @warning If an unknown @p alg is given (not specified on r_goose_security.h) the function returns -1, as an error. 
  * @note @p key and @p key_size must be defined according the specified algorithm @p alg. If AES128-GCM is used, then a 16 bytes
- * long key should be given, although, if AES256-GCM is used, a 32 bytes key should be given. 
- * @note For now, the Initialization Vector (IV) is constant and defined inside the function as all-zeros byte array.
+ * long key should be given, although, if AES256-GCM or ChaCha20-Poly1305 (CHACHA20_POLY1305_128) is used, a 32 bytes key should be given. 
+ * @note For now, the Initialization Vector (IV) of GMAC is constant and defined inside the function as all-zeros byte array.
+ * CHACHA20_POLY1305_128 uses a nonce derived from the key and the SPDU Number (poly1305_CHACHA20_nonce()), as a
+ * Poly1305 key must never authenticate two messages.
  */
 int r_gooseMessage_InsertGMAC(uint8_t* buffer, uint8_t* key, size_t key_size, int alg, uint8_t** dest);
 
@@ -210,6 +233,8 @@ int r_gooseMessage_InsertGMAC(uint8_t* buffer, uint8_t* key, size_t key_size, in
  * provided in the packet (message is invalid), 1 if the generated HMAC matches with the one provided (message is valid)
  * and 2 if the message doesn't contain the HMAC (not secured message)
  * @warning The packet format must be the same as specified on the top the this page.
+ * @warning The SPDU Length field is trusted. Messages received from the network should first be checked with
+ * r_gooseMessage_Prefilter() (r_goose_prefilter.h), against the received length.
  */
 int r_gooseMessage_ValidateHMAC(uint8_t* buffer, uint8_t* key, size_t key_size);
 
@@ -254,7 +279,11 @@ int r_gooseMessage_ValidateHMAC(uint8_t* buffer, uint8_t* key, size_t key_size);
  * provided in the packet (message is invalid), 1 if the generated GMAC matches with the one provided (message is valid)
  * and 2 if the message doesn't contain the GMAC (not secured message)
  * @warning The packet format must be the same as specified on the top the this page.
- * @note For now, the Initialization Vector (IV) is constant and defined inside the function as all-zeros byte array.
+ * @warning The SPDU Length field is trusted. Messages received from the network should first be checked with
+ * r_gooseMessage_Prefilter() (r_goose_prefilter.h), against the received length.
+ * @note For now, the Initialization Vector (IV) of GMAC is constant and defined inside the function as all-zeros byte array.
+ * CHACHA20_POLY1305_128 uses a nonce derived from the key and the SPDU Number (poly1305_CHACHA20_nonce()), as a
+ * Poly1305 key must never authenticate two messages.
  */
 int r_gooseMessage_ValidateGMAC(uint8_t* buffer, uint8_t* key, size_t key_size);
 
@@ -302,6 +331,50 @@ int r_gooseMessage_ValidateGMAC(uint8_t* buffer, uint8_t* key, size_t key_size);
  */
 int r_gooseMessage_Encrypt(uint8_t* buffer, uint8_t* key, int alg, uint32_t timeOfCurrentKey, uint16_t timeToNextKey, uint32_t key_id, uint8_t* iv, int iv_size);
 
+/**
+ * @brief Function that encrypts the GOOSE payload of an R-GOOSE message out of place, leaving the original message
+ * unchanged. 
+ * 
+ * Same result as r_gooseMessage_Encrypt() on a copy of @p src, but the header and trailer are copied to @p dest and
+ * the cipher reads the payload from @p src and writes the ciphertext to @p dest, so the message is traversed once and
+ * no copy of the plaintext is needed. A publisher keeps the plaintext message as a template and encrypts it again for
+ * each retransmission or group. The message in @p dest has no MAC Tag (see r_gooseMessage_InsertHMAC() and
+ * r_gooseMessage_InsertGMAC()).
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * uint8_t* plain = build_message();						// pseudo-function that writes an R-GOOSE message
+ * uint8_t out[1600];
+ *
+ * int res = r_gooseMessage_EncryptTo(plain, out, sizeof(out), key, AES_256_GCM, TimeOfCurrentKey, TimeToNextKey, KeyID, iv, iv_size);
+ * 
+ * if(res == 1){
+ *		printf("Encryption success\n");
+ * }else if(res == 0){
+ *		printf("Non Encryption success\n");
+ * }else{
+ *		printf("Error while encrypting\n");
+ * }
+ *
+ * @endcode
+ *
+ * @param src Pointer (<tt>const uint8_t*</tt>) containg the R-GOOSE message (left unchanged)
+ * @param dest Pointer (<tt>uint8_t*</tt>) to the buffer that receives the encrypted R-GOOSE message
+ * @param dest_size Variable (<tt>size_t</tt>) with the size of @p dest (message size at least)
+ * @param key Pointer (<tt>uint8_t*</tt>) containg the key that will be used to encrypt the GOOSE Payload
+ * @param alg Variable (<tt>int</tt>) contaning the reference to the encryption algorithm to be used (specified in r_goose_security.h) 
+ * @param timeOfCurrentKey Variable (<tt>uint32_t</tt>) contaning the value specifying the time value of the current key in use
+ * @param timeToNextKey Variable (<tt>uint16_t</tt>) contaning the value specifying the time in minutes to the next key
+ * @param key_id Variable (<tt>uint32_t</tt>) containing the ID of the key being used
+ * @param iv Pointer (<tt>uint8_t*</tt>) containg the Initialization Vector to be used in encryption
+ * @param iv_size Variable (<tt>size_t</tt>) that hold the size in bytes of IV. 
+ * @return The function returns -1 if an error occurred (unknown algorithm, @p dest too small), 0 if the encryption
+ * algorithm was set to None Encryption (the message is copied) and 1 if the GOOSE Payload was correctly encrypted. 
+ * @warning @p src and @p dest must not overlap; use r_gooseMessage_Encrypt() to encrypt in place.
+ */
+int r_gooseMessage_EncryptTo(const uint8_t* src, uint8_t* dest, size_t dest_size, uint8_t* key, int alg, uint32_t timeOfCurrentKey, uint16_t timeToNextKey, uint32_t key_id, uint8_t* iv, int iv_size);
+
 
 /**
  * @brief Function that decrypts the GOOSE payload of an R-GOOSE message. 
@@ -342,6 +415,77 @@ int r_gooseMessage_Encrypt(uint8_t* buffer, uint8_t* key, int alg, uint32_t time
 int r_gooseMessage_Decrypt(uint8_t* buffer, uint8_t* key, uint8_t* iv, int iv_size);
 
 
+/**
+ * @brief Key of one MAC algorithm with its prebuilt states (opaque, defined in r_goose_keyring.c).
+ *
+ * The states are those of a key ring entry: HMAC inner/outer hash states and keyed BLAKE2 states absorbed once, and
+ * the cipher context of GMAC/Poly1305 created and keyed once. So r_goose_mac_key_tag() allocates nothing.
+ */
+typedef struct r_goose_mac_key r_goose_mac_key;
+
+/**
+ * @brief Function that builds the states of a MAC key, with the allocator of the library (r_goose_alloc.h).
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * r_goose_mac_key* mk = r_goose_mac_key_new(GMAC_AES128_64, key, 16);
+ *
+ * int size = r_goose_mac_key_tag(mk, &buffer[2], messageSize - 4, &buffer[messageSize]);
+ *
+ * r_goose_mac_key_free(mk);
+ *
+ * @endcode
+ *
+ * @param alg Variable (<tt>int</tt>) with the MAC algorithm (MAC_NONE excluded)
+ * @param key Pointer (<tt>uint8_t*</tt>) containg the key
+ * @param key_size Variable (<tt>size_t</tt>) that hold the size in bytes of key (at most 64, at least the key size of the cipher for GMAC and Poly1305)
+ * @return A pointer to the MAC key, or NULL (algorithm unknown or not compiled in, key size, allocation failure).
+ */
+r_goose_mac_key* r_goose_mac_key_new(int alg, const uint8_t* key, size_t key_size);
+
+/**
+ * @brief Function that wipes and releases a MAC key (NULL is ignored).
+ *
+ * @param mk Pointer (<tt>r_goose_mac_key*</tt>) to the MAC key
+ * @return The function doesn't return any value
+ */
+void r_goose_mac_key_free(r_goose_mac_key* mk);
+
+/**
+ * @brief Function that generates the MAC Tag of @p data with a MAC key, as hmac_*(), blake2*_80(), gmac_*() and
+ * poly1305_CHACHA20_128() do (the nonce of Poly1305 is derived from the SPDU Number in @p data).
+ *
+ * @param mk Pointer (<tt>r_goose_mac_key*</tt>) to the MAC key
+ * @param data Pointer (<tt>uint8_t*</tt>) containg the data covered by the MAC Tag (from the third byte of the message)
+ * @param data_size Variable (<tt>size_t</tt>) that hold the size in bytes of data
+ * @param dest Pointer (<tt>uint8_t*</tt>) to a buffer with at least MAC_SIZES[alg] bytes
+ * @return The function returns the size of the MAC Tag, or -1 if an error occurred.
+ * @warning A MAC key holds a cipher context: it is used by one thread at a time.
+ */
+int r_goose_mac_key_tag(r_goose_mac_key* mk, uint8_t* data, size_t data_size, uint8_t* dest);
+
+/**
+ * @brief Functions that generate the MAC Tag of @p data as r_goose_mac_key_tag() does, for the algorithms of one family
+ * only (HMAC of one hash function, keyed BLAKE2b/BLAKE2s, GMAC, Poly1305), with no dispatch on the algorithm. Used by
+ * the C++ interface (r_goose_security.hpp), which picks the function of its algorithm at compile time.
+ *
+ * @param mk Pointer (<tt>r_goose_mac_key*</tt>) to the MAC key
+ * @param data Pointer (<tt>uint8_t*</tt>) containg the data covered by the MAC Tag (from the third byte of the message)
+ * @param data_size Variable (<tt>size_t</tt>) that hold the size in bytes of data
+ * @param dest Pointer (<tt>uint8_t*</tt>) to a buffer with at least MAC_SIZES[alg] bytes
+ * @return The function returns the size of the MAC Tag, or -1 if an error occurred (including a key of another family).
+ */
+int r_goose_mac_key_tag_hmac_sha256(r_goose_mac_key* mk, const uint8_t* data, size_t data_size, uint8_t* dest);
+int r_goose_mac_key_tag_hmac_sha512_256(r_goose_mac_key* mk, const uint8_t* data, size_t data_size, uint8_t* dest);
+int r_goose_mac_key_tag_hmac_blake2b(r_goose_mac_key* mk, const uint8_t* data, size_t data_size, uint8_t* dest);
+int r_goose_mac_key_tag_hmac_blake2s(r_goose_mac_key* mk, const uint8_t* data, size_t data_size, uint8_t* dest);
+int r_goose_mac_key_tag_blake2b_keyed(r_goose_mac_key* mk, const uint8_t* data, size_t data_size, uint8_t* dest);
+int r_goose_mac_key_tag_blake2s_keyed(r_goose_mac_key* mk, const uint8_t* data, size_t data_size, uint8_t* dest);
+int r_goose_mac_key_tag_gmac(r_goose_mac_key* mk, const uint8_t* data, size_t data_size, uint8_t* dest);
+int r_goose_mac_key_tag_poly1305(r_goose_mac_key* mk, const uint8_t* data, size_t data_size, uint8_t* dest);
+
+
 
 /**
  * @brief Function that dissects and prints the R-GOOSE message. 
@@ -0,0 +1,414 @@
+/**
+ * @file r_goose_security.hpp
+ * @author Eduardo Andrade
+ * @date Mar 2020
+ * @brief File containing the header-only C++ (C++20) interface of the MAC Tag functions of r_goose_security.h.
+ *
+ * The MAC algorithm is a template parameter: the tag size of Signer<HMAC_SHA256_80> and Verifier<GMAC_AES128_64> is a
+ * constant expression taken from MAC_SIZES_INIT, and an algorithm unknown or not compiled in (r_goose_config.h) does
+ * not compile. A Signer produces the same message as r_gooseMessage_InsertHMAC()/r_gooseMessage_InsertGMAC(), but in
+ * place, in storage given by the caller.
+ *
+ * Key owns the prebuilt states of its algorithm (r_goose_mac_key: HMAC hash states, keyed BLAKE2 state, GMAC/Poly1305
+ * cipher context), built once by its constructor and wiped and released by its destructor, so neither signing nor
+ * verification allocates. A Signer or Verifier reuses the cipher context of its Key: it is used by one thread at a
+ * time. Key, Signer, Verifier and Buffer are move-only.
+ * Errors are return codes, as in the C functions (-1 error, 0 invalid, 1 valid), and nothing throws.
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * r_goose::Signer<HMAC_SHA256_80> signer{r_goose::Key<HMAC_SHA256_80>{key}};		// key: std::span<const uint8_t>
+ * r_goose::Verifier<HMAC_SHA256_80> verifier{r_goose::Key<HMAC_SHA256_80>{key}};
+ *
+ * r_goose::Buffer buffer(1500 + decltype(signer)::tag_size);
+ * buffer.assign(message);															// R-GOOSE message, without MAC Tag
+ * signer.sign(buffer);																// buffer.message(): message with MAC Tag
+ *
+ * int res = verifier.verify(buffer.message());										// 1 valid, 0 invalid, -1 error
+ *
+ * @endcode
+ * @warning Every file of the library must be built as C (the header includes the C headers with C linkage), and
+ * r_goose_keyring.c (r_goose_mac_key) must be linked.
+ */
+
+#ifndef R_GOOSE_SECURITY_HPP
+#define R_GOOSE_SECURITY_HPP
+
+#if __cplusplus < 202002L
+#error "r_goose_security.hpp requires C++20 (std::span)"
+#endif
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+extern "C" {
+#include "r_goose_security.h"
+#include <openssl/crypto.h>
+}
+
+
+namespace r_goose {
+
+/**
+ * @brief MAC Tag sizes, indexed by the MAC algorithm constants (same values as MAC_SIZES).
+ */
+inline constexpr int mac_sizes[MAC_ALGS_COUNT] = MAC_SIZES_INIT;
+
+/**
+ * @brief Size of the key buffer of Key (the largest key of the HMAC and BLAKE2 algorithms).
+ */
+inline constexpr std::size_t max_key_size = 64;
+
+
+namespace detail {
+
+// Key sizes accepted by each algorithm compiled in
+template<int Alg> struct key_sizes;
+
+inline std::uint32_t read_u32(const std::uint8_t* p) noexcept {
+	return (std::uint32_t)p[0] << 24 | (std::uint32_t)p[1] << 16 | (std::uint32_t)p[2] << 8 | p[3];
+}
+
+#define R_GOOSE_KEY_SIZES(alg, min_key, max_key)															\
+	template<> struct key_sizes<alg> {																		\
+		static constexpr std::size_t min = min_key;															\
+		static constexpr std::size_t max = max_key;															\
+	};
+
+#if R_GOOSE_WITH_HMAC_SHA256_80
+R_GOOSE_KEY_SIZES(HMAC_SHA256_80, 1, max_key_size)
+#endif
+#if R_GOOSE_WITH_HMAC_SHA256_128
+R_GOOSE_KEY_SIZES(HMAC_SHA256_128, 1, max_key_size)
+#endif
+#if R_GOOSE_WITH_HMAC_SHA256_256
+R_GOOSE_KEY_SIZES(HMAC_SHA256_256, 1, max_key_size)
+#endif
+#if R_GOOSE_WITH_HMAC_SHA512_256_80
+R_GOOSE_KEY_SIZES(HMAC_SHA512_256_80, 1, max_key_size)
+#endif
+#if R_GOOSE_WITH_HMAC_SHA512_256_128
+R_GOOSE_KEY_SIZES(HMAC_SHA512_256_128, 1, max_key_size)
+#endif
+#if R_GOOSE_WITH_HMAC_BLAKE2B_80
+R_GOOSE_KEY_SIZES(HMAC_BLAKE2B_80, 1, max_key_size)
+#endif
+#if R_GOOSE_WITH_HMAC_BLAKE2S_80
+R_GOOSE_KEY_SIZES(HMAC_BLAKE2S_80, 1, max_key_size)
+#endif
+#if R_GOOSE_WITH_BLAKE2B_KEYED_80
+R_GOOSE_KEY_SIZES(BLAKE2B_KEYED_80, 1, 64)
+#endif
+#if R_GOOSE_WITH_BLAKE2S_KEYED_80
+R_GOOSE_KEY_SIZES(BLAKE2S_KEYED_80, 1, 32)
+#endif
+#if R_GOOSE_WITH_GMAC_AES256_64
+R_GOOSE_KEY_SIZES(GMAC_AES256_64, 32, 32)
+#endif
+#if R_GOOSE_WITH_GMAC_AES256_128
+R_GOOSE_KEY_SIZES(GMAC_AES256_128, 32, 32)
+#endif
+#if R_GOOSE_WITH_GMAC_AES128_64
+R_GOOSE_KEY_SIZES(GMAC_AES128_64, 16, 16)
+#endif
+#if R_GOOSE_WITH_GMAC_AES128_128
+R_GOOSE_KEY_SIZES(GMAC_AES128_128, 16, 16)
+#endif
+#if R_GOOSE_WITH_CHACHA20_POLY1305_128
+R_GOOSE_KEY_SIZES(CHACHA20_POLY1305_128, 32, 32)
+#endif
+
+#undef R_GOOSE_KEY_SIZES
+
+// MAC Tag function of the family of Alg, chosen at compile time
+template<int Alg>
+inline int mac_key_tag(r_goose_mac_key* mk, const std::uint8_t* data, std::size_t data_size, std::uint8_t* dest) noexcept {
+	if constexpr(Alg == HMAC_SHA256_80 || Alg == HMAC_SHA256_128 || Alg == HMAC_SHA256_256){
+		return r_goose_mac_key_tag_hmac_sha256(mk, data, data_size, dest);
+	}else if constexpr(Alg == HMAC_SHA512_256_80 || Alg == HMAC_SHA512_256_128){
+		return r_goose_mac_key_tag_hmac_sha512_256(mk, data, data_size, dest);
+	}else if constexpr(Alg == HMAC_BLAKE2B_80){
+		return r_goose_mac_key_tag_hmac_blake2b(mk, data, data_size, dest);
+	}else if constexpr(Alg == HMAC_BLAKE2S_80){
+		return r_goose_mac_key_tag_hmac_blake2s(mk, data, data_size, dest);
+	}else if constexpr(Alg == BLAKE2B_KEYED_80){
+		return r_goose_mac_key_tag_blake2b_keyed(mk, data, data_size, dest);
+	}else if constexpr(Alg == BLAKE2S_KEYED_80){
+		return r_goose_mac_key_tag_blake2s_keyed(mk, data, data_size, dest);
+	}else if constexpr(Alg == CHACHA20_POLY1305_128){
+		return r_goose_mac_key_tag_poly1305(mk, data, data_size, dest);
+	}else{
+		return r_goose_mac_key_tag_gmac(mk, data, data_size, dest);
+	}
+}
+
+} // namespace detail
+
+
+/**
+ * @brief Key of the MAC algorithm @p Alg with its prebuilt states (r_goose_mac_key), move-only.
+ *
+ * The constructor builds the states once (HMAC inner/outer hash states, keyed BLAKE2 state, GMAC/Poly1305 cipher
+ * context keyed), with the allocator of the library; the destructor wipes and releases them. A key of a size the
+ * algorithm does not accept (16 bytes for GMAC-AES128, 32 for GMAC-AES256 and Poly1305, 1 to 64 for HMAC and BLAKE2b,
+ * 1 to 32 for BLAKE2s), or whose states could not be built, gives an invalid Key, refused by Signer and Verifier.
+ */
+template<int Alg>
+class Key {
+	static_assert(Alg != MAC_NONE, "MAC_NONE has no MAC Tag");
+	static_assert(R_GOOSE_MAC_ENABLED(Alg), "MAC algorithm unknown or not compiled in (r_goose_config.h)");
+
+public:
+	static constexpr int algorithm = Alg;
+	static constexpr std::size_t min_size = detail::key_sizes<Alg>::min;
+	static constexpr std::size_t max_size = detail::key_sizes<Alg>::max;
+
+	Key() noexcept = default;
+
+	explicit Key(std::span<const std::uint8_t> key) noexcept {
+		if(key.size() >= min_size && key.size() <= max_size){
+			state_ = r_goose_mac_key_new(Alg, key.data(), key.size());
+			size_ = state_ != nullptr ? key.size() : 0;
+		}
+	}
+
+	Key(const Key&) = delete;
+	Key& operator=(const Key&) = delete;
+
+	Key(Key&& other) noexcept : state_(other.state_), size_(other.size_) {
+		other.state_ = nullptr;
+		other.size_ = 0;
+	}
+
+	Key& operator=(Key&& other) noexcept {
+		if(this != &other){
+			r_goose_mac_key_free(state_);
+			state_ = other.state_;
+			size_ = other.size_;
+			other.state_ = nullptr;
+			other.size_ = 0;
+		}
+		return *this;
+	}
+
+	~Key(){
+		r_goose_mac_key_free(state_);
+	}
+
+	bool valid() const noexcept { return state_ != nullptr; }
+	std::size_t size() const noexcept { return size_; }
+
+	// MAC Tag of data (from the third byte of the message): its size, or -1. The function of the MAC family is
+	// chosen at compile time, and the cipher context is reused in place.
+	int tag(const std::uint8_t* data, std::size_t data_size, std::uint8_t* dest) const noexcept {
+		return detail::mac_key_tag<Alg>(state_, data, data_size, dest);
+	}
+
+private:
+	r_goose_mac_key* state_ = nullptr;
+	std::size_t size_ = 0;
+};
+
+
+/**
+ * @brief Move-only storage for one R-GOOSE message, allocated with the allocator of the library (r_goose_alloc.h).
+ *
+ * The capacity is fixed at construction. message() is the message held, whose size is kept by assign() and
+ * Signer::sign().
+ */
+class Buffer {
+public:
+	Buffer() noexcept = default;
+
+	explicit Buffer(std::size_t capacity) noexcept
+		: data_(static_cast<std::uint8_t*>(r_goose_malloc(capacity))), capacity_(data_ != nullptr ? capacity : 0) {}
+
+	Buffer(const Buffer&) = delete;
+	Buffer& operator=(const Buffer&) = delete;
+
+	Buffer(Buffer&& other) noexcept : data_(other.data_), size_(other.size_), capacity_(other.capacity_) {
+		other.data_ = nullptr;
+		other.size_ = other.capacity_ = 0;
+	}
+
+	Buffer& operator=(Buffer&& other) noexcept {
+		if(this != &other){
+			r_goose_free(data_);
+			data_ = other.data_;
+			size_ = other.size_;
+			capacity_ = other.capacity_;
+			other.data_ = nullptr;
+			other.size_ = other.capacity_ = 0;
+		}
+		return *this;
+	}
+
+	~Buffer(){
+		r_goose_free(data_);
+	}
+
+	// Copies a message into the buffer, false if it does not fit
+	bool assign(std::span<const std::uint8_t> message) noexcept {
+		if(message.size() > capacity_){
+			return false;
+		}
+		if(!message.empty()){
+			std::memcpy(data_, message.data(), message.size());
+		}
+		size_ = message.size();
+		return true;
+	}
+
+	// Sets the size of the message held, false if larger than the capacity
+	bool resize(std::size_t size) noexcept {
+		if(size > capacity_){
+			return false;
+		}
+		size_ = size;
+		return true;
+	}
+
+	std::uint8_t* data() noexcept { return data_; }
+	std::size_t size() const noexcept { return size_; }
+	std::size_t capacity() const noexcept { return capacity_; }
+
+	std::span<std::uint8_t> message() noexcept { return {data_, size_}; }
+	std::span<const std::uint8_t> message() const noexcept { return {data_, size_}; }
+	std::span<std::uint8_t> storage() noexcept { return {data_, capacity_}; }
+
+private:
+	std::uint8_t* data_ = nullptr;
+	std::size_t size_ = 0;
+	std::size_t capacity_ = 0;
+};
+
+
+/**
+ * @brief Generates and inserts the MAC Tag of algorithm @p Alg into R-GOOSE messages, in place.
+ *
+ * The message is updated as by r_gooseMessage_InsertHMAC()/r_gooseMessage_InsertGMAC(): Security Information set to
+ * zero (but the MAC Algorithm), SPDU Length, Signature Length and MAC Tag.
+ */
+template<int Alg>
+class Signer {
+public:
+	static constexpr int algorithm = Alg;
+	static constexpr std::size_t tag_size = (std::size_t)mac_sizes[Alg];
+
+	explicit Signer(Key<Alg> key) noexcept : key_(std::move(key)) {}
+
+	Signer(Signer&&) noexcept = default;
+	Signer& operator=(Signer&&) noexcept = default;
+
+	/**
+	 * @brief Function that signs the message at the start of @p storage (without MAC Tag, its size read from the SPDU
+	 * Length), appending the MAC Tag after it.
+	 *
+	 * @param storage Span (<tt>std::span<uint8_t></tt>) with the message and the room for the MAC Tag
+	 * @return The function returns the size of the signed message, or -1 (invalid key, message shorter than its header
+	 * or longer than @p storage, no room for the MAC Tag, MAC error). The message is left unchanged on error: the header
+	 * fields written before the MAC (SPDU Length, Security Information, Signature Length) are restored if it fails.
+	 */
+	int sign(std::span<std::uint8_t> storage) const noexcept {
+		std::uint8_t* tmp = storage.data();
+
+		if(!key_.valid() || storage.size() < INDEX_PAYLOAD){
+			return -1;
+		}
+		std::size_t messageSize = (std::size_t)detail::read_u32(&tmp[INDEX_SPDU_LENGTH]) + 10;
+		std::size_t new_size = messageSize + tag_size;
+		if(messageSize < INDEX_PAYLOAD || new_size > storage.size()){
+			return -1;
+		}
+
+		// Fields changed below (SPDU Length, Security Information, Signature Length), restored if the MAC fails
+		std::array<std::uint8_t, 4> spdu_length;
+		std::array<std::uint8_t, INDEX_LENGTH - INDEX_SECURITY_INFO> security_info;
+		std::uint8_t signature_length = tmp[messageSize - 1];
+		std::memcpy(spdu_length.data(), &tmp[INDEX_SPDU_LENGTH], spdu_length.size());
+		std::memcpy(security_info.data(), &tmp[INDEX_SECURITY_INFO], security_info.size());
+
+		// Mutable fields, as in r_gooseMessage_InsertHMAC()
+		std::memset(&tmp[INDEX_SECURITY_INFO], 0, INDEX_LENGTH - INDEX_SECURITY_INFO);
+		tmp[INDEX_MAC_ALG] = (std::uint8_t)Alg;
+		encodeInt4Bytes(tmp, (std::uint32_t)(new_size - 10), INDEX_SPDU_LENGTH);
+		tmp[messageSize - 1] = (std::uint8_t)tag_size;
+
+		if(key_.tag(&tmp[2], messageSize - 4, &tmp[messageSize]) != (int)tag_size){
+			std::memcpy(&tmp[INDEX_SPDU_LENGTH], spdu_length.data(), spdu_length.size());
+			std::memcpy(&tmp[INDEX_SECURITY_INFO], security_info.data(), security_info.size());
+			tmp[messageSize - 1] = signature_length;
+			return -1;
+		}
+		return (int)new_size;
+	}
+
+	/**
+	 * @brief Function that signs the message held by @p buffer, updating its size.
+	 *
+	 * @param buffer Reference (<tt>Buffer&</tt>) to the buffer
+	 * @return The function returns the size of the signed message, or -1 (see the other overload).
+	 */
+	int sign(Buffer& buffer) const noexcept {
+		int size = sign(buffer.storage());
+		if(size > 0){
+			buffer.resize((std::size_t)size);
+		}
+		return size;
+	}
+
+private:
+	Key<Alg> key_;
+};
+
+
+/**
+ * @brief Validates the MAC Tag of algorithm @p Alg of R-GOOSE messages.
+ */
+template<int Alg>
+class Verifier {
+public:
+	static constexpr int algorithm = Alg;
+	static constexpr std::size_t tag_size = (std::size_t)mac_sizes[Alg];
+
+	explicit Verifier(Key<Alg> key) noexcept : key_(std::move(key)) {}
+
+	Verifier(Verifier&&) noexcept = default;
+	Verifier& operator=(Verifier&&) noexcept = default;
+
+	/**
+	 * @brief Function that validates the MAC Tag of @p message (the MAC Tag comparison takes constant time).
+	 *
+	 * @param message Span (<tt>std::span<const uint8_t></tt>) with the message, at least its SPDU Length + 10 bytes
+	 * @return The function returns 1 if valid, 0 if invalid, or -1 (invalid key, MAC Algorithm of the message other
+	 * than @p Alg, SPDU Length out of @p message, MAC error).
+	 */
+	int verify(std::span<const std::uint8_t> message) const noexcept {
+		std::uint8_t aux[MAX_MAC_SIZE];
+		const std::uint8_t* buffer = message.data();
+
+		if(!key_.valid() || message.size() < INDEX_PAYLOAD || buffer[INDEX_MAC_ALG] != Alg){
+			return -1;
+		}
+		std::size_t messageSize = (std::size_t)detail::read_u32(&buffer[INDEX_SPDU_LENGTH]) + 10;
+		if(messageSize > message.size() || messageSize < INDEX_PAYLOAD + tag_size){
+			return -1;
+		}
+
+		if(key_.tag(&buffer[2], messageSize - 4 - tag_size, aux) != (int)tag_size){
+			return -1;
+		}
+		return CRYPTO_memcmp(aux, &buffer[messageSize - tag_size], tag_size) == 0 ? 1 : 0;
+	}
+
+private:
+	Key<Alg> key_;
+};
+
+} // namespace r_goose
+
+#endif
@@ -0,0 +1,380 @@
+/*
+	File defining the R-GOOSE session table (Custom/Off-Standard)
+
+	Table:
+		Open addressing (linear probing) array of 32 byte entries, 64 byte aligned (two entries
+		per cache line), at most half full. The stream identifier (source << 16 | APPID) + 1 is
+		stored in the entry, 0 marks an empty entry. Entries are removed with backward shift
+		deletion, so there are no tombstones and probe sequences stay short.
+
+	Window:
+		bit i of the bitmap is set when SPDU Number (highest - i) was accepted. Distances are
+		computed modulo 2^32 (serial number arithmetic). An empty bitmap means the stream was
+		added by a failure and has no SPDU Number yet.
+
+	Admission:
+		tokens are refilled lazily, rate * (now - last_seen), whenever the stream is touched
+		(admit, accept, fail), so last_seen is both the idle clock of expire() and the refill
+		clock of the bucket.
+
+	Eviction:
+		entries added by failures only (empty bitmap) are counted. When the table is full, a
+		stream whose message was authenticated takes the place of one of them (found from a
+		rotating cursor), so forged packets from many spoofed sources can't lock out new
+		streams. Failures never evict: unknown streams that fail on a full table are not
+		tracked.
+*/
+
+#include "r_goose_session.h"
+
+
+#define SESSION_FRESH		1
+#define SESSION_REPLAY		0
+#define SESSION_STALE		-2
+
+
+static inline uint64_t session_id(uint32_t source, uint16_t appid){
+	return (((uint64_t)source << 16) | appid) + 1;
+}
+
+static inline size_t session_home(r_goose_session_table* table, uint64_t id){
+	uint64_t h = id;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return (size_t)h & (table->capacity - 1);
+}
+
+// Returns the entry of stream id, or NULL (*slot set to the empty entry where it would be inserted)
+static inline r_goose_session* session_find(r_goose_session_table* table, uint64_t id, r_goose_session** slot){
+	size_t mask = table->capacity - 1;
+	size_t idx = session_home(table, id);
+
+	while(1){
+		r_goose_session* s = &table->entries[idx];
+		if(s->id == id){
+			return s;
+		}
+		if(s->id == 0){
+			*slot = s;
+			return NULL;
+		}
+		idx = (idx + 1) & mask;
+	}
+}
+
+static inline int window_test(const r_goose_session* s, uint32_t spdu_number){
+	if(s->window == 0 || (int32_t)(spdu_number - s->highest) > 0){
+		return SESSION_FRESH;
+	}
+
+	uint32_t back = s->highest - spdu_number;
+	if(back >= R_GOOSE_REPLAY_WINDOW){
+		return SESSION_STALE;
+	}
+
+	return ((s->window >> back) & 1) ? SESSION_REPLAY : SESSION_FRESH;
+}
+
+static inline void session_refill(r_goose_session_table* table, r_goose_session* s, uint32_t now){
+	int32_t elapsed = (int32_t)(now - s->last_seen);
+
+	if(elapsed > 0){
+		uint64_t tokens = s->tokens + (uint64_t)elapsed * table->rate;
+		s->tokens = (uint16_t)(tokens > table->burst ? table->burst : tokens);
+		s->last_seen = now;
+	}
+}
+
+static inline int session_blocked(const r_goose_session* s, uint32_t now){
+	return (int32_t)(s->quarantine_until - now) > 0 || s->tokens == 0;
+}
+
+static inline void session_init(r_goose_session_table* table, r_goose_session* slot, uint64_t id, uint32_t now){
+	slot->id = id;
+	slot->window = 0;
+	slot->highest = 0;
+	slot->last_seen = now;
+	slot->quarantine_until = now;
+	slot->tokens = (uint16_t)table->burst;
+	table->count++;
+	table->failure_only++;
+	table->stats.new_streams++;
+}
+
+static void session_remove(r_goose_session_table* table, size_t i){
+	size_t mask = table->capacity - 1;
+	size_t j = i;
+
+	if(table->entries[i].window == 0){
+		table->failure_only--;
+	}
+
+	while(1){
+		j = (j + 1) & mask;
+		if(table->entries[j].id == 0){
+			break;
+		}
+		// Entry j stays if its home position is cyclically in (i, j]
+		size_t k = session_home(table, table->entries[j].id);
+		if(i <= j ? (i < k && k <= j) : (i < k || k <= j)){
+			continue;
+		}
+		table->entries[i] = table->entries[j];
+		i = j;
+	}
+
+	memset(&table->entries[i], 0, sizeof(r_goose_session));
+	table->count--;
+}
+
+// Removes one entry that has no SPDU Number accepted (added by failures). Returns 0 if there is none.
+static int session_evict(r_goose_session_table* table){
+	size_t mask = table->capacity - 1;
+
+	if(table->failure_only == 0){
+		return 0;
+	}
+
+	while(1){
+		size_t i = table->evict_cursor;
+		table->evict_cursor = (i + 1) & mask;
+
+		if(table->entries[i].id != 0 && table->entries[i].window == 0){
+			session_remove(table, i);
+			table->stats.evicted++;
+			return 1;
+		}
+	}
+}
+
+
+r_goose_session_table* r_goose_session_table_new(size_t max_streams){
+	size_t capacity = 16;
+
+	if(max_streams == 0){
+		return NULL;
+	}
+	while(capacity < 2 * max_streams){
+		capacity <<= 1;
+	}
+
+	r_goose_session_table* table = (r_goose_session_table*)r_goose_calloc(1, sizeof(r_goose_session_table));
+	if(table == NULL){
+		return NULL;
+	}
+
+	table->entries = (r_goose_session*)r_goose_aligned_alloc(64, capacity * sizeof(r_goose_session));
+	if(table->entries == NULL){
+		r_goose_free(table);
+		return NULL;
+	}
+	memset(table->entries, 0, capacity * sizeof(r_goose_session));
+
+	table->capacity = capacity;
+	table->max_streams = max_streams;
+
+	return table;
+}
+
+void r_goose_session_table_free(r_goose_session_table* table){
+	if(table == NULL){
+		return;
+	}
+	r_goose_free(table->entries);
+	r_goose_free(table);
+}
+
+
+int r_goose_session_check(r_goose_session_table* table, uint32_t source, uint16_t appid, uint32_t spdu_number){
+	r_goose_session* slot;
+	r_goose_session* s = session_find(table, session_id(source, appid), &slot);
+
+	if(s == NULL){
+		if(table->count >= table->max_streams && table->failure_only == 0){
+			table->stats.table_full++;
+			return -1;
+		}
+		return 1;
+	}
+
+	switch(window_test(s, spdu_number)){
+		case SESSION_FRESH:
+			return 1;
+		case SESSION_REPLAY:
+			table->stats.replayed++;
+			return 0;
+		default:
+			table->stats.stale++;
+			return 0;
+	}
+}
+
+int r_goose_session_accept(r_goose_session_table* table, uint32_t source, uint16_t appid, uint32_t spdu_number, uint32_t now){
+	r_goose_session* slot;
+	uint64_t id = session_id(source, appid);
+	r_goose_session* s = session_find(table, id, &slot);
+
+	if(s == NULL){
+		if(table->count >= table->max_streams){
+			if(!session_evict(table)){
+				table->stats.table_full++;
+				return -1;
+			}
+			// The removal may have moved entries
+			session_find(table, id, &slot);
+		}
+		session_init(table, slot, id, now);
+		s = slot;
+	}
+
+	if(window_test(s, spdu_number) != SESSION_FRESH){
+		return 0;
+	}
+
+	uint32_t shift = spdu_number - s->highest;
+	if(s->window == 0){
+		table->failure_only--;
+		s->window = 1;
+		s->highest = spdu_number;
+	}else if((int32_t)shift > 0){
+		s->window = shift >= R_GOOSE_REPLAY_WINDOW ? 1 : (s->window << shift) | 1;
+		s->highest = spdu_number;
+	}else{
+		s->window |= (uint64_t)1 << (s->highest - spdu_number);
+	}
+	session_refill(table, s, now);
+	table->stats.accepted++;
+
+	return 1;
+}
+
+int r_goose_session_set_admission(r_goose_session_table* table, uint32_t burst, uint32_t rate, uint32_t quarantine){
+	if(burst > R_GOOSE_ADMISSION_MAX_BURST){
+		return -1;
+	}
+
+	table->burst = burst;
+	table->rate = rate;
+	table->quarantine = quarantine;
+
+	// Streams already tracked start with a full bucket
+	for(size_t i = 0; i < table->capacity; i++){
+		table->entries[i].tokens = (uint16_t)burst;
+	}
+
+	return 1;
+}
+
+int r_goose_session_admit(r_goose_session_table* table, uint32_t source, uint16_t appid, uint32_t now){
+	r_goose_session* slot;
+
+	if(table->burst == 0){
+		return 1;
+	}
+
+	r_goose_session* s = session_find(table, session_id(source, appid), &slot);
+	if(s == NULL){
+		return 1;
+	}
+
+	session_refill(table, s, now);
+	if((int32_t)(s->quarantine_until - now) > 0){
+		table->stats.quarantined++;
+		return 0;
+	}
+	if(s->tokens == 0){
+		table->stats.throttled++;
+		return 0;
+	}
+
+	return 1;
+}
+
+int r_goose_session_fail(r_goose_session_table* table, uint32_t source, uint16_t appid, uint32_t now){
+	r_goose_session* slot;
+	uint64_t id = session_id(source, appid);
+
+	table->stats.failures++;
+	if(table->burst == 0){
+		return -1;
+	}
+
+	r_goose_session* s = session_find(table, id, &slot);
+	if(s == NULL){
+		if(table->count >= table->max_streams){
+			table->stats.table_full++;
+			return -1;
+		}
+		session_init(table, slot, id, now);
+		s = slot;
+	}else{
+		session_refill(table, s, now);
+	}
+
+	if(s->tokens > 0){
+		s->tokens--;
+		if(s->tokens == 0 && table->quarantine > 0){
+			s->quarantine_until = now + table->quarantine;
+			table->stats.quarantines++;
+		}
+	}
+
+	return session_blocked(s, now) ? 0 : 1;
+}
+
+size_t r_goose_session_expire(r_goose_session_table* table, uint32_t now, uint32_t idle){
+	size_t removed = 0;
+
+	for(size_t i = 0; i < table->capacity; i++){
+		// Backward shift may move another expired entry into i, so i is checked again
+		while(table->entries[i].id != 0 && now - table->entries[i].last_seen >= idle){
+			session_remove(table, i);
+			removed++;
+		}
+	}
+
+	table->stats.expired_streams += removed;
+	return removed;
+}
+
+size_t r_goose_session_get_stats(r_goose_session_table* table, r_goose_session_stats* stats){
+	*stats = table->stats;
+	return table->count;
+}
+
+
+int r_gooseMessage_ValidateSession(uint8_t* buffer, size_t len, r_goose_session_table* table, uint32_t source,
+								   r_goose_keyring* ring, int reader, uint32_t now){
+
+	// Header fields are read before the MAC Tag verification
+	if(len < INDEX_PAYLOAD){
+		return -1;
+	}
+
+	uint16_t appid = decode_2bytesToInt(buffer, INDEX_APPID);
+	uint32_t spdu_number = decode_4bytesToInt(buffer, INDEX_SPDU_NUMBER);
+	int res;
+
+	// Throttled stream, replay/stale - rejected before any cryptographic operation
+	if(r_goose_session_admit(table, source, appid, now) == 0){
+		return R_GOOSE_THROTTLED;
+	}
+
+	res = r_goose_session_check(table, source, appid, spdu_number);
+	if(res == 0){
+		return R_GOOSE_REPLAY;
+	}
+	if(res < 0){
+		return -1;
+	}
+
+	res = r_gooseMessage_ValidateKeyring(buffer, len, ring, reader);
+	if(res == 1){
+		r_goose_session_accept(table, source, appid, spdu_number, now);
+	}else if(res == 0){
+		r_goose_session_fail(table, source, appid, now);
+	}
+
+	return res;
+}
@@ -0,0 +1,261 @@
+/**
+ * @file r_goose_session.h
+ * @author Eduardo Andrade
+ * @date Mar 2020
+ * @brief File containing the declarations of the R-GOOSE session table: per stream tracking of the SPDU Number
+ * (INDEX_SPDU_NUMBER) with a sliding replay window.
+ *
+ * Each stream is identified by (source, APPID), where source is any 32-bit identifier of the publisher chosen by
+ * the application (e.g. IPv4 source address). The table keeps, per stream, the highest SPDU Number accepted and a
+ * 64-bit bitmap of the SPDU Numbers accepted immediately below it (same scheme as the IPsec anti-replay window):
+ *
+ *				- SPDU Number above the highest			-> fresh, window slides
+ *				- inside the window, bit not set		-> fresh (reordered packet), bit set
+ *				- inside the window, bit already set	-> replay
+ *				- below the window						-> stale
+ *
+ * SPDU Numbers are compared with serial number arithmetic, so the 32-bit counter may wrap around.
+ *
+ * The table is an open addressing (linear probing) array with a fixed number of entries, allocated once:
+ * lookups are O(1) and the memory used does not grow with the traffic. When the table is full, packets of new
+ * streams are rejected until idle streams are removed (r_goose_session_expire()).
+ *
+ * The window is only updated after the MAC Tag was verified (r_goose_session_accept()), so forged packets can't
+ * move it. r_goose_session_check() is called before the MAC Tag verification, so that replayed and stale packets
+ * are rejected without any cryptographic operation.
+ *
+ * Admission control (disabled by default, r_goose_session_set_admission()) keeps a token bucket per stream that is
+ * spent by MAC Tag verification failures (r_goose_session_fail()) and refilled at a fixed rate. A stream whose
+ * bucket is empty is throttled, and optionally quarantined for some time: its messages are dropped by
+ * r_goose_session_admit() before the MAC Tag verification, so a source sending invalid MAC Tags (attacker or
+ * misconfigured IED) can only consume the CPU time allowed by its failure budget.
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * r_goose_session_table* table = r_goose_session_table_new(100000);
+ *
+ * while(1){
+ * 	uint8_t* buffer = receive_packet(&len, &source);		// pseudo-function that receives a packet and its source
+ *
+ * 	if(r_gooseMessage_ValidateSession(buffer, len, table, source, ring, reader, time(NULL)) == 1){
+ * 		process_packet(buffer);								// pseudo-function that processes a valid packet
+ * 	}
+ * }
+ *
+ * @endcode
+ * @warning A table must only be used by one thread. Receivers with several threads should use one table per
+ * thread and distribute the streams among the threads (e.g. by APPID).
+ */
+
+#ifndef R_GOOSE_SESSION_H
+#define R_GOOSE_SESSION_H
+
+#include "r_goose_security.h"
+#include "r_goose_keyring.h"
+
+// Size of the replay window (SPDU Numbers)
+#define R_GOOSE_REPLAY_WINDOW		64
+
+// Return value of r_gooseMessage_ValidateSession() for replayed/stale messages (rejected before the MAC Tag verification)
+#define R_GOOSE_REPLAY				3
+
+// Return value of r_gooseMessage_ValidateSession() for messages of throttled/quarantined streams (not verified)
+#define R_GOOSE_THROTTLED			5
+
+// Largest token bucket size (r_goose_session_set_admission())
+#define R_GOOSE_ADMISSION_MAX_BURST	65535
+
+
+/**
+ * @brief Stream entry (32 bytes). @p id is 0 for empty entries, @p window is 0 while no SPDU Number was accepted.
+ */
+typedef struct r_goose_session {
+	uint64_t id;
+	uint64_t window;
+	uint32_t highest;
+	uint32_t last_seen;
+	uint32_t quarantine_until;
+	uint16_t tokens;
+	uint16_t reserved;
+} r_goose_session;
+
+
+/**
+ * @brief Counters of a session table.
+ */
+typedef struct r_goose_session_stats {
+	uint64_t accepted;			// Packets accepted (window updated)
+	uint64_t replayed;			// Packets rejected, SPDU Number already accepted
+	uint64_t stale;				// Packets rejected, SPDU Number below the window
+	uint64_t new_streams;		// Streams added to the table
+	uint64_t expired_streams;	// Streams removed by r_goose_session_expire()
+	uint64_t table_full;		// Packets rejected because the table was full
+	uint64_t failures;			// MAC Tag verification failures recorded
+	uint64_t throttled;			// Packets dropped, token bucket of the stream empty
+	uint64_t quarantined;		// Packets dropped, stream in quarantine
+	uint64_t quarantines;		// Times a stream was put in quarantine
+	uint64_t evicted;			// Streams with failures only removed to make room for an authenticated stream
+} r_goose_session_stats;
+
+
+/**
+ * @brief Session table.
+ */
+typedef struct r_goose_session_table {
+	r_goose_session* entries;
+	size_t capacity;
+	size_t count;
+	size_t max_streams;
+	size_t failure_only;
+	size_t evict_cursor;
+	uint32_t burst;
+	uint32_t rate;
+	uint32_t quarantine;
+	r_goose_session_stats stats;
+} r_goose_session_table;
+
+/**
+ * @brief Static storage (no heap build) of a session table of @p max_streams streams.
+ */
+#define R_GOOSE_SESSION_TABLE_STORAGE(max_streams)	(R_GOOSE_STATIC_BLOCK(sizeof(r_goose_session_table)) + \
+		R_GOOSE_STATIC_ALIGNED_BLOCK(R_GOOSE_STATIC_POW2(2 * (size_t)(max_streams), 16) * sizeof(r_goose_session), 64))
+
+
+/**
+ * @brief Function that creates a session table able to track @p max_streams streams.
+ *
+ * @param max_streams Variable (<tt>size_t</tt>) with the maximum number of streams tracked at the same time
+ * @return A pointer to the new table, or NULL if an error occurred.
+ * @note The table uses (at most) 2 * @p max_streams entries, rounded up to a power of two, of 32 bytes each.
+ * @warning The table must be released with r_goose_session_table_free().
+ */
+r_goose_session_table* r_goose_session_table_new(size_t max_streams);
+
+/**
+ * @brief Function that releases a session table.
+ *
+ * @param table Pointer (<tt>r_goose_session_table*</tt>) to the table
+ * @return The function doesn't return any value
+ */
+void r_goose_session_table_free(r_goose_session_table* table);
+
+
+/**
+ * @brief Function that checks if the SPDU Number @p spdu_number of stream (@p source, @p appid) would be accepted.
+ *
+ * The table is not changed (only the counters).
+ *
+ * @param table Pointer (<tt>r_goose_session_table*</tt>) to the table
+ * @param source Variable (<tt>uint32_t</tt>) with the source identifier of the stream
+ * @param appid Variable (<tt>uint16_t</tt>) with the APPID of the stream
+ * @param spdu_number Variable (<tt>uint32_t</tt>) with the SPDU Number of the message
+ * @return The function returns 1 if the SPDU Number is fresh (or the stream is new), 0 if it is a replay or stale
+ * and -1 if the stream is new and the table is full of streams with accepted SPDU Numbers.
+ */
+int r_goose_session_check(r_goose_session_table* table, uint32_t source, uint16_t appid, uint32_t spdu_number);
+
+/**
+ * @brief Function that records the SPDU Number @p spdu_number of stream (@p source, @p appid) as accepted.
+ *
+ * Must only be called after the message was authenticated, and after r_goose_session_check() returned 1. A new
+ * stream on a full table takes the place of a stream added by failures only (r_goose_session_fail()).
+ *
+ * @param table Pointer (<tt>r_goose_session_table*</tt>) to the table
+ * @param source Variable (<tt>uint32_t</tt>) with the source identifier of the stream
+ * @param appid Variable (<tt>uint16_t</tt>) with the APPID of the stream
+ * @param spdu_number Variable (<tt>uint32_t</tt>) with the SPDU Number of the message
+ * @param now Variable (<tt>uint32_t</tt>) with the current time (seconds), used by r_goose_session_expire()
+ * @return The function returns 1 if the SPDU Number was recorded, 0 if it is a replay or stale and -1 if the table is full
+ * of streams with accepted SPDU Numbers.
+ */
+int r_goose_session_accept(r_goose_session_table* table, uint32_t source, uint16_t appid, uint32_t spdu_number, uint32_t now);
+
+/**
+ * @brief Function that enables admission control on @p table.
+ *
+ * Each stream has a bucket of @p burst tokens, refilled with @p rate tokens per second. Each MAC Tag verification
+ * failure takes one token. When the bucket is empty the messages of the stream are dropped until a token is
+ * refilled (throttling) and, if @p quarantine is not 0, during @p quarantine seconds.
+ *
+ * @param table Pointer (<tt>r_goose_session_table*</tt>) to the table
+ * @param burst Variable (<tt>uint32_t</tt>) with the number of failures accepted in a burst (0 disables admission control)
+ * @param rate Variable (<tt>uint32_t</tt>) with the number of failures per second accepted in the long run
+ * @param quarantine Variable (<tt>uint32_t</tt>) with the time (seconds) a stream is blocked when its bucket gets empty
+ * @return The function returns 1 if the policy was set, and -1 if @p burst is larger than R_GOOSE_ADMISSION_MAX_BURST.
+ * @warning The stream is identified by the (unauthenticated) source and APPID of the message. A spoofed source
+ * can get the stream of the real source throttled: @p quarantine should be kept short.
+ */
+int r_goose_session_set_admission(r_goose_session_table* table, uint32_t burst, uint32_t rate, uint32_t quarantine);
+
+/**
+ * @brief Function that checks if the messages of stream (@p source, @p appid) are admitted to the MAC Tag verification.
+ *
+ * @param table Pointer (<tt>r_goose_session_table*</tt>) to the table
+ * @param source Variable (<tt>uint32_t</tt>) with the source identifier of the stream
+ * @param appid Variable (<tt>uint16_t</tt>) with the APPID of the stream
+ * @param now Variable (<tt>uint32_t</tt>) with the current time (seconds)
+ * @return The function returns 1 if the message is admitted, and 0 if the stream is throttled or in quarantine.
+ */
+int r_goose_session_admit(r_goose_session_table* table, uint32_t source, uint16_t appid, uint32_t now);
+
+/**
+ * @brief Function that records a MAC Tag verification failure of stream (@p source, @p appid).
+ *
+ * The stream is added to the table if needed (with an empty replay window). Such streams don't take the place of
+ * authenticated ones: a new authenticated stream evicts one of them when the table is full.
+ *
+ * @param table Pointer (<tt>r_goose_session_table*</tt>) to the table
+ * @param source Variable (<tt>uint32_t</tt>) with the source identifier of the stream
+ * @param appid Variable (<tt>uint16_t</tt>) with the APPID of the stream
+ * @param now Variable (<tt>uint32_t</tt>) with the current time (seconds)
+ * @return The function returns 1 if the stream is still admitted, 0 if it is now throttled or in quarantine, and
+ * -1 if the table is full (or admission control is disabled, only the counter is updated).
+ */
+int r_goose_session_fail(r_goose_session_table* table, uint32_t source, uint16_t appid, uint32_t now);
+
+/**
+ * @brief Function that removes the streams with no message since @p now - @p idle seconds.
+ *
+ * @param table Pointer (<tt>r_goose_session_table*</tt>) to the table
+ * @param now Variable (<tt>uint32_t</tt>) with the current time (seconds)
+ * @param idle Variable (<tt>uint32_t</tt>) with the idle time (seconds) after which a stream is removed
+ * @return The number of streams removed.
+ */
+size_t r_goose_session_expire(r_goose_session_table* table, uint32_t now, uint32_t idle);
+
+/**
+ * @brief Function that copies the counters of @p table to @p stats.
+ *
+ * @param table Pointer (<tt>r_goose_session_table*</tt>) to the table
+ * @param stats Pointer (<tt>r_goose_session_stats*</tt>) to the destination
+ * @return The number of streams currently tracked.
+ */
+size_t r_goose_session_get_stats(r_goose_session_table* table, r_goose_session_stats* stats);
+
+
+/**
+ * @brief Function that validates an R-GOOSE message with replay protection.
+ *
+ * Messages of throttled streams are dropped, and the SPDU Number of the message is checked against the window of
+ * its stream (@p source, APPID of the message), before any cryptographic operation. Fresh messages are validated
+ * with r_gooseMessage_ValidateKeyring(): their SPDU Number is recorded when the MAC Tag is valid, and a failure is
+ * recorded when it is invalid.
+ *
+ * @param buffer Pointer (<tt>uint8_t*</tt>) containg to the R-GOOSE message
+ * @param len Variable (<tt>size_t</tt>) with the number of bytes received
+ * @param table Pointer (<tt>r_goose_session_table*</tt>) to the session table
+ * @param source Variable (<tt>uint32_t</tt>) with the source identifier of the message
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the key ring reader identifier
+ * @param now Variable (<tt>uint32_t</tt>) with the current time (seconds)
+ * @return The function returns R_GOOSE_THROTTLED (5) if the stream is throttled or in quarantine, R_GOOSE_REPLAY (3)
+ * if the message is a replay or stale, and otherwise the value of
+ * r_gooseMessage_ValidateKeyring() (-1 error/unknown key/malformed message or table full, 0 invalid, 1 valid, 2 no
+ * MAC Tag).
+ * @note Messages without MAC Tag (2) are not recorded, as their SPDU Number is not authenticated.
+ */
+int r_gooseMessage_ValidateSession(uint8_t* buffer, size_t len, r_goose_session_table* table, uint32_t source,
+								   r_goose_keyring* ring, int reader, uint32_t now);
+
+#endif
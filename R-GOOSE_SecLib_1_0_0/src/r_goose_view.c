@@ -0,0 +1,663 @@
+/*
+	File defining the GOOSE PDU view (Custom/Off-Standard)
+
+	Elements:
+		single byte tags (tag number below 31) and definite lengths of at most 2 bytes (81 xx,
+		82 xx xx), which covers any GOOSE PDU inside a 64 KB message. Every element is checked
+		against the end of the element that contains it, the outermost one being the position
+		of the Signature TAG (SPDU Length + 10 - MAC size - 2).
+
+	allData scan:
+		the first entries are walked until one has the same tag and length bytes as entry 0.
+		Its offset is the period P (at most R_GOOSE_VIEW_MAX_PERIOD bytes) and the entries
+		before it are one record. A pattern of the record is built with the tag/length bytes
+		of each entry and a mask selecting them, and every full period of allData is compared
+		with it:
+
+			(data & mask) == pattern,	pattern/mask taken at offset (o mod P)
+
+		If all the tag/length bytes match, entry i of the periodic part starts at
+		(i / m) * P + offsets[i mod m] (m entries per record), by induction on the entries.
+		The remaining bytes (less than one period) are walked. When the pattern doesn't match,
+		the whole allData is walked and entries are found with the cursor.
+
+	Layout cache:
+		direct mapped by APPID. Each layout has a pattern/mask of the APDU (max_apdu bytes each)
+		selecting the tag and length bytes of the GOOSE PDU, of its top level elements and of
+		the allData entries, and the value of confRev, and the offsets of the allData entries
+		(max_apdu / 2, entries take 2 bytes or more). By the same induction as the allData scan,
+		an APDU matching the pattern has every element where the layout has it, so the view is
+		filled from the layout. The pattern is compared with match_periods() (period = size).
+*/
+
+#include "r_goose_view.h"
+#include "r_goose_prefilter.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VIEW_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#define GOOSE_PDU_TAG		0x61
+#define ALL_DATA_TAG		0xAB
+
+// Constructed bit of a tag
+#define TAG_CONSTRUCTED		0x20
+
+
+// Reads the element at p (contained before end), returns the position after it or NULL
+static inline const uint8_t* read_element(const uint8_t* p, const uint8_t* end, r_goose_data* d, size_t* header){
+	size_t avail = (size_t)(end - p);
+	size_t len, h;
+
+	if(avail < 2 || (p[0] & 0x1F) == 0x1F){
+		return NULL;
+	}
+
+	len = p[1];
+	h = 2;
+	if(len == 0x81){
+		if(avail < 3){
+			return NULL;
+		}
+		len = p[2];
+		h = 3;
+	}else if(len == 0x82){
+		if(avail < 4){
+			return NULL;
+		}
+		len = ((size_t)p[2] << 8) | p[3];
+		h = 4;
+	}else if(len > 0x80){
+		return NULL;
+	}else if(len == 0x80){
+		// Indefinite length
+		return NULL;
+	}
+
+	if(len > avail - h){
+		return NULL;
+	}
+
+	d->tag = p[0];
+	d->len = len;
+	d->value = p + h;
+	if(header != NULL){
+		*header = h;
+	}
+
+	return p + h + len;
+}
+
+
+int r_goose_view_init(r_goose_view* view, const uint8_t* buffer){
+
+	size_t messageSize = decode_4bytesToInt((uint8_t*)buffer, INDEX_SPDU_LENGTH) + 10;
+	int alg = buffer[INDEX_MAC_ALG];
+	r_goose_data outer, f;
+
+	memset(view, 0, sizeof(r_goose_view));
+	view->count = -1;
+
+	if(alg >= MAC_ALGS_COUNT || messageSize < INDEX_PAYLOAD + 2 + MAC_SIZES[alg]){
+		return -1;
+	}
+
+	// GOOSE PDU ends at the Signature TAG
+	const uint8_t* end = buffer + messageSize - MAC_SIZES[alg] - 2;
+	if(read_element(buffer + INDEX_PAYLOAD, end, &outer, NULL) == NULL || outer.tag != GOOSE_PDU_TAG){
+		return -1;
+	}
+
+	view->pdu = outer.value;
+	view->size = outer.len;
+
+	const uint8_t* p = outer.value;
+	const uint8_t* pdu_end = outer.value + outer.len;
+	while(p < pdu_end){
+		p = read_element(p, pdu_end, &f, NULL);
+		if(p == NULL){
+			return -1;
+		}
+		// Context specific fields, in any order, each one at most once
+		int n = f.tag & 0x1F;
+		if((f.tag & 0xC0) == 0x80 && n < R_GOOSE_FIELDS){
+			if(view->fields[n].tag != 0){
+				return -1;
+			}
+			view->fields[n] = f;
+		}
+	}
+
+	return 1;
+}
+
+int r_gooseMessage_ValidateView(uint8_t* buffer, size_t len, r_goose_keyring* ring, int reader, r_goose_view* view){
+
+	int res = r_gooseMessage_ValidateKeyring(buffer, len, ring, reader);
+
+	// Decoded right after the MAC Tag, while the message is in the cache
+	if(res == 1 && r_goose_view_init(view, buffer) < 0){
+		return R_GOOSE_PDU_ERROR;
+	}
+
+	return res;
+}
+
+
+const char* r_goose_view_string(r_goose_view* view, int field, size_t* len){
+	if(field != R_GOOSE_FIELD_GOCBREF && field != R_GOOSE_FIELD_DATSET && field != R_GOOSE_FIELD_GOID){
+		return NULL;
+	}
+	if(view->fields[field].tag == 0){
+		return NULL;
+	}
+	*len = view->fields[field].len;
+	return (const char*)view->fields[field].value;
+}
+
+int r_goose_view_uint(r_goose_view* view, int field, uint32_t* value){
+	uint64_t v;
+
+	if(field < 0 || field >= R_GOOSE_FIELDS || view->fields[field].tag == 0){
+		return -1;
+	}
+
+	// INTEGER fields of the GOOSE PDU are unsigned (INT32U)
+	r_goose_data d = view->fields[field];
+	d.tag = 0x86;
+	if(r_goose_data_uint(&d, &v) < 0 || v > UINT32_MAX){
+		return -1;
+	}
+
+	*value = (uint32_t)v;
+	return 1;
+}
+
+int r_goose_view_boolean(r_goose_view* view, int field){
+	if(field < 0 || field >= R_GOOSE_FIELDS || view->fields[field].len != 1){
+		return -1;
+	}
+	return view->fields[field].value[0] != 0;
+}
+
+int r_goose_view_timestamp(r_goose_view* view, uint32_t* seconds, uint32_t* fraction, uint8_t* quality){
+	const r_goose_data* t = &view->fields[R_GOOSE_FIELD_T];
+
+	if(t->len != 8){
+		return -1;
+	}
+
+	*seconds = ((uint32_t)t->value[0] << 24) | ((uint32_t)t->value[1] << 16) | ((uint32_t)t->value[2] << 8) | t->value[3];
+	*fraction = ((uint32_t)t->value[4] << 16) | ((uint32_t)t->value[5] << 8) | t->value[6];
+	*quality = t->value[7];
+	return 1;
+}
+
+
+#ifdef VIEW_X86_SIMD
+
+__attribute__((target("avx2")))
+static int match_periods_avx2(const uint8_t* data, size_t size, const uint8_t* pattern, const uint8_t* mask, size_t period){
+	size_t o = 0, r = 0;
+
+	for(; o + 32 <= size; o += 32){
+		__m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)&data[o]), _mm256_loadu_si256((const __m256i*)&mask[r]));
+		if(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_loadu_si256((const __m256i*)&pattern[r]))) != -1){
+			return 0;
+		}
+		r += 32;
+		while(r >= period){
+			r -= period;
+		}
+	}
+
+	for(; o < size; o++, r = r + 1 == period ? 0 : r + 1){
+		if((data[o] & mask[r]) != pattern[r]){
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+#endif
+
+static int match_periods(const uint8_t* data, size_t size, const uint8_t* pattern, const uint8_t* mask, size_t period){
+	size_t r = 0;
+
+#ifdef VIEW_X86_SIMD
+	if(__builtin_cpu_supports("avx2")){
+		return match_periods_avx2(data, size, pattern, mask, period);
+	}
+#endif
+
+	for(size_t o = 0; o < size; o++, r = r + 1 == period ? 0 : r + 1){
+		if((data[o] & mask[r]) != pattern[r]){
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+// Finds the record repeated along allData and checks it, returns the number of entries of the periodic part
+static int scan_periodic(r_goose_view* view, const uint8_t* data, size_t size){
+	uint8_t pattern[R_GOOSE_VIEW_MAX_PERIOD + 32];
+	uint8_t mask[R_GOOSE_VIEW_MAX_PERIOD + 32];
+	size_t headers[R_GOOSE_VIEW_MAX_PERIOD_ENTRIES];
+	const uint8_t* p = data;
+	const uint8_t* end = data + size;
+	size_t period = 0;
+	int m = 0;
+	r_goose_data d;
+
+	// First record: entries until one starts like entry 0
+	while(m <= R_GOOSE_VIEW_MAX_PERIOD_ENTRIES){
+		size_t offset = (size_t)(p - data);
+		size_t h;
+
+		if(offset > R_GOOSE_VIEW_MAX_PERIOD || p == end){
+			return 0;
+		}
+		if(m > 0 && (size_t)(end - p) >= headers[0] && memcmp(p, data, headers[0]) == 0){
+			period = offset;
+			break;
+		}
+		if(m == R_GOOSE_VIEW_MAX_PERIOD_ENTRIES){
+			return 0;
+		}
+		if((p = read_element(p, end, &d, &h)) == NULL){
+			return 0;
+		}
+		view->offsets[m] = (uint8_t)offset;
+		headers[m++] = h;
+	}
+
+	if(period == 0 || size / period < 2){
+		return 0;
+	}
+
+	memset(mask, 0, sizeof(mask));
+	memset(pattern, 0, sizeof(pattern));
+	for(int i = 0; i < m; i++){
+		memset(&mask[view->offsets[i]], 0xFF, headers[i]);
+		memcpy(&pattern[view->offsets[i]], &data[view->offsets[i]], headers[i]);
+	}
+	// Extended by 32 bytes, so a 32 byte load at any offset of the period wraps around
+	for(size_t i = period; i < period + 32; i++){
+		mask[i] = mask[i - period];
+		pattern[i] = pattern[i - period];
+	}
+
+	size_t periods = size / period;
+	if(!match_periods(data, periods * period, pattern, mask, period)){
+		return 0;
+	}
+
+	view->period = period;
+	view->period_entries = m;
+	view->periods = (int)periods;
+
+	return (int)periods * m;
+}
+
+static int scan_all_data(r_goose_view* view){
+	const r_goose_data* all = &view->fields[R_GOOSE_FIELD_ALLDATA];
+	r_goose_data d;
+
+	if(all->tag != ALL_DATA_TAG){
+		return -1;
+	}
+
+	int count = scan_periodic(view, all->value, all->len);
+	size_t offset = (size_t)view->periods * view->period;
+
+	view->cursor = count;
+	view->cursor_offset = offset;
+
+	// Entries after the periodic part (or all of them)
+	const uint8_t* p = all->value + offset;
+	const uint8_t* end = all->value + all->len;
+	while(p < end){
+		if((p = read_element(p, end, &d, NULL)) == NULL){
+			return -1;
+		}
+		count++;
+	}
+
+	view->count = count;
+	return count;
+}
+
+int r_goose_view_data_count(r_goose_view* view){
+	if(view->count < 0){
+		return scan_all_data(view);
+	}
+	return view->count;
+}
+
+int r_goose_view_data_at(r_goose_view* view, int index, r_goose_data* d){
+	const r_goose_data* all = &view->fields[R_GOOSE_FIELD_ALLDATA];
+	const uint8_t* end = all->value + all->len;
+	int periodic = view->periods * view->period_entries;
+
+	if(index < 0 || index >= r_goose_view_data_count(view)){
+		return -1;
+	}
+
+	if(view->layout != NULL){
+		return read_element(all->value + view->layout[index], end, d, NULL) == NULL ? -1 : 1;
+	}
+
+	if(index < periodic){
+		int record = index / view->period_entries;
+		size_t offset = (size_t)record * view->period + view->offsets[index - record * view->period_entries];
+		return read_element(all->value + offset, end, d, NULL) == NULL ? -1 : 1;
+	}
+
+	if(index < view->cursor){
+		view->cursor = periodic;
+		view->cursor_offset = (size_t)view->periods * view->period;
+	}
+
+	// Every entry after the periodic part was checked by the scan
+	const uint8_t* p = all->value + view->cursor_offset;
+	while(view->cursor < index && p != NULL){
+		p = read_element(p, end, d, NULL);
+		view->cursor++;
+	}
+	if(p == NULL){
+		return -1;
+	}
+	view->cursor_offset = (size_t)(p - all->value);
+
+	return read_element(p, end, d, NULL) == NULL ? -1 : 1;
+}
+
+int r_goose_view_data_iter(r_goose_view* view, r_goose_data_iter* it){
+	if(view->fields[R_GOOSE_FIELD_ALLDATA].tag != ALL_DATA_TAG){
+		return -1;
+	}
+	return r_goose_data_iter_init(&view->fields[R_GOOSE_FIELD_ALLDATA], it);
+}
+
+int r_goose_data_iter_init(const r_goose_data* d, r_goose_data_iter* it){
+	if(!(d->tag & TAG_CONSTRUCTED)){
+		return -1;
+	}
+	it->p = d->value;
+	it->end = d->value + d->len;
+	return 1;
+}
+
+int r_goose_data_next(r_goose_data_iter* it, r_goose_data* d){
+	if(it->p == it->end){
+		return 0;
+	}
+
+	const uint8_t* next = read_element(it->p, it->end, d, NULL);
+	if(next == NULL){
+		it->p = it->end;
+		return -1;
+	}
+
+	it->p = next;
+	return 1;
+}
+
+
+int r_goose_data_boolean(const r_goose_data* d){
+	if(d->tag != 0x83 || d->len != 1){
+		return -1;
+	}
+	return d->value[0] != 0;
+}
+
+int r_goose_data_int(const r_goose_data* d, int64_t* value){
+	if(d->tag != 0x85 || d->len < 1 || d->len > 8){
+		return -1;
+	}
+
+	// Sign extension from the first byte
+	int64_t v = (int8_t)d->value[0];
+	for(size_t i = 1; i < d->len; i++){
+		v = (int64_t)((uint64_t)v << 8) | d->value[i];
+	}
+
+	*value = v;
+	return 1;
+}
+
+int r_goose_data_uint(const r_goose_data* d, uint64_t* value){
+	if(d->tag != 0x86 || d->len < 1 || d->len > 9 || (d->value[0] & 0x80) || (d->len == 9 && d->value[0] != 0)){
+		return -1;
+	}
+
+	uint64_t v = 0;
+	for(size_t i = 0; i < d->len; i++){
+		v = (v << 8) | d->value[i];
+	}
+
+	*value = v;
+	return 1;
+}
+
+int r_goose_data_float(const r_goose_data* d, double* value){
+	uint64_t bits = 0;
+
+	if(d->tag != 0x87){
+		return -1;
+	}
+
+	// Exponent width byte, then IEEE 754 single (8) or double (11)
+	if(d->len == 5 && d->value[0] == 8){
+		float f;
+		uint32_t b = ((uint32_t)d->value[1] << 24) | ((uint32_t)d->value[2] << 16) | ((uint32_t)d->value[3] << 8) | d->value[4];
+		memcpy(&f, &b, sizeof(f));
+		*value = f;
+		return 1;
+	}
+	if(d->len == 9 && d->value[0] == 11){
+		for(int i = 1; i < 9; i++){
+			bits = (bits << 8) | d->value[i];
+		}
+		memcpy(value, &bits, sizeof(bits));
+		return 1;
+	}
+
+	return -1;
+}
+
+
+static inline size_t layout_index(r_goose_layout_cache* cache, uint16_t appid){
+	return (size_t)((appid * 0x9E3779B1u) >> 16) & (cache->capacity - 1);
+}
+
+r_goose_layout_cache* r_goose_layout_cache_new(size_t streams, size_t max_apdu){
+	size_t capacity = 1;
+
+	if(streams == 0 || max_apdu < 2 || max_apdu > R_GOOSE_MAX_MESSAGE_SIZE){
+		return NULL;
+	}
+	while(capacity < streams){
+		capacity <<= 1;
+	}
+
+	r_goose_layout_cache* cache = (r_goose_layout_cache*)r_goose_calloc(1, sizeof(r_goose_layout_cache));
+	if(cache == NULL){
+		return NULL;
+	}
+
+	cache->layouts = (r_goose_layout*)r_goose_calloc(capacity, sizeof(r_goose_layout));
+	cache->patterns = (uint8_t*)r_goose_malloc(capacity * max_apdu);
+	cache->masks = (uint8_t*)r_goose_malloc(capacity * max_apdu);
+	cache->offsets = (uint16_t*)r_goose_malloc(capacity * (max_apdu / 2) * sizeof(uint16_t));
+	if(cache->layouts == NULL || cache->patterns == NULL || cache->masks == NULL || cache->offsets == NULL){
+		r_goose_layout_cache_free(cache);
+		return NULL;
+	}
+
+	cache->capacity = capacity;
+	cache->max_apdu = max_apdu;
+
+	return cache;
+}
+
+void r_goose_layout_cache_free(r_goose_layout_cache* cache){
+	if(cache == NULL){
+		return;
+	}
+	r_goose_free(cache->layouts);
+	r_goose_free(cache->patterns);
+	r_goose_free(cache->masks);
+	r_goose_free(cache->offsets);
+	r_goose_free(cache);
+}
+
+// Selects the tag and length bytes of the element at p
+static inline const uint8_t* layout_element(const uint8_t* p, const uint8_t* end, const uint8_t* apdu, uint8_t* pattern, uint8_t* mask, r_goose_data* d){
+	size_t h;
+	const uint8_t* next = read_element(p, end, d, &h);
+
+	if(next != NULL){
+		memset(&mask[p - apdu], 0xFF, h);
+		memcpy(&pattern[p - apdu], p, h);
+	}
+	return next;
+}
+
+// Walks the APDU of a view already created, and stores its layout in slot i
+static void layout_store(r_goose_layout_cache* cache, size_t i, uint16_t appid, uint32_t fingerprint, const uint8_t* apdu, r_goose_view* view){
+	r_goose_layout* layout = &cache->layouts[i];
+	uint8_t* pattern = &cache->patterns[i * cache->max_apdu];
+	uint8_t* mask = &cache->masks[i * cache->max_apdu];
+	uint16_t* offsets = &cache->offsets[i * (cache->max_apdu / 2)];
+	const uint8_t* pdu_end = view->pdu + view->size;
+	size_t size = (size_t)(pdu_end - apdu);
+	r_goose_data d;
+	int count = -1;
+
+	layout->used = 0;
+	if(size > cache->max_apdu){
+		cache->stats.too_large++;
+		return;
+	}
+
+	memset(mask, 0, size);
+	memset(pattern, 0, size);
+
+	layout_element(apdu, pdu_end, apdu, pattern, mask, &d);
+	for(const uint8_t* p = view->pdu; p < pdu_end; ){
+		p = layout_element(p, pdu_end, apdu, pattern, mask, &d);
+	}
+
+	// confRev changes with the dataset
+	const r_goose_data* f = &view->fields[R_GOOSE_FIELD_CONFREV];
+	if(f->tag != 0){
+		memset(&mask[f->value - apdu], 0xFF, f->len);
+		memcpy(&pattern[f->value - apdu], f->value, f->len);
+	}
+
+	// allData entries (not stored if malformed)
+	f = &view->fields[R_GOOSE_FIELD_ALLDATA];
+	if(f->tag == ALL_DATA_TAG){
+		const uint8_t* end = f->value + f->len;
+		count = 0;
+		for(const uint8_t* p = f->value; p < end; count++){
+			offsets[count] = (uint16_t)(p - f->value);
+			if((p = layout_element(p, end, apdu, pattern, mask, &d)) == NULL){
+				return;
+			}
+		}
+	}
+
+	for(int n = 0; n < R_GOOSE_FIELDS; n++){
+		layout->tags[n] = view->fields[n].tag;
+		layout->fields[n] = view->fields[n].tag != 0 ? (uint16_t)(view->fields[n].value - apdu) : 0;
+		layout->lengths[n] = (uint16_t)view->fields[n].len;
+	}
+
+	layout->appid = appid;
+	layout->fingerprint = fingerprint;
+	layout->size = (uint32_t)size;
+	layout->pdu = (uint16_t)(view->pdu - apdu);
+	layout->pdu_size = (uint16_t)view->size;
+	layout->count = count;
+	layout->hits = 0;
+	layout->used = 1;
+	cache->stats.stored++;
+
+	if(count >= 0){
+		view->count = count;
+		view->layout = offsets;
+	}
+}
+
+int r_goose_view_init_cached(r_goose_view* view, const uint8_t* buffer, r_goose_layout_cache* cache){
+	uint16_t appid = decode_2bytesToInt((uint8_t*)buffer, INDEX_APPID);
+	size_t messageSize = decode_4bytesToInt((uint8_t*)buffer, INDEX_SPDU_LENGTH) + 10;
+	int alg = buffer[INDEX_MAC_ALG];
+	uint32_t fingerprint = ((uint32_t)messageSize << 8) | (uint8_t)alg;
+	const uint8_t* apdu = buffer + INDEX_PAYLOAD;
+	size_t i = layout_index(cache, appid);
+	r_goose_layout* layout = &cache->layouts[i];
+
+	if(layout->used && layout->appid == appid && layout->fingerprint == fingerprint){
+		if(match_periods(apdu, layout->size, &cache->patterns[i * cache->max_apdu], &cache->masks[i * cache->max_apdu], layout->size)){
+			view->pdu = apdu + layout->pdu;
+			view->size = layout->pdu_size;
+			for(int n = 0; n < R_GOOSE_FIELDS; n++){
+				view->fields[n].tag = layout->tags[n];
+				view->fields[n].len = layout->lengths[n];
+				view->fields[n].value = layout->tags[n] != 0 ? apdu + layout->fields[n] : NULL;
+			}
+			view->count = layout->count;
+			view->period = 0;
+			view->period_entries = 0;
+			view->periods = 0;
+			view->cursor = 0;
+			view->cursor_offset = 0;
+			view->layout = &cache->offsets[i * (cache->max_apdu / 2)];
+
+			layout->hits++;
+			cache->stats.hits++;
+			return 1;
+		}
+		cache->stats.changed++;
+	}else{
+		cache->stats.misses++;
+	}
+
+	if(r_goose_view_init(view, buffer) < 0){
+		return -1;
+	}
+
+	layout_store(cache, i, appid, fingerprint, apdu, view);
+
+	return 1;
+}
+
+int r_gooseMessage_ValidateViewCached(uint8_t* buffer, size_t len, r_goose_keyring* ring, int reader, r_goose_layout_cache* cache, r_goose_view* view){
+
+	int res = r_gooseMessage_ValidateKeyring(buffer, len, ring, reader);
+
+	if(res == 1 && r_goose_view_init_cached(view, buffer, cache) < 0){
+		return R_GOOSE_PDU_ERROR;
+	}
+
+	return res;
+}
+
+uint64_t r_goose_layout_cache_hits(r_goose_layout_cache* cache, uint16_t appid){
+	r_goose_layout* layout = &cache->layouts[layout_index(cache, appid)];
+
+	if(!layout->used || layout->appid != appid){
+		return 0;
+	}
+	return layout->hits;
+}
+
+void r_goose_layout_cache_get_stats(r_goose_layout_cache* cache, r_goose_layout_stats* stats){
+	*stats = cache->stats;
+}
@@ -0,0 +1,354 @@
+/**
+ * @file r_goose_view.h
+ * @author Eduardo Andrade
+ * @date Mar 2020
+ * @brief File containing the declarations of the GOOSE PDU view, a zero-copy decoder of the GOOSE PDU (BER) of an
+ * authenticated R-GOOSE message.
+ *
+ * A view points into the message buffer, nothing is copied:
+ *				- When the view is created only the top level of the GOOSE PDU is walked (about 12 TLVs), recording
+ *				  where each field is. Fields are decoded when they are asked for (r_goose_view_string(),
+ *				  r_goose_view_uint(), ...).
+ *				- allData is only scanned on the first access to its entries. Datasets are usually the same
+ *				  record (e.g. value, quality) repeated, so the scan finds the period of the first record and
+ *				  checks the tag/length bytes of all the others against it, 32 bytes at a time when the CPU
+ *				  supports AVX2. Entries are then found by their index in constant time
+ *				  (r_goose_view_data_at()). Other datasets are walked entry by entry.
+ *				- Entries are returned as (tag, length, pointer to the contents), and constructed entries
+ *				  (structure, array) are iterated the same way (r_goose_data_iter_init()).
+ *
+ * r_gooseMessage_ValidateView() validates the message and, if it is authentic, creates the view right away, while
+ * the bytes just read by the MAC Tag generation are still in the cache.
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * r_goose_view view;
+ * r_goose_data d;
+ * uint32_t stnum;
+ * double value;
+ *
+ * if(r_gooseMessage_ValidateView(buffer, len, ring, reader, &view) == 1){
+ * 	r_goose_view_uint(&view, R_GOOSE_FIELD_STNUM, &stnum);
+ *
+ * 	for(int i = 0; i < r_goose_view_data_count(&view); i += 2){
+ * 		r_goose_view_data_at(&view, i, &d);
+ * 		r_goose_data_float(&d, &value);
+ * 		process_value(i / 2, value);							// pseudo-function that processes a value
+ * 	}
+ * }
+ *
+ * @endcode
+ * @warning The view points to the message buffer, which must not be changed or released while the view is used.
+ */
+
+#ifndef R_GOOSE_VIEW_H
+#define R_GOOSE_VIEW_H
+
+#include "r_goose_security.h"
+#include "r_goose_keyring.h"
+
+// Return value of r_gooseMessage_ValidateView() for authentic messages whose GOOSE PDU can't be decoded
+#define R_GOOSE_PDU_ERROR			6
+
+// GOOSE PDU fields (context specific tag numbers)
+#define R_GOOSE_FIELD_GOCBREF			0
+#define R_GOOSE_FIELD_TIMEALLOWEDTOLIVE	1
+#define R_GOOSE_FIELD_DATSET			2
+#define R_GOOSE_FIELD_GOID				3
+#define R_GOOSE_FIELD_T					4
+#define R_GOOSE_FIELD_STNUM				5
+#define R_GOOSE_FIELD_SQNUM				6
+#define R_GOOSE_FIELD_SIMULATION		7
+#define R_GOOSE_FIELD_CONFREV			8
+#define R_GOOSE_FIELD_NDSCOM			9
+#define R_GOOSE_FIELD_NUMDATSETENTRIES	10
+#define R_GOOSE_FIELD_ALLDATA			11
+#define R_GOOSE_FIELDS					12
+
+// Largest record (entries, bytes) found as the period of allData
+#define R_GOOSE_VIEW_MAX_PERIOD_ENTRIES	16
+#define R_GOOSE_VIEW_MAX_PERIOD			64
+
+
+/**
+ * @brief BER element (Data value or GOOSE PDU field). @p value points into the message.
+ */
+typedef struct r_goose_data {
+	uint8_t tag;
+	size_t len;
+	const uint8_t* value;
+} r_goose_data;
+
+/**
+ * @brief Iterator over the elements of a constructed element.
+ */
+typedef struct r_goose_data_iter {
+	const uint8_t* p;
+	const uint8_t* end;
+} r_goose_data_iter;
+
+
+/**
+ * @brief View over the GOOSE PDU of a message.
+ */
+typedef struct r_goose_view {
+	const uint8_t* pdu;
+	size_t size;
+
+	// Top level fields, tag 0 if not present
+	r_goose_data fields[R_GOOSE_FIELDS];
+
+	// allData index (count -1 until allData is scanned)
+	int count;
+	size_t period;
+	int period_entries;
+	int periods;
+	uint8_t offsets[R_GOOSE_VIEW_MAX_PERIOD_ENTRIES];
+
+	// Last entry found by walking (entries after the periodic part, or non periodic datasets)
+	int cursor;
+	size_t cursor_offset;
+
+	// Offsets of the allData entries, from the layout cache (NULL otherwise)
+	const uint16_t* layout;
+} r_goose_view;
+
+
+/**
+ * @brief Function that creates a view over the GOOSE PDU of an R-GOOSE message (with or without MAC Tag).
+ *
+ * @param view Pointer (<tt>r_goose_view*</tt>) to the view
+ * @param buffer Pointer (<tt>uint8_t*</tt>) containg to the R-GOOSE message, already validated
+ * @return The function returns 1 if the top level of the GOOSE PDU is well formed, and -1 otherwise.
+ */
+int r_goose_view_init(r_goose_view* view, const uint8_t* buffer);
+
+/**
+ * @brief Function that validates an R-GOOSE message with the key ring and creates a view over its GOOSE PDU.
+ *
+ * @param buffer Pointer (<tt>uint8_t*</tt>) containg to the R-GOOSE message
+ * @param len Variable (<tt>size_t</tt>) with the number of bytes received
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the reader identifier
+ * @param view Pointer (<tt>r_goose_view*</tt>) to the view, only set when the message is valid
+ * @return The function returns the result of r_gooseMessage_ValidateKeyring(), or R_GOOSE_PDU_ERROR (6) if the message
+ * is valid but the GOOSE PDU is malformed.
+ */
+int r_gooseMessage_ValidateView(uint8_t* buffer, size_t len, r_goose_keyring* ring, int reader, r_goose_view* view);
+
+
+/**
+ * @brief Functions that decode a field of the GOOSE PDU.
+ *
+ * @param view Pointer (<tt>r_goose_view*</tt>) to the view
+ * @param field Variable (<tt>int</tt>) with the field (R_GOOSE_FIELD_*)
+ * @return r_goose_view_string() returns a pointer to the characters (not NUL terminated, @p len set), or NULL.
+ * r_goose_view_uint() and r_goose_view_timestamp() return 1, or -1 if the field is missing or malformed.
+ * r_goose_view_boolean() returns 0 or 1, or -1 if the field is missing or malformed.
+ */
+const char* r_goose_view_string(r_goose_view* view, int field, size_t* len);
+int r_goose_view_uint(r_goose_view* view, int field, uint32_t* value);
+int r_goose_view_boolean(r_goose_view* view, int field);
+int r_goose_view_timestamp(r_goose_view* view, uint32_t* seconds, uint32_t* fraction, uint8_t* quality);
+
+
+/**
+ * @brief Function that returns the number of entries of allData (scanned on the first call).
+ *
+ * @param view Pointer (<tt>r_goose_view*</tt>) to the view
+ * @return The number of entries, or -1 if allData is missing or malformed.
+ */
+int r_goose_view_data_count(r_goose_view* view);
+
+/**
+ * @brief Function that finds the entry @p index of allData.
+ *
+ * Constant time for the periodic part of allData, otherwise the walk continues from the last entry found (so
+ * increasing indexes cost one step each).
+ *
+ * @param view Pointer (<tt>r_goose_view*</tt>) to the view
+ * @param index Variable (<tt>int</tt>) with the position of the entry
+ * @param d Pointer (<tt>r_goose_data*</tt>) set to the entry
+ * @return The function returns 1, or -1 if @p index is out of range or allData is malformed.
+ */
+int r_goose_view_data_at(r_goose_view* view, int index, r_goose_data* d);
+
+/**
+ * @brief Function that starts an iteration over the entries of allData.
+ *
+ * @param view Pointer (<tt>r_goose_view*</tt>) to the view
+ * @param it Pointer (<tt>r_goose_data_iter*</tt>) to the iterator
+ * @return The function returns 1, or -1 if allData is missing.
+ */
+int r_goose_view_data_iter(r_goose_view* view, r_goose_data_iter* it);
+
+/**
+ * @brief Function that starts an iteration over the elements of a constructed element (structure, array).
+ *
+ * @param d Pointer (<tt>r_goose_data*</tt>) to the constructed element
+ * @param it Pointer (<tt>r_goose_data_iter*</tt>) to the iterator
+ * @return The function returns 1, or -1 if @p d is not constructed.
+ */
+int r_goose_data_iter_init(const r_goose_data* d, r_goose_data_iter* it);
+
+/**
+ * @brief Function that returns the next element of an iteration.
+ *
+ * @param it Pointer (<tt>r_goose_data_iter*</tt>) to the iterator
+ * @param d Pointer (<tt>r_goose_data*</tt>) set to the element
+ * @return The function returns 1 if @p d was set, 0 at the end and -1 if the element is malformed.
+ */
+int r_goose_data_next(r_goose_data_iter* it, r_goose_data* d);
+
+
+/**
+ * @brief Functions that decode a Data value (boolean 0x83, integer 0x85, unsigned 0x86, floating-point 0x87).
+ *
+ * @param d Pointer (<tt>r_goose_data*</tt>) to the value
+ * @return The functions return 1, or -1 if the value has another type or is malformed. r_goose_data_boolean()
+ * returns 0 or 1, or -1.
+ */
+int r_goose_data_boolean(const r_goose_data* d);
+int r_goose_data_int(const r_goose_data* d, int64_t* value);
+int r_goose_data_uint(const r_goose_data* d, uint64_t* value);
+int r_goose_data_float(const r_goose_data* d, double* value);
+
+
+/*
+ * Layout cache
+ *
+ * The GOOSE PDU of a stream has the same layout in every message (only the values change) until its configuration
+ * revision changes. The layout cache keeps, for each APPID, the structure of the last GOOSE PDU decoded: where each
+ * field and allData entry is, and a pattern of the bytes that define it (tags, lengths and confRev). A message
+ * whose fingerprint (message size, MAC algorithm) and pattern match is decoded without walking the BER: one masked
+ * comparison of the APDU, 32 bytes at a time when the CPU supports AVX2. Other messages are decoded as usual and
+ * their layout replaces the one stored.
+ *
+ * Below is and example of usage:
+ * @code
+ *
+ * r_goose_layout_cache* layouts = r_goose_layout_cache_new(64, 1500);	// 64 streams, APDUs up to 1500 bytes
+ *
+ * if(r_gooseMessage_ValidateViewCached(buffer, len, ring, reader, layouts, &view) == 1){
+ * 	...																// same use as r_gooseMessage_ValidateView()
+ * }
+ *
+ * @endcode
+ */
+
+/**
+ * @brief Layout of the GOOSE PDU of a stream. Offsets are counted from the start of the APDU (INDEX_PAYLOAD).
+ */
+typedef struct r_goose_layout {
+	uint16_t appid;
+	uint16_t used;
+	uint32_t fingerprint;				// (message size << 8) | MAC algorithm
+	uint32_t size;						// APDU bytes covered by the pattern
+	uint16_t pdu;						// Offset and length of the GOOSE PDU contents
+	uint16_t pdu_size;
+	int count;							// allData entries, -1 without allData
+	uint8_t tags[R_GOOSE_FIELDS];		// Top level fields (tag 0 if not present), value offsets and lengths
+	uint16_t fields[R_GOOSE_FIELDS];
+	uint16_t lengths[R_GOOSE_FIELDS];
+	uint64_t hits;						// Messages decoded with this layout
+} r_goose_layout;
+
+
+/**
+ * @brief Counters of a layout cache.
+ */
+typedef struct r_goose_layout_stats {
+	uint64_t hits;				// Messages decoded with a stored layout
+	uint64_t misses;			// Streams without a stored layout, or with another fingerprint
+	uint64_t changed;			// Same fingerprint but the pattern didn't match (values with other lengths, confRev)
+	uint64_t stored;			// Layouts stored
+	uint64_t too_large;			// APDUs larger than max_apdu, not stored
+} r_goose_layout_stats;
+
+
+/**
+ * @brief Layout cache.
+ */
+typedef struct r_goose_layout_cache {
+	r_goose_layout* layouts;
+	uint8_t* patterns;
+	uint8_t* masks;
+	uint16_t* offsets;
+	size_t capacity;
+	size_t max_apdu;
+	r_goose_layout_stats stats;
+} r_goose_layout_cache;
+
+/**
+ * @brief Static storage (no heap build) of a layout cache of @p streams streams of at most @p max_apdu bytes.
+ */
+#define R_GOOSE_LAYOUT_CACHE_STORAGE(streams, max_apdu)	(R_GOOSE_STATIC_BLOCK(sizeof(r_goose_layout_cache)) + \
+		R_GOOSE_STATIC_BLOCK(R_GOOSE_STATIC_POW2(streams, 1) * sizeof(r_goose_layout)) + \
+		2 * R_GOOSE_STATIC_BLOCK(R_GOOSE_STATIC_POW2(streams, 1) * (size_t)(max_apdu)) + \
+		R_GOOSE_STATIC_BLOCK(R_GOOSE_STATIC_POW2(streams, 1) * ((size_t)(max_apdu) / 2) * sizeof(uint16_t)))
+
+
+/**
+ * @brief Function that creates a layout cache.
+ * @param streams Variable (<tt>size_t</tt>) with the number of layouts, rounded up to a power of two
+ * @param max_apdu Variable (<tt>size_t</tt>) with the size of the largest APDU stored
+ * @return A pointer to the new cache, or NULL if an error occurred.
+ * @note The cache is direct mapped by APPID: streams whose APPIDs share a position replace each other's layout. It
+ * uses @p streams * (3 * @p max_apdu + 88) bytes.
+ * @warning The cache must be released with r_goose_layout_cache_free().
+ */
+r_goose_layout_cache* r_goose_layout_cache_new(size_t streams, size_t max_apdu);
+
+/**
+ * @brief Function that releases a layout cache.
+ * @param cache Pointer (<tt>r_goose_layout_cache*</tt>) to the cache
+ * @return The function doesn't return any value
+ */
+void r_goose_layout_cache_free(r_goose_layout_cache* cache);
+
+/**
+ * @brief Function that creates a view over the GOOSE PDU of an R-GOOSE message with the layout stored for its
+ * APPID, or decodes it and stores its layout.
+ *
+ * @param view Pointer (<tt>r_goose_view*</tt>) to the view
+ * @param buffer Pointer (<tt>uint8_t*</tt>) containg to the R-GOOSE message, already validated
+ * @param cache Pointer (<tt>r_goose_layout_cache*</tt>) to the cache
+ * @return The function returns 1 if the top level of the GOOSE PDU is well formed, and -1 otherwise (same as
+ * r_goose_view_init()).
+ * @warning The allData entries of the view are found with the offsets stored in the cache: the view must not be
+ * used after another message of a stream at the same position of the cache is decoded.
+ */
+int r_goose_view_init_cached(r_goose_view* view, const uint8_t* buffer, r_goose_layout_cache* cache);
+
+/**
+ * @brief Function that validates an R-GOOSE message with the key ring and creates a view over its GOOSE PDU with
+ * the layout cache.
+ *
+ * @param buffer Pointer (<tt>uint8_t*</tt>) containg to the R-GOOSE message
+ * @param len Variable (<tt>size_t</tt>) with the number of bytes received
+ * @param ring Pointer (<tt>r_goose_keyring*</tt>) to the key ring
+ * @param reader Variable (<tt>int</tt>) with the reader identifier
+ * @param cache Pointer (<tt>r_goose_layout_cache*</tt>) to the cache
+ * @param view Pointer (<tt>r_goose_view*</tt>) to the view, only set when the message is valid
+ * @return Same as r_gooseMessage_ValidateView().
+ */
+int r_gooseMessage_ValidateViewCached(uint8_t* buffer, size_t len, r_goose_keyring* ring, int reader, r_goose_layout_cache* cache, r_goose_view* view);
+
+/**
+ * @brief Function that returns the number of messages of the stream @p appid decoded with its stored layout.
+ * @param cache Pointer (<tt>r_goose_layout_cache*</tt>) to the cache
+ * @param appid Variable (<tt>uint16_t</tt>) with the APPID
+ * @return The number of hits of the layout stored for @p appid (since it was stored), 0 if there is none.
+ */
+uint64_t r_goose_layout_cache_hits(r_goose_layout_cache* cache, uint16_t appid);
+
+/**
+ * @brief Function that copies the counters of @p cache to @p stats.
+ * @param cache Pointer (<tt>r_goose_layout_cache*</tt>) to the cache
+ * @param stats Pointer (<tt>r_goose_layout_stats*</tt>) to the destination
+ * @return The function doesn't return any value
+ */
+void r_goose_layout_cache_get_stats(r_goose_layout_cache* cache, r_goose_layout_stats* stats);
+
+#endif
@@ -0,0 +1,294 @@
+/*
+	Test file:
+
+		Admission control - r_goose_session_set_admission(), r_goose_session_admit(),
+		r_goose_session_fail() and r_gooseMessage_ValidateSession()
+
+		1. Quarantine: a stream sending invalid MAC Tags is blocked after BURST failures, for
+		   QUARANTINE seconds, then admitted again. Other streams are never affected.
+		2. Throttling (no quarantine): failures below RATE per second are always verified, a
+		   faster stream is limited to RATE verifications per second.
+		3. Flood: one source sends invalid MAC Tags at line rate next to STREAMS legitimate
+		   streams. CPU time per message with and without admission control, and counters
+		   reported by r_goose_session_get_stats().
+		4. Many-source flood: invalid MAC Tags from more spoofed sources than the table holds.
+		   New authenticated streams still get an entry (taking the place of a stream with failures
+		   only), and the streams already authenticated keep their replay window.
+
+*/
+
+#include "r_goose_security.h"
+#include "r_goose_keyring.h"
+#include "r_goose_session.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <time.h>
+
+#define BURST			5
+#define RATE			2
+#define QUARANTINE		10
+
+#define STREAMS			1000
+#define ROUNDS			200
+#define FLOOD_PER_ROUND	5000
+
+int64_t timespecDiff(struct timespec *timeA_p, struct timespec *timeB_p)
+{
+  return ((timeA_p->tv_sec * 1000000000) + timeA_p->tv_nsec) -
+           ((timeB_p->tv_sec * 1000000000) + timeB_p->tv_nsec);
+}
+
+uint8_t* read_packet(char* filename, long* filelen){
+	FILE *fp;
+	unsigned char *buffer;
+
+	fp = fopen(filename, "rb");
+	fseek(fp, 0, SEEK_END);
+	*filelen = ftell(fp);
+	rewind(fp);
+
+	buffer = (unsigned char*) malloc((*filelen)*sizeof(char));
+	fread(buffer, *filelen, 1, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...)	do{ if(!(cond)){ failures++; printf("FAILED: " __VA_ARGS__); printf("\n"); } }while(0)
+
+// Number of bytes "received" for a well formed message
+static size_t message_size(const uint8_t* m){
+	return (size_t)decode_4bytesToInt((uint8_t*)m, INDEX_SPDU_LENGTH) + 10;
+}
+
+static r_goose_keyring* ring;
+static int reader;
+
+// Message of APPID appid with SPDU Number n, MAC Tag valid or not
+static uint8_t* make_message(uint8_t* packet, uint16_t appid, uint32_t n, int valid){
+	uint8_t* dest = NULL;
+
+	encodeInt2Bytes(packet, appid, INDEX_APPID);
+	encodeInt4Bytes(packet, n, INDEX_SPDU_NUMBER);
+	r_gooseMessage_InsertKeyring(packet, ring, reader, appid, &dest);
+	if(!valid){
+		dest[INDEX_PAYLOAD + 4] ^= 0x01;
+	}
+	return dest;
+}
+
+static int validate(r_goose_session_table* t, uint8_t* packet, uint32_t source, uint16_t appid, uint32_t n, int valid, uint32_t now){
+	uint8_t* m = make_message(packet, appid, n, valid);
+	int res = r_gooseMessage_ValidateSession(m, message_size(m), t, source, ring, reader, now);
+	free(m);
+	return res;
+}
+
+
+static void quarantine(uint8_t* packet){
+	r_goose_session_table* t = r_goose_session_table_new(64);
+	r_goose_session_stats stats;
+	uint32_t n = 1;
+
+	CHECK(r_goose_session_set_admission(t, BURST, RATE, QUARANTINE) == 1, "set admission");
+	CHECK(r_goose_session_set_admission(t, R_GOOSE_ADMISSION_MAX_BURST + 1, RATE, QUARANTINE) == -1, "burst too large accepted");
+	r_goose_session_set_admission(t, BURST, RATE, QUARANTINE);
+
+	// Source 1 - legitimate, source 2 - invalid MAC Tags on the same APPID
+	CHECK(validate(t, packet, 1, 1, n++, 1, 100) == 1, "legitimate stream");
+	for(int i = 0; i < BURST; i++){
+		CHECK(validate(t, packet, 2, 1, n++, 0, 100) == 0, "failure %d verified", i);
+	}
+	CHECK(validate(t, packet, 2, 1, n++, 0, 100) == R_GOOSE_THROTTLED, "stream not quarantined after %d failures", BURST);
+	CHECK(validate(t, packet, 2, 1, n++, 1, 100 + QUARANTINE - 1) == R_GOOSE_THROTTLED, "valid message admitted in quarantine");
+	CHECK(validate(t, packet, 1, 1, n++, 1, 100 + QUARANTINE - 1) == 1, "other source affected by the quarantine");
+	CHECK(validate(t, packet, 2, 2, n++, 1, 100 + QUARANTINE - 1) == 1, "other APPID of the source affected by the quarantine");
+
+	// End of the quarantine - bucket refilled, the stream is verified again
+	CHECK(validate(t, packet, 2, 1, n++, 1, 100 + QUARANTINE) == 1, "stream still blocked after the quarantine");
+	CHECK(validate(t, packet, 2, 1, n++, 0, 100 + QUARANTINE) == 0, "failure after the quarantine");
+
+	r_goose_session_get_stats(t, &stats);
+	printf("Quarantine: failures %llu, quarantines %llu, quarantined %llu, throttled %llu\n",
+		(unsigned long long)stats.failures, (unsigned long long)stats.quarantines,
+		(unsigned long long)stats.quarantined, (unsigned long long)stats.throttled);
+	CHECK(stats.failures == BURST + 1 && stats.quarantines == 1 && stats.quarantined == 2, "counters");
+
+	r_goose_session_table_free(t);
+}
+
+
+static void throttling(uint8_t* packet){
+	r_goose_session_table* t = r_goose_session_table_new(64);
+	uint32_t n = 1;
+	int verified;
+
+	r_goose_session_set_admission(t, BURST, RATE, 0);
+
+	// RATE failures per second - never throttled
+	verified = 0;
+	for(uint32_t now = 1000; now < 1100; now++){
+		for(int i = 0; i < RATE; i++){
+			verified += validate(t, packet, 3, 1, n++, 0, now) == 0;
+		}
+	}
+	CHECK(verified == 100 * RATE, "stream at the allowed failure rate throttled (%d verified)", verified);
+
+	// 10 * RATE failures per second - BURST first, then RATE per second
+	verified = 0;
+	for(uint32_t now = 2000; now < 2100; now++){
+		for(int i = 0; i < 10 * RATE; i++){
+			verified += validate(t, packet, 4, 1, n++, 0, now) == 0;
+		}
+	}
+	CHECK(verified == BURST + 99 * RATE, "throttled stream verified %d times (expected %d)", verified, BURST + 99 * RATE);
+
+	// Disabled admission control - failures only counted
+	r_goose_session_table* off = r_goose_session_table_new(64);
+	verified = 0;
+	for(int i = 0; i < 100; i++){
+		verified += validate(off, packet, 4, 1, n++, 0, 3000) == 0;
+	}
+	CHECK(verified == 100 && off->stats.failures == 100 && off->count == 0, "admission control disabled by default");
+
+	r_goose_session_table_free(off);
+	r_goose_session_table_free(t);
+}
+
+
+static void flood(uint8_t* packet){
+	uint8_t* forged = make_message(packet, 1, 1, 0);
+	struct timespec start, end;
+
+	for(int mode = 0; mode < 2; mode++){
+		r_goose_session_table* t = r_goose_session_table_new(2 * STREAMS);
+		long errors = 0;
+		uint64_t legit_ns = 0, forged_ns = 0;
+		uint32_t n = 0;
+
+		if(mode == 1){
+			r_goose_session_set_admission(t, 50, 10, 60);
+		}
+
+		for(int r = 0; r < ROUNDS; r++){
+			uint32_t now = 5000 + r;
+
+			// One message per legitimate stream (sources 100 ...)
+			uint8_t* legit = make_message(packet, 1, n++, 1);
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			for(int i = 0; i < STREAMS; i++){
+				errors += r_gooseMessage_ValidateSession(legit, message_size(legit), t, 100 + i, ring, reader, now) != 1;
+			}
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			legit_ns += timespecDiff(&end, &start);
+			free(legit);
+
+			// Flood from source 1 (each message with a new SPDU Number, so the replay window doesn't stop it)
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			for(int i = 0; i < FLOOD_PER_ROUND; i++){
+				encodeInt4Bytes(forged, 1000000 + r * FLOOD_PER_ROUND + i, INDEX_SPDU_NUMBER);
+				r_gooseMessage_ValidateSession(forged, message_size(forged), t, 1, ring, reader, now);
+			}
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			forged_ns += timespecDiff(&end, &start);
+		}
+
+		r_goose_session_stats stats;
+		r_goose_session_get_stats(t, &stats);
+
+		printf("%-28s legitimate %7.1f ns/msg   flood %7.1f ns/msg   failures %8llu   dropped %8llu\n",
+			mode == 0 ? "Flood, no admission control" : "Flood, admission control",
+			(double)legit_ns / (ROUNDS * STREAMS), (double)forged_ns / (ROUNDS * FLOOD_PER_ROUND),
+			(unsigned long long)stats.failures, (unsigned long long)(stats.throttled + stats.quarantined));
+
+		CHECK(errors == 0, "%ld legitimate messages rejected", errors);
+		if(mode == 1){
+			// 50 in the burst, then at most 10 per second over the quarantines
+			CHECK(stats.failures <= 50 + 10 * ROUNDS, "flood verified %llu times", (unsigned long long)stats.failures);
+			CHECK(stats.throttled + stats.quarantined + stats.failures == (uint64_t)ROUNDS * FLOOD_PER_ROUND, "flood counters");
+		}
+
+		r_goose_session_table_free(t);
+	}
+
+	free(forged);
+}
+
+static void spoofed_sources(uint8_t* packet){
+	r_goose_session_table* t = r_goose_session_table_new(64);
+	uint8_t* forged = make_message(packet, 1, 1, 0);
+	r_goose_session_stats stats;
+	long errors = 0;
+	uint32_t now = 100;
+
+	r_goose_session_set_admission(t, BURST, RATE, QUARANTINE);
+
+	// 32 authenticated streams, then every spoofed source fails once
+	for(uint32_t i = 0; i < 32; i++){
+		errors += validate(t, packet, 100 + i, 1, 10, 1, now) != 1;
+	}
+	for(uint32_t i = 0; i < 10000; i++){
+		encodeInt4Bytes(forged, i, INDEX_SPDU_NUMBER);
+		errors += r_gooseMessage_ValidateSession(forged, message_size(forged), t, 1000000 + i, ring, reader, now) != 0;
+	}
+	CHECK(errors == 0, "%ld unexpected results before the new streams", errors);
+	CHECK(t->count == 64, "table holds %zu streams", t->count);
+
+	// New authenticated streams during the flood
+	for(uint32_t i = 0; i < 32; i++){
+		CHECK(validate(t, packet, 200 + i, 1, 10, 1, now) == 1, "new stream %u refused", i);
+		encodeInt4Bytes(forged, i, INDEX_SPDU_NUMBER);
+		r_gooseMessage_ValidateSession(forged, message_size(forged), t, 2000000 + i, ring, reader, now);
+	}
+
+	// Authenticated streams are never evicted: replay window kept, further streams refused
+	for(uint32_t i = 0; i < 32; i++){
+		CHECK(validate(t, packet, 100 + i, 1, 10, 1, now) == R_GOOSE_REPLAY, "stream %u lost its replay window", i);
+		CHECK(validate(t, packet, 200 + i, 1, 10, 1, now) == R_GOOSE_REPLAY, "new stream %u lost its replay window", i);
+	}
+	CHECK(validate(t, packet, 300, 1, 10, 1, now) == -1, "stream added to a table full of authenticated streams");
+
+	r_goose_session_get_stats(t, &stats);
+	printf("Spoofed sources: %llu failures, %llu failure-only streams evicted, %llu refused on a full table\n",
+		(unsigned long long)stats.failures, (unsigned long long)stats.evicted, (unsigned long long)stats.table_full);
+	CHECK(stats.evicted == 32 && t->count == 64, "evicted %llu, %zu streams", (unsigned long long)stats.evicted, t->count);
+
+	free(forged);
+	r_goose_session_table_free(t);
+}
+
+
+int main(int argc, char** argv){
+
+	char keyHex[] = "219bcef0cd0f89a5e1297b99d956150f3128459f65312fdd71618f1177393e3f";
+	uint8_t* key = hexStringToBytes(keyHex, 64);
+
+	long len;
+	uint8_t* packet = read_packet("../resources/valid_small.pkt", &len);
+
+	ring = r_goose_keyring_new(16);
+	reader = r_goose_keyring_reader_register(ring);
+
+	// Key ID = APPID
+	r_goose_keyring_publish(ring, 1, 1, HMAC_SHA256_80, ENC_NONE, key, 32, 100, 60);
+	r_goose_keyring_publish(ring, 2, 2, HMAC_SHA256_80, ENC_NONE, key, 32, 100, 60);
+
+	quarantine(packet);
+	throttling(packet);
+	flood(packet);
+	spoofed_sources(packet);
+
+	r_goose_keyring_free(ring);
+	free(packet);
+	free(key);
+
+	printf("\n%s\n", failures == 0 ? "All admission control tests passed" : "Admission control tests FAILED");
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,220 @@
+/*
+	Test file:
+
+		Compile time algorithm selection - r_goose_config.h
+
+		Built with R_GOOSE_SELECT_ALGORITHMS, HMAC_SHA256_80 and AES_128_GCM only (see Makefile).
+
+		1. Selection macros: only the selected algorithms (and MAC_NONE/ENC_NONE) are enabled.
+		2. Selected algorithms on the three resource packets: InsertHMAC/ValidateHMAC,
+		   Encrypt/Decrypt, EncryptTo, and ProtectKeyring/UnprotectKeyring with a key of the pair.
+		3. Algorithms not compiled in are handled as unknown ones: Insert, Validate, Encrypt,
+		   EncryptTo and Decrypt return -1 (message left as it was), and the key ring refuses
+		   their keys.
+		4. Time per message on valid_large.pkt: InsertHMAC + ValidateHMAC and ProtectKeyring +
+		   UnprotectKeyring (to compare with the same build without R_GOOSE_SELECT_ALGORITHMS).
+
+*/
+
+#include "r_goose_security.h"
+#include "r_goose_keyring.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <time.h>
+
+#define ITERATIONS		200000
+
+#if !R_GOOSE_WITH_HMAC_SHA256_80 || !R_GOOSE_WITH_AES_128_GCM || R_GOOSE_WITH_HMAC_SHA256_128 || R_GOOSE_WITH_AES_256_GCM
+#error "test must be built with the selection of its Makefile"
+#endif
+
+int64_t timespecDiff(struct timespec *timeA_p, struct timespec *timeB_p)
+{
+  return ((timeA_p->tv_sec * 1000000000) + timeA_p->tv_nsec) -
+           ((timeB_p->tv_sec * 1000000000) + timeB_p->tv_nsec);
+}
+
+uint8_t* read_packet(char* filename, long* filelen){
+	FILE *fp;
+	unsigned char *buffer;
+
+	fp = fopen(filename, "rb");
+	fseek(fp, 0, SEEK_END);
+	*filelen = ftell(fp);
+	rewind(fp);
+
+	buffer = (unsigned char*) malloc((*filelen)*sizeof(char));
+	fread(buffer, *filelen, 1, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...)	do{ if(!(cond)){ failures++; printf("FAILED: " __VA_ARGS__); printf("\n"); } }while(0)
+
+static r_goose_keyring* ring;
+static int reader;
+
+static uint8_t key[32] = {0x21, 0x9b, 0xce, 0xf0, 0xcd, 0x0f, 0x89, 0xa5, 0xe1, 0x29, 0x7b, 0x99, 0xd9, 0x56, 0x15, 0x0f,
+						  0x31, 0x28, 0x45, 0x9f, 0x65, 0x31, 0x2f, 0xdd, 0x71, 0x61, 0x8f, 0x11, 0x77, 0x39, 0x3e, 0x3f};
+static uint8_t iv[12] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b};
+
+
+static void macros(void){
+	CHECK(R_GOOSE_MAC_ENABLED(MAC_NONE) && R_GOOSE_MAC_ENABLED(HMAC_SHA256_80), "selected MAC algorithms");
+	for(int alg = HMAC_SHA256_128; alg <= MAC_ALGS_COUNT; alg++){
+		CHECK(!R_GOOSE_MAC_ENABLED(alg), "MAC algorithm %d enabled", alg);
+	}
+	CHECK(!R_GOOSE_MAC_ENABLED(-1), "negative MAC algorithm");
+	CHECK(R_GOOSE_ENC_ENABLED(ENC_NONE) && R_GOOSE_ENC_ENABLED(AES_128_GCM), "selected encryption algorithms");
+	CHECK(!R_GOOSE_ENC_ENABLED(AES_256_GCM) && !R_GOOSE_ENC_ENABLED(CHACHA20_POLY1305) && !R_GOOSE_ENC_ENABLED(4), "encryption algorithms enabled");
+}
+
+static void selected(void){
+	char* files[] = {"../resources/valid_small.pkt", "../resources/valid_medium.pkt", "../resources/valid_large.pkt"};
+
+	for(int f = 0; f < 3; f++){
+		long len;
+		uint8_t* packet = read_packet(files[f], &len);
+		uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+		int data_size = decode_2bytesToInt(packet, INDEX_APDU_LENGTH) - 2;
+		uint8_t* buffer = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+		uint8_t* copy = (uint8_t*)malloc(len);
+		uint8_t* message = NULL;
+
+		// Encryption in place and out of place
+		memcpy(buffer, packet, len);
+		CHECK(r_gooseMessage_Encrypt(buffer, key, AES_128_GCM, 100, 60, 1, iv, 12) == 1, "%s: Encrypt", files[f]);
+		CHECK(r_gooseMessage_EncryptTo(packet, copy, len, key, AES_128_GCM, 100, 60, 1, iv, 12) == 1 && memcmp(copy, buffer, len) == 0,
+			  "%s: EncryptTo", files[f]);
+		CHECK(memcmp(&buffer[INDEX_PAYLOAD], &packet[INDEX_PAYLOAD], 16) != 0, "%s: not encrypted", files[f]);
+		CHECK(r_gooseMessage_Decrypt(buffer, key, iv, 12) == 1 && memcmp(&buffer[INDEX_PAYLOAD], &packet[INDEX_PAYLOAD], data_size) == 0,
+			  "%s: Decrypt", files[f]);
+
+		// MAC Tag
+		CHECK(r_gooseMessage_InsertHMAC(packet, key, 32, HMAC_SHA256_80, &message) == 1, "%s: InsertHMAC", files[f]);
+		CHECK(r_gooseMessage_ValidateHMAC(message, key, 32) == 1, "%s: ValidateHMAC", files[f]);
+		message[INDEX_PAYLOAD] ^= 0x10;
+		CHECK(r_gooseMessage_ValidateHMAC(message, key, 32) == 0, "%s: changed message valid", files[f]);
+		r_goose_free(message);
+
+		// Key ring, single pass
+		CHECK(r_goose_keyring_publish(ring, appid, 1, HMAC_SHA256_80, AES_128_GCM, key, 32, 100, 60) == 1, "%s: publish", files[f]);
+		memcpy(buffer, packet, len);
+		int size = r_gooseMessage_ProtectKeyring(buffer, len + MAX_MAC_SIZE, ring, reader, 1, iv, 12);
+		CHECK(size == len + 10, "%s: ProtectKeyring", files[f]);
+		CHECK(r_gooseMessage_UnprotectKeyring(buffer, size, ring, reader, iv, 12) == 1 && memcmp(&buffer[INDEX_PAYLOAD], &packet[INDEX_PAYLOAD], data_size) == 0,
+			  "%s: UnprotectKeyring", files[f]);
+		r_goose_keyring_retire(ring, appid, 1);
+		r_goose_keyring_reclaim(ring);
+
+		free(copy);
+		free(buffer);
+		free(packet);
+	}
+}
+
+static void not_compiled_in(void){
+	long len;
+	uint8_t* packet = read_packet("../resources/valid_medium.pkt", &len);
+	uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+	uint8_t* buffer = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+	uint8_t* message = NULL;
+	int hmacs[] = {HMAC_SHA256_128, HMAC_SHA256_256, HMAC_BLAKE2B_80, HMAC_BLAKE2S_80, BLAKE2B_KEYED_80, BLAKE2S_KEYED_80, HMAC_SHA512_256_80, HMAC_SHA512_256_128};
+	int gmacs[] = {GMAC_AES256_64, GMAC_AES256_128, GMAC_AES128_64, GMAC_AES128_128, CHACHA20_POLY1305_128};
+
+	memcpy(buffer, packet, len);
+	for(int a = 0; a < 8; a++){
+		CHECK(r_gooseMessage_InsertHMAC(buffer, key, 32, hmacs[a], &message) == -1, "InsertHMAC %d", hmacs[a]);
+		CHECK(r_goose_keyring_publish(ring, appid, 2, hmacs[a], AES_128_GCM, key, 32, 100, 60) == -1, "publish MAC %d", hmacs[a]);
+	}
+	for(int a = 0; a < 5; a++){
+		CHECK(r_gooseMessage_InsertGMAC(buffer, key, 32, gmacs[a], &message) == -1, "InsertGMAC %d", gmacs[a]);
+		CHECK(r_goose_keyring_publish(ring, appid, 2, gmacs[a], ENC_NONE, key, 32, 100, 60) == -1, "publish MAC %d", gmacs[a]);
+	}
+	CHECK(r_gooseMessage_Encrypt(buffer, key, AES_256_GCM, 100, 60, 1, iv, 12) == -1, "Encrypt AES_256_GCM");
+	CHECK(r_gooseMessage_Encrypt(buffer, key, CHACHA20_POLY1305, 100, 60, 1, iv, 12) == -1, "Encrypt CHACHA20_POLY1305");
+	CHECK(r_gooseMessage_EncryptTo(packet, buffer, len, key, AES_256_GCM, 100, 60, 1, iv, 12) == -1, "EncryptTo AES_256_GCM");
+	CHECK(r_goose_keyring_publish(ring, appid, 2, HMAC_SHA256_80, CHACHA20_POLY1305, key, 32, 100, 60) == -1, "publish CHACHA20_POLY1305");
+	CHECK(memcmp(buffer, packet, len) == 0, "message changed");
+
+	// Received messages with an algorithm not compiled in
+	CHECK(r_gooseMessage_InsertHMAC(buffer, key, 32, HMAC_SHA256_80, &message) == 1, "InsertHMAC");
+	message[INDEX_MAC_ALG] = HMAC_SHA256_128;
+	CHECK(r_gooseMessage_ValidateHMAC(message, key, 32) == -1, "ValidateHMAC HMAC_SHA256_128");
+	message[INDEX_MAC_ALG] = GMAC_AES128_64;
+	CHECK(r_gooseMessage_ValidateGMAC(message, key, 32) == -1, "ValidateGMAC GMAC_AES128_64");
+	message[INDEX_ENCRYPTION_ALG] = CHACHA20_POLY1305;
+	CHECK(r_gooseMessage_Decrypt(message, key, iv, 12) == -1 && message[INDEX_ENCRYPTION_ALG] == CHACHA20_POLY1305, "Decrypt CHACHA20_POLY1305");
+	r_goose_free(message);
+
+	r_goose_keyring_reclaim(ring);
+	free(buffer);
+	free(packet);
+}
+
+static void timing(void){
+	long len;
+	uint8_t* packet = read_packet("../resources/valid_large.pkt", &len);
+	uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+	uint8_t* buffer = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+	uint8_t* message = NULL;
+	struct timespec start, end;
+	uint64_t hmac_ns, keyring_ns;
+	int ok = 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < ITERATIONS; i++){
+		ok &= r_gooseMessage_InsertHMAC(packet, key, 32, HMAC_SHA256_80, &message) == 1;
+		ok &= r_gooseMessage_ValidateHMAC(message, key, 32) == 1;
+		r_goose_free(message);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	hmac_ns = timespecDiff(&end, &start);
+
+	r_goose_keyring_publish(ring, appid, 1, HMAC_SHA256_80, AES_128_GCM, key, 32, 100, 60);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < ITERATIONS; i++){
+		memcpy(buffer, packet, len);
+		ok &= r_gooseMessage_ProtectKeyring(buffer, len + MAX_MAC_SIZE, ring, reader, 1, iv, 12) == len + 10;
+		ok &= r_gooseMessage_UnprotectKeyring(buffer, len + 10, ring, reader, iv, 12) == 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	keyring_ns = timespecDiff(&end, &start);
+	r_goose_keyring_retire(ring, appid, 1);
+	r_goose_keyring_reclaim(ring);
+
+	CHECK(ok, "timing loops");
+	printf("valid_large.pkt (%ld bytes), %d iterations\n", len, ITERATIONS);
+	printf("\tInsertHMAC + ValidateHMAC (HMAC_SHA256_80):\t\t\t%8.1f ns/message\n", (double)hmac_ns / ITERATIONS);
+	printf("\tProtectKeyring + UnprotectKeyring (HMAC_SHA256_80, AES_128_GCM):\t%8.1f ns/message\n", (double)keyring_ns / ITERATIONS);
+
+	free(buffer);
+	free(packet);
+}
+
+int main(){
+	ring = r_goose_keyring_new(16);
+	reader = r_goose_keyring_reader_register(ring);
+
+	macros();
+	selected();
+	not_compiled_in();
+	timing();
+
+	r_goose_keyring_reader_unregister(ring, reader);
+	r_goose_keyring_free(ring);
+
+	if(failures != 0){
+		printf("%d failures\n", failures);
+		return 1;
+	}
+	printf("All algorithm selection tests passed\n");
+	return 0;
+}
@@ -0,0 +1,461 @@
+/*
+	Test file:
+
+		Allocator hooks - r_goose_set_allocator(), r_goose_malloc()/r_goose_free() and the counting mode
+
+		1. Default allocator: alignment, calloc overflow, invalid registration.
+		2. Application allocator (tracking every block with a header): the constructors of the
+		   library and the buffers it returns (InsertHMAC/InsertGMAC/InsertKeyring *dest,
+		   hexStringToBytes) come from it, and every block is given back to it.
+		3. Allocation failures injected at every allocation of each constructor (OpenSSL ones
+		   included, one child process each): NULL returned and nothing left allocated.
+		4. OpenSSL: its contexts come from the application allocator (and go back to it after
+		   the allocator is changed).
+		5. Counting mode: allocations per call of each path, OpenSSL ones included, after a
+		   first call (reader contexts created): the protect/validate paths of the key ring,
+		   buffers, view and publisher allocate nothing.
+		6. Late registration (child process, OpenSSL used first): the callbacks are set for the
+		   library, OpenSSL keeps its own allocator and r_goose_set_allocator() reports it (1).
+		7. Kernels that allocate the tag (@p *dest NULL): a failed allocation is an error, not a
+		   write through NULL.
+
+		r_goose_set_allocator() is called first (OpenSSL routed to the hooks), and OpenSSL is
+		warmed up with the default allocator, so the tables it keeps for the life of the process
+		are not counted as blocks left by the library.
+
+*/
+
+#include "r_goose_security.h"
+#include "r_goose_keyring.h"
+#include "r_goose_session.h"
+#include "r_goose_dedup.h"
+#include "r_goose_pdu.h"
+#include "r_goose_publisher.h"
+#include "r_goose_view.h"
+#include "r_goose_mbuf.h"
+#include "r_goose_alloc.h"
+#include "blake2_functions.h"
+#include "gmac_functions.h"
+#include "aes_crypto.h"
+#include "chacha_crypto.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <time.h>
+#include <stdalign.h>
+#include <stddef.h>
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <openssl/err.h>
+
+#define ITERATIONS		1000
+
+int64_t timespecDiff(struct timespec *timeA_p, struct timespec *timeB_p)
+{
+  return ((timeA_p->tv_sec * 1000000000) + timeA_p->tv_nsec) -
+           ((timeB_p->tv_sec * 1000000000) + timeB_p->tv_nsec);
+}
+
+uint8_t* read_packet(char* filename, long* filelen){
+	FILE *fp;
+	unsigned char *buffer;
+
+	fp = fopen(filename, "rb");
+	fseek(fp, 0, SEEK_END);
+	*filelen = ftell(fp);
+	rewind(fp);
+
+	buffer = (unsigned char*) malloc((*filelen)*sizeof(char));
+	fread(buffer, *filelen, 1, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...)	do{ if(!(cond)){ failures++; printf("FAILED: " __VA_ARGS__); printf("\n"); } }while(0)
+
+// Number of bytes "received" for a well formed message
+static size_t message_size(const uint8_t* m){
+	return (size_t)decode_4bytesToInt((uint8_t*)m, INDEX_SPDU_LENGTH) + 10;
+}
+
+static uint8_t key[32] = {0x21, 0x9b, 0xce, 0xf0, 0xcd, 0x0f, 0x89, 0xa5, 0xe1, 0x29, 0x7b, 0x99, 0xd9, 0x56, 0x15, 0x0f,
+						  0x31, 0x28, 0x45, 0x9f, 0x65, 0x31, 0x2f, 0xdd, 0x71, 0x61, 0x8f, 0x11, 0x77, 0x39, 0x3e, 0x3f};
+static uint8_t iv[12] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b};
+
+// Application allocator: blocks with a header (magic, size) in front, counted in the context
+#define BLOCK_HEADER	64
+#define BLOCK_MAGIC		0x52474f4f53454d41ULL
+
+typedef struct tracker {
+	long live;
+	long allocs;
+	long fail_at;		// allocation number that fails (-1: none)
+} tracker;
+
+static void* tracking_alloc(size_t size, size_t align, void* ctx){
+	tracker* t = (tracker*)ctx;
+	uint8_t* base;
+
+	if(align > BLOCK_HEADER || t->allocs++ == t->fail_at){
+		return NULL;
+	}
+	base = (uint8_t*)aligned_alloc(BLOCK_HEADER, (BLOCK_HEADER + size + BLOCK_HEADER - 1) / BLOCK_HEADER * BLOCK_HEADER);
+	if(base == NULL){
+		return NULL;
+	}
+	((uint64_t*)base)[0] = BLOCK_MAGIC;
+	((uint64_t*)base)[1] = size;
+	t->live++;
+	return base + BLOCK_HEADER;
+}
+
+static void tracking_free(void* ptr, void* ctx){
+	tracker* t = (tracker*)ctx;
+	uint8_t* base = (uint8_t*)ptr - BLOCK_HEADER;
+
+	if(((uint64_t*)base)[0] != BLOCK_MAGIC){
+		failures++;
+		printf("FAILED: block not allocated by the application allocator\n");
+		return;
+	}
+	((uint64_t*)base)[0] = 0;
+	t->live--;
+	free(base);
+}
+
+static int from_tracker(void* ptr){
+	return ptr != NULL && ((uint64_t*)((uint8_t*)ptr - BLOCK_HEADER))[0] == BLOCK_MAGIC;
+}
+
+static int types[] = {R_GOOSE_DATA_FLOAT32, R_GOOSE_DATA_QUALITY, R_GOOSE_DATA_BOOLEAN};
+static r_goose_pdu_config cfg = {"IED1LD0/LLN0$GO$gcb1", "IED1LD0/LLN0$DataSet1", "IED1", 2000, 1, 0, 0, 0x0A, types, 3};
+
+static void defaults(void){
+	void* p = r_goose_malloc(100);
+	void* a = r_goose_aligned_alloc(256, 1000);
+	uint8_t* z = (uint8_t*)r_goose_calloc(50, 4);
+	int zeroed = 1;
+
+	for(int i = 0; i < 200; i++){
+		zeroed &= z[i] == 0;
+	}
+	CHECK(p != NULL && ((uintptr_t)p % alignof(max_align_t)) == 0, "malloc");
+	CHECK(a != NULL && ((uintptr_t)a % 256) == 0, "aligned_alloc");
+	CHECK(z != NULL && zeroed, "calloc");
+	CHECK(r_goose_calloc(SIZE_MAX / 2, 4) == NULL, "calloc overflow");
+	CHECK(r_goose_set_allocator(tracking_alloc, NULL, NULL) == -1 && r_goose_set_allocator(NULL, tracking_free, NULL) == -1, "invalid registration");
+	r_goose_free(p);
+	r_goose_free(a);
+	r_goose_free(z);
+	r_goose_free(NULL);
+}
+
+// Creates and releases one object of each constructor. Returns the number of constructors that failed.
+static int constructors(uint8_t* packet){
+	int failed = 0;
+
+	r_goose_keyring* ring = r_goose_keyring_new(16);
+	failed += ring == NULL;
+	if(ring != NULL){
+		int reader = r_goose_keyring_reader_register(ring);
+		uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+		if(r_goose_keyring_publish(ring, appid, 1, HMAC_SHA256_80, ENC_NONE, key, 32, 100, 60) < 0){
+			failed++;
+		}else{
+			// The publisher needs the published key (without encryption)
+			r_goose_publisher* pub = r_goose_publisher_new(packet, ring, reader, 1, 1500);
+			failed += pub == NULL;
+			r_goose_publisher_free(pub);
+		}
+		r_goose_keyring_free(ring);
+	}
+
+	r_goose_session_table* table = r_goose_session_table_new(64);
+	failed += table == NULL;
+	r_goose_session_table_free(table);
+
+	r_goose_dedup* dedup = r_goose_dedup_new(64, 1600, 1000);
+	failed += dedup == NULL;
+	r_goose_dedup_free(dedup);
+
+	r_goose_pdu_template* pdu = r_goose_pdu_template_new(&cfg);
+	failed += pdu == NULL;
+	r_goose_pdu_template_free(pdu);
+
+	r_goose_layout_cache* cache = r_goose_layout_cache_new(16, 1500);
+	failed += cache == NULL;
+	r_goose_layout_cache_free(cache);
+
+	r_goose_mbuf_pool* pool = r_goose_mbuf_pool_new(16, R_GOOSE_MBUF_HEADROOM, 1600);
+	failed += pool == NULL;
+	r_goose_mbuf_pool_free(pool);
+
+	return failed;
+}
+
+static void application_allocator(uint8_t* packet){
+	tracker t = {0, 0, -1};
+	uint8_t* dest = NULL;
+
+	r_goose_set_allocator(tracking_alloc, tracking_free, &t);
+
+	CHECK(constructors(packet) == 0 && t.allocs > 0, "constructors with the application allocator");
+	CHECK(t.live == 0, "%ld blocks left by the constructors", t.live);
+
+	CHECK(r_gooseMessage_InsertHMAC(packet, key, 32, HMAC_SHA256_80, &dest) > 0 && from_tracker(dest), "InsertHMAC *dest");
+	r_goose_free(dest);
+	dest = NULL;
+	CHECK(r_gooseMessage_InsertGMAC(packet, key, 32, GMAC_AES256_64, &dest) > 0 && from_tracker(dest), "InsertGMAC *dest");
+	r_goose_free(dest);
+	dest = NULL;
+
+	r_goose_keyring* ring = r_goose_keyring_new(16);
+	int reader = r_goose_keyring_reader_register(ring);
+	r_goose_keyring_publish(ring, decode_2bytesToInt(packet, INDEX_APPID), 1, HMAC_SHA256_80, AES_128_GCM, key, 32, 100, 60);
+	CHECK(r_gooseMessage_InsertKeyring(packet, ring, reader, 1, &dest) > 0 && from_tracker(dest), "InsertKeyring *dest");
+	r_goose_free(dest);
+	r_goose_keyring_free(ring);
+
+	uint8_t* bytes = hexStringToBytes("00112233", 8);
+	CHECK(from_tracker(bytes) && bytes[3] == 0x33, "hexStringToBytes");
+	r_goose_free(bytes);
+
+	CHECK(t.live == 0, "%ld blocks not given back", t.live);
+
+	r_goose_set_allocator(NULL, NULL, NULL);
+}
+
+static void allocation_failures(uint8_t* packet){
+	tracker t = {0, 0, -1};
+
+	r_goose_set_allocator(tracking_alloc, tracking_free, &t);
+	constructors(packet);
+	long total = t.allocs;
+
+	/* Every allocation of the run fails once, in a child process: each constructor that fails returns NULL and
+	   leaves nothing. A failure inside OpenSSL may be absorbed by it (no constructor fails) and leave blocks in its
+	   error queue and caches, so those are released (ERR_clear_error(), OPENSSL_cleanup()) before counting */
+	long absorbed = 0;
+	for(long n = 0; n < total; n++){
+		pid_t pid = fork();
+		if(pid == 0){
+			t.allocs = 0;
+			t.fail_at = n;
+			int failed = constructors(packet);
+			ERR_clear_error();
+			OPENSSL_cleanup();
+			_exit(failed > 1 ? 2 : (t.live != 0 ? 3 : (failed == 0 ? 1 : 0)));
+		}
+		int status = -1;
+		waitpid(pid, &status, 0);
+		int code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+		CHECK(code == 0 || code == 1, "allocation %ld failed: %s", n,
+			  code == 2 ? "several constructors failed" : code == 3 ? "blocks left" : "child crashed");
+		absorbed += code == 1;
+	}
+	printf("Allocation failures: %ld allocations, %ld absorbed by OpenSSL\n", total, absorbed);
+	CHECK(absorbed < total, "no constructor failed");
+
+	r_goose_set_allocator(NULL, NULL, NULL);
+}
+
+static void openssl(void){
+	tracker t = {0, 0, -1};
+
+	r_goose_set_allocator(tracking_alloc, tracking_free, &t);
+
+	EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+	CHECK(ctx != NULL && t.allocs > 0 && t.live > 0, "EVP_CIPHER_CTX_new(): %ld blocks from the application allocator", t.live);
+	CHECK(EVP_EncryptInit_ex(ctx, EVP_aes_128_gcm(), NULL, key, iv) == 1 && t.live > 1, "EVP_EncryptInit_ex(): %ld blocks", t.live);
+
+	// Released after the allocator is changed: the blocks still go back to the application allocator
+	r_goose_set_allocator(NULL, NULL, NULL);
+	EVP_CIPHER_CTX_free(ctx);
+	CHECK(t.live == 0, "%ld OpenSSL blocks not given back", t.live);
+}
+
+static void late_registration(void){
+	pid_t pid = fork();
+	if(pid == 0){
+		tracker t = {0, 0, -1};
+		EVP_CIPHER_CTX_free(EVP_CIPHER_CTX_new());
+
+		int res = r_goose_set_allocator(tracking_alloc, tracking_free, &t);
+		void* p = r_goose_malloc(100);
+		int library = from_tracker(p);
+		r_goose_free(p);
+		EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+		int openssl = ctx != NULL && !from_tracker(ctx);
+		EVP_CIPHER_CTX_free(ctx);
+		_exit(res != 1 ? 2 : r_goose_alloc_openssl_hooked() != 0 ? 3 : !library ? 4 : !openssl ? 5 : t.live != 0 ? 6 : 0);
+	}
+	int status = -1;
+	waitpid(pid, &status, 0);
+	int code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+	CHECK(code == 0, "late registration: %s", code == 2 ? "not reported" : code == 3 ? "OpenSSL reported hooked" :
+		  code == 4 ? "callbacks not set" : code == 5 ? "OpenSSL block from the callbacks" : code == 6 ? "blocks left" : "child crashed");
+}
+
+static void kernel_failures(uint8_t* packet){
+	tracker t = {0, 0, -1};
+	uint8_t* tag = NULL;
+
+	r_goose_set_allocator(tracking_alloc, tracking_free, &t);
+
+	t.fail_at = t.allocs;
+	CHECK(blake2b_80(packet, key, 100, 32, &tag) == 1 && tag == NULL, "blake2b_80 allocation failure");
+	t.fail_at = t.allocs;
+	CHECK(blake2s_80(packet, key, 100, 32, &tag) == 1 && tag == NULL, "blake2s_80 allocation failure");
+	t.fail_at = t.allocs;
+	CHECK(gmac_AES128_64(packet, key, iv, 100, 12, &tag) == 1 && tag == NULL, "gmac_AES128_64 allocation failure");
+	t.fail_at = t.allocs;
+	CHECK(gmac_AES256_128(packet, key, iv, 100, 12, &tag) == 1 && tag == NULL, "gmac_AES256_128 allocation failure");
+	t.fail_at = t.allocs;
+	CHECK(poly1305_CHACHA20_128(packet, key, iv, 100, 12, &tag) == 1 && tag == NULL, "poly1305_CHACHA20_128 allocation failure");
+	t.fail_at = t.allocs;
+	CHECK(aes_128_gcm_encrypt(packet, key, iv, 100, 12, &tag) == -1 && tag == NULL, "aes_128_gcm_encrypt allocation failure");
+	t.fail_at = t.allocs;
+	CHECK(aes_256_gcm_decrypt(packet, key, iv, 100, 12, &tag) == -1 && tag == NULL, "aes_256_gcm_decrypt allocation failure");
+	t.fail_at = t.allocs;
+	CHECK(chacha20_poly1305_encrypt(packet, key, iv, 100, 12, &tag) == -1 && tag == NULL, "chacha20_poly1305_encrypt allocation failure");
+
+	CHECK(t.live == 0, "kernels: %ld blocks left", t.live);
+	r_goose_set_allocator(NULL, NULL, NULL);
+}
+
+// OpenSSL initialization and the algorithms it fetches, kept until the process ends
+static void warm_up(uint8_t* packet){
+	uint8_t* dest = NULL;
+
+	constructors(packet);
+	r_gooseMessage_InsertHMAC(packet, key, 32, HMAC_SHA256_80, &dest);
+	r_goose_free(dest);
+	dest = NULL;
+	r_gooseMessage_InsertGMAC(packet, key, 32, GMAC_AES256_64, &dest);
+	r_goose_free(dest);
+
+	EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+	EVP_EncryptInit_ex(ctx, EVP_aes_128_gcm(), NULL, key, iv);
+	EVP_CIPHER_CTX_free(ctx);
+
+	// Error queue of the thread (created by the first error, e.g. an allocation failure)
+	ERR_raise(ERR_LIB_EVP, ERR_R_MALLOC_FAILURE);
+	ERR_clear_error();
+}
+
+static long allocations(r_goose_alloc_stats* before){
+	r_goose_alloc_stats after;
+	r_goose_alloc_get_stats(&after);
+	return (long)(after.allocs - before->allocs);
+}
+
+#define COUNT(name, expected, ...)	do{ \
+		r_goose_alloc_stats before; \
+		{ int i = -1; (void)i; __VA_ARGS__; } \
+		r_goose_alloc_get_stats(&before); \
+		for(int i = 0; i < ITERATIONS; i++){ __VA_ARGS__; } \
+		long n = allocations(&before); \
+		printf("  %-40s %5.2f allocations/call\n", name, (double)n / ITERATIONS); \
+		CHECK(n == (long)(expected) * ITERATIONS, "%s: %ld allocations", name, n); \
+	}while(0)
+
+static void counting(uint8_t* packet, long len){
+	r_goose_keyring* ring = r_goose_keyring_new(16);
+	int reader = r_goose_keyring_reader_register(ring);
+	uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+	uint8_t* buffer = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+	uint8_t* protected = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+	uint8_t* out[2] = {(uint8_t*)malloc(len + MAX_MAC_SIZE), (uint8_t*)malloc(len + MAX_MAC_SIZE)};
+	uint8_t* dest;
+	uint8_t tag_buffer[MAX_MAC_SIZE];
+	r_goose_fanout_target targets[2] = {{1, 1, NULL, 0, out[0], len + MAX_MAC_SIZE, 0}, {2, 1, NULL, 0, out[1], len + MAX_MAC_SIZE, 0}};
+	r_goose_view view;
+
+	r_goose_keyring_publish(ring, appid, 1, HMAC_SHA256_80, AES_128_GCM, key, 32, 100, 60);
+	r_goose_keyring_publish(ring, appid, 2, GMAC_AES256_128, ENC_NONE, key, 32, 100, 60);
+	memcpy(protected, packet, len);
+	int size = r_gooseMessage_ProtectKeyring(protected, len + MAX_MAC_SIZE, ring, reader, 2, NULL, 0);
+
+	r_goose_mbuf_pool* pool = r_goose_mbuf_pool_new(4, R_GOOSE_MBUF_HEADROOM, 1600);
+	r_goose_mbuf* src = r_goose_mbuf_alloc(pool);
+	memcpy(r_goose_mbuf_append(src, len), packet, len);
+	r_goose_layout_cache* cache = r_goose_layout_cache_new(16, 1500);
+	r_goose_publisher* pub = r_goose_publisher_new(packet, ring, reader, 2, 1500);
+	r_goose_pdu_template* pdu = r_goose_pdu_template_new(&cfg);
+	r_goose_pdu_encode(pdu, r_goose_publisher_payload(pub), 1500);
+
+	r_goose_alloc_count(1);
+	printf("valid_large.pkt (%ld bytes), allocations per call\n", len);
+
+	/* The legacy entry points use OpenSSL per call (HMAC() and a cipher context each): counts measured with
+	   OpenSSL 3.0, the output buffer of InsertHMAC/InsertKeyring included */
+	COUNT("r_gooseMessage_InsertHMAC", 14, dest = NULL; r_gooseMessage_InsertHMAC(packet, key, 32, HMAC_SHA256_80, &dest); r_goose_free(dest));
+	COUNT("r_gooseMessage_InsertKeyring", 1, r_gooseMessage_InsertKeyring(packet, ring, reader, 1, &dest); r_goose_free(dest));
+	COUNT("r_gooseMessage_Encrypt", 3, memcpy(buffer, packet, len); r_gooseMessage_Encrypt(buffer, key, AES_128_GCM, 1, 1, 1, iv, 12));
+	COUNT("r_gooseMessage_EncryptTo", 3, r_gooseMessage_EncryptTo(packet, buffer, len, key, AES_128_GCM, 1, 1, 1, iv, 12));
+	COUNT("r_gooseMessage_ValidateKeyring", 0, r_gooseMessage_ValidateKeyring(protected, message_size(protected), ring, reader));
+	COUNT("r_gooseMessage_ProtectKeyring", 0, memcpy(buffer, packet, len); r_gooseMessage_ProtectKeyring(buffer, len + MAX_MAC_SIZE, ring, reader, 1, NULL, 0));
+	COUNT("r_gooseMessage_UnprotectKeyring", 0, r_gooseMessage_UnprotectKeyring(buffer, message_size(buffer), ring, reader, NULL, 0));
+	COUNT("r_gooseMessage_ProtectKeyringTo", 0, r_gooseMessage_ProtectKeyringTo(packet, buffer, len + MAX_MAC_SIZE, ring, reader, 1, NULL, 0));
+	COUNT("r_gooseMessage_ProtectKeyringFanout", 0, r_gooseMessage_ProtectKeyringFanout(packet, targets, 2, ring, reader));
+	COUNT("r_gooseMessage_ProtectKeyringV", 0,
+		  memcpy(buffer, packet, len);
+		  struct iovec iov[2] = {{buffer, 100}, {&buffer[100], len - 100}};
+		  struct iovec tag = {tag_buffer, sizeof(tag_buffer)};
+		  r_gooseMessage_ProtectKeyringV(iov, 2, &tag, ring, reader, 1, NULL, 0));
+	COUNT("r_gooseMessage_ProtectMbufTo", 0,
+		  r_goose_mbuf* m = r_goose_mbuf_alloc(pool);
+		  r_gooseMessage_ProtectMbufTo(src, m, ring, reader, 1, NULL, 0);
+		  r_goose_mbuf_release(m));
+	COUNT("r_gooseMessage_ValidateView", 0, r_gooseMessage_ValidateView(protected, message_size(protected), ring, reader, &view));
+	COUNT("r_gooseMessage_ValidateViewCached", 0, r_gooseMessage_ValidateViewCached(protected, message_size(protected), ring, reader, cache, &view));
+	COUNT("r_goose_publisher_sign", 0, uint8_t* message; r_goose_pdu_set_sqnum(pdu, i); r_goose_publisher_sign(pub, pdu->size, &message));
+
+	r_goose_alloc_count(0);
+	CHECK(size > 0, "protected message");
+
+	r_goose_pdu_template_free(pdu);
+	r_goose_publisher_free(pub);
+	r_goose_layout_cache_free(cache);
+	r_goose_mbuf_release(src);
+	r_goose_mbuf_pool_free(pool);
+	r_goose_keyring_free(ring);
+	free(out[0]);
+	free(out[1]);
+	free(protected);
+	free(buffer);
+}
+
+
+int main(int argc, char** argv){
+
+	long len;
+	uint8_t* packet = read_packet("../resources/valid_large.pkt", &len);
+
+	late_registration();
+
+	// Before OpenSSL allocates anything
+	CHECK(r_goose_set_allocator(NULL, NULL, NULL) == 0 && r_goose_alloc_openssl_hooked() == 1, "OpenSSL routed to the allocator");
+	warm_up(packet);
+
+	defaults();
+	application_allocator(packet);
+	allocation_failures(packet);
+	openssl();
+	kernel_failures(packet);
+	counting(packet, len);
+
+	free(packet);
+
+	printf("\n%s\n", failures == 0 ? "All allocator tests passed" : "Allocator tests FAILED");
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+/* 
+	Test file: 
+
+		Native keyed BLAKE2 MAC (BLAKE2B_KEYED_80 / BLAKE2S_KEYED_80)
+			- Keyed Known Answer Tests (BLAKE2 reference KAT, empty message)
+			- r_gooseMessage_InsertHMAC() / r_gooseMessage_ValidateHMAC() round trip
+			- Timing against the HMAC-wrapped variants (HMAC_BLAKE2B_80 / HMAC_BLAKE2S_80)
+
+*/
+
+#include "r_goose_security.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <time.h>
+
+int64_t timespecDiff(struct timespec *timeA_p, struct timespec *timeB_p)
+{
+  return ((timeA_p->tv_sec * 1000000000) + timeA_p->tv_nsec) -
+           ((timeB_p->tv_sec * 1000000000) + timeB_p->tv_nsec);
+}
+
+uint8_t* read_packet(char* filename){
+	FILE *fp;
+	unsigned char *buffer;
+	long filelen;
+
+	fp = fopen(filename, "rb");
+	if(fp == NULL){
+		perror(filename);
+		exit(1);
+	}
+
+	fseek(fp, 0, SEEK_END);
+	filelen = ftell(fp);
+	rewind(fp);
+
+	buffer = (unsigned char*) malloc(filelen*sizeof(char));
+	fread(buffer, filelen, 1, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+void kat(){
+	// Key = 00 01 02 ... , message = empty, full length digest
+	char b2bHex[] = "10ebb67700b1868efb4417987acf4690ae9d972fb7a590c2f02871799aaa4786b5e996e8f0f4eb981fc214b005f42d2ff4233499391653df7aefcbc13fc51568";
+	char b2sHex[] = "48a8997da407876b3d79c0d92325ad3b89cbb754d86ab71aee047ad345fd2c49";
+
+	uint8_t* b2bExpected = hexStringToBytes(b2bHex, 128);
+	uint8_t* b2sExpected = hexStringToBytes(b2sHex, 64);
+
+	uint8_t key[64], out[64];
+	for(int i = 0; i < 64; i++){
+		key[i] = i;
+	}
+
+	for(int simd = 0; simd < 2; simd++){
+		blake2b_state S;
+		blake2b_init_key(&S, 64, key, 64, simd);
+		blake2b_final(&S, out);
+		printf("BLAKE2b keyed KAT (simd=%d): %s\n", simd, memcmp(out, b2bExpected, 64) == 0 ? "ok" : "FAIL");
+
+		blake2s_state T;
+		blake2s_init_key(&T, 32, key, 32, simd);
+		blake2s_final(&T, out);
+		printf("BLAKE2s keyed KAT (simd=%d): %s\n", simd, memcmp(out, b2sExpected, 32) == 0 ? "ok" : "FAIL");
+	}
+
+	free(b2bExpected);
+	free(b2sExpected);
+}
+
+double bench(uint8_t* packet, uint8_t* key, int key_size, int alg, int iterations){
+	uint8_t* dest = NULL;
+	struct timespec start, end;
+
+	if(r_gooseMessage_InsertHMAC(packet, key, key_size, alg, &dest) != 1){
+		printf("InsertHMAC error (alg %d)\n", alg);
+		return -1;
+	}
+
+	if(r_gooseMessage_ValidateHMAC(dest, key, key_size) != 1){
+		printf("ValidateHMAC: invalid tag (alg %d)\n", alg);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < iterations; i++){
+		r_gooseMessage_ValidateHMAC(dest, key, key_size);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	free(dest);
+
+	return (double)timespecDiff(&end, &start) / iterations;
+}
+
+int main(int argc, char** argv){
+
+	char keyHex[] = "11754cd72aec309bf52f7687212e8957";
+	uint8_t* key = hexStringToBytes(keyHex, 32);
+	int key_size = 16;
+
+	int iterations = 100000;
+
+	char* files[] = {"../resources/valid_small.pkt", "../resources/valid_medium.pkt", "../resources/valid_large.pkt"};
+
+	kat();
+
+	for(int f = 0; f < 3; f++){
+		uint8_t* packet = read_packet(files[f]);
+
+		printf("\n%s\n", files[f]);
+		printf("\tHMAC_BLAKE2B_80  : %8.1lf ns/validate\n", bench(packet, key, key_size, HMAC_BLAKE2B_80, iterations));
+		printf("\tBLAKE2B_KEYED_80 : %8.1lf ns/validate\n", bench(packet, key, key_size, BLAKE2B_KEYED_80, iterations));
+		printf("\tHMAC_BLAKE2S_80  : %8.1lf ns/validate\n", bench(packet, key, key_size, HMAC_BLAKE2S_80, iterations));
+		printf("\tBLAKE2S_KEYED_80 : %8.1lf ns/validate\n", bench(packet, key, key_size, BLAKE2S_KEYED_80, iterations));
+
+		free(packet);
+	}
+
+	free(key);
+}
@@ -0,0 +1,168 @@
+/* 
+	Test file: 
+
+		ChaCha20-Poly1305 against AES-GCM/GMAC
+			- r_gooseMessage_Encrypt() / r_gooseMessage_Decrypt() round trip (CHACHA20_POLY1305)
+			- r_gooseMessage_InsertGMAC() / r_gooseMessage_ValidateGMAC() round trip (CHACHA20_POLY1305_128)
+			- CHACHA20_POLY1305_128 nonce: salt || SPDU Number, not the all-zero IV of GMAC
+			- Timing of every encryption and GMAC-like algorithm on valid_small/medium/large.pkt
+
+		"make bench" runs the timings twice: with the default OpenSSL capabilities and with
+		AES-NI/PCLMULQDQ masked off (OPENSSL_ia32cap), emulating hosts without AES acceleration.
+
+*/
+
+#include "r_goose_security.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <time.h>
+
+int64_t timespecDiff(struct timespec *timeA_p, struct timespec *timeB_p)
+{
+  return ((timeA_p->tv_sec * 1000000000) + timeA_p->tv_nsec) -
+           ((timeB_p->tv_sec * 1000000000) + timeB_p->tv_nsec);
+}
+
+uint8_t* read_packet(char* filename, long* filelen){
+	FILE *fp;
+	unsigned char *buffer;
+
+	fp = fopen(filename, "rb");
+	if(fp == NULL){
+		perror(filename);
+		exit(1);
+	}
+
+	fseek(fp, 0, SEEK_END);
+	*filelen = ftell(fp);
+	rewind(fp);
+
+	buffer = (unsigned char*) malloc((*filelen)*sizeof(char));
+	fread(buffer, *filelen, 1, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+double bench_encrypt(uint8_t* packet, long len, uint8_t* key, uint8_t* iv, int iv_size, int alg, int iterations){
+	struct timespec start, end;
+	uint8_t* buffer = (uint8_t*)malloc(len);
+	memcpy(buffer, packet, len);
+
+	// Round trip check
+	r_gooseMessage_Encrypt(buffer, key, alg, 1, 1, 1, iv, iv_size);
+	r_gooseMessage_Decrypt(buffer, key, iv, iv_size);
+	if(memcmp(&buffer[INDEX_PAYLOAD], &packet[INDEX_PAYLOAD], len-INDEX_PAYLOAD) != 0){
+		printf("Encrypt/Decrypt round trip FAILED (alg %d)\n", alg);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < iterations; i++){
+		r_gooseMessage_Encrypt(buffer, key, alg, 1, 1, 1, iv, iv_size);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	free(buffer);
+
+	return (double)timespecDiff(&end, &start) / iterations;
+}
+
+double bench_mac(uint8_t* packet, uint8_t* key, int alg, int iterations){
+	struct timespec start, end;
+	uint8_t* dest = NULL;
+
+	r_gooseMessage_InsertGMAC(packet, key, 32, alg, &dest);
+	if(r_gooseMessage_ValidateGMAC(dest, key, 32) != 1){
+		printf("InsertGMAC/ValidateGMAC round trip FAILED (alg %d)\n", alg);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < iterations; i++){
+		r_gooseMessage_ValidateGMAC(dest, key, 32);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	free(dest);
+
+	return (double)timespecDiff(&end, &start) / iterations;
+}
+
+int check_nonce(uint8_t* packet, uint8_t* key){
+	uint8_t* dest = NULL;
+	uint8_t zero_iv[12] = {0}, nonce[12], other[12], tag[16];
+	uint8_t* tag_ptr = tag;
+	int failures = 0;
+
+	r_gooseMessage_InsertGMAC(packet, key, 32, CHACHA20_POLY1305_128, &dest);
+	long messageSize = decode_4bytesToInt(dest, INDEX_SPDU_LENGTH) + 10;
+	uint32_t spdu_number = decode_4bytesToInt(dest, INDEX_SPDU_NUMBER);
+
+	// The tag is the one of the derived nonce
+	poly1305_CHACHA20_nonce(key, spdu_number, nonce);
+	poly1305_CHACHA20_128(&dest[2], key, nonce, messageSize - 4 - 16, 12, &tag_ptr);
+	if(memcmp(tag, &dest[messageSize - 16], 16) != 0){
+		printf("CHACHA20_POLY1305_128 tag not computed with the derived nonce\n");
+		failures++;
+	}
+	poly1305_CHACHA20_128(&dest[2], key, zero_iv, messageSize - 4 - 16, 12, &tag_ptr);
+	if(memcmp(tag, &dest[messageSize - 16], 16) == 0){
+		printf("CHACHA20_POLY1305_128 tag computed with the all-zero nonce\n");
+		failures++;
+	}
+
+	// Every SPDU Number has its own nonce (a one-time Poly1305 key)
+	poly1305_CHACHA20_nonce(key, spdu_number + 1, other);
+	if(memcmp(nonce, other, 12) == 0 || memcmp(nonce, &other[0], POLY1305_NONCE_SALT_SIZE) != 0){
+		printf("CHACHA20_POLY1305_128 nonce not salt || SPDU Number\n");
+		failures++;
+	}
+
+	free(dest);
+	return failures;
+}
+
+int main(int argc, char** argv){
+
+	char keyHex[] = "219bcef0cd0f89a5e1297b99d956150f3128459f65312fdd71618f1177393e3f";
+	uint8_t* key = hexStringToBytes(keyHex, 64);
+
+	char ivHex[] = "75b66d3df73da95345c11a32";
+	uint8_t* iv = hexStringToBytes(ivHex,24);
+	int iv_size = 12;
+
+	int iterations = 100000;
+
+	char* files[] = {"../resources/valid_small.pkt", "../resources/valid_medium.pkt", "../resources/valid_large.pkt"};
+
+	long nonce_len;
+	uint8_t* nonce_packet = read_packet(files[0], &nonce_len);
+	int failures = check_nonce(nonce_packet, key);
+	free(nonce_packet);
+
+	char* cap = getenv("OPENSSL_ia32cap");
+	printf("OPENSSL_ia32cap = %s\n", cap == NULL ? "(default)" : cap);
+
+	for(int f = 0; f < 3; f++){
+		long len;
+		uint8_t* packet = read_packet(files[f], &len);
+
+		printf("\n%s\n", files[f]);
+		printf("\tEncrypt AES_128_GCM           : %8.1lf ns\n", bench_encrypt(packet, len, key, iv, iv_size, AES_128_GCM, iterations));
+		printf("\tEncrypt AES_256_GCM           : %8.1lf ns\n", bench_encrypt(packet, len, key, iv, iv_size, AES_256_GCM, iterations));
+		printf("\tEncrypt CHACHA20_POLY1305     : %8.1lf ns\n", bench_encrypt(packet, len, key, iv, iv_size, CHACHA20_POLY1305, iterations));
+		printf("\tValidate GMAC_AES128_128      : %8.1lf ns\n", bench_mac(packet, key, GMAC_AES128_128, iterations));
+		printf("\tValidate GMAC_AES256_128      : %8.1lf ns\n", bench_mac(packet, key, GMAC_AES256_128, iterations));
+		printf("\tValidate CHACHA20_POLY1305_128: %8.1lf ns\n", bench_mac(packet, key, CHACHA20_POLY1305_128, iterations));
+
+		free(packet);
+	}
+
+	free(key);
+	free(iv);
+
+	return failures != 0;
+}
@@ -0,0 +1,290 @@
+/*
+	Test file:
+
+		Header-only C++ interface - r_goose_security.hpp
+
+		1. Compile time: tag sizes equal to MAC_SIZES, Key/Signer/Verifier/Buffer move-only.
+		2. Every MAC algorithm on the three resource packets: signed message byte-identical to
+		   r_gooseMessage_InsertHMAC()/InsertGMAC(), accepted by Verifier and by
+		   r_gooseMessage_ValidateHMAC()/ValidateGMAC(). Changed message or MAC Tag: invalid.
+		3. Errors: key size not accepted by the algorithm, moved from key, storage too small
+		   (message left unchanged), MAC Algorithm of the message other than the Verifier's,
+		   SPDU Length beyond the message. The MAC Tag function of one family (picked by Key at
+		   compile time) refuses a key of another family.
+		4. Allocations, OpenSSL ones included (counting mode of r_goose_alloc.h): sign and verify
+		   make none for HMAC, keyed BLAKE2, GMAC and Poly1305; a Key releases what it built.
+		5. Time per message on valid_large.pkt: InsertHMAC + ValidateHMAC vs Signer + Verifier,
+		   for HMAC_SHA256_80 and GMAC_AES128_64.
+
+*/
+
+#include "r_goose_security.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <time.h>
+
+#include <type_traits>
+#include <utility>
+
+#define ITERATIONS		200000
+
+int64_t timespecDiff(struct timespec *timeA_p, struct timespec *timeB_p)
+{
+  return ((timeA_p->tv_sec * 1000000000) + timeA_p->tv_nsec) -
+           ((timeB_p->tv_sec * 1000000000) + timeB_p->tv_nsec);
+}
+
+uint8_t* read_packet(const char* filename, long* filelen){
+	FILE *fp;
+	unsigned char *buffer;
+
+	fp = fopen(filename, "rb");
+	fseek(fp, 0, SEEK_END);
+	*filelen = ftell(fp);
+	rewind(fp);
+
+	buffer = (unsigned char*) malloc((*filelen)*sizeof(char));
+	fread(buffer, *filelen, 1, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...)	do{ if(!(cond)){ failures++; printf("FAILED: " __VA_ARGS__); printf("\n"); } }while(0)
+
+static uint8_t key[32] = {0x21, 0x9b, 0xce, 0xf0, 0xcd, 0x0f, 0x89, 0xa5, 0xe1, 0x29, 0x7b, 0x99, 0xd9, 0x56, 0x15, 0x0f,
+						  0x31, 0x28, 0x45, 0x9f, 0x65, 0x31, 0x2f, 0xdd, 0x71, 0x61, 0x8f, 0x11, 0x77, 0x39, 0x3e, 0x3f};
+
+static const char* files[] = {"../resources/valid_small.pkt", "../resources/valid_medium.pkt", "../resources/valid_large.pkt"};
+
+
+static_assert(r_goose::Signer<HMAC_SHA256_80>::tag_size == 10 && r_goose::Verifier<GMAC_AES128_64>::tag_size == 8);
+static_assert(r_goose::Signer<HMAC_SHA256_256>::tag_size == MAX_MAC_SIZE);
+static_assert(!std::is_copy_constructible_v<r_goose::Key<HMAC_SHA256_80>> && std::is_nothrow_move_constructible_v<r_goose::Key<HMAC_SHA256_80>>);
+static_assert(!std::is_copy_constructible_v<r_goose::Signer<HMAC_SHA256_80>> && std::is_nothrow_move_constructible_v<r_goose::Signer<HMAC_SHA256_80>>);
+static_assert(!std::is_copy_constructible_v<r_goose::Verifier<GMAC_AES128_64>> && std::is_nothrow_move_constructible_v<r_goose::Verifier<GMAC_AES128_64>>);
+static_assert(!std::is_copy_constructible_v<r_goose::Buffer> && std::is_nothrow_move_constructible_v<r_goose::Buffer>);
+
+
+static void sizes(void){
+	for(int alg = 0; alg < MAC_ALGS_COUNT; alg++){
+		CHECK(r_goose::mac_sizes[alg] == MAC_SIZES[alg], "mac_sizes[%d]", alg);
+	}
+}
+
+// Signer/Verifier of Alg against the C functions, on the three resource packets
+template<int Alg>
+static void algorithm(int gmac){
+	size_t key_size = r_goose::Key<Alg>::max_size < sizeof(key) ? r_goose::Key<Alg>::max_size : sizeof(key);
+	r_goose::Signer<Alg> signer{r_goose::Key<Alg>{std::span<const uint8_t>(key, key_size)}};
+	r_goose::Verifier<Alg> verifier{r_goose::Key<Alg>{std::span<const uint8_t>(key, key_size)}};
+
+	for(int f = 0; f < 3; f++){
+		long len;
+		uint8_t* packet = read_packet(files[f], &len);
+		uint8_t* ref = NULL;
+		r_goose::Buffer buffer(len + r_goose::Signer<Alg>::tag_size);
+
+		int res = gmac ? r_gooseMessage_InsertGMAC(packet, key, key_size, Alg, &ref) : r_gooseMessage_InsertHMAC(packet, key, key_size, Alg, &ref);
+		CHECK(res == 1, "%s, alg %d: reference", files[f], Alg);
+
+		buffer.assign(std::span<const uint8_t>(packet, len));
+		int size = signer.sign(buffer);
+		CHECK(size == (int)(len + r_goose::Signer<Alg>::tag_size) && buffer.size() == (size_t)size && memcmp(buffer.data(), ref, size) == 0,
+			  "%s, alg %d: signed message differs", files[f], Alg);
+
+		CHECK(verifier.verify(buffer.message()) == 1, "%s, alg %d: Verifier", files[f], Alg);
+		res = gmac ? r_gooseMessage_ValidateGMAC(buffer.data(), key, key_size) : r_gooseMessage_ValidateHMAC(buffer.data(), key, key_size);
+		CHECK(res == 1, "%s, alg %d: C validation", files[f], Alg);
+
+		// Changed payload and MAC Tag
+		int positions[] = {INDEX_PAYLOAD + 5, size - 1};
+		for(int p = 0; p < 2; p++){
+			buffer.data()[positions[p]] ^= 0x10;
+			CHECK(verifier.verify(buffer.message()) == 0, "%s, alg %d: change at %d", files[f], Alg, positions[p]);
+			buffer.data()[positions[p]] ^= 0x10;
+		}
+
+		r_goose_free(ref);
+		free(packet);
+	}
+}
+
+static void errors(void){
+	long len;
+	uint8_t* packet = read_packet("../resources/valid_medium.pkt", &len);
+	std::span<const uint8_t> k16(key, 16), k32(key, 32);
+
+	// Key sizes
+	CHECK(!r_goose::Key<GMAC_AES128_64>{k32}.valid() && r_goose::Key<GMAC_AES128_64>{k16}.valid(), "GMAC_AES128_64 key size");
+	CHECK(!r_goose::Key<GMAC_AES256_128>{k16}.valid() && r_goose::Key<GMAC_AES256_128>{k32}.valid(), "GMAC_AES256_128 key size");
+	CHECK(!r_goose::Key<HMAC_SHA256_80>{std::span<const uint8_t>()}.valid(), "empty key");
+
+	r_goose::Buffer buffer(len + 10);
+	buffer.assign(std::span<const uint8_t>(packet, len));
+
+	r_goose::Signer<GMAC_AES256_128> bad_key{r_goose::Key<GMAC_AES256_128>{k16}};
+	CHECK(bad_key.sign(buffer) == -1 && buffer.size() == (size_t)len && memcmp(buffer.data(), packet, len) == 0, "invalid key");
+
+	// Moved from key
+	r_goose::Key<HMAC_SHA256_80> moved{k32};
+	r_goose::Key<HMAC_SHA256_80> owner = std::move(moved);
+	CHECK(!moved.valid() && owner.valid() && owner.size() == 32, "moved key");
+	r_goose::Signer<HMAC_SHA256_80> signer{std::move(owner)};
+	r_goose::Signer<HMAC_SHA256_80> empty{std::move(moved)};
+	CHECK(empty.sign(buffer) == -1, "moved from key signs");
+
+	// Storage too small, message unchanged
+	CHECK(signer.sign(std::span<uint8_t>(buffer.data(), len + 9)) == -1 && memcmp(buffer.data(), packet, len) == 0, "storage too small");
+	CHECK(signer.sign(std::span<uint8_t>(buffer.data(), 20)) == -1, "storage shorter than the header");
+	CHECK(signer.sign(buffer) == len + 10, "exact storage");
+
+	// MAC Algorithm of the message, SPDU Length
+	r_goose::Verifier<HMAC_SHA256_80> verifier{r_goose::Key<HMAC_SHA256_80>{k32}};
+	r_goose::Verifier<HMAC_SHA256_128> other{r_goose::Key<HMAC_SHA256_128>{k32}};
+	CHECK(verifier.verify(buffer.message()) == 1 && other.verify(buffer.message()) == -1, "MAC Algorithm of the message");
+	CHECK(verifier.verify(buffer.message().first(len + 9)) == -1, "SPDU Length beyond the message");
+
+	// MAC Tag function of another family
+	uint8_t tag[MAX_MAC_SIZE], ref[MAX_MAC_SIZE];
+	r_goose_mac_key* mk = r_goose_mac_key_new(HMAC_SHA256_80, key, 32);
+	CHECK(r_goose_mac_key_tag_hmac_sha256(mk, &packet[2], len - 4, tag) == 10 && r_goose_mac_key_tag(mk, &packet[2], len - 4, ref) == 10 &&
+		  memcmp(tag, ref, 10) == 0, "HMAC-SHA256 function");
+	CHECK(r_goose_mac_key_tag_hmac_sha512_256(mk, &packet[2], len - 4, tag) == -1 && r_goose_mac_key_tag_blake2b_keyed(mk, &packet[2], len - 4, tag) == -1 &&
+		  r_goose_mac_key_tag_gmac(mk, &packet[2], len - 4, tag) == -1 && r_goose_mac_key_tag_poly1305(mk, &packet[2], len - 4, tag) == -1,
+		  "function of another family");
+	r_goose_mac_key_free(mk);
+
+	// Moved Buffer
+	r_goose::Buffer moved_buffer = std::move(buffer);
+	CHECK(buffer.data() == NULL && buffer.capacity() == 0 && verifier.verify(moved_buffer.message()) == 1, "moved buffer");
+
+	free(packet);
+}
+
+template<int Alg>
+static void allocations(const char* name){
+	long len;
+	uint8_t* packet = read_packet("../resources/valid_large.pkt", &len);
+	size_t key_size = r_goose::Key<Alg>::max_size < sizeof(key) ? r_goose::Key<Alg>::max_size : sizeof(key);
+	r_goose::Buffer buffer(len + r_goose::Signer<Alg>::tag_size);
+	r_goose_alloc_stats before, built, after, released;
+	int ok = 1;
+
+	r_goose_alloc_count(1);
+	r_goose_alloc_get_stats(&before);
+	{
+		r_goose::Signer<Alg> signer{r_goose::Key<Alg>{std::span<const uint8_t>(key, key_size)}};
+		r_goose::Verifier<Alg> verifier{r_goose::Key<Alg>{std::span<const uint8_t>(key, key_size)}};
+		r_goose_alloc_get_stats(&built);
+		for(int i = 0; i < 1000; i++){
+			buffer.assign(std::span<const uint8_t>(packet, len));
+			ok &= signer.sign(buffer) == (int)(len + r_goose::Signer<Alg>::tag_size);
+			ok &= verifier.verify(buffer.message()) == 1;
+		}
+		r_goose_alloc_get_stats(&after);
+	}
+	r_goose_alloc_get_stats(&released);
+	r_goose_alloc_count(0);
+
+	CHECK(ok, "%s: sign/verify loop", name);
+	CHECK(after.allocs == built.allocs && after.frees == built.frees, "%s: %llu allocations in sign/verify", name,
+		  (unsigned long long)(after.allocs - built.allocs));
+	CHECK(built.allocs > before.allocs && released.allocs - before.allocs == released.frees - before.frees,
+		  "%s: keys allocated %llu blocks, released %llu", name, (unsigned long long)(released.allocs - before.allocs),
+		  (unsigned long long)(released.frees - before.frees));
+
+	free(packet);
+}
+
+template<int Alg>
+static void timing(int gmac, const char* name){
+	long len;
+	uint8_t* packet = read_packet("../resources/valid_large.pkt", &len);
+	size_t key_size = r_goose::Key<Alg>::max_size < sizeof(key) ? r_goose::Key<Alg>::max_size : sizeof(key);
+	r_goose::Signer<Alg> signer{r_goose::Key<Alg>{std::span<const uint8_t>(key, key_size)}};
+	r_goose::Verifier<Alg> verifier{r_goose::Key<Alg>{std::span<const uint8_t>(key, key_size)}};
+	r_goose::Buffer buffer(len + r_goose::Signer<Alg>::tag_size);
+	uint8_t* message = NULL;
+	struct timespec start, end;
+	uint64_t c_ns, cpp_ns;
+	int ok = 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < ITERATIONS; i++){
+		if(gmac){
+			ok &= r_gooseMessage_InsertGMAC(packet, key, key_size, Alg, &message) == 1;
+			ok &= r_gooseMessage_ValidateGMAC(message, key, key_size) == 1;
+		}else{
+			ok &= r_gooseMessage_InsertHMAC(packet, key, key_size, Alg, &message) == 1;
+			ok &= r_gooseMessage_ValidateHMAC(message, key, key_size) == 1;
+		}
+		r_goose_free(message);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	c_ns = timespecDiff(&end, &start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < ITERATIONS; i++){
+		buffer.assign(std::span<const uint8_t>(packet, len));
+		ok &= signer.sign(buffer) > 0;
+		ok &= verifier.verify(buffer.message()) == 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	cpp_ns = timespecDiff(&end, &start);
+
+	CHECK(ok, "%s: timing loops", name);
+	printf("\t%-16s Insert + Validate: %8.1f ns/message\tSigner + Verifier: %8.1f ns/message\n", name,
+		   (double)c_ns / ITERATIONS, (double)cpp_ns / ITERATIONS);
+
+	free(packet);
+}
+
+int main(){
+	// OpenSSL allocations counted too (r_goose_set_allocator() before any use of OpenSSL)
+	if(r_goose_set_allocator(NULL, NULL, NULL) != 0){
+		printf("FAILED: r_goose_set_allocator\n");
+		return 1;
+	}
+
+	sizes();
+
+	algorithm<HMAC_SHA256_80>(0);
+	algorithm<HMAC_SHA256_128>(0);
+	algorithm<HMAC_SHA256_256>(0);
+	algorithm<HMAC_SHA512_256_80>(0);
+	algorithm<HMAC_SHA512_256_128>(0);
+	algorithm<HMAC_BLAKE2B_80>(0);
+	algorithm<HMAC_BLAKE2S_80>(0);
+	algorithm<BLAKE2B_KEYED_80>(0);
+	algorithm<BLAKE2S_KEYED_80>(0);
+	algorithm<GMAC_AES256_64>(1);
+	algorithm<GMAC_AES256_128>(1);
+	algorithm<GMAC_AES128_64>(1);
+	algorithm<GMAC_AES128_128>(1);
+	algorithm<CHACHA20_POLY1305_128>(1);
+
+	errors();
+	allocations<HMAC_SHA256_80>("HMAC_SHA256_80");
+	allocations<HMAC_SHA512_256_128>("HMAC_SHA512_256_128");
+	allocations<BLAKE2B_KEYED_80>("BLAKE2B_KEYED_80");
+	allocations<GMAC_AES128_64>("GMAC_AES128_64");
+	allocations<CHACHA20_POLY1305_128>("CHACHA20_POLY1305_128");
+
+	printf("valid_large.pkt, %d iterations\n", ITERATIONS);
+	timing<HMAC_SHA256_80>(0, "HMAC_SHA256_80");
+	timing<GMAC_AES128_64>(1, "GMAC_AES128_64");
+
+	if(failures != 0){
+		printf("%d failures\n", failures);
+		return 1;
+	}
+	printf("All C++ interface tests passed\n");
+	return 0;
+}
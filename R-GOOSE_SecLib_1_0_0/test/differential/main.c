@@ -0,0 +1,704 @@
+/*
+	Test file:
+
+		Differential and Known Answer verification of the MAC/encryption kernels
+
+		Every library function (hmac_*, gmac_*, blake2*_80, poly1305_CHACHA20_128,
+		aes_*_gcm_*, chacha20_poly1305_*) is compared, bit by bit, against a reference
+		computed directly with OpenSSL (HMAC() / EVP, EVP_MAC BLAKE2BMAC/BLAKE2SMAC with a
+		10 byte digest for the keyed BLAKE2 kernels). Tags are truncated to the sizes in
+		MAC_SIZES.
+
+		1. Known Answer Tests - RFC 4231 (HMAC-SHA256), GCM spec test cases 1, 2, 13, 14,
+		   BLAKE2 reference keyed KAT.
+		2. Fixed cases - the inputs used by test/aes, test/test1 and test/test2, and the
+		   data sizes measured in test/testing_docs (51, 196, 204, 256, 408, 572 bytes).
+		3. Randomized cases - random function, data length (0-2048), key length, IV and
+		   buffer alignment (0-15 bytes offset on data, key, IV and output).
+		4. R-GOOSE cases - InsertHMAC/InsertGMAC tags checked against the reference over
+		   the packet (all-zero IV for GMAC, salt || SPDU Number nonce for Poly1305),
+		   ValidateHMAC/ValidateGMAC on valid and bit-flipped packets, and Encrypt/Decrypt
+		   round trips, on mutated valid_small/medium/large.pkt.
+
+		Usage: ./a.out [random cases (default 1000000)] [seed]
+
+		On a divergence, the input is shrunk (shorter data, aligned buffers) while it keeps
+		diverging, and the minimal reproducer is printed. The program returns 1 if any
+		divergence was found.
+
+*/
+
+#include "r_goose_security.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <openssl/opensslv.h>
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+
+#define MAX_DATA		2048
+#define MAX_KEY			128
+#define MAX_IV			12
+#define MAX_OUT			(MAX_DATA + 64)
+#define MAX_OFFSET		16
+
+#define KIND_MAC		0
+#define KIND_ENC		1
+
+
+/* Case input - buffers are offset from aligned storage to test unaligned access */
+typedef struct {
+	uint8_t data_store[MAX_DATA + MAX_OFFSET];
+	uint8_t key_store[MAX_KEY + MAX_OFFSET];
+	uint8_t iv_store[MAX_IV + MAX_OFFSET];
+	size_t data_size, key_size, iv_size;
+	size_t data_off, key_off, iv_off, out_off;
+} case_input;
+
+#define DATA(c)		((c)->data_store + (c)->data_off)
+#define KEY(c)		((c)->key_store + (c)->key_off)
+#define IV(c)		((c)->iv_store + (c)->iv_off)
+
+typedef int (*kernel_fn)(case_input* c, uint8_t* out);
+
+typedef struct {
+	const char* name;
+	int kind;
+	int alg;					// MAC algorithm (MAC_SIZES index) or encryption algorithm
+	size_t key_min, key_max;
+	size_t iv_size;
+	kernel_fn lib;
+	kernel_fn ref;
+} kernel_pair;
+
+
+static long total_cases = 0, total_divergences = 0;
+
+
+// xorshift64* - reproducible from the printed seed
+
+static uint64_t rng_state;
+
+static uint64_t rng(void){
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static void rng_fill(uint8_t* p, size_t n){
+	for(size_t i = 0; i < n; i++){
+		p[i] = (uint8_t)rng();
+	}
+}
+
+static void print_hex(const char* label, const uint8_t* p, size_t n){
+	printf("\t%-8s (%3zu) ", label, n);
+	for(size_t i = 0; i < n; i++){
+		printf("%02x", p[i]);
+	}
+	printf("\n");
+}
+
+
+// Reference implementations - OpenSSL called directly
+
+static int ref_hmac(const EVP_MD* md, case_input* c, uint8_t* out, int macSize){
+	uint8_t full[EVP_MAX_MD_SIZE];
+	HMAC(md, KEY(c), c->key_size, DATA(c), c->data_size, full, NULL);
+	memcpy(out, full, macSize);
+	return macSize;
+}
+
+static int ref_aead_tag(const EVP_CIPHER* cipher, case_input* c, uint8_t* out, int macSize){
+	uint8_t full[16];
+	int unused;
+	EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+	EVP_EncryptInit_ex(ctx, cipher, NULL, NULL, NULL);
+	EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN, c->iv_size, NULL);
+	EVP_EncryptInit_ex(ctx, NULL, NULL, KEY(c), IV(c));
+	EVP_EncryptUpdate(ctx, NULL, &unused, DATA(c), c->data_size);
+	EVP_EncryptFinal_ex(ctx, NULL, &unused);
+	EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, 16, full);
+	EVP_CIPHER_CTX_free(ctx);
+	memcpy(out, full, macSize);
+	return macSize;
+}
+
+static int ref_crypt(const EVP_CIPHER* cipher, int enc, case_input* c, uint8_t* out){
+	int len, total;
+	EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+	EVP_CipherInit_ex(ctx, cipher, NULL, NULL, NULL, enc);
+	EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN, c->iv_size, NULL);
+	EVP_CipherInit_ex(ctx, NULL, NULL, KEY(c), IV(c), enc);
+	EVP_CipherUpdate(ctx, out, &len, DATA(c), c->data_size);
+	total = len;
+	EVP_CIPHER_CTX_free(ctx);
+	return total;
+}
+
+// Keyed BLAKE2 (RFC 7693) of OpenSSL, with the 10 byte digest set as a parameter (it is part of the parameter block,
+// so it can't be obtained by truncating a longer digest)
+static int ref_blake2_mac(const char* name, case_input* c, uint8_t* out){
+	size_t outlen = 10, len;
+	OSSL_PARAM params[] = {OSSL_PARAM_construct_size_t(OSSL_MAC_PARAM_SIZE, &outlen), OSSL_PARAM_construct_end()};
+	EVP_MAC* mac = EVP_MAC_fetch(NULL, name, NULL);
+	EVP_MAC_CTX* ctx = EVP_MAC_CTX_new(mac);
+	EVP_MAC_init(ctx, KEY(c), c->key_size, params);
+	EVP_MAC_update(ctx, DATA(c), c->data_size);
+	EVP_MAC_final(ctx, out, &len, outlen);
+	EVP_MAC_CTX_free(ctx);
+	EVP_MAC_free(mac);
+	return (int)len;
+}
+
+static int ref_blake2b(case_input* c, uint8_t* out){
+	return ref_blake2_mac("BLAKE2BMAC", c, out);
+}
+
+static int ref_blake2s(case_input* c, uint8_t* out){
+	return ref_blake2_mac("BLAKE2SMAC", c, out);
+}
+
+// Nonce of the CHACHA20_POLY1305_128 MAC Tag of a message: SHA-256("R-GOOSE Poly1305 nonce" || key) truncated
+// to 8 bytes, followed by the SPDU Number
+static void ref_poly1305_nonce(uint8_t* key, uint8_t* spdu_number, uint8_t* nonce){
+	static const char label[] = "R-GOOSE Poly1305 nonce";
+	uint8_t digest[32];
+	EVP_MD_CTX* md = EVP_MD_CTX_new();
+	EVP_DigestInit_ex(md, EVP_sha256(), NULL);
+	EVP_DigestUpdate(md, label, sizeof(label) - 1);
+	EVP_DigestUpdate(md, key, 32);
+	EVP_DigestFinal_ex(md, digest, NULL);
+	EVP_MD_CTX_free(md);
+	memcpy(nonce, digest, 8);
+	memcpy(&nonce[8], spdu_number, 4);
+}
+
+#define REF_HMAC(fn, md, alg)	static int fn(case_input* c, uint8_t* out){ return ref_hmac(md, c, out, MAC_SIZES[alg]); }
+#define REF_TAG(fn, cph, alg)	static int fn(case_input* c, uint8_t* out){ return ref_aead_tag(cph, c, out, MAC_SIZES[alg]); }
+#define REF_ENC(fn, cph, enc)	static int fn(case_input* c, uint8_t* out){ return ref_crypt(cph, enc, c, out); }
+
+REF_HMAC(ref_hmac_sha256_80, EVP_sha256(), HMAC_SHA256_80)
+REF_HMAC(ref_hmac_sha256_128, EVP_sha256(), HMAC_SHA256_128)
+REF_HMAC(ref_hmac_sha256_256, EVP_sha256(), HMAC_SHA256_256)
+REF_HMAC(ref_hmac_sha512_256_80, EVP_sha512_256(), HMAC_SHA512_256_80)
+REF_HMAC(ref_hmac_sha512_256_128, EVP_sha512_256(), HMAC_SHA512_256_128)
+REF_HMAC(ref_hmac_blake2b_80, EVP_blake2b512(), HMAC_BLAKE2B_80)
+REF_HMAC(ref_hmac_blake2s_80, EVP_blake2s256(), HMAC_BLAKE2S_80)
+REF_TAG(ref_gmac_aes128_64, EVP_aes_128_gcm(), GMAC_AES128_64)
+REF_TAG(ref_gmac_aes128_128, EVP_aes_128_gcm(), GMAC_AES128_128)
+REF_TAG(ref_gmac_aes256_64, EVP_aes_256_gcm(), GMAC_AES256_64)
+REF_TAG(ref_gmac_aes256_128, EVP_aes_256_gcm(), GMAC_AES256_128)
+REF_TAG(ref_poly1305_chacha20_128, EVP_chacha20_poly1305(), CHACHA20_POLY1305_128)
+REF_ENC(ref_aes_128_gcm_encrypt, EVP_aes_128_gcm(), 1)
+REF_ENC(ref_aes_128_gcm_decrypt, EVP_aes_128_gcm(), 0)
+REF_ENC(ref_aes_256_gcm_encrypt, EVP_aes_256_gcm(), 1)
+REF_ENC(ref_aes_256_gcm_decrypt, EVP_aes_256_gcm(), 0)
+REF_ENC(ref_chacha20_poly1305_encrypt, EVP_chacha20_poly1305(), 1)
+REF_ENC(ref_chacha20_poly1305_decrypt, EVP_chacha20_poly1305(), 0)
+
+
+// Library kernels - tag written to a caller provided (possibly unaligned) buffer
+
+#define LIB_HMAC(fn, call, alg)																\
+	static int fn(case_input* c, uint8_t* out){												\
+		uint8_t* dest = out;																\
+		return call(DATA(c), KEY(c), c->data_size, c->key_size, &dest) == 0 ? MAC_SIZES[alg] : -1;	\
+	}
+
+#define LIB_TAG(fn, call, alg)																\
+	static int fn(case_input* c, uint8_t* out){												\
+		uint8_t* dest = out;																\
+		call(DATA(c), KEY(c), IV(c), c->data_size, c->iv_size, &dest);						\
+		return MAC_SIZES[alg];																\
+	}
+
+#define LIB_ENC(fn, call)																	\
+	static int fn(case_input* c, uint8_t* out){												\
+		uint8_t* dest = NULL;																\
+		int len = call(DATA(c), KEY(c), IV(c), c->data_size, c->iv_size, &dest);			\
+		if(len > 0){																		\
+			memcpy(out, dest, len);															\
+		}																					\
+		free(dest);																			\
+		return len;																			\
+	}
+
+LIB_HMAC(lib_hmac_sha256_80, hmac_SHA256_80, HMAC_SHA256_80)
+LIB_HMAC(lib_hmac_sha256_128, hmac_SHA256_128, HMAC_SHA256_128)
+LIB_HMAC(lib_hmac_sha256_256, hmac_SHA256_256, HMAC_SHA256_256)
+LIB_HMAC(lib_hmac_sha512_256_80, hmac_SHA512_256_80, HMAC_SHA512_256_80)
+LIB_HMAC(lib_hmac_sha512_256_128, hmac_SHA512_256_128, HMAC_SHA512_256_128)
+LIB_HMAC(lib_hmac_blake2b_80, hmac_BLAKE2b_80, HMAC_BLAKE2B_80)
+LIB_HMAC(lib_hmac_blake2s_80, hmac_BLAKE2s_80, HMAC_BLAKE2S_80)
+LIB_HMAC(lib_blake2b_80, blake2b_80, BLAKE2B_KEYED_80)
+LIB_HMAC(lib_blake2s_80, blake2s_80, BLAKE2S_KEYED_80)
+LIB_TAG(lib_gmac_aes128_64, gmac_AES128_64, GMAC_AES128_64)
+LIB_TAG(lib_gmac_aes128_128, gmac_AES128_128, GMAC_AES128_128)
+LIB_TAG(lib_gmac_aes256_64, gmac_AES256_64, GMAC_AES256_64)
+LIB_TAG(lib_gmac_aes256_128, gmac_AES256_128, GMAC_AES256_128)
+LIB_TAG(lib_poly1305_chacha20_128, poly1305_CHACHA20_128, CHACHA20_POLY1305_128)
+LIB_ENC(lib_aes_128_gcm_encrypt, aes_128_gcm_encrypt)
+LIB_ENC(lib_aes_128_gcm_decrypt, aes_128_gcm_decrypt)
+LIB_ENC(lib_aes_256_gcm_encrypt, aes_256_gcm_encrypt)
+LIB_ENC(lib_aes_256_gcm_decrypt, aes_256_gcm_decrypt)
+LIB_ENC(lib_chacha20_poly1305_encrypt, chacha20_poly1305_encrypt)
+LIB_ENC(lib_chacha20_poly1305_decrypt, chacha20_poly1305_decrypt)
+
+
+static const kernel_pair kernels[] = {
+	{"hmac_SHA256_80",				KIND_MAC, HMAC_SHA256_80,			1, 128, 0,  lib_hmac_sha256_80,				ref_hmac_sha256_80},
+	{"hmac_SHA256_128",				KIND_MAC, HMAC_SHA256_128,			1, 128, 0,  lib_hmac_sha256_128,			ref_hmac_sha256_128},
+	{"hmac_SHA256_256",				KIND_MAC, HMAC_SHA256_256,			1, 128, 0,  lib_hmac_sha256_256,			ref_hmac_sha256_256},
+	{"hmac_SHA512_256_80",			KIND_MAC, HMAC_SHA512_256_80,		1, 128, 0,  lib_hmac_sha512_256_80,			ref_hmac_sha512_256_80},
+	{"hmac_SHA512_256_128",			KIND_MAC, HMAC_SHA512_256_128,		1, 128, 0,  lib_hmac_sha512_256_128,		ref_hmac_sha512_256_128},
+	{"hmac_BLAKE2b_80",				KIND_MAC, HMAC_BLAKE2B_80,			1, 128, 0,  lib_hmac_blake2b_80,			ref_hmac_blake2b_80},
+	{"hmac_BLAKE2s_80",				KIND_MAC, HMAC_BLAKE2S_80,			1, 128, 0,  lib_hmac_blake2s_80,			ref_hmac_blake2s_80},
+	{"blake2b_80",					KIND_MAC, BLAKE2B_KEYED_80,			1, 64,  0,  lib_blake2b_80,					ref_blake2b},
+	{"blake2s_80",					KIND_MAC, BLAKE2S_KEYED_80,			1, 32,  0,  lib_blake2s_80,					ref_blake2s},
+	{"gmac_AES128_64",				KIND_MAC, GMAC_AES128_64,			16, 16, 12, lib_gmac_aes128_64,				ref_gmac_aes128_64},
+	{"gmac_AES128_128",				KIND_MAC, GMAC_AES128_128,			16, 16, 12, lib_gmac_aes128_128,			ref_gmac_aes128_128},
+	{"gmac_AES256_64",				KIND_MAC, GMAC_AES256_64,			32, 32, 12, lib_gmac_aes256_64,				ref_gmac_aes256_64},
+	{"gmac_AES256_128",				KIND_MAC, GMAC_AES256_128,			32, 32, 12, lib_gmac_aes256_128,			ref_gmac_aes256_128},
+	{"poly1305_CHACHA20_128",		KIND_MAC, CHACHA20_POLY1305_128,	32, 32, 12, lib_poly1305_chacha20_128,		ref_poly1305_chacha20_128},
+	{"aes_128_gcm_encrypt",			KIND_ENC, AES_128_GCM,				16, 16, 12, lib_aes_128_gcm_encrypt,		ref_aes_128_gcm_encrypt},
+	{"aes_128_gcm_decrypt",			KIND_ENC, AES_128_GCM,				16, 16, 12, lib_aes_128_gcm_decrypt,		ref_aes_128_gcm_decrypt},
+	{"aes_256_gcm_encrypt",			KIND_ENC, AES_256_GCM,				32, 32, 12, lib_aes_256_gcm_encrypt,		ref_aes_256_gcm_encrypt},
+	{"aes_256_gcm_decrypt",			KIND_ENC, AES_256_GCM,				32, 32, 12, lib_aes_256_gcm_decrypt,		ref_aes_256_gcm_decrypt},
+	{"chacha20_poly1305_encrypt",	KIND_ENC, CHACHA20_POLY1305,		32, 32, 12, lib_chacha20_poly1305_encrypt,	ref_chacha20_poly1305_encrypt},
+	{"chacha20_poly1305_decrypt",	KIND_ENC, CHACHA20_POLY1305,		32, 32, 12, lib_chacha20_poly1305_decrypt,	ref_chacha20_poly1305_decrypt},
+};
+
+#define N_KERNELS	((int)(sizeof(kernels)/sizeof(kernels[0])))
+
+
+// Differential execution and shrinking
+
+static int diverges(const kernel_pair* k, case_input* c){
+	uint8_t lib_store[MAX_OUT + MAX_OFFSET], ref_out[MAX_OUT];
+	uint8_t* lib_out = lib_store + c->out_off;
+
+	int lib_len = k->lib(c, lib_out);
+	int ref_len = k->ref(c, ref_out);
+
+	return lib_len != ref_len || (ref_len > 0 && memcmp(lib_out, ref_out, ref_len) != 0);
+}
+
+static void report(const kernel_pair* k, case_input* c, const char* origin){
+	uint8_t lib_store[MAX_OUT + MAX_OFFSET], ref_out[MAX_OUT];
+	uint8_t* lib_out;
+	size_t original_size = c->data_size;
+
+	// Shrink: shortest data prefix that still diverges, then aligned buffers
+	while(c->data_size > 0){
+		size_t saved = c->data_size;
+		c->data_size = saved / 2;
+		if(diverges(k, c)) continue;
+		c->data_size = saved - 1;
+		if(diverges(k, c)) continue;
+		c->data_size = saved;
+		break;
+	}
+	size_t offsets[4] = {c->data_off, c->key_off, c->iv_off, c->out_off};
+	c->data_off = c->key_off = c->iv_off = c->out_off = 0;
+	if(!diverges(k, c)){
+		c->data_off = offsets[0]; c->key_off = offsets[1]; c->iv_off = offsets[2]; c->out_off = offsets[3];
+	}
+
+	lib_out = lib_store + c->out_off;
+	int lib_len = k->lib(c, lib_out);
+	int ref_len = k->ref(c, ref_out);
+
+	printf("DIVERGENCE %s (%s) - original data size %zu\n", k->name, origin, original_size);
+	printf("\tminimal reproducer: data_size=%zu key_size=%zu iv_size=%zu offsets data=%zu key=%zu iv=%zu out=%zu\n",
+		c->data_size, c->key_size, c->iv_size, c->data_off, c->key_off, c->iv_off, c->out_off);
+	print_hex("key", KEY(c), c->key_size);
+	print_hex("iv", IV(c), c->iv_size);
+	print_hex("data", DATA(c), c->data_size);
+	print_hex("lib", lib_out, lib_len > 0 ? lib_len : 0);
+	print_hex("ref", ref_out, ref_len > 0 ? ref_len : 0);
+}
+
+static int run_case(const kernel_pair* k, case_input* c, const char* origin){
+	total_cases++;
+	if(diverges(k, c)){
+		total_divergences++;
+		if(total_divergences <= 20){
+			report(k, c, origin);
+		}
+		return 1;
+	}
+	return 0;
+}
+
+static const kernel_pair* find_kernel(const char* name){
+	for(int i = 0; i < N_KERNELS; i++){
+		if(strcmp(kernels[i].name, name) == 0){
+			return &kernels[i];
+		}
+	}
+	return NULL;
+}
+
+static const kernel_pair* find_mac_kernel(int alg){
+	for(int i = 0; i < N_KERNELS; i++){
+		if(kernels[i].kind == KIND_MAC && kernels[i].alg == alg){
+			return &kernels[i];
+		}
+	}
+	return NULL;
+}
+
+static void set_input(case_input* c, const uint8_t* data, size_t data_size, const uint8_t* key, size_t key_size, const uint8_t* iv, size_t iv_size){
+	memset(c, 0, sizeof(*c));
+	memcpy(DATA(c), data, data_size);
+	memcpy(KEY(c), key, key_size);
+	if(iv_size > 0){
+		memcpy(IV(c), iv, iv_size);
+	}
+	c->data_size = data_size;
+	c->key_size = key_size;
+	c->iv_size = iv_size;
+}
+
+
+// 1. Known Answer Tests
+
+static void kat_check(const char* name, case_input* c, const char* expectedHex){
+	uint8_t out[MAX_OUT];
+	const kernel_pair* k = find_kernel(name);
+	size_t len = strlen(expectedHex);
+	uint8_t* expected = hexStringToBytes((char*)expectedHex, len);
+
+	int out_len = k->lib(c, out);
+
+	total_cases++;
+	if(out_len != (int)len/2 || memcmp(out, expected, len/2) != 0){
+		total_divergences++;
+		printf("KAT FAILED %s\n", name);
+		print_hex("expected", expected, len/2);
+		print_hex("lib", out, out_len > 0 ? out_len : 0);
+	}
+
+	// The reference must agree with the published values as well
+	run_case(k, c, "KAT");
+
+	free(expected);
+}
+
+static void known_answer_tests(void){
+	case_input c;
+	uint8_t key[64], zero[32];
+
+	memset(zero, 0, sizeof(zero));
+
+	// RFC 4231 - Test Case 1
+	memset(key, 0x0b, 20);
+	set_input(&c, (const uint8_t*)"Hi There", 8, key, 20, NULL, 0);
+	kat_check("hmac_SHA256_80", &c, "b0344c61d8db38535ca8");
+	kat_check("hmac_SHA256_128", &c, "b0344c61d8db38535ca8afceaf0bf12b");
+	kat_check("hmac_SHA256_256", &c, "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7");
+
+	// RFC 4231 - Test Case 2
+	set_input(&c, (const uint8_t*)"what do ya want for nothing?", 28, (const uint8_t*)"Jefe", 4, NULL, 0);
+	kat_check("hmac_SHA256_256", &c, "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843");
+
+	// GCM specification (McGrew & Viega) - Test Cases 1 and 13: empty data, the tag is the GMAC of nothing
+	set_input(&c, zero, 0, zero, 16, zero, 12);
+	kat_check("gmac_AES128_128", &c, "58e2fccefa7e3061367f1d57a4e7455a");
+	kat_check("gmac_AES128_64", &c, "58e2fccefa7e3061");
+	set_input(&c, zero, 0, zero, 32, zero, 12);
+	kat_check("gmac_AES256_128", &c, "530f8afbc74536b9a963b4f1c4cb738b");
+	kat_check("gmac_AES256_64", &c, "530f8afbc74536b9");
+
+	// GCM specification - Test Cases 2 and 14: one zero block
+	set_input(&c, zero, 16, zero, 16, zero, 12);
+	kat_check("aes_128_gcm_encrypt", &c, "0388dace60b6a392f328c2b971b2fe78");
+	set_input(&c, zero, 16, zero, 32, zero, 12);
+	kat_check("aes_256_gcm_encrypt", &c, "cea7403d4d606b6e074ec5d3baf39d18");
+
+	// BLAKE2 reference KAT - keyed, empty message, checked through the full length digest
+	for(int i = 0; i < 64; i++){
+		key[i] = i;
+	}
+	for(int simd = 0; simd < 2; simd++){
+		uint8_t out[64];
+		blake2b_state S;
+		blake2s_state T;
+		uint8_t* b = hexStringToBytes("10ebb67700b1868efb4417987acf4690ae9d972fb7a590c2f02871799aaa4786b5e996e8f0f4eb981fc214b005f42d2ff4233499391653df7aefcbc13fc51568", 128);
+		uint8_t* s = hexStringToBytes("48a8997da407876b3d79c0d92325ad3b89cbb754d86ab71aee047ad345fd2c49", 64);
+
+		blake2b_init_key(&S, 64, key, 64, simd);
+		blake2b_final(&S, out);
+		total_cases++;
+		if(memcmp(out, b, 64) != 0){
+			total_divergences++;
+			printf("KAT FAILED blake2b keyed (simd=%d)\n", simd);
+		}
+
+		blake2s_init_key(&T, 32, key, 32, simd);
+		blake2s_final(&T, out);
+		total_cases++;
+		if(memcmp(out, s, 32) != 0){
+			total_divergences++;
+			printf("KAT FAILED blake2s keyed (simd=%d)\n", simd);
+		}
+
+		free(b);
+		free(s);
+	}
+}
+
+
+// 2. Fixed cases - inputs of test/aes, test/test1, test/test2 and the sizes of test/testing_docs
+
+static void fixed_cases(void){
+	case_input c;
+	const size_t sizes[] = {0, 1, 15, 16, 17, 51, 63, 64, 65, 127, 128, 129, 196, 204, 256, 408, 572, 1523};
+	uint8_t data[MAX_DATA];
+
+	// test/test1 - RFC 4231 key, 572 bytes
+	uint8_t key1[20];
+	memset(key1, 0x0b, 20);
+
+	// test/test2 - AES256 key and IV, 572 bytes of 0x23
+	uint8_t* key2 = hexStringToBytes("6dfa1a07c14f978020ace450ad663d18fafa1a07c14f978020ace450ad663d18", 64);
+	uint8_t* iv2 = hexStringToBytes("34edfa462a14c6969a680ec1", 24);
+
+	// test/aes - key and IV
+	uint8_t* key3 = hexStringToBytes("219bcef0cd0f89a5e1297b99d956150f3128459f65312fdd71618f1177393e3f", 64);
+	uint8_t* iv3 = hexStringToBytes("75b66d3df73da95345c11a32", 24);
+
+	for(size_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++){
+		for(int i = 0; i < N_KERNELS; i++){
+			const kernel_pair* k = &kernels[i];
+
+			memset(data, 0x23, sizes[s]);
+			if(k->iv_size == 0){
+				set_input(&c, data, sizes[s], key1, 20 > k->key_max ? k->key_max : 20, NULL, 0);
+				run_case(k, &c, "test/test1 key");
+				set_input(&c, data, sizes[s], key2, k->key_max < 32 ? k->key_max : 32, NULL, 0);
+				run_case(k, &c, "test/test2 key");
+			}else{
+				set_input(&c, data, sizes[s], key2, k->key_max, iv2, 12);
+				run_case(k, &c, "test/test2 key/iv");
+				set_input(&c, data, sizes[s], key3, k->key_max, iv3, 12);
+				run_case(k, &c, "test/aes key/iv");
+			}
+		}
+	}
+
+	free(key2);
+	free(iv2);
+	free(key3);
+	free(iv3);
+}
+
+
+// 3. Randomized cases
+
+static void random_cases(long n){
+	case_input c;
+
+	for(long i = 0; i < n; i++){
+		const kernel_pair* k = &kernels[rng() % N_KERNELS];
+
+		memset(&c, 0, sizeof(c));
+
+		// Bias towards the R-GOOSE payload sizes (small packets) and block boundaries
+		switch(rng() % 4){
+			case 0:  c.data_size = rng() % 64; break;
+			case 1:  c.data_size = 64 * (1 + rng() % 24) + (rng() % 3) - 1; break;
+			default: c.data_size = rng() % (MAX_DATA + 1); break;
+		}
+		if(c.data_size > MAX_DATA){
+			c.data_size = MAX_DATA;
+		}
+
+		c.key_size = k->key_min + rng() % (k->key_max - k->key_min + 1);
+		c.iv_size = k->iv_size;
+
+		c.data_off = rng() % MAX_OFFSET;
+		c.key_off = rng() % MAX_OFFSET;
+		c.iv_off = rng() % MAX_OFFSET;
+		c.out_off = rng() % MAX_OFFSET;
+
+		rng_fill(DATA(&c), c.data_size);
+		rng_fill(KEY(&c), c.key_size);
+		rng_fill(IV(&c), c.iv_size);
+
+		run_case(k, &c, "random");
+	}
+}
+
+
+// 4. R-GOOSE message cases
+
+static uint8_t* read_packet(char* filename, long* filelen){
+	FILE *fp;
+	unsigned char *buffer;
+
+	fp = fopen(filename, "rb");
+	if(fp == NULL){
+		perror(filename);
+		exit(1);
+	}
+
+	fseek(fp, 0, SEEK_END);
+	*filelen = ftell(fp);
+	rewind(fp);
+
+	buffer = (unsigned char*) malloc((*filelen)*sizeof(char));
+	fread(buffer, *filelen, 1, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+static void packet_divergence(const char* what, int alg, const char* file, int got, int expected){
+	total_divergences++;
+	if(total_divergences <= 20){
+		printf("DIVERGENCE %s alg %d on %s: got %d, expected %d\n", what, alg, file, got, expected);
+	}
+}
+
+static void packet_cases(long n){
+	char* files[] = {"../resources/valid_small.pkt", "../resources/valid_medium.pkt", "../resources/valid_large.pkt"};
+	const int hmac_algs[] = {HMAC_SHA256_80, HMAC_SHA256_128, HMAC_SHA256_256, HMAC_BLAKE2B_80, HMAC_BLAKE2S_80,
+							 BLAKE2B_KEYED_80, BLAKE2S_KEYED_80, HMAC_SHA512_256_80, HMAC_SHA512_256_128};
+	const int gmac_algs[] = {GMAC_AES256_64, GMAC_AES256_128, GMAC_AES128_64, GMAC_AES128_128, CHACHA20_POLY1305_128};
+	const int enc_algs[] = {AES_128_GCM, AES_256_GCM, CHACHA20_POLY1305};
+	const int n_hmac = sizeof(hmac_algs)/sizeof(hmac_algs[0]);
+	const int n_gmac = sizeof(gmac_algs)/sizeof(gmac_algs[0]);
+
+	uint8_t key[32], iv[12];
+	uint8_t ref_tag[MAX_OUT];
+	case_input c;
+
+	for(int f = 0; f < 3; f++){
+		long len;
+		uint8_t* original = read_packet(files[f], &len);
+		uint8_t* packet = (uint8_t*)malloc(len);
+
+		for(long i = 0; i < n; i++){
+			uint8_t* dest = NULL;
+			int alg, res, macSize, messageSize;
+			const kernel_pair* k;
+
+			// Mutate GOOSE PDU bytes only - header lengths stay consistent
+			memcpy(packet, original, len);
+			for(int m = rng() % 8; m > 0; m--){
+				packet[INDEX_PAYLOAD + rng() % (len - INDEX_PAYLOAD - 2)] = (uint8_t)rng();
+			}
+			rng_fill(key, sizeof(key));
+
+			// InsertHMAC / ValidateHMAC
+			alg = hmac_algs[rng() % n_hmac];
+			macSize = MAC_SIZES[alg];
+			size_t key_size = (alg == BLAKE2S_KEYED_80) ? 16 : 16 + rng() % 17;
+
+			total_cases++;
+			if((res = r_gooseMessage_InsertHMAC(packet, key, key_size, alg, &dest)) != 1){
+				packet_divergence("InsertHMAC", alg, files[f], res, 1);
+				continue;
+			}
+			messageSize = decode_4bytesToInt(dest, INDEX_SPDU_LENGTH) + 10;
+			k = find_mac_kernel(alg);
+			set_input(&c, &dest[2], messageSize-4-macSize, key, key_size, NULL, 0);
+			k->ref(&c, ref_tag);
+			if(memcmp(ref_tag, &dest[messageSize-macSize], macSize) != 0){
+				packet_divergence("InsertHMAC tag", alg, files[f], 0, 1);
+			}
+			if((res = r_gooseMessage_ValidateHMAC(dest, key, key_size)) != 1){
+				packet_divergence("ValidateHMAC valid", alg, files[f], res, 1);
+			}
+			// The tag field header (0x85 and length) is not covered by the MAC
+			long flip = 2 + rng() % (messageSize - 2);
+			if(flip == messageSize-macSize-2 || flip == messageSize-macSize-1){
+				flip = messageSize - 1;
+			}
+			dest[flip] ^= (uint8_t)(1 << (rng() % 8));
+			if(dest[INDEX_MAC_ALG] == alg && decode_4bytesToInt(dest, INDEX_SPDU_LENGTH) + 10 == messageSize){
+				total_cases++;
+				if((res = r_gooseMessage_ValidateHMAC(dest, key, key_size)) != 0){
+					packet_divergence("ValidateHMAC flipped", alg, files[f], res, 0);
+				}
+			}
+			free(dest);
+			dest = NULL;
+
+			// InsertGMAC / ValidateGMAC - fixed all-zeros IV (GMAC), derived nonce (Poly1305)
+			alg = gmac_algs[rng() % n_gmac];
+			macSize = MAC_SIZES[alg];
+			memset(iv, 0, sizeof(iv));
+
+			total_cases++;
+			r_gooseMessage_InsertGMAC(packet, key, 32, alg, &dest);
+			messageSize = decode_4bytesToInt(dest, INDEX_SPDU_LENGTH) + 10;
+			if(alg == CHACHA20_POLY1305_128){
+				ref_poly1305_nonce(key, &dest[INDEX_SPDU_NUMBER], iv);
+			}
+			k = find_mac_kernel(alg);
+			set_input(&c, &dest[2], messageSize-4-macSize, key, k->key_max, iv, 12);
+			k->ref(&c, ref_tag);
+			if(memcmp(ref_tag, &dest[messageSize-macSize], macSize) != 0){
+				packet_divergence("InsertGMAC tag", alg, files[f], 0, 1);
+			}
+			if((res = r_gooseMessage_ValidateGMAC(dest, key, 32)) != 1){
+				packet_divergence("ValidateGMAC valid", alg, files[f], res, 1);
+			}
+			free(dest);
+
+			// Encrypt / Decrypt round trip
+			alg = enc_algs[rng() % 3];
+			rng_fill(iv, sizeof(iv));
+
+			total_cases++;
+			uint8_t* copy = (uint8_t*)malloc(len);
+			memcpy(copy, packet, len);
+			r_gooseMessage_Encrypt(copy, key, alg, 1, 1, 1, iv, 12);
+			res = r_gooseMessage_Decrypt(copy, key, iv, 12);
+			if(res != 1 || memcmp(&copy[INDEX_PAYLOAD], &packet[INDEX_PAYLOAD], len - INDEX_PAYLOAD) != 0){
+				packet_divergence("Encrypt/Decrypt round trip", alg, files[f], res, 1);
+			}
+			free(copy);
+		}
+
+		free(packet);
+		free(original);
+	}
+}
+
+
+int main(int argc, char** argv){
+
+	long n = argc > 1 ? atol(argv[1]) : 1000000;
+	uint64_t seed = argc > 2 ? strtoull(argv[2], NULL, 0) : 0x5eed0f62351ULL;
+
+	rng_state = seed ? seed : 1;
+
+	printf("Differential verification - %ld random cases, seed 0x%llx (%s)\n", n, (unsigned long long)seed, OPENSSL_VERSION_TEXT);
+
+	known_answer_tests();
+	printf("Known Answer Tests     : %ld cases, %ld divergences\n", total_cases, total_divergences);
+
+	long before = total_cases;
+	fixed_cases();
+	printf("Fixed cases            : %ld cases, %ld divergences\n", total_cases - before, total_divergences);
+
+	before = total_cases;
+	random_cases(n);
+	printf("Random cases           : %ld cases, %ld divergences\n", total_cases - before, total_divergences);
+
+	before = total_cases;
+	packet_cases(n / 100 > 0 ? n / 100 : 1);
+	printf("R-GOOSE message cases  : %ld cases, %ld divergences\n", total_cases - before, total_divergences);
+
+	printf("%s - %ld cases, %ld divergences\n", total_divergences == 0 ? "PASS" : "FAIL", total_cases, total_divergences);
+
+	return total_divergences == 0 ? 0 : 1;
+}
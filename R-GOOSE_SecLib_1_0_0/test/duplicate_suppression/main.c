@@ -0,0 +1,236 @@
+/*
+	Test file:
+
+		Duplicate suppression (PRP/HSR) - r_goose_dedup_*() and r_gooseMessage_ValidateDedup()
+
+		1. Second copy of a verified message answered from the cache (R_GOOSE_DUPLICATE), for every
+		   MAC algorithm.
+		2. Messages that are not byte-identical copies always go through the MAC Tag verification:
+		   copied MAC Tag with a changed payload or header, forged first copy, expired entry.
+		   Messages whose SPDU Length doesn't match the received length are rejected (-1) before the
+		   MAC Tag is read.
+		3. Dual-homed subscriber: every message received twice (LAN A and LAN B), total validation
+		   time with and without the cache.
+
+*/
+
+#include "r_goose_security.h"
+#include "r_goose_keyring.h"
+#include "r_goose_dedup.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <time.h>
+
+#define MESSAGES		100000
+#define IN_FLIGHT		64
+
+int64_t timespecDiff(struct timespec *timeA_p, struct timespec *timeB_p)
+{
+  return ((timeA_p->tv_sec * 1000000000) + timeA_p->tv_nsec) -
+           ((timeB_p->tv_sec * 1000000000) + timeB_p->tv_nsec);
+}
+
+uint8_t* read_packet(char* filename, long* filelen){
+	FILE *fp;
+	unsigned char *buffer;
+
+	fp = fopen(filename, "rb");
+	fseek(fp, 0, SEEK_END);
+	*filelen = ftell(fp);
+	rewind(fp);
+
+	buffer = (unsigned char*) malloc((*filelen)*sizeof(char));
+	fread(buffer, *filelen, 1, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...)	do{ if(!(cond)){ failures++; printf("FAILED: " __VA_ARGS__); printf("\n"); } }while(0)
+
+// Number of bytes "received" for a well formed message
+static size_t message_size(const uint8_t* m){
+	return (size_t)decode_4bytesToInt((uint8_t*)m, INDEX_SPDU_LENGTH) + 10;
+}
+
+
+static void duplicates(uint8_t* packet, uint8_t* key, r_goose_keyring* ring, int reader){
+	const int algs[] = {HMAC_SHA256_80, HMAC_SHA256_128, HMAC_SHA256_256, GMAC_AES256_64, GMAC_AES256_128,
+						HMAC_BLAKE2B_80, HMAC_BLAKE2S_80, GMAC_AES128_64, GMAC_AES128_128, BLAKE2B_KEYED_80,
+						BLAKE2S_KEYED_80, CHACHA20_POLY1305_128, HMAC_SHA512_256_80, HMAC_SHA512_256_128};
+	uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+	r_goose_dedup* dedup = r_goose_dedup_new(64, 2048, 100);
+	r_goose_dedup_stats stats;
+
+	for(int a = 0; a < (int)(sizeof(algs)/sizeof(algs[0])); a++){
+		int alg = algs[a];
+		size_t key_size = (alg == GMAC_AES128_64 || alg == GMAC_AES128_128 || alg == BLAKE2S_KEYED_80) ? 16 : 32;
+		uint8_t* dest = NULL;
+
+		r_goose_keyring_publish(ring, appid, alg, alg, ENC_NONE, key, key_size, 100, 60);
+		encodeInt4Bytes(packet, 1000 + alg, INDEX_SPDU_NUMBER);
+		r_gooseMessage_InsertKeyring(packet, ring, reader, alg, &dest);
+
+		CHECK(r_gooseMessage_ValidateDedup(dest, message_size(dest), dedup, ring, reader, 10) == 1, "first copy alg %d", alg);
+		CHECK(r_gooseMessage_ValidateDedup(dest, message_size(dest), dedup, ring, reader, 11) == R_GOOSE_DUPLICATE, "second copy alg %d", alg);
+
+		free(dest);
+	}
+
+	r_goose_dedup_get_stats(dedup, &stats);
+	CHECK(stats.duplicates == 14 && stats.stored == 14, "counters");
+
+	r_goose_dedup_free(dedup);
+}
+
+
+static void not_duplicates(uint8_t* packet, uint8_t* key, r_goose_keyring* ring, int reader){
+	uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+	r_goose_dedup* dedup = r_goose_dedup_new(64, 2048, 100);
+	uint8_t* dest = NULL;
+	long size;
+
+	r_goose_keyring_publish(ring, appid, 1, HMAC_SHA256_80, ENC_NONE, key, 32, 100, 60);
+	encodeInt4Bytes(packet, 7, INDEX_SPDU_NUMBER);
+	r_gooseMessage_InsertKeyring(packet, ring, reader, 1, &dest);
+	size = decode_4bytesToInt(dest, INDEX_SPDU_LENGTH) + 10;
+
+	uint8_t* copy = (uint8_t*)malloc(size);
+
+	// Forged first copy - not stored, so the genuine message is verified normally
+	memcpy(copy, dest, size);
+	copy[INDEX_PAYLOAD + 4] ^= 0x01;
+	CHECK(r_gooseMessage_ValidateDedup(copy, message_size(copy), dedup, ring, reader, 0) == 0, "forged first copy");
+	CHECK(r_gooseMessage_ValidateDedup(copy, message_size(copy), dedup, ring, reader, 0) == 0, "forged second copy");
+	CHECK(r_gooseMessage_ValidateDedup(dest, message_size(dest), dedup, ring, reader, 0) == 1, "genuine message after a forged one");
+
+	// Same APPID, SPDU Number and MAC Tag, different bytes - MAC Tag verified (and rejected)
+	const int positions[] = {INDEX_PAYLOAD + 4, (int)size - 20, INDEX_SIMULATION, INDEX_VERSION_NUMBER};
+	for(int i = 0; i < 4; i++){
+		memcpy(copy, dest, size);
+		copy[positions[i]] ^= 0x01;
+		CHECK(r_gooseMessage_ValidateDedup(copy, message_size(copy), dedup, ring, reader, 1) == 0, "modified copy (byte %d) accepted", positions[i]);
+	}
+	CHECK(r_gooseMessage_ValidateDedup(dest, message_size(dest), dedup, ring, reader, 1) == R_GOOSE_DUPLICATE, "byte-identical copy");
+
+	// Entry expired after ttl_ms
+	CHECK(r_gooseMessage_ValidateDedup(dest, message_size(dest), dedup, ring, reader, 100) == 1, "expired entry");
+	CHECK(r_gooseMessage_ValidateDedup(dest, message_size(dest), dedup, ring, reader, 150) == R_GOOSE_DUPLICATE, "refreshed entry");
+
+	// Time wrap-around
+	CHECK(r_gooseMessage_ValidateDedup(dest, message_size(dest), dedup, ring, reader, 0xFFFFFFF0u) == 1, "before wrap");
+	CHECK(r_gooseMessage_ValidateDedup(dest, message_size(dest), dedup, ring, reader, 0x10) == R_GOOSE_DUPLICATE, "across the wrap");
+
+	// Messages without MAC Tag are never duplicates
+	CHECK(r_gooseMessage_ValidateDedup(packet, message_size(packet), dedup, ring, reader, 0x10) == 2, "message without MAC Tag");
+
+	// SPDU Length that doesn't match the received length, or leaves no room for the MAC Tag - rejected before the
+	// MAC Tag is read
+	memcpy(copy, dest, size);
+	CHECK(r_gooseMessage_ValidateDedup(copy, size - 1, dedup, ring, reader, 1) == -1, "received length below SPDU Length");
+	CHECK(r_goose_dedup_lookup(dedup, copy, size + 1, 1) == -1, "received length above SPDU Length");
+	encodeInt4Bytes(copy, INDEX_PAYLOAD - 10, INDEX_SPDU_LENGTH);
+	CHECK(r_gooseMessage_ValidateDedup(copy, INDEX_PAYLOAD, dedup, ring, reader, 1) == -1, "SPDU Length below the MAC Tag size");
+	CHECK(r_goose_dedup_insert(dedup, copy, INDEX_PAYLOAD, 1) == -1, "malformed message stored");
+	encodeInt4Bytes(copy, 0, INDEX_SPDU_LENGTH);
+	CHECK(r_gooseMessage_ValidateDedup(copy, 10, dedup, ring, reader, 1) == -1, "SPDU Length 0");
+	CHECK(r_gooseMessage_ValidateDedup(dest, message_size(dest), dedup, ring, reader, 1) == R_GOOSE_DUPLICATE, "entry kept");
+
+	// Messages larger than max_message are verified every time
+	r_goose_dedup* small = r_goose_dedup_new(64, INDEX_PAYLOAD, 100);
+	CHECK(r_gooseMessage_ValidateDedup(dest, message_size(dest), small, ring, reader, 0) == 1, "large message, first copy");
+	CHECK(r_gooseMessage_ValidateDedup(dest, message_size(dest), small, ring, reader, 0) == 1, "large message, second copy");
+	r_goose_dedup_free(small);
+
+	free(copy);
+	free(dest);
+	r_goose_dedup_free(dedup);
+}
+
+
+static void dual_homed(char* file, const char* name, int alg, uint8_t* key, r_goose_keyring* ring, int reader){
+	long len;
+	uint8_t* packet = read_packet(file, &len);
+	uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+	size_t key_size = alg == GMAC_AES128_64 ? 16 : 32;
+	uint8_t* signedPackets[IN_FLIGHT];
+	struct timespec start, end;
+	long errors = 0;
+
+	r_goose_keyring_publish(ring, appid, 500 + alg, alg, ENC_NONE, key, key_size, 100, 60);
+	for(int i = 0; i < IN_FLIGHT; i++){
+		signedPackets[i] = NULL;
+		encodeInt4Bytes(packet, i, INDEX_SPDU_NUMBER);
+		r_gooseMessage_InsertKeyring(packet, ring, reader, 500 + alg, &signedPackets[i]);
+	}
+
+	// Copies from LAN A and LAN B, one ms apart
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int m = 0; m < MESSAGES; m++){
+		uint8_t* p = signedPackets[m % IN_FLIGHT];
+		errors += r_gooseMessage_ValidateKeyring(p, message_size(p), ring, reader) != 1;
+		errors += r_gooseMessage_ValidateKeyring(p, message_size(p), ring, reader) != 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double without = (double)timespecDiff(&end, &start) / MESSAGES;
+
+	r_goose_dedup* dedup = r_goose_dedup_new(2 * IN_FLIGHT, 2048, 5);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int m = 0; m < MESSAGES; m++){
+		uint8_t* p = signedPackets[m % IN_FLIGHT];
+		uint32_t now = 10 * m;
+		errors += r_gooseMessage_ValidateDedup(p, message_size(p), dedup, ring, reader, now) != 1;
+		errors += r_gooseMessage_ValidateDedup(p, message_size(p), dedup, ring, reader, now + 1) != R_GOOSE_DUPLICATE;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double with = (double)timespecDiff(&end, &start) / MESSAGES;
+
+	printf("%-22s %-18s %14.1f %14.1f %8.2fx\n", name, file + 13, without, with, without / with);
+	CHECK(errors == 0, "%ld unexpected results (%s)", errors, name);
+
+	r_goose_dedup_free(dedup);
+	for(int i = 0; i < IN_FLIGHT; i++){
+		free(signedPackets[i]);
+	}
+	free(packet);
+}
+
+
+int main(int argc, char** argv){
+
+	char keyHex[] = "219bcef0cd0f89a5e1297b99d956150f3128459f65312fdd71618f1177393e3f";
+	uint8_t* key = hexStringToBytes(keyHex, 64);
+
+	char* files[] = {"../resources/valid_small.pkt", "../resources/valid_medium.pkt", "../resources/valid_large.pkt"};
+
+	r_goose_keyring* ring = r_goose_keyring_new(256);
+	int reader = r_goose_keyring_reader_register(ring);
+
+	for(int f = 0; f < 3; f++){
+		long len;
+		uint8_t* packet = read_packet(files[f], &len);
+		duplicates(packet, key, ring, reader);
+		not_duplicates(packet, key, ring, reader);
+		free(packet);
+	}
+
+	printf("\n%-22s %-18s %14s %14s %9s\n", "Algorithm", "Packet", "2 copies (ns)", "with cache (ns)", "speedup");
+	for(int f = 0; f < 3; f++){
+		dual_homed(files[f], "HMAC_SHA256_80", HMAC_SHA256_80, key, ring, reader);
+		dual_homed(files[f], "GMAC_AES128_64", GMAC_AES128_64, key, ring, reader);
+		dual_homed(files[f], "HMAC_SHA512_256_128", HMAC_SHA512_256_128, key, ring, reader);
+	}
+
+	r_goose_keyring_free(ring);
+	free(key);
+
+	printf("\n%s\n", failures == 0 ? "All duplicate suppression tests passed" : "Duplicate suppression tests FAILED");
+
+	return failures == 0 ? 0 : 1;
+}
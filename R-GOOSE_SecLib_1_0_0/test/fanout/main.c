@@ -0,0 +1,282 @@
+/*
+	Test file:
+
+		Multi-group fan-out - r_gooseMessage_ProtectKeyringFanout()
+
+		1. Eight destinations with different (MAC, encryption) keys and SPDU Numbers, on the three
+		   resource packets and a 48 KB message, with given IVs and IVs derived from the SPDU
+		   Number: each destination byte-identical to r_gooseMessage_ProtectKeyringTo() on the
+		   source with its SPDU Number, and unprotected back to the source payload. Source unchanged.
+		2. Invalid count; unknown key, key without MAC and destination too small mixed with valid
+		   destinations: only those get size -1 and are left untouched.
+		3. Time per message on valid_large.pkt and a 48 KB message for 4 and 8 groups:
+		   ProtectKeyringTo per group vs one ProtectKeyringFanout.
+
+*/
+
+#include "r_goose_security.h"
+#include "r_goose_keyring.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <time.h>
+
+#define ITERATIONS		200000
+
+int64_t timespecDiff(struct timespec *timeA_p, struct timespec *timeB_p)
+{
+  return ((timeA_p->tv_sec * 1000000000) + timeA_p->tv_nsec) -
+           ((timeB_p->tv_sec * 1000000000) + timeB_p->tv_nsec);
+}
+
+uint8_t* read_packet(char* filename, long* filelen){
+	FILE *fp;
+	unsigned char *buffer;
+
+	fp = fopen(filename, "rb");
+	fseek(fp, 0, SEEK_END);
+	*filelen = ftell(fp);
+	rewind(fp);
+
+	buffer = (unsigned char*) malloc((*filelen)*sizeof(char));
+	fread(buffer, *filelen, 1, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...)	do{ if(!(cond)){ failures++; printf("FAILED: " __VA_ARGS__); printf("\n"); } }while(0)
+
+static r_goose_keyring* ring;
+static int reader;
+
+static uint8_t key[32] = {0x21, 0x9b, 0xce, 0xf0, 0xcd, 0x0f, 0x89, 0xa5, 0xe1, 0x29, 0x7b, 0x99, 0xd9, 0x56, 0x15, 0x0f,
+						  0x31, 0x28, 0x45, 0x9f, 0x65, 0x31, 0x2f, 0xdd, 0x71, 0x61, 0x8f, 0x11, 0x77, 0x39, 0x3e, 0x3f};
+static uint8_t iv[12] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b};
+
+static int macs[R_GOOSE_FANOUT_MAX] = {HMAC_SHA256_80, GMAC_AES256_128, BLAKE2B_KEYED_80, CHACHA20_POLY1305_128,
+									   HMAC_SHA512_256_128, GMAC_AES128_64, BLAKE2S_KEYED_80, HMAC_SHA256_256};
+static int encs[R_GOOSE_FANOUT_MAX] = {AES_128_GCM, AES_256_GCM, CHACHA20_POLY1305, AES_128_GCM,
+									   ENC_NONE, AES_128_GCM, ENC_NONE, AES_256_GCM};
+
+static void publish_groups(uint16_t appid){
+	for(int g = 0; g < R_GOOSE_FANOUT_MAX; g++){
+		r_goose_keyring_publish(ring, appid, 10 + g, macs[g], encs[g], key, 32, 100, 60);
+	}
+}
+
+static void retire_groups(uint16_t appid){
+	for(int g = 0; g < R_GOOSE_FANOUT_MAX; g++){
+		r_goose_keyring_retire(ring, appid, 10 + g);
+	}
+	r_goose_keyring_reclaim(ring);
+}
+
+// Reference: the source with the SPDU Number of the group, protected on its own
+static int reference(uint8_t* packet, long len, r_goose_fanout_target* d, uint8_t* ref){
+	uint8_t* tmp = (uint8_t*)malloc(len);
+	int size;
+
+	memcpy(tmp, packet, len);
+	encodeInt4Bytes(tmp, d->spdu_number, INDEX_SPDU_NUMBER);
+	size = r_gooseMessage_ProtectKeyringTo(tmp, ref, len + MAX_MAC_SIZE, ring, reader, d->key_id, d->iv, d->iv_size);
+	free(tmp);
+
+	return size;
+}
+
+static void groups(uint8_t* packet, long len, const char* name){
+	uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+	int data_size = decode_2bytesToInt(packet, INDEX_APDU_LENGTH) - 2;
+	uint8_t* source = (uint8_t*)malloc(len);
+	uint8_t* ref = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+	uint8_t* out[R_GOOSE_FANOUT_MAX];
+	r_goose_fanout_target targets[R_GOOSE_FANOUT_MAX];
+
+	publish_groups(appid);
+	memcpy(source, packet, len);
+	for(int g = 0; g < R_GOOSE_FANOUT_MAX; g++){
+		out[g] = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+	}
+
+	for(int derived = 0; derived < 2; derived++){
+		for(int g = 0; g < R_GOOSE_FANOUT_MAX; g++){
+			targets[g].key_id = 10 + g;
+			targets[g].spdu_number = 1000 * (g + 1) + derived;
+			targets[g].iv = derived ? NULL : iv;
+			targets[g].iv_size = 12;
+			targets[g].dest = out[g];
+			targets[g].dest_size = len + MAX_MAC_SIZE;
+		}
+
+		int res = r_gooseMessage_ProtectKeyringFanout(source, targets, R_GOOSE_FANOUT_MAX, ring, reader);
+		CHECK(res == R_GOOSE_FANOUT_MAX, "%s, derived IV %d: %d destinations protected", name, derived, res);
+		CHECK(memcmp(source, packet, len) == 0, "%s, derived IV %d: source changed", name, derived);
+
+		for(int g = 0; g < R_GOOSE_FANOUT_MAX; g++){
+			int size = reference(packet, len, &targets[g], ref);
+			CHECK(targets[g].size == size && memcmp(out[g], ref, size) == 0, "%s, derived IV %d, group %d: protected message differs", name, derived, g);
+			CHECK(decode_4bytesToInt(out[g], INDEX_SPDU_NUMBER) == targets[g].spdu_number, "%s, group %d: SPDU Number", name, g);
+			CHECK(r_gooseMessage_UnprotectKeyring(out[g], targets[g].size, ring, reader, targets[g].iv, 12) == 1 &&
+				  memcmp(&out[g][INDEX_PAYLOAD], &packet[INDEX_PAYLOAD], data_size) == 0, "%s, derived IV %d, group %d: unprotected payload differs", name, derived, g);
+		}
+	}
+
+	retire_groups(appid);
+	for(int g = 0; g < R_GOOSE_FANOUT_MAX; g++){
+		free(out[g]);
+	}
+	free(ref);
+	free(source);
+}
+
+static void errors(void){
+	long len;
+	uint8_t* packet = read_packet("../resources/valid_medium.pkt", &len);
+	uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+	uint8_t* out[4];
+	r_goose_fanout_target targets[R_GOOSE_FANOUT_MAX + 1];
+
+	publish_groups(appid);
+	r_goose_keyring_publish(ring, appid, 99, MAC_NONE, AES_128_GCM, key, 32, 100, 60);
+
+	for(int g = 0; g < 4; g++){
+		out[g] = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+		memset(out[g], 0xa5, len + MAX_MAC_SIZE);
+		targets[g].spdu_number = g;
+		targets[g].iv = NULL;
+		targets[g].dest = out[g];
+		targets[g].dest_size = len + MAX_MAC_SIZE;
+	}
+	targets[0].key_id = 10;
+	targets[1].key_id = 98;							// unknown key
+	targets[2].key_id = 99;							// key without MAC
+	targets[3].key_id = 11;
+	targets[3].dest_size = len + 15;				// GMAC_AES256_128 needs len + 16
+
+	CHECK(r_gooseMessage_ProtectKeyringFanout(packet, targets, 0, ring, reader) == -1, "no destination");
+	CHECK(r_gooseMessage_ProtectKeyringFanout(packet, targets, R_GOOSE_FANOUT_MAX + 1, ring, reader) == -1, "too many destinations");
+
+	CHECK(r_gooseMessage_ProtectKeyringFanout(packet, targets, 4, ring, reader) == 1, "mixed destinations");
+	CHECK(targets[0].size == len + 10, "valid destination");
+	for(int g = 1; g < 4; g++){
+		int untouched = 1;
+		for(long i = 0; i < len + MAX_MAC_SIZE; i++){
+			untouched &= out[g][i] == 0xa5;
+		}
+		CHECK(targets[g].size == -1 && untouched, "failed destination %d", g);
+	}
+
+	targets[3].dest_size = len + 16;
+	CHECK(r_gooseMessage_ProtectKeyringFanout(packet, targets, 4, ring, reader) == 2 && targets[3].size == len + 16, "exact buffer");
+
+	r_goose_keyring_retire(ring, appid, 99);
+	retire_groups(appid);
+	for(int g = 0; g < 4; g++){
+		free(out[g]);
+	}
+	free(packet);
+}
+
+static void timing(uint8_t* packet, long len, const char* name, int count, int iterations){
+	uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+	uint8_t* out[R_GOOSE_FANOUT_MAX];
+	r_goose_fanout_target targets[R_GOOSE_FANOUT_MAX];
+	struct timespec start, end;
+	uint64_t separate_ns, fanout_ns;
+	int ok = 1;
+
+	publish_groups(appid);
+	for(int g = 0; g < count; g++){
+		out[g] = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+		targets[g].key_id = 10 + g;
+		targets[g].spdu_number = 1;
+		targets[g].iv = iv;
+		targets[g].iv_size = 12;
+		targets[g].dest = out[g];
+		targets[g].dest_size = len + MAX_MAC_SIZE;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < iterations; i++){
+		for(int g = 0; g < count; g++){
+			ok &= r_gooseMessage_ProtectKeyringTo(packet, out[g], len + MAX_MAC_SIZE, ring, reader, 10 + g, iv, 12) > 0;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	separate_ns = timespecDiff(&end, &start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < iterations; i++){
+		ok &= r_gooseMessage_ProtectKeyringFanout(packet, targets, count, ring, reader) == count;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	fanout_ns = timespecDiff(&end, &start);
+
+	CHECK(ok, "timing loop results");
+
+	printf("%s (%ld bytes), %d groups\n", name, len, count);
+	printf("  ProtectKeyringTo per group %9.1f ns/msg   ProtectKeyringFanout %9.1f ns/msg\n",
+		(double)separate_ns / iterations, (double)fanout_ns / iterations);
+
+	retire_groups(appid);
+	for(int g = 0; g < count; g++){
+		free(out[g]);
+	}
+}
+
+// valid_large.pkt header and the payload repeated up to size bytes (Signature TAG at the end)
+static uint8_t* large_message(uint8_t* packet, long size){
+	uint8_t* message = (uint8_t*)malloc(size);
+	int payload = decode_2bytesToInt(packet, INDEX_APDU_LENGTH) - 2;
+
+	memcpy(message, packet, INDEX_PAYLOAD);
+	for(long o = INDEX_PAYLOAD; o < size - 2; o++){
+		message[o] = packet[INDEX_PAYLOAD + (o - INDEX_PAYLOAD) % payload];
+	}
+	message[size - 2] = 0x85;
+	message[size - 1] = 0x00;
+	encodeInt4Bytes(message, (uint32_t)(size - 10), INDEX_SPDU_LENGTH);
+	encodeInt2Bytes(message, (uint16_t)(size - 2 - INDEX_PAYLOAD + 2), INDEX_APDU_LENGTH);
+
+	return message;
+}
+
+
+int main(int argc, char** argv){
+
+	ring = r_goose_keyring_new(32);
+	reader = r_goose_keyring_reader_register(ring);
+
+	char* files[] = {"../resources/valid_small.pkt", "../resources/valid_medium.pkt", "../resources/valid_large.pkt"};
+	for(int f = 0; f < 3; f++){
+		long len;
+		uint8_t* packet = read_packet(files[f], &len);
+		groups(packet, len, files[f]);
+		free(packet);
+	}
+
+	long len;
+	uint8_t* packet = read_packet("../resources/valid_large.pkt", &len);
+	uint8_t* large = large_message(packet, 48000);
+	groups(large, 48000, "48 KB message");
+	errors();
+
+	timing(packet, len, "valid_large.pkt", 4, ITERATIONS / 4);
+	timing(packet, len, "valid_large.pkt", 8, ITERATIONS / 8);
+	timing(large, 48000, "48 KB message", 4, ITERATIONS / 128);
+	timing(large, 48000, "48 KB message", 8, ITERATIONS / 256);
+	free(large);
+	free(packet);
+
+	r_goose_keyring_free(ring);
+
+	printf("\n%s\n", failures == 0 ? "All fan-out tests passed" : "Fan-out tests FAILED");
+
+	return failures == 0 ? 0 : 1;
+}
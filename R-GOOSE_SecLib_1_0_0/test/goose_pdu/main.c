@@ -0,0 +1,360 @@
+/*
+	Test file:
+
+		Pre-encoded GOOSE PDU template - r_goose_pdu_*()
+
+		1. Encoding: the GOOSE PDU built from the fields of valid_small.pkt is decoded back (BER) and
+		   every field and allData value is checked, before and after patching them.
+		2. Long strings and many values (2 byte BER lengths), type/index errors.
+		3. Publisher: the PDU is encoded in the payload of a publisher, patched and signed, the
+		   messages pass the pre-filter and r_gooseMessage_ValidateKeyring().
+		4. Time per message: encoding the whole PDU vs patching the template, with and without the
+		   MAC Tag generation.
+
+*/
+
+#include "r_goose_security.h"
+#include "r_goose_keyring.h"
+#include "r_goose_prefilter.h"
+#include "r_goose_publisher.h"
+#include "r_goose_pdu.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <time.h>
+
+#define ITERATIONS		1000000
+
+int64_t timespecDiff(struct timespec *timeA_p, struct timespec *timeB_p)
+{
+  return ((timeA_p->tv_sec * 1000000000) + timeA_p->tv_nsec) -
+           ((timeB_p->tv_sec * 1000000000) + timeB_p->tv_nsec);
+}
+
+uint8_t* read_packet(char* filename, long* filelen){
+	FILE *fp;
+	unsigned char *buffer;
+
+	fp = fopen(filename, "rb");
+	fseek(fp, 0, SEEK_END);
+	*filelen = ftell(fp);
+	rewind(fp);
+
+	buffer = (unsigned char*) malloc((*filelen)*sizeof(char));
+	fread(buffer, *filelen, 1, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...)	do{ if(!(cond)){ failures++; printf("FAILED: " __VA_ARGS__); printf("\n"); } }while(0)
+
+// Number of bytes "received" for a well formed message
+static size_t message_size(const uint8_t* m){
+	return (size_t)decode_4bytesToInt((uint8_t*)m, INDEX_SPDU_LENGTH) + 10;
+}
+
+// Fields of valid_small.pkt
+#define GOCBREF		"simpleIOGenericIO/LLN0$GO$gcbAnalogValues"
+#define DATSET		"simpleIOGenericIO/LLN0$AnalogValues"
+
+static int types[] = {R_GOOSE_DATA_INT32, R_GOOSE_DATA_FLOAT32, R_GOOSE_DATA_QUALITY, R_GOOSE_DATA_BOOLEAN,
+					  R_GOOSE_DATA_UINT32, R_GOOSE_DATA_UTCTIME};
+#define VALUES		(int)(sizeof(types)/sizeof(types[0]))
+
+
+// BER TLV reader
+typedef struct tlv {
+	uint8_t tag;
+	size_t len;
+	const uint8_t* value;
+} tlv;
+
+static int read_tlv(const uint8_t* buf, size_t size, size_t* pos, tlv* t){
+	if(*pos + 2 > size){
+		return 0;
+	}
+	t->tag = buf[(*pos)++];
+	size_t len = buf[(*pos)++];
+	if(len == 0x81){
+		len = buf[(*pos)++];
+	}else if(len == 0x82){
+		len = ((size_t)buf[*pos] << 8) | buf[*pos + 1];
+		*pos += 2;
+	}else if(len > 0x82){
+		return 0;
+	}
+	if(*pos + len > size){
+		return 0;
+	}
+	t->len = len;
+	t->value = &buf[*pos];
+	*pos += len;
+	return 1;
+}
+
+static uint64_t ber_uint(const tlv* t){
+	uint64_t v = 0;
+	for(size_t i = 0; i < t->len; i++){
+		v = (v << 8) | t->value[i];
+	}
+	return v;
+}
+
+static uint32_t be32(const uint8_t* p){
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+typedef struct decoded {
+	char gocbRef[128];
+	char datSet[128];
+	uint64_t tal, stnum, sqnum, confrev, entries;
+	uint8_t t[8];
+	int simulation, ndscom;
+	int count;
+	tlv values[2048];
+} decoded;
+
+// Decodes a GOOSE PDU, returns 0 if the encoding is inconsistent
+static int decode(const uint8_t* pdu, size_t size, decoded* d){
+	size_t pos = 0, inner = 0;
+	tlv outer, f;
+
+	memset(d, 0, sizeof(decoded));
+	if(!read_tlv(pdu, size, &pos, &outer) || outer.tag != 0x61 || pos != size){
+		return 0;
+	}
+
+	while(inner < outer.len){
+		if(!read_tlv(outer.value, outer.len, &inner, &f)){
+			return 0;
+		}
+		switch(f.tag){
+			case 0x80: memcpy(d->gocbRef, f.value, f.len < 127 ? f.len : 127); break;
+			case 0x81: d->tal = ber_uint(&f); break;
+			case 0x82: memcpy(d->datSet, f.value, f.len < 127 ? f.len : 127); break;
+			case 0x84: if(f.len != 8) return 0; memcpy(d->t, f.value, 8); break;
+			case 0x85: d->stnum = ber_uint(&f); break;
+			case 0x86: d->sqnum = ber_uint(&f); break;
+			case 0x87: d->simulation = f.value[0] != 0; break;
+			case 0x88: d->confrev = ber_uint(&f); break;
+			case 0x89: d->ndscom = f.value[0] != 0; break;
+			case 0x8A: d->entries = ber_uint(&f); break;
+			case 0xAB: {
+				size_t p = 0;
+				while(p < f.len){
+					if(d->count == 2048 || !read_tlv(f.value, f.len, &p, &d->values[d->count++])){
+						return 0;
+					}
+				}
+				break;
+			}
+			default: break;
+		}
+	}
+
+	return inner == outer.len;
+}
+
+
+static void encoding(void){
+	r_goose_pdu_config cfg = {GOCBREF, DATSET, GOCBREF, 2000, 1, 0, 1, 0x0A, types, VALUES};
+	uint8_t buffer[1024];
+	decoded* d = (decoded*)malloc(sizeof(decoded));
+
+	r_goose_pdu_template* pdu = r_goose_pdu_template_new(&cfg);
+	CHECK(pdu != NULL, "template");
+
+	// Garbage in the buffer must be fully overwritten
+	memset(buffer, 0xA5, sizeof(buffer));
+	CHECK(r_goose_pdu_encode(pdu, buffer, pdu->size - 1) == -1, "buffer too small accepted");
+	CHECK(r_goose_pdu_encode(pdu, buffer, sizeof(buffer)) == (int)pdu->size, "encode");
+
+	CHECK(decode(buffer, pdu->size, d), "encoded PDU doesn't decode");
+	CHECK(strcmp(d->gocbRef, GOCBREF) == 0 && strcmp(d->datSet, DATSET) == 0, "strings");
+	CHECK(d->tal == 2000 && d->confrev == 1 && d->entries == VALUES && d->count == VALUES, "fixed fields");
+	CHECK(d->stnum == 1 && d->sqnum == 0 && d->simulation == 0 && d->ndscom == 1 && d->t[7] == 0x0A, "initial stNum/sqNum/t");
+
+	uint8_t tags[] = {0x85, 0x87, 0x84, 0x83, 0x86, 0x91};
+	for(int i = 0; i < VALUES; i++){
+		CHECK(d->values[i].tag == tags[i], "value %d tag %02x", i, d->values[i].tag);
+	}
+
+	// Patches
+	r_goose_pdu_set_stnum(pdu, 0xFEDCBA98);
+	r_goose_pdu_set_sqnum(pdu, 7);
+	r_goose_pdu_set_timestamp(pdu, 0x5EB2976C, 0xE9BA5E);
+	CHECK(r_goose_pdu_set_int32(pdu, 0, -1234) == 1, "set int32");
+	CHECK(r_goose_pdu_set_float32(pdu, 1, 50.125f) == 1, "set float32");
+	CHECK(r_goose_pdu_set_quality(pdu, 2, 0x1801) == 1, "set quality");
+	CHECK(r_goose_pdu_set_boolean(pdu, 3, 1) == 1, "set boolean");
+	CHECK(r_goose_pdu_set_uint32(pdu, 4, 0xFFFFFFFF) == 1, "set uint32");
+	CHECK(r_goose_pdu_set_utctime(pdu, 5, 1, 2, 3) == 1, "set utctime");
+
+	CHECK(decode(buffer, pdu->size, d), "patched PDU doesn't decode");
+	CHECK(d->stnum == 0xFEDCBA98 && d->sqnum == 7, "stNum/sqNum");
+	CHECK(memcmp(d->t, "\x5e\xb2\x97\x6c\xe9\xba\x5e\x0a", 8) == 0, "t");
+	CHECK((int32_t)be32(d->values[0].value) == -1234, "int32");
+	float f;
+	uint32_t bits = be32(&d->values[1].value[1]);
+	memcpy(&f, &bits, sizeof(f));
+	CHECK(d->values[1].value[0] == 8 && f == 50.125f, "float32");
+	CHECK(d->values[2].value[0] == 3 && d->values[2].value[1] == 0xC0 && d->values[2].value[2] == 0x08, "quality");
+	CHECK(d->values[3].value[0] == 0xFF, "boolean");
+	CHECK(ber_uint(&d->values[4]) == 0xFFFFFFFF, "uint32");
+	CHECK(memcmp(d->values[5].value, "\x00\x00\x00\x01\x00\x00\x02\x03", 8) == 0, "utctime");
+
+	// Wrong type, out of range
+	CHECK(r_goose_pdu_set_float32(pdu, 0, 1.0f) == -1, "wrong type accepted");
+	CHECK(r_goose_pdu_set_int32(pdu, VALUES, 1) == -1 && r_goose_pdu_set_int32(pdu, -1, 1) == -1, "index out of range accepted");
+	size_t small_size = pdu->size;
+	r_goose_pdu_template_free(pdu);
+
+	// Unknown type, too many values
+	int bad[] = {R_GOOSE_DATA_INT32, 99};
+	r_goose_pdu_config bad_cfg = {GOCBREF, DATSET, NULL, 2000, 1, 0, 0, 0, bad, 2};
+	CHECK(r_goose_pdu_template_new(&bad_cfg) == NULL, "unknown type accepted");
+	bad_cfg.count = R_GOOSE_PDU_MAX_VALUES + 1;
+	CHECK(r_goose_pdu_template_new(&bad_cfg) == NULL, "too many values accepted");
+
+	// Long strings and many values - 2 byte lengths, no goID
+	char long_ref[300];
+	memset(long_ref, 'x', sizeof(long_ref) - 1);
+	long_ref[sizeof(long_ref) - 1] = '\0';
+	int* many = (int*)malloc(R_GOOSE_PDU_MAX_VALUES * sizeof(int));
+	for(int i = 0; i < R_GOOSE_PDU_MAX_VALUES; i++){
+		many[i] = types[i % VALUES];
+	}
+	r_goose_pdu_config big_cfg = {long_ref, DATSET, NULL, 0x12345678, 0x80, 1, 0, 0, many, R_GOOSE_PDU_MAX_VALUES};
+	pdu = r_goose_pdu_template_new(&big_cfg);
+	uint8_t* big = (uint8_t*)malloc(pdu->size);
+	r_goose_pdu_encode(pdu, big, pdu->size);
+	for(int i = 0; i < R_GOOSE_PDU_MAX_VALUES; i++){
+		if(many[i] == R_GOOSE_DATA_INT32){
+			r_goose_pdu_set_int32(pdu, i, i);
+		}
+	}
+	CHECK(decode(big, pdu->size, d), "large PDU doesn't decode");
+	CHECK(d->tal == 0x12345678 && d->confrev == 0x80 && d->entries == R_GOOSE_PDU_MAX_VALUES && d->count == R_GOOSE_PDU_MAX_VALUES,
+		  "large PDU fields");
+	CHECK(d->simulation == 1 && strlen(d->gocbRef) == 127, "large PDU simulation/gocbRef");
+	int values_ok = 1;
+	for(int i = 0; i < R_GOOSE_PDU_MAX_VALUES; i += VALUES){
+		values_ok &= (int32_t)be32(d->values[i].value) == i;
+	}
+	CHECK(values_ok, "large PDU values");
+	printf("GOOSE PDU: %d values -> %zu bytes, %d values -> %zu bytes\n", VALUES, small_size, R_GOOSE_PDU_MAX_VALUES, pdu->size);
+
+	free(big);
+	free(many);
+	r_goose_pdu_template_free(pdu);
+	free(d);
+}
+
+
+static void publishing(uint8_t* packet){
+	uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+	r_goose_pdu_config cfg = {GOCBREF, DATSET, GOCBREF, 2000, 1, 0, 0, 0x0A, types, VALUES};
+	struct timespec start, end;
+	uint64_t encode_ns, patch_ns, encode_sign_ns, patch_sign_ns;
+	uint8_t* message;
+
+	char keyHex[] = "219bcef0cd0f89a5e1297b99d956150f3128459f65312fdd71618f1177393e3f";
+	uint8_t* key = hexStringToBytes(keyHex, 64);
+	r_goose_keyring* ring = r_goose_keyring_new(16);
+	int reader = r_goose_keyring_reader_register(ring);
+	r_goose_keyring_publish(ring, appid, 1, HMAC_SHA256_80, ENC_NONE, key, 32, 1000, 60);
+
+	r_goose_publisher* pub = r_goose_publisher_new(packet, ring, reader, 1, 1400);
+	r_goose_pdu_template* pdu = r_goose_pdu_template_new(&cfg);
+	uint8_t* payload = r_goose_publisher_payload(pub);
+
+	CHECK(r_goose_pdu_encode(pdu, payload, pub->max_payload) > 0, "encode in the publisher");
+
+	// stNum changes with the values, sqNum counts the retransmissions
+	for(uint32_t i = 0; i < 20; i++){
+		r_goose_pdu_set_stnum(pdu, 1 + i / 4);
+		r_goose_pdu_set_sqnum(pdu, i % 4);
+		r_goose_pdu_set_timestamp(pdu, 1600000000 + i, 0);
+		r_goose_pdu_set_int32(pdu, 0, (int32_t)(i / 4));
+
+		int len = r_goose_publisher_sign(pub, pdu->size, &message);
+		CHECK(len == (int)(INDEX_PAYLOAD + pdu->size + 2 + MAC_SIZES[HMAC_SHA256_80]), "message size");
+		CHECK(r_gooseMessage_Prefilter(message, len) == 0, "pre-filter");
+		CHECK(r_gooseMessage_ValidateKeyring(message, message_size(message), ring, reader) == 1, "validation");
+	}
+
+	// Timing - whole PDU encoded per message vs patched
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(uint32_t i = 0; i < ITERATIONS; i++){
+		r_goose_pdu_encode(pdu, payload, pub->max_payload);
+		r_goose_pdu_set_stnum(pdu, i);
+		r_goose_pdu_set_timestamp(pdu, i, i);
+		r_goose_pdu_set_float32(pdu, 1, (float)i);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	encode_ns = timespecDiff(&end, &start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(uint32_t i = 0; i < ITERATIONS; i++){
+		r_goose_pdu_set_stnum(pdu, i);
+		r_goose_pdu_set_timestamp(pdu, i, i);
+		r_goose_pdu_set_float32(pdu, 1, (float)i);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	patch_ns = timespecDiff(&end, &start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(uint32_t i = 0; i < ITERATIONS / 10; i++){
+		r_goose_pdu_encode(pdu, payload, pub->max_payload);
+		r_goose_pdu_set_stnum(pdu, i);
+		r_goose_pdu_set_timestamp(pdu, i, i);
+		r_goose_pdu_set_float32(pdu, 1, (float)i);
+		r_goose_publisher_sign(pub, pdu->size, &message);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	encode_sign_ns = timespecDiff(&end, &start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(uint32_t i = 0; i < ITERATIONS / 10; i++){
+		r_goose_pdu_set_stnum(pdu, i);
+		r_goose_pdu_set_timestamp(pdu, i, i);
+		r_goose_pdu_set_float32(pdu, 1, (float)i);
+		r_goose_publisher_sign(pub, pdu->size, &message);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	patch_sign_ns = timespecDiff(&end, &start);
+
+	CHECK(r_gooseMessage_ValidateKeyring(message, message_size(message), ring, reader) == 1, "validation after timing");
+
+	printf("PDU of %zu bytes      encode %7.1f ns/msg   patch %7.1f ns/msg\n", pdu->size,
+		(double)encode_ns / ITERATIONS, (double)patch_ns / ITERATIONS);
+	printf("With HMAC-SHA256-80   encode %7.1f ns/msg   patch %7.1f ns/msg\n",
+		(double)encode_sign_ns / (ITERATIONS / 10), (double)patch_sign_ns / (ITERATIONS / 10));
+
+	r_goose_pdu_template_free(pdu);
+	r_goose_publisher_free(pub);
+	r_goose_keyring_free(ring);
+	free(key);
+}
+
+
+int main(int argc, char** argv){
+
+	long len;
+	uint8_t* packet = read_packet("../resources/valid_small.pkt", &len);
+
+	encoding();
+	publishing(packet);
+
+	free(packet);
+
+	printf("\n%s\n", failures == 0 ? "All GOOSE PDU template tests passed" : "GOOSE PDU template tests FAILED");
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,452 @@
+/*
+	Test file:
+
+		GOOSE PDU view - r_goose_view_*(), r_goose_data_*() and r_gooseMessage_ValidateView()
+
+		1. Resource packets: header fields and every allData entry, found by index (periodic
+		   part and walk) and by iteration, compared with a reference BER walk.
+		2. Values written with the GOOSE PDU template (r_goose_pdu_*()) read back through the
+		   view, nested structures, negative integers.
+		3. Malformed PDUs in authentic messages (R_GOOSE_PDU_ERROR) and random corruptions of
+		   allData: the view never leaves the PDU and always agrees with the reference walk.
+		4. Time per message on valid_large.pkt: validation then a separate walk of allData vs
+		   r_gooseMessage_ValidateView() and the view, and allData scan vs a plain walk.
+
+*/
+
+#include "r_goose_security.h"
+#include "r_goose_keyring.h"
+#include "r_goose_publisher.h"
+#include "r_goose_pdu.h"
+#include "r_goose_view.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <time.h>
+
+#define ITERATIONS		200000
+#define FUZZ			200000
+
+int64_t timespecDiff(struct timespec *timeA_p, struct timespec *timeB_p)
+{
+  return ((timeA_p->tv_sec * 1000000000) + timeA_p->tv_nsec) -
+           ((timeB_p->tv_sec * 1000000000) + timeB_p->tv_nsec);
+}
+
+uint8_t* read_packet(char* filename, long* filelen){
+	FILE *fp;
+	unsigned char *buffer;
+
+	fp = fopen(filename, "rb");
+	fseek(fp, 0, SEEK_END);
+	*filelen = ftell(fp);
+	rewind(fp);
+
+	buffer = (unsigned char*) malloc((*filelen)*sizeof(char));
+	fread(buffer, *filelen, 1, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...)	do{ if(!(cond)){ failures++; printf("FAILED: " __VA_ARGS__); printf("\n"); } }while(0)
+
+// Number of bytes "received" for a well formed message
+static size_t message_size(const uint8_t* m){
+	return (size_t)decode_4bytesToInt((uint8_t*)m, INDEX_SPDU_LENGTH) + 10;
+}
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t rng(void){
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static r_goose_keyring* ring;
+static int reader;
+
+
+// Reference BER walk (what applications do today): offsets of the allData entries, -1 if malformed
+static int reference_walk(const uint8_t* p, size_t size, size_t* offsets, int max){
+	size_t pos = 0;
+	int n = 0;
+
+	while(pos < size){
+		if(size - pos < 2 || (p[pos] & 0x1F) == 0x1F){
+			return -1;
+		}
+		size_t len = p[pos + 1], h = 2;
+		if(len == 0x81 && size - pos >= 3){
+			len = p[pos + 2];
+			h = 3;
+		}else if(len == 0x82 && size - pos >= 4){
+			len = ((size_t)p[pos + 2] << 8) | p[pos + 3];
+			h = 4;
+		}else if(len >= 0x80){
+			return -1;
+		}
+		if(len > size - pos - h){
+			return -1;
+		}
+		if(n < max){
+			offsets[n] = pos;
+		}
+		n++;
+		pos += h + len;
+	}
+
+	return n;
+}
+
+// Every entry found by the view (by index, backwards, and by iteration) starts where the reference walk says
+static int view_matches(r_goose_view* view, const uint8_t* all, size_t all_len){
+	static size_t offsets[65536];
+	r_goose_data d;
+	r_goose_data_iter it;
+
+	int n = reference_walk(all, all_len, offsets, 65536);
+	if(r_goose_view_data_count(view) != n){
+		return 0;
+	}
+	if(n < 0){
+		// Malformed allData - iteration stops with an error
+		int res;
+		r_goose_view_data_iter(view, &it);
+		while((res = r_goose_data_next(&it, &d)) == 1);
+		return res == -1 && r_goose_view_data_at(view, 0, &d) == -1;
+	}
+
+	for(int i = 0; i < n; i++){
+		if(r_goose_view_data_at(view, i, &d) != 1 || d.value - all < (long)offsets[i] || d.value - all > (long)offsets[i] + 4){
+			return 0;
+		}
+	}
+	for(int i = n - 1; i >= 0; i -= 7){
+		if(r_goose_view_data_at(view, i, &d) != 1 || d.value - all < (long)offsets[i] || d.value - all > (long)offsets[i] + 4){
+			return 0;
+		}
+	}
+	if(n > 0 && (r_goose_view_data_at(view, n, &d) != -1 || r_goose_view_data_at(view, -1, &d) != -1)){
+		return 0;
+	}
+
+	int i = 0;
+	r_goose_view_data_iter(view, &it);
+	while(r_goose_data_next(&it, &d) == 1){
+		if(i >= n || d.value - all < (long)offsets[i] || d.value - all > (long)offsets[i] + 4){
+			return 0;
+		}
+		i++;
+	}
+	return i == n;
+}
+
+
+static void resources(void){
+	char* files[] = {"../resources/valid_small.pkt", "../resources/valid_medium.pkt", "../resources/valid_large.pkt"};
+	uint32_t entries[] = {1, 20, 220};
+
+	for(int f = 0; f < 3; f++){
+		long len;
+		uint8_t* packet = read_packet(files[f], &len);
+		uint8_t* message = NULL;
+		r_goose_view view;
+		size_t slen;
+		uint32_t v, seconds, fraction;
+		uint8_t quality;
+		r_goose_data d;
+		int64_t value;
+
+		r_goose_keyring_publish(ring, decode_2bytesToInt(packet, INDEX_APPID), 1, HMAC_SHA256_80, ENC_NONE,
+								(uint8_t*)"0123456789abcdef0123456789abcdef", 32, 100, 60);
+		r_gooseMessage_InsertKeyring(packet, ring, reader, 1, &message);
+
+		CHECK(r_gooseMessage_ValidateView(message, message_size(message), ring, reader, &view) == 1, "%s: validation", files[f]);
+
+		const char* s = r_goose_view_string(&view, R_GOOSE_FIELD_GOCBREF, &slen);
+		CHECK(s != NULL && slen == 41 && memcmp(s, "simpleIOGenericIO/LLN0$GO$gcbAnalogValues", slen) == 0, "%s: gocbRef", files[f]);
+		s = r_goose_view_string(&view, R_GOOSE_FIELD_DATSET, &slen);
+		CHECK(s != NULL && slen == 35 && memcmp(s, "simpleIOGenericIO/LLN0$AnalogValues", slen) == 0, "%s: datSet", files[f]);
+		CHECK(r_goose_view_string(&view, R_GOOSE_FIELD_STNUM, &slen) == NULL, "%s: stNum as a string", files[f]);
+
+		CHECK(r_goose_view_uint(&view, R_GOOSE_FIELD_STNUM, &v) == 1 && v == 1, "%s: stNum", files[f]);
+		CHECK(r_goose_view_uint(&view, R_GOOSE_FIELD_SQNUM, &v) == 1 && v == 0, "%s: sqNum", files[f]);
+		CHECK(r_goose_view_uint(&view, R_GOOSE_FIELD_CONFREV, &v) == 1 && v == 1, "%s: confRev", files[f]);
+		CHECK(r_goose_view_uint(&view, R_GOOSE_FIELD_NUMDATSETENTRIES, &v) == 1 && v == entries[f], "%s: numDatSetEntries", files[f]);
+		CHECK(r_goose_view_boolean(&view, R_GOOSE_FIELD_SIMULATION) == 0 && r_goose_view_boolean(&view, R_GOOSE_FIELD_NDSCOM) == 0,
+			  "%s: simulation/ndsCom", files[f]);
+		CHECK(r_goose_view_timestamp(&view, &seconds, &fraction, &quality) == 1 && seconds >> 24 == 0x5E && quality == 0x0A, "%s: t", files[f]);
+
+		CHECK(r_goose_view_data_count(&view) == (int)entries[f], "%s: %d entries", files[f], r_goose_view_data_count(&view));
+		CHECK(r_goose_view_data_at(&view, 0, &d) == 1 && r_goose_data_int(&d, &value) == 1 && value == 1234, "%s: first value", files[f]);
+		if(f > 0){
+			CHECK(view.periods > 0 && view.period == 12 && view.period_entries == 2, "%s: periodic allData not found", files[f]);
+		}
+
+		const r_goose_data* all = &view.fields[R_GOOSE_FIELD_ALLDATA];
+		CHECK(view_matches(&view, all->value, all->len), "%s: entries differ from the reference walk", files[f]);
+
+		// Invalid MAC Tag - no view
+		message[INDEX_PAYLOAD + 10] ^= 1;
+		CHECK(r_gooseMessage_ValidateView(message, message_size(message), ring, reader, &view) == 0, "%s: invalid message", files[f]);
+
+		r_goose_keyring_retire(ring, decode_2bytesToInt(packet, INDEX_APPID), 1);
+		free(message);
+		free(packet);
+	}
+	r_goose_keyring_reclaim(ring);
+}
+
+
+static void values(r_goose_publisher* pub){
+	int types[] = {R_GOOSE_DATA_FLOAT32, R_GOOSE_DATA_QUALITY, R_GOOSE_DATA_INT32, R_GOOSE_DATA_UINT32, R_GOOSE_DATA_BOOLEAN};
+	r_goose_pdu_config cfg = {"IED1LD0/LLN0$GO$gcb1", "IED1LD0/LLN0$DataSet1", NULL, 2000, 3, 1, 0, 0x0A, types, 5};
+	r_goose_view view;
+	r_goose_data d, e;
+	r_goose_data_iter it;
+	uint8_t* message;
+	uint32_t v;
+	double f;
+	int64_t i64;
+	uint64_t u64;
+
+	// 5 values: one record of 5 entries (not repeated), walked
+	r_goose_pdu_template* pdu = r_goose_pdu_template_new(&cfg);
+	r_goose_pdu_encode(pdu, r_goose_publisher_payload(pub), pub->max_payload);
+	r_goose_pdu_set_stnum(pdu, 0x89ABCDEF);
+	r_goose_pdu_set_float32(pdu, 0, -2.5f);
+	r_goose_pdu_set_int32(pdu, 2, -100000);
+	r_goose_pdu_set_uint32(pdu, 3, 0xF0000000);
+	r_goose_pdu_set_boolean(pdu, 4, 1);
+	int len = r_goose_publisher_sign(pub, pdu->size, &message);
+
+	CHECK(len > 0 && r_gooseMessage_ValidateView(message, len, ring, reader, &view) == 1, "template message");
+	CHECK(r_goose_view_uint(&view, R_GOOSE_FIELD_STNUM, &v) == 1 && v == 0x89ABCDEF, "fixed width stNum");
+	CHECK(r_goose_view_boolean(&view, R_GOOSE_FIELD_SIMULATION) == 1, "simulation");
+	CHECK(view.fields[R_GOOSE_FIELD_GOID].tag == 0, "goID present");
+	CHECK(r_goose_view_data_count(&view) == 5 && view.periods == 0, "5 entries, not periodic");
+	CHECK(r_goose_view_data_at(&view, 0, &d) == 1 && r_goose_data_float(&d, &f) == 1 && f == -2.5, "float32");
+	CHECK(r_goose_view_data_at(&view, 2, &d) == 1 && r_goose_data_int(&d, &i64) == 1 && i64 == -100000, "int32");
+	CHECK(r_goose_view_data_at(&view, 3, &d) == 1 && r_goose_data_uint(&d, &u64) == 1 && u64 == 0xF0000000, "uint32");
+	CHECK(r_goose_view_data_at(&view, 4, &d) == 1 && r_goose_data_boolean(&d) == 1, "boolean");
+	CHECK(r_goose_view_data_at(&view, 1, &d) == 1 && d.tag == 0x84 && d.len == 3 && r_goose_data_int(&d, &i64) == -1, "quality");
+	r_goose_pdu_template_free(pdu);
+
+	// 1001 values (500 records of float + quality, one float after them)
+	int many[1001];
+	for(int i = 0; i < 1001; i++){
+		many[i] = i % 2 == 0 ? R_GOOSE_DATA_FLOAT32 : R_GOOSE_DATA_QUALITY;
+	}
+	cfg.types = many;
+	cfg.count = 1001;
+	pdu = r_goose_pdu_template_new(&cfg);
+	r_goose_pdu_encode(pdu, r_goose_publisher_payload(pub), pub->max_payload);
+	for(int i = 0; i < 1001; i += 2){
+		r_goose_pdu_set_float32(pdu, i, (float)i);
+	}
+	len = r_goose_publisher_sign(pub, pdu->size, &message);
+
+	CHECK(len > 0 && r_gooseMessage_ValidateView(message, len, ring, reader, &view) == 1, "1001 values message");
+	CHECK(r_goose_view_data_count(&view) == 1001 && view.periods == 500 && view.period_entries == 2, "1001 values layout");
+	int ok = 1;
+	for(int i = 1000; i >= 0; i -= 2){
+		ok &= r_goose_view_data_at(&view, i, &d) == 1 && r_goose_data_float(&d, &f) == 1 && f == (double)i;
+	}
+	CHECK(ok, "1001 values, by index");
+	const r_goose_data* all = &view.fields[R_GOOSE_FIELD_ALLDATA];
+	CHECK(view_matches(&view, all->value, all->len), "1001 values differ from the reference walk");
+	r_goose_pdu_template_free(pdu);
+
+	// Hand encoded: structure {int -2, boolean TRUE, array {unsigned 5}}, double, then unknown elements after allData
+	uint8_t nested[] = {0x61, 0x2B,
+						0x80, 0x03, 'a', 'b', 'c',
+						0x85, 0x01, 0x07,
+						0x86, 0x01, 0x00,
+						0xAB, 0x19,
+							0xA2, 0x0C, 0x85, 0x01, 0xFE, 0x83, 0x01, 0xFF, 0xA1, 0x04, 0x86, 0x02, 0x00, 0x05,
+							0x87, 0x09, 0x0B, 0x40, 0x09, 0x21, 0xFB, 0x54, 0x44, 0x2D, 0x18,
+						0x8C, 0x01, 0x00,
+						0x99, 0x00};
+	memcpy(r_goose_publisher_payload(pub), nested, sizeof(nested));
+	len = r_goose_publisher_sign(pub, sizeof(nested), &message);
+
+	CHECK(r_gooseMessage_ValidateView(message, len, ring, reader, &view) == 1, "nested message");
+	CHECK(r_goose_view_uint(&view, R_GOOSE_FIELD_STNUM, &v) == 1 && v == 7, "nested stNum");
+	CHECK(r_goose_view_data_count(&view) == 2, "nested entries");
+	CHECK(r_goose_view_data_at(&view, 1, &d) == 1 && r_goose_data_float(&d, &f) == 1 && f > 3.14159 && f < 3.1416, "double");
+
+	r_goose_view_data_at(&view, 0, &d);
+	CHECK(r_goose_data_iter_init(&d, &it) == 1, "structure iterator");
+	CHECK(r_goose_data_next(&it, &e) == 1 && r_goose_data_int(&e, &i64) == 1 && i64 == -2, "structure int");
+	CHECK(r_goose_data_next(&it, &e) == 1 && r_goose_data_boolean(&e) == 1, "structure boolean");
+	CHECK(r_goose_data_next(&it, &e) == 1 && e.tag == 0xA1, "structure array");
+	CHECK(r_goose_data_iter_init(&e, &it) == 1 && r_goose_data_next(&it, &e) == 1 && r_goose_data_uint(&e, &u64) == 1 && u64 == 5, "array unsigned");
+	CHECK(r_goose_data_next(&it, &e) == 0, "end of array");
+	CHECK(r_goose_data_iter_init(&e, &it) == -1, "primitive iterated");
+
+	// Element overflowing the GOOSE PDU, duplicated field, wrong outer tag
+	uint8_t bad[][8] = {{0x61, 0x06, 0x80, 0x07, 'a', 'b', 'c', 'd'},
+						{0x61, 0x06, 0x85, 0x01, 0x01, 0x85, 0x01, 0x02},
+						{0x62, 0x06, 0x85, 0x01, 0x01, 0x86, 0x01, 0x02},
+						{0x61, 0x06, 0x85, 0x80, 0x01, 0x86, 0x01, 0x02}};
+	for(int i = 0; i < 4; i++){
+		memcpy(r_goose_publisher_payload(pub), bad[i], 8);
+		len = r_goose_publisher_sign(pub, 8, &message);
+		CHECK(r_gooseMessage_ValidateView(message, len, ring, reader, &view) == R_GOOSE_PDU_ERROR, "malformed PDU %d accepted", i);
+	}
+}
+
+
+static void fuzz(uint8_t* large, long len){
+	long mismatches = 0, decoded = 0;
+
+	for(int i = 0; i < FUZZ; i++){
+		// Exact size copy, so any read past the message is caught by the sanitizers
+		uint8_t* m = (uint8_t*)malloc(len);
+		r_goose_view view;
+
+		memcpy(m, large, len);
+		int changes = 1 + rng() % 4;
+		for(int c = 0; c < changes; c++){
+			// Mostly inside allData (tag/length bytes of the records), sometimes anywhere in the PDU
+			long pos = rng() % 4 ? 0xC9 + (long)(rng() % (len - 0xC9 - 2)) : INDEX_PAYLOAD + (long)(rng() % (len - INDEX_PAYLOAD - 2));
+			m[pos] = rng() % 2 ? (uint8_t)rng() : m[pos] ^ (uint8_t)(1 << (rng() % 8));
+		}
+
+		if(r_goose_view_init(&view, m) == 1 && view.fields[R_GOOSE_FIELD_ALLDATA].tag == 0xAB){
+			const r_goose_data* all = &view.fields[R_GOOSE_FIELD_ALLDATA];
+			decoded++;
+			if(!view_matches(&view, all->value, all->len)){
+				mismatches++;
+			}
+		}
+		free(m);
+	}
+
+	printf("Fuzz: %d corrupted messages, %ld with allData, %ld mismatches\n", FUZZ, decoded, mismatches);
+	CHECK(mismatches == 0, "view differs from the reference walk on corrupted messages");
+}
+
+
+static void timing(uint8_t* large){
+	uint8_t* message = NULL;
+	struct timespec start, end;
+	uint64_t separate_ns, fused_ns, index_ns, walk_ns, scan_ns;
+	static size_t offsets[1024];
+	r_goose_view view;
+	r_goose_data d;
+	r_goose_data_iter it;
+	int64_t value, sum = 0;
+
+	r_goose_keyring_publish(ring, decode_2bytesToInt(large, INDEX_APPID), 1, HMAC_SHA256_80, ENC_NONE,
+							(uint8_t*)"0123456789abcdef0123456789abcdef", 32, 100, 60);
+	r_gooseMessage_InsertKeyring(large, ring, reader, 1, &message);
+
+	r_goose_view_init(&view, message);
+	const uint8_t* all = view.fields[R_GOOSE_FIELD_ALLDATA].value;
+	size_t all_len = view.fields[R_GOOSE_FIELD_ALLDATA].len;
+
+	// Validation, then the application walks allData and reads every integer
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < ITERATIONS; i++){
+		if(r_gooseMessage_ValidateKeyring(message, message_size(message), ring, reader) == 1){
+			int n = reference_walk(all, all_len, offsets, 1024);
+			for(int j = 0; j < n; j += 2){
+				sum += (int16_t)((all[offsets[j] + 2] << 8) | all[offsets[j] + 3]);
+			}
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	separate_ns = timespecDiff(&end, &start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < ITERATIONS; i++){
+		if(r_gooseMessage_ValidateView(message, message_size(message), ring, reader, &view) == 1){
+			r_goose_view_data_iter(&view, &it);
+			while(r_goose_data_next(&it, &d) == 1){
+				if(r_goose_data_int(&d, &value) == 1){
+					sum -= value;
+				}
+			}
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	fused_ns = timespecDiff(&end, &start);
+
+	// Random access by index (allData scanned once per message)
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < ITERATIONS; i++){
+		view.count = -1;
+		int n = r_goose_view_data_count(&view);
+		for(int j = 0; j < n; j += 2){
+			r_goose_view_data_at(&view, j, &d);
+			r_goose_data_int(&d, &value);
+			sum -= value;
+		}
+		sum += 1234 * (n / 2);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	index_ns = timespecDiff(&end, &start);
+
+	// allData only: plain walk vs periodic scan
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < ITERATIONS; i++){
+		sum += reference_walk(all, all_len, offsets, 1024);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	walk_ns = timespecDiff(&end, &start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < ITERATIONS; i++){
+		view.count = -1;
+		sum -= r_goose_view_data_count(&view);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	scan_ns = timespecDiff(&end, &start);
+
+	CHECK(sum == 0, "values read differ");
+
+	printf("valid_large.pkt (220 entries)  validate + walk %7.1f ns/msg   ValidateView + view %7.1f ns/msg\n",
+		(double)separate_ns / ITERATIONS, (double)fused_ns / ITERATIONS);
+	printf("allData (%zu bytes)           walk %7.1f ns   scan %7.1f ns   scan + 110 values by index %7.1f ns\n", all_len,
+		(double)walk_ns / ITERATIONS, (double)scan_ns / ITERATIONS, (double)index_ns / ITERATIONS);
+
+	free(message);
+}
+
+
+int main(int argc, char** argv){
+
+	ring = r_goose_keyring_new(16);
+	reader = r_goose_keyring_reader_register(ring);
+
+	resources();
+
+	long len;
+	uint8_t* packet = read_packet("../resources/valid_small.pkt", &len);
+	r_goose_keyring_publish(ring, decode_2bytesToInt(packet, INDEX_APPID), 2, GMAC_AES256_64, ENC_NONE,
+							(uint8_t*)"0123456789abcdef0123456789abcdef", 32, 100, 60);
+	r_goose_publisher* pub = r_goose_publisher_new(packet, ring, reader, 2, 8000);
+	values(pub);
+	r_goose_publisher_free(pub);
+	free(packet);
+
+	uint8_t* large = read_packet("../resources/valid_large.pkt", &len);
+	fuzz(large, len);
+	timing(large);
+	free(large);
+
+	r_goose_keyring_free(ring);
+
+	printf("\n%s\n", failures == 0 ? "All GOOSE PDU view tests passed" : "GOOSE PDU view tests FAILED");
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+/* 
+	Test file: 
+
+		HMAC-SHA512/256 (HMAC_SHA512_256_80 / HMAC_SHA512_256_128) against HMAC-SHA256
+			- Tag check against a direct OpenSSL HMAC(EVP_sha512_256()) computation
+			- r_gooseMessage_InsertHMAC() / r_gooseMessage_ValidateHMAC() round trip
+			- Timing of r_gooseMessage_ValidateHMAC() on valid_small/medium/large.pkt
+
+*/
+
+#include "r_goose_security.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <time.h>
+
+int64_t timespecDiff(struct timespec *timeA_p, struct timespec *timeB_p)
+{
+  return ((timeA_p->tv_sec * 1000000000) + timeA_p->tv_nsec) -
+           ((timeB_p->tv_sec * 1000000000) + timeB_p->tv_nsec);
+}
+
+uint8_t* read_packet(char* filename){
+	FILE *fp;
+	unsigned char *buffer;
+	long filelen;
+
+	fp = fopen(filename, "rb");
+	if(fp == NULL){
+		perror(filename);
+		exit(1);
+	}
+
+	fseek(fp, 0, SEEK_END);
+	filelen = ftell(fp);
+	rewind(fp);
+
+	buffer = (unsigned char*) malloc(filelen*sizeof(char));
+	fread(buffer, filelen, 1, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+void check(uint8_t* packet, uint8_t* key, int key_size){
+	uint8_t* dest = NULL;
+	uint8_t expected[EVP_MAX_MD_SIZE];
+	int algs[] = {HMAC_SHA512_256_80, HMAC_SHA512_256_128};
+
+	for(int i = 0; i < 2; i++){
+		r_gooseMessage_InsertHMAC(packet, key, key_size, algs[i], &dest);
+
+		int macSize = MAC_SIZES[algs[i]];
+		int messageSize = decode_4bytesToInt(dest, INDEX_SPDU_LENGTH) + 10;
+
+		HMAC(EVP_sha512_256(), key, key_size, &dest[2], messageSize-4-macSize, expected, NULL);
+
+		printf("alg %d: tag %s, ValidateHMAC = %d\n", algs[i],
+			memcmp(expected, &dest[messageSize-macSize], macSize) == 0 ? "ok" : "FAIL",
+			r_gooseMessage_ValidateHMAC(dest, key, key_size));
+
+		free(dest);
+		dest = NULL;
+	}
+}
+
+double bench(uint8_t* packet, uint8_t* key, int key_size, int alg, int iterations){
+	uint8_t* dest = NULL;
+	struct timespec start, end;
+
+	r_gooseMessage_InsertHMAC(packet, key, key_size, alg, &dest);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < iterations; i++){
+		r_gooseMessage_ValidateHMAC(dest, key, key_size);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	free(dest);
+
+	return (double)timespecDiff(&end, &start) / iterations;
+}
+
+int main(int argc, char** argv){
+
+	char keyHex[] = "11754cd72aec309bf52f7687212e8957";
+	uint8_t* key = hexStringToBytes(keyHex, 32);
+	int key_size = 16;
+
+	int iterations = 100000;
+
+	char* files[] = {"../resources/valid_small.pkt", "../resources/valid_medium.pkt", "../resources/valid_large.pkt"};
+
+	for(int f = 0; f < 3; f++){
+		uint8_t* packet = read_packet(files[f]);
+
+		printf("\n%s\n", files[f]);
+		check(packet, key, key_size);
+		printf("\tHMAC_SHA256_80      : %8.1lf ns/validate\n", bench(packet, key, key_size, HMAC_SHA256_80, iterations));
+		printf("\tHMAC_SHA512_256_80  : %8.1lf ns/validate\n", bench(packet, key, key_size, HMAC_SHA512_256_80, iterations));
+		printf("\tHMAC_SHA256_128     : %8.1lf ns/validate\n", bench(packet, key, key_size, HMAC_SHA256_128, iterations));
+		printf("\tHMAC_SHA512_256_128 : %8.1lf ns/validate\n", bench(packet, key, key_size, HMAC_SHA512_256_128, iterations));
+
+		free(packet);
+	}
+
+	free(key);
+}
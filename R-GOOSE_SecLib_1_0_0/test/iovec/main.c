@@ -0,0 +1,301 @@
+/*
+	Test file:
+
+		Scatter-gather - r_gooseMessage_ProtectKeyringV(), ValidateKeyringV() and UnprotectKeyringV()
+
+		1. Five (MAC, encryption) key pairs on the three resource packets, each message split in
+		   separately allocated fragments at fixed (inside header fields, empty fragments) and
+		   pseudo-random points: fragments + MAC Tag byte-identical to r_gooseMessage_ProtectKeyring()
+		   on the contiguous message; validated and unprotected again under other splits (MAC Tag
+		   split too), payload identical to the source.
+		2. Changed ciphertext, header and MAC Tag: invalid and fragments left as received.
+		   No MAC Tag, unknown key, fragments shorter than the message, MAC Tag buffer too small.
+		3. Time per message on valid_large.pkt (session header / GOOSE PDU / MAC Tag):
+		   concatenation + ProtectKeyring + split vs ProtectKeyringV.
+
+*/
+
+#include "r_goose_security.h"
+#include "r_goose_keyring.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <time.h>
+
+#define ITERATIONS		200000
+
+#define MAX_FRAGMENTS	12
+
+int64_t timespecDiff(struct timespec *timeA_p, struct timespec *timeB_p)
+{
+  return ((timeA_p->tv_sec * 1000000000) + timeA_p->tv_nsec) -
+           ((timeB_p->tv_sec * 1000000000) + timeB_p->tv_nsec);
+}
+
+uint8_t* read_packet(char* filename, long* filelen){
+	FILE *fp;
+	unsigned char *buffer;
+
+	fp = fopen(filename, "rb");
+	fseek(fp, 0, SEEK_END);
+	*filelen = ftell(fp);
+	rewind(fp);
+
+	buffer = (unsigned char*) malloc((*filelen)*sizeof(char));
+	fread(buffer, *filelen, 1, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...)	do{ if(!(cond)){ failures++; printf("FAILED: " __VA_ARGS__); printf("\n"); } }while(0)
+
+static r_goose_keyring* ring;
+static int reader;
+
+static uint8_t key[32] = {0x21, 0x9b, 0xce, 0xf0, 0xcd, 0x0f, 0x89, 0xa5, 0xe1, 0x29, 0x7b, 0x99, 0xd9, 0x56, 0x15, 0x0f,
+						  0x31, 0x28, 0x45, 0x9f, 0x65, 0x31, 0x2f, 0xdd, 0x71, 0x61, 0x8f, 0x11, 0x77, 0x39, 0x3e, 0x3f};
+static uint8_t iv[12] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b};
+
+typedef struct fragments {
+	struct iovec iov[MAX_FRAGMENTS];
+	int count;
+} fragments;
+
+// Copies message into fragments cut at the given points (ascending, may repeat: empty fragments)
+static void split(fragments* f, uint8_t* message, long len, long* cuts, int ncuts){
+	long from = 0;
+
+	f->count = 0;
+	for(int i = 0; i <= ncuts; i++){
+		long to = i < ncuts ? cuts[i] : len;
+		f->iov[f->count].iov_base = malloc(to - from + 1);
+		f->iov[f->count].iov_len = to - from;
+		memcpy(f->iov[f->count].iov_base, &message[from], to - from);
+		f->count++;
+		from = to;
+	}
+}
+
+static long join(fragments* f, uint8_t* dest){
+	long len = 0;
+	for(int i = 0; i < f->count; i++){
+		memcpy(&dest[len], f->iov[i].iov_base, f->iov[i].iov_len);
+		len += f->iov[i].iov_len;
+	}
+	return len;
+}
+
+static void release(fragments* f){
+	for(int i = 0; i < f->count; i++){
+		free(f->iov[i].iov_base);
+	}
+	f->count = 0;
+}
+
+static int cmp_long(const void* a, const void* b){
+	long x = *(const long*)a, y = *(const long*)b;
+	return (x > y) - (x < y);
+}
+
+// Split s of a message: s 0 - inside header fields and empty fragments, otherwise pseudo-random points
+static int cut_points(long* cuts, long len, int s){
+	if(s == 0){
+		long fixed[] = {1, INDEX_SPDU_LENGTH + 2, INDEX_SPDU_LENGTH + 2, INDEX_KEYID + 1, INDEX_APDU_LENGTH + 1, INDEX_PAYLOAD + 3, len - 1};
+		memcpy(cuts, fixed, sizeof(fixed));
+		return 7;
+	}
+
+	int n = 1 + rand() % (MAX_FRAGMENTS - 2);
+	for(int i = 0; i < n; i++){
+		cuts[i] = rand() % (len + 1);
+	}
+	qsort(cuts, n, sizeof(long), cmp_long);
+	return n;
+}
+
+static void pairs(void){
+	char* files[] = {"../resources/valid_small.pkt", "../resources/valid_medium.pkt", "../resources/valid_large.pkt"};
+	int macs[] = {HMAC_SHA256_80, GMAC_AES256_128, BLAKE2B_KEYED_80, CHACHA20_POLY1305_128, HMAC_SHA512_256_128};
+	int encs[] = {AES_128_GCM, AES_256_GCM, CHACHA20_POLY1305, AES_128_GCM, ENC_NONE};
+	long cuts[MAX_FRAGMENTS];
+
+	srand(45);
+	for(int f = 0; f < 3; f++){
+		long len;
+		uint8_t* packet = read_packet(files[f], &len);
+		uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+		int data_size = decode_2bytesToInt(packet, INDEX_APDU_LENGTH) - 2;
+		uint8_t* ref = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+		uint8_t* joined = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+
+		for(int a = 0; a < 5; a++){
+			r_goose_keyring_publish(ring, appid, 10 + a, macs[a], encs[a], key, 32, 100, 60);
+
+			memcpy(ref, packet, len);
+			int ref_size = r_gooseMessage_ProtectKeyring(ref, len + MAX_MAC_SIZE, ring, reader, 10 + a, NULL, 0);
+
+			for(int s = 0; s < 8; s++){
+				fragments frag;
+				uint8_t tag_buffer[MAX_MAC_SIZE];
+				struct iovec tag = {tag_buffer, sizeof(tag_buffer)};
+
+				split(&frag, packet, len, cuts, cut_points(cuts, len, s));
+				int size = r_gooseMessage_ProtectKeyringV(frag.iov, frag.count, &tag, ring, reader, 10 + a, NULL, 0);
+				long joined_len = join(&frag, joined);
+				memcpy(&joined[joined_len], tag_buffer, tag.iov_len);
+				CHECK(size == ref_size && joined_len + (long)tag.iov_len == size && memcmp(joined, ref, size) == 0,
+					  "%s, pair %d, split %d: protected message differs", files[f], a, s);
+				release(&frag);
+
+				// Received under another split, MAC Tag included
+				split(&frag, ref, ref_size, cuts, cut_points(cuts, ref_size, s + 1));
+				CHECK(r_gooseMessage_ValidateKeyringV(frag.iov, frag.count, ring, reader) == 1, "%s, pair %d, split %d: invalid", files[f], a, s);
+				CHECK(r_gooseMessage_UnprotectKeyringV(frag.iov, frag.count, ring, reader, NULL, 0) == 1, "%s, pair %d, split %d: not unprotected", files[f], a, s);
+				join(&frag, joined);
+				CHECK(memcmp(&joined[INDEX_PAYLOAD], &packet[INDEX_PAYLOAD], data_size) == 0 && joined[INDEX_ENCRYPTION_ALG] == 0,
+					  "%s, pair %d, split %d: unprotected payload differs", files[f], a, s);
+				release(&frag);
+			}
+
+			// Changed ciphertext, header, MAC Tag: invalid, left as received
+			int positions[] = {INDEX_PAYLOAD + data_size / 2, INDEX_KEYID - 3, ref_size - 1};
+			for(int p = 0; p < 3; p++){
+				fragments frag;
+				ref[positions[p]] ^= 0x10;
+				split(&frag, ref, ref_size, cuts, cut_points(cuts, ref_size, p));
+				CHECK(r_gooseMessage_ValidateKeyringV(frag.iov, frag.count, ring, reader) == 0, "%s, pair %d: change at %d validated", files[f], a, positions[p]);
+				CHECK(r_gooseMessage_UnprotectKeyringV(frag.iov, frag.count, ring, reader, NULL, 0) == 0 &&
+					  join(&frag, joined) == ref_size && memcmp(joined, ref, ref_size) == 0, "%s, pair %d: change at %d", files[f], a, positions[p]);
+				ref[positions[p]] ^= 0x10;
+				release(&frag);
+			}
+
+			r_goose_keyring_retire(ring, appid, 10 + a);
+		}
+		r_goose_keyring_reclaim(ring);
+		free(joined);
+		free(ref);
+		free(packet);
+	}
+}
+
+static void errors(void){
+	long len;
+	uint8_t* packet = read_packet("../resources/valid_medium.pkt", &len);
+	uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+	uint8_t tag_buffer[MAX_MAC_SIZE];
+	struct iovec tag = {tag_buffer, 9};
+	long cuts[] = {20, 100};				// Key ID in the second fragment
+	fragments frag;
+
+	r_goose_keyring_publish(ring, appid, 1, HMAC_SHA256_80, AES_128_GCM, key, 32, 100, 60);
+
+	split(&frag, packet, len, cuts, 2);
+	CHECK(r_gooseMessage_ValidateKeyringV(frag.iov, frag.count, ring, reader) == 2, "no MAC Tag (validate)");
+	CHECK(r_gooseMessage_UnprotectKeyringV(frag.iov, frag.count, ring, reader, NULL, 0) == 2, "no MAC Tag (unprotect)");
+	CHECK(r_gooseMessage_ProtectKeyringV(frag.iov, frag.count, &tag, ring, reader, 1, NULL, 0) == -1, "MAC Tag buffer too small");
+	tag.iov_len = sizeof(tag_buffer);
+	CHECK(r_gooseMessage_ProtectKeyringV(frag.iov, frag.count, &tag, ring, reader, 2, NULL, 0) == -1, "unknown key");
+	CHECK(r_gooseMessage_ProtectKeyringV(frag.iov, frag.count - 1, &tag, ring, reader, 1, NULL, 0) == -1, "fragments too short");
+	CHECK(r_gooseMessage_ProtectKeyringV(frag.iov, 1, &tag, ring, reader, 1, NULL, 0) == -1, "header too short");
+
+	CHECK(r_gooseMessage_ProtectKeyringV(frag.iov, frag.count, &tag, ring, reader, 1, NULL, 0) == len + 10 && tag.iov_len == 10, "protected");
+	CHECK(r_gooseMessage_UnprotectKeyringV(frag.iov, frag.count, ring, reader, NULL, 0) == -1, "MAC Tag missing from the fragments");
+
+	struct iovec with_tag[MAX_FRAGMENTS];
+	memcpy(with_tag, frag.iov, frag.count * sizeof(struct iovec));
+	with_tag[frag.count] = tag;
+	encodeInt4Bytes(frag.iov[1].iov_base, 2, INDEX_KEYID - 20);
+	CHECK(r_gooseMessage_UnprotectKeyringV(with_tag, frag.count + 1, ring, reader, NULL, 0) == -1, "unknown key id");
+	encodeInt4Bytes(frag.iov[1].iov_base, 1, INDEX_KEYID - 20);
+	CHECK(r_gooseMessage_UnprotectKeyringV(with_tag, frag.count + 1, ring, reader, NULL, 0) == 1, "MAC Tag in its own fragment");
+
+	r_goose_keyring_retire(ring, appid, 1);
+	r_goose_keyring_reclaim(ring);
+	release(&frag);
+	free(packet);
+}
+
+static void timing(uint8_t* packet, long len, const char* name, int iterations){
+	uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+	long pdu_size = len - INDEX_PAYLOAD;
+	uint8_t* session = (uint8_t*)malloc(INDEX_PAYLOAD);
+	uint8_t* pdu = (uint8_t*)malloc(pdu_size);
+	uint8_t* buffer = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+	uint8_t tag_buffer[MAX_MAC_SIZE];
+	struct iovec iov[3];
+	struct timespec start, end;
+	uint64_t concat_ns, iovec_ns;
+	int ok = 1;
+
+	r_goose_keyring_publish(ring, appid, 1, HMAC_SHA256_80, AES_128_GCM, key, 32, 100, 60);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < iterations; i++){
+		memcpy(session, packet, INDEX_PAYLOAD);
+		memcpy(pdu, &packet[INDEX_PAYLOAD], pdu_size);
+
+		memcpy(buffer, session, INDEX_PAYLOAD);
+		memcpy(&buffer[INDEX_PAYLOAD], pdu, pdu_size);
+		ok &= r_gooseMessage_ProtectKeyring(buffer, len + MAX_MAC_SIZE, ring, reader, 1, iv, 12) == len + 10;
+		memcpy(session, buffer, INDEX_PAYLOAD);
+		memcpy(pdu, &buffer[INDEX_PAYLOAD], pdu_size);
+		memcpy(tag_buffer, &buffer[len], 10);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	concat_ns = timespecDiff(&end, &start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < iterations; i++){
+		memcpy(session, packet, INDEX_PAYLOAD);
+		memcpy(pdu, &packet[INDEX_PAYLOAD], pdu_size);
+
+		iov[0].iov_base = session;
+		iov[0].iov_len = INDEX_PAYLOAD;
+		iov[1].iov_base = pdu;
+		iov[1].iov_len = pdu_size;
+		iov[2].iov_base = tag_buffer;
+		iov[2].iov_len = sizeof(tag_buffer);
+		ok &= r_gooseMessage_ProtectKeyringV(iov, 2, &iov[2], ring, reader, 1, iv, 12) == len + 10;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	iovec_ns = timespecDiff(&end, &start);
+
+	CHECK(ok, "timing loop results");
+
+	printf("%s (%ld bytes), HMAC-SHA256-80 + AES-128-GCM, session header / GOOSE PDU / MAC Tag\n", name, len);
+	printf("  concatenation + ProtectKeyring + split %7.1f ns/msg   ProtectKeyringV %7.1f ns/msg\n",
+		(double)concat_ns / iterations, (double)iovec_ns / iterations);
+
+	r_goose_keyring_retire(ring, appid, 1);
+	r_goose_keyring_reclaim(ring);
+	free(buffer);
+	free(pdu);
+	free(session);
+}
+
+
+int main(int argc, char** argv){
+
+	ring = r_goose_keyring_new(16);
+	reader = r_goose_keyring_reader_register(ring);
+
+	pairs();
+	errors();
+	long len;
+	uint8_t* packet = read_packet("../resources/valid_large.pkt", &len);
+	timing(packet, len, "valid_large.pkt", ITERATIONS);
+	free(packet);
+
+	r_goose_keyring_free(ring);
+
+	printf("\n%s\n", failures == 0 ? "All scatter-gather tests passed" : "Scatter-gather tests FAILED");
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,294 @@
+/*
+	Test file:
+
+		Deterministic IVs - r_goose_key_iv(), r_goose_key_iv_reserve(), r_goose_iv_block_next(),
+		r_goose_key_iv_advance(), and ProtectKeyring()/UnprotectKeyring() with derived IVs
+
+		1. Salt: same key material gives the same IVs on two key rings (publisher/subscriber),
+		   other key material gives other IVs. IV = salt || SPDU Number.
+		2. Messages protected and unprotected with the IV derived from their SPDU Number.
+		3. Counter: blocks, exhaustion at 2^32 numbers per key, advance never moving back, numbers
+		   continued when a key is published again with the same APPID and Key ID.
+		4. Four threads taking numbers under one key: no number handed out twice.
+		5. Time per IV: block + derivation vs a random IV (RAND_bytes).
+
+*/
+
+#include "r_goose_security.h"
+#include "r_goose_keyring.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <pthread.h>
+#include <time.h>
+
+#include <openssl/rand.h>
+
+#define ITERATIONS		1000000
+#define THREADS			4
+#define PER_THREAD		250000
+
+int64_t timespecDiff(struct timespec *timeA_p, struct timespec *timeB_p)
+{
+  return ((timeA_p->tv_sec * 1000000000) + timeA_p->tv_nsec) -
+           ((timeB_p->tv_sec * 1000000000) + timeB_p->tv_nsec);
+}
+
+uint8_t* read_packet(char* filename, long* filelen){
+	FILE *fp;
+	unsigned char *buffer;
+
+	fp = fopen(filename, "rb");
+	fseek(fp, 0, SEEK_END);
+	*filelen = ftell(fp);
+	rewind(fp);
+
+	buffer = (unsigned char*) malloc((*filelen)*sizeof(char));
+	fread(buffer, *filelen, 1, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...)	do{ if(!(cond)){ failures++; printf("FAILED: " __VA_ARGS__); printf("\n"); } }while(0)
+
+static uint8_t key[32] = {0x21, 0x9b, 0xce, 0xf0, 0xcd, 0x0f, 0x89, 0xa5, 0xe1, 0x29, 0x7b, 0x99, 0xd9, 0x56, 0x15, 0x0f,
+						  0x31, 0x28, 0x45, 0x9f, 0x65, 0x31, 0x2f, 0xdd, 0x71, 0x61, 0x8f, 0x11, 0x77, 0x39, 0x3e, 0x3f};
+
+
+static void salts(void){
+	r_goose_keyring* publisher = r_goose_keyring_new(4);
+	r_goose_keyring* subscriber = r_goose_keyring_new(4);
+	int p = r_goose_keyring_reader_register(publisher);
+	int s = r_goose_keyring_reader_register(subscriber);
+	uint8_t a[R_GOOSE_IV_SIZE], b[R_GOOSE_IV_SIZE], c[R_GOOSE_IV_SIZE];
+	uint8_t other[32];
+
+	memcpy(other, key, 32);
+	other[31] ^= 1;
+	r_goose_keyring_publish(publisher, 1000, 1, HMAC_SHA256_80, AES_128_GCM, key, 32, 100, 60);
+	r_goose_keyring_publish(subscriber, 1000, 1, HMAC_SHA256_80, AES_128_GCM, key, 32, 100, 60);
+	r_goose_keyring_publish(subscriber, 1000, 2, HMAC_SHA256_80, AES_128_GCM, other, 32, 100, 60);
+
+	r_goose_keyring_reader_enter(publisher, p);
+	r_goose_keyring_reader_enter(subscriber, s);
+	r_goose_key_iv(r_goose_keyring_lookup(publisher, 1000, 1), 0x01020304, a);
+	r_goose_key_iv(r_goose_keyring_lookup(subscriber, 1000, 1), 0x01020304, b);
+	r_goose_key_iv(r_goose_keyring_lookup(subscriber, 1000, 2), 0x01020304, c);
+	r_goose_keyring_reader_exit(publisher, p);
+	r_goose_keyring_reader_exit(subscriber, s);
+
+	CHECK(memcmp(a, b, R_GOOSE_IV_SIZE) == 0, "same key, different IVs");
+	CHECK(memcmp(a, c, R_GOOSE_IV_SALT_SIZE) != 0, "different keys, same salt");
+	CHECK(a[8] == 0x01 && a[9] == 0x02 && a[10] == 0x03 && a[11] == 0x04, "SPDU Number in the IV");
+
+	// Protected by the publisher, unprotected by the subscriber, IVs derived on both sides
+	long len;
+	uint8_t* packet = read_packet("../resources/valid_large.pkt", &len);
+	encodeInt2Bytes(packet, 1000, INDEX_APPID);
+	uint8_t* m1 = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+	uint8_t* m2 = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+	uint8_t* m3 = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+
+	memcpy(m1, packet, len);
+	encodeInt4Bytes(m1, 7, INDEX_SPDU_NUMBER);
+	memcpy(m2, m1, len);
+	memcpy(m3, packet, len);
+	encodeInt4Bytes(m3, 8, INDEX_SPDU_NUMBER);
+
+	r_goose_keyring_reader_enter(publisher, p);
+	r_goose_key_iv(r_goose_keyring_lookup(publisher, 1000, 1), 7, a);
+	r_goose_keyring_reader_exit(publisher, p);
+
+	int size = r_gooseMessage_ProtectKeyring(m1, len + MAX_MAC_SIZE, publisher, p, 1, NULL, 0);
+	CHECK(size == len + 10 && r_gooseMessage_ProtectKeyring(m2, len + MAX_MAC_SIZE, publisher, p, 1, a, 12) == size &&
+		  memcmp(m1, m2, size) == 0, "derived IV differs from r_goose_key_iv()");
+	r_gooseMessage_ProtectKeyring(m3, len + MAX_MAC_SIZE, publisher, p, 1, NULL, 0);
+	CHECK(memcmp(&m1[INDEX_PAYLOAD], &m3[INDEX_PAYLOAD], 64) != 0, "same keystream for two SPDU Numbers");
+
+	CHECK(r_gooseMessage_UnprotectKeyring(m1, size, subscriber, s, NULL, 0) == 1 && memcmp(&m1[INDEX_PAYLOAD], &packet[INDEX_PAYLOAD], len - INDEX_PAYLOAD - 2) == 0,
+		  "subscriber can't decrypt");
+	CHECK(r_gooseMessage_UnprotectKeyring(m3, size, subscriber, s, NULL, 0) == 1 && memcmp(&m3[INDEX_PAYLOAD], &packet[INDEX_PAYLOAD], len - INDEX_PAYLOAD - 2) == 0,
+		  "subscriber can't decrypt the second message");
+
+	free(m1);
+	free(m2);
+	free(m3);
+	free(packet);
+	r_goose_keyring_free(publisher);
+	r_goose_keyring_free(subscriber);
+}
+
+static void counter(r_goose_keyring* ring, int reader){
+	r_goose_iv_block block = {0}, other = {0};
+	uint32_t n, previous = 0;
+	int ok = 1;
+
+	r_goose_keyring_publish(ring, 2000, 1, HMAC_SHA256_80, AES_128_GCM, key, 32, 100, 60);
+	r_goose_keyring_publish(ring, 2000, 2, HMAC_SHA256_80, AES_128_GCM, key, 32, 100, 60);
+
+	r_goose_keyring_reader_enter(ring, reader);
+	const r_goose_key* k = r_goose_keyring_lookup(ring, 2000, 1);
+	const r_goose_key* k2 = r_goose_keyring_lookup(ring, 2000, 2);
+
+	CHECK(r_goose_key_iv_reserve(k, 0, &other) == -1, "empty reservation");
+
+	// Two blocks taken alternately: consecutive inside a block, second block after the first
+	for(int i = 0; i < R_GOOSE_IV_BLOCK; i++){
+		ok &= r_goose_iv_block_next(k, &block, &n, NULL) == 1 && n == (uint32_t)i;
+		ok &= r_goose_iv_block_next(k, &other, &n, NULL) == 1 && n == (uint32_t)(R_GOOSE_IV_BLOCK + i);
+	}
+	CHECK(ok, "block numbers");
+
+	// Block of another key: a new block is reserved from that key
+	CHECK(r_goose_iv_block_next(k2, &block, &n, NULL) == 1 && n == 0 && block.key == k2, "block moved to another key");
+
+	// Key published again (same APPID and Key ID): the new entry continues the numbers, the old one hands out no more
+	r_goose_keyring_publish(ring, 2000, 2, HMAC_SHA256_80, AES_128_GCM, key, 32, 100, 60);
+	const r_goose_key* k2b = r_goose_keyring_lookup(ring, 2000, 2);
+	CHECK(r_goose_key_iv_reserve(k2, 1, &other) == -1, "reservation under a replaced key");
+	CHECK(r_goose_iv_block_next(k2b, &block, &n, NULL) == 1 && n == R_GOOSE_IV_BLOCK, "numbers after a replacement");
+
+	// Advance: up only
+	r_goose_key_iv_advance(k, 1000);
+	r_goose_key_iv_advance(k, 500);
+	CHECK(r_goose_iv_block_next(k, &block, &n, NULL) == 1 && n == 1000, "advance");
+
+	// Last numbers of the key
+	r_goose_key_iv_advance(k, UINT32_MAX - R_GOOSE_IV_BLOCK - 3);
+	ok = 1;
+	block.key = NULL;
+	for(int i = 0; i < R_GOOSE_IV_BLOCK; i++){
+		ok &= r_goose_iv_block_next(k, &block, &n, NULL) == 1 && (i == 0 || n == previous + 1);
+		previous = n;
+	}
+	CHECK(ok && n == UINT32_MAX - 4, "last block");
+	CHECK(r_goose_iv_block_next(k, &block, &n, NULL) == -1, "numbers past 2^32");
+	CHECK(r_goose_key_iv_reserve(k, 1, &other) == -1, "reservation after exhaustion");
+	r_goose_keyring_publish(ring, 2000, 1, HMAC_SHA256_80, AES_128_GCM, key, 32, 100, 60);
+	CHECK(r_goose_key_iv_reserve(r_goose_keyring_lookup(ring, 2000, 1), 1, &other) == -1, "exhausted key published again");
+	r_goose_keyring_reader_exit(ring, reader);
+
+	r_goose_keyring_retire(ring, 2000, 1);
+	r_goose_keyring_retire(ring, 2000, 2);
+	r_goose_keyring_reclaim(ring);
+}
+
+
+typedef struct thread_args {
+	r_goose_keyring* ring;
+	uint32_t* numbers;
+} thread_args;
+
+static void* publisher_thread(void* arg){
+	thread_args* a = (thread_args*)arg;
+	r_goose_iv_block block = {0};
+	uint8_t iv[R_GOOSE_IV_SIZE];
+	int reader = r_goose_keyring_reader_register(a->ring);
+
+	for(int i = 0; i < PER_THREAD; i++){
+		r_goose_keyring_reader_enter(a->ring, reader);
+		const r_goose_key* k = r_goose_keyring_lookup(a->ring, 3000, 1);
+		if(k == NULL || r_goose_iv_block_next(k, &block, &a->numbers[i], iv) < 0){
+			a->numbers[i] = UINT32_MAX;
+		}
+		r_goose_keyring_reader_exit(a->ring, reader);
+	}
+
+	r_goose_keyring_reader_unregister(a->ring, reader);
+	return NULL;
+}
+
+static void threads(r_goose_keyring* ring){
+	pthread_t t[THREADS];
+	thread_args args[THREADS];
+	size_t range = (size_t)THREADS * (PER_THREAD + R_GOOSE_IV_BLOCK);
+	uint8_t* seen = (uint8_t*)calloc(range, 1);
+	long duplicates = 0, outside = 0;
+
+	r_goose_keyring_publish(ring, 3000, 1, HMAC_SHA256_80, AES_128_GCM, key, 32, 100, 60);
+
+	for(int i = 0; i < THREADS; i++){
+		args[i].ring = ring;
+		args[i].numbers = (uint32_t*)malloc(PER_THREAD * sizeof(uint32_t));
+		pthread_create(&t[i], NULL, publisher_thread, &args[i]);
+	}
+	for(int i = 0; i < THREADS; i++){
+		pthread_join(t[i], NULL);
+	}
+
+	for(int i = 0; i < THREADS; i++){
+		for(int j = 0; j < PER_THREAD; j++){
+			uint32_t n = args[i].numbers[j];
+			if(n >= range){
+				outside++;
+			}else if(seen[n]++){
+				duplicates++;
+			}
+		}
+		free(args[i].numbers);
+	}
+
+	printf("%d threads, %d SPDU Numbers each: %ld duplicates, %ld out of range\n", THREADS, PER_THREAD, duplicates, outside);
+	CHECK(duplicates == 0 && outside == 0, "numbers handed out twice");
+
+	r_goose_keyring_retire(ring, 3000, 1);
+	r_goose_keyring_reclaim(ring);
+	free(seen);
+}
+
+static void timing(r_goose_keyring* ring, int reader){
+	r_goose_iv_block block = {0};
+	uint8_t iv[R_GOOSE_IV_SIZE];
+	struct timespec start, end;
+	uint64_t derived_ns, random_ns;
+	uint32_t n;
+	int ok = 1;
+
+	r_goose_keyring_publish(ring, 4000, 1, HMAC_SHA256_80, AES_128_GCM, key, 32, 100, 60);
+	r_goose_keyring_reader_enter(ring, reader);
+	const r_goose_key* k = r_goose_keyring_lookup(ring, 4000, 1);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < ITERATIONS; i++){
+		ok &= r_goose_iv_block_next(k, &block, &n, iv) == 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	derived_ns = timespecDiff(&end, &start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < ITERATIONS; i++){
+		ok &= RAND_bytes(iv, sizeof(iv)) == 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	random_ns = timespecDiff(&end, &start);
+
+	r_goose_keyring_reader_exit(ring, reader);
+	CHECK(ok, "IV generation");
+
+	printf("IV per message: SPDU Number block + salt %6.1f ns   RAND_bytes %6.1f ns\n",
+		(double)derived_ns / ITERATIONS, (double)random_ns / ITERATIONS);
+}
+
+
+int main(int argc, char** argv){
+
+	r_goose_keyring* ring = r_goose_keyring_new(16);
+	int reader = r_goose_keyring_reader_register(ring);
+
+	salts();
+	counter(ring, reader);
+	threads(ring);
+	timing(ring, reader);
+
+	r_goose_keyring_free(ring);
+
+	printf("\n%s\n", failures == 0 ? "All IV generator tests passed" : "IV generator tests FAILED");
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,319 @@
+/*
+	Test file:
+
+		Key rotation storm - r_goose_keyring_set_schedule() / r_goose_keyring_tick()
+
+		STREAMS streams (APPIDs) share the same rollover time. For each one, the latency of the
+		first packet a reader unprotects with the next key is measured (GMAC and ChaCha20-Poly1305
+		streams are also encrypted, so both cipher contexts of the reader are involved), against
+		the steady state (second packet of each stream under the current key):
+
+		1. Cold rollover: the next key is only known by the receiver when its first packet arrives
+		   (lookup miss -> key requested and published -> unprotect).
+		2. Pre-warmed rollover: r_goose_keyring_tick() published every next key LEAD seconds before
+		   the rollover, with the contexts of the reader: its first packet takes the same path as
+		   any other packet (median within twice the steady state).
+
+		Then the overlap window is checked: both keys accepted until rollover + OVERLAP, only the
+		new key afterwards.
+
+		3. A callback that hands out the Key ID of the current key is refused by the tick (it would
+		   replace the entry the tick is working on) and counted as a failure; the current key stays
+		   valid, and the other streams of the same tick still get their next key.
+
+*/
+
+#include "r_goose_security.h"
+#include "r_goose_keyring.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <time.h>
+
+#define STREAMS			10000
+#define T0				1000000
+#define TIME_TO_NEXT	10				// minutes
+#define ROLLOVER		(T0 + TIME_TO_NEXT * 60)
+#define LEAD			30
+#define OVERLAP			20
+
+int64_t timespecDiff(struct timespec *timeA_p, struct timespec *timeB_p)
+{
+  return ((timeA_p->tv_sec * 1000000000) + timeA_p->tv_nsec) -
+           ((timeB_p->tv_sec * 1000000000) + timeB_p->tv_nsec);
+}
+
+uint8_t* read_packet(char* filename, long* filelen){
+	FILE *fp;
+	unsigned char *buffer;
+
+	fp = fopen(filename, "rb");
+	fseek(fp, 0, SEEK_END);
+	*filelen = ftell(fp);
+	rewind(fp);
+
+	buffer = (unsigned char*) malloc((*filelen)*sizeof(char));
+	fread(buffer, *filelen, 1, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+// Number of bytes "received" for a well formed message
+static size_t message_size(const uint8_t* m){
+	return (size_t)decode_4bytesToInt((uint8_t*)m, INDEX_SPDU_LENGTH) + 10;
+}
+
+static int mac_alg;
+static int enc_alg;
+static int failures = 0;
+
+// Deterministic key material per (APPID, Key ID), as a key distribution center would hand out
+static void derive_key(uint16_t appid, uint32_t key_id, r_goose_key_material* m){
+	uint64_t x = ((uint64_t)appid << 32 | key_id) * 0x9E3779B97F4A7C15ULL + 1;
+
+	m->key_id = key_id;
+	m->mac_alg = mac_alg;
+	m->enc_alg = enc_alg;
+	m->key_size = 32;
+	for(int i = 0; i < 32; i++){
+		x ^= x >> 12; x ^= x << 25; x ^= x >> 27;
+		m->key[i] = (uint8_t)(x * 0x2545F4914F6CDD1DULL >> 56);
+	}
+	m->timeOfCurrentKey = key_id == 1 ? T0 : ROLLOVER;
+	m->timeToNextKey = TIME_TO_NEXT;
+}
+
+static int next_key(void* arg, const r_goose_key* current, r_goose_key_material* next){
+	derive_key(current->appid, current->key_id + 1, next);
+	return 1;
+}
+
+// Stream 1 is handed the Key ID of its current key, the others their next key
+static int same_key(void* arg, const r_goose_key* current, r_goose_key_material* next){
+	derive_key(current->appid, current->appid == 1 ? current->key_id : current->key_id + 1, next);
+	return 1;
+}
+
+static int publish(r_goose_keyring* ring, uint16_t appid, uint32_t key_id){
+	r_goose_key_material m;
+	derive_key(appid, key_id, &m);
+	return r_goose_keyring_publish(ring, appid, m.key_id, m.mac_alg, m.enc_alg, m.key, m.key_size, m.timeOfCurrentKey, m.timeToNextKey);
+}
+
+static int cmp_u64(const void* a, const void* b){
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+// Prints the distribution of @p lat and returns its median
+static uint64_t report(const char* name, uint64_t* lat, int n){
+	uint64_t total = 0;
+	for(int i = 0; i < n; i++){
+		total += lat[i];
+	}
+	qsort(lat, n, sizeof(uint64_t), cmp_u64);
+	printf("%-34s total %9.3f ms   p50 %7llu ns   p99 %7llu ns   max %8llu ns\n", name, total / 1e6,
+		(unsigned long long)lat[n/2], (unsigned long long)lat[n*99/100], (unsigned long long)lat[n-1]);
+	return lat[n/2];
+}
+
+// Protected copy of the packet (room for the MAC Tag), under Key ID @p key_id of the sender
+static uint8_t* protect(uint8_t* packet, r_goose_keyring* sender, int s, uint32_t key_id){
+	uint8_t* m = (uint8_t*)malloc(message_size(packet) + MAX_MAC_SIZE);
+
+	memcpy(m, packet, message_size(packet));
+	if(r_gooseMessage_ProtectKeyring(m, message_size(packet) + MAX_MAC_SIZE, sender, s, key_id, NULL, 0) <= 0){
+		failures++;
+		printf("FAILED: protect under key %u\n", key_id);
+	}
+	return m;
+}
+
+// Unprotects a copy of a received message (the copy is not timed); result in *res, returns the latency
+static uint64_t receive(r_goose_keyring* ring, int reader, uint8_t* m, uint8_t* scratch, int* res){
+	struct timespec start, end;
+
+	memcpy(scratch, m, message_size(m));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	*res = r_gooseMessage_UnprotectKeyring(scratch, message_size(m), ring, reader, NULL, 0);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return timespecDiff(&end, &start);
+}
+
+static int received(r_goose_keyring* ring, int reader, uint8_t* m, uint8_t* scratch){
+	int res;
+	receive(ring, reader, m, scratch, &res);
+	return res;
+}
+
+static void storm(int alg, int enc, const char* alg_name, uint8_t* packet){
+	uint8_t** signed1 = (uint8_t**)calloc(STREAMS, sizeof(uint8_t*));
+	uint8_t** signed2 = (uint8_t**)calloc(STREAMS, sizeof(uint8_t*));
+	uint8_t* scratch = (uint8_t*)malloc(message_size(packet) + MAX_MAC_SIZE);
+	uint64_t* lat = (uint64_t*)malloc(STREAMS * sizeof(uint64_t));
+	struct timespec start, end;
+
+	mac_alg = alg;
+	enc_alg = enc;
+	printf("\n%s - %d streams rolling over at the same time\n", alg_name, STREAMS);
+
+	// Publisher side - every stream protected with key 1 and key 2
+	r_goose_keyring* sender = r_goose_keyring_new(2 * STREAMS);
+	int s = r_goose_keyring_reader_register(sender);
+	for(int i = 0; i < STREAMS; i++){
+		uint16_t appid = (uint16_t)(i + 1);
+		encodeInt2Bytes(packet, appid, INDEX_APPID);
+		publish(sender, appid, 1);
+		publish(sender, appid, 2);
+		signed1[i] = protect(packet, sender, s, 1);
+		signed2[i] = protect(packet, sender, s, 2);
+	}
+	r_goose_keyring_free(sender);
+
+	for(int mode = 0; mode < 2; mode++){
+		// The reader registers before any key is published, as the packet threads of a subscriber would
+		r_goose_keyring* ring = r_goose_keyring_new(2 * STREAMS);
+		int reader = r_goose_keyring_reader_register(ring);
+		uint64_t steady = 0, first;
+		int errors = 0, res;
+
+		if(mode == 1){
+			r_goose_keyring_set_schedule(ring, LEAD, OVERLAP, next_key, NULL);
+		}
+		for(int i = 0; i < STREAMS; i++){
+			publish(ring, (uint16_t)(i + 1), 1);
+		}
+
+		// Steady state under key 1 (second pass)
+		for(int pass = 0; pass < 2; pass++){
+			for(int i = 0; i < STREAMS; i++){
+				lat[i] = receive(ring, reader, signed1[i], scratch, &res);
+				errors += res != 1;
+			}
+		}
+		if(mode == 0){
+			steady = report("steady state (key 1)", lat, STREAMS);
+		}else{
+			qsort(lat, STREAMS, sizeof(uint64_t), cmp_u64);
+			steady = lat[STREAMS/2];
+		}
+
+		if(mode == 1){
+			// Pre-warm: next keys published ahead of the rollover
+			int failed;
+			r_goose_keyring_tick(ring, ROLLOVER - LEAD - 1, NULL);
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			int published = r_goose_keyring_tick(ring, ROLLOVER - LEAD, &failed);
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			printf("%-34s %d keys published in %.3f ms (control thread, before the rollover)\n", "pre-warm tick",
+				published, timespecDiff(&end, &start) / 1e6);
+			if(published != STREAMS || failed != 0){
+				failures++;
+				printf("FAILED: pre-warm published %d keys, %d failed\n", published, failed);
+			}
+		}
+
+		// Rollover - first packet of the reader in every stream under key 2
+		for(int i = 0; i < STREAMS; i++){
+			lat[i] = receive(ring, reader, signed2[i], scratch, &res);
+			if(res == -1 && mode == 0){
+				// Cold: key unknown, fetched and built on the packet path
+				clock_gettime(CLOCK_MONOTONIC, &start);
+				publish(ring, (uint16_t)(i + 1), 2);
+				clock_gettime(CLOCK_MONOTONIC, &end);
+				lat[i] += timespecDiff(&end, &start) + receive(ring, reader, signed2[i], scratch, &res);
+			}
+			errors += res != 1;
+		}
+		first = report(mode == 0 ? "rollover, cold" : "rollover, pre-warmed", lat, STREAMS);
+		if(mode == 1 && first > 2 * steady){
+			failures++;
+			printf("FAILED: first packet under the pre-warmed key: p50 %llu ns, steady state %llu ns\n",
+				(unsigned long long)first, (unsigned long long)steady);
+		}
+
+		// Overlap window: both keys accepted
+		r_goose_keyring_tick(ring, ROLLOVER + OVERLAP - 1, NULL);
+		for(int i = 0; i < STREAMS; i++){
+			errors += received(ring, reader, signed1[i], scratch) != 1;
+			errors += received(ring, reader, signed2[i], scratch) != 1;
+		}
+
+		if(mode == 1){
+			// End of the overlap window: key 1 retired
+			r_goose_keyring_tick(ring, ROLLOVER + OVERLAP, NULL);
+			for(int i = 0; i < STREAMS; i++){
+				errors += received(ring, reader, signed1[i], scratch) != -1;
+				errors += received(ring, reader, signed2[i], scratch) != 1;
+			}
+		}
+
+		if(errors != 0){
+			failures++;
+			printf("FAILED: %d unexpected validation results (%s)\n", errors, mode == 0 ? "cold" : "pre-warmed");
+		}
+
+		r_goose_keyring_free(ring);
+	}
+
+	for(int i = 0; i < STREAMS; i++){
+		free(signed1[i]);
+		free(signed2[i]);
+	}
+	free(signed1);
+	free(signed2);
+	free(scratch);
+	free(lat);
+}
+
+static void same_key_id(uint8_t* packet){
+	uint8_t* signed1 = NULL;
+	int errors = 0, failed = -1;
+
+	mac_alg = HMAC_SHA256_80;
+	enc_alg = ENC_NONE;
+	r_goose_keyring* ring = r_goose_keyring_new(16);
+	int reader = r_goose_keyring_reader_register(ring);
+	r_goose_keyring_set_schedule(ring, LEAD, OVERLAP, same_key, NULL);
+	publish(ring, 1, 1);
+	publish(ring, 2, 1);
+	encodeInt2Bytes(packet, 1, INDEX_APPID);
+	r_gooseMessage_InsertKeyring(packet, ring, reader, 1, &signed1);
+
+	// Stream 1 refused, stream 2 (after it in the table or not) still gets its next key
+	errors += r_goose_keyring_tick(ring, ROLLOVER - LEAD, &failed) != 1 || failed != 1;
+	errors += r_goose_keyring_lookup(ring, 2, 2) == NULL;
+	errors += r_gooseMessage_ValidateKeyring(signed1, message_size(signed1), ring, reader) != 1;
+	// Not staged: requested again on the next tick, and refused again
+	errors += r_goose_keyring_tick(ring, ROLLOVER + OVERLAP, &failed) != 0 || failed != 1;
+	errors += r_gooseMessage_ValidateKeyring(signed1, message_size(signed1), ring, reader) != 1;
+
+	printf("\nnext key with the current Key ID: %s\n", errors == 0 ? "refused, other streams rotated" : "FAILED");
+	if(errors != 0){
+		failures++;
+	}
+
+	r_goose_keyring_free(ring);
+	free(signed1);
+}
+
+
+int main(int argc, char** argv){
+	long len;
+	uint8_t* packet = read_packet("../resources/valid_small.pkt", &len);
+
+	storm(HMAC_SHA256_80, ENC_NONE, "HMAC_SHA256_80", packet);
+	storm(GMAC_AES128_64, AES_128_GCM, "GMAC_AES128_64 + AES_128_GCM", packet);
+	storm(CHACHA20_POLY1305_128, CHACHA20_POLY1305, "CHACHA20_POLY1305_128 + CHACHA20_POLY1305", packet);
+	same_key_id(packet);
+
+	free(packet);
+
+	printf("\n%s\n", failures == 0 ? "All key rotation tests passed" : "Key rotation tests FAILED");
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,321 @@
+/*
+	Test file:
+
+		R-GOOSE key ring - r_goose_keyring_*() and r_gooseMessage_{Insert,Validate,Decrypt}Keyring()
+
+		1. Every MAC algorithm: message signed through the key ring is accepted by the raw key
+		   functions (ValidateHMAC/ValidateGMAC) and by ValidateKeyring, rejected when tampered
+		   and reported as unknown (-1) for a Key ID not in the ring or as an error (-1) when
+		   the received length doesn't match the SPDU Length.
+		2. Encrypt (raw key) / DecryptKeyring round trip for every encryption algorithm; length not
+		   matching the SPDU Length and APDU Length past the payload rejected.
+		3. Rotation under load: reader threads validate continuously while the control thread
+		   replaces and retires keys. Every lookup must succeed and every tag must be valid.
+		4. Tombstones: after many publish/retire cycles the table is compacted, so a quarter
+		   of the slots stays empty and every live key is still found.
+		5. Timing: ValidateHMAC/ValidateGMAC (raw key) vs ValidateKeyring (prebuilt contexts).
+
+*/
+
+#include "r_goose_security.h"
+#include "r_goose_keyring.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include <time.h>
+
+#define ITERATIONS		100000
+#define READERS			4
+#define ROTATIONS		20000
+
+int64_t timespecDiff(struct timespec *timeA_p, struct timespec *timeB_p)
+{
+  return ((timeA_p->tv_sec * 1000000000) + timeA_p->tv_nsec) -
+           ((timeB_p->tv_sec * 1000000000) + timeB_p->tv_nsec);
+}
+
+uint8_t* read_packet(char* filename, long* filelen){
+	FILE *fp;
+	unsigned char *buffer;
+
+	fp = fopen(filename, "rb");
+	fseek(fp, 0, SEEK_END);
+	*filelen = ftell(fp);
+	rewind(fp);
+
+	buffer = (unsigned char*) malloc((*filelen)*sizeof(char));
+	fread(buffer, *filelen, 1, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+static int is_gmac(int alg){
+	return alg == GMAC_AES256_64 || alg == GMAC_AES256_128 || alg == GMAC_AES128_64 || alg == GMAC_AES128_128 || alg == CHACHA20_POLY1305_128;
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...)	do{ if(!(cond)){ failures++; printf("FAILED: " __VA_ARGS__); printf("\n"); } }while(0)
+
+// Number of bytes "received" for a well formed message
+static size_t message_size(const uint8_t* m){
+	return (size_t)decode_4bytesToInt((uint8_t*)m, INDEX_SPDU_LENGTH) + 10;
+}
+
+
+// 3. Rotation under load
+
+typedef struct {
+	r_goose_keyring* ring;
+	uint8_t* packet;
+	volatile int* stop;
+	long validated;
+	long errors;
+} reader_arg;
+
+static void* reader_thread(void* p){
+	reader_arg* arg = (reader_arg*)p;
+	int reader = r_goose_keyring_reader_register(arg->ring);
+
+	while(!*arg->stop){
+		if(r_gooseMessage_ValidateKeyring(arg->packet, message_size(arg->packet), arg->ring, reader) != 1){
+			arg->errors++;
+		}
+		arg->validated++;
+	}
+
+	r_goose_keyring_reader_unregister(arg->ring, reader);
+	return NULL;
+}
+
+static void rotation_under_load(uint8_t* packet, uint8_t* key){
+	r_goose_keyring* ring = r_goose_keyring_new(256);
+	int writer = r_goose_keyring_reader_register(ring);
+	uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+	uint8_t* signedPacket = NULL;
+	volatile int stop = 0;
+	pthread_t threads[READERS];
+	reader_arg args[READERS];
+
+	r_goose_keyring_publish(ring, appid, 7, HMAC_SHA256_128, ENC_NONE, key, 32, 1, 60);
+	r_gooseMessage_InsertKeyring(packet, ring, writer, 7, &signedPacket);
+
+	for(int i = 0; i < READERS; i++){
+		args[i] = (reader_arg){ring, signedPacket, &stop, 0, 0};
+		pthread_create(&threads[i], NULL, reader_thread, &args[i]);
+	}
+
+	// Same key material republished (new entry, old one retired) and unrelated keys churned
+	for(int i = 0; i < ROTATIONS; i++){
+		r_goose_keyring_publish(ring, appid, 7, HMAC_SHA256_128, ENC_NONE, key, 32, 1 + i, 60);
+		r_goose_keyring_publish(ring, appid + 1, i, HMAC_SHA256_80, ENC_NONE, key, 32, 1, 60);
+		if(i > 0){
+			r_goose_keyring_retire(ring, appid + 1, i - 1);
+		}
+	}
+
+	stop = 1;
+	long validated = 0, errors = 0;
+	for(int i = 0; i < READERS; i++){
+		pthread_join(threads[i], NULL);
+		validated += args[i].validated;
+		errors += args[i].errors;
+	}
+
+	int pending = r_goose_keyring_reclaim(ring);
+
+	printf("Rotation under load: %d rotations, %d readers, %ld validations, %ld errors, %d retired keys pending\n",
+		ROTATIONS, READERS, validated, errors, pending);
+	CHECK(errors == 0, "validation failed during rotation");
+	CHECK(pending == 0, "retired keys not reclaimed after readers exited");
+
+	free(signedPacket);
+	r_goose_keyring_free(ring);
+}
+
+
+static void tombstones(uint8_t* key){
+	r_goose_keyring* ring = r_goose_keyring_new(8);
+	int reader = r_goose_keyring_reader_register(ring);
+	int ok = 1;
+
+	r_goose_keyring_publish(ring, 2000, 0, HMAC_SHA256_80, ENC_NONE, key, 32, 1, 60);
+	for(uint32_t id = 1; id <= 1000; id++){
+		ok &= r_goose_keyring_publish(ring, 1000, id, HMAC_SHA256_80, ENC_NONE, key, 32, 1, 60) == 1;
+		if(id > 1){
+			ok &= r_goose_keyring_retire(ring, 1000, id - 1) == 1;
+		}
+	}
+	CHECK(ok, "publish/retire cycles");
+
+	r_goose_keyring_table* table = atomic_load(&ring->table);
+	size_t empty = 0;
+	for(size_t i = 0; i < ring->capacity; i++){
+		empty += atomic_load(&table->slots[i]) == NULL;
+	}
+	printf("Tombstones: %zu slots, %zu live keys, %zu tombstones, %zu empty after 1000 rotations\n",
+		ring->capacity, ring->count, ring->tombstones, empty);
+	CHECK(ring->tombstones * 4 < ring->capacity && empty * 4 >= ring->capacity, "tombstones not compacted");
+
+	r_goose_keyring_reader_enter(ring, reader);
+	CHECK(r_goose_keyring_lookup(ring, 1000, 1000) != NULL && r_goose_keyring_lookup(ring, 2000, 0) != NULL, "live key lost");
+	CHECK(r_goose_keyring_lookup(ring, 1000, 999) == NULL, "retired key found");
+	r_goose_keyring_reader_exit(ring, reader);
+
+	CHECK(r_goose_keyring_reclaim(ring) == 0, "replaced table not reclaimed");
+
+	r_goose_keyring_reader_unregister(ring, reader);
+	r_goose_keyring_free(ring);
+}
+
+int main(int argc, char** argv){
+
+	char keyHex[] = "219bcef0cd0f89a5e1297b99d956150f3128459f65312fdd71618f1177393e3f";
+	uint8_t* key = hexStringToBytes(keyHex, 64);
+
+	char ivHex[] = "75b66d3df73da95345c11a32";
+	uint8_t* iv = hexStringToBytes(ivHex, 24);
+
+	char* files[] = {"../resources/valid_small.pkt", "../resources/valid_medium.pkt", "../resources/valid_large.pkt"};
+	const int algs[] = {HMAC_SHA256_80, HMAC_SHA256_128, HMAC_SHA256_256, GMAC_AES256_64, GMAC_AES256_128,
+						HMAC_BLAKE2B_80, HMAC_BLAKE2S_80, GMAC_AES128_64, GMAC_AES128_128, BLAKE2B_KEYED_80,
+						BLAKE2S_KEYED_80, CHACHA20_POLY1305_128, HMAC_SHA512_256_80, HMAC_SHA512_256_128};
+	const int n_algs = sizeof(algs)/sizeof(algs[0]);
+
+	r_goose_keyring* ring = r_goose_keyring_new(64);
+	int reader = r_goose_keyring_reader_register(ring);
+
+	for(int f = 0; f < 3; f++){
+		long len;
+		uint8_t* packet = read_packet(files[f], &len);
+		uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+
+		// 1. MAC algorithms - one key (Key ID = alg) per algorithm
+		for(int a = 0; a < n_algs; a++){
+			int alg = algs[a];
+			size_t key_size = (alg == GMAC_AES128_64 || alg == GMAC_AES128_128 || alg == BLAKE2S_KEYED_80) ? 16 : 32;
+			uint8_t* dest = NULL;
+
+			CHECK(r_goose_keyring_publish(ring, appid, alg, alg, ENC_NONE, key, key_size, 100, 60) == 1, "publish alg %d", alg);
+			CHECK(r_gooseMessage_InsertKeyring(packet, ring, reader, alg, &dest) == 1, "InsertKeyring alg %d", alg);
+
+			int raw = is_gmac(alg) ? r_gooseMessage_ValidateGMAC(dest, key, key_size) : r_gooseMessage_ValidateHMAC(dest, key, key_size);
+			CHECK(raw == 1, "raw key validation alg %d on %s (%d)", alg, files[f], raw);
+			CHECK(r_gooseMessage_ValidateKeyring(dest, message_size(dest), ring, reader) == 1, "ValidateKeyring alg %d on %s", alg, files[f]);
+
+			dest[INDEX_PAYLOAD + 4] ^= 0x01;
+			CHECK(r_gooseMessage_ValidateKeyring(dest, message_size(dest), ring, reader) == 0, "tampered message accepted alg %d", alg);
+			dest[INDEX_PAYLOAD + 4] ^= 0x01;
+
+			size_t size = message_size(dest);
+			CHECK(r_gooseMessage_ValidateKeyring(dest, size - 1, ring, reader) == -1, "short length accepted alg %d", alg);
+			CHECK(r_gooseMessage_ValidateKeyring(dest, size + 1, ring, reader) == -1, "long length accepted alg %d", alg);
+			CHECK(r_gooseMessage_ValidateKeyring(dest, INDEX_PAYLOAD - 1, ring, reader) == -1, "truncated header accepted alg %d", alg);
+
+			encodeInt4Bytes(dest, 0xdead, INDEX_KEYID);
+			CHECK(r_gooseMessage_ValidateKeyring(dest, message_size(dest), ring, reader) == -1, "unknown Key ID accepted alg %d", alg);
+
+			free(dest);
+		}
+
+		// 2. Encryption algorithms
+		for(int alg = AES_128_GCM; alg <= CHACHA20_POLY1305; alg++){
+			uint8_t* copy = (uint8_t*)malloc(len);
+			memcpy(copy, packet, len);
+
+			CHECK(r_goose_keyring_publish(ring, appid, 100 + alg, HMAC_SHA256_80, alg, key, 32, 100, 60) == 1, "publish enc %d", alg);
+			r_gooseMessage_Encrypt(copy, key, alg, 100, 60, 100 + alg, iv, 12);
+			CHECK(memcmp(&copy[INDEX_PAYLOAD], &packet[INDEX_PAYLOAD], len - INDEX_PAYLOAD) != 0, "payload not encrypted, enc %d", alg);
+			CHECK(r_gooseMessage_DecryptKeyring(copy, len - 1, ring, reader, iv, 12) == -1, "DecryptKeyring, length not matching, enc %d", alg);
+			encodeInt2Bytes(copy, (uint16_t)(len - INDEX_PAYLOAD + 1), INDEX_APDU_LENGTH);
+			CHECK(r_gooseMessage_DecryptKeyring(copy, len, ring, reader, iv, 12) == -1, "DecryptKeyring, APDU Length past the payload, enc %d", alg);
+			encodeInt2Bytes(copy, decode_2bytesToInt(packet, INDEX_APDU_LENGTH), INDEX_APDU_LENGTH);
+			CHECK(r_gooseMessage_DecryptKeyring(copy, len, ring, reader, iv, 12) == 1, "DecryptKeyring enc %d", alg);
+			CHECK(memcmp(&copy[INDEX_PAYLOAD], &packet[INDEX_PAYLOAD], len - INDEX_PAYLOAD) == 0, "round trip enc %d on %s", alg, files[f]);
+
+			free(copy);
+		}
+
+		free(packet);
+	}
+
+	// Retired keys are no longer found
+	{
+		long len;
+		uint8_t* packet = read_packet(files[0], &len);
+		uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+		uint8_t* dest = NULL;
+
+		r_gooseMessage_InsertKeyring(packet, ring, reader, HMAC_SHA256_80, &dest);
+		CHECK(r_goose_keyring_retire(ring, appid, HMAC_SHA256_80) == 1, "retire");
+		CHECK(r_gooseMessage_ValidateKeyring(dest, message_size(dest), ring, reader) == -1, "retired key still found");
+
+		free(dest);
+		free(packet);
+	}
+
+	// 3. Rotation under load
+	{
+		long len;
+		uint8_t* packet = read_packet(files[0], &len);
+		rotation_under_load(packet, key);
+		free(packet);
+	}
+
+	// 4. Tombstones
+	tombstones(key);
+
+	// 5. Timing
+	printf("\n%-24s %-8s %12s %12s\n", "Algorithm", "Packet", "raw key (ns)", "keyring (ns)");
+	const int timed[] = {HMAC_SHA256_80, GMAC_AES128_64, GMAC_AES256_128, BLAKE2B_KEYED_80, CHACHA20_POLY1305_128};
+	const char* timed_names[] = {"HMAC_SHA256_80", "GMAC_AES128_64", "GMAC_AES256_128", "BLAKE2B_KEYED_80", "CHACHA20_POLY1305_128"};
+	const char* sizes[] = {"small", "medium", "large"};
+
+	for(int t = 0; t < 5; t++){
+		for(int f = 0; f < 3; f++){
+			long len;
+			uint8_t* packet = read_packet(files[f], &len);
+			int alg = timed[t];
+			size_t key_size = (alg == GMAC_AES128_64) ? 16 : 32;
+			uint8_t* dest = NULL;
+			struct timespec start, end;
+			volatile int res = 0;
+
+			r_goose_keyring_publish(ring, decode_2bytesToInt(packet, INDEX_APPID), alg, alg, ENC_NONE, key, key_size, 100, 60);
+			r_gooseMessage_InsertKeyring(packet, ring, reader, alg, &dest);
+
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			for(int i = 0; i < ITERATIONS; i++){
+				res += is_gmac(alg) ? r_gooseMessage_ValidateGMAC(dest, key, key_size) : r_gooseMessage_ValidateHMAC(dest, key, key_size);
+			}
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			double raw = (double)timespecDiff(&end, &start) / ITERATIONS;
+
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			for(int i = 0; i < ITERATIONS; i++){
+				res += r_gooseMessage_ValidateKeyring(dest, message_size(dest), ring, reader);
+			}
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			double ringed = (double)timespecDiff(&end, &start) / ITERATIONS;
+
+			CHECK(res == 2 * ITERATIONS, "timed validations failed for %s", timed_names[t]);
+			printf("%-24s %-8s %12.1f %12.1f\n", timed_names[t], sizes[f], raw, ringed);
+
+			free(dest);
+			free(packet);
+		}
+	}
+
+	r_goose_keyring_reader_unregister(ring, reader);
+	r_goose_keyring_free(ring);
+	free(key);
+	free(iv);
+
+	printf("\n%s\n", failures == 0 ? "All key ring tests passed" : "Key ring tests FAILED");
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,406 @@
+/*
+	Test file:
+
+		GOOSE PDU layout cache - r_goose_view_init_cached() and r_gooseMessage_ValidateViewCached()
+
+		1. Resource packets as three streams (APPIDs 1000-1002): one miss per stream, then every
+		   message decoded with the stored layout, views identical to r_goose_view_init().
+		2. Stream written with the GOOSE PDU template (non periodic dataset, ~1.5 KB): new values
+		   and sqNum in every message, all hits. New confRev and a value encoded with another
+		   length (same message size): layout changed, message decoded again and stored.
+		3. Random corruptions of the APDU: the cached view always agrees with r_goose_view_init().
+		4. Time per message (view + reading every entry) with and without the cache.
+
+*/
+
+#include "r_goose_security.h"
+#include "r_goose_keyring.h"
+#include "r_goose_publisher.h"
+#include "r_goose_pdu.h"
+#include "r_goose_view.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <time.h>
+
+#define ITERATIONS		200000
+#define FUZZ			200000
+#define VALUES			260
+
+int64_t timespecDiff(struct timespec *timeA_p, struct timespec *timeB_p)
+{
+  return ((timeA_p->tv_sec * 1000000000) + timeA_p->tv_nsec) -
+           ((timeB_p->tv_sec * 1000000000) + timeB_p->tv_nsec);
+}
+
+uint8_t* read_packet(char* filename, long* filelen){
+	FILE *fp;
+	unsigned char *buffer;
+
+	fp = fopen(filename, "rb");
+	fseek(fp, 0, SEEK_END);
+	*filelen = ftell(fp);
+	rewind(fp);
+
+	buffer = (unsigned char*) malloc((*filelen)*sizeof(char));
+	fread(buffer, *filelen, 1, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...)	do{ if(!(cond)){ failures++; printf("FAILED: " __VA_ARGS__); printf("\n"); } }while(0)
+
+// Number of bytes "received" for a well formed message
+static size_t message_size(const uint8_t* m){
+	return (size_t)decode_4bytesToInt((uint8_t*)m, INDEX_SPDU_LENGTH) + 10;
+}
+
+static uint64_t rng_state = 0x2545F4914F6CDD1DULL;
+
+static uint64_t rng(void){
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+static r_goose_keyring* ring;
+static int reader;
+static int types[VALUES];
+
+
+// Same fields and allData entries (pointing to the same bytes)
+static int views_equal(r_goose_view* a, r_goose_view* b){
+	r_goose_data da, db;
+
+	if(a->pdu != b->pdu || a->size != b->size){
+		return 0;
+	}
+	for(int n = 0; n < R_GOOSE_FIELDS; n++){
+		if(a->fields[n].tag != b->fields[n].tag || a->fields[n].len != b->fields[n].len ||
+		   (a->fields[n].tag != 0 && a->fields[n].value != b->fields[n].value)){
+			return 0;
+		}
+	}
+
+	int count = r_goose_view_data_count(a);
+	if(r_goose_view_data_count(b) != count){
+		return 0;
+	}
+	for(int i = count - 1; i >= 0; i--){
+		if(r_goose_view_data_at(a, i, &da) != 1 || r_goose_view_data_at(b, i, &db) != 1 ||
+		   da.tag != db.tag || da.len != db.len || da.value != db.value){
+			return 0;
+		}
+	}
+	return 1;
+}
+
+
+static void streams(void){
+	char* files[] = {"../resources/valid_small.pkt", "../resources/valid_medium.pkt", "../resources/valid_large.pkt"};
+	uint8_t* messages[3];
+	r_goose_layout_cache* cache = r_goose_layout_cache_new(16, 2000);
+	r_goose_layout_stats stats;
+	r_goose_view a, b;
+	int ok = 1;
+
+	for(int f = 0; f < 3; f++){
+		long len;
+		uint8_t* packet = read_packet(files[f], &len);
+		packet[INDEX_APPID] = 1000 >> 8;
+		packet[INDEX_APPID + 1] = (1000 + f) & 0xFF;
+		r_goose_keyring_publish(ring, 1000 + f, 1, HMAC_SHA256_80, ENC_NONE,
+								(uint8_t*)"0123456789abcdef0123456789abcdef", 32, 100, 60);
+		messages[f] = NULL;
+		r_gooseMessage_InsertKeyring(packet, ring, reader, 1, &messages[f]);
+		free(packet);
+	}
+
+	for(int round = 0; round < 10; round++){
+		for(int f = 0; f < 3; f++){
+			ok &= r_gooseMessage_ValidateViewCached(messages[f], message_size(messages[f]), ring, reader, cache, &b) == 1;
+			ok &= r_goose_view_init(&a, messages[f]) == 1 && views_equal(&a, &b);
+			ok &= round == 0 || b.layout != NULL;
+		}
+	}
+	CHECK(ok, "cached views differ");
+
+	r_goose_layout_cache_get_stats(cache, &stats);
+	CHECK(stats.misses == 3 && stats.stored == 3 && stats.hits == 27 && stats.changed == 0,
+		  "stats: %lu misses, %lu stored, %lu hits", stats.misses, stats.stored, stats.hits);
+	for(int f = 0; f < 3; f++){
+		CHECK(r_goose_layout_cache_hits(cache, 1000 + f) == 9, "stream %d hits", 1000 + f);
+	}
+	CHECK(r_goose_layout_cache_hits(cache, 1003) == 0, "unknown stream hits");
+
+	// Invalid MAC Tag - no view, layout unchanged
+	messages[2][INDEX_PAYLOAD + 10] ^= 1;
+	CHECK(r_gooseMessage_ValidateViewCached(messages[2], message_size(messages[2]), ring, reader, cache, &b) == 0, "invalid message");
+	messages[2][INDEX_PAYLOAD + 10] ^= 1;
+	CHECK(r_goose_layout_cache_hits(cache, 1002) == 9, "invalid message hit");
+	r_goose_layout_cache_free(cache);
+
+	// APDU larger than the cache: decoded, not stored
+	cache = r_goose_layout_cache_new(16, 500);
+	for(int round = 0; round < 2; round++){
+		CHECK(r_goose_view_init_cached(&b, messages[2], cache) == 1 && r_goose_view_init(&a, messages[2]) == 1 &&
+			  views_equal(&a, &b), "large APDU");
+	}
+	r_goose_layout_cache_get_stats(cache, &stats);
+	CHECK(stats.too_large == 2 && stats.stored == 0 && stats.hits == 0, "large APDU stored");
+	r_goose_layout_cache_free(cache);
+
+	CHECK(r_goose_layout_cache_new(0, 2000) == NULL && r_goose_layout_cache_new(16, 70000) == NULL, "invalid cache");
+
+	for(int f = 0; f < 3; f++){
+		r_goose_keyring_retire(ring, 1000 + f, 1);
+		free(messages[f]);
+	}
+	r_goose_keyring_reclaim(ring);
+}
+
+
+static void values(r_goose_publisher* pub, r_goose_layout_cache* cache){
+	r_goose_pdu_config cfg = {"IED1LD0/LLN0$GO$gcb1", "IED1LD0/LLN0$DataSet1", "IED1LD0/LLN0.gcb1", 2000, 3, 0, 0, 0x0A, types, VALUES};
+	r_goose_layout_stats stats;
+	r_goose_view view;
+	r_goose_data d;
+	uint8_t* message;
+	uint32_t v;
+	int64_t i64;
+	int ok = 1, len = 0;
+
+	r_goose_pdu_template* pdu = r_goose_pdu_template_new(&cfg);
+	r_goose_pdu_encode(pdu, r_goose_publisher_payload(pub), pub->max_payload);
+
+	for(int m = 0; m < 100; m++){
+		r_goose_pdu_set_sqnum(pdu, m);
+		for(int i = 0; i < VALUES; i++){
+			if(types[i] == R_GOOSE_DATA_INT32){
+				r_goose_pdu_set_int32(pdu, i, m * 1000 - i);
+			}
+		}
+		len = r_goose_publisher_sign(pub, pdu->size, &message);
+		ok &= r_gooseMessage_ValidateViewCached(message, message_size(message), ring, reader, cache, &view) == 1;
+		ok &= r_goose_view_uint(&view, R_GOOSE_FIELD_SQNUM, &v) == 1 && v == (uint32_t)m;
+		ok &= r_goose_view_data_count(&view) == VALUES;
+		for(int i = 0; i < VALUES; i++){
+			if(types[i] == R_GOOSE_DATA_INT32){
+				ok &= r_goose_view_data_at(&view, i, &d) == 1 && r_goose_data_int(&d, &i64) == 1 && i64 == m * 1000 - i;
+			}
+		}
+	}
+	CHECK(ok, "template stream values");
+	CHECK(len > 1400 && view.periods == 0, "%d bytes, periodic dataset", len);
+
+	r_goose_layout_cache_get_stats(cache, &stats);
+	CHECK(stats.misses == 1 && stats.hits == 99, "template stream: %lu misses, %lu hits", stats.misses, stats.hits);
+
+	// New confRev, same size
+	cfg.confRev = 4;
+	r_goose_pdu_template* pdu4 = r_goose_pdu_template_new(&cfg);
+	r_goose_pdu_encode(pdu4, r_goose_publisher_payload(pub), pub->max_payload);
+	CHECK(pdu4->size == pdu->size, "confRev changes the size");
+	for(int m = 0; m < 2; m++){
+		r_goose_publisher_sign(pub, pdu4->size, &message);
+		CHECK(r_gooseMessage_ValidateViewCached(message, message_size(message), ring, reader, cache, &view) == 1 &&
+			  r_goose_view_uint(&view, R_GOOSE_FIELD_CONFREV, &v) == 1 && v == 4, "confRev 4");
+	}
+	r_goose_layout_cache_get_stats(cache, &stats);
+	CHECK(stats.changed == 1 && stats.stored == 2 && stats.hits == 100, "confRev: %lu changed, %lu stored", stats.changed, stats.stored);
+
+	// An INT32 (85 04 ...) followed by a BOOLEAN (83 01 ..) re-encoded as 85 03 ... and 83 02 .. ..
+	int first = -1;
+	for(int i = 0; i + 1 < VALUES && first < 0; i++){
+		if(types[i] == R_GOOSE_DATA_INT32 && types[i + 1] == R_GOOSE_DATA_BOOLEAN){
+			first = i;
+		}
+	}
+	CHECK(first >= 0, "no INT32 followed by a BOOLEAN");
+	r_goose_view_data_at(&view, first, &d);
+	uint8_t* p = (uint8_t*)d.value - 2;
+	uint8_t shifted[] = {0x85, 0x03, 0x01, 0x02, 0x03, 0x83, 0x02, 0x00, 0x01};
+	memcpy(p, shifted, sizeof(shifted));
+	r_goose_publisher_sign(pub, pdu4->size, &message);
+	CHECK(r_gooseMessage_ValidateViewCached(message, message_size(message), ring, reader, cache, &view) == 1 &&
+		  r_goose_view_data_at(&view, first, &d) == 1 && r_goose_data_int(&d, &i64) == 1 && i64 == 0x010203 &&
+		  r_goose_view_data_at(&view, first + 1, &d) == 1 && d.len == 2, "value with another length");
+	r_goose_layout_cache_get_stats(cache, &stats);
+	CHECK(stats.changed == 2 && stats.stored == 3, "value with another length: %lu changed", stats.changed);
+
+	r_goose_pdu_template_free(pdu);
+	r_goose_pdu_template_free(pdu4);
+}
+
+
+static void fuzz(r_goose_publisher* pub, r_goose_layout_cache* cache){
+	uint8_t* message;
+	r_goose_view a, b;
+	long mismatches = 0, decoded = 0;
+
+	int len = r_goose_publisher_sign(pub, pub->payload_size, &message);
+	uint8_t* m = (uint8_t*)malloc(len);
+	size_t apdu = pub->payload_size;
+
+	for(int i = 0; i < FUZZ; i++){
+		memcpy(m, message, len);
+		int flips = 1 + (int)(rng() % 3);
+		for(int j = 0; j < flips; j++){
+			m[INDEX_PAYLOAD + rng() % apdu] ^= (uint8_t)(1 + rng() % 255);
+		}
+
+		int ra = r_goose_view_init(&a, m);
+		int rb = r_goose_view_init_cached(&b, m, cache);
+		if(ra != rb || (ra == 1 && !views_equal(&a, &b))){
+			mismatches++;
+		}
+		decoded += ra == 1;
+	}
+
+	printf("Fuzz: %d corrupted messages, %ld decoded, %ld mismatches\n", FUZZ, decoded, mismatches);
+	CHECK(mismatches == 0, "cached view differs on corrupted messages");
+	free(m);
+}
+
+
+static int64_t read_all(r_goose_view* view){
+	r_goose_data d;
+	int64_t value, sum = 0;
+	int n = r_goose_view_data_count(view);
+
+	for(int i = 0; i < n; i++){
+		r_goose_view_data_at(view, i, &d);
+		if(r_goose_data_int(&d, &value) == 1){
+			sum += value;
+		}
+	}
+	return sum;
+}
+
+static void timing(uint8_t* message, const char* name){
+	r_goose_layout_cache* cache = r_goose_layout_cache_new(16, 2000);
+	struct timespec start, end;
+	uint64_t decode_ns, decode_cached_ns, plain_ns, cached_ns, validate_ns, validate_cached_ns;
+	r_goose_view view;
+	r_goose_data d;
+	int64_t sum = 0;
+
+	// Decoding only: view, number of entries and the last one
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < ITERATIONS; i++){
+		r_goose_view_init(&view, message);
+		sum += r_goose_view_data_at(&view, r_goose_view_data_count(&view) - 1, &d);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	decode_ns = timespecDiff(&end, &start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < ITERATIONS; i++){
+		r_goose_view_init_cached(&view, message, cache);
+		sum -= r_goose_view_data_at(&view, r_goose_view_data_count(&view) - 1, &d);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	decode_cached_ns = timespecDiff(&end, &start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < ITERATIONS; i++){
+		r_goose_view_init(&view, message);
+		sum += read_all(&view);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	plain_ns = timespecDiff(&end, &start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < ITERATIONS; i++){
+		r_goose_view_init_cached(&view, message, cache);
+		sum -= read_all(&view);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	cached_ns = timespecDiff(&end, &start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < ITERATIONS; i++){
+		r_gooseMessage_ValidateView(message, message_size(message), ring, reader, &view);
+		sum += read_all(&view);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	validate_ns = timespecDiff(&end, &start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < ITERATIONS; i++){
+		r_gooseMessage_ValidateViewCached(message, message_size(message), ring, reader, cache, &view);
+		sum -= read_all(&view);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	validate_cached_ns = timespecDiff(&end, &start);
+
+	CHECK(sum == 0, "%s: values read differ", name);
+	CHECK(r_goose_layout_cache_hits(cache, decode_2bytesToInt(message, INDEX_APPID)) == 3 * ITERATIONS - 1, "%s: hits", name);
+
+	printf("%s\n", name);
+	printf("  decode                      %7.1f ns   cached %7.1f ns\n", (double)decode_ns / ITERATIONS, (double)decode_cached_ns / ITERATIONS);
+	printf("  decode + read every entry   %7.1f ns   cached %7.1f ns\n", (double)plain_ns / ITERATIONS, (double)cached_ns / ITERATIONS);
+	printf("  ValidateView + every entry  %7.1f ns   cached %7.1f ns\n", (double)validate_ns / ITERATIONS, (double)validate_cached_ns / ITERATIONS);
+
+	r_goose_layout_cache_free(cache);
+}
+
+
+int main(int argc, char** argv){
+
+	ring = r_goose_keyring_new(16);
+	reader = r_goose_keyring_reader_register(ring);
+
+	for(int i = 0; i < VALUES; i++){
+		int t[] = {R_GOOSE_DATA_FLOAT32, R_GOOSE_DATA_BOOLEAN, R_GOOSE_DATA_QUALITY, R_GOOSE_DATA_UINT32, R_GOOSE_DATA_INT32};
+		types[i] = t[((i * 7) % 23) % 5];
+	}
+
+	streams();
+
+	// Template stream, APPID 2000
+	long len;
+	uint8_t* packet = read_packet("../resources/valid_small.pkt", &len);
+	packet[INDEX_APPID] = 2000 >> 8;
+	packet[INDEX_APPID + 1] = 2000 & 0xFF;
+	r_goose_keyring_publish(ring, 2000, 2, HMAC_SHA256_80, ENC_NONE,
+							(uint8_t*)"0123456789abcdef0123456789abcdef", 32, 100, 60);
+	r_goose_publisher* pub = r_goose_publisher_new(packet, ring, reader, 2, 2000);
+	r_goose_layout_cache* cache = r_goose_layout_cache_new(16, 2000);
+
+	values(pub, cache);
+	fuzz(pub, cache);
+
+	uint8_t* message;
+	r_goose_pdu_config cfg = {"IED1LD0/LLN0$GO$gcb1", "IED1LD0/LLN0$DataSet1", "IED1LD0/LLN0.gcb1", 2000, 3, 0, 0, 0x0A, types, VALUES};
+	r_goose_pdu_template* pdu = r_goose_pdu_template_new(&cfg);
+	r_goose_pdu_encode(pdu, r_goose_publisher_payload(pub), pub->max_payload);
+	r_goose_publisher_sign(pub, pdu->size, &message);
+	timing(message, "template (260 entries)");
+	r_goose_pdu_template_free(pdu);
+
+	uint8_t* large = read_packet("../resources/valid_large.pkt", &len);
+	uint8_t* signed_large = NULL;
+	r_goose_keyring_publish(ring, decode_2bytesToInt(large, INDEX_APPID), 1, HMAC_SHA256_80, ENC_NONE,
+							(uint8_t*)"0123456789abcdef0123456789abcdef", 32, 100, 60);
+	r_gooseMessage_InsertKeyring(large, ring, reader, 1, &signed_large);
+	timing(signed_large, "valid_large.pkt (220 entries)");
+
+	free(signed_large);
+	free(large);
+	r_goose_layout_cache_free(cache);
+	r_goose_publisher_free(pub);
+	free(packet);
+	r_goose_keyring_free(ring);
+
+	printf("\n%s\n", failures == 0 ? "All layout cache tests passed" : "Layout cache tests FAILED");
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,377 @@
+/*
+	Test file:
+
+		Packet buffer pool - r_goose_mbuf_*() and the key ring functions on buffers
+
+		1. Pool: every buffer taken once then the pool is empty, alignment, headroom/tailroom,
+		   prepend/append/adj/trim limits, reference counts (shared buffers can't be changed and
+		   go back to the pool with the last release).
+		2. ProtectMbuf/ProtectMbufTo/ProtectMbufFanout byte-identical to the contiguous key ring
+		   functions on the three resource packets, MAC Tag in the tailroom, UDP header prepended
+		   in the headroom and stripped again, ValidateMbuf/UnprotectMbuf back to the source.
+		   Data size that isn't one message, shared buffers.
+		3. THREADS threads taking and releasing buffers (each filled with the thread id and
+		   checked before it is released) and dropping references to one shared buffer: no buffer
+		   is handed out twice and every buffer is back in the pool at the end.
+		4. Time per message on valid_large.pkt: malloc'ed buffers (copy of the plaintext,
+		   ProtectKeyring, copy behind a UDP header, free) vs pool buffers (ProtectMbufTo,
+		   prepend, release).
+
+*/
+
+#include "r_goose_security.h"
+#include "r_goose_keyring.h"
+#include "r_goose_mbuf.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <time.h>
+#include <pthread.h>
+
+#define ITERATIONS		200000
+#define THREADS			4
+#define THREAD_ROUNDS	200000
+
+int64_t timespecDiff(struct timespec *timeA_p, struct timespec *timeB_p)
+{
+  return ((timeA_p->tv_sec * 1000000000) + timeA_p->tv_nsec) -
+           ((timeB_p->tv_sec * 1000000000) + timeB_p->tv_nsec);
+}
+
+uint8_t* read_packet(char* filename, long* filelen){
+	FILE *fp;
+	unsigned char *buffer;
+
+	fp = fopen(filename, "rb");
+	fseek(fp, 0, SEEK_END);
+	*filelen = ftell(fp);
+	rewind(fp);
+
+	buffer = (unsigned char*) malloc((*filelen)*sizeof(char));
+	fread(buffer, *filelen, 1, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...)	do{ if(!(cond)){ failures++; printf("FAILED: " __VA_ARGS__); printf("\n"); } }while(0)
+
+static r_goose_keyring* ring;
+static int reader;
+
+static uint8_t key[32] = {0x21, 0x9b, 0xce, 0xf0, 0xcd, 0x0f, 0x89, 0xa5, 0xe1, 0x29, 0x7b, 0x99, 0xd9, 0x56, 0x15, 0x0f,
+						  0x31, 0x28, 0x45, 0x9f, 0x65, 0x31, 0x2f, 0xdd, 0x71, 0x61, 0x8f, 0x11, 0x77, 0x39, 0x3e, 0x3f};
+static uint8_t iv[12] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b};
+
+static void pool(void){
+	r_goose_mbuf_pool* p = r_goose_mbuf_pool_new(8, R_GOOSE_MBUF_HEADROOM, 1600);
+	r_goose_mbuf* m[8];
+
+	CHECK(p != NULL && r_goose_mbuf_available(p) == 8, "new pool");
+	CHECK(r_goose_mbuf_pool_new(0, R_GOOSE_MBUF_HEADROOM, 1600) == NULL, "empty pool");
+
+	for(int i = 0; i < 8; i++){
+		m[i] = r_goose_mbuf_alloc(p);
+		CHECK(m[i] != NULL && ((uintptr_t)m[i]->buf % R_GOOSE_MBUF_ALIGN) == 0, "buffer %d", i);
+		CHECK(r_goose_mbuf_headroom(m[i]) == R_GOOSE_MBUF_HEADROOM && r_goose_mbuf_len(m[i]) == 0 &&
+			  r_goose_mbuf_tailroom(m[i]) >= 1600 && r_goose_mbuf_refcnt(m[i]) == 1, "buffer %d: new buffer", i);
+		for(int j = 0; j < i; j++){
+			CHECK(m[j] != m[i], "buffer %d taken twice", i);
+		}
+		memset(r_goose_mbuf_data(m[i]), i, 1600);
+	}
+	CHECK(r_goose_mbuf_alloc(p) == NULL && r_goose_mbuf_available(p) == 0, "pool exhausted");
+	for(int i = 0; i < 8; i++){
+		int intact = 1;
+		for(int b = 0; b < 1600; b++){
+			intact &= r_goose_mbuf_data(m[i])[b] == i;
+		}
+		CHECK(intact, "buffer %d overlaps another one", i);
+	}
+
+	// Headroom and tailroom
+	r_goose_mbuf* b = m[0];
+	uint32_t room = r_goose_mbuf_tailroom(b);
+	CHECK(r_goose_mbuf_append(b, 100) == r_goose_mbuf_data(b) && r_goose_mbuf_len(b) == 100 && r_goose_mbuf_tailroom(b) == room - 100, "append");
+	CHECK(r_goose_mbuf_append(b, room - 99) == NULL && r_goose_mbuf_len(b) == 100, "append beyond the tailroom");
+	CHECK(r_goose_mbuf_prepend(b, 8) == r_goose_mbuf_data(b) && r_goose_mbuf_len(b) == 108 && r_goose_mbuf_headroom(b) == R_GOOSE_MBUF_HEADROOM - 8, "prepend");
+	CHECK(r_goose_mbuf_prepend(b, R_GOOSE_MBUF_HEADROOM - 7) == NULL, "prepend beyond the headroom");
+	CHECK(r_goose_mbuf_adj(b, 8) != NULL && r_goose_mbuf_headroom(b) == R_GOOSE_MBUF_HEADROOM && r_goose_mbuf_len(b) == 100, "adj");
+	CHECK(r_goose_mbuf_adj(b, 101) == NULL && r_goose_mbuf_trim(b, 101) == -1, "adj/trim beyond the data");
+	CHECK(r_goose_mbuf_trim(b, 100) == 0 && r_goose_mbuf_len(b) == 0 && r_goose_mbuf_tailroom(b) == room, "trim");
+
+	// Reference counts
+	r_goose_mbuf_ref(b);
+	CHECK(r_goose_mbuf_refcnt(b) == 2 && r_goose_mbuf_append(b, 1) == NULL && r_goose_mbuf_prepend(b, 1) == NULL, "shared buffer changed");
+	r_goose_mbuf_release(b);
+	CHECK(r_goose_mbuf_available(p) == 0 && r_goose_mbuf_refcnt(b) == 1, "first release");
+	for(int i = 0; i < 8; i++){
+		r_goose_mbuf_release(m[i]);
+	}
+	CHECK(r_goose_mbuf_available(p) == 8, "buffers back in the pool");
+
+	// Freed buffers are taken again, with the initial state
+	for(int i = 0; i < 8; i++){
+		m[i] = r_goose_mbuf_alloc(p);
+		r_goose_mbuf_append(m[i], 10);
+	}
+	CHECK(r_goose_mbuf_alloc(p) == NULL, "pool exhausted again");
+	for(int i = 0; i < 8; i++){
+		r_goose_mbuf_release(m[i]);
+	}
+	m[0] = r_goose_mbuf_alloc(p);
+	CHECK(r_goose_mbuf_len(m[0]) == 0 && r_goose_mbuf_headroom(m[0]) == R_GOOSE_MBUF_HEADROOM, "reused buffer reset");
+	r_goose_mbuf_release(m[0]);
+
+	r_goose_mbuf_pool_free(p);
+}
+
+static r_goose_mbuf* load(r_goose_mbuf_pool* p, uint8_t* packet, long len){
+	r_goose_mbuf* m = r_goose_mbuf_alloc(p);
+	memcpy(r_goose_mbuf_append(m, len), packet, len);
+	return m;
+}
+
+static void protect(void){
+	char* files[] = {"../resources/valid_small.pkt", "../resources/valid_medium.pkt", "../resources/valid_large.pkt"};
+	int macs[] = {HMAC_SHA256_80, GMAC_AES256_128, BLAKE2B_KEYED_80, HMAC_SHA512_256_128};
+	int encs[] = {AES_128_GCM, AES_256_GCM, CHACHA20_POLY1305, ENC_NONE};
+	r_goose_mbuf_pool* p = r_goose_mbuf_pool_new(16, R_GOOSE_MBUF_HEADROOM, 1600);
+
+	for(int f = 0; f < 3; f++){
+		long len;
+		uint8_t* packet = read_packet(files[f], &len);
+		uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+		int data_size = decode_2bytesToInt(packet, INDEX_APDU_LENGTH) - 2;
+		uint8_t* ref = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+
+		for(int a = 0; a < 4; a++){
+			r_goose_keyring_publish(ring, appid, 10 + a, macs[a], encs[a], key, 32, 100, 60);
+		}
+
+		for(int a = 0; a < 4; a++){
+			memcpy(ref, packet, len);
+			int ref_size = r_gooseMessage_ProtectKeyring(ref, len + MAX_MAC_SIZE, ring, reader, 10 + a, NULL, 0);
+
+			// In place, MAC Tag in the tailroom
+			r_goose_mbuf* m = load(p, packet, len);
+			uint32_t room = r_goose_mbuf_tailroom(m);
+			CHECK(r_gooseMessage_ProtectMbuf(m, ring, reader, 10 + a, NULL, 0) == ref_size && r_goose_mbuf_len(m) == ref_size &&
+				  r_goose_mbuf_tailroom(m) == room - (ref_size - len) && memcmp(r_goose_mbuf_data(m), ref, ref_size) == 0,
+				  "%s, pair %d: ProtectMbuf", files[f], a);
+
+			// UDP header in the headroom, stripped on reception
+			uint8_t* udp = r_goose_mbuf_prepend(m, 8);
+			memset(udp, 0xee, 8);
+			CHECK(r_goose_mbuf_adj(m, 8) != NULL && r_gooseMessage_ValidateMbuf(m, ring, reader) == 1, "%s, pair %d: ValidateMbuf", files[f], a);
+
+			r_goose_mbuf_ref(m);
+			CHECK(r_gooseMessage_UnprotectMbuf(m, ring, reader, NULL, 0) == -1, "%s, pair %d: shared buffer unprotected", files[f], a);
+			CHECK(r_gooseMessage_ValidateMbuf(m, ring, reader) == 1, "%s, pair %d: shared buffer not validated", files[f], a);
+			r_goose_mbuf_release(m);
+
+			CHECK(r_gooseMessage_UnprotectMbuf(m, ring, reader, NULL, 0) == 1 &&
+				  memcmp(&r_goose_mbuf_data(m)[INDEX_PAYLOAD], &packet[INDEX_PAYLOAD], data_size) == 0, "%s, pair %d: UnprotectMbuf", files[f], a);
+			r_goose_mbuf_release(m);
+
+			// Out of place, source kept
+			r_goose_mbuf* src = load(p, packet, len);
+			r_goose_mbuf* dest = r_goose_mbuf_alloc(p);
+			r_goose_mbuf_ref(src);
+			CHECK(r_gooseMessage_ProtectMbufTo(src, dest, ring, reader, 10 + a, NULL, 0) == ref_size && r_goose_mbuf_len(dest) == ref_size &&
+				  memcmp(r_goose_mbuf_data(dest), ref, ref_size) == 0 && memcmp(r_goose_mbuf_data(src), packet, len) == 0,
+				  "%s, pair %d: ProtectMbufTo", files[f], a);
+			r_goose_mbuf_release(src);
+			r_goose_mbuf_release(src);
+			r_goose_mbuf_release(dest);
+		}
+
+		// Fan-out, one buffer per group
+		r_goose_mbuf* src = load(p, packet, len);
+		r_goose_mbuf* dests[4];
+		r_goose_fanout_target targets[4];
+		for(int a = 0; a < 4; a++){
+			dests[a] = r_goose_mbuf_alloc(p);
+			targets[a].key_id = 10 + a;
+			targets[a].spdu_number = decode_4bytesToInt(packet, INDEX_SPDU_NUMBER);
+			targets[a].iv = NULL;
+		}
+		CHECK(r_gooseMessage_ProtectMbufFanout(src, dests, targets, 4, ring, reader) == 4, "%s: ProtectMbufFanout", files[f]);
+		for(int a = 0; a < 4; a++){
+			memcpy(ref, packet, len);
+			int ref_size = r_gooseMessage_ProtectKeyring(ref, len + MAX_MAC_SIZE, ring, reader, 10 + a, NULL, 0);
+			CHECK(r_goose_mbuf_len(dests[a]) == ref_size && memcmp(r_goose_mbuf_data(dests[a]), ref, ref_size) == 0, "%s, group %d: fan-out differs", files[f], a);
+		}
+		r_goose_mbuf_ref(dests[2]);
+		CHECK(r_gooseMessage_ProtectMbufFanout(src, dests, targets, 4, ring, reader) == -1, "%s: shared fan-out destination", files[f]);
+		r_goose_mbuf_release(dests[2]);
+		for(int a = 0; a < 4; a++){
+			r_goose_mbuf_release(dests[a]);
+		}
+
+		// Data that isn't exactly one message
+		r_goose_mbuf_append(src, 1);
+		CHECK(r_gooseMessage_ProtectMbuf(src, ring, reader, 10, NULL, 0) == -1, "%s: data longer than the message", files[f]);
+		r_goose_mbuf_trim(src, 2);
+		CHECK(r_gooseMessage_ValidateMbuf(src, ring, reader) == -1, "%s: data shorter than the message", files[f]);
+		r_goose_mbuf_release(src);
+
+		for(int a = 0; a < 4; a++){
+			r_goose_keyring_retire(ring, appid, 10 + a);
+		}
+		r_goose_keyring_reclaim(ring);
+		free(ref);
+		free(packet);
+	}
+
+	CHECK(r_goose_mbuf_available(p) == 16, "buffers left out of the pool");
+	r_goose_mbuf_pool_free(p);
+}
+
+typedef struct thread_arg {
+	r_goose_mbuf_pool* pool;
+	r_goose_mbuf* shared;
+	int id;
+	int errors;
+} thread_arg;
+
+static void* worker(void* arg){
+	thread_arg* t = (thread_arg*)arg;
+	r_goose_mbuf* held[4];
+
+	for(int r = 0; r < THREAD_ROUNDS; r++){
+		int n = 1 + r % 4, got = 0;
+
+		for(int i = 0; i < n; i++){
+			held[got] = r_goose_mbuf_alloc(t->pool);
+			if(held[got] != NULL){
+				memset(r_goose_mbuf_append(held[got], 64), t->id, 64);
+				got++;
+			}
+		}
+		for(int i = 0; i < got; i++){
+			uint8_t* data = r_goose_mbuf_data(held[i]);
+			for(int b = 0; b < 64; b++){
+				t->errors += data[b] != t->id;
+			}
+			r_goose_mbuf_release(held[i]);
+		}
+	}
+	r_goose_mbuf_release(t->shared);
+
+	return NULL;
+}
+
+static void threads(void){
+	r_goose_mbuf_pool* p = r_goose_mbuf_pool_new(THREADS * 3, R_GOOSE_MBUF_HEADROOM, 256);
+	pthread_t tid[THREADS];
+	thread_arg args[THREADS];
+	int errors = 0;
+
+	r_goose_mbuf* shared = r_goose_mbuf_alloc(p);
+	for(int i = 0; i < THREADS; i++){
+		r_goose_mbuf_ref(shared);
+		args[i].pool = p;
+		args[i].shared = shared;
+		args[i].id = i + 1;
+		args[i].errors = 0;
+		pthread_create(&tid[i], NULL, worker, &args[i]);
+	}
+	r_goose_mbuf_release(shared);
+	for(int i = 0; i < THREADS; i++){
+		pthread_join(tid[i], NULL);
+		errors += args[i].errors;
+	}
+
+	CHECK(errors == 0, "%d bytes written by another thread (buffer handed out twice)", errors);
+	CHECK(r_goose_mbuf_available(p) == THREADS * 3, "%u buffers in the pool after the threads", r_goose_mbuf_available(p));
+
+	// Every buffer can be taken once
+	r_goose_mbuf* all[THREADS * 3];
+	int distinct = 1;
+	for(int i = 0; i < THREADS * 3; i++){
+		all[i] = r_goose_mbuf_alloc(p);
+		distinct &= all[i] != NULL;
+		for(int j = 0; j < i && distinct; j++){
+			distinct &= all[j] != all[i];
+		}
+	}
+	CHECK(distinct && r_goose_mbuf_alloc(p) == NULL, "free list broken after the threads");
+
+	r_goose_mbuf_pool_free(p);
+}
+
+static void timing(uint8_t* packet, long len, int iterations){
+	uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+	r_goose_mbuf_pool* p = r_goose_mbuf_pool_new(64, R_GOOSE_MBUF_HEADROOM, 1600);
+	r_goose_mbuf* src = load(p, packet, len);
+	struct timespec start, end;
+	uint64_t malloc_ns, pool_ns;
+	int ok = 1;
+
+	r_goose_keyring_publish(ring, appid, 1, HMAC_SHA256_80, AES_128_GCM, key, 32, 100, 60);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < iterations; i++){
+		uint8_t* buffer = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+		memcpy(buffer, packet, len);
+		int size = r_gooseMessage_ProtectKeyring(buffer, len + MAX_MAC_SIZE, ring, reader, 1, iv, 12);
+		uint8_t* datagram = (uint8_t*)malloc(size + 8);
+		memset(datagram, 0xee, 8);
+		memcpy(&datagram[8], buffer, size);
+		ok &= datagram[8 + INDEX_MAC_ALG] == HMAC_SHA256_80;
+		free(buffer);
+		free(datagram);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	malloc_ns = timespecDiff(&end, &start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < iterations; i++){
+		r_goose_mbuf* m = r_goose_mbuf_alloc(p);
+		ok &= r_gooseMessage_ProtectMbufTo(src, m, ring, reader, 1, iv, 12) == len + 10;
+		uint8_t* datagram = r_goose_mbuf_prepend(m, 8);
+		memset(datagram, 0xee, 8);
+		ok &= datagram[8 + INDEX_MAC_ALG] == HMAC_SHA256_80;
+		r_goose_mbuf_release(m);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	pool_ns = timespecDiff(&end, &start);
+
+	CHECK(ok, "timing loop results");
+
+	printf("valid_large.pkt (%ld bytes), HMAC-SHA256-80 + AES-128-GCM, protected and behind a UDP header\n", len);
+	printf("  malloc'ed buffers %7.1f ns/msg   pool buffers %7.1f ns/msg\n",
+		(double)malloc_ns / iterations, (double)pool_ns / iterations);
+
+	r_goose_keyring_retire(ring, appid, 1);
+	r_goose_keyring_reclaim(ring);
+	r_goose_mbuf_release(src);
+	r_goose_mbuf_pool_free(p);
+}
+
+
+int main(int argc, char** argv){
+
+	ring = r_goose_keyring_new(16);
+	reader = r_goose_keyring_reader_register(ring);
+
+	pool();
+	protect();
+	threads();
+	long len;
+	uint8_t* packet = read_packet("../resources/valid_large.pkt", &len);
+	timing(packet, len, ITERATIONS);
+	free(packet);
+
+	r_goose_keyring_free(ring);
+
+	printf("\n%s\n", failures == 0 ? "All packet buffer tests passed" : "Packet buffer tests FAILED");
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,330 @@
+/*
+	Test file:
+
+		No heap build - R_GOOSE_NO_HEAP, r_goose_static_init() and the R_GOOSE_*_STORAGE() budgets
+
+		Built with -DR_GOOSE_NO_HEAP and linked with --wrap=malloc (calloc, realloc, free,
+		posix_memalign, aligned_alloc): any heap call left in the library or in this file does
+		not link. Packets are read into static buffers.
+
+		1. Init: every object of an IED (key ring, session table, duplicate cache, layout cache,
+		   publisher, PDU template, buffer pool) created from the storage, each within its
+		   R_GOOSE_*_STORAGE() budget, all within the storage sized by the macros.
+		2. Steady state: protect/validate/unprotect ITERATIONS messages, nothing is allocated
+		   (no block handed out, by the library or OpenSSL) and the storage does not change.
+		3. Several readers: THREADS threads protect/validate/unprotect at once, alternating
+		   between a HMAC/AES-128-GCM key and a GMAC/ChaCha20-Poly1305 key, registered after
+		   both keys were published; after the first message under each key (which builds the
+		   contexts of the thread) nothing is allocated.
+		4. Several streams: MULTI_KEYS GMAC/AES-GCM keys published after the reader registered,
+		   messages alternating between them: nothing is allocated, not even by the first
+		   message under each key, and the time per message stays close to the one of a single
+		   stream (no key schedule expanded per message).
+		5. Key rotation: ROTATIONS keys published and released, the released blocks are reused
+		   (the carved storage stops growing after the first rotation).
+		6. Exhaustion: a constructor that does not fit returns NULL and leaves nothing allocated.
+
+*/
+
+#include "r_goose_security.h"
+#include "r_goose_keyring.h"
+#include "r_goose_session.h"
+#include "r_goose_dedup.h"
+#include "r_goose_pdu.h"
+#include "r_goose_publisher.h"
+#include "r_goose_view.h"
+#include "r_goose_mbuf.h"
+#include "r_goose_alloc.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+#define ITERATIONS		10000
+#define ROTATIONS		1000
+#define THREADS			3
+#define SECOND_KEY		0x10000
+#define MULTI_KEYS		6
+#define MULTI_KEY		0x20000
+#define PUBLISHER_KEY	0x30000
+
+#define CAPACITY		16
+#define KEYS			(3 + MULTI_KEYS)
+#define READERS			(1 + THREADS)
+#define STREAMS			64
+#define MAX_MESSAGE		1600
+#define MAX_APDU		1500
+#define BUFFERS			16
+#define VALUES			3
+
+#define STORAGE			(R_GOOSE_STATIC_CRYPTO_STORAGE + R_GOOSE_KEYRING_STORAGE(CAPACITY, KEYS, READERS) + \
+						 R_GOOSE_SESSION_TABLE_STORAGE(STREAMS) + R_GOOSE_DEDUP_STORAGE(STREAMS, MAX_MESSAGE) + \
+						 R_GOOSE_LAYOUT_CACHE_STORAGE(STREAMS, MAX_APDU) + R_GOOSE_PUBLISHER_STORAGE(MAX_APDU) + \
+						 R_GOOSE_PDU_TEMPLATE_STORAGE(VALUES) + R_GOOSE_MBUF_POOL_STORAGE(BUFFERS, R_GOOSE_MBUF_HEADROOM, MAX_MESSAGE))
+
+R_GOOSE_STATIC_STORAGE(storage, STORAGE);
+
+static uint8_t packet[MAX_MESSAGE];
+static uint8_t buffer[MAX_MESSAGE];
+
+static int failures = 0;
+
+#define CHECK(cond, ...)	do{ if(!(cond)){ failures++; printf("FAILED: " __VA_ARGS__); printf("\n"); } }while(0)
+
+static uint8_t key[32] = {0x21, 0x9b, 0xce, 0xf0, 0xcd, 0x0f, 0x89, 0xa5, 0xe1, 0x29, 0x7b, 0x99, 0xd9, 0x56, 0x15, 0x0f,
+						  0x31, 0x28, 0x45, 0x9f, 0x65, 0x31, 0x2f, 0xdd, 0x71, 0x61, 0x8f, 0x11, 0x77, 0x39, 0x3e, 0x3f};
+static uint8_t iv[12] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b};
+
+static pthread_barrier_t barrier;
+
+typedef struct reader_args {
+	r_goose_keyring* ring;
+	int reader;
+	int failed;
+	uint8_t buffer[MAX_MESSAGE];
+} reader_args;
+
+static reader_args readers[THREADS];
+
+static int types[VALUES] = {R_GOOSE_DATA_FLOAT32, R_GOOSE_DATA_QUALITY, R_GOOSE_DATA_BOOLEAN};
+static r_goose_pdu_config cfg = {"IED1LD0/LLN0$GO$gcb1", "IED1LD0/LLN0$DataSet1", "IED1", 2000, 1, 0, 0, 0x0A, types, VALUES};
+
+static long read_packet(char* filename, uint8_t* dest, size_t size){
+	FILE *fp;
+	long len;
+
+	fp = fopen(filename, "rb");
+	len = (long)fread(dest, 1, size, fp);
+	fclose(fp);
+
+	return len;
+}
+
+// One message of a reader thread: key 1 on even messages, SECOND_KEY on odd ones
+static int reader_message(reader_args* a, int i){
+	uint32_t key_id = i % 2 == 0 ? 1 : SECOND_KEY;
+	int size;
+
+	memcpy(a->buffer, packet, decode_4bytesToInt(packet, INDEX_SPDU_LENGTH) + 10);
+	encodeInt4Bytes(a->buffer, (uint32_t)i, INDEX_SPDU_NUMBER);
+	size = r_gooseMessage_ProtectKeyring(a->buffer, sizeof(a->buffer), a->ring, a->reader, key_id, iv, 12);
+	return size > 0 && r_gooseMessage_ValidateKeyring(a->buffer, size, a->ring, a->reader) == 1 &&
+		   r_gooseMessage_UnprotectKeyring(a->buffer, size, a->ring, a->reader, iv, 12) == 1;
+}
+
+// First message under each key, then ITERATIONS messages between the two barriers
+static void* reader_thread(void* arg){
+	reader_args* a = (reader_args*)arg;
+
+	a->failed = !reader_message(a, 0) || !reader_message(a, 1);
+	pthread_barrier_wait(&barrier);
+	pthread_barrier_wait(&barrier);
+	for(int i = 0; i < ITERATIONS && !a->failed; i++){
+		a->failed = !reader_message(a, i);
+	}
+	return NULL;
+}
+
+static double now_ns(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+// ITERATIONS messages of the main reader, under MULTI_KEY + (i % streams); ns/message, or -1
+static double stream_messages(r_goose_keyring* ring, int reader, int streams){
+	double start = now_ns();
+	int size;
+
+	for(int i = 0; i < ITERATIONS; i++){
+		memcpy(buffer, packet, decode_4bytesToInt(packet, INDEX_SPDU_LENGTH) + 10);
+		encodeInt4Bytes(buffer, (uint32_t)i, INDEX_SPDU_NUMBER);
+		size = r_gooseMessage_ProtectKeyring(buffer, sizeof(buffer), ring, reader, MULTI_KEY + i % streams, iv, 12);
+		if(size <= 0 || r_gooseMessage_ValidateKeyring(buffer, size, ring, reader) != 1 ||
+		   r_gooseMessage_UnprotectKeyring(buffer, size, ring, reader, iv, 12) != 1){
+			return -1;
+		}
+	}
+	return (now_ns() - start) / ITERATIONS;
+}
+
+static r_goose_static_stats usage(void){
+	r_goose_static_stats stats;
+	r_goose_static_get_stats(&stats);
+	return stats;
+}
+
+// Storage carved by one constructor, checked against its budget
+#define BUDGET(name, budget, call)	do{ \
+		size_t before = usage().carved; \
+		CHECK((call) != NULL, "%s", name); \
+		size_t used = usage().carved - before; \
+		printf("  %-28s %8zu / %8zu bytes\n", name, used, (size_t)(budget)); \
+		CHECK(used <= (size_t)(budget), "%s: %zu bytes, budget %zu", name, used, (size_t)(budget)); \
+	}while(0)
+
+int main(){
+	r_goose_keyring* ring;
+	r_goose_session_table* table;
+	r_goose_dedup* dedup;
+	r_goose_layout_cache* cache;
+	r_goose_publisher* pub;
+	r_goose_pdu_template* pdu;
+	r_goose_mbuf_pool* pool;
+	r_goose_static_stats before, after;
+	uint16_t appid;
+	int reader, size;
+
+	// Before anything else: OpenSSL allocates through the storage too
+	CHECK(r_goose_static_init(storage, sizeof(storage)) == 0, "static init");
+	CHECK(r_goose_static_init(storage, sizeof(storage)) == -1, "second static init");
+
+	read_packet("../resources/valid_small.pkt", packet, sizeof(packet));
+	appid = decode_2bytesToInt(packet, INDEX_APPID);
+
+	// 1. Init
+	printf("Init (storage %zu bytes)\n", sizeof(storage));
+
+	// OpenSSL is initialized by the first key ring and its algorithms fetched by the first key
+	ring = r_goose_keyring_new(CAPACITY);
+	reader = r_goose_keyring_reader_register(ring);
+	CHECK(ring != NULL && reader >= 0, "key ring");
+	CHECK(r_goose_keyring_publish(ring, appid, 1, HMAC_SHA256_80, AES_128_GCM, key, 32, 100, 60) == 1, "publish");
+	size_t crypto = usage().carved;
+	printf("  %-28s %8zu / %8zu bytes\n", "key ring and OpenSSL", crypto,
+		   (size_t)(R_GOOSE_STATIC_CRYPTO_STORAGE + R_GOOSE_KEYRING_STORAGE(CAPACITY, 1, READERS)));
+	CHECK(crypto <= R_GOOSE_STATIC_CRYPTO_STORAGE + R_GOOSE_KEYRING_STORAGE(CAPACITY, 1, READERS), "key ring and OpenSSL: %zu bytes", crypto);
+
+	BUDGET("session table", R_GOOSE_SESSION_TABLE_STORAGE(STREAMS), table = r_goose_session_table_new(STREAMS));
+	BUDGET("duplicate cache", R_GOOSE_DEDUP_STORAGE(STREAMS, MAX_MESSAGE), dedup = r_goose_dedup_new(STREAMS, MAX_MESSAGE, 1000));
+	BUDGET("layout cache", R_GOOSE_LAYOUT_CACHE_STORAGE(STREAMS, MAX_APDU), cache = r_goose_layout_cache_new(STREAMS, MAX_APDU));
+	// The publisher signs without encryption
+	CHECK(r_goose_keyring_publish(ring, appid, PUBLISHER_KEY, HMAC_SHA256_80, ENC_NONE, key, 32, 100, 60) == 1, "publisher key");
+	BUDGET("publisher", R_GOOSE_PUBLISHER_STORAGE(MAX_APDU), pub = r_goose_publisher_new(packet, ring, reader, PUBLISHER_KEY, MAX_APDU));
+	BUDGET("PDU template", R_GOOSE_PDU_TEMPLATE_STORAGE(VALUES), pdu = r_goose_pdu_template_new(&cfg));
+	BUDGET("buffer pool", R_GOOSE_MBUF_POOL_STORAGE(BUFFERS, R_GOOSE_MBUF_HEADROOM, MAX_MESSAGE), pool = r_goose_mbuf_pool_new(BUFFERS, R_GOOSE_MBUF_HEADROOM, MAX_MESSAGE));
+
+	after = usage();
+	printf("  %-28s %8zu / %8zu bytes\n", "total", after.carved, sizeof(storage));
+	CHECK(after.failures == 0, "%llu allocations failed", (unsigned long long)after.failures);
+
+	// 2. Steady state (after a first message: the reader creates its cipher context)
+	before = usage();
+	for(int i = -1; i < ITERATIONS; i++){
+		if(i == 0){
+			before = usage();
+		}
+		memcpy(buffer, packet, decode_4bytesToInt(packet, INDEX_SPDU_LENGTH) + 10);
+		size = r_gooseMessage_ProtectKeyring(buffer, sizeof(buffer), ring, reader, 1, iv, 12);
+		if(size <= 0 || r_gooseMessage_ValidateKeyring(buffer, size, ring, reader) != 1 ||
+		   r_gooseMessage_UnprotectKeyring(buffer, size, ring, reader, iv, 12) != 1){
+			CHECK(0, "message %d", i);
+			break;
+		}
+	}
+	after = usage();
+	CHECK(after.allocs == before.allocs, "steady state: %llu allocations", (unsigned long long)(after.allocs - before.allocs));
+	CHECK(after.carved == before.carved && after.in_use == before.in_use, "steady state: %zu -> %zu bytes in use",
+		  before.in_use, after.in_use);
+	printf("Steady state: %d messages, %zu bytes in use before and after\n", ITERATIONS, after.in_use);
+
+	// 3. Several readers (the main thread measures the storage while the readers wait at the barrier)
+	pthread_t threads[THREADS];
+	CHECK(r_goose_keyring_publish(ring, appid, SECOND_KEY, GMAC_AES128_128, CHACHA20_POLY1305, key, 32, 100, 60) == 1, "second key");
+	pthread_barrier_init(&barrier, NULL, THREADS + 1);
+	for(int t = 0; t < THREADS; t++){
+		readers[t].ring = ring;
+		readers[t].reader = r_goose_keyring_reader_register(ring);
+		CHECK(readers[t].reader >= 0, "reader %d", t);
+		pthread_create(&threads[t], NULL, reader_thread, &readers[t]);
+	}
+	pthread_barrier_wait(&barrier);
+	before = usage();
+	pthread_barrier_wait(&barrier);
+	for(int t = 0; t < THREADS; t++){
+		pthread_join(threads[t], NULL);
+		CHECK(!readers[t].failed, "reader %d", t);
+		r_goose_keyring_reader_unregister(ring, readers[t].reader);
+	}
+	after = usage();
+	CHECK(after.allocs == before.allocs, "several readers: %llu allocations", (unsigned long long)(after.allocs - before.allocs));
+	CHECK(after.carved == before.carved && after.in_use == before.in_use && after.failures == before.failures,
+		  "several readers: %zu -> %zu bytes in use", before.in_use, after.in_use);
+	printf("Several readers: %d threads x %d messages, %zu bytes in use before and after\n", THREADS, ITERATIONS, after.in_use);
+	pthread_barrier_destroy(&barrier);
+	CHECK(r_goose_keyring_retire(ring, appid, SECOND_KEY) == 1, "retire the second key");
+	r_goose_keyring_reclaim(ring);
+
+	// 4. Several streams (best of a few runs, against the time of a single stream)
+	static const int multi_mac[2] = {GMAC_AES256_128, GMAC_AES128_64};
+	static const int multi_enc[2] = {AES_256_GCM, AES_128_GCM};
+	double single = -1, alternating = -1;
+	for(int s = 0; s < MULTI_KEYS; s++){
+		CHECK(r_goose_keyring_publish(ring, appid, MULTI_KEY + s, multi_mac[s % 2], multi_enc[s % 2], key, 32, 100, 60) == 1,
+			  "stream key %d", s);
+	}
+	before = usage();
+	for(int run = 0; run < 5; run++){
+		double t1 = stream_messages(ring, reader, 1), tn = stream_messages(ring, reader, MULTI_KEYS);
+		CHECK(t1 > 0 && tn > 0, "several streams: run %d", run);
+		single = single < 0 || t1 < single ? t1 : single;
+		alternating = alternating < 0 || tn < alternating ? tn : alternating;
+	}
+	after = usage();
+	CHECK(after.allocs == before.allocs, "several streams: %llu allocations", (unsigned long long)(after.allocs - before.allocs));
+	CHECK(after.carved == before.carved && after.in_use == before.in_use, "several streams: %zu -> %zu bytes in use",
+		  before.in_use, after.in_use);
+	// Expanding the AES key schedule and GHASH table of the MAC and payload contexts per message costs about as much
+	// as the message itself: a quarter of margin for cache effects
+	CHECK(alternating < single * 1.25, "several streams: %.1f ns/msg, single stream %.1f ns/msg", alternating, single);
+	printf("Several streams: %d keys, %.1f ns/msg (single stream %.1f ns/msg), nothing allocated\n", MULTI_KEYS, alternating, single);
+	for(int s = 0; s < MULTI_KEYS; s++){
+		CHECK(r_goose_keyring_retire(ring, appid, MULTI_KEY + s) == 1, "retire stream key %d", s);
+	}
+	r_goose_keyring_reclaim(ring);
+
+	// 5. Key rotation: two keys alive at once
+	size_t carved_first = 0;
+	for(uint32_t id = 2; id < 2 + ROTATIONS; id++){
+		if(r_goose_keyring_publish(ring, appid, id, HMAC_SHA256_80, AES_128_GCM, key, 32, 100 + id, 60) != 1 ||
+		   r_goose_keyring_retire(ring, appid, id - 1) != 1){
+			CHECK(0, "rotation to key %u", id);
+			break;
+		}
+		r_goose_keyring_reclaim(ring);
+		if(id == 2){
+			carved_first = usage().carved;
+		}
+	}
+	memcpy(buffer, packet, decode_4bytesToInt(packet, INDEX_SPDU_LENGTH) + 10);
+	size = r_gooseMessage_ProtectKeyring(buffer, sizeof(buffer), ring, reader, 1 + ROTATIONS, iv, 12);
+	CHECK(size > 0 && r_gooseMessage_ValidateKeyring(buffer, size, ring, reader) == 1, "protect with the last key");
+	after = usage();
+	CHECK(after.carved == carved_first, "rotation: carved %zu after the first rotation, %zu after %d", carved_first, after.carved, ROTATIONS);
+	printf("Key rotation: %d keys, %zu bytes carved after the first and after the last\n", ROTATIONS, after.carved);
+
+	// 6. Exhaustion
+	before = usage();
+	CHECK(r_goose_mbuf_pool_new(BUFFERS, R_GOOSE_MBUF_HEADROOM, (uint32_t)sizeof(storage)) == NULL, "pool larger than the storage");
+	CHECK(r_goose_dedup_new(STREAMS, sizeof(storage), 1000) == NULL, "cache larger than the storage");
+	after = usage();
+	CHECK(after.in_use == before.in_use && after.failures == before.failures + 2, "exhaustion: %zu -> %zu bytes in use",
+		  before.in_use, after.in_use);
+
+	r_goose_mbuf_pool_free(pool);
+	r_goose_pdu_template_free(pdu);
+	r_goose_publisher_free(pub);
+	r_goose_layout_cache_free(cache);
+	r_goose_dedup_free(dedup);
+	r_goose_session_table_free(table);
+	r_goose_keyring_free(ring);
+
+	if(failures == 0){
+		printf("\nAll no heap tests passed\n");
+		return 0;
+	}
+	printf("\nNo heap tests FAILED\n");
+	return 1;
+}
@@ -0,0 +1,311 @@
+/*
+	Test file:
+
+		Structural pre-filter - r_gooseMessage_Prefilter() and r_gooseMessage_PrefilterBatch()
+
+		1. Well formed messages accepted: unsigned, signed with every MAC algorithm, encrypted.
+		2. Every malformation reported with its own flag (and only that flag).
+		3. Fuzzing: mutated, truncated, extended and random messages (each one in a buffer of
+		   exactly the received length), scalar and batch results compared. [cases] [seed]
+		4. Timing: pre-filter (scalar and batch) vs ValidateHMAC on a flood of malformed messages.
+
+*/
+
+#include "r_goose_security.h"
+#include "r_goose_prefilter.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <time.h>
+
+#define FUZZ_CASES		1000000
+#define BATCH			16
+#define ITERATIONS		1000000
+
+int64_t timespecDiff(struct timespec *timeA_p, struct timespec *timeB_p)
+{
+  return ((timeA_p->tv_sec * 1000000000) + timeA_p->tv_nsec) -
+           ((timeB_p->tv_sec * 1000000000) + timeB_p->tv_nsec);
+}
+
+uint8_t* read_packet(char* filename, long* filelen){
+	FILE *fp;
+	unsigned char *buffer;
+
+	fp = fopen(filename, "rb");
+	fseek(fp, 0, SEEK_END);
+	*filelen = ftell(fp);
+	rewind(fp);
+
+	buffer = (unsigned char*) malloc((*filelen)*sizeof(char));
+	fread(buffer, *filelen, 1, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...)	do{ if(!(cond)){ failures++; printf("FAILED: " __VA_ARGS__); printf("\n"); } }while(0)
+
+static uint64_t rng_state;
+
+static uint64_t rng(void){
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static int is_gmac(int alg){
+	return alg == GMAC_AES256_64 || alg == GMAC_AES256_128 || alg == GMAC_AES128_64 || alg == GMAC_AES128_128 || alg == CHACHA20_POLY1305_128;
+}
+
+static size_t message_size(uint8_t* buffer){
+	return decode_4bytesToInt(buffer, INDEX_SPDU_LENGTH) + 10;
+}
+
+// Pre-filter of a copy of buffer with one byte changed
+static int mutated(uint8_t* buffer, size_t len, int index, uint8_t value){
+	uint8_t* copy = (uint8_t*)malloc(len);
+	memcpy(copy, buffer, len);
+	copy[index] = value;
+	int res = r_gooseMessage_Prefilter(copy, len);
+	free(copy);
+	return res;
+}
+
+static void malformations(uint8_t* signedPacket, const char* name){
+	size_t len = message_size(signedPacket);
+	int alg = signedPacket[INDEX_MAC_ALG];
+	int s = MAC_SIZES[alg];
+	uint8_t* copy = (uint8_t*)malloc(len + 1);
+
+	CHECK(r_gooseMessage_Prefilter(signedPacket, len) == 0, "%s: well formed message rejected", name);
+
+	CHECK(mutated(signedPacket, len, 0, 0x02) == R_GOOSE_MALFORMED_LI_TI, "%s: LI", name);
+	CHECK(mutated(signedPacket, len, 1, 0x41) == R_GOOSE_MALFORMED_LI_TI, "%s: TI", name);
+
+	CHECK(r_gooseMessage_Prefilter(signedPacket, len - 1) == R_GOOSE_MALFORMED_SPDU_LENGTH, "%s: truncated", name);
+	memcpy(copy, signedPacket, len);
+	copy[len] = 0;
+	CHECK(r_gooseMessage_Prefilter(copy, len + 1) == R_GOOSE_MALFORMED_SPDU_LENGTH, "%s: trailing byte", name);
+	CHECK(mutated(signedPacket, len, INDEX_SPDU_LENGTH, 0xFF) == R_GOOSE_MALFORMED_SPDU_LENGTH, "%s: huge SPDU Length", name);
+	CHECK(r_gooseMessage_Prefilter(signedPacket, R_GOOSE_MIN_MESSAGE_SIZE - 1) == R_GOOSE_MALFORMED_SHORT, "%s: short", name);
+
+	CHECK(mutated(signedPacket, len, INDEX_MAC_ALG, MAC_ALGS_COUNT) == R_GOOSE_MALFORMED_ALG, "%s: MAC Algorithm %d", name, MAC_ALGS_COUNT);
+	CHECK(mutated(signedPacket, len, INDEX_MAC_ALG, 0xFF) == R_GOOSE_MALFORMED_ALG, "%s: MAC Algorithm 255", name);
+	CHECK(mutated(signedPacket, len, INDEX_ENCRYPTION_ALG, CHACHA20_POLY1305 + 1) == R_GOOSE_MALFORMED_ALG, "%s: Encryption Algorithm", name);
+
+	// Known algorithm with another MAC Tag size - Signature Length (and TAG) found elsewhere
+	int other = (s == 10) ? HMAC_SHA256_128 : HMAC_SHA256_80;
+	CHECK(mutated(signedPacket, len, INDEX_MAC_ALG, other) & R_GOOSE_MALFORMED_SIGNATURE, "%s: MAC Algorithm with other size", name);
+	CHECK(mutated(signedPacket, len, len - s - 2, 0x84) == R_GOOSE_MALFORMED_SIGNATURE, "%s: Signature TAG", name);
+	CHECK(mutated(signedPacket, len, len - s - 1, s + 1) == R_GOOSE_MALFORMED_SIGNATURE, "%s: Signature Length", name);
+
+	CHECK(mutated(signedPacket, len, INDEX_APDU_LENGTH + 1, signedPacket[INDEX_APDU_LENGTH + 1] ^ 0x01) == R_GOOSE_MALFORMED_APDU_LENGTH, "%s: APDU Length", name);
+	CHECK(mutated(signedPacket, len, INDEX_LENGTH + 3, signedPacket[INDEX_LENGTH + 3] ^ 0x02) == R_GOOSE_MALFORMED_APDU_LENGTH, "%s: Length", name);
+	CHECK(mutated(signedPacket, len, INDEX_LENGTH, 0x80) == R_GOOSE_MALFORMED_APDU_LENGTH, "%s: Length (high byte)", name);
+
+	// Several at once
+	memcpy(copy, signedPacket, len);
+	copy[0] = 0;
+	copy[INDEX_ENCRYPTION_ALG] = 9;
+	copy[INDEX_APDU_LENGTH] ^= 0x10;
+	CHECK(r_gooseMessage_Prefilter(copy, len) == (R_GOOSE_MALFORMED_LI_TI | R_GOOSE_MALFORMED_ALG | R_GOOSE_MALFORMED_APDU_LENGTH), "%s: combined", name);
+
+	free(copy);
+}
+
+
+// Random malformed (or not) message in a buffer of exactly *len bytes
+static uint8_t* fuzz_message(uint8_t** valid, int n_valid, size_t* len){
+	uint8_t* src = valid[rng() % n_valid];
+	size_t src_len = message_size(src);
+	uint8_t* p;
+	int mode = rng() % 8;
+
+	if(mode == 0){
+		// Random bytes
+		*len = rng() % 300;
+		p = (uint8_t*)malloc(*len);
+		for(size_t i = 0; i < *len; i++){
+			p[i] = (uint8_t)rng();
+		}
+		return p;
+	}
+
+	*len = src_len;
+	if(mode == 1){
+		*len = rng() % (src_len + 1);				// truncated
+	}else if(mode == 2){
+		*len = src_len + 1 + rng() % 16;			// extended
+	}
+	p = (uint8_t*)malloc(*len);
+	for(size_t i = 0; i < *len; i++){
+		p[i] = i < src_len ? src[i] : (uint8_t)rng();
+	}
+
+	// Header mutations (or a few random bytes of the trailer)
+	int changes = mode >= 6 ? 0 : (int)(rng() % 4);
+	for(int c = 0; c < changes && *len > 0; c++){
+		size_t i = (rng() & 1) ? rng() % (INDEX_PAYLOAD + 2) : *len - 1 - rng() % 40;
+		if(i < *len){
+			p[i] = (rng() & 1) ? (uint8_t)rng() : p[i] ^ (uint8_t)(1 << (rng() % 8));
+		}
+	}
+
+	return p;
+}
+
+static void fuzz(uint8_t** valid, int n_valid, long cases){
+	uint8_t* buffers[BATCH];
+	size_t lens[BATCH];
+	int results[BATCH];
+	long accepted = 0, mismatches = 0;
+	int n = 0;
+
+	for(long c = 0; c < cases; c += n){
+		n = 1 + rng() % BATCH;
+		for(int i = 0; i < n; i++){
+			buffers[i] = fuzz_message(valid, n_valid, &lens[i]);
+		}
+
+		int valid_count = r_gooseMessage_PrefilterBatch(buffers, lens, n, results);
+		int count = 0;
+
+		for(int i = 0; i < n; i++){
+			int scalar = r_gooseMessage_Prefilter(buffers[i], lens[i]);
+			if(scalar != results[i]){
+				if(mismatches++ < 10){
+					printf("FAILED: batch %d / scalar %d, len %zu\n", results[i], scalar, lens[i]);
+				}
+			}
+			if(scalar == 0){
+				// Accepted message - fields consistent with the received length
+				int s = MAC_SIZES[buffers[i][INDEX_MAC_ALG]];
+				CHECK(message_size(buffers[i]) == lens[i] && buffers[i][lens[i] - s - 2] == 0x85, "accepted inconsistent message");
+				count++;
+			}
+			free(buffers[i]);
+		}
+		CHECK(valid_count == count, "batch count");
+		accepted += count;
+	}
+
+	printf("Fuzzing: %ld messages, %ld accepted, %ld scalar/batch mismatches\n", cases, accepted, mismatches);
+	CHECK(mismatches == 0, "scalar and batch results differ");
+}
+
+
+int main(int argc, char** argv){
+
+	long cases = argc > 1 ? atol(argv[1]) : FUZZ_CASES;
+	rng_state = argc > 2 ? strtoull(argv[2], NULL, 0) : 0x9E3779B97F4A7C15ULL;
+
+	char keyHex[] = "219bcef0cd0f89a5e1297b99d956150f3128459f65312fdd71618f1177393e3f";
+	uint8_t* key = hexStringToBytes(keyHex, 64);
+
+	char ivHex[] = "75b66d3df73da95345c11a32";
+	uint8_t* iv = hexStringToBytes(ivHex, 24);
+
+	char* files[] = {"../resources/valid_small.pkt", "../resources/valid_medium.pkt", "../resources/valid_large.pkt"};
+
+	uint8_t* valid[3 * (MAC_ALGS_COUNT + 2)];
+	int n_valid = 0;
+
+	// 1. Well formed messages, 2. Malformations
+	for(int f = 0; f < 3; f++){
+		long len;
+		uint8_t* packet = read_packet(files[f], &len);
+		char name[64];
+
+		CHECK(r_gooseMessage_Prefilter(packet, len) == 0, "unsigned %s rejected", files[f]);
+		valid[n_valid++] = packet;
+
+		for(int alg = 1; alg < MAC_ALGS_COUNT; alg++){
+			size_t key_size = (alg == GMAC_AES128_64 || alg == GMAC_AES128_128 || alg == BLAKE2S_KEYED_80) ? 16 : 32;
+			uint8_t* dest = NULL;
+
+			if(is_gmac(alg)){
+				r_gooseMessage_InsertGMAC(packet, key, key_size, alg, &dest);
+			}else{
+				r_gooseMessage_InsertHMAC(packet, key, key_size, alg, &dest);
+			}
+
+			snprintf(name, sizeof(name), "alg %d, %s", alg, files[f] + 13);
+			malformations(dest, name);
+			valid[n_valid++] = dest;
+		}
+
+		uint8_t* encrypted = (uint8_t*)malloc(len);
+		memcpy(encrypted, packet, len);
+		r_gooseMessage_Encrypt(encrypted, key, AES_256_GCM, 100, 60, 1, iv, 12);
+		CHECK(r_gooseMessage_Prefilter(encrypted, len) == 0, "encrypted %s rejected", files[f]);
+		valid[n_valid++] = encrypted;
+	}
+
+	// 3. Fuzzing
+	fuzz(valid, n_valid, cases);
+
+	// 4. Timing - flood of messages with a wrong SPDU Length
+	{
+		uint8_t* buffers[BATCH];
+		size_t lens[BATCH];
+		int results[BATCH];
+		uint8_t* signedPacket = valid[1];
+		size_t len = message_size(signedPacket);
+		struct timespec start, end;
+		volatile int res = 0;
+
+		for(int i = 0; i < BATCH; i++){
+			buffers[i] = (uint8_t*)malloc(len);
+			memcpy(buffers[i], signedPacket, len);
+			buffers[i][INDEX_SPDU_NUMBER] = i;
+			lens[i] = len - 1;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for(int i = 0; i < ITERATIONS; i++){
+			res += r_gooseMessage_Prefilter(buffers[i % BATCH], lens[i % BATCH]);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		double scalar = (double)timespecDiff(&end, &start) / ITERATIONS;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for(int i = 0; i < ITERATIONS; i += BATCH){
+			res += r_gooseMessage_PrefilterBatch(buffers, lens, BATCH, results);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		double batch = (double)timespecDiff(&end, &start) / ITERATIONS;
+
+		CHECK(res == ITERATIONS * R_GOOSE_MALFORMED_SPDU_LENGTH, "malformed flood accepted");
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for(int i = 0; i < ITERATIONS / 10; i++){
+			res += r_gooseMessage_ValidateHMAC(buffers[i % BATCH], key, 32);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		double hmac = (double)timespecDiff(&end, &start) / (ITERATIONS / 10);
+
+		printf("Malformed message rejected: pre-filter %.1f ns, batch of %d %.1f ns/message, ValidateHMAC %.1f ns\n",
+			scalar, BATCH, batch, hmac);
+
+		for(int i = 0; i < BATCH; i++){
+			free(buffers[i]);
+		}
+	}
+
+	for(int i = 0; i < n_valid; i++){
+		free(valid[i]);
+	}
+	free(key);
+	free(iv);
+
+	printf("\n%s\n", failures == 0 ? "All pre-filter tests passed" : "Pre-filter tests FAILED");
+
+	return failures == 0 ? 0 : 1;
+}
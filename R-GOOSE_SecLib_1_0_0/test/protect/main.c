@@ -0,0 +1,328 @@
+/*
+	Test file:
+
+		Single pass protection - r_gooseMessage_ProtectKeyring() and r_gooseMessage_UnprotectKeyring()
+
+		1. Five (MAC, encryption) key pairs, including a GMAC key with AES-GCM encryption (two
+		   cipher contexts at the same time) and ENC_NONE, on the three resource packets:
+		   protected message byte-identical to r_gooseMessage_Encrypt() + InsertKeyring(), and
+		   unprotected message identical to ValidateKeyring() + DecryptKeyring().
+		2. Changed ciphertext, header and MAC Tag: invalid, message left as received.
+		   Unknown key, algorithm mismatch, no MAC Tag, buffer too small, SPDU Length not
+		   matching the received length (message left as received).
+		3. 48 KB message (several chunks), three key pairs: change in a middle chunk, in the
+		   last one and in the MAC Tag found after chunks were decrypted, message left as received.
+		4. Time per message on valid_large.pkt and a 48 KB message: Encrypt + InsertKeyring vs
+		   ProtectKeyring, and ValidateKeyring + DecryptKeyring vs UnprotectKeyring.
+
+*/
+
+#include "r_goose_security.h"
+#include "r_goose_keyring.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <time.h>
+
+#define ITERATIONS		200000
+
+int64_t timespecDiff(struct timespec *timeA_p, struct timespec *timeB_p)
+{
+  return ((timeA_p->tv_sec * 1000000000) + timeA_p->tv_nsec) -
+           ((timeB_p->tv_sec * 1000000000) + timeB_p->tv_nsec);
+}
+
+uint8_t* read_packet(char* filename, long* filelen){
+	FILE *fp;
+	unsigned char *buffer;
+
+	fp = fopen(filename, "rb");
+	fseek(fp, 0, SEEK_END);
+	*filelen = ftell(fp);
+	rewind(fp);
+
+	buffer = (unsigned char*) malloc((*filelen)*sizeof(char));
+	fread(buffer, *filelen, 1, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...)	do{ if(!(cond)){ failures++; printf("FAILED: " __VA_ARGS__); printf("\n"); } }while(0)
+
+// Number of bytes "received" for a well formed message
+static size_t message_size(const uint8_t* m){
+	return (size_t)decode_4bytesToInt((uint8_t*)m, INDEX_SPDU_LENGTH) + 10;
+}
+
+static r_goose_keyring* ring;
+static int reader;
+
+static uint8_t key[32] = {0x21, 0x9b, 0xce, 0xf0, 0xcd, 0x0f, 0x89, 0xa5, 0xe1, 0x29, 0x7b, 0x99, 0xd9, 0x56, 0x15, 0x0f,
+						  0x31, 0x28, 0x45, 0x9f, 0x65, 0x31, 0x2f, 0xdd, 0x71, 0x61, 0x8f, 0x11, 0x77, 0x39, 0x3e, 0x3f};
+static uint8_t iv[12] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b};
+
+
+// Reference: encryption and MAC Tag insertion as separate passes
+static uint8_t* reference_protect(uint8_t* packet, long len, uint32_t key_id, int enc_alg){
+	uint8_t* plain = (uint8_t*)malloc(len);
+	uint8_t* message = NULL;
+
+	memcpy(plain, packet, len);
+	r_gooseMessage_Encrypt(plain, key, enc_alg, 100, 60, key_id, iv, 12);
+	r_gooseMessage_InsertKeyring(plain, ring, reader, key_id, &message);
+	free(plain);
+
+	return message;
+}
+
+static void pairs(void){
+	char* files[] = {"../resources/valid_small.pkt", "../resources/valid_medium.pkt", "../resources/valid_large.pkt"};
+	int macs[] = {HMAC_SHA256_80, GMAC_AES256_128, BLAKE2B_KEYED_80, CHACHA20_POLY1305_128, HMAC_SHA512_256_128};
+	int encs[] = {AES_128_GCM, AES_256_GCM, CHACHA20_POLY1305, AES_128_GCM, ENC_NONE};
+
+	for(int f = 0; f < 3; f++){
+		long len;
+		uint8_t* packet = read_packet(files[f], &len);
+		uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+
+		for(int a = 0; a < 5; a++){
+			uint32_t key_id = 10 + a;
+			r_goose_keyring_publish(ring, appid, key_id, macs[a], encs[a], key, 32, 100, 60);
+
+			uint8_t* ref = reference_protect(packet, len, key_id, encs[a]);
+			int ref_size = decode_4bytesToInt(ref, INDEX_SPDU_LENGTH) + 10;
+
+			uint8_t* buffer = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+			memcpy(buffer, packet, len);
+			int size = r_gooseMessage_ProtectKeyring(buffer, len + MAX_MAC_SIZE, ring, reader, key_id, iv, 12);
+			CHECK(size == ref_size && memcmp(buffer, ref, size) == 0, "%s, pair %d: protected message differs", files[f], a);
+			CHECK(encs[a] == ENC_NONE || memcmp(&buffer[INDEX_PAYLOAD], &packet[INDEX_PAYLOAD], 16) != 0, "%s, pair %d: not encrypted", files[f], a);
+
+			// Changed ciphertext, header, MAC Tag: invalid, left as received
+			int positions[] = {INDEX_PAYLOAD + (size - INDEX_PAYLOAD) / 2, INDEX_KEYID - 3, size - 1};
+			for(int p = 0; p < 3; p++){
+				uint8_t* bad = (uint8_t*)malloc(size);
+				memcpy(bad, buffer, size);
+				bad[positions[p]] ^= 0x10;
+				uint8_t* received = (uint8_t*)malloc(size);
+				memcpy(received, bad, size);
+				CHECK(r_gooseMessage_UnprotectKeyring(bad, size, ring, reader, iv, 12) == 0 && memcmp(bad, received, size) == 0,
+					  "%s, pair %d: change at %d", files[f], a, positions[p]);
+				free(bad);
+				free(received);
+			}
+
+			// Reference: validation then decryption
+			CHECK(r_gooseMessage_ValidateKeyring(ref, message_size(ref), ring, reader) == 1, "%s, pair %d: reference invalid", files[f], a);
+			r_gooseMessage_DecryptKeyring(ref, message_size(ref), ring, reader, iv, 12);
+
+			CHECK(r_gooseMessage_UnprotectKeyring(buffer, size, ring, reader, iv, 12) == 1 && memcmp(buffer, ref, size) == 0,
+				  "%s, pair %d: unprotected message differs", files[f], a);
+			CHECK(memcmp(&buffer[INDEX_PAYLOAD], &packet[INDEX_PAYLOAD], decode_2bytesToInt(packet, INDEX_APDU_LENGTH) - 2) == 0,
+				  "%s, pair %d: payload differs", files[f], a);
+
+			r_goose_keyring_retire(ring, appid, key_id);
+			free(ref);
+			free(buffer);
+		}
+		free(packet);
+	}
+	r_goose_keyring_reclaim(ring);
+}
+
+static void errors(void){
+	long len;
+	uint8_t* packet = read_packet("../resources/valid_medium.pkt", &len);
+	uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+	uint8_t* buffer = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+
+	r_goose_keyring_publish(ring, appid, 1, HMAC_SHA256_80, AES_128_GCM, key, 32, 100, 60);
+	r_goose_keyring_publish(ring, appid, 2, MAC_NONE, AES_128_GCM, key, 32, 100, 60);
+
+	memcpy(buffer, packet, len);
+	CHECK(r_gooseMessage_ProtectKeyring(buffer, len + MAX_MAC_SIZE, ring, reader, 3, iv, 12) == -1, "unknown key");
+	CHECK(r_gooseMessage_ProtectKeyring(buffer, len + MAX_MAC_SIZE, ring, reader, 2, iv, 12) == -1, "key without MAC");
+	CHECK(r_gooseMessage_ProtectKeyring(buffer, len + 9, ring, reader, 1, iv, 12) == -1, "buffer too small");
+	CHECK(memcmp(buffer, packet, len) == 0, "message changed by a failed protection");
+
+	CHECK(r_gooseMessage_UnprotectKeyring(buffer, len, ring, reader, iv, 12) == 2 && memcmp(buffer, packet, len) == 0, "no MAC Tag");
+
+	int size = r_gooseMessage_ProtectKeyring(buffer, len + 10, ring, reader, 1, iv, 12);
+	CHECK(size == len + 10, "exact buffer");
+
+	// Encryption algorithm of the message differs from the key
+	buffer[INDEX_ENCRYPTION_ALG] = AES_256_GCM;
+	CHECK(r_gooseMessage_UnprotectKeyring(buffer, size, ring, reader, iv, 12) == -1, "encryption algorithm mismatch");
+	buffer[INDEX_ENCRYPTION_ALG] = AES_128_GCM;
+	encodeInt4Bytes(buffer, 3, INDEX_KEYID);
+	CHECK(r_gooseMessage_UnprotectKeyring(buffer, size, ring, reader, iv, 12) == -1, "unknown key id");
+	encodeInt4Bytes(buffer, 1, INDEX_KEYID);
+
+	// APDU Length beyond the Signature
+	encodeInt2Bytes(buffer, (uint16_t)(size), INDEX_APDU_LENGTH);
+	CHECK(r_gooseMessage_UnprotectKeyring(buffer, size, ring, reader, iv, 12) == -1, "APDU Length");
+	encodeInt2Bytes(buffer, decode_2bytesToInt(packet, INDEX_APDU_LENGTH), INDEX_APDU_LENGTH);
+
+	// SPDU Length not matching the received length: rejected before the payload is read or decrypted
+	uint8_t* received = (uint8_t*)malloc(size);
+	memcpy(received, buffer, size);
+	CHECK(r_gooseMessage_UnprotectKeyring(buffer, size - 1, ring, reader, iv, 12) == -1 && memcmp(buffer, received, size) == 0,
+		  "message longer than received");
+	encodeInt4Bytes(buffer, 0xFFF0, INDEX_SPDU_LENGTH);
+	CHECK(r_gooseMessage_UnprotectKeyring(buffer, size, ring, reader, iv, 12) == -1, "forged SPDU Length");
+	encodeInt4Bytes(buffer, (uint32_t)(size - 10), INDEX_SPDU_LENGTH);
+	CHECK(r_gooseMessage_UnprotectKeyring(buffer, size, ring, reader, iv, 12) == 1, "restored message");
+	free(received);
+
+	r_goose_keyring_retire(ring, appid, 1);
+	r_goose_keyring_retire(ring, appid, 2);
+	r_goose_keyring_reclaim(ring);
+	free(buffer);
+	free(packet);
+}
+
+static void timing(uint8_t* packet, long len, const char* name, int iterations){
+	uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+	uint8_t* buffer = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+	uint8_t* message = NULL;
+	uint8_t* protected;
+	struct timespec start, end;
+	uint64_t separate_ns, protect_ns, receive_ns, unprotect_ns;
+	int ok = 1;
+
+	r_goose_keyring_publish(ring, appid, 1, HMAC_SHA256_80, AES_128_GCM, key, 32, 100, 60);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < iterations; i++){
+		memcpy(buffer, packet, len);
+		r_gooseMessage_Encrypt(buffer, key, AES_128_GCM, 100, 60, 1, iv, 12);
+		r_gooseMessage_InsertKeyring(buffer, ring, reader, 1, &message);
+		free(message);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	separate_ns = timespecDiff(&end, &start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < iterations; i++){
+		memcpy(buffer, packet, len);
+		ok &= r_gooseMessage_ProtectKeyring(buffer, len + MAX_MAC_SIZE, ring, reader, 1, iv, 12) == len + 10;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	protect_ns = timespecDiff(&end, &start);
+
+	protected = (uint8_t*)malloc(len + 10);
+	memcpy(protected, buffer, len + 10);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < iterations; i++){
+		memcpy(buffer, protected, len + 10);
+		if(r_gooseMessage_ValidateKeyring(buffer, message_size(buffer), ring, reader) == 1){
+			r_gooseMessage_DecryptKeyring(buffer, len + 10, ring, reader, iv, 12);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	receive_ns = timespecDiff(&end, &start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < iterations; i++){
+		memcpy(buffer, protected, len + 10);
+		ok &= r_gooseMessage_UnprotectKeyring(buffer, len + 10, ring, reader, iv, 12) == 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	unprotect_ns = timespecDiff(&end, &start);
+
+	CHECK(ok, "timing loop results");
+
+	printf("%s (%ld bytes), HMAC-SHA256-80 + AES-128-GCM\n", name, len);
+	printf("  Encrypt + InsertKeyring          %7.1f ns/msg   ProtectKeyring   %7.1f ns/msg\n",
+		(double)separate_ns / iterations, (double)protect_ns / iterations);
+	printf("  ValidateKeyring + DecryptKeyring %7.1f ns/msg   UnprotectKeyring %7.1f ns/msg\n",
+		(double)receive_ns / iterations, (double)unprotect_ns / iterations);
+
+	r_goose_keyring_retire(ring, appid, 1);
+	r_goose_keyring_reclaim(ring);
+	free(protected);
+	free(buffer);
+}
+
+// valid_large.pkt header and the payload repeated up to size bytes (Signature TAG at the end)
+static uint8_t* large_message(uint8_t* packet, long size){
+	uint8_t* message = (uint8_t*)malloc(size);
+	int payload = decode_2bytesToInt(packet, INDEX_APDU_LENGTH) - 2;
+
+	memcpy(message, packet, INDEX_PAYLOAD);
+	for(long o = INDEX_PAYLOAD; o < size - 2; o++){
+		message[o] = packet[INDEX_PAYLOAD + (o - INDEX_PAYLOAD) % payload];
+	}
+	message[size - 2] = 0x85;
+	message[size - 1] = 0x00;
+	encodeInt4Bytes(message, (uint32_t)(size - 10), INDEX_SPDU_LENGTH);
+	encodeInt2Bytes(message, (uint16_t)(size - 2 - INDEX_PAYLOAD + 2), INDEX_APDU_LENGTH);
+
+	return message;
+}
+
+// Payload of several chunks: a change in a middle chunk or in the MAC Tag is found after chunks were decrypted
+static void chunks(uint8_t* packet, long len){
+	int macs[] = {HMAC_SHA256_80, GMAC_AES256_128, BLAKE2B_KEYED_80};
+	int encs[] = {AES_128_GCM, AES_256_GCM, CHACHA20_POLY1305};
+	uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+	uint8_t* buffer = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+	uint8_t* bad = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+	uint8_t* received = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+
+	for(int a = 0; a < 3; a++){
+		r_goose_keyring_publish(ring, appid, 20 + a, macs[a], encs[a], key, 32, 100, 60);
+		memcpy(buffer, packet, len);
+		int size = r_gooseMessage_ProtectKeyring(buffer, len + MAX_MAC_SIZE, ring, reader, 20 + a, iv, 12);
+		CHECK(size == len + MAC_SIZES[macs[a]], "%ld bytes, pair %d: ProtectKeyring", len, a);
+
+		int positions[] = {INDEX_PAYLOAD + R_GOOSE_PROTECT_CHUNK + 100, size - 3 - MAC_SIZES[macs[a]], size - 1};
+		for(int p = 0; p < 3; p++){
+			memcpy(bad, buffer, size);
+			bad[positions[p]] ^= 0x01;
+			memcpy(received, bad, size);
+			CHECK(r_gooseMessage_UnprotectKeyring(bad, size, ring, reader, iv, 12) == 0 && memcmp(bad, received, size) == 0,
+				  "%ld bytes, pair %d: change at %d, message not left as received", len, a, positions[p]);
+		}
+
+		CHECK(r_gooseMessage_UnprotectKeyring(buffer, size, ring, reader, iv, 12) == 1 &&
+			  memcmp(&buffer[INDEX_PAYLOAD], &packet[INDEX_PAYLOAD], len - INDEX_PAYLOAD - 2) == 0, "%ld bytes, pair %d: UnprotectKeyring", len, a);
+		r_goose_keyring_retire(ring, appid, 20 + a);
+	}
+
+	r_goose_keyring_reclaim(ring);
+	free(received);
+	free(bad);
+	free(buffer);
+}
+
+
+int main(int argc, char** argv){
+
+	ring = r_goose_keyring_new(16);
+	reader = r_goose_keyring_reader_register(ring);
+
+	pairs();
+	errors();
+	long len;
+	uint8_t* packet = read_packet("../resources/valid_large.pkt", &len);
+	timing(packet, len, "valid_large.pkt", ITERATIONS);
+	uint8_t* large = large_message(packet, 48000);
+	chunks(large, 48000);
+	timing(large, 48000, "48 KB message", ITERATIONS / 32);
+	free(large);
+	free(packet);
+
+	r_goose_keyring_free(ring);
+
+	printf("\n%s\n", failures == 0 ? "All protect/unprotect tests passed" : "Protect/unprotect tests FAILED");
+
+	return failures == 0 ? 0 : 1;
+}
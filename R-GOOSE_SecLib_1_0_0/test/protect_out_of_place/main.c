@@ -0,0 +1,247 @@
+/*
+	Test file:
+
+		Out of place encryption - r_gooseMessage_EncryptTo() and r_gooseMessage_ProtectKeyringTo()
+
+		1. The four encryption algorithms on the three resource packets: EncryptTo() output
+		   byte-identical to r_gooseMessage_Encrypt() on a copy, source message unchanged.
+		2. Five (MAC, encryption) key pairs: ProtectKeyringTo() output byte-identical to
+		   r_gooseMessage_ProtectKeyring() on a copy (given IV and IV derived from the SPDU
+		   Number), source message unchanged, and one source protected for four groups in a row,
+		   each result unprotected back to the source payload.
+		3. Destination too small, unknown key: -1 and nothing written.
+		4. Time per message on valid_large.pkt and a 48 KB message: memcpy + Encrypt vs
+		   EncryptTo, and memcpy + ProtectKeyring vs ProtectKeyringTo.
+
+*/
+
+#include "r_goose_security.h"
+#include "r_goose_keyring.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <time.h>
+
+#define ITERATIONS		200000
+
+int64_t timespecDiff(struct timespec *timeA_p, struct timespec *timeB_p)
+{
+  return ((timeA_p->tv_sec * 1000000000) + timeA_p->tv_nsec) -
+           ((timeB_p->tv_sec * 1000000000) + timeB_p->tv_nsec);
+}
+
+uint8_t* read_packet(char* filename, long* filelen){
+	FILE *fp;
+	unsigned char *buffer;
+
+	fp = fopen(filename, "rb");
+	fseek(fp, 0, SEEK_END);
+	*filelen = ftell(fp);
+	rewind(fp);
+
+	buffer = (unsigned char*) malloc((*filelen)*sizeof(char));
+	fread(buffer, *filelen, 1, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...)	do{ if(!(cond)){ failures++; printf("FAILED: " __VA_ARGS__); printf("\n"); } }while(0)
+
+static r_goose_keyring* ring;
+static int reader;
+
+static uint8_t key[32] = {0x21, 0x9b, 0xce, 0xf0, 0xcd, 0x0f, 0x89, 0xa5, 0xe1, 0x29, 0x7b, 0x99, 0xd9, 0x56, 0x15, 0x0f,
+						  0x31, 0x28, 0x45, 0x9f, 0x65, 0x31, 0x2f, 0xdd, 0x71, 0x61, 0x8f, 0x11, 0x77, 0x39, 0x3e, 0x3f};
+static uint8_t iv[12] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b};
+
+static char* files[] = {"../resources/valid_small.pkt", "../resources/valid_medium.pkt", "../resources/valid_large.pkt"};
+
+
+static void encrypt_to(void){
+	for(int f = 0; f < 3; f++){
+		long len;
+		uint8_t* packet = read_packet(files[f], &len);
+		uint8_t* source = (uint8_t*)malloc(len);
+		uint8_t* ref = (uint8_t*)malloc(len);
+		uint8_t* out = (uint8_t*)malloc(len);
+
+		memcpy(source, packet, len);
+		for(int alg = ENC_NONE; alg <= CHACHA20_POLY1305; alg++){
+			memcpy(ref, packet, len);
+			int ref_res = r_gooseMessage_Encrypt(ref, key, alg, 100, 60, 7, iv, 12);
+
+			memset(out, 0xa5, len);
+			int res = r_gooseMessage_EncryptTo(source, out, len, key, alg, 100, 60, 7, iv, 12);
+			CHECK(res == ref_res && memcmp(out, ref, len) == 0, "%s, algorithm %d: encrypted message differs", files[f], alg);
+			CHECK(memcmp(source, packet, len) == 0, "%s, algorithm %d: source changed", files[f], alg);
+		}
+
+		CHECK(r_gooseMessage_EncryptTo(source, out, len - 1, key, AES_128_GCM, 100, 60, 7, iv, 12) == -1, "%s: destination too small", files[f]);
+		CHECK(r_gooseMessage_EncryptTo(source, out, len, key, 4, 100, 60, 7, iv, 12) == -1, "%s: unknown algorithm", files[f]);
+
+		free(out);
+		free(ref);
+		free(source);
+		free(packet);
+	}
+}
+
+static void protect_to(void){
+	int macs[] = {HMAC_SHA256_80, GMAC_AES256_128, BLAKE2B_KEYED_80, CHACHA20_POLY1305_128, HMAC_SHA512_256_128};
+	int encs[] = {AES_128_GCM, AES_256_GCM, CHACHA20_POLY1305, AES_128_GCM, ENC_NONE};
+
+	for(int f = 0; f < 3; f++){
+		long len;
+		uint8_t* packet = read_packet(files[f], &len);
+		uint8_t* source = (uint8_t*)malloc(len);
+		uint8_t* ref = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+		uint8_t* out = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+		uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+		int data_size = decode_2bytesToInt(packet, INDEX_APDU_LENGTH) - 2;
+
+		memcpy(source, packet, len);
+		for(int a = 0; a < 5; a++){
+			r_goose_keyring_publish(ring, appid, 10 + a, macs[a], encs[a], key, 32, 100, 60);
+		}
+
+		for(int a = 0; a < 5; a++){
+			for(int derived = 0; derived < 2; derived++){
+				uint8_t* v = derived ? NULL : iv;
+
+				memcpy(ref, packet, len);
+				int ref_size = r_gooseMessage_ProtectKeyring(ref, len + MAX_MAC_SIZE, ring, reader, 10 + a, v, 12);
+
+				memset(out, 0xa5, len + MAX_MAC_SIZE);
+				int size = r_gooseMessage_ProtectKeyringTo(source, out, len + MAX_MAC_SIZE, ring, reader, 10 + a, v, 12);
+				CHECK(size > 0 && size == ref_size && memcmp(out, ref, size) == 0, "%s, pair %d, derived IV %d: protected message differs", files[f], a, derived);
+				CHECK(memcmp(source, packet, len) == 0, "%s, pair %d: source changed", files[f], a);
+			}
+		}
+
+		// One source, four groups in a row
+		for(int a = 0; a < 4; a++){
+			int size = r_gooseMessage_ProtectKeyringTo(source, out, len + MAX_MAC_SIZE, ring, reader, 10 + a, NULL, 0);
+			CHECK(size == len + MAC_SIZES[macs[a]], "%s, group %d: size", files[f], a);
+			CHECK(r_gooseMessage_UnprotectKeyring(out, size, ring, reader, NULL, 0) == 1 &&
+				  memcmp(&out[INDEX_PAYLOAD], &packet[INDEX_PAYLOAD], data_size) == 0, "%s, group %d: unprotected payload differs", files[f], a);
+		}
+		CHECK(memcmp(source, packet, len) == 0, "%s: source changed by the groups", files[f]);
+
+		// Failed protection writes nothing
+		memset(out, 0xa5, len + MAX_MAC_SIZE);
+		CHECK(r_gooseMessage_ProtectKeyringTo(source, out, len + 9, ring, reader, 10, iv, 12) == -1, "%s: destination too small", files[f]);
+		CHECK(r_gooseMessage_ProtectKeyringTo(source, out, len + MAX_MAC_SIZE, ring, reader, 99, iv, 12) == -1, "%s: unknown key", files[f]);
+		int untouched = 1;
+		for(long i = 0; i < len + MAX_MAC_SIZE; i++){
+			untouched &= out[i] == 0xa5;
+		}
+		CHECK(untouched, "%s: destination written by a failed protection", files[f]);
+
+		for(int a = 0; a < 5; a++){
+			r_goose_keyring_retire(ring, appid, 10 + a);
+		}
+		r_goose_keyring_reclaim(ring);
+		free(out);
+		free(ref);
+		free(source);
+		free(packet);
+	}
+}
+
+static void timing(uint8_t* packet, long len, const char* name, int iterations){
+	uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+	uint8_t* buffer = (uint8_t*)malloc(len + MAX_MAC_SIZE);
+	struct timespec start, end;
+	uint64_t copy_encrypt_ns, encrypt_to_ns, copy_protect_ns, protect_to_ns;
+	int ok = 1;
+
+	r_goose_keyring_publish(ring, appid, 1, HMAC_SHA256_80, AES_128_GCM, key, 32, 100, 60);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < iterations; i++){
+		memcpy(buffer, packet, len);
+		ok &= r_gooseMessage_Encrypt(buffer, key, AES_128_GCM, 100, 60, 1, iv, 12) == 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	copy_encrypt_ns = timespecDiff(&end, &start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < iterations; i++){
+		ok &= r_gooseMessage_EncryptTo(packet, buffer, len + MAX_MAC_SIZE, key, AES_128_GCM, 100, 60, 1, iv, 12) == 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	encrypt_to_ns = timespecDiff(&end, &start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < iterations; i++){
+		memcpy(buffer, packet, len);
+		ok &= r_gooseMessage_ProtectKeyring(buffer, len + MAX_MAC_SIZE, ring, reader, 1, iv, 12) == len + 10;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	copy_protect_ns = timespecDiff(&end, &start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < iterations; i++){
+		ok &= r_gooseMessage_ProtectKeyringTo(packet, buffer, len + MAX_MAC_SIZE, ring, reader, 1, iv, 12) == len + 10;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	protect_to_ns = timespecDiff(&end, &start);
+
+	CHECK(ok, "timing loop results");
+
+	printf("%s (%ld bytes), HMAC-SHA256-80 + AES-128-GCM\n", name, len);
+	printf("  memcpy + Encrypt        %7.1f ns/msg   EncryptTo          %7.1f ns/msg\n",
+		(double)copy_encrypt_ns / iterations, (double)encrypt_to_ns / iterations);
+	printf("  memcpy + ProtectKeyring %7.1f ns/msg   ProtectKeyringTo   %7.1f ns/msg\n",
+		(double)copy_protect_ns / iterations, (double)protect_to_ns / iterations);
+
+	r_goose_keyring_retire(ring, appid, 1);
+	r_goose_keyring_reclaim(ring);
+	free(buffer);
+}
+
+// valid_large.pkt header and the payload repeated up to size bytes (Signature TAG at the end)
+static uint8_t* large_message(uint8_t* packet, long size){
+	uint8_t* message = (uint8_t*)malloc(size);
+	int payload = decode_2bytesToInt(packet, INDEX_APDU_LENGTH) - 2;
+
+	memcpy(message, packet, INDEX_PAYLOAD);
+	for(long o = INDEX_PAYLOAD; o < size - 2; o++){
+		message[o] = packet[INDEX_PAYLOAD + (o - INDEX_PAYLOAD) % payload];
+	}
+	message[size - 2] = 0x85;
+	message[size - 1] = 0x00;
+	encodeInt4Bytes(message, (uint32_t)(size - 10), INDEX_SPDU_LENGTH);
+	encodeInt2Bytes(message, (uint16_t)(size - 2 - INDEX_PAYLOAD + 2), INDEX_APDU_LENGTH);
+
+	return message;
+}
+
+
+int main(int argc, char** argv){
+
+	ring = r_goose_keyring_new(16);
+	reader = r_goose_keyring_reader_register(ring);
+
+	encrypt_to();
+	protect_to();
+	long len;
+	uint8_t* packet = read_packet("../resources/valid_large.pkt", &len);
+	timing(packet, len, "valid_large.pkt", ITERATIONS);
+	uint8_t* large = large_message(packet, 48000);
+	timing(large, 48000, "48 KB message", ITERATIONS / 32);
+	free(large);
+	free(packet);
+
+	r_goose_keyring_free(ring);
+
+	printf("\n%s\n", failures == 0 ? "All out of place encryption tests passed" : "Out of place encryption tests FAILED");
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,237 @@
+/*
+	Test file:
+
+		Publisher session - r_goose_publisher_*()
+
+		1. Equivalence: for each packet size and MAC algorithm, the messages signed by a publisher are
+		   byte-identical to r_gooseMessage_InsertKeyring() with the same SPDU Number, pass the
+		   pre-filter and are validated by r_gooseMessage_ValidateKeyring().
+		2. SPDU Number: incremented after each message, wraps around, not incremented on errors.
+		   Keys with an encryption algorithm are refused (the publisher never encrypts), and the
+		   Encryption Algorithm of the template is replaced by ENC_NONE.
+		3. APDU size changes and key rotation (r_goose_publisher_set_key()).
+		4. Time per message: r_gooseMessage_InsertKeyring() (with the header updates done by the
+		   application) vs r_goose_publisher_sign().
+
+*/
+
+#include "r_goose_security.h"
+#include "r_goose_keyring.h"
+#include "r_goose_prefilter.h"
+#include "r_goose_publisher.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <time.h>
+
+#define ITERATIONS		200000
+
+int64_t timespecDiff(struct timespec *timeA_p, struct timespec *timeB_p)
+{
+  return ((timeA_p->tv_sec * 1000000000) + timeA_p->tv_nsec) -
+           ((timeB_p->tv_sec * 1000000000) + timeB_p->tv_nsec);
+}
+
+uint8_t* read_packet(char* filename, long* filelen){
+	FILE *fp;
+	unsigned char *buffer;
+
+	fp = fopen(filename, "rb");
+	fseek(fp, 0, SEEK_END);
+	*filelen = ftell(fp);
+	rewind(fp);
+
+	buffer = (unsigned char*) malloc((*filelen)*sizeof(char));
+	fread(buffer, *filelen, 1, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...)	do{ if(!(cond)){ failures++; printf("FAILED: " __VA_ARGS__); printf("\n"); } }while(0)
+
+// Number of bytes "received" for a well formed message
+static size_t message_size(const uint8_t* m){
+	return (size_t)decode_4bytesToInt((uint8_t*)m, INDEX_SPDU_LENGTH) + 10;
+}
+
+static char* files[] = {"../resources/valid_small.pkt", "../resources/valid_medium.pkt", "../resources/valid_large.pkt"};
+
+static int algs[] = {HMAC_SHA256_80, HMAC_SHA256_256, GMAC_AES256_64, CHACHA20_POLY1305_128, BLAKE2S_KEYED_80};
+#define ALGS	(int)(sizeof(algs)/sizeof(algs[0]))
+
+static r_goose_keyring* ring;
+static int reader;
+static uint8_t* key;
+
+
+static void equivalence(uint8_t* packet, long len){
+	uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+
+	for(int a = 0; a < ALGS; a++){
+		uint32_t key_id = 100 + a;
+		r_goose_keyring_publish(ring, appid, key_id, algs[a], ENC_NONE, key, 32, 1000 + a, 60);
+
+		r_goose_publisher* pub = r_goose_publisher_new(packet, ring, reader, key_id, 0);
+		CHECK(pub != NULL, "publisher (alg %d)", algs[a]);
+		if(pub == NULL){
+			continue;
+		}
+
+		uint32_t first = decode_4bytesToInt(packet, INDEX_SPDU_NUMBER);
+		for(int i = 0; i < 3; i++){
+			uint8_t* message;
+			uint8_t* expected = NULL;
+
+			int size = r_goose_publisher_sign(pub, len - INDEX_PAYLOAD - 2, &message);
+
+			encodeInt4Bytes(packet, first + i, INDEX_SPDU_NUMBER);
+			r_gooseMessage_InsertKeyring(packet, ring, reader, key_id, &expected);
+
+			CHECK(size == len + MAC_SIZES[algs[a]], "size %d (alg %d)", size, algs[a]);
+			CHECK(size > 0 && memcmp(message, expected, size) == 0, "message differs from r_gooseMessage_InsertKeyring() (alg %d, message %d)", algs[a], i);
+			CHECK(r_gooseMessage_Prefilter(message, size) == 0, "pre-filter (alg %d)", algs[a]);
+			CHECK(r_gooseMessage_ValidateKeyring(message, message_size(message), ring, reader) == 1, "validation (alg %d)", algs[a]);
+
+			free(expected);
+		}
+		encodeInt4Bytes(packet, first, INDEX_SPDU_NUMBER);
+
+		r_goose_publisher_free(pub);
+		r_goose_keyring_retire(ring, appid, key_id);
+	}
+	r_goose_keyring_reclaim(ring);
+}
+
+
+static void numbering(uint8_t* packet, long len){
+	uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+	size_t apdu = len - INDEX_PAYLOAD - 2;
+	uint8_t* message;
+
+	r_goose_keyring_publish(ring, appid, 1, HMAC_SHA256_80, ENC_NONE, key, 32, 1000, 60);
+
+	r_goose_keyring_publish(ring, appid, 3, HMAC_SHA256_80, AES_128_GCM, key, 32, 1000, 60);
+
+	CHECK(r_goose_publisher_new(packet, ring, reader, 99, 0) == NULL, "publisher with an unknown key");
+	CHECK(r_goose_publisher_new(packet, ring, reader, 3, 0) == NULL, "publisher with an encryption key");
+
+	uint8_t enc = packet[INDEX_ENCRYPTION_ALG];
+	packet[INDEX_ENCRYPTION_ALG] = AES_128_GCM;
+	r_goose_publisher* pub = r_goose_publisher_new(packet, ring, reader, 1, 2000);
+	packet[INDEX_ENCRYPTION_ALG] = enc;
+
+	// Wrap-around
+	r_goose_publisher_set_spdu_number(pub, 0xFFFFFFFE);
+	for(uint32_t expected = 0xFFFFFFFE; expected != 2; expected++){
+		r_goose_publisher_sign(pub, apdu, &message);
+		CHECK(decode_4bytesToInt(message, INDEX_SPDU_NUMBER) == (int)expected, "SPDU Number %u", expected);
+	}
+
+	// Errors don't consume SPDU Numbers
+	CHECK(r_goose_publisher_sign(pub, 2001, &message) == -1, "APDU above max_payload");
+	r_goose_publisher_set_key(pub, 2);
+	CHECK(r_goose_publisher_sign(pub, apdu, &message) == -1, "unknown key");
+	r_goose_publisher_set_key(pub, 3);
+	CHECK(r_goose_publisher_sign(pub, apdu, &message) == -1, "encryption key");
+	r_goose_publisher_set_key(pub, 1);
+	CHECK(pub->spdu_number == 2, "SPDU Number incremented on error");
+
+	// Shorter and longer APDU (the length fields follow)
+	uint8_t* payload = r_goose_publisher_payload(pub);
+	for(size_t size = 10; size <= 2000; size = size * 3 + 1){
+		memset(payload, (int)size, size);
+		int n = r_goose_publisher_sign(pub, size, &message);
+		CHECK(n == (int)(INDEX_PAYLOAD + size + 2 + MAC_SIZES[HMAC_SHA256_80]), "size %d for an APDU of %zu bytes", n, size);
+		CHECK(r_gooseMessage_Prefilter(message, n) == 0, "pre-filter for an APDU of %zu bytes", size);
+		CHECK(message[INDEX_ENCRYPTION_ALG] == ENC_NONE, "Encryption Algorithm %d", message[INDEX_ENCRYPTION_ALG]);
+		CHECK(r_gooseMessage_ValidateKeyring(message, message_size(message), ring, reader) == 1, "validation for an APDU of %zu bytes", size);
+	}
+
+	// Key rotation - Key ID 2 with another algorithm, then back to the template APDU
+	r_goose_keyring_publish(ring, appid, 2, GMAC_AES128_128, ENC_NONE, key, 16, 2000, 60);
+	r_goose_publisher_set_key(pub, 2);
+	memcpy(payload, &packet[INDEX_PAYLOAD], apdu);
+	int n = r_goose_publisher_sign(pub, apdu, &message);
+	CHECK(n == len + MAC_SIZES[GMAC_AES128_128], "size after key rotation");
+	CHECK(decode_4bytesToInt(message, INDEX_KEYID) == 2 && message[INDEX_MAC_ALG] == GMAC_AES128_128 &&
+		  (uint32_t)decode_4bytesToInt(message, INDEX_TIMECURKEY) == 2000, "Security Information after key rotation");
+	CHECK(r_gooseMessage_ValidateKeyring(message, message_size(message), ring, reader) == 1, "validation after key rotation");
+
+	r_goose_publisher_free(pub);
+	r_goose_keyring_retire(ring, appid, 1);
+	r_goose_keyring_retire(ring, appid, 2);
+	r_goose_keyring_retire(ring, appid, 3);
+	r_goose_keyring_reclaim(ring);
+}
+
+
+static void timing(uint8_t* packet, long len, char* name){
+	uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+	struct timespec start, end;
+	uint64_t insert_ns, sign_ns;
+	uint8_t* message;
+
+	r_goose_keyring_publish(ring, appid, 1, HMAC_SHA256_80, ENC_NONE, key, 32, 1000, 60);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(uint32_t i = 0; i < ITERATIONS; i++){
+		encodeInt4Bytes(packet, i, INDEX_SPDU_NUMBER);
+		r_gooseMessage_InsertKeyring(packet, ring, reader, 1, &message);
+		free(message);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	insert_ns = timespecDiff(&end, &start);
+
+	r_goose_publisher* pub = r_goose_publisher_new(packet, ring, reader, 1, 0);
+	size_t apdu = len - INDEX_PAYLOAD - 2;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(uint32_t i = 0; i < ITERATIONS; i++){
+		r_goose_publisher_sign(pub, apdu, &message);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	sign_ns = timespecDiff(&end, &start);
+
+	printf("%-8s (%4ld bytes)   InsertKeyring %7.1f ns/msg   publisher %7.1f ns/msg\n", name, len,
+		(double)insert_ns / ITERATIONS, (double)sign_ns / ITERATIONS);
+
+	r_goose_publisher_free(pub);
+	r_goose_keyring_retire(ring, appid, 1);
+	r_goose_keyring_reclaim(ring);
+}
+
+
+int main(int argc, char** argv){
+
+	char keyHex[] = "219bcef0cd0f89a5e1297b99d956150f3128459f65312fdd71618f1177393e3f";
+	key = hexStringToBytes(keyHex, 64);
+
+	ring = r_goose_keyring_new(16);
+	reader = r_goose_keyring_reader_register(ring);
+
+	char* names[] = {"small", "medium", "large"};
+
+	for(int f = 0; f < 3; f++){
+		long len;
+		uint8_t* packet = read_packet(files[f], &len);
+
+		equivalence(packet, len);
+		numbering(packet, len);
+		timing(packet, len, names[f]);
+
+		free(packet);
+	}
+
+	r_goose_keyring_free(ring);
+	free(key);
+
+	printf("\n%s\n", failures == 0 ? "All publisher tests passed" : "Publisher tests FAILED");
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,268 @@
+/*
+	Test file:
+
+		Replay window / SPDU Number tracking - r_goose_session_*() and r_gooseMessage_ValidateSession()
+
+		1. Window semantics: new stream, in-order, reordered (inside the window), replayed, stale
+		   (below the window), large jumps and SPDU Number wrap-around.
+		2. Bounded table: streams beyond max_streams rejected, r_goose_session_expire() frees them.
+		3. ValidateSession: replays rejected with R_GOOSE_REPLAY before the MAC Tag verification,
+		   forged packets (invalid MAC Tag) don't move the window.
+		4. STREAMS concurrent streams: check + accept latency over random streams, memory used, and
+		   cost of rejecting a replay vs validating the MAC Tag.
+
+*/
+
+#include "r_goose_security.h"
+#include "r_goose_keyring.h"
+#include "r_goose_session.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <time.h>
+
+#define STREAMS			100000
+#define PACKETS			10000000
+#define ITERATIONS		100000
+
+int64_t timespecDiff(struct timespec *timeA_p, struct timespec *timeB_p)
+{
+  return ((timeA_p->tv_sec * 1000000000) + timeA_p->tv_nsec) -
+           ((timeB_p->tv_sec * 1000000000) + timeB_p->tv_nsec);
+}
+
+uint8_t* read_packet(char* filename, long* filelen){
+	FILE *fp;
+	unsigned char *buffer;
+
+	fp = fopen(filename, "rb");
+	fseek(fp, 0, SEEK_END);
+	*filelen = ftell(fp);
+	rewind(fp);
+
+	buffer = (unsigned char*) malloc((*filelen)*sizeof(char));
+	fread(buffer, *filelen, 1, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...)	do{ if(!(cond)){ failures++; printf("FAILED: " __VA_ARGS__); printf("\n"); } }while(0)
+
+// Number of bytes "received" for a well formed message
+static size_t message_size(const uint8_t* m){
+	return (size_t)decode_4bytesToInt((uint8_t*)m, INDEX_SPDU_LENGTH) + 10;
+}
+
+// check + accept, as done by the receiver for authenticated packets
+static int receive(r_goose_session_table* t, uint32_t source, uint16_t appid, uint32_t n){
+	int res = r_goose_session_check(t, source, appid, n);
+	if(res == 1){
+		res = r_goose_session_accept(t, source, appid, n, 0);
+	}
+	return res;
+}
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t rng(void){
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+
+static void window_semantics(void){
+	r_goose_session_table* t = r_goose_session_table_new(16);
+	r_goose_session_stats stats;
+
+	CHECK(receive(t, 1, 10, 100) == 1, "new stream");
+	CHECK(receive(t, 1, 10, 100) == 0, "replay of the first packet");
+	CHECK(receive(t, 1, 10, 101) == 1, "in order");
+	CHECK(receive(t, 1, 10, 110) == 1, "gap");
+	CHECK(receive(t, 1, 10, 105) == 1, "reordered inside the window");
+	CHECK(receive(t, 1, 10, 105) == 0, "replay of a reordered packet");
+	CHECK(receive(t, 1, 10, 110 - R_GOOSE_REPLAY_WINDOW + 1) == 1, "oldest position of the window");
+	CHECK(receive(t, 1, 10, 110 - R_GOOSE_REPLAY_WINDOW) == 0, "stale (below the window)");
+	CHECK(receive(t, 1, 10, 1000) == 1, "jump larger than the window");
+	CHECK(receive(t, 1, 10, 999) == 1, "window reset after the jump");
+	CHECK(receive(t, 1, 10, 110) == 0, "stale after the jump");
+
+	// Other streams are independent - same APPID from another source, other APPID from the same source
+	CHECK(receive(t, 2, 10, 100) == 1, "same APPID, other source");
+	CHECK(receive(t, 1, 11, 100) == 1, "same source, other APPID");
+
+	// Wrap-around
+	CHECK(receive(t, 3, 10, 0xFFFFFFF0u) == 1, "before wrap");
+	CHECK(receive(t, 3, 10, 0x00000005u) == 1, "after wrap");
+	CHECK(receive(t, 3, 10, 0xFFFFFFFFu) == 1, "reordered across the wrap");
+	CHECK(receive(t, 3, 10, 0xFFFFFFF0u) == 0, "replay across the wrap");
+	CHECK(receive(t, 3, 10, 0x80000004u) == 1, "half the sequence space ahead");
+	CHECK(receive(t, 3, 10, 0x00000006u) == 0, "half the sequence space behind is stale");
+
+	// accept() alone refuses what check() refuses
+	CHECK(r_goose_session_accept(t, 1, 10, 1000, 0) == 0, "accept of a replay");
+
+	r_goose_session_get_stats(t, &stats);
+	printf("Window semantics: accepted %llu, replayed %llu, stale %llu, streams %llu\n",
+		(unsigned long long)stats.accepted, (unsigned long long)stats.replayed,
+		(unsigned long long)stats.stale, (unsigned long long)stats.new_streams);
+	CHECK(stats.replayed == 3 && stats.stale == 3 && stats.new_streams == 4, "counters");
+
+	r_goose_session_table_free(t);
+}
+
+
+static void bounded_table(void){
+	r_goose_session_table* t = r_goose_session_table_new(4);
+	r_goose_session_stats stats;
+
+	for(int i = 0; i < 4; i++){
+		CHECK(r_goose_session_accept(t, 0, i, 1, 10 * i) == 1, "stream %d", i);
+	}
+	CHECK(receive(t, 0, 4, 1) == -1, "fifth stream accepted by a full table");
+	CHECK(r_goose_session_check(t, 0, 3, 2) == 1, "known stream rejected by a full table");
+
+	// Streams 0 and 1 idle since 0 and 10
+	CHECK(r_goose_session_expire(t, 30, 15) == 2, "expire");
+	CHECK(receive(t, 0, 4, 1) == 1, "new stream after expire");
+	CHECK(receive(t, 0, 0, 1) == 1, "expired stream starts over");
+	CHECK(receive(t, 0, 2, 1) == 0, "remaining stream lost its window");
+
+	CHECK(r_goose_session_get_stats(t, &stats) == 4, "stream count");
+	CHECK(stats.table_full == 1 && stats.expired_streams == 2, "counters");
+
+	r_goose_session_table_free(t);
+}
+
+
+static void validate_session(uint8_t* packet, uint8_t* key){
+	r_goose_keyring* ring = r_goose_keyring_new(16);
+	int reader = r_goose_keyring_reader_register(ring);
+	r_goose_session_table* t = r_goose_session_table_new(16);
+	uint16_t appid = decode_2bytesToInt(packet, INDEX_APPID);
+	uint8_t* signed1 = NULL;
+	uint8_t* signed2 = NULL;
+
+	r_goose_keyring_publish(ring, appid, 1, HMAC_SHA256_80, ENC_NONE, key, 32, 100, 60);
+
+	encodeInt4Bytes(packet, 1, INDEX_SPDU_NUMBER);
+	r_gooseMessage_InsertKeyring(packet, ring, reader, 1, &signed1);
+	encodeInt4Bytes(packet, 2, INDEX_SPDU_NUMBER);
+	r_gooseMessage_InsertKeyring(packet, ring, reader, 1, &signed2);
+
+	CHECK(r_gooseMessage_ValidateSession(signed1, message_size(signed1), t, 7, ring, reader, 0) == 1, "first packet");
+	CHECK(r_gooseMessage_ValidateSession(signed1, message_size(signed1), t, 7, ring, reader, 0) == R_GOOSE_REPLAY, "replay");
+	CHECK(r_gooseMessage_ValidateSession(signed1, message_size(signed1), t, 8, ring, reader, 0) == 1, "same packet from another source");
+
+	// Forged packet claiming SPDU Number 2 - rejected by the MAC Tag, window unchanged
+	signed2[INDEX_PAYLOAD + 4] ^= 0x01;
+	CHECK(r_gooseMessage_ValidateSession(signed2, message_size(signed2), t, 7, ring, reader, 0) == 0, "forged packet");
+	signed2[INDEX_PAYLOAD + 4] ^= 0x01;
+	CHECK(r_gooseMessage_ValidateSession(signed2, message_size(signed2), t, 7, ring, reader, 0) == 1, "genuine packet after a forged one");
+	CHECK(r_gooseMessage_ValidateSession(signed2, message_size(signed2), t, 7, ring, reader, 0) == R_GOOSE_REPLAY, "replay of the genuine packet");
+
+	// Timing: replay rejection vs MAC Tag verification
+	struct timespec start, end;
+	volatile int res = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < ITERATIONS; i++){
+		res += r_gooseMessage_ValidateSession(signed2, message_size(signed2), t, 7, ring, reader, 0);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double replay = (double)timespecDiff(&end, &start) / ITERATIONS;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < ITERATIONS; i++){
+		res += r_gooseMessage_ValidateKeyring(signed2, message_size(signed2), ring, reader);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double mac = (double)timespecDiff(&end, &start) / ITERATIONS;
+
+	CHECK(res == ITERATIONS * (R_GOOSE_REPLAY + 1), "timed validations");
+	printf("Replay rejected in %.1f ns, MAC Tag verification (keyring, HMAC_SHA256_80) %.1f ns\n", replay, mac);
+
+	free(signed1);
+	free(signed2);
+	r_goose_session_table_free(t);
+	r_goose_keyring_free(ring);
+}
+
+
+static void many_streams(void){
+	r_goose_session_table* t = r_goose_session_table_new(STREAMS);
+	uint32_t* next = (uint32_t*)calloc(STREAMS, sizeof(uint32_t));
+	uint32_t* order = (uint32_t*)malloc(PACKETS * sizeof(uint32_t));
+	struct timespec start, end;
+	long errors = 0;
+
+	// Streams: source = 10.0.x.y, APPID 0..999
+	for(int i = 0; i < STREAMS; i++){
+		next[i] = (uint32_t)rng();
+		errors += receive(t, 0x0A000000u + i / 1000, i % 1000, next[i]++) != 1;
+	}
+	for(int i = 0; i < PACKETS; i++){
+		order[i] = (uint32_t)(rng() % STREAMS);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int p = 0; p < PACKETS; p++){
+		uint32_t i = order[p];
+		errors += receive(t, 0x0A000000u + i / 1000, i % 1000, next[i]++) != 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double fresh = (double)timespecDiff(&end, &start) / PACKETS;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int p = 0; p < PACKETS; p++){
+		uint32_t i = order[p];
+		errors += r_goose_session_check(t, 0x0A000000u + i / 1000, i % 1000, next[i] - 1) != 0;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double replay = (double)timespecDiff(&end, &start) / PACKETS;
+
+	r_goose_session_stats stats;
+	size_t streams = r_goose_session_get_stats(t, &stats);
+
+	printf("%zu streams, %zu entries (%.1f MB): fresh packet %.1f ns, replay %.1f ns\n", streams, t->capacity,
+		t->capacity * sizeof(r_goose_session) / 1048576.0, fresh, replay);
+	CHECK(errors == 0, "%ld unexpected results over %d streams", errors, STREAMS);
+	CHECK(streams == STREAMS, "stream count %zu", streams);
+
+	// Every stream idle - all removed, table reusable
+	CHECK(r_goose_session_expire(t, 100, 50) == STREAMS, "expire all streams");
+	CHECK(receive(t, 0x0A000000u, 0, next[0] - 1) == 1, "stream starts over after expire");
+
+	free(order);
+	free(next);
+	r_goose_session_table_free(t);
+}
+
+
+int main(int argc, char** argv){
+
+	char keyHex[] = "219bcef0cd0f89a5e1297b99d956150f3128459f65312fdd71618f1177393e3f";
+	uint8_t* key = hexStringToBytes(keyHex, 64);
+
+	long len;
+	uint8_t* packet = read_packet("../resources/valid_small.pkt", &len);
+
+	window_semantics();
+	bounded_table();
+	validate_session(packet, key);
+	many_streams();
+
+	free(packet);
+	free(key);
+
+	printf("\n%s\n", failures == 0 ? "All replay window tests passed" : "Replay window tests FAILED");
+
+	return failures == 0 ? 0 : 1;
+}